@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_CACHEDPROPERTIES_H
+#define HELIUM_CACHEDPROPERTIES_H
+
+#include <Helium/hemol.h>
+#include <Helium/algorithms/cycles.h>
+#include <Helium/algorithms/extendedconnectivities.h>
+
+namespace Helium {
+
+  /**
+   * @file algorithms/cachedproperties.h
+   * @brief Derived molecule properties cached on a HeMol.
+   *
+   * Pipelines that compute the same derived properties (e.g. fingerprinting
+   * and then matching the same molecule) can use these functions to compute
+   * them only once. The values are stored in the molecule (see
+   * HeMol::cache()) and recomputed after the molecule is changed. The
+   * returned references are valid until the molecule is changed. These
+   * functions can not be called concurrently for the same molecule.
+   */
+
+  namespace impl {
+
+    inline void cache_cycle_membership(HeMol &mol)
+    {
+      HeMolCache &cache = mol.cache();
+      if (cache.isValid(HeMolCache::CycleMembership))
+        return;
+      cycle_membership(mol, cache.cyclicAtoms, cache.cyclicBonds);
+      cache.validate(HeMolCache::CycleMembership);
+    }
+
+  }
+
+  /**
+   * Get the cyclic atoms (see cycle_membership()).
+   *
+   * @return The ring membership indexed by atom index.
+   */
+  inline const std::vector<bool>& cached_cyclic_atoms(HeMol &mol)
+  {
+    impl::cache_cycle_membership(mol);
+    return mol.cache().cyclicAtoms;
+  }
+
+  /**
+   * Get the cyclic bonds (see cycle_membership()).
+   *
+   * @return The ring membership indexed by bond index.
+   */
+  inline const std::vector<bool>& cached_cyclic_bonds(HeMol &mol)
+  {
+    impl::cache_cycle_membership(mol);
+    return mol.cache().cyclicBonds;
+  }
+
+  /**
+   * Get the extended connectivities (see extended_connectivities()). The
+   * values are renumbered to [0,n-1] and can be used as the symmetry classes
+   * for canonicalize().
+   *
+   * @return The EC values indexed by atom index.
+   */
+  inline const std::vector<unsigned long>& cached_extended_connectivities(HeMol &mol)
+  {
+    impl::HeMolCache &cache = mol.cache();
+    if (!cache.isValid(impl::HeMolCache::ExtendedConnectivities)) {
+      cache.ec = extended_connectivities(mol);
+      cache.validate(impl::HeMolCache::ExtendedConnectivities);
+    }
+    return cache.ec;
+  }
+
+  /**
+   * Get the number of symmetry classes (i.e. unique extended connectivities
+   * values).
+   */
+  inline unsigned int cached_num_symmetry_classes(HeMol &mol)
+  {
+    const std::vector<unsigned long> &ec = cached_extended_connectivities(mol);
+    return ec.empty() ? 0 : *std::max_element(ec.begin(), ec.end()) + 1;
+  }
+
+}
+
+#endif
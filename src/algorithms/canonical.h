@@ -29,7 +29,11 @@
 
 #include <Helium/substructure.h>
 #include <Helium/algorithms/invariants.h>
+#include <Helium/algorithms/extendedconnectivities.h>
 #include <Helium/util.h>
+#include <Helium/util/arena.h>
+
+#include <algorithm>
 
 #define DEBUG_CANON 0
 
@@ -60,6 +64,24 @@ namespace Helium {
       Index target; // canonical target index
     };
 
+    /**
+     * Compare canonical codes, shorter codes are smaller (the same order as
+     * operator< in util/vector.h).
+     */
+    template<typename CodeType1, typename CodeType2>
+    bool canonical_code_less(const CodeType1 &code1, const CodeType2 &code2)
+    {
+      if (code1.size() != code2.size())
+        return code1.size() < code2.size();
+      return std::lexicographical_compare(code1.begin(), code1.end(), code2.begin(), code2.end());
+    }
+
+    /**
+     * All buffers are allocated from the arena, each recursive call releases
+     * its temporary buffers using an Arena::Scope. The buffers that outlive
+     * these scopes are reserved in the constructor so they never grow inside
+     * one.
+     */
     template<typename MoleculeType>
     class Canonicalize
     {
@@ -68,10 +90,28 @@ namespace Helium {
         typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
         typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
 
+        typedef std::pair<bond_type, atom_type> StackEntry;
+        typedef typename ArenaVector<StackEntry>::type Stack;
+        typedef typename ArenaVector<Index>::type IndexVector;
+        typedef typename ArenaVector<unsigned long>::type Code;
+
       public:
-        Canonicalize(MoleculeType &mol, const std::vector<unsigned long> &symmetry)
-            : m_mol(mol), m_symmetry(symmetry), m_visited(num_bonds(mol))
+        Canonicalize(MoleculeType &mol, const std::vector<unsigned long> &symmetry, Arena &arena)
+            : m_mol(mol), m_symmetry(symmetry), m_arena(arena), m_stack(ArenaAllocator<StackEntry>(arena)),
+              m_atoms(ArenaAllocator<Index>(arena)), m_bonds(ArenaAllocator<Index>(arena)),
+              m_from(ArenaAllocator<Index>(arena)), m_visited(num_bonds(mol), false, ArenaAllocator<bool>(arena)),
+              m_labels(ArenaAllocator<Index>(arena)), m_code(ArenaAllocator<unsigned long>(arena))
         {
+          // each atom on the path to the current atom pushes at most its
+          // degree bonds and the stack is empty again when a non-leaf call
+          // returns
+          m_stack.reserve(2 * num_bonds(mol) + 1);
+          m_atoms.reserve(num_atoms(mol));
+          m_bonds.reserve(num_bonds(mol));
+          m_from.reserve(num_atoms(mol));
+          m_labels.reserve(num_atoms(mol));
+          // FROM atoms, closures, atom and bond attributes
+          m_code.reserve(2 * num_atoms(mol) + 3 * num_bonds(mol));
         }
 
         void canonicalize()
@@ -88,17 +128,17 @@ namespace Helium {
             assert(m_from.empty());
             assert(std::find(m_visited.begin(), m_visited.end(), true) == m_visited.end());
 
-            std::vector<std::pair<bond_type, atom_type> > stack(1, std::make_pair(molecule_traits<MoleculeType>::null_bond(), *atom));
-            next(stack);
+            m_stack.assign(1, std::make_pair(molecule_traits<MoleculeType>::null_bond(), *atom));
+            next(m_stack);
           }
         }
 
-        const std::vector<Index>& labels() const
+        const IndexVector& labels() const
         {
           return m_labels;
         }
 
-        const std::vector<unsigned long>& code() const
+        const Code& code() const
         {
           return m_code;
         }
@@ -106,7 +146,9 @@ namespace Helium {
       private:
         void createCode()
         {
-          std::vector<unsigned long> code;
+          Arena::Scope scope(m_arena);
+          Code code((ArenaAllocator<unsigned long>(m_arena)));
+          code.reserve(m_code.capacity());
           //
           // encode graph
           //
@@ -119,7 +161,7 @@ namespace Helium {
           for (std::size_t i = 0; i < m_atoms.size(); ++i) {
             atom_type atom = get_atom(m_mol, m_atoms[i]);
             // still need to sort [1 3] and [1 4]
-            std::vector<Closure> closures; // [(bond index, other atom index)]
+            std::vector<Closure, ArenaAllocator<Closure> > closures((ArenaAllocator<Closure>(m_arena))); // [(bond index, other atom index)]
 
             incident_iter bond, end_bonds;
             TIE(bond, end_bonds) = get_bonds(m_mol, atom);
@@ -172,13 +214,13 @@ namespace Helium {
           if (DEBUG_CANON)
             std::cout << "code: " << code << std::endl;
 
-          if (m_code.empty() || code < m_code) {
+          if (m_code.empty() || canonical_code_less(code, m_code)) {
             m_labels = m_atoms;
             m_code = code;
           }
         }
 
-        void next(std::vector<std::pair<bond_type, atom_type> > &stack)
+        void next(Stack &stack)
         {
           if (DEBUG_CANON)
             std::cout << "stack: " << stack << std::endl;
@@ -219,8 +261,9 @@ namespace Helium {
             createCode();
           } else {
 
-            std::vector<std::pair<bond_type, atom_type> > stackCopy(stack);
-            std::vector<std::pair<bond_type, atom_type> > bonds;
+            Arena::Scope scope(m_arena);
+            Stack stackCopy(stack);
+            Stack bonds((ArenaAllocator<StackEntry>(m_arena)));
 
 
             // append unvisited bonds around atom to stack
@@ -242,6 +285,7 @@ namespace Helium {
             // recursive call for each permutation of the new bonds
             bool last = false;
             do {
+              assert(stackCopy.size() + bonds.size() <= stack.capacity());
               stack = stackCopy;
               std::copy(bonds.begin(), bonds.end(), std::back_inserter(stack));
               next(stack);
@@ -267,32 +311,36 @@ namespace Helium {
 
         MoleculeType &m_mol;
         const std::vector<unsigned long> &m_symmetry;
-        std::vector<Index> m_atoms; // canonical atom order
-        std::vector<Index> m_bonds; // canonical bond order
-        std::vector<Index> m_from; // from atoms
-        std::vector<bool> m_visited; // visited bonds
-
-        std::vector<Index> m_labels; // currently lowest canonical labels
-        std::vector<unsigned long> m_code; // currently lowest canonical code
+        Arena &m_arena; // the arena for all buffers
+        Stack m_stack; // the DFS stack
+        IndexVector m_atoms; // canonical atom order
+        IndexVector m_bonds; // canonical bond order
+        IndexVector m_from; // from atoms
+        std::vector<bool, ArenaAllocator<bool> > m_visited; // visited bonds
+
+        IndexVector m_labels; // currently lowest canonical labels
+        Code m_code; // currently lowest canonical code
     };
 
   }
 
 
   /**
-   * Canonicalize a molecule. The canonicalization algorithm consists of two
-   * steps. In the first step, the atoms are partitioned using graph
-   * invariants (e.g. atom degree). This initial partitioning reduces the
-   * number of states that need to be visited to find the canonical code.
+   * Canonicalize a molecule using an arena for the temporary buffers (see
+   * canonicalize()). No memory is allocated once the arena and the result
+   * vectors are large enough, this makes canonicalizing many small
+   * molecules (e.g. fragments of a fingerprint) malloc free. The arena is
+   * left as it was.
    *
-   * In the second step all automorphic permutations of the graph are
-   * investigated and a code is generated for each one. The unique code is
-   * selected and the associated atom order is the canonical atom order.
-   *
-   * @return The canonical atom order and canonical code.
+   * @param mol The molecule.
+   * @param symmetry The symmetry classes of the atoms.
+   * @param labels Output: The canonical atom order.
+   * @param code Output: The canonical code.
+   * @param arena The arena.
    */
   template<typename MoleculeType, typename T>
-  std::pair<std::vector<Index>, std::vector<unsigned long> > canonicalize(MoleculeType &mol, const std::vector<T> &symmetry)
+  void canonicalize(MoleculeType &mol, const std::vector<T> &symmetry, std::vector<Index> &labels,
+      std::vector<unsigned long> &code, Arena &arena)
   {
     if (DEBUG_CANON) {
       std::cout << "+---------------------------+" << std::endl;
@@ -300,15 +348,118 @@ namespace Helium {
       std::cout << "+---------------------------+" << std::endl;
       std::cout << "symmetry: " << symmetry << std::endl;
     }
-    impl::Canonicalize<MoleculeType> can(mol, symmetry);
+    Arena::Scope scope(arena);
+    impl::Canonicalize<MoleculeType> can(mol, symmetry, arena);
     can.canonicalize();
+    labels.assign(can.labels().begin(), can.labels().end());
+    code.assign(can.code().begin(), can.code().end());
     if (DEBUG_CANON) {
-      std::cout << "labels: " << can.labels() << ", code: " << can.code() << std::endl;
+      std::cout << "labels: " << labels << ", code: " << code << std::endl;
       std::cout << "+---------------------------+" << std::endl;
       std::cout << "| START CAONICALIZATION     |" << std::endl;
       std::cout << "+---------------------------+" << std::endl;
     }
-    return std::make_pair(can.labels(), can.code());
+  }
+
+  /**
+   * Canonicalize a molecule. The canonicalization algorithm consists of two
+   * steps. In the first step, the atoms are partitioned using graph
+   * invariants (e.g. atom degree). This initial partitioning reduces the
+   * number of states that need to be visited to find the canonical code.
+   *
+   * In the second step all automorphic permutations of the graph are
+   * investigated and a code is generated for each one. The unique code is
+   * selected and the associated atom order is the canonical atom order.
+   *
+   * @return The canonical atom order and canonical code.
+   */
+  template<typename MoleculeType, typename T>
+  std::pair<std::vector<Index>, std::vector<unsigned long> > canonicalize(MoleculeType &mol, const std::vector<T> &symmetry)
+  {
+    std::pair<std::vector<Index>, std::vector<unsigned long> > result;
+    Arena arena;
+    canonicalize(mol, symmetry, result.first, result.second, arena);
+    return result;
+  }
+
+  /**
+   * Get a key that uniquely identifies a (connected) molecule. The key
+   * consists of the canonical code (see canonicalize()) followed by the
+   * element, mass, charge, number of hydrogens and aromaticity of the atoms
+   * and the order (see get_order()) and aromaticity of the bonds in
+   * canonical order. Since the canonical code does not contain all these
+   * attributes, two equal keys always mean the molecules are the same but
+   * the same molecule may in rare cases get different keys for different
+   * atom orders. This makes the key suitable for caching results.
+   *
+   * @param mol The molecule.
+   * @param symmetry The symmetry classes (e.g. extended_connectivities() or
+   *        cached_extended_connectivities()).
+   *
+   * @return The key or an empty vector if the molecule can not be
+   *         canonicalized (i.e. it is empty or has multiple components).
+   */
+  template<typename MoleculeType, typename T>
+  std::vector<unsigned long> canonical_key(MoleculeType &mol, const std::vector<T> &symmetry)
+  {
+    typedef typename molecule_traits<MoleculeType>::bond_iter bond_iter;
+
+    if (!num_atoms(mol))
+      return std::vector<unsigned long>();
+
+    std::pair<std::vector<Index>, std::vector<unsigned long> > canon = canonicalize(mol, symmetry);
+    const std::vector<Index> &labels = canon.first;
+    if (labels.size() != num_atoms(mol))
+      return std::vector<unsigned long>();
+
+    std::vector<unsigned long> key(canon.second);
+    key.push_back(num_atoms(mol));
+    key.push_back(num_bonds(mol));
+
+    // atom attributes in canonical order
+    std::vector<Index> order(num_atoms(mol));
+    for (std::size_t i = 0; i < labels.size(); ++i) {
+      order[labels[i]] = i;
+      typename molecule_traits<MoleculeType>::atom_type atom = get_atom(mol, labels[i]);
+      key.push_back(get_element(mol, atom));
+      key.push_back(get_mass(mol, atom));
+      key.push_back(get_charge(mol, atom) + 128);
+      key.push_back(num_hydrogens(mol, atom));
+      key.push_back(is_aromatic(mol, atom));
+    }
+
+    // bond attributes sorted by canonical atom indices
+    std::vector<std::vector<unsigned long> > bonds;
+    bond_iter bond, end_bonds;
+    TIE(bond, end_bonds) = get_bonds(mol);
+    for (; bond != end_bonds; ++bond) {
+      unsigned long source = order[get_index(mol, get_source(mol, *bond))];
+      unsigned long target = order[get_index(mol, get_target(mol, *bond))];
+      std::vector<unsigned long> b(4);
+      b[0] = std::min(source, target);
+      b[1] = std::max(source, target);
+      b[2] = get_order(mol, *bond);
+      b[3] = is_aromatic(mol, *bond);
+      bonds.push_back(b);
+    }
+    std::sort(bonds.begin(), bonds.end());
+    for (std::size_t i = 0; i < bonds.size(); ++i)
+      std::copy(bonds[i].begin(), bonds[i].end(), std::back_inserter(key));
+
+    return key;
+  }
+
+  /**
+   * Get a key that uniquely identifies a (connected) molecule using the
+   * extended_connectivities() as symmetry classes (see
+   * canonical_key(mol, symmetry)).
+   */
+  template<typename MoleculeType>
+  std::vector<unsigned long> canonical_key(MoleculeType &mol)
+  {
+    if (!num_atoms(mol))
+      return std::vector<unsigned long>();
+    return canonical_key(mol, extended_connectivities(mol));
   }
 
 }
@@ -30,36 +30,74 @@
 #include <Helium/molecule.h>
 #include <Helium/tie.h>
 #include <Helium/util.h>
+#include <Helium/algorithms/dfs.h>
 
 #include <vector>
 
 namespace Helium {
 
-  namespace impl {
-
-    /**
-     * Find all bond belonging to the same component using a recursive DFS search.
-     */
-    template<typename MoleculeType>
-    void connected_bond_components(MoleculeType &mol, typename molecule_traits<MoleculeType>::atom_type atom,
-        unsigned int number, std::vector<unsigned int> &components)
-    {
-      typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
-
-      // iterator over atom's bonds
-      incident_iter bond, end_bonds;
-      TIE(bond, end_bonds) = get_bonds(mol, atom);
-      for (; bond != end_bonds; ++bond) {
-        // skip already visited bonds
-        if (components[get_index(mol, *bond)] != molecule_traits<MoleculeType>::null_index())
-          continue;
-        // assign component to bond
-        components[get_index(mol, *bond)] = number;
-        // recursive call
-        connected_bond_components(mol, get_other(mol, *bond, atom), number, components);
+  /**
+   * Get the component number for each bond. The @p components vector is
+   * indexed by bond index starting from 0. The components are sequentially
+   * numbered starting from 0. The search is iterative and uses the buffers
+   * in @p workspace, the @p components vector is reused as well.
+   *
+   * @note Complexity: O(n)
+   *
+   * @param mol The molecule.
+   * @param components The output component number for each bond.
+   * @param workspace The buffers to reuse.
+   *
+   * @return The number of bond components.
+   */
+  template<typename MoleculeType>
+  unsigned int connected_bond_components(MoleculeType &mol, std::vector<unsigned int> &components,
+      TraversalWorkspace<MoleculeType> &workspace)
+  {
+    typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
+    typedef typename molecule_traits<MoleculeType>::bond_iter bond_iter;
+    typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
+
+    unsigned int number = 0;
+    components.assign(num_bonds(mol), molecule_traits<MoleculeType>::null_index());
+    workspace.reset(num_atoms(mol), 0);
+
+    // start searching from each (non-visited) bond
+    bond_iter bond, end_bonds;
+    TIE(bond, end_bonds) = get_bonds(mol);
+    for (; bond != end_bonds; ++bond) {
+      if (components[get_index(mol, *bond)] != molecule_traits<MoleculeType>::null_index())
+        continue;
+
+      // find all bonds belonging to the same component
+      Index source = get_index(mol, get_source(mol, *bond));
+      workspace.visitAtom(source);
+      workspace.atoms.push_back(source);
+      while (!workspace.atoms.empty()) {
+        atom_type atom = get_atom(mol, workspace.atoms.back());
+        workspace.atoms.pop_back();
+
+        incident_iter nbr, end_nbrs;
+        TIE(nbr, end_nbrs) = get_bonds(mol, atom);
+        for (; nbr != end_nbrs; ++nbr) {
+          // skip already visited bonds
+          if (components[get_index(mol, *nbr)] != molecule_traits<MoleculeType>::null_index())
+            continue;
+          // assign component to bond
+          components[get_index(mol, *nbr)] = number;
+
+          Index other = get_index(mol, get_other(mol, *nbr, atom));
+          if (!workspace.isAtomVisited(other)) {
+            workspace.visitAtom(other);
+            workspace.atoms.push_back(other);
+          }
+        }
       }
+
+      ++number;
     }
 
+    return number;
   }
 
   /**
@@ -75,23 +113,52 @@ namespace Helium {
    */
   template<typename MoleculeType>
   std::vector<unsigned int> connected_bond_components(MoleculeType &mol)
+  {
+    TraversalWorkspace<MoleculeType> workspace;
+    std::vector<unsigned int> components;
+    connected_bond_components(mol, components, workspace);
+    return components;
+  }
+
+  /**
+   * Get the component number for each atom. The @p components vector is
+   * indexed by atom index starting from 0. The components are sequentially
+   * numbered starting from 0, isolated atoms are numbered after the
+   * components containing bonds.
+   *
+   * @note Complexity: O(n)
+   *
+   * @param mol The molecule.
+   * @param components The output component number for each atom.
+   * @param workspace The buffers to reuse.
+   *
+   * @return The number of components.
+   */
+  template<typename MoleculeType>
+  unsigned int connected_atom_components(MoleculeType &mol, std::vector<unsigned int> &components,
+      TraversalWorkspace<MoleculeType> &workspace)
   {
     typedef typename molecule_traits<MoleculeType>::bond_iter bond_iter;
 
-    unsigned int number = 0;
-    std::vector<unsigned int> components(num_bonds(mol), molecule_traits<MoleculeType>::null_index());
+    // convert bond components to atom components
+    std::vector<unsigned int> &bondComponents = workspace.components;
+    unsigned int number = connected_bond_components(mol, bondComponents, workspace);
 
-    // start searching from each (non-visited) bond
+    components.assign(num_atoms(mol), molecule_traits<MoleculeType>::null_index());
     bond_iter bond, end_bonds;
     TIE(bond, end_bonds) = get_bonds(mol);
     for (; bond != end_bonds; ++bond) {
-      if (components[get_index(mol, *bond)] != molecule_traits<MoleculeType>::null_index())
-        continue;
-      // initiate recursion for each component
-      impl::connected_bond_components(mol, get_source(mol, *bond), number++, components);
+      unsigned int component = bondComponents[get_index(mol, *bond)];
+      components[get_index(mol, get_source(mol, *bond))] = component;
+      components[get_index(mol, get_target(mol, *bond))] = component;
     }
 
-    return components;
+    // handle isolated atoms
+    for (std::size_t i = 0; i < components.size(); ++i)
+      if (components[i] == molecule_traits<MoleculeType>::null_index())
+        components[i] = number++;
+
+    return number;
   }
 
   /**
@@ -108,30 +175,27 @@ namespace Helium {
   template<typename MoleculeType>
   std::vector<unsigned int> connected_atom_components(MoleculeType &mol)
   {
-    typedef typename molecule_traits<MoleculeType>::bond_iter bond_iter;
-    typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
-
-    std::vector<unsigned int> atom_components(num_atoms(mol), molecule_traits<MoleculeType>::null_index());
-
-    // convert bond components to atom components
-    std::vector<unsigned int> bond_components(connected_bond_components(mol));
-    bond_iter bond, end_bonds;
-    TIE(bond, end_bonds) = get_bonds(mol);
-    for (; bond != end_bonds; ++bond) {
-      unsigned int number = bond_components[get_index(mol, *bond)];
-      atom_components[get_index(mol, get_source(mol, *bond))] = number;
-      atom_components[get_index(mol, get_target(mol, *bond))] = number;
-    }
+    TraversalWorkspace<MoleculeType> workspace;
+    std::vector<unsigned int> components;
+    connected_atom_components(mol, components, workspace);
+    return components;
+  }
 
-    // handle isolated atoms
-    unsigned int number = unique_elements(atom_components);
-    atom_iter atom, end_atoms;
-    TIE(atom, end_atoms) = get_atoms(mol);
-    for (; atom != end_atoms; ++atom)
-      if (atom_components[get_index(mol, *atom)] == molecule_traits<MoleculeType>::null_index())
-        atom_components[get_index(mol, *atom)] = number++;
-
-    return atom_components;
+  /**
+   * Get the number of connected components in a molecule. Only components
+   * containing bonds are counted.
+   *
+   * @note Complexity: O(n)
+   *
+   * @param mol The molecule.
+   * @param workspace The buffers to reuse.
+   *
+   * @return The number of connected components.
+   */
+  template<typename MoleculeType>
+  Size num_connected_components(MoleculeType &mol, TraversalWorkspace<MoleculeType> &workspace)
+  {
+    return connected_bond_components(mol, workspace.components, workspace);
   }
 
   /**
@@ -146,7 +210,8 @@ namespace Helium {
   template<typename MoleculeType>
   Size num_connected_components(MoleculeType &mol)
   {
-    return unique_elements(connected_bond_components(mol));
+    TraversalWorkspace<MoleculeType> workspace;
+    return num_connected_components(mol, workspace);
   }
 
 }
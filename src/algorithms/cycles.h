@@ -28,9 +28,10 @@
 #define HELIUM_CYCLES_H
 
 #include <Helium/algorithms/components.h>
-#include <Helium/algorithms/isomorphism.h>
-#include <Helium/smiles.h>
-#include <Helium/algorithms/dfs.h>
+#include <Helium/bitvec.h>
+
+#include <algorithm>
+#include <vector>
 
 namespace Helium {
 
@@ -46,138 +47,550 @@ namespace Helium {
     return cyclomatic_number(mol, num_connected_components(mol));
   }
 
+  /**
+   * @brief Reusable buffers for cycle_membership().
+   *
+   * Passing the same scratch object to many cycle_membership() calls avoids
+   * allocating memory once the buffers are large enough.
+   */
+  struct CycleMembershipScratch
+  {
+    std::vector<unsigned int> offsets; //!< The offsets of the atoms in incident (flat adjacency)
+    std::vector<std::pair<unsigned int, unsigned int> > incident; //!< The (bond, neighbor) pairs of all atoms
+    std::vector<unsigned int> order; //!< The DFS discovery order (0 for unvisited atoms)
+    std::vector<unsigned int> low; //!< The lowest discovery order reachable from the atom's DFS subtree
+    std::vector<std::pair<unsigned int, unsigned int> > stack; //!< The DFS stack of (atom, next incident position)
+    std::vector<unsigned int> parentBond; //!< The DFS tree bond to the parent of each atom
+  };
+
   namespace impl {
-  
+
+    /**
+     * Copy the adjacency of @p mol to flat (bond index, neighbor index)
+     * arrays.
+     */
     template<typename MoleculeType>
-    struct CycleMembershipVisitor : public DFSVisitor<MoleculeType>
+    void cycles_adjacency(MoleculeType &mol, std::vector<unsigned int> &offsets,
+        std::vector<std::pair<unsigned int, unsigned int> > &incident)
     {
-      typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
-      typedef typename molecule_traits<MoleculeType>::bond_type bond_type;
+      typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
+      typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
 
-      CycleMembershipVisitor(std::vector<bool> &cycle_atoms_,
-          std::vector<bool> &cycle_bonds_) : cycle_atoms(cycle_atoms_),
-          cycle_bonds(cycle_bonds_)
-      {
+      offsets.resize(num_atoms(mol) + 1);
+      incident.clear();
+      atom_iter atom, end_atoms;
+      TIE(atom, end_atoms) = get_atoms(mol);
+      for (; atom != end_atoms; ++atom) {
+        offsets[get_index(mol, *atom)] = incident.size();
+        incident_iter bond, end_bonds;
+        TIE(bond, end_bonds) = get_bonds(mol, *atom);
+        for (; bond != end_bonds; ++bond)
+          incident.push_back(std::make_pair(get_index(mol, *bond), get_index(mol, get_other(mol, *bond, *atom))));
       }
+      offsets[num_atoms(mol)] = incident.size();
+    }
 
-      void initialize(MoleculeType &mol)
-      {
-        path.reserve(num_atoms(mol));
-      }
+  }
 
-      void atom(MoleculeType &mol, atom_type prev, atom_type atom) 
-      {
-        path.push_back(get_index(mol, atom));
-      }
+  /**
+   * Find the atoms and bonds that are part of a cycle.
+   *
+   * A bond is cyclic if it is not a bridge (i.e. removing the bond does not
+   * increase the number of connected components) and an atom is cyclic if it
+   * has a cyclic bond. The bridges are found using an iterative depth-first
+   * search (Tarjan's lowlink values) in linear time using the buffers in
+   * @p scratch.
+   *
+   * @param mol The molecule.
+   * @param cycle_atoms The cyclic atoms indexed by atom index (output).
+   * @param cycle_bonds The cyclic bonds indexed by bond index (output).
+   * @param scratch The buffers to reuse.
+   */
+  template<typename MoleculeType>
+  void cycle_membership(MoleculeType &mol, std::vector<bool> &cycle_atoms, std::vector<bool> &cycle_bonds,
+      CycleMembershipScratch &scratch)
+  {
+    const unsigned int numAtoms = num_atoms(mol);
+    const unsigned int noBond = num_bonds(mol);
+    cycle_atoms.assign(numAtoms, false);
+    cycle_bonds.assign(num_bonds(mol), false);
 
-      void backtrack(MoleculeType &mol, atom_type atom)
-      {
-        path.pop_back();
-      }
+    impl::cycles_adjacency(mol, scratch.offsets, scratch.incident);
+    scratch.order.assign(numAtoms, 0);
+    scratch.low.resize(numAtoms);
+    scratch.parentBond.resize(numAtoms);
+
+    unsigned int counter = 0;
+    for (unsigned int root = 0; root < numAtoms; ++root) {
+      if (scratch.order[root])
+        continue;
+
+      scratch.order[root] = scratch.low[root] = ++counter;
+      scratch.parentBond[root] = noBond;
+      scratch.stack.assign(1, std::make_pair(root, scratch.offsets[root]));
 
-      void back_bond(MoleculeType &mol, bond_type bond)
-      {
-        // find the atom that ends the cycle
-        atom_type last_atom = get_other(mol, bond, get_atom(mol, path.back()));
-        cycle_atoms[get_index(mol, last_atom)] = true;
-        cycle_bonds[get_index(mol, bond)] = true;
-        // traceback the path to last_atom
-        for (std::size_t i = 0; i < path.size(); ++i) {
-          atom_type atom = get_atom(mol, path[path.size() - i - 1]);
-          // mark bond as cyclic
-          if (i)
-            cycle_bonds[get_index(mol, get_bond(mol, atom, get_atom(mol, path[path.size() - i])))] = true;
-          // stop when the atom closing the cycle is found
-          if (atom == last_atom)
-            break;
-          // mark vertex as cyclic
-          cycle_atoms[get_index(mol, atom)] = true;
+      while (!scratch.stack.empty()) {
+        unsigned int atom = scratch.stack.back().first;
+        unsigned int &next = scratch.stack.back().second;
+
+        if (next < scratch.offsets[atom + 1]) {
+          unsigned int bond = scratch.incident[next].first;
+          unsigned int nbr = scratch.incident[next].second;
+          ++next;
+          if (bond == scratch.parentBond[atom])
+            continue;
+          if (scratch.order[nbr]) {
+            // back bond (or the other direction of a bond to a descendant)
+            scratch.low[atom] = std::min(scratch.low[atom], scratch.order[nbr]);
+            continue;
+          }
+          // tree bond
+          scratch.order[nbr] = scratch.low[nbr] = ++counter;
+          scratch.parentBond[nbr] = bond;
+          scratch.stack.push_back(std::make_pair(nbr, scratch.offsets[nbr]));
+          continue;
         }
-      }
 
-      std::vector<Index> path;
-      std::vector<bool> &cycle_atoms;
-      std::vector<bool> &cycle_bonds;
-    };
+        // backtrack
+        scratch.stack.pop_back();
+        if (scratch.stack.empty())
+          break;
+        unsigned int parent = scratch.stack.back().first;
+        scratch.low[parent] = std::min(scratch.low[parent], scratch.low[atom]);
+        // the tree bond is a bridge if the subtree has no back bond above atom
+        if (scratch.low[atom] <= scratch.order[parent])
+          cycle_bonds[scratch.parentBond[atom]] = true;
+      }
+    }
 
+    // cyclic bonds that are not tree bonds are back bonds (never bridges)
+    for (unsigned int atom = 0; atom < numAtoms; ++atom)
+      for (unsigned int i = scratch.offsets[atom]; i < scratch.offsets[atom + 1]; ++i) {
+        unsigned int bond = scratch.incident[i].first;
+        unsigned int nbr = scratch.incident[i].second;
+        if (bond != scratch.parentBond[atom] && bond != scratch.parentBond[nbr])
+          cycle_bonds[bond] = true;
+        if (cycle_bonds[bond])
+          cycle_atoms[atom] = true;
+      }
   }
 
+  /**
+   * Find the atoms and bonds that are part of a cycle (see
+   * cycle_membership(mol, cycle_atoms, cycle_bonds, scratch)).
+   */
   template<typename MoleculeType>
   void cycle_membership(MoleculeType &mol, std::vector<bool> &cycle_atoms, std::vector<bool> &cycle_bonds)
   {
-    cycle_atoms.clear();
-    cycle_bonds.clear();
-    cycle_atoms.resize(num_atoms(mol));
-    cycle_bonds.resize(num_bonds(mol));
-
-    impl::CycleMembershipVisitor<MoleculeType> visitor(cycle_atoms, cycle_bonds);
-    depth_first_search(mol, visitor);
+    CycleMembershipScratch scratch;
+    cycle_membership(mol, cycle_atoms, cycle_bonds, scratch);
   }
 
   namespace impl {
 
-    template<typename MoleculeType, typename QueryType>
-    struct CycleAtomMatcher
+    /**
+     * @brief Gaussian elimination over GF(2) on cycle (bond) bit vectors.
+     */
+    class CycleBasis
     {
-      typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
-      typedef typename molecule_traits<QueryType>::atom_type query_atom_type;
+      public:
+        CycleBasis(unsigned int numWords) : m_numWords(numWords), m_reduced(numWords)
+        {
+        }
 
-      bool operator()(QueryType &query, query_atom_type queryAtom, MoleculeType &mol, atom_type atom) const
-      {
-        return true;
-        //return is_cyclic(mol, atom);
-      }
+        /**
+         * Get the number of independent cycles.
+         */
+        std::size_t rank() const
+        {
+          return m_pivots.size();
+        }
+
+        /**
+         * Check if a cycle is independent of the cycles in the basis.
+         */
+        bool isIndependent(const std::vector<Word> &bonds)
+        {
+          std::copy(bonds.begin(), bonds.end(), m_reduced.begin());
+          return reduce();
+        }
+
+        /**
+         * Add a cycle to the basis if it is independent.
+         *
+         * @return True if the cycle was added.
+         */
+        bool add(const std::vector<Word> &bonds)
+        {
+          if (!isIndependent(bonds))
+            return false;
+          // the lowest bit of the reduced cycle is the pivot
+          unsigned int pivot = 0;
+          while (!bitvec_get(pivot, &m_reduced[0]))
+            ++pivot;
+          m_pivots.push_back(pivot);
+          m_rows.insert(m_rows.end(), m_reduced.begin(), m_reduced.end());
+          return true;
+        }
+
+      private:
+        /**
+         * Reduce m_reduced using the basis.
+         *
+         * @return True if the result is not zero.
+         */
+        bool reduce()
+        {
+          for (std::size_t i = 0; i < m_pivots.size(); ++i)
+            if (bitvec_get(m_pivots[i], &m_reduced[0]))
+              for (unsigned int j = 0; j < m_numWords; ++j)
+                m_reduced[j] ^= m_rows[i * m_numWords + j];
+          for (unsigned int j = 0; j < m_numWords; ++j)
+            if (m_reduced[j])
+              return true;
+          return false;
+        }
+
+        unsigned int m_numWords;
+        std::vector<unsigned int> m_pivots; //!< The pivot bit of each row
+        std::vector<Word> m_rows; //!< The basis rows
+        std::vector<Word> m_reduced; //!< The cycle being reduced
     };
 
-    template<typename MoleculeType, typename QueryType>
-    struct CycleBondMatcher
+    /**
+     * @brief Vismara's candidate cycles (the prototypes of the cycle families).
+     *
+     * For each atom r, the shortest paths from r are computed using only
+     * atoms with a lower index (i.e. r is the highest atom in the cycle). The
+     * odd cycles are formed by two disjoint shortest paths from r to the atoms
+     * of a bond (p, q) with d(r,p) = d(r,q). The even cycles are formed by two
+     * disjoint shortest paths from r to two neighbors p and q of an atom y
+     * with d(r,p) = d(r,q) = d(r,y) - 1. The family of a prototype consists of
+     * all cycles formed by any shortest paths from r to p and q.
+     */
+    template<typename MoleculeType>
+    class VismaraCycles
     {
-      typedef typename molecule_traits<MoleculeType>::bond_type bond_type;
-      typedef typename molecule_traits<QueryType>::bond_type query_bond_type;
+      public:
+        /**
+         * @brief A candidate cycle and its family.
+         */
+        struct Candidate
+        {
+          unsigned int r; //!< The highest atom
+          unsigned int p; //!< The end of the first path
+          unsigned int q; //!< The end of the second path
+          unsigned int y; //!< The middle atom for even cycles (numAtoms for odd cycles)
+          std::vector<Index> atoms; //!< The atoms in ring order
+          std::vector<Word> bonds; //!< The bonds (bit vector)
 
-      bool operator()(QueryType &query, query_bond_type queryAtom, MoleculeType &mol, bond_type bond) const
-      {
-        return true;
-        //return is_cyclic(mol, bond);
-      }
+          bool operator<(const Candidate &other) const
+          {
+            return atoms.size() < other.atoms.size();
+          }
+        };
+
+        VismaraCycles(MoleculeType &mol) : m_numAtoms(num_atoms(mol)),
+            m_numWords(bitvec_num_words_for_bits(num_bonds(mol))), m_dist(m_numAtoms),
+            m_parent(m_numAtoms), m_parentBond(m_numAtoms), m_branch(m_numAtoms), m_onPath(m_numAtoms)
+        {
+          // only cyclic atoms and bonds can be in a cycle
+          CycleMembershipScratch scratch;
+          cycle_membership(mol, m_cyclicAtoms, m_cyclicBonds, scratch);
+          m_offsets.swap(scratch.offsets);
+          m_incident.swap(scratch.incident);
+        }
+
+        /**
+         * Generate the candidate cycles ordered by size.
+         */
+        void candidates(std::vector<Candidate> &cycles)
+        {
+          std::vector<unsigned int> lower; // neighbors of y at distance d(r,y) - 1
+
+          for (unsigned int r = 0; r < m_numAtoms; ++r) {
+            if (!m_cyclicAtoms[r])
+              continue;
+
+            search(r);
+
+            for (std::size_t head = 1; head < m_queue.size(); ++head) {
+              unsigned int y = m_queue[head];
+              lower.clear();
+              for (unsigned int i = m_offsets[y]; i < m_offsets[y + 1]; ++i) {
+                unsigned int z = m_incident[i].second;
+                if (!isEdge(r, i))
+                  continue;
+                if (m_dist[z] + 1 == m_dist[y])
+                  lower.push_back(i);
+                else if (m_dist[z] == m_dist[y] && z < y && m_branch[y] != m_branch[z]) {
+                  // odd cycle: r ... y - z ... r
+                  cycles.push_back(Candidate());
+                  Candidate &cycle = cycles.back();
+                  cycle.r = r;
+                  cycle.p = y;
+                  cycle.q = z;
+                  cycle.y = m_numAtoms;
+                  treeCycle(cycle, m_incident[i].first, 0);
+                }
+              }
+
+              // even cycles: r ... p - y - q ... r
+              for (std::size_t i = 0; i < lower.size(); ++i)
+                for (std::size_t j = i + 1; j < lower.size(); ++j) {
+                  unsigned int p = m_incident[lower[i]].second;
+                  unsigned int q = m_incident[lower[j]].second;
+                  if (m_branch[p] == m_branch[q])
+                    continue;
+                  cycles.push_back(Candidate());
+                  Candidate &cycle = cycles.back();
+                  cycle.r = r;
+                  cycle.p = p;
+                  cycle.q = q;
+                  cycle.y = y;
+                  treeCycle(cycle, m_incident[lower[i]].first, m_incident[lower[j]].first);
+                }
+            }
+          }
+
+          // order by size (stable to have a deterministic result)
+          std::stable_sort(cycles.begin(), cycles.end());
+        }
+
+        /**
+         * Get all cycles in the family of a candidate (including the
+         * candidate itself).
+         */
+        void family(const Candidate &candidate, std::vector<std::vector<Index> > &cycles)
+        {
+          search(candidate.r);
+
+          std::vector<std::vector<unsigned int> > pathsP, pathsQ;
+          std::vector<unsigned int> path;
+          shortestPaths(candidate.r, candidate.p, path, pathsP);
+          shortestPaths(candidate.r, candidate.q, path, pathsQ);
+
+          for (std::size_t i = 0; i < pathsP.size(); ++i) {
+            // the paths are stored from p/q to r
+            for (std::size_t k = 0; k + 1 < pathsP[i].size(); ++k)
+              m_onPath[pathsP[i][k]] = true;
+            for (std::size_t j = 0; j < pathsQ.size(); ++j) {
+              bool disjoint = true;
+              for (std::size_t k = 0; k + 1 < pathsQ[j].size(); ++k)
+                if (m_onPath[pathsQ[j][k]])
+                  disjoint = false;
+              if (!disjoint)
+                continue;
+              cycles.push_back(std::vector<Index>(pathsP[i].rbegin(), pathsP[i].rend()));
+              if (candidate.y != m_numAtoms)
+                cycles.back().push_back(candidate.y);
+              cycles.back().insert(cycles.back().end(), pathsQ[j].begin(), pathsQ[j].end() - 1);
+            }
+            for (std::size_t k = 0; k + 1 < pathsP[i].size(); ++k)
+              m_onPath[pathsP[i][k]] = false;
+          }
+        }
+
+      private:
+        /**
+         * Check if the i-th incident bond can be used for cycles with
+         * highest atom r.
+         */
+        bool isEdge(unsigned int r, unsigned int i) const
+        {
+          unsigned int w = m_incident[i].second;
+          return w <= r && m_cyclicBonds[m_incident[i].first] && m_dist[w] != m_numAtoms;
+        }
+
+        /**
+         * Breadth-first search from r using the atoms with index < r.
+         */
+        void search(unsigned int r)
+        {
+          std::fill(m_dist.begin(), m_dist.end(), m_numAtoms);
+          m_dist[r] = 0;
+          m_branch[r] = r;
+          m_queue.assign(1, r);
+          for (std::size_t head = 0; head < m_queue.size(); ++head) {
+            unsigned int v = m_queue[head];
+            for (unsigned int i = m_offsets[v]; i < m_offsets[v + 1]; ++i) {
+              unsigned int bond = m_incident[i].first;
+              unsigned int w = m_incident[i].second;
+              if (w > r || !m_cyclicBonds[bond] || m_dist[w] != m_numAtoms)
+                continue;
+              m_dist[w] = m_dist[v] + 1;
+              m_parent[w] = v;
+              m_parentBond[w] = bond;
+              // the first atom on the path from r (tree paths only share a prefix)
+              m_branch[w] = v == r ? w : m_branch[v];
+              m_queue.push_back(w);
+            }
+          }
+        }
+
+        /**
+         * Add the path from r to v in the BFS tree to the cycle.
+         */
+        void treePath(Candidate &cycle, unsigned int v, bool reverse)
+        {
+          std::size_t begin = cycle.atoms.size();
+          for (; v != cycle.r; v = m_parent[v]) {
+            cycle.atoms.push_back(v);
+            bitvec_set(m_parentBond[v], &cycle.bonds[0]);
+          }
+          if (reverse) {
+            cycle.atoms.push_back(cycle.r);
+            std::reverse(cycle.atoms.begin() + begin, cycle.atoms.end());
+          }
+        }
+
+        /**
+         * Create the cycle for a candidate using the BFS tree paths.
+         */
+        void treeCycle(Candidate &cycle, unsigned int bond1, unsigned int bond2)
+        {
+          cycle.bonds.assign(m_numWords, 0);
+          treePath(cycle, cycle.p, true);
+          if (cycle.y != m_numAtoms)
+            cycle.atoms.push_back(cycle.y);
+          treePath(cycle, cycle.q, false);
+          bitvec_set(bond1, &cycle.bonds[0]);
+          if (cycle.y != m_numAtoms)
+            bitvec_set(bond2, &cycle.bonds[0]);
+        }
+
+        /**
+         * Enumerate all shortest paths from v to r (using the atoms with
+         * index < r).
+         */
+        void shortestPaths(unsigned int r, unsigned int v, std::vector<unsigned int> &path,
+            std::vector<std::vector<unsigned int> > &paths)
+        {
+          path.push_back(v);
+          if (v == r)
+            paths.push_back(path);
+          else
+            for (unsigned int i = m_offsets[v]; i < m_offsets[v + 1]; ++i)
+              if (isEdge(r, i) && m_dist[m_incident[i].second] + 1 == m_dist[v])
+                shortestPaths(r, m_incident[i].second, path, paths);
+          path.pop_back();
+        }
+
+        unsigned int m_numAtoms;
+        unsigned int m_numWords;
+        std::vector<bool> m_cyclicAtoms; //!< The cyclic atoms
+        std::vector<bool> m_cyclicBonds; //!< The cyclic bonds
+        std::vector<unsigned int> m_offsets; //!< The offsets in m_incident for each atom
+        std::vector<std::pair<unsigned int, unsigned int> > m_incident; //!< (bond, neighbor)
+        std::vector<unsigned int> m_dist; //!< The BFS distance from r (m_numAtoms if unreachable)
+        std::vector<unsigned int> m_parent; //!< The BFS tree parent
+        std::vector<unsigned int> m_parentBond; //!< The BFS tree bond to the parent
+        std::vector<unsigned int> m_branch; //!< The first atom after r on the BFS tree path
+        std::vector<unsigned int> m_queue; //!< The BFS queue (reachable atoms in BFS order)
+        std::vector<bool> m_onPath; //!< The atoms on the current path (family())
     };
 
-  }
+    /**
+     * Select the relevant cycles or a minimum cycle basis from the
+     * candidate cycles.
+     */
+    template<typename MoleculeType>
+    std::vector<std::vector<Index> > select_cycles(MoleculeType &mol, Size cyclomaticNumber, bool relevant)
+    {
+      typedef typename VismaraCycles<MoleculeType>::Candidate Candidate;
 
-  template<typename MoleculeType>
-  std::vector<std::vector<Index> > relevant_cycles(MoleculeType &mol, Size cyclomaticNumber)
-  {
-    std::vector<std::vector<Index> > cycles;
-
-    // current cycle size
-    unsigned int size = 3;
-
-    while (cycles.size() < cyclomaticNumber) {
-      // create query
-      std::string smiles = "*1" + std::string(size - 1, '*') + "1";
-      HeMol cycleMol;
-      parse_smiles(smiles, cycleMol);
-
-      // find all cycles of size
-      MappingList mappings;
-      if (isomorphism_search<impl::CycleAtomMatcher, impl::CycleBondMatcher, MoleculeType, HeMol, MappingList>(mol, cycleMol, mappings)) {
-        for (std::size_t i = 0; i < mappings.maps.size(); ++i)
-          cycles.push_back(mappings.maps[i]);
+      std::vector<std::vector<Index> > cycles;
+      if (!cyclomaticNumber)
+        return cycles;
+
+      VismaraCycles<MoleculeType> vismara(mol);
+      std::vector<Candidate> candidates;
+      vismara.candidates(candidates);
+
+      CycleBasis basis(bitvec_num_words_for_bits(num_bonds(mol)));
+      std::size_t begin = 0;
+      while (begin < candidates.size() && basis.rank() < cyclomaticNumber) {
+        // the candidates with the same size
+        std::size_t end = begin;
+        while (end < candidates.size() && candidates[end].atoms.size() == candidates[begin].atoms.size())
+          ++end;
+
+        if (relevant) {
+          // a cycle family is relevant if it is independent of the smaller cycles
+          for (std::size_t i = begin; i < end; ++i)
+            if (basis.isIndependent(candidates[i].bonds))
+              vismara.family(candidates[i], cycles);
+          for (std::size_t i = begin; i < end; ++i)
+            basis.add(candidates[i].bonds);
+        } else {
+          // greedy minimum cycle basis
+          for (std::size_t i = begin; i < end && basis.rank() < cyclomaticNumber; ++i)
+            if (basis.add(candidates[i].bonds))
+              cycles.push_back(candidates[i].atoms);
+        }
+
+        begin = end;
       }
 
-      // increment cycle size
-      ++size;
+      return cycles;
     }
 
-    return cycles;
   }
 
+  /**
+   * Find the relevant cycles. A cycle is relevant if it can not be written as
+   * the sum (i.e. symmetric difference of the bonds) of smaller cycles. The
+   * relevant cycles are the union of all minimum cycle bases (SSSR).
+   *
+   * The candidate cycles are generated using Vismara's algorithm and the
+   * bonds of each cycle are stored in a bit vector to test the independence
+   * using Gaussian elimination. For each relevant candidate, all cycles in
+   * its family are returned. Note that the number of relevant cycles can
+   * grow exponentially with the number of atoms.
+   *
+@verbatim
+Vismara, P. Union of all the minimum cycle bases of a graph. Electron. J.
+Comb. 1997, 4: R9.
+@endverbatim
+   *
+   * @param mol The molecule.
+   * @param cyclomaticNumber The cyclomatic number of the molecule (see
+   *        cyclomatic_number()).
+   *
+   * @return The cycles ordered by size, each cycle is a list of atom indices
+   *         in ring order.
+   */
+  template<typename MoleculeType>
+  std::vector<std::vector<Index> > relevant_cycles(MoleculeType &mol, Size cyclomaticNumber)
+  {
+    return impl::select_cycles(mol, cyclomaticNumber, true);
+  }
+
+  /**
+   * Find the relevant cycles (see relevant_cycles(mol, cyclomaticNumber)).
+   */
   template<typename MoleculeType>
   std::vector<std::vector<Index> > relevant_cycles(MoleculeType &mol)
   {
     return relevant_cycles(mol, cyclomatic_number(mol));
   }
 
+  /**
+   * Find the smallest set of smallest rings (SSSR), i.e. a minimum cycle
+   * basis. The SSSR is not unique, the result is a subset of the
+   * relevant_cycles() with cyclomatic_number() cycles.
+   *
+   * @param mol The molecule.
+   *
+   * @return The cycles ordered by size, each cycle is a list of atom indices
+   *         in ring order.
+   */
+  template<typename MoleculeType>
+  std::vector<std::vector<Index> > sssr(MoleculeType &mol)
+  {
+    return impl::select_cycles(mol, cyclomatic_number(mol), false);
+  }
+
 }
 
 #endif
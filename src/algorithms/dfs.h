@@ -1,9 +1,12 @@
 #ifndef HELIUM_DFS_H
 #define HELIUM_DFS_H
 
-#include <iostream>
-
 #include <Helium/molecule.h>
+#include <Helium/tie.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
 
 namespace Helium {
 
@@ -21,64 +24,195 @@ namespace Helium {
     void back_bond(MoleculeType &mol, bond_type bond) {}
   };
 
+  /**
+   * @brief Reusable buffers for depth_first_search() and the connected
+   *        components functions.
+   *
+   * The visited atoms and bonds are marked with the current epoch, starting
+   * a new traversal only increments the epoch (the mark arrays are only
+   * cleared when it wraps around). Together with the explicit stacks, this
+   * makes repeated traversals of (small) molecules allocation free once the
+   * buffers are large enough. A workspace should be used by a single thread.
+   */
+  template<typename MoleculeType>
+  class TraversalWorkspace
+  {
+    public:
+      typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
+      typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
+
+      /**
+       * @brief A depth-first search stack frame.
+       */
+      struct Frame
+      {
+        Frame(atom_type atom_, atom_type prev_, incident_iter bond_, incident_iter end_)
+          : atom(atom_), prev(prev_), bond(bond_), end(end_)
+        {
+        }
+
+        atom_type atom; //!< The atom
+        atom_type prev; //!< The previous atom (parent in the DFS tree)
+        incident_iter bond; //!< The next incident bond to consider
+        incident_iter end; //!< The end of the incident bonds
+      };
+
+      TraversalWorkspace() : m_epoch(0)
+      {
+      }
+
+      /**
+       * Start a new traversal, all atoms and bonds are unvisited afterwards.
+       */
+      void reset(std::size_t numAtoms, std::size_t numBonds)
+      {
+        if (++m_epoch == 0) {
+          // the epoch wrapped around
+          std::fill(m_atoms.begin(), m_atoms.end(), 0);
+          std::fill(m_bonds.begin(), m_bonds.end(), 0);
+          m_epoch = 1;
+        }
+        if (m_atoms.size() < numAtoms)
+          m_atoms.resize(numAtoms, 0);
+        if (m_bonds.size() < numBonds)
+          m_bonds.resize(numBonds, 0);
+        frames.clear();
+        atoms.clear();
+      }
+
+      bool isAtomVisited(Index index) const
+      {
+        return m_atoms[index] == m_epoch;
+      }
+
+      void visitAtom(Index index)
+      {
+        m_atoms[index] = m_epoch;
+      }
+
+      bool isBondVisited(Index index) const
+      {
+        return m_bonds[index] == m_epoch;
+      }
+
+      void visitBond(Index index)
+      {
+        m_bonds[index] = m_epoch;
+      }
+
+      std::vector<Frame> frames; //!< The depth-first search stack
+      std::vector<Index> atoms; //!< Atom stack (components)
+      std::vector<unsigned int> components; //!< Component numbers (num_connected_components())
+
+    private:
+      std::vector<unsigned int> m_atoms; //!< The epoch when the atom was visited
+      std::vector<unsigned int> m_bonds; //!< The epoch when the bond was visited
+      unsigned int m_epoch; //!< The current epoch
+  };
+
   namespace impl {
 
-    template<typename MoleculeType, typename AtomType, typename DFSVisitorType>
-    void dfs_visit(MoleculeType &mol, AtomType atom, DFSVisitorType &visitor, std::vector<bool> &visited,
-        AtomType prev = molecule_traits<MoleculeType>::null_atom())
+    /**
+     * Iterative depth-first search from @p root. The visitor functions are
+     * invoked in the same order as for a recursive search.
+     */
+    template<typename MoleculeType, typename DFSVisitorType>
+    void dfs_visit(MoleculeType &mol, typename molecule_traits<MoleculeType>::atom_type root,
+        DFSVisitorType &visitor, TraversalWorkspace<MoleculeType> &workspace)
     {
-      typedef AtomType atom_type;
+      typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
       typedef typename molecule_traits<MoleculeType>::bond_type bond_type;
       typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
+      typedef typename TraversalWorkspace<MoleculeType>::Frame Frame;
+
+      // mark atom as visited & invoke atom visitor
+      workspace.visitAtom(get_index(mol, root));
+      visitor.atom(mol, molecule_traits<MoleculeType>::null_atom(), root);
+      incident_iter bond, end_bonds;
+      TIE(bond, end_bonds) = get_bonds(mol, root);
+      workspace.frames.push_back(Frame(root, molecule_traits<MoleculeType>::null_atom(), bond, end_bonds));
+
+      while (!workspace.frames.empty()) {
+        Frame &frame = workspace.frames.back();
+
+        if (frame.bond == frame.end) {
+          // invoke backtrack visitor
+          atom_type atom = frame.atom;
+          workspace.frames.pop_back();
+          visitor.backtrack(mol, atom);
+          continue;
+        }
 
-      // mark atom as visited
-      visited[get_index(mol, atom)] = true;
-      // invoke atom visitor
-      visitor.atom(mol, prev, atom);
-
-      // call dfs_visit for all unvisited neighbors of v
-      FOREACH_INCIDENT (bond, atom, mol, MoleculeType) {
-        atom_type nbr = get_other(mol, *bond, atom);
+        bond_type current = *frame.bond;
+        ++frame.bond;
+        atom_type nbr = get_other(mol, current, frame.atom);
 
-        if (visited[get_index(mol, nbr)]) {
+        if (workspace.isAtomVisited(get_index(mol, nbr))) {
           // if this bond has not been visited before, a back_bond has been found
-          if (!visited[num_atoms(mol) + get_index(mol, *bond)])
-            visitor.back_bond(mol, *bond);
+          if (!workspace.isBondVisited(get_index(mol, current)))
+            visitor.back_bond(mol, current);
           // mark bond as visited
-          visited[num_atoms(mol) + get_index(mol, *bond)] = true;
+          workspace.visitBond(get_index(mol, current));
           continue;
         }
 
-        // mark bond as visited
-        visited[num_atoms(mol) + get_index(mol, *bond)] = true;
-        // invoke bond visitor
-        visitor.bond(mol, prev, *bond);
+        // mark bond as visited & invoke bond visitor
+        workspace.visitBond(get_index(mol, current));
+        visitor.bond(mol, frame.prev, current);
 
-        dfs_visit(mol, nbr, visitor, visited, atom);
+        // visit the neighbor (frame is invalidated by push_back)
+        atom_type atom = frame.atom;
+        workspace.visitAtom(get_index(mol, nbr));
+        visitor.atom(mol, atom, nbr);
+        TIE(bond, end_bonds) = get_bonds(mol, nbr);
+        workspace.frames.push_back(Frame(nbr, atom, bond, end_bonds));
       }
-
-      // invoke backtrack visitor
-      visitor.backtrack(mol, atom);
     }
 
   }
 
+  /**
+   * Perform a depth-first search of all components in the molecule. The
+   * search is iterative (no recursion depth limit) and uses the buffers in
+   * @p workspace.
+   *
+   * The visitor's functions are invoked when an atom is visited
+   * (atom(mol, prev, atom), prev is molecule_traits::null_atom() for the
+   * first atom of a component), when a bond is traversed (bond(mol, prev,
+   * bond), prev is the parent of the atom the bond is traversed from), when
+   * the search backtracks from an atom (backtrack(mol, atom)) and when a bond
+   * closing a cycle is found (back_bond(mol, bond)). See DFSVisitor.
+   *
+   * @param mol The molecule.
+   * @param visitor The visitor.
+   * @param workspace The buffers to reuse.
+   */
   template<typename MoleculeType, typename DFSVisitorType>
-  void depth_first_search(MoleculeType &mol, DFSVisitorType &visitor)
+  void depth_first_search(MoleculeType &mol, DFSVisitorType &visitor, TraversalWorkspace<MoleculeType> &workspace)
   {
-    typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
     typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
 
     visitor.initialize(mol);
 
-    std::vector<bool> visited(num_atoms(mol) + num_bonds(mol));
+    workspace.reset(num_atoms(mol), num_bonds(mol));
 
     FOREACH_ATOM (atom, mol, MoleculeType) {
-      if (!visited[get_index(mol, *atom)])
-        dfs_visit(mol, *atom, visitor, visited);
+      if (!workspace.isAtomVisited(get_index(mol, *atom)))
+        impl::dfs_visit(mol, *atom, visitor, workspace);
     }
   }
 
+  /**
+   * Perform a depth-first search of all components in the molecule (see
+   * depth_first_search(mol, visitor, workspace)).
+   */
+  template<typename MoleculeType, typename DFSVisitorType>
+  void depth_first_search(MoleculeType &mol, DFSVisitorType &visitor)
+  {
+    TraversalWorkspace<MoleculeType> workspace;
+    depth_first_search(mol, visitor, workspace);
+  }
+
 
   template<typename MoleculeType>
   struct DFSAtomOrderVisitor : public DFSVisitor<MoleculeType>
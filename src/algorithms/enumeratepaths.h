@@ -54,7 +54,7 @@ namespace Helium {
          * @param mol The molecule.
          * @param size The maximum path size (i.e. number of atoms in the path).
          */
-        EnumeratePaths(MoleculeType &mol, int size) : m_mol(mol), m_size(size)
+        EnumeratePaths(MoleculeType &mol, int size) : m_mol(mol), m_size(size), m_visited(num_atoms(mol))
         {
           m_paths.resize(size);
         }
@@ -92,6 +92,7 @@ namespace Helium {
         {
           // add the new atom
           path.push_back(get_index(m_mol, atom));
+          m_visited[get_index(m_mol, atom)] = true;
 
           // add the path if it is unique
           addPath(path);
@@ -102,7 +103,7 @@ namespace Helium {
             nbr_iter nbr, end_nbrs;
             TIE(nbr, end_nbrs) = get_nbrs(m_mol, atom);
             for (; nbr != end_nbrs; ++nbr) {
-              if (std::find(path.begin(), path.end(), get_index(m_mol, *nbr)) != path.end())
+              if (m_visited[get_index(m_mol, *nbr)])
                 continue;
 
               // recursive call
@@ -111,6 +112,7 @@ namespace Helium {
           }
 
           // backtrack
+          m_visited[path.back()] = false;
           path.pop_back();
         }
 
@@ -149,6 +151,7 @@ namespace Helium {
         MoleculeType &m_mol; //!< The molecule
         std::vector<std::vector<std::vector<unsigned int> > > m_paths; //!< List of unique found paths, ordered by path size
         int m_size; //!< Maximum path size
+        std::vector<bool> m_visited; //!< The atoms in the current path
     };
 
   } // namespace impl
@@ -6,9 +6,12 @@
 #include <Helium/substructure.h>
 #include <Helium/tie.h>
 #include <Helium/util.h>
-//#include "timeout.h"
+#include <Helium/timeout.h>
+#include <Helium/bitvec.h>
+#include <Helium/util/arena.h>
 
 #include <set>
+#include <algorithm>
 #include <iterator>
 
 //#include <boost/functional/hash.hpp>
@@ -110,7 +113,13 @@ namespace Helium {
     if (maxSize == 1 || !num_bonds(mol))
       return;
 
-    std::vector<unsigned int> components = connected_bond_components(mol);
+    TraversalWorkspace<MoleculeType> workspace;
+    std::vector<unsigned int> components;
+    connected_bond_components(mol, components, workspace);
+
+    // reused for the connectivity check of each combination
+    TraversalWorkspace<Substructure<MoleculeType> > subworkspace;
+    std::vector<unsigned int> subcomponents;
 
     int size = 1;
     bool foundSubgraph;
@@ -167,8 +176,7 @@ namespace Helium {
           if (trees && is_cyclic(substruct))
             continue;
           // make sure the all subgraph bonds are connected
-          std::vector<unsigned int> subcomponents = connected_bond_components(substruct);
-          if (unique_elements(subcomponents) > 1)
+          if (connected_bond_components(substruct, subcomponents, subworkspace) > 1)
             continue;
         }
  
@@ -464,16 +472,30 @@ namespace Helium {
   }
 
 
+  /**
+   * Enumerate all connected subgraphs (or trees) with up to @p maxSize atoms.
+   * The callback is invoked with a Subgraph for each subgraph found.
+   *
+   * @param mol The molecule.
+   * @param callback The callback functor.
+   * @param maxSize The maximum number of atoms in a subgraph.
+   * @param trees If true, only acyclic subgraphs are enumerated.
+   * @param token Optional cancellation token, checked once every 16 seeds.
+   *
+   * @return False if the enumeration was stopped because @p token expired.
+   *         The callback has received a partial set of subgraphs in this case.
+   */
   template<typename MoleculeType, typename CallbackType>
-  void enumerate_subgraphs(MoleculeType &mol, CallbackType &callback, int maxSize, bool trees = false)
+  bool enumerate_subgraphs(MoleculeType &mol, CallbackType &callback, int maxSize, bool trees = false,
+      const CancellationToken *token = 0)
   {
     typedef typename molecule_traits<MoleculeType>::bond_iter bond_iter;
 
-    //Timeout timeout(500000); // 5s timeout
+    CancellationCheck cancelled(token, 16);
 
     assert(maxSize >= 0);
     if (maxSize == 0)
-      return;
+      return true;
 
     // generate single atom subgraphs
     for (unsigned int i = 0; i < num_atoms(mol); ++i) {
@@ -483,7 +505,7 @@ namespace Helium {
     }
 
     if (maxSize == 1)
-      return;
+      return true;
 
     std::vector<impl::SubgraphSeed> seeds;
     std::vector<bool> visited(num_bonds(mol)); // visited bonds
@@ -510,11 +532,12 @@ namespace Helium {
     }
 
     if (maxSize == 2)
-      return;
+      return true;
 
     while (!seeds.empty()) {
       // check timeout
-      //timeout.check();
+      if (cancelled())
+        return false;
 
       impl::SubgraphSeed seed = seeds.back();
       seeds.pop_back();
@@ -539,6 +562,11 @@ namespace Helium {
       //std::cout << "    combinations: " << combinations << std::endl;
 
       for (std::size_t i = 0; i < combinations.size(); ++i) {
+        // when enumerating trees all extensions add an atom, two extensions
+        // adding the same atom would close a ring
+        if (trees && combinations[i].first.size() < combinations[i].second.size())
+          continue;
+
         std::vector<bool> atoms(seed.subgraph.atoms);
         std::vector<bool> newAtoms(seed.subgraph.atoms.size());
 
@@ -556,11 +584,6 @@ namespace Helium {
 
         Subgraph subgraph(atoms, bonds);
         assert(std::count(subgraph.atoms.begin(), subgraph.atoms.end(), true) <= maxSize);
-        
-
-        Substructure<MoleculeType> substruct(mol, atoms, bonds);
-        if (trees && is_cyclic(substruct))
-          continue;
 
         callback(subgraph);
         
@@ -579,10 +602,509 @@ namespace Helium {
 
     }
 
+    return true;
   }
 
 
 
+  /**
+   * @brief Lightweight view of a subgraph found by enumerate_subgraph_views().
+   *
+   * The atoms and bonds are stored as bit vectors (see bitvec.h) indexed by
+   * the molecule's atom and bond indices. The view (and the bit vectors) are
+   * only valid during the callback.
+   */
+  class SubgraphView
+  {
+    public:
+      SubgraphView(const Word *atoms, const Word *bonds, unsigned int numAtoms, unsigned int numBonds,
+          unsigned int molAtoms, unsigned int molBonds) : m_atoms(atoms), m_bonds(bonds),
+          m_numAtoms(numAtoms), m_numBonds(numBonds), m_molAtoms(molAtoms), m_molBonds(molBonds)
+      {
+      }
+
+      /**
+       * Check if an atom is in the subgraph.
+       */
+      bool atom(Index index) const
+      {
+        return bitvec_get(index, m_atoms);
+      }
+
+      /**
+       * Check if a bond is in the subgraph.
+       */
+      bool bond(Index index) const
+      {
+        return bitvec_get(index, m_bonds);
+      }
+
+      /**
+       * Get the atoms bit vector.
+       */
+      const Word* atoms() const
+      {
+        return m_atoms;
+      }
+
+      /**
+       * Get the bonds bit vector.
+       */
+      const Word* bonds() const
+      {
+        return m_bonds;
+      }
+
+      /**
+       * Get the number of atoms in the subgraph.
+       */
+      unsigned int numAtoms() const
+      {
+        return m_numAtoms;
+      }
+
+      /**
+       * Get the number of bonds in the subgraph.
+       */
+      unsigned int numBonds() const
+      {
+        return m_numBonds;
+      }
+
+      /**
+       * Copy the subgraph to atom and bond vectors (e.g. to create a
+       * Substructure). The vectors are resized to the number of atoms and
+       * bonds in the molecule.
+       */
+      void copy(std::vector<bool> &atoms, std::vector<bool> &bonds) const
+      {
+        atoms.assign(m_molAtoms, false);
+        bonds.assign(m_molBonds, false);
+        for (unsigned int i = 0; i < m_molAtoms; ++i)
+          if (bitvec_get(i, m_atoms))
+            atoms[i] = true;
+        for (unsigned int i = 0; i < m_molBonds; ++i)
+          if (bitvec_get(i, m_bonds))
+            bonds[i] = true;
+      }
+
+    private:
+      const Word *m_atoms;
+      const Word *m_bonds;
+      unsigned int m_numAtoms;
+      unsigned int m_numBonds;
+      unsigned int m_molAtoms;
+      unsigned int m_molBonds;
+  };
+
+  namespace impl {
+
+    /**
+     * @brief Subgraph enumeration using fixed size bit vectors.
+     *
+     * This is the same algorithm as enumerate_subgraphs() but the atoms,
+     * bonds and visited bonds of a seed are stored in N words (i.e. up to
+     * N * 64 atoms and bonds). The seeds are kept on an explicit stack and
+     * their extensions in a single shared pool. All buffers are allocated
+     * from an arena so no memory is allocated once the arena is large
+     * enough.
+     *
+     * Trees are enumerated by enumerateTrees() which never creates a
+     * combination of extensions closing a ring.
+     */
+    template<int N>
+    class EnumerateSubgraphBits
+    {
+        struct Extension
+        {
+          unsigned int bond; //!< The bond index
+          int atom; //!< The new atom index (-1 for bonds between atoms in the subgraph)
+        };
+
+        struct Seed
+        {
+          Word visited[N]; //!< The visited bonds
+          Word atoms[N]; //!< The subgraph atoms
+          Word bonds[N]; //!< The subgraph bonds
+          unsigned int numAtoms; //!< The number of subgraph atoms
+          unsigned int numBonds; //!< The number of subgraph bonds
+          std::size_t begin; //!< The first extension in the pool
+          std::size_t end; //!< The end of the extensions in the pool
+        };
+
+      public:
+        EnumerateSubgraphBits(Arena &arena) : m_offsets(ArenaAllocator<unsigned int>(arena)),
+            m_incident(ArenaAllocator<std::pair<unsigned int, unsigned int> >(arena)),
+            m_source(ArenaAllocator<unsigned int>(arena)), m_target(ArenaAllocator<unsigned int>(arena)),
+            m_seeds(ArenaAllocator<Seed>(arena)), m_pool(ArenaAllocator<Extension>(arena)),
+            m_extensions(ArenaAllocator<Extension>(arena)), m_groups(ArenaAllocator<std::size_t>(arena))
+        {
+        }
+
+        template<typename MoleculeType, typename CallbackType>
+        bool enumerate(MoleculeType &mol, CallbackType &callback, int maxSize, bool trees,
+            const CancellationToken *token)
+        {
+          typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
+          typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
+
+          m_molAtoms = num_atoms(mol);
+          m_molBonds = num_bonds(mol);
+          m_trees = trees;
+          assert(m_molAtoms <= N * 64 && m_molBonds <= N * 64);
+
+          CancellationCheck cancelled(token, 16);
+
+          assert(maxSize >= 0);
+          if (maxSize == 0)
+            return true;
+
+          // flat adjacency: (bond, other atom) for the incident bonds of each atom
+          m_offsets.assign(1, 0);
+          m_incident.clear();
+          atom_iter atom, end_atoms;
+          TIE(atom, end_atoms) = get_atoms(mol);
+          for (; atom != end_atoms; ++atom) {
+            incident_iter bond, end_bonds;
+            TIE(bond, end_bonds) = get_bonds(mol, *atom);
+            for (; bond != end_bonds; ++bond)
+              m_incident.push_back(std::make_pair(get_index(mol, *bond), get_index(mol, get_other(mol, *bond, *atom))));
+            m_offsets.push_back(m_incident.size());
+          }
+          m_source.resize(m_molBonds);
+          m_target.resize(m_molBonds);
+          for (unsigned int i = 0; i < m_molBonds; ++i) {
+            m_source[i] = get_index(mol, get_source(mol, get_bond(mol, i)));
+            m_target[i] = get_index(mol, get_target(mol, get_bond(mol, i)));
+          }
+
+          // generate single atom subgraphs
+          Word atoms[N], bonds[N];
+          bitvec_zero(bonds, N);
+          for (unsigned int i = 0; i < m_molAtoms; ++i) {
+            bitvec_zero(atoms, N);
+            bitvec_set(i, atoms);
+            callback(SubgraphView(atoms, bonds, 1, 0, m_molAtoms, m_molBonds));
+          }
+
+          if (maxSize == 1)
+            return true;
+
+          m_seeds.clear();
+          m_pool.clear();
+
+          // generate the initial seeds
+          // seeds[i] starts with bond i and bonds 0-i will not be used to extend the seed
+          Seed seed;
+          bitvec_zero(seed.visited, N);
+          for (unsigned int i = 0; i < m_molBonds; ++i) {
+            bitvec_set(i, seed.visited);
+            bitvec_zero(seed.atoms, N);
+            bitvec_zero(seed.bonds, N);
+            bitvec_set(m_source[i], seed.atoms);
+            bitvec_set(m_target[i], seed.atoms);
+            bitvec_set(i, seed.bonds);
+            seed.numAtoms = 2;
+            seed.numBonds = 1;
+
+            callback(SubgraphView(seed.atoms, seed.bonds, 2, 1, m_molAtoms, m_molBonds));
+
+            pushSeed(seed, seed.atoms);
+          }
+
+          if (maxSize == 2)
+            return true;
+
+          while (!m_seeds.empty()) {
+            // check timeout
+            if (cancelled())
+              return false;
+
+            // pop the seed and move its extensions out of the pool
+            seed = m_seeds.back();
+            m_seeds.pop_back();
+            m_extensions.assign(m_pool.begin() + seed.begin, m_pool.begin() + seed.end);
+            m_pool.resize(seed.begin);
+            std::size_t n = m_extensions.size();
+            assert(n < 64);
+
+            // handle all 2^(n-1) ways to expand using these sets of bonds, so there
+            // is no need to consider them during any of the future expansions
+            Word visited[N];
+            std::copy(seed.visited, seed.visited + N, visited);
+            for (std::size_t i = 0; i < n; ++i)
+              bitvec_set(m_extensions[i].bond, visited);
+
+            if (trees) {
+              enumerateTrees(callback, seed, visited, maxSize);
+              continue;
+            }
+
+            // for each possible extension which is small enough
+            for (unsigned long long combination = 1; combination < (1ULL << n); ++combination) {
+              Seed next;
+              std::copy(seed.atoms, seed.atoms + N, next.atoms);
+              std::copy(seed.bonds, seed.bonds + N, next.bonds);
+              Word newAtoms[N];
+              bitvec_zero(newAtoms, N);
+              bool hasNewAtoms = false;
+              for (std::size_t i = 0; i < n; ++i) {
+                if (!(combination & (1ULL << i)))
+                  continue;
+                bitvec_set(m_extensions[i].bond, next.bonds);
+                if (m_extensions[i].atom >= 0) {
+                  bitvec_set(m_extensions[i].atom, newAtoms);
+                  hasNewAtoms = true;
+                }
+              }
+
+              // two extensions may add the same atom
+              unsigned int numNewAtoms = hasNewAtoms ? bitvec_count(newAtoms, N) : 0;
+              next.numAtoms = seed.numAtoms + numNewAtoms;
+              if (next.numAtoms > static_cast<unsigned int>(maxSize))
+                continue;
+              next.numBonds = seed.numBonds + bitvec_count(static_cast<Word>(combination));
+
+              // a connected subgraph is a tree if it has one bond less than atoms
+              if (trees && next.numBonds >= next.numAtoms)
+                continue;
+
+              for (int i = 0; i < N; ++i)
+                next.atoms[i] |= newAtoms[i];
+
+              callback(SubgraphView(next.atoms, next.bonds, next.numAtoms, next.numBonds, m_molAtoms, m_molBonds));
+
+              // if no new atoms were added, and all ways to expand from the old atoms
+              // has been explorered, than there is no other way to expand this seed
+              if (!hasNewAtoms)
+                continue;
+
+              // start from the new atoms to find additional bonds for further expansion
+              std::copy(visited, visited + N, next.visited);
+              pushSeed(next, newAtoms);
+            }
+          }
+
+          return true;
+        }
+
+      private:
+        static bool compareExtensionAtoms(const Extension &a, const Extension &b)
+        {
+          return a.atom < b.atom;
+        }
+
+        /**
+         * Expand a tree seed. All extensions add an atom (bonds between
+         * atoms in the tree are never extensions). Extensions adding the
+         * same atom are grouped and at most one extension is used from each
+         * group. This way every combination is a tree, and combinations with
+         * too many atoms are pruned before they are built.
+         */
+        template<typename CallbackType>
+        void enumerateTrees(CallbackType &callback, const Seed &seed, const Word *visited, int maxSize)
+        {
+          std::sort(m_extensions.begin(), m_extensions.end(), compareExtensionAtoms);
+          m_groups.clear();
+          for (std::size_t i = 0; i < m_extensions.size(); ++i) {
+            assert(m_extensions[i].atom >= 0);
+            if (!i || m_extensions[i].atom != m_extensions[i - 1].atom)
+              m_groups.push_back(i);
+          }
+          m_groups.push_back(m_extensions.size());
+
+          Seed next = seed;
+          Word newAtoms[N];
+          bitvec_zero(newAtoms, N);
+          extendTree(callback, next, newAtoms, visited, 0, maxSize);
+        }
+
+        /**
+         * Choose no extension or one extension from group @p group and
+         * recurse to the next group.
+         */
+        template<typename CallbackType>
+        void extendTree(CallbackType &callback, Seed &next, Word *newAtoms, const Word *visited,
+            std::size_t group, int maxSize)
+        {
+          if (group + 1 == m_groups.size()) {
+            // no extensions used
+            if (!bitvec_count(newAtoms, N))
+              return;
+
+            callback(SubgraphView(next.atoms, next.bonds, next.numAtoms, next.numBonds, m_molAtoms, m_molBonds));
+
+            // start from the new atoms to find additional bonds for further expansion
+            Seed seed = next;
+            std::copy(visited, visited + N, seed.visited);
+            pushSeed(seed, newAtoms);
+            return;
+          }
+
+          // skip this group
+          extendTree(callback, next, newAtoms, visited, group + 1, maxSize);
+
+          if (next.numAtoms == static_cast<unsigned int>(maxSize))
+            return;
+
+          // add the atom using each of the extensions in this group
+          for (std::size_t i = m_groups[group]; i < m_groups[group + 1]; ++i) {
+            const Extension &extension = m_extensions[i];
+            bitvec_set(extension.bond, next.bonds);
+            bitvec_set(extension.atom, next.atoms);
+            bitvec_set(extension.atom, newAtoms);
+            ++next.numAtoms;
+            ++next.numBonds;
+
+            extendTree(callback, next, newAtoms, visited, group + 1, maxSize);
+
+            bitvec_reset(extension.bond, next.bonds);
+            bitvec_reset(extension.atom, next.atoms);
+            bitvec_reset(extension.atom, newAtoms);
+            --next.numAtoms;
+            --next.numBonds;
+          }
+        }
+
+        /**
+         * Find the extensions going out of @p newAtoms and push the seed if
+         * there are any.
+         */
+        void pushSeed(Seed &seed, const Word *newAtoms)
+        {
+          seed.begin = m_pool.size();
+          Word internal[N]; // bonds between atoms in the subgraph
+          bitvec_zero(internal, N);
+          for (int w = 0; w < N; ++w)
+            for (Word bits = newAtoms[w]; bits; bits &= bits - 1) {
+              unsigned int atom = w * 64 + __builtin_ctzll(bits);
+              for (unsigned int i = m_offsets[atom]; i < m_offsets[atom + 1]; ++i) {
+                unsigned int bond = m_incident[i].first;
+                unsigned int other = m_incident[i].second;
+                if (bitvec_get(bond, seed.visited))
+                  continue;
+                Extension extension;
+                extension.bond = bond;
+                if (bitvec_get(other, seed.atoms)) {
+                  // this bond will appear twice if both atoms are new
+                  if (m_trees || bitvec_get(bond, internal))
+                    continue;
+                  bitvec_set(bond, internal);
+                  extension.atom = -1;
+                } else
+                  extension.atom = other;
+                m_pool.push_back(extension);
+              }
+            }
+          seed.end = m_pool.size();
+          if (seed.end > seed.begin)
+            m_seeds.push_back(seed);
+        }
+
+        typename ArenaVector<unsigned int>::type m_offsets; //!< Offsets in m_incident for each atom
+        typename ArenaVector<std::pair<unsigned int, unsigned int> >::type m_incident; //!< (bond, other atom)
+        typename ArenaVector<unsigned int>::type m_source; //!< The bond source atoms
+        typename ArenaVector<unsigned int>::type m_target; //!< The bond target atoms
+        typename ArenaVector<Seed>::type m_seeds; //!< The seed stack
+        typename ArenaVector<Extension>::type m_pool; //!< The extensions of the seeds on the stack
+        typename ArenaVector<Extension>::type m_extensions; //!< The extensions of the current seed
+        typename ArenaVector<std::size_t>::type m_groups; //!< The first extension for each atom (trees)
+        unsigned int m_molAtoms;
+        unsigned int m_molBonds;
+        bool m_trees;
+    };
+
+    /**
+     * @brief Adapter for enumerate_subgraphs() to call a SubgraphView
+     *        callback (used for large molecules).
+     */
+    template<typename CallbackType>
+    struct SubgraphViewAdapter
+    {
+      SubgraphViewAdapter(CallbackType &callback_, unsigned int molAtoms_, unsigned int molBonds_)
+        : callback(callback_), molAtoms(molAtoms_), molBonds(molBonds_),
+          atoms(bitvec_num_words_for_bits(molAtoms_)), bonds(bitvec_num_words_for_bits(molBonds_))
+      {
+      }
+
+      void operator()(const Subgraph &subgraph)
+      {
+        std::fill(atoms.begin(), atoms.end(), 0);
+        std::fill(bonds.begin(), bonds.end(), 0);
+        unsigned int numAtoms = 0, numBonds = 0;
+        for (unsigned int i = 0; i < molAtoms; ++i)
+          if (subgraph.atoms[i]) {
+            bitvec_set(i, &atoms[0]);
+            ++numAtoms;
+          }
+        for (unsigned int i = 0; i < molBonds; ++i)
+          if (subgraph.bonds[i]) {
+            bitvec_set(i, &bonds[0]);
+            ++numBonds;
+          }
+        callback(SubgraphView(&atoms[0], &bonds[0], numAtoms, numBonds, molAtoms, molBonds));
+      }
+
+      CallbackType &callback;
+      unsigned int molAtoms;
+      unsigned int molBonds;
+      std::vector<Word> atoms;
+      std::vector<Word> bonds;
+    };
+
+  }
+
+  /**
+   * Enumerate all connected subgraphs (or trees) with up to @p maxSize atoms.
+   * The same subgraphs as enumerate_subgraphs() are found but the callback
+   * is invoked with a SubgraphView for each subgraph found:
+   *
+   * @code
+   * void callback(const SubgraphView &subgraph);
+   * @endcode
+   *
+   * For molecules with up to 256 atoms and bonds, the subgraphs are stored
+   * in fixed size bit vectors and no memory is allocated per subgraph (the
+   * order in which the subgraphs are found may differ from
+   * enumerate_subgraphs()). Larger molecules are handled by
+   * enumerate_subgraphs().
+   *
+   * @param mol The molecule.
+   * @param callback The callback functor.
+   * @param maxSize The maximum number of atoms in a subgraph.
+   * @param trees If true, only acyclic subgraphs are enumerated.
+   * @param token Optional cancellation token, checked once every 16 seeds.
+   * @param arena Optional arena for the buffers (see Arena). The callback
+   *        may use the arena too as long as it releases its allocations
+   *        (e.g. using an Arena::Scope).
+   *
+   * @return False if the enumeration was stopped because @p token expired.
+   *         The callback has received a partial set of subgraphs in this case.
+   */
+  template<typename MoleculeType, typename CallbackType>
+  bool enumerate_subgraph_views(MoleculeType &mol, CallbackType &callback, int maxSize, bool trees = false,
+      const CancellationToken *token = 0, Arena *arena = 0)
+  {
+    Arena ownArena;
+    Arena &buffers = arena ? *arena : ownArena;
+    Arena::Scope scope(buffers);
+    std::size_t size = std::max<std::size_t>(num_atoms(mol), num_bonds(mol));
+    if (size <= 64) {
+      impl::EnumerateSubgraphBits<1> enumerator(buffers);
+      return enumerator.enumerate(mol, callback, maxSize, trees, token);
+    }
+    if (size <= 128) {
+      impl::EnumerateSubgraphBits<2> enumerator(buffers);
+      return enumerator.enumerate(mol, callback, maxSize, trees, token);
+    }
+    if (size <= 256) {
+      impl::EnumerateSubgraphBits<4> enumerator(buffers);
+      return enumerator.enumerate(mol, callback, maxSize, trees, token);
+    }
+    impl::SubgraphViewAdapter<CallbackType> adapter(callback, num_atoms(mol), num_bonds(mol));
+    return enumerate_subgraphs(mol, adapter, maxSize, trees, token);
+  }
+
 }
 
 #endif
@@ -29,8 +29,27 @@
 
 #include <Helium/algorithms/invariants.h>
 
+#include <algorithm>
+#include <vector>
+
 namespace Helium {
 
+  /**
+   * @brief Reusable buffers for extended_connectivities().
+   *
+   * Passing the same scratch object to many extended_connectivities() calls
+   * (e.g. for all subgraphs in a fingerprint) avoids allocating memory once
+   * the buffers are large enough.
+   */
+  struct ExtendedConnectivitiesScratch
+  {
+    std::vector<unsigned int> offsets; //!< The offsets of the atoms in nbrs (flat adjacency)
+    std::vector<unsigned int> nbrs; //!< The neighbor indices of all atoms (flat adjacency)
+    std::vector<unsigned long> next; //!< The EC values of the next iteration
+    std::vector<unsigned long> values; //!< Sorted EC values to count the unique values
+    std::vector<std::pair<unsigned long, unsigned int> > sorted; //!< Sorted (value, index) pairs to renumber
+  };
+
   namespace impl {
 
     /**
@@ -55,52 +74,122 @@ namespace Helium {
       ec.swap(next);
     }
 
+    /**
+     * Copy the adjacency of @p mol to the flat arrays in @p scratch. The
+     * neighbors of each atom are stored in the order of the atom's incident
+     * bonds.
+     */
+    template<typename MoleculeType>
+    void extended_connectivities_adjacency(MoleculeType &mol, ExtendedConnectivitiesScratch &scratch)
+    {
+      typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
+      typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
+
+      scratch.offsets.resize(num_atoms(mol) + 1);
+      scratch.nbrs.clear();
+      atom_iter atom, end_atoms;
+      TIE(atom, end_atoms) = get_atoms(mol);
+      for (; atom != end_atoms; ++atom) {
+        scratch.offsets[get_index(mol, *atom)] = scratch.nbrs.size();
+        incident_iter bond, end_bonds;
+        TIE(bond, end_bonds) = get_bonds(mol, *atom);
+        for (; bond != end_bonds; ++bond)
+          scratch.nbrs.push_back(get_index(mol, get_other(mol, *bond, *atom)));
+      }
+      scratch.offsets[num_atoms(mol)] = scratch.nbrs.size();
+    }
+
+    /**
+     * Perform a single Extended Connectivities (EC) iteration using the flat
+     * adjacency in @p scratch.
+     */
+    inline void extended_connectivities_iterate(std::vector<unsigned long> &ec, ExtendedConnectivitiesScratch &scratch)
+    {
+      const unsigned int *offsets = &scratch.offsets[0];
+      const unsigned int *nbrs = scratch.nbrs.empty() ? 0 : &scratch.nbrs[0];
+      scratch.next.resize(ec.size());
+      for (std::size_t i = 0; i < ec.size(); ++i) {
+        unsigned long sum = 0;
+        for (unsigned int j = offsets[i]; j < offsets[i + 1]; ++j)
+          sum += ec[nbrs[j]];
+        scratch.next[i] = sum;
+      }
+      ec.swap(scratch.next);
+    }
+
+    /**
+     * Count the number of unique EC values by sorting a copy.
+     */
+    inline unsigned int extended_connectivities_classes(const std::vector<unsigned long> &ec, std::vector<unsigned long> &values)
+    {
+      values.assign(ec.begin(), ec.end());
+      std::sort(values.begin(), values.end());
+      return std::unique(values.begin(), values.end()) - values.begin();
+    }
+
     /**
      * Renumber the extended connectivities values to be in the range [0,n-1]
-     * where n is the number of unique values.
+     * where n is the number of unique values. The order of the values is
+     * preserved.
      */
-    inline void extended_connectivities_renumber(std::vector<unsigned long> &ec)
+    inline void extended_connectivities_renumber(std::vector<unsigned long> &ec,
+        std::vector<std::pair<unsigned long, unsigned int> > &sorted)
     {
-      std::set<unsigned long> classes;
+      sorted.resize(ec.size());
       for (std::size_t i = 0; i < ec.size(); ++i)
-        classes.insert(ec[i]);
+        sorted[i] = std::make_pair(ec[i], static_cast<unsigned int>(i));
+      std::sort(sorted.begin(), sorted.end());
+
       unsigned long cls = 0;
-      for (std::set<unsigned long>::iterator i = classes.begin(); i != classes.end(); ++i) {
-        for (std::size_t j = 0; j < ec.size(); ++j)
-          if (ec[j] == *i)
-            ec[j] = cls;
-        ++cls;
+      for (std::size_t i = 0; i < sorted.size(); ++i) {
+        if (i && sorted[i].first != sorted[i - 1].first)
+          ++cls;
+        ec[sorted[i].second] = cls;
       }
     }
 
+    /**
+     * Renumber the extended connectivities values to be in the range [0,n-1]
+     * where n is the number of unique values.
+     */
+    inline void extended_connectivities_renumber(std::vector<unsigned long> &ec)
+    {
+      std::vector<std::pair<unsigned long, unsigned int> > sorted;
+      extended_connectivities_renumber(ec, sorted);
+    }
+
   }
 
   /**
    * Calculate the Morgan's Extended Connectivities for the specified molecule.
    *
-@verbatim
-Morgan, H. L. The Generation of a Unique Machine Description for Chemical
-Structures - A Technique Developed at Chemical Abstracts Service. J. Chem.
-Doc. 1965, 5: 107-112.
-@endverbatim
+   * This version stores the result in @p ec and uses the buffers in
+   * @p scratch. The adjacency is copied to flat arrays once and the unique
+   * values are counted and renumbered by sorting. The result is the same as
+   * for extended_connectivities(mol).
+   *
+   * @param mol The molecule.
+   * @param ec The EC values indexed by atom index (output).
+   * @param scratch The buffers to reuse.
    */
   template<typename MoleculeType>
-  std::vector<unsigned long> extended_connectivities(MoleculeType &mol)
+  void extended_connectivities(MoleculeType &mol, std::vector<unsigned long> &ec, ExtendedConnectivitiesScratch &scratch)
   {
     typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
 
-    // initial atom invariants
-    std::vector<unsigned long> ec;
+    // initial atom invariants & flat adjacency
+    ec.resize(num_atoms(mol));
     atom_iter atom, end_atoms;
     TIE(atom, end_atoms) = get_atoms(mol);
     for (; atom != end_atoms; ++atom)
-      ec.push_back(atom_invariant(mol, *atom));
+      ec[get_index(mol, *atom)] = atom_invariant(mol, *atom);
+    impl::extended_connectivities_adjacency(mol, scratch);
 
     // iterate
-    unsigned int numClasses = unique_elements(ec);
+    unsigned int numClasses = impl::extended_connectivities_classes(ec, scratch.values);
     for (int i = 0; i < 100; ++i) { // should never reach 100...
-      impl::extended_connectivities_iterate(mol, ec);
-      unsigned int nextNumClasses = unique_elements(ec);
+      impl::extended_connectivities_iterate(ec, scratch);
+      unsigned int nextNumClasses = impl::extended_connectivities_classes(ec, scratch.values);
       // if the number of unique values didn't change, stop the iteration
       if (numClasses == nextNumClasses)
         break;
@@ -108,7 +197,24 @@ Doc. 1965, 5: 107-112.
     }
 
     // renumber the EC values
-    impl::extended_connectivities_renumber(ec);
+    impl::extended_connectivities_renumber(ec, scratch.sorted);
+  }
+
+  /**
+   * Calculate the Morgan's Extended Connectivities for the specified molecule.
+   *
+@verbatim
+Morgan, H. L. The Generation of a Unique Machine Description for Chemical
+Structures - A Technique Developed at Chemical Abstracts Service. J. Chem.
+Doc. 1965, 5: 107-112.
+@endverbatim
+   */
+  template<typename MoleculeType>
+  std::vector<unsigned long> extended_connectivities(MoleculeType &mol)
+  {
+    std::vector<unsigned long> ec;
+    ExtendedConnectivitiesScratch scratch;
+    extended_connectivities(mol, ec, scratch);
     return ec;
   }
 
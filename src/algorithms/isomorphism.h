@@ -29,6 +29,9 @@
 
 #include <Helium/molecule.h>
 #include <Helium/tie.h>
+#include <Helium/timeout.h>
+#include <Helium/instrumentation.h>
+#include <Helium/bitvec.h>
 
 #include <vector>
 #include <cassert>
@@ -165,208 +168,859 @@ namespace Helium {
       std::cout << std::endl;
     }
 
-    template<template <typename, typename> class AtomMatcher, template<typename, typename> class BondMatcher, typename MoleculeType, typename QueryType, typename MappingType>
-    class Isomorphism
+    /**
+     * Hash set for the atom sets of the mappings found by the
+     * IsomorphismMatcher. A key is the sorted list of mapped atom indices,
+     * all keys in the set have the same size.
+     */
+    class MappingHashSet
     {
       public:
-        typedef typename molecule_traits<QueryType>::atom_type query_atom_type;
-        typedef typename molecule_traits<QueryType>::bond_type query_bond_type;
-        typedef typename molecule_traits<QueryType>::incident_iter query_incident_iter;
-
-        typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
-        typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
-        typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
-
-        Isomorphism(MoleculeType &mol, QueryType &query) : m_mol(mol), m_query(query)
+        MappingHashSet() : m_keySize(0), m_size(0)
         {
-          dfsBonds();
-          m_map.resize(num_atoms(query), -1);
         }
 
-        void dfsBonds(query_atom_type atom, std::vector<bool> &visited)
+        /**
+         * Remove all keys.
+         */
+        void clear()
         {
-          query_incident_iter bond, end_bonds;
-          TIE(bond, end_bonds) = get_bonds(m_query, atom);
-          for (; bond != end_bonds; ++bond) {
-            if (visited[get_index(m_query, *bond)])
-              continue;
-            visited[get_index(m_query, *bond)] = true;
-
-            bool swap = get_source(m_query, *bond) != atom;
-            m_bondSwap.push_back(swap);
-
-            m_dfsBonds.push_back(get_index(m_query, *bond));
-            dfsBonds(swap ? get_source(m_query, *bond) : get_target(m_query, *bond), visited);
-          }
+          if (!m_size)
+            return;
+          std::fill(m_slots.begin(), m_slots.end(), -1);
+          m_keys.clear();
+          m_size = 0;
         }
 
-        void dfsBonds()
+        /**
+         * Insert a key.
+         *
+         * @return True if the key was not in the set yet.
+         */
+        bool insert(const std::vector<Index> &key)
         {
-          std::vector<bool> visited(num_bonds(m_query));
-
-          // TODO extend for disconnected...
-          query_atom_type atom = get_atom(m_query, 0);
-          dfsBonds(atom, visited);
-
-          if (DEBUG_ISOMORPHISM) {
-            std::cout << "DFS bonds: ";
-            for (std::size_t i = 0; i < m_dfsBonds.size(); ++i) {
-              query_bond_type bond = get_bond(m_query, m_dfsBonds[i]);
-              if (!m_bondSwap[i])
-                std::cout << get_index(m_query, get_source(m_query, bond)) << "-" << get_index(m_query, get_target(m_query, bond)) << " ";
-              else
-                std::cout << get_index(m_query, get_target(m_query, bond)) << "-" << get_index(m_query, get_source(m_query, bond)) << " ";
+          if (!m_size)
+            m_keySize = key.size();
+          assert(key.size() == m_keySize);
+
+          // keep the load factor below 0.5
+          if (2 * (m_size + 1) > m_slots.size())
+            rehash(std::max<std::size_t>(16, 2 * m_slots.size()));
+
+          std::size_t mask = m_slots.size() - 1;
+          for (std::size_t slot = hash(&key[0]) & mask; ; slot = (slot + 1) & mask) {
+            if (m_slots[slot] == -1) {
+              m_slots[slot] = m_size++;
+              m_keys.insert(m_keys.end(), key.begin(), key.end());
+              return true;
             }
-            std::cout << std::endl;
+            if (std::equal(key.begin(), key.end(), m_keys.begin() + m_slots[slot] * m_keySize))
+              return false;
           }
         }
 
-        void match(MappingType &mapping, int bondIndex)
+      private:
+        std::size_t hash(const Index *key) const
         {
-          query_bond_type queryBond = get_bond(m_query, m_dfsBonds[bondIndex]);
-          query_atom_type querySource = m_bondSwap[bondIndex] ? get_target(m_query, queryBond) : get_source(m_query, queryBond);
-
-          atom_type atom = get_atom(m_mol, m_map[get_index(m_mol, querySource)]);
-
-          query_atom_type queryTarget = m_bondSwap[bondIndex] ? get_source(m_query, queryBond) : get_target(m_query, queryBond);
-          bool isRingClosure = m_map[get_index(m_query, queryTarget)] != -1;
-
-          if (DEBUG_ISOMORPHISM)
-            std::cout << "mapping bond: " << get_index(m_query, querySource) << "-" << get_index(m_query, queryTarget) << std::endl;
+          // FNV-1a
+          std::size_t h = 2166136261u;
+          for (std::size_t i = 0; i < m_keySize; ++i)
+            h = (h ^ key[i]) * 16777619u;
+          return h;
+        }
 
-          incident_iter bond, end_bonds;
-          TIE(bond, end_bonds) = get_bonds(m_mol, atom);
-          for (; bond != end_bonds; ++bond) {
-            if (!m_bondMatcher(m_query, queryBond, m_mol, *bond))
-              continue;
+        void rehash(std::size_t numSlots)
+        {
+          m_slots.assign(numSlots, -1);
+          std::size_t mask = numSlots - 1;
+          for (int i = 0; i < m_size; ++i) {
+            std::size_t slot = hash(&m_keys[i * m_keySize]) & mask;
+            while (m_slots[slot] != -1)
+              slot = (slot + 1) & mask;
+            m_slots[slot] = i;
+          }
+        }
 
-            atom_type nbrAtom = get_other(m_mol, *bond, atom);
+        std::vector<Index> m_keys; // the keys, m_keySize indices each
+        std::vector<int> m_slots; // open addressing table, index of the key or -1
+        std::size_t m_keySize; // the number of indices in a key
+        int m_size; // the number of keys
+    };
 
-            if (isRingClosure) {
-              if (DEBUG_ISOMORPHISM)
-                std::cout << "ring closure..." << std::endl;
-              if (m_map[get_index(m_query, queryTarget)] != get_index(m_mol, nbrAtom))
-                continue;
-            } else {
-              if (std::find(m_map.begin(), m_map.end(), get_index(m_mol, nbrAtom)) != m_map.end())
-                continue;
+  }
 
-              if (!m_atomMatcher(m_query, queryTarget, m_mol, nbrAtom))
-                continue;
+  /**
+   * @brief A query compiled for isomorphism searches.
+   *
+   * Compiling a query computes the order in which the query atoms and bonds
+   * are matched. This order only depends on the query, an IsomorphismQuery
+   * can be reused for searching any number of molecules using an
+   * IsomorphismMatcher.
+   *
+   * The search starts from the most selective query atom. Atoms with rare
+   * elements are preferred over nitrogen, oxygen and carbon atoms (and '*'
+   * atoms which are assumed to match anything). Between atoms with equally
+   * common elements, the atom with the highest degree is used. The bonds
+   * are visited in depth-first order from this atom. If the query is
+   * disconnected, each connected component starts from its most selective
+   * atom.
+   */
+  template<typename QueryType>
+  class IsomorphismQuery
+  {
+    public:
+      typedef typename molecule_traits<QueryType>::atom_type query_atom_type;
+      typedef typename molecule_traits<QueryType>::bond_type query_bond_type;
+      typedef typename molecule_traits<QueryType>::incident_iter query_incident_iter;
+
+      /**
+       * @brief A single step in the matching order.
+       *
+       * A root step maps the target query atom to any unmapped atom. A bond
+       * step maps the query bond between the (already mapped) source atom
+       * and the target atom. For a ring closure the target atom is already
+       * mapped too and only the bond is checked.
+       */
+      struct Step
+      {
+        bool root; //!< True for a root step.
+        Index bond; //!< The query bond (bond steps only).
+        Index source; //!< The mapped query atom (bond steps only).
+        Index target; //!< The query atom to map.
+        bool ringClosure; //!< True if the target is already mapped (bond steps only).
+        int degree; //!< The minimum degree of an atom to map the target to.
+      };
+
+      /**
+       * Constructor.
+       *
+       * @param query The query, this must stay valid during the lifetime of
+       *        the IsomorphismQuery.
+       */
+      IsomorphismQuery(QueryType &query) : m_query(query)
+      {
+        std::vector<bool> visitedAtoms(num_atoms(query));
+        std::vector<bool> visitedBonds(num_bonds(query));
+
+        while (true) {
+          // find the most selective atom that is not visited
+          int root = -1;
+          for (Index i = 0; i < num_atoms(query); ++i)
+            if (!visitedAtoms[i] && (root == -1 || moreSelective(i, root)))
+              root = i;
+          if (root == -1)
+            break;
+
+          query_atom_type atom = get_atom(query, root);
+          Step step = { true, 0, 0, static_cast<Index>(root), false, get_degree(query, atom) };
+          m_steps.push_back(step);
+          visitedAtoms[root] = true;
+
+          dfs(atom, visitedAtoms, visitedBonds);
+        }
+      }
+
+      /**
+       * Get the query.
+       */
+      QueryType& query() const
+      {
+        return m_query;
+      }
+
+      /**
+       * Get the steps in matching order.
+       */
+      const std::vector<Step>& steps() const
+      {
+        return m_steps;
+      }
+
+    private:
+      /**
+       * Get the relative frequency of an element (0 for rare elements).
+       */
+      static int elementFrequency(int element)
+      {
+        switch (element) {
+          case 0:
+            return 4;
+          case 6:
+            return 3;
+          case 8:
+            return 2;
+          case 7:
+            return 1;
+          default:
+            return 0;
+        }
+      }
+
+      bool moreSelective(Index atom1, Index atom2) const
+      {
+        query_atom_type a1 = get_atom(m_query, atom1);
+        query_atom_type a2 = get_atom(m_query, atom2);
+        int frequency1 = elementFrequency(get_element(m_query, a1));
+        int frequency2 = elementFrequency(get_element(m_query, a2));
+        if (frequency1 != frequency2)
+          return frequency1 < frequency2;
+        return get_degree(m_query, a1) > get_degree(m_query, a2);
+      }
+
+      void dfs(query_atom_type atom, std::vector<bool> &visitedAtoms, std::vector<bool> &visitedBonds)
+      {
+        query_incident_iter bond, end_bonds;
+        TIE(bond, end_bonds) = get_bonds(m_query, atom);
+        for (; bond != end_bonds; ++bond) {
+          if (visitedBonds[get_index(m_query, *bond)])
+            continue;
+          visitedBonds[get_index(m_query, *bond)] = true;
+
+          query_atom_type other = get_other(m_query, *bond, atom);
+          Step step = { false, get_index(m_query, *bond), get_index(m_query, atom), get_index(m_query, other),
+                        visitedAtoms[get_index(m_query, other)], get_degree(m_query, other) };
+          m_steps.push_back(step);
+          visitedAtoms[get_index(m_query, other)] = true;
+
+          dfs(other, visitedAtoms, visitedBonds);
+        }
+      }
 
-              if (DEBUG_ISOMORPHISM)
-                std::cout << get_index(m_query, queryTarget) << " -> " << get_index(m_mol, nbrAtom) << std::endl;
+      QueryType &m_query; // the query
+      std::vector<Step> m_steps; // the matching order
+  };
 
-              // map the target atom
-              m_map[get_index(m_query, queryTarget)] = get_index(m_mol, nbrAtom);
-              //print_map(m_map);
-            }
+  /**
+   * @brief Reusable state for matching a compiled query against molecules.
+   *
+   * The matcher keeps the current mapping, a bitset of the mapped atoms and
+   * the hash set used to ensure the mappings are unique between searches.
+   * This avoids allocations when searching many molecules. A matcher should
+   * only be used by a single thread, multiple matchers may share the same
+   * IsomorphismQuery.
+   *
+   * @code
+   * IsomorphismQuery<HeMol> compiled(query);
+   * IsomorphismMatcher<DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol> matcher(compiled);
+   * for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+   *   file.read_molecule(i, mol);
+   *   if (matcher.match(mol))
+   *     hits.push_back(i);
+   * }
+   * @endcode
+   */
+  template<template <typename, typename> class AtomMatcher, template<typename, typename> class BondMatcher,
+           typename MoleculeType, typename QueryType>
+  class IsomorphismMatcher
+  {
+    public:
+      typedef typename molecule_traits<QueryType>::atom_type query_atom_type;
+      typedef typename molecule_traits<QueryType>::bond_type query_bond_type;
+
+      typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
+      typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
+      typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
+
+      typedef typename IsomorphismQuery<QueryType>::Step Step;
+
+      /**
+       * Constructor.
+       *
+       * @param query The compiled query, this must stay valid during the
+       *        lifetime of the matcher.
+       */
+      IsomorphismMatcher(const IsomorphismQuery<QueryType> &query) : m_query(query), m_mol(0),
+          m_token(0), m_cancelled(false)
+      {
+        m_map.resize(num_atoms(query.query()), -1);
+      }
+
+      /**
+       * Perform a subgraph isomorphism search for the query in the molecule.
+       *
+       * @param mol The molecule (queried).
+       * @param mapping The desired mapping (e.g. NoMapping, SingleMapping, ...).
+       *
+       * @return True if the query is a substructure of @p mol.
+       */
+      template<typename MappingType>
+      bool match(MoleculeType &mol, MappingType &mapping)
+      {
+        impl::clear_mappig(mapping);
+
+        if (!num_atoms(m_query.query()))
+          return false;
+
+        m_mol = &mol;
+        if (m_mapped.size() < num_atoms(mol))
+          m_mapped.resize(num_atoms(mol));
+        m_mappings.clear();
+        m_check = CancellationCheck(m_token);
+        m_cancelled = false;
+        HELIUM_COUNT(CandidatesVerified, 1);
+
+        match(mapping, 0);
+
+        return !impl::empty_mappig(mapping);
+      }
+
+      /**
+       * @overload
+       */
+      bool match(MoleculeType &mol)
+      {
+        NoMapping mapping;
+        return match(mol, mapping);
+      }
+
+      /**
+       * Set the cancellation token for subsequent match() calls. The token
+       * is checked every 256 search steps and the search stops once it has
+       * expired. A null token (the default) disables the check.
+       *
+       * @param token The token, this must stay valid while matching.
+       */
+      void setCancellationToken(const CancellationToken *token)
+      {
+        m_token = token;
+      }
+
+      /**
+       * Check if the last match() call was stopped because the cancellation
+       * token expired. If true, the returned mappings are partial and a
+       * false return value does not mean the query is not a substructure.
+       */
+      bool cancelled() const
+      {
+        return m_cancelled;
+      }
+
+    private:
+      template<typename MappingType>
+      void addMapping(MappingType &mapping)
+      {
+        if (DEBUG_ISOMORPHISM) {
+          std::cout << "found mapping..." << std::endl;
+          impl::print_map(m_map);
+        }
 
-            if (bondIndex + 1 == m_dfsBonds.size()) {
-              if (DEBUG_ISOMORPHISM) {
-                std::cout << "found mapping..." << std::endl;
-                print_map(m_map);
-              }
+        if (MappingType::single) {
+          impl::add_mapping(mapping, m_map);
+          return;
+        }
 
-              // create bit mask of atoms (to ensure uniqueness of mapping)
-              std::vector<bool> atoms(num_atoms(m_mol));
-              for (std::size_t i = 0; i < m_map.size(); ++i)
-                atoms[m_map[i]] = true;
+        // add the mapping to the result if the set of atoms is unique
+        m_key = m_map;
+        std::sort(m_key.begin(), m_key.end());
+        if (m_mappings.insert(m_key))
+          impl::add_mapping(mapping, m_map);
+      }
+
+      template<typename MappingType>
+      void mapAtom(MappingType &mapping, std::size_t stepIndex, Index queryAtom, Index atom)
+      {
+        if (DEBUG_ISOMORPHISM)
+          std::cout << queryAtom << " -> " << atom << std::endl;
+
+        m_map[queryAtom] = atom;
+        m_mapped[atom] = true;
+
+        match(mapping, stepIndex + 1);
+
+        // backtrack
+        HELIUM_COUNT(IsomorphismBacktracks, 1);
+        m_map[queryAtom] = -1;
+        m_mapped[atom] = false;
+      }
+
+      template<typename MappingType>
+      void match(MappingType &mapping, std::size_t stepIndex)
+      {
+        if (m_check()) {
+          m_cancelled = true;
+          return;
+        }
 
-              // add the mapping to the result if it is unique
-              if (m_mappings.find(atoms) == m_mappings.end()) {
-                m_mappings.insert(atoms);
-                add_mapping(mapping, m_map);
-              }
-            } else
-              match(mapping, bondIndex + 1);
+        const std::vector<Step> &steps = m_query.steps();
+        if (stepIndex == steps.size()) {
+          addMapping(mapping);
+          return;
+        }
 
-            // bracktrack target atom
-            if (!isRingClosure) {
-              if (DEBUG_ISOMORPHISM)
-                std::cout << "backtrack: " << get_index(m_query, queryTarget) << std::endl;
+        QueryType &query = m_query.query();
+        MoleculeType &mol = *m_mol;
+        const Step &step = steps[stepIndex];
+        query_atom_type queryTarget = get_atom(query, step.target);
+
+        if (step.root) {
+          // try to match each unmapped atom in the molecule
+          atom_iter atom, end_atoms;
+          TIE(atom, end_atoms) = get_atoms(mol);
+          for (; atom != end_atoms; ++atom) {
+            Index index = get_index(mol, *atom);
+            if (m_mapped[index] || get_degree(mol, *atom) < step.degree)
+              continue;
+            if (!m_atomMatcher(query, queryTarget, mol, *atom))
+              continue;
 
-              m_map[get_index(m_query, queryTarget)] = -1;
-            }
+            mapAtom(mapping, stepIndex, step.target, index);
 
             // exit as soon as possible if only one match is required
-            if (MappingType::single && !empty_mappig(mapping))
+            if (m_cancelled || (MappingType::single && !impl::empty_mappig(mapping)))
               return;
           }
+          return;
+        }
 
+        query_bond_type queryBond = get_bond(query, step.bond);
+        atom_type atom = get_atom(mol, m_map[step.source]);
 
-        }
+        incident_iter bond, end_bonds;
+        TIE(bond, end_bonds) = get_bonds(mol, atom);
+        for (; bond != end_bonds; ++bond) {
+          if (!m_bondMatcher(query, queryBond, mol, *bond))
+            continue;
 
-        void match(MappingType &mapping)
-        {
-          if (!num_atoms(m_query))
-            return;
+          Index nbr = get_index(mol, get_other(mol, *bond, atom));
 
-          if (!num_bonds(m_query)) {
-            query_atom_type queryAtom = get_atom(m_query, 0);
+          if (step.ringClosure) {
+            if (m_map[step.target] != nbr)
+              continue;
+            match(mapping, stepIndex + 1);
+          } else {
+            if (m_mapped[nbr])
+              continue;
+            atom_type nbrAtom = get_atom(mol, nbr);
+            if (get_degree(mol, nbrAtom) < step.degree)
+              continue;
+            if (!m_atomMatcher(query, queryTarget, mol, nbrAtom))
+              continue;
 
-            atom_iter atom, end_atoms;
-            TIE(atom, end_atoms) = get_atoms(m_mol);
-            for (; atom != end_atoms; ++atom) {
-              if (!m_atomMatcher(m_query, queryAtom, m_mol, *atom))
-                continue;
+            mapAtom(mapping, stepIndex, step.target, nbr);
+          }
 
-              if (DEBUG_ISOMORPHISM)
-                std::cout << get_index(m_query, queryAtom) << " -> " << get_index(m_mol, *atom) << std::endl;
+          // exit as soon as possible if only one match is required
+          if (m_cancelled || (MappingType::single && !impl::empty_mappig(mapping)))
+            return;
+        }
+      }
+
+      AtomMatcher<MoleculeType, QueryType> m_atomMatcher;
+      BondMatcher<MoleculeType, QueryType> m_bondMatcher;
+      const IsomorphismQuery<QueryType> &m_query; // the compiled query
+      MoleculeType *m_mol; // the queried molecule
+      IsomorphismMapping m_map; // current mapping: query atom index -> queried atom index
+      std::vector<bool> m_mapped; // the queried atoms in the current mapping
+      impl::MappingHashSet m_mappings; // keep track of unique mappings
+      IsomorphismMapping m_key; // sorted mapping used as key in m_mappings
+      const CancellationToken *m_token; // optional cancellation token
+      CancellationCheck m_check; // amortized check of m_token
+      bool m_cancelled; // true if the last search was cancelled
+  };
 
-              // map the source atom
-              m_map[get_index(m_query, queryAtom)] = get_index(m_mol, *atom);
+  /**
+   * @brief Candidate domain matcher for large substructure queries.
+   *
+   * An alternative to the IsomorphismMatcher with the same interface. The
+   * IsomorphismMatcher extends the mapping bond by bond without any
+   * lookahead which causes a lot of backtracking for large or symmetric
+   * queries (e.g. steroid or macrocycle cores). This matcher keeps a domain
+   * for each query atom: a bitset of the molecule atoms it can still be
+   * mapped to. The domains are refined using arc consistency before and
+   * during the search. A query atom can only be mapped to an atom with a
+   * neighbour (over a matching bond) in the domain of each adjacent query
+   * atom. This is computed for all atoms at once by OR-ing the neighbour
+   * bitsets of the candidates and AND-ing the result with the adjacent
+   * domain (Ullmann's refinement).
+   *
+   * The search maps the query atom with the smallest domain first. Mapping
+   * an atom removes it from the other domains and restricts the domains of
+   * the adjacent query atoms to its neighbours, followed by another
+   * refinement. Any empty domain ends the branch.
+   *
+   * The mappings found are the same as those found by the
+   * IsomorphismMatcher, only the order in which they are found differs. The
+   * overhead of maintaining the domains makes this matcher slower for
+   * small queries.
+   *
+   * @code
+   * IsomorphismQuery<HeMol> compiled(query);
+   * DomainIsomorphismMatcher<DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol> matcher(compiled);
+   * CountMapping count;
+   * matcher.match(mol, count);
+   * @endcode
+   */
+  template<template <typename, typename> class AtomMatcher, template<typename, typename> class BondMatcher,
+           typename MoleculeType, typename QueryType>
+  class DomainIsomorphismMatcher
+  {
+    public:
+      typedef typename molecule_traits<QueryType>::atom_type query_atom_type;
+      typedef typename molecule_traits<QueryType>::bond_type query_bond_type;
+      typedef typename molecule_traits<QueryType>::atom_iter query_atom_iter;
+      typedef typename molecule_traits<QueryType>::bond_iter query_bond_iter;
+
+      typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
+      typedef typename molecule_traits<MoleculeType>::bond_type bond_type;
+      typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
+      typedef typename molecule_traits<MoleculeType>::bond_iter bond_iter;
+
+      typedef typename IsomorphismQuery<QueryType>::Step Step;
+
+      /**
+       * Constructor.
+       *
+       * @param query The compiled query, this must stay valid during the
+       *        lifetime of the matcher.
+       */
+      DomainIsomorphismMatcher(const IsomorphismQuery<QueryType> &query) : m_query(query), m_mol(0),
+          m_numWords(0), m_token(0), m_cancelled(false)
+      {
+        QueryType &q = query.query();
+        m_map.resize(num_atoms(q), -1);
+        m_queued.resize(num_atoms(q));
+        m_nbrs.resize(num_atoms(q));
+
+        // the query atom adjacency, (bond, neighbour) pairs
+        query_bond_iter bond, end_bonds;
+        TIE(bond, end_bonds) = get_bonds(q);
+        for (; bond != end_bonds; ++bond) {
+          Index index = get_index(q, *bond);
+          Index source = get_index(q, get_source(q, *bond));
+          Index target = get_index(q, get_target(q, *bond));
+          m_nbrs[source].push_back(std::make_pair(index, target));
+          m_nbrs[target].push_back(std::make_pair(index, source));
+        }
+
+        // the position of the atoms in the matching order, used to break ties
+        m_rank.resize(num_atoms(q));
+        int rank = 0;
+        const std::vector<Step> &steps = query.steps();
+        for (std::size_t i = 0; i < steps.size(); ++i)
+          if (!steps[i].ringClosure)
+            m_rank[steps[i].target] = rank++;
+      }
+
+      /**
+       * Perform a subgraph isomorphism search for the query in the molecule.
+       *
+       * @param mol The molecule (queried).
+       * @param mapping The desired mapping (e.g. NoMapping, SingleMapping, ...).
+       *
+       * @return True if the query is a substructure of @p mol.
+       */
+      template<typename MappingType>
+      bool match(MoleculeType &mol, MappingType &mapping)
+      {
+        impl::clear_mappig(mapping);
+
+        if (!num_atoms(m_query.query()) || num_atoms(m_query.query()) > num_atoms(mol))
+          return false;
+
+        m_mol = &mol;
+        m_mappings.clear();
+        m_check = CancellationCheck(m_token);
+        m_cancelled = false;
+        HELIUM_COUNT(CandidatesVerified, 1);
+
+        if (initialize())
+          match(mapping, 0);
+
+        return !impl::empty_mappig(mapping);
+      }
+
+      /**
+       * @overload
+       */
+      bool match(MoleculeType &mol)
+      {
+        NoMapping mapping;
+        return match(mol, mapping);
+      }
+
+      /**
+       * Set the cancellation token for subsequent match() calls. The token
+       * is checked for every mapped atom and the search stops once it has
+       * expired. A null token (the default) disables the check.
+       *
+       * @param token The token, this must stay valid while matching.
+       */
+      void setCancellationToken(const CancellationToken *token)
+      {
+        m_token = token;
+      }
+
+      /**
+       * Check if the last match() call was stopped because the cancellation
+       * token expired. If true, the returned mappings are partial and a
+       * false return value does not mean the query is not a substructure.
+       */
+      bool cancelled() const
+      {
+        return m_cancelled;
+      }
+
+    private:
+      /**
+       * Get the domain of a query atom at a search depth.
+       */
+      Word* domain(std::size_t depth, Index queryAtom)
+      {
+        return &m_domains[(depth * m_map.size() + queryAtom) * m_numWords];
+      }
+
+      /**
+       * Get the molecule atoms bonded to @p atom by a bond matching the
+       * query bond.
+       */
+      Word* neighbours(Index queryBond, Index atom)
+      {
+        return &m_bondMasks[(queryBond * num_atoms(*m_mol) + atom) * m_numWords];
+      }
+
+      bool isEmpty(const Word *bitvec) const
+      {
+        for (int i = 0; i < m_numWords; ++i)
+          if (bitvec[i])
+            return false;
+        return true;
+      }
+
+      void enqueue(Index queryAtom)
+      {
+        if (m_queued[queryAtom])
+          return;
+        m_queued[queryAtom] = true;
+        m_queue.push_back(queryAtom);
+      }
+
+      /**
+       * Compute the initial domains and neighbour bitsets for the molecule
+       * and make the domains arc consistent.
+       *
+       * @return False if a domain is empty.
+       */
+      bool initialize()
+      {
+        QueryType &query = m_query.query();
+        MoleculeType &mol = *m_mol;
+        Index numQueryAtoms = num_atoms(query);
+        m_numWords = bitvec_num_words_for_bits(num_atoms(mol));
+
+        m_domains.assign((numQueryAtoms + 1) * numQueryAtoms * m_numWords, 0);
+        m_bondMasks.assign(num_bonds(query) * num_atoms(mol) * m_numWords, 0);
+        m_support.resize(m_numWords);
+
+        // the atoms matching each query atom (with a sufficient degree)
+        query_atom_iter queryAtom, end_query_atoms;
+        TIE(queryAtom, end_query_atoms) = get_atoms(query);
+        for (; queryAtom != end_query_atoms; ++queryAtom) {
+          Word *D = domain(0, get_index(query, *queryAtom));
+          int degree = get_degree(query, *queryAtom);
+          atom_iter atom, end_atoms;
+          TIE(atom, end_atoms) = get_atoms(mol);
+          for (; atom != end_atoms; ++atom)
+            if (get_degree(mol, *atom) >= degree && m_atomMatcher(query, *queryAtom, mol, *atom))
+              bitvec_set(get_index(mol, *atom), D);
+          if (isEmpty(D))
+            return false;
+        }
+
+        // the neighbours over bonds matching each query bond
+        query_bond_iter queryBond, end_query_bonds;
+        TIE(queryBond, end_query_bonds) = get_bonds(query);
+        for (; queryBond != end_query_bonds; ++queryBond) {
+          Index queryIndex = get_index(query, *queryBond);
+          bond_iter bond, end_bonds;
+          TIE(bond, end_bonds) = get_bonds(mol);
+          for (; bond != end_bonds; ++bond) {
+            if (!m_bondMatcher(query, *queryBond, mol, *bond))
+              continue;
+            Index source = get_index(mol, get_source(mol, *bond));
+            Index target = get_index(mol, get_target(mol, *bond));
+            bitvec_set(target, neighbours(queryIndex, source));
+            bitvec_set(source, neighbours(queryIndex, target));
+          }
+        }
 
-              add_mapping(mapping, m_map);
+        for (Index i = 0; i < numQueryAtoms; ++i)
+          enqueue(i);
+        return refine(0);
+      }
+
+      /**
+       * Make the domains of the unmapped query atoms at a search depth arc
+       * consistent with the domains of the queued query atoms (AC-3).
+       *
+       * @return False if a domain is empty.
+       */
+      bool refine(std::size_t depth)
+      {
+        bool consistent = true;
+        for (std::size_t i = 0; i < m_queue.size(); ++i) {
+          Index a = m_queue[i];
+          m_queued[a] = false;
+          if (!consistent)
+            continue;
+
+          const Word *Da = domain(depth, a);
+          for (std::size_t j = 0; j < m_nbrs[a].size(); ++j) {
+            Index b = m_nbrs[a][j].second;
+            if (m_map[b] != -1)
+              continue;
 
-              if (DEBUG_ISOMORPHISM)
-                std::cout << "backtrack: " << get_index(m_query, queryAtom) << std::endl;
-              m_map[get_index(m_query, queryAtom)] = -1;
+            // the atoms supported by a candidate for a
+            std::fill(m_support.begin(), m_support.end(), 0);
+            for (int w = 0; w < m_numWords; ++w)
+              for (Word word = Da[w]; word; word &= word - 1) {
+                const Word *nbrs = neighbours(m_nbrs[a][j].first, w * BitsPerWord + __builtin_ctzll(word));
+                for (int k = 0; k < m_numWords; ++k)
+                  m_support[k] |= nbrs[k];
+              }
 
-              if (MappingType::single && !empty_mappig(mapping))
-                return;
+            Word *Db = domain(depth, b);
+            bool changed = false;
+            for (int w = 0; w < m_numWords; ++w) {
+              Word word = Db[w] & m_support[w];
+              changed |= word != Db[w];
+              Db[w] = word;
             }
-          } else {
-            query_atom_type queryAtom = m_bondSwap[0] ? get_target(m_query, get_bond(m_query, m_dfsBonds[0])) : get_source(m_query, get_bond(m_query, m_dfsBonds[0]));
 
-            // try to match each atom in the molecule against the first atom
-            // epxression in the SMARTS
-            atom_iter atom, end_atoms;
-            TIE(atom, end_atoms) = get_atoms(m_mol);
-            for (; atom != end_atoms; ++atom) {
-              if (!m_atomMatcher(m_query, queryAtom, m_mol, *atom))
-                continue;
+            if (!changed)
+              continue;
+            if (isEmpty(Db)) {
+              consistent = false;
+              break;
+            }
+            enqueue(b);
+          }
+        }
 
-              if (DEBUG_ISOMORPHISM)
-                std::cout << get_index(m_query, queryAtom) << " -> " << get_index(m_mol, *atom) << std::endl;
+        m_queue.clear();
+        return consistent;
+      }
+
+      /**
+       * Select the unmapped query atom with the smallest domain.
+       */
+      Index select(std::size_t depth)
+      {
+        Index best = 0;
+        int bestSize = -1;
+        for (Index i = 0; i < m_map.size(); ++i) {
+          if (m_map[i] != -1)
+            continue;
+          int size = bitvec_count(domain(depth, i), m_numWords);
+          if (bestSize == -1 || size < bestSize || (size == bestSize && m_rank[i] < m_rank[best])) {
+            best = i;
+            bestSize = size;
+          }
+        }
+        return best;
+      }
+
+      /**
+       * Map a query atom and refine the domains for the next depth.
+       *
+       * @return False if a domain is empty.
+       */
+      bool assign(std::size_t depth, Index queryAtom, Index atom)
+      {
+        m_map[queryAtom] = atom;
+
+        Word *next = domain(depth + 1, 0);
+        std::copy(domain(depth, 0), domain(depth, 0) + m_map.size() * m_numWords, next);
+
+        Word *D = domain(depth + 1, queryAtom);
+        bitvec_zero(D, m_numWords);
+        bitvec_set(atom, D);
+        enqueue(queryAtom);
+
+        // the atom can not be mapped to any other query atom
+        for (Index i = 0; i < m_map.size(); ++i) {
+          if (m_map[i] != -1)
+            continue;
+          Word *Di = domain(depth + 1, i);
+          if (!bitvec_get(atom, Di))
+            continue;
+          bitvec_reset(atom, Di);
+          if (isEmpty(Di)) {
+            for (std::size_t j = 0; j < m_queue.size(); ++j)
+              m_queued[m_queue[j]] = false;
+            m_queue.clear();
+            return false;
+          }
+          enqueue(i);
+        }
 
-              // map the source atom
-              m_map[get_index(m_query, queryAtom)] = get_index(m_mol, *atom);
+        return refine(depth + 1);
+      }
 
-              match(mapping, 0);
+      template<typename MappingType>
+      void addMapping(MappingType &mapping)
+      {
+        if (MappingType::single) {
+          impl::add_mapping(mapping, m_map);
+          return;
+        }
 
-              if (DEBUG_ISOMORPHISM)
-                std::cout << "backtrack: " << get_index(m_query, queryAtom) << std::endl;
-              m_map[get_index(m_query, queryAtom)] = -1;
+        // add the mapping to the result if the set of atoms is unique
+        m_key = m_map;
+        std::sort(m_key.begin(), m_key.end());
+        if (m_mappings.insert(m_key))
+          impl::add_mapping(mapping, m_map);
+      }
+
+      template<typename MappingType>
+      void match(MappingType &mapping, std::size_t depth)
+      {
+        if (m_check()) {
+          m_cancelled = true;
+          return;
+        }
 
-              if (MappingType::single && !empty_mappig(mapping))
-                return;
-            }
-          }
+        if (depth == m_map.size()) {
+          addMapping(mapping);
+          return;
         }
 
-      private:
-        AtomMatcher<MoleculeType, QueryType> m_atomMatcher;
-        BondMatcher<MoleculeType, QueryType> m_bondMatcher;
-        MoleculeType &m_mol; // the queried molecule
-        QueryType &m_query; // the query
-        IsomorphismMapping  m_map; // current mapping: query atom index -> queried atom index
-        std::set<std::vector<bool> > m_mappings; // keep track of unique mappins
-        std::vector<Index> m_dfsBonds; // dfs bond order
-        std::vector<bool> m_bondSwap; // should source/target atoms be swapped
-    };
+        Index queryAtom = select(depth);
+        // the domain at this depth is not modified by deeper levels
+        const Word *D = domain(depth, queryAtom);
+        for (int w = 0; w < m_numWords; ++w)
+          for (Word word = D[w]; word; word &= word - 1) {
+            if (assign(depth, queryAtom, w * BitsPerWord + __builtin_ctzll(word)))
+              match(mapping, depth + 1);
 
-  }
+            // backtrack
+            HELIUM_COUNT(IsomorphismBacktracks, 1);
+            m_map[queryAtom] = -1;
+
+            // exit as soon as possible if only one match is required
+            if (m_cancelled || (MappingType::single && !impl::empty_mappig(mapping)))
+              return;
+          }
+      }
+
+      AtomMatcher<MoleculeType, QueryType> m_atomMatcher;
+      BondMatcher<MoleculeType, QueryType> m_bondMatcher;
+      const IsomorphismQuery<QueryType> &m_query; // the compiled query
+      MoleculeType *m_mol; // the queried molecule
+      std::vector<std::vector<std::pair<Index, Index> > > m_nbrs; // query atom -> (query bond, query atom)
+      std::vector<int> m_rank; // query atom -> position in the matching order
+      int m_numWords; // the number of words in a domain
+      std::vector<Word> m_domains; // the domains for each depth, depth -> query atom -> bitset
+      std::vector<Word> m_bondMasks; // query bond -> atom -> bitset of neighbours over matching bonds
+      std::vector<Word> m_support; // scratch bitset for refine()
+      std::vector<Index> m_queue; // query atoms with changed domains
+      std::vector<bool> m_queued; // the query atoms in m_queue
+      IsomorphismMapping m_map; // current mapping: query atom index -> queried atom index
+      impl::MappingHashSet m_mappings; // keep track of unique mappings
+      IsomorphismMapping m_key; // sorted mapping used as key in m_mappings
+      const CancellationToken *m_token; // optional cancellation token
+      CancellationCheck m_check; // amortized check of m_token
+      bool m_cancelled; // true if the last search was cancelled
+  };
 
   /**
    * @brief The default atom matcher for isomorphism searches.
@@ -401,7 +1055,13 @@ namespace Helium {
 
   /**
    * Perform a subgraph isomorphism search for the specified query in the
-   * molecule.
+   * molecule using the specified matcher (IsomorphismMatcher or
+   * DomainIsomorphismMatcher).
+   *
+   * @code
+   * CountMapping count;
+   * isomorphism_search<DomainIsomorphismMatcher, DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol>(mol, query, count);
+   * @endcode
    *
    * @param mol The molecule (queried).
    * @param query The query.
@@ -409,18 +1069,46 @@ namespace Helium {
    *
    * @return True if the query is a substructure of @p mol.
    */
-  template<template <typename, typename> class AtomMatcher, template <typename, typename> class BondMatcher, typename MoleculeType, typename QueryType, typename MappingType>
+  template<template<template<typename, typename> class, template<typename, typename> class, typename, typename> class Matcher,
+           template<typename, typename> class AtomMatcher, template<typename, typename> class BondMatcher,
+           typename MoleculeType, typename QueryType, typename MappingType>
   bool isomorphism_search(MoleculeType &mol, QueryType &query, MappingType &mapping)
   {
-    impl::clear_mappig(mapping);
-
-    if (!num_atoms(query))
-      return false;
+    IsomorphismQuery<QueryType> compiled(query);
+    Matcher<AtomMatcher, BondMatcher, MoleculeType, QueryType> matcher(compiled);
+    return matcher.match(mol, mapping);
+  }
 
-    impl::Isomorphism<AtomMatcher, BondMatcher, MoleculeType, QueryType, MappingType> iso(mol, query);
-    iso.match(mapping);
+  /**
+   * @overload
+   */
+  template<template<template<typename, typename> class, template<typename, typename> class, typename, typename> class Matcher,
+           template<typename, typename> class AtomMatcher, template<typename, typename> class BondMatcher,
+           typename MoleculeType, typename QueryType>
+  bool isomorphism_search(MoleculeType &mol, QueryType &query)
+  {
+    NoMapping mapping;
+    return isomorphism_search<Matcher, AtomMatcher, BondMatcher, MoleculeType, QueryType>(mol, query, mapping);
+  }
 
-    return !impl::empty_mappig(mapping);
+  /**
+   * Perform a subgraph isomorphism search for the specified query in the
+   * molecule.
+   *
+   * @param mol The molecule (queried).
+   * @param query The query.
+   * @param mapping The desired mapping (e.g. NoMapping, SingleMapping, ...).
+   *
+   * When searching the same query in many molecules, the IsomorphismQuery
+   * and IsomorphismMatcher classes should be used to only compile the query
+   * once.
+   *
+   * @return True if the query is a substructure of @p mol.
+   */
+  template<template <typename, typename> class AtomMatcher, template <typename, typename> class BondMatcher, typename MoleculeType, typename QueryType, typename MappingType>
+  bool isomorphism_search(MoleculeType &mol, QueryType &query, MappingType &mapping)
+  {
+    return isomorphism_search<IsomorphismMatcher, AtomMatcher, BondMatcher, MoleculeType, QueryType>(mol, query, mapping);
   }
 
   /**
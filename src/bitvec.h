@@ -29,12 +29,14 @@
 
 #include <Helium/config.h>
 #include <Helium/contract.h>
+#include <Helium/bitvec_kernels.h>
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cassert>
 #include <cmath>
+#include <algorithm>
 
 #ifdef _MSC_VER
 #include <cstdint>
@@ -200,6 +202,27 @@ namespace Helium {
     return true;
   }
 
+  /**
+   * @brief Check if two bit vectors are equal.
+   *
+   * @pre Both bitvec1 and bitvec2 pointers must be valid.
+   *
+   * @param bitvec1 The first bit vector.
+   * @param bitvec2 The second bit vector.
+   * @param numWords The number of words for @p bitvec1 and @p bitvec2.
+   *
+   * @return True if all words of both bit vectors are equal.
+   */
+  inline bool bitvec_equal(const Word *bitvec1, const Word *bitvec2, int numWords)
+  {
+    PRE(bitvec1);
+    PRE(bitvec2);
+    for (int i = 0; i < numWords; ++i)
+      if (bitvec1[i] != bitvec2[i])
+        return false;
+    return true;
+  }
+
   /**
    * @brief Get the population count for a single word.
    *
@@ -231,8 +254,8 @@ namespace Helium {
    * @brief Get the population count for a bit vector.
    *
    * Get the bit count (i.e. number of bits set to 1 or the population count)
-   * for a single bit vector word. When compiling with g++, the builtin function
-   * wrapper for the POPCNT instruction is used.
+   * for a bit vector. The fastest kernel supported by the CPU (AVX-512
+   * VPOPCNTDQ, AVX2, POPCNT or scalar) is selected at runtime.
    *
    * @pre The bitvec pointer must be valid.
    *
@@ -244,24 +267,7 @@ namespace Helium {
   inline int bitvec_count(const Word *bitvec, int numWords)
   {
     PRE(bitvec);
-#ifdef HAVE_POPCNT
-    // use popcount
-    int count = 0;
-    for (int i = 0; i < numWords; ++i)
-      count += __builtin_popcountl(*(bitvec + i));
-    return count;
-#else
-    int count = 0;
-    for (int i = 0; i < numWords; ++i) {
-      Word bit = 1;
-      for (int j = 0; j < BitsPerWord; ++j) {
-        if (bit & bitvec[i])
-          ++count;
-        bit <<= 1;
-      }
-    }
-    return count;
-#endif
+    return impl::bitvec_kernels().count(bitvec, numWords);
   }
 
 
@@ -299,6 +305,35 @@ namespace Helium {
     return count;
   }
 
+  /**
+   * @brief Get the population count for a part of a bit vector.
+   *
+   * The @p numBits bits are divided in @p numParts consecutive parts of
+   * numBits / numParts bits, the last part also contains the remaining bits.
+   * These are the parts used by the kD-grid of the SimilaritySearchIndex.
+   *
+   * @pre The bitvec pointer must be valid and @p numParts must not be larger
+   *      than @p numBits.
+   *
+   * @param bitvec The bit vector.
+   * @param numBits The number of bits in the bit vector.
+   * @param numParts The number of parts.
+   * @param part The part in the range [0,numParts).
+   *
+   * @return The bit count for the part.
+   */
+  inline int bitvec_part_count(const Word *bitvec, int numBits, int numParts, int part)
+  {
+    PRE(numParts > 0 && numParts <= numBits);
+    int beginBit = part * (numBits / numParts);
+    int endBit = (part + 1) * (numBits / numParts);
+
+    if (part == numParts - 1)
+      endBit = (part + 1) * (numBits / numParts) + (numBits % ((part + 1) * (numBits / numParts)));
+
+    return bitvec_count(bitvec, beginBit, endBit);
+  }
+
 
   /**
    * @brief Get the population count for the union of two bit vectors.
@@ -318,20 +353,7 @@ namespace Helium {
   {
     PRE(bitvec1);
     PRE(bitvec2);
-    int count = 0;
-
-    for (int i = 0; i < numWords; ++i) {
-      Word andfp = bitvec1[i] & bitvec2[i];
-#ifdef HAVE_POPCNT
-      count += __builtin_popcountl(andfp);
-#else
-      for (; andfp; andfp = andfp << 1)
-        if (andfp < 0)
-          ++count;
-#endif
-    }
-
-    return count;
+    return impl::bitvec_kernels().andCount(bitvec1, bitvec2, numWords);
   }
 
   /**
@@ -357,25 +379,8 @@ namespace Helium {
   {
     PRE(bitvec1);
     PRE(bitvec2);
-    int andCount = 0;
-    int orCount = 0;
-
-    for (int i = 0; i < numWords; ++i) {
-      Word andbv = bitvec1[i] & bitvec2[i];
-      Word orbv = bitvec1[i] | bitvec2[i];
-#ifdef HAVE_POPCNT
-      andCount += __builtin_popcountll(andbv);
-      orCount += __builtin_popcountll(orbv);
-#else
-      for (; andbv; andbv = andbv << 1)
-        if(andbv < 0)
-          ++andCount;
-      for (; orbv; orbv = orbv << 1)
-        if(orbv < 0)
-          ++orCount;
-#endif
-    }
-
+    int andCount, orCount;
+    impl::bitvec_kernels().andOrCount(bitvec1, bitvec2, numWords, andCount, orCount);
     return static_cast<double>(andCount) / orCount;
   }
 
@@ -408,6 +413,161 @@ namespace Helium {
     return static_cast<double>(andCount) / (bitCount1 + bitCount2 - andCount);
   }
 
+  /**
+   * @brief Compute the Tanimoto coefficients between a query and a block of
+   * bit vectors.
+   *
+   * The block contains @p n bit vectors stored in row-major order (i.e. bit
+   * vector i starts at @p block + i * @p stride where the stride defaults to
+   * @p numWords for contiguous bit vectors). Since the
+   * bit counts for the query and all bit vectors in the block are known, only
+   * the intersection has to be counted for each pair:
+   *
+   * \f[
+   *   T_{\mathrm{sim}} = \frac{| A \wedge B |}{|A| + |B| - | A \wedge B |}
+   * \f]
+   *
+   * @pre The query, block, blockCounts and out pointers must be valid.
+   *
+   * @param query The query bit vector (\f$A\f$).
+   * @param queryCount The bit count for the query (\f$|A|\f$).
+   * @param block The block of bit vectors (\f$B\f$).
+   * @param blockCounts The bit counts for the bit vectors in the block
+   *        (\f$|B|\f$).
+   * @param n The number of bit vectors in the block.
+   * @param numWords The number of words in the bit vectors.
+   * @param out Output array for the @p n Tanimoto coefficients.
+   * @param stride The number of words between consecutive bit vectors in
+   *        the block (0 for @p numWords).
+   */
+  inline void bitvec_tanimoto_batch(const Word *query, int queryCount, const Word *block,
+      const int *blockCounts, int n, int numWords, double *out, int stride = 0)
+  {
+    PRE(query);
+    PRE(block || !n);
+    PRE(blockCounts || !n);
+    PRE(out || !n);
+    if (!stride)
+      stride = numWords;
+    const impl::BitvecKernels &kernels = impl::bitvec_kernels_for_words(numWords);
+    for (int i = 0; i < n; ++i, block += stride) {
+      int andCount = kernels.andCount(query, block, numWords);
+      out[i] = static_cast<double>(andCount) / (queryCount + blockCounts[i] - andCount);
+    }
+  }
+
+  /**
+   * @name Fixed-width bit vector functions
+   *
+   * Overloads for bit vectors with a number of words known at compile time.
+   * The word loops are fully unrolled. The @p NumWords template parameter
+   * must be a multiple of 8 (e.g. 16, 32 and 64 for 1024, 2048 and 4096 bit
+   * fingerprints).
+   *
+   * @code
+   * double T = bitvec_tanimoto<16>(fp1, fp2);
+   * @endcode
+   */
+  //@{
+
+  /**
+   * @brief Get the population count for a fixed-width bit vector.
+   *
+   * @pre The bitvec pointer must be valid.
+   *
+   * @param bitvec The bit vector.
+   *
+   * @return The bit count.
+   */
+  template<int NumWords>
+  inline int bitvec_count(const Word *bitvec)
+  {
+    PRE(bitvec);
+    return impl::bitvec_fixed_kernels<NumWords>().count(bitvec, NumWords);
+  }
+
+  /**
+   * @brief Get the population count for the intersection of two fixed-width
+   * bit vectors.
+   *
+   * @pre Both bitvec1 and bitvec2 pointers must be valid.
+   *
+   * @param bitvec1 The first bit vector.
+   * @param bitvec2 The second bit vector.
+   *
+   * @return The population count for @p bitvec1 AND @p bitvec2.
+   */
+  template<int NumWords>
+  inline int bitvec_union_count(const Word *bitvec1, const Word *bitvec2)
+  {
+    PRE(bitvec1);
+    PRE(bitvec2);
+    return impl::bitvec_fixed_kernels<NumWords>().andCount(bitvec1, bitvec2, NumWords);
+  }
+
+  /**
+   * @brief Check if fixed-width @p bitvec1 is a subset of @p bitvec2.
+   *
+   * @pre Both bitvec1 and bitvec2 pointers must be valid.
+   *
+   * @param bitvec1 The subset bit vector.
+   * @param bitvec2 The superset bit vector.
+   *
+   * @return True if @p bitvec1 is a subset of @p bitvec2.
+   */
+  template<int NumWords>
+  inline bool bitvec_is_subset_superset(const Word *bitvec1, const Word *bitvec2)
+  {
+    PRE(bitvec1);
+    PRE(bitvec2);
+    Word notSubset = 0;
+    for (int i = 0; i < NumWords; ++i)
+      notSubset |= bitvec1[i] & ~bitvec2[i];
+    return !notSubset;
+  }
+
+  /**
+   * @brief Compute the Tanimoto coefficient for two fixed-width bit vectors.
+   *
+   * @pre Both bitvec1 and bitvec2 pointers must be valid.
+   *
+   * @param bitvec1 The first bit vector (\f$A\f$).
+   * @param bitvec2 The first bit vector (\f$B\f$).
+   *
+   * @return The Tanimoto coefficient of difference.
+   */
+  template<int NumWords>
+  inline double bitvec_tanimoto(const Word *bitvec1, const Word *bitvec2)
+  {
+    PRE(bitvec1);
+    PRE(bitvec2);
+    int andCount, orCount;
+    impl::bitvec_fixed_kernels<NumWords>().andOrCount(bitvec1, bitvec2, NumWords, andCount, orCount);
+    return static_cast<double>(andCount) / orCount;
+  }
+
+  /**
+   * @brief Compute the Tanimoto coefficient for two fixed-width bit vectors
+   * with known bit counts.
+   *
+   * @pre Both bitvec1 and bitvec2 pointers must be valid.
+   *
+   * @param bitvec1 The first bit vector (\f$A\f$).
+   * @param bitvec2 The first bit vector (\f$B\f$).
+   * @param bitCount1 The bit count for the first bit vector (\f$|A|\f$).
+   * @param bitCount2 The bit count for the second bit vector (\f$|B|\f$).
+   *
+   * @return The Tanimoto coefficient of difference.
+   */
+  template<int NumWords>
+  inline double bitvec_tanimoto(const Word *bitvec1, const Word *bitvec2, int bitCount1, int bitCount2)
+  {
+    int andCount = bitvec_union_count<NumWords>(bitvec1, bitvec2);
+    return static_cast<double>(andCount) / (bitCount1 + bitCount2 - andCount);
+  }
+
+  //@}
+
   /**
    * @brief Compute the Cosine coefficient of difference between two bit vectors.
    *
@@ -575,6 +735,142 @@ namespace Helium {
     return static_cast<double>(andCount * numWords * 8 * sizeof(Word)) / (bitvec_count(bitvec1, numWords) * bitvec_count(bitvec2, numWords));
   }
 
+  /**
+   * @brief Fold a bit vector by OR-ing its words.
+   *
+   * Word i of @p bitvec is OR-ed into word (i % @p foldedWords) of
+   * @p folded. This is equivalent to setting bit (j % (64 * @p foldedWords))
+   * for every bit j set in @p bitvec (e.g. folding a 2048-bit fingerprint to
+   * 1024 bits).
+   *
+   * @pre The bitvec and folded pointers must be valid and @p foldedWords must
+   *      be greater than 0.
+   *
+   * @param bitvec The bit vector to fold.
+   * @param numWords The number of words for @p bitvec.
+   * @param folded The folded bit vector, will be zeroed first.
+   * @param foldedWords The number of words for @p folded.
+   */
+  inline void bitvec_fold(const Word *bitvec, int numWords, Word *folded, int foldedWords)
+  {
+    PRE(bitvec);
+    PRE(folded);
+    PRE(foldedWords > 0);
+    bitvec_zero(folded, foldedWords);
+    for (int i = 0; i < numWords; i += foldedWords) {
+      int n = std::min(foldedWords, numWords - i);
+      for (int j = 0; j < n; ++j)
+        folded[j] |= bitvec[i + j];
+    }
+  }
+
+  namespace impl {
+
+    /**
+     * OR the lowest @p n bits of @p value into @p bitvec starting at bit
+     * index @p pos.
+     */
+    inline void bitvec_or_bits(Word *bitvec, int pos, Word value, int n)
+    {
+      if (n < BitsPerWord)
+        value &= (static_cast<Word>(1) << n) - 1;
+      int word = pos / BitsPerWord;
+      int offset = pos % BitsPerWord;
+      bitvec[word] |= value << offset;
+      if (offset && n + offset > BitsPerWord)
+        bitvec[word + 1] |= value >> (BitsPerWord - offset);
+    }
+
+  }
+
+  /**
+   * @brief Fold a bit vector using a modulus.
+   *
+   * For every bit j set in @p bitvec, bit (j % @p modulus) is set in
+   * @p folded. The fingerprint tools use a prime modulus (see
+   * previous_prime()). Instead of testing every bit, each input word is
+   * shifted into place: the 64 bits of a word map to at most two runs of
+   * consecutive bits in the folded bit vector when the modulus is at least
+   * 64. Smaller moduli use a bit by bit fold.
+   *
+   * @pre The bitvec and folded pointers must be valid and @p modulus must be
+   *      in the range [1, 64 * @p foldedWords].
+   *
+   * @param bitvec The bit vector to fold.
+   * @param numBits The number of bits in @p bitvec.
+   * @param folded The folded bit vector, will be zeroed first.
+   * @param foldedWords The number of words for @p folded.
+   * @param modulus The modulus.
+   */
+  inline void bitvec_fold(const Word *bitvec, int numBits, Word *folded, int foldedWords, int modulus)
+  {
+    PRE(bitvec);
+    PRE(folded);
+    PRE(modulus > 0 && modulus <= foldedWords * BitsPerWord);
+    bitvec_zero(folded, foldedWords);
+
+    if (modulus == foldedWords * BitsPerWord && (numBits % BitsPerWord) == 0) {
+      bitvec_fold(bitvec, numBits / BitsPerWord, folded, foldedWords);
+      return;
+    }
+
+    if (modulus < BitsPerWord) {
+      for (int j = 0; j < numBits; ++j)
+        if (bitvec_get(j, bitvec))
+          bitvec_set(j % modulus, folded);
+      return;
+    }
+
+    int numWords = bitvec_num_words_for_bits(numBits);
+    // start of the current input word in the folded bit vector
+    int start = 0;
+    for (int i = 0; i < numWords; ++i, start = (start + BitsPerWord) % modulus) {
+      Word word = bitvec[i];
+      // ignore bits past the end of bitvec
+      int n = std::min(BitsPerWord, numBits - i * BitsPerWord);
+      if (n < BitsPerWord)
+        word &= (static_cast<Word>(1) << n) - 1;
+      if (!word)
+        continue;
+
+      // first run: [start, min(start + 64, modulus))
+      int first = std::min(BitsPerWord, modulus - start);
+      impl::bitvec_or_bits(folded, start, word, first);
+      // second run (wrapped around): [0, 64 - first)
+      if (first < BitsPerWord)
+        impl::bitvec_or_bits(folded, 0, word >> first, BitsPerWord - first);
+    }
+  }
+
+  /**
+   * @brief Transpose a 64 x 64 bit matrix in place.
+   *
+   * The matrix is stored as 64 words (rows), bit j of row i (see
+   * bitvec_get()) becomes bit i of row j. The blocks are swapped
+   * recursively (32 x 32, 16 x 16, ..., 1 x 1) using shifts and masks on
+   * whole words so a transpose takes 6 * 32 word operations instead of
+   * testing all 4096 bits. This is used to convert row-major fingerprints
+   * to column-major order (see ColumnMajorFingerprintOutputFile).
+   *
+   * @pre The matrix pointer must be valid and BitsPerWord must be 64.
+   *
+   * @param matrix The 64 rows of the matrix.
+   */
+  inline void bitvec_transpose_64x64(Word *matrix)
+  {
+    PRE(matrix);
+    PRE(BitsPerWord == 64);
+    Word mask = 0x00000000FFFFFFFFULL;
+    for (int j = 32; j != 0; j >>= 1, mask ^= (mask << j)) {
+      // rows k and k + j for all k with bit j not set
+      for (int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+        Word t = ((matrix[k] >> j) ^ matrix[k | j]) & mask;
+        matrix[k] ^= t << j;
+        matrix[k | j] ^= t;
+      }
+    }
+  }
+
   /**
    * @brief Print a single bit vector word to std::cout.
    *
@@ -779,6 +1075,77 @@ namespace Helium {
 
   }
 
+  namespace impl {
+
+    /**
+     * @brief Table mapping characters to their hexadecimal value (-1 for
+     * characters that are not hexadecimal digits).
+     */
+    struct HexTable
+    {
+      HexTable()
+      {
+        for (int i = 0; i < 256; ++i)
+          values[i] = -1;
+        for (int i = 0; i < 10; ++i)
+          values['0' + i] = i;
+        for (int i = 0; i < 6; ++i) {
+          values['a' + i] = 10 + i;
+          values['A' + i] = 10 + i;
+        }
+      }
+
+      signed char values[256];
+    };
+
+    inline const signed char* hex_table()
+    {
+      static const HexTable table;
+      return table.values;
+    }
+
+  }
+
+  /**
+   * @brief Convert hexadecimal characters to a bit vector.
+   *
+   * This is the same as hex_to_bitvec() but works on a character range
+   * (e.g. part of a line in a file buffer) and uses a lookup table instead
+   * of a switch per nibble. A trailing unpaired nibble is ignored.
+   *
+   * @pre The @p hex and @p bitvec pointers must be valid and there may not
+   *      be more bytes in the hexadecimal characters than the size of the
+   *      bit vector.
+   *
+   * @param hex Pointer to the hexadecimal characters.
+   * @param size The number of characters.
+   * @param bitvec The bit vector to store the result, will be zeroed first.
+   * @param numWords The number of words for @p bitvec.
+   *
+   * @return False if there is a character that is not a hexadecimal digit.
+   */
+  inline bool hex_to_bitvec(const char *hex, std::size_t size, Word *bitvec, int numWords)
+  {
+    PRE(hex || !size);
+    PRE(bitvec);
+    PRE(size / 2 <= numWords * sizeof(Word));
+
+    bitvec_zero(bitvec, numWords);
+
+    const signed char *table = impl::hex_table();
+    unsigned char *fp = reinterpret_cast<unsigned char*>(bitvec);
+    // OR all values to check for invalid characters only once
+    int invalid = 0;
+    for (std::size_t i = 0; i < size / 2; ++i) {
+      int high = table[static_cast<unsigned char>(hex[2 * i])];
+      int low = table[static_cast<unsigned char>(hex[2 * i + 1])];
+      invalid |= high | low;
+      fp[i] = (high << 4) | (low & 15);
+    }
+
+    return invalid >= 0;
+  }
+
   /**
    * @brief Convert a hexadecimal string to a bit vector.
    *
@@ -0,0 +1,700 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_BITVEC_KERNELS_H
+#define HELIUM_BITVEC_KERNELS_H
+
+#include <Helium/config.h>
+
+#include <cstring>
+#include <cstdlib>
+#include <string>
+
+#ifdef _MSC_VER
+#include <cstdint>
+#else
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_CPU_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace Helium {
+
+  namespace impl {
+
+    /**
+     * @brief Table of population count kernels.
+     *
+     * The bit vector functions that are dominated by population counts
+     * (bitvec_count(), bitvec_union_count(), bitvec_tanimoto(), ...) call
+     * these kernels through function pointers. The kernel table is selected
+     * once, the first time it is needed, based on the instructions supported
+     * by the CPU (see bitvec_kernels()).
+     */
+    struct BitvecKernels
+    {
+      /**
+       * Population count for a bit vector.
+       */
+      int (*count)(const uint64_t *bitvec, int numWords);
+      /**
+       * Population count for the intersection (AND) of two bit vectors.
+       */
+      int (*andCount)(const uint64_t *bitvec1, const uint64_t *bitvec2, int numWords);
+      /**
+       * Population counts for both the intersection (AND) and union (OR) of
+       * two bit vectors computed in a single pass.
+       */
+      void (*andOrCount)(const uint64_t *bitvec1, const uint64_t *bitvec2, int numWords,
+          int &andCount, int &orCount);
+      /**
+       * The kernel name (i.e. "scalar", "popcnt", "avx2" or "avx512").
+       */
+      const char *name;
+    };
+
+    /**
+     * Portable population count for a single word (SWAR).
+     */
+    inline int popcount_swar(uint64_t x)
+    {
+      x = x - ((x >> 1) & 0x5555555555555555ULL);
+      x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+      x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+      return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+    }
+
+    inline int popcount_word(uint64_t x)
+    {
+#ifdef HAVE_POPCNT
+      return __builtin_popcountll(x);
+#else
+      return popcount_swar(x);
+#endif
+    }
+
+    //
+    // Scalar kernels: one word at a time using the compiler builtin (when
+    // available) compiled for the baseline instruction set.
+    //
+
+    inline int bitvec_count_scalar(const uint64_t *bitvec, int numWords)
+    {
+      int count = 0;
+      for (int i = 0; i < numWords; ++i)
+        count += popcount_word(bitvec[i]);
+      return count;
+    }
+
+    inline int bitvec_and_count_scalar(const uint64_t *bitvec1, const uint64_t *bitvec2, int numWords)
+    {
+      int count = 0;
+      for (int i = 0; i < numWords; ++i)
+        count += popcount_word(bitvec1[i] & bitvec2[i]);
+      return count;
+    }
+
+    inline void bitvec_and_or_count_scalar(const uint64_t *bitvec1, const uint64_t *bitvec2, int numWords,
+        int &andCount, int &orCount)
+    {
+      andCount = orCount = 0;
+      for (int i = 0; i < numWords; ++i) {
+        andCount += popcount_word(bitvec1[i] & bitvec2[i]);
+        orCount += popcount_word(bitvec1[i] | bitvec2[i]);
+      }
+    }
+
+#ifdef HAVE_CPU_DISPATCH
+
+    //
+    // POPCNT kernels: same as the scalar kernels but compiled with the POPCNT
+    // instruction enabled so __builtin_popcountll() is a single instruction
+    // instead of a libgcc call.
+    //
+
+    __attribute__((target("popcnt")))
+    inline int bitvec_count_popcnt(const uint64_t *bitvec, int numWords)
+    {
+      int count = 0;
+      for (int i = 0; i < numWords; ++i)
+        count += __builtin_popcountll(bitvec[i]);
+      return count;
+    }
+
+    __attribute__((target("popcnt")))
+    inline int bitvec_and_count_popcnt(const uint64_t *bitvec1, const uint64_t *bitvec2, int numWords)
+    {
+      int count = 0;
+      for (int i = 0; i < numWords; ++i)
+        count += __builtin_popcountll(bitvec1[i] & bitvec2[i]);
+      return count;
+    }
+
+    __attribute__((target("popcnt")))
+    inline void bitvec_and_or_count_popcnt(const uint64_t *bitvec1, const uint64_t *bitvec2, int numWords,
+        int &andCount, int &orCount)
+    {
+      andCount = orCount = 0;
+      for (int i = 0; i < numWords; ++i) {
+        andCount += __builtin_popcountll(bitvec1[i] & bitvec2[i]);
+        orCount += __builtin_popcountll(bitvec1[i] | bitvec2[i]);
+      }
+    }
+
+    //
+    // AVX2 kernels: 256-bit nibble lookup (vpshufb) popcount, with the
+    // Harley-Seal carry-save adder tree for bit vectors of 16 or more AVX2
+    // words (i.e. 4096 bits and larger).
+    //
+
+    __attribute__((target("avx2")))
+    inline __m256i popcount_avx2(__m256i v)
+    {
+      const __m256i lookup = _mm256_setr_epi8(
+          0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+          0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+      const __m256i lowMask = _mm256_set1_epi8(0x0f);
+      __m256i lo = _mm256_and_si256(v, lowMask);
+      __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+      __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+      return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+    }
+
+    __attribute__((target("avx2")))
+    inline void csa_avx2(__m256i &h, __m256i &l, __m256i a, __m256i b, __m256i c)
+    {
+      __m256i u = _mm256_xor_si256(a, b);
+      h = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c));
+      l = _mm256_xor_si256(u, c);
+    }
+
+    __attribute__((target("avx2")))
+    inline uint64_t hsum_avx2(__m256i v)
+    {
+      return static_cast<uint64_t>(_mm256_extract_epi64(v, 0)) + static_cast<uint64_t>(_mm256_extract_epi64(v, 1)) +
+             static_cast<uint64_t>(_mm256_extract_epi64(v, 2)) + static_cast<uint64_t>(_mm256_extract_epi64(v, 3));
+    }
+
+    /**
+     * Loader for the bit vector itself.
+     */
+    struct LoadAvx2
+    {
+      LoadAvx2(const uint64_t *bv1, const uint64_t*) : bitvec(bv1) {}
+      __attribute__((target("avx2"))) __m256i operator()(int i) const
+      {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bitvec) + i);
+      }
+      const uint64_t *bitvec;
+    };
+
+    /**
+     * Loader for the intersection of two bit vectors.
+     */
+    struct LoadAndAvx2
+    {
+      LoadAndAvx2(const uint64_t *bv1, const uint64_t *bv2) : bitvec1(bv1), bitvec2(bv2) {}
+      __attribute__((target("avx2"))) __m256i operator()(int i) const
+      {
+        return _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bitvec1) + i),
+                                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bitvec2) + i));
+      }
+      const uint64_t *bitvec1;
+      const uint64_t *bitvec2;
+    };
+
+    /**
+     * Loader for the union of two bit vectors.
+     */
+    struct LoadOrAvx2
+    {
+      LoadOrAvx2(const uint64_t *bv1, const uint64_t *bv2) : bitvec1(bv1), bitvec2(bv2) {}
+      __attribute__((target("avx2"))) __m256i operator()(int i) const
+      {
+        return _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bitvec1) + i),
+                               _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bitvec2) + i));
+      }
+      const uint64_t *bitvec1;
+      const uint64_t *bitvec2;
+    };
+
+    /**
+     * Count the bits in the first @p numVectors AVX2 words returned by
+     * @p load. Blocks of 16 AVX2 words are reduced using the Harley-Seal
+     * carry-save adder tree, the remaining words use the lookup popcount.
+     */
+    template<typename Load>
+    __attribute__((target("avx2")))
+    inline uint64_t harley_seal_avx2(const Load &load, int numVectors)
+    {
+      __m256i total = _mm256_setzero_si256();
+      __m256i ones = _mm256_setzero_si256();
+      __m256i twos = _mm256_setzero_si256();
+      __m256i fours = _mm256_setzero_si256();
+      __m256i eights = _mm256_setzero_si256();
+      __m256i sixteens, twosA, twosB, foursA, foursB, eightsA, eightsB;
+
+      int i = 0;
+      for (; i + 16 <= numVectors; i += 16) {
+        csa_avx2(twosA, ones, ones, load(i + 0), load(i + 1));
+        csa_avx2(twosB, ones, ones, load(i + 2), load(i + 3));
+        csa_avx2(foursA, twos, twos, twosA, twosB);
+        csa_avx2(twosA, ones, ones, load(i + 4), load(i + 5));
+        csa_avx2(twosB, ones, ones, load(i + 6), load(i + 7));
+        csa_avx2(foursB, twos, twos, twosA, twosB);
+        csa_avx2(eightsA, fours, fours, foursA, foursB);
+        csa_avx2(twosA, ones, ones, load(i + 8), load(i + 9));
+        csa_avx2(twosB, ones, ones, load(i + 10), load(i + 11));
+        csa_avx2(foursA, twos, twos, twosA, twosB);
+        csa_avx2(twosA, ones, ones, load(i + 12), load(i + 13));
+        csa_avx2(twosB, ones, ones, load(i + 14), load(i + 15));
+        csa_avx2(foursB, twos, twos, twosA, twosB);
+        csa_avx2(eightsB, fours, fours, foursA, foursB);
+        csa_avx2(sixteens, eights, eights, eightsA, eightsB);
+        total = _mm256_add_epi64(total, popcount_avx2(sixteens));
+      }
+
+      total = _mm256_slli_epi64(total, 4);
+      total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount_avx2(eights), 3));
+      total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount_avx2(fours), 2));
+      total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount_avx2(twos), 1));
+      total = _mm256_add_epi64(total, popcount_avx2(ones));
+
+      for (; i < numVectors; ++i)
+        total = _mm256_add_epi64(total, popcount_avx2(load(i)));
+
+      return hsum_avx2(total);
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    inline int bitvec_count_avx2(const uint64_t *bitvec, int numWords)
+    {
+      int numVectors = numWords / 4;
+      int count = harley_seal_avx2(LoadAvx2(bitvec, 0), numVectors);
+      for (int i = numVectors * 4; i < numWords; ++i)
+        count += __builtin_popcountll(bitvec[i]);
+      return count;
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    inline int bitvec_and_count_avx2(const uint64_t *bitvec1, const uint64_t *bitvec2, int numWords)
+    {
+      int numVectors = numWords / 4;
+      int count = harley_seal_avx2(LoadAndAvx2(bitvec1, bitvec2), numVectors);
+      for (int i = numVectors * 4; i < numWords; ++i)
+        count += __builtin_popcountll(bitvec1[i] & bitvec2[i]);
+      return count;
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    inline void bitvec_and_or_count_avx2(const uint64_t *bitvec1, const uint64_t *bitvec2, int numWords,
+        int &andCount, int &orCount)
+    {
+      int numVectors = numWords / 4;
+      if (numVectors < 16) {
+        // single pass for small bit vectors
+        __m256i andTotal = _mm256_setzero_si256();
+        __m256i orTotal = _mm256_setzero_si256();
+        LoadAndAvx2 loadAnd(bitvec1, bitvec2);
+        LoadOrAvx2 loadOr(bitvec1, bitvec2);
+        for (int i = 0; i < numVectors; ++i) {
+          andTotal = _mm256_add_epi64(andTotal, popcount_avx2(loadAnd(i)));
+          orTotal = _mm256_add_epi64(orTotal, popcount_avx2(loadOr(i)));
+        }
+        andCount = hsum_avx2(andTotal);
+        orCount = hsum_avx2(orTotal);
+      } else {
+        andCount = harley_seal_avx2(LoadAndAvx2(bitvec1, bitvec2), numVectors);
+        orCount = harley_seal_avx2(LoadOrAvx2(bitvec1, bitvec2), numVectors);
+      }
+      for (int i = numVectors * 4; i < numWords; ++i) {
+        andCount += __builtin_popcountll(bitvec1[i] & bitvec2[i]);
+        orCount += __builtin_popcountll(bitvec1[i] | bitvec2[i]);
+      }
+    }
+
+    //
+    // AVX-512 kernels: VPOPCNTDQ counts 8 words per instruction, the tail is
+    // handled using a masked load.
+    //
+
+    __attribute__((target("avx512f")))
+    inline uint64_t hsum_avx512(__m512i v)
+    {
+      uint64_t words[8];
+      _mm512_storeu_si512(words, v);
+      return words[0] + words[1] + words[2] + words[3] + words[4] + words[5] + words[6] + words[7];
+    }
+
+    __attribute__((target("avx512f,avx512vpopcntdq")))
+    inline int bitvec_count_avx512(const uint64_t *bitvec, int numWords)
+    {
+      __m512i total = _mm512_setzero_si512();
+      int i = 0;
+      for (; i + 8 <= numWords; i += 8)
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_loadu_si512(bitvec + i)));
+      if (i < numWords) {
+        __mmask8 mask = static_cast<__mmask8>((1U << (numWords - i)) - 1);
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(mask, bitvec + i)));
+      }
+      return static_cast<int>(hsum_avx512(total));
+    }
+
+    __attribute__((target("avx512f,avx512vpopcntdq")))
+    inline int bitvec_and_count_avx512(const uint64_t *bitvec1, const uint64_t *bitvec2, int numWords)
+    {
+      __m512i total = _mm512_setzero_si512();
+      int i = 0;
+      for (; i + 8 <= numWords; i += 8) {
+        __m512i v = _mm512_and_si512(_mm512_loadu_si512(bitvec1 + i), _mm512_loadu_si512(bitvec2 + i));
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+      }
+      if (i < numWords) {
+        __mmask8 mask = static_cast<__mmask8>((1U << (numWords - i)) - 1);
+        __m512i v = _mm512_and_si512(_mm512_maskz_loadu_epi64(mask, bitvec1 + i),
+                                     _mm512_maskz_loadu_epi64(mask, bitvec2 + i));
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+      }
+      return static_cast<int>(hsum_avx512(total));
+    }
+
+    __attribute__((target("avx512f,avx512vpopcntdq")))
+    inline void bitvec_and_or_count_avx512(const uint64_t *bitvec1, const uint64_t *bitvec2, int numWords,
+        int &andCount, int &orCount)
+    {
+      __m512i andTotal = _mm512_setzero_si512();
+      __m512i orTotal = _mm512_setzero_si512();
+      int i = 0;
+      for (; i + 8 <= numWords; i += 8) {
+        __m512i a = _mm512_loadu_si512(bitvec1 + i);
+        __m512i b = _mm512_loadu_si512(bitvec2 + i);
+        andTotal = _mm512_add_epi64(andTotal, _mm512_popcnt_epi64(_mm512_and_si512(a, b)));
+        orTotal = _mm512_add_epi64(orTotal, _mm512_popcnt_epi64(_mm512_or_si512(a, b)));
+      }
+      if (i < numWords) {
+        __mmask8 mask = static_cast<__mmask8>((1U << (numWords - i)) - 1);
+        __m512i a = _mm512_maskz_loadu_epi64(mask, bitvec1 + i);
+        __m512i b = _mm512_maskz_loadu_epi64(mask, bitvec2 + i);
+        andTotal = _mm512_add_epi64(andTotal, _mm512_popcnt_epi64(_mm512_and_si512(a, b)));
+        orTotal = _mm512_add_epi64(orTotal, _mm512_popcnt_epi64(_mm512_or_si512(a, b)));
+      }
+      andCount = static_cast<int>(hsum_avx512(andTotal));
+      orCount = static_cast<int>(hsum_avx512(orTotal));
+    }
+
+#endif // HAVE_CPU_DISPATCH
+
+    //
+    // Fixed-width kernels: the number of words is a template parameter so the
+    // word loops are fully unrolled. The numWords argument is ignored, it is
+    // only there to allow using the same kernel table.
+    //
+
+    template<int NumWords>
+    inline int bitvec_count_scalar_fixed(const uint64_t *bitvec, int)
+    {
+      int count = 0;
+      for (int i = 0; i < NumWords; ++i)
+        count += popcount_word(bitvec[i]);
+      return count;
+    }
+
+    template<int NumWords>
+    inline int bitvec_and_count_scalar_fixed(const uint64_t *bitvec1, const uint64_t *bitvec2, int)
+    {
+      int count = 0;
+      for (int i = 0; i < NumWords; ++i)
+        count += popcount_word(bitvec1[i] & bitvec2[i]);
+      return count;
+    }
+
+    template<int NumWords>
+    inline void bitvec_and_or_count_scalar_fixed(const uint64_t *bitvec1, const uint64_t *bitvec2, int,
+        int &andCount, int &orCount)
+    {
+      andCount = orCount = 0;
+      for (int i = 0; i < NumWords; ++i) {
+        andCount += popcount_word(bitvec1[i] & bitvec2[i]);
+        orCount += popcount_word(bitvec1[i] | bitvec2[i]);
+      }
+    }
+
+#ifdef HAVE_CPU_DISPATCH
+
+    template<int NumWords>
+    __attribute__((target("popcnt")))
+    inline int bitvec_count_popcnt_fixed(const uint64_t *bitvec, int)
+    {
+      int count = 0;
+      for (int i = 0; i < NumWords; ++i)
+        count += __builtin_popcountll(bitvec[i]);
+      return count;
+    }
+
+    template<int NumWords>
+    __attribute__((target("popcnt")))
+    inline int bitvec_and_count_popcnt_fixed(const uint64_t *bitvec1, const uint64_t *bitvec2, int)
+    {
+      int count = 0;
+      for (int i = 0; i < NumWords; ++i)
+        count += __builtin_popcountll(bitvec1[i] & bitvec2[i]);
+      return count;
+    }
+
+    template<int NumWords>
+    __attribute__((target("popcnt")))
+    inline void bitvec_and_or_count_popcnt_fixed(const uint64_t *bitvec1, const uint64_t *bitvec2, int,
+        int &andCount, int &orCount)
+    {
+      andCount = orCount = 0;
+      for (int i = 0; i < NumWords; ++i) {
+        andCount += __builtin_popcountll(bitvec1[i] & bitvec2[i]);
+        orCount += __builtin_popcountll(bitvec1[i] | bitvec2[i]);
+      }
+    }
+
+    // NumWords must be a multiple of 4
+    template<int NumWords>
+    __attribute__((target("avx2")))
+    inline int bitvec_count_avx2_fixed(const uint64_t *bitvec, int)
+    {
+      LoadAvx2 load(bitvec, 0);
+      __m256i total = _mm256_setzero_si256();
+      for (int i = 0; i < NumWords / 4; ++i)
+        total = _mm256_add_epi64(total, popcount_avx2(load(i)));
+      return hsum_avx2(total);
+    }
+
+    template<int NumWords>
+    __attribute__((target("avx2")))
+    inline int bitvec_and_count_avx2_fixed(const uint64_t *bitvec1, const uint64_t *bitvec2, int)
+    {
+      LoadAndAvx2 load(bitvec1, bitvec2);
+      __m256i total = _mm256_setzero_si256();
+      for (int i = 0; i < NumWords / 4; ++i)
+        total = _mm256_add_epi64(total, popcount_avx2(load(i)));
+      return hsum_avx2(total);
+    }
+
+    template<int NumWords>
+    __attribute__((target("avx2")))
+    inline void bitvec_and_or_count_avx2_fixed(const uint64_t *bitvec1, const uint64_t *bitvec2, int,
+        int &andCount, int &orCount)
+    {
+      LoadAndAvx2 loadAnd(bitvec1, bitvec2);
+      LoadOrAvx2 loadOr(bitvec1, bitvec2);
+      __m256i andTotal = _mm256_setzero_si256();
+      __m256i orTotal = _mm256_setzero_si256();
+      for (int i = 0; i < NumWords / 4; ++i) {
+        andTotal = _mm256_add_epi64(andTotal, popcount_avx2(loadAnd(i)));
+        orTotal = _mm256_add_epi64(orTotal, popcount_avx2(loadOr(i)));
+      }
+      andCount = hsum_avx2(andTotal);
+      orCount = hsum_avx2(orTotal);
+    }
+
+    // NumWords must be a multiple of 8
+    template<int NumWords>
+    __attribute__((target("avx512f,avx512vpopcntdq")))
+    inline int bitvec_count_avx512_fixed(const uint64_t *bitvec, int)
+    {
+      __m512i total = _mm512_setzero_si512();
+      for (int i = 0; i < NumWords; i += 8)
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_loadu_si512(bitvec + i)));
+      return static_cast<int>(hsum_avx512(total));
+    }
+
+    template<int NumWords>
+    __attribute__((target("avx512f,avx512vpopcntdq")))
+    inline int bitvec_and_count_avx512_fixed(const uint64_t *bitvec1, const uint64_t *bitvec2, int)
+    {
+      __m512i total = _mm512_setzero_si512();
+      for (int i = 0; i < NumWords; i += 8) {
+        __m512i v = _mm512_and_si512(_mm512_loadu_si512(bitvec1 + i), _mm512_loadu_si512(bitvec2 + i));
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+      }
+      return static_cast<int>(hsum_avx512(total));
+    }
+
+    template<int NumWords>
+    __attribute__((target("avx512f,avx512vpopcntdq")))
+    inline void bitvec_and_or_count_avx512_fixed(const uint64_t *bitvec1, const uint64_t *bitvec2, int,
+        int &andCount, int &orCount)
+    {
+      __m512i andTotal = _mm512_setzero_si512();
+      __m512i orTotal = _mm512_setzero_si512();
+      for (int i = 0; i < NumWords; i += 8) {
+        __m512i a = _mm512_loadu_si512(bitvec1 + i);
+        __m512i b = _mm512_loadu_si512(bitvec2 + i);
+        andTotal = _mm512_add_epi64(andTotal, _mm512_popcnt_epi64(_mm512_and_si512(a, b)));
+        orTotal = _mm512_add_epi64(orTotal, _mm512_popcnt_epi64(_mm512_or_si512(a, b)));
+      }
+      andCount = static_cast<int>(hsum_avx512(andTotal));
+      orCount = static_cast<int>(hsum_avx512(orTotal));
+    }
+
+#endif // HAVE_CPU_DISPATCH
+
+    /**
+     * Get the kernel table by name. Valid names are "scalar", "popcnt",
+     * "avx2" and "avx512". The returned pointer is 0 if the name is not
+     * known or the kernels are not supported by this CPU (or compiler).
+     */
+    inline const BitvecKernels* bitvec_kernels_by_name(const std::string &name)
+    {
+      static const BitvecKernels scalar = { &bitvec_count_scalar, &bitvec_and_count_scalar,
+                                            &bitvec_and_or_count_scalar, "scalar" };
+      if (name == "scalar")
+        return &scalar;
+
+#ifdef HAVE_CPU_DISPATCH
+      static const BitvecKernels popcnt = { &bitvec_count_popcnt, &bitvec_and_count_popcnt,
+                                            &bitvec_and_or_count_popcnt, "popcnt" };
+      static const BitvecKernels avx2 = { &bitvec_count_avx2, &bitvec_and_count_avx2,
+                                          &bitvec_and_or_count_avx2, "avx2" };
+      static const BitvecKernels avx512 = { &bitvec_count_avx512, &bitvec_and_count_avx512,
+                                            &bitvec_and_or_count_avx512, "avx512" };
+
+      __builtin_cpu_init();
+      if (name == "popcnt" && __builtin_cpu_supports("popcnt"))
+        return &popcnt;
+      if (name == "avx2" && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return &avx2;
+      if (name == "avx512" && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq"))
+        return &avx512;
+#endif
+
+      return 0;
+    }
+
+    /**
+     * Select the best kernel table supported by this CPU. The selection can
+     * be overridden by setting the HELIUM_BITVEC_KERNEL environment variable
+     * to one of the names accepted by bitvec_kernels_by_name().
+     */
+    inline const BitvecKernels* select_bitvec_kernels()
+    {
+      const char *env = std::getenv("HELIUM_BITVEC_KERNEL");
+      if (env)
+        if (const BitvecKernels *kernels = bitvec_kernels_by_name(env))
+          return kernels;
+
+      const char *names[] = { "avx512", "avx2", "popcnt" };
+      for (int i = 0; i < 3; ++i)
+        if (const BitvecKernels *kernels = bitvec_kernels_by_name(names[i]))
+          return kernels;
+
+      return bitvec_kernels_by_name("scalar");
+    }
+
+    /**
+     * Get the kernel table for this CPU. The CPUID based selection is only
+     * done once.
+     */
+    inline const BitvecKernels& bitvec_kernels()
+    {
+      static const BitvecKernels *kernels = select_bitvec_kernels();
+      return *kernels;
+    }
+
+    template<bool> struct FixedWidthCheck;
+    template<> struct FixedWidthCheck<true> {};
+
+    /**
+     * Get the fixed-width kernel table by name (see bitvec_kernels_by_name()).
+     * The @p NumWords template parameter must be a multiple of 8.
+     */
+    template<int NumWords>
+    inline const BitvecKernels* bitvec_fixed_kernels_by_name(const std::string &name)
+    {
+      // compile time check: NumWords must be a multiple of 8
+      (void)sizeof(FixedWidthCheck<NumWords % 8 == 0>);
+
+      static const BitvecKernels scalar = { &bitvec_count_scalar_fixed<NumWords>,
+          &bitvec_and_count_scalar_fixed<NumWords>, &bitvec_and_or_count_scalar_fixed<NumWords>, "scalar" };
+      if (name == "scalar")
+        return &scalar;
+
+#ifdef HAVE_CPU_DISPATCH
+      static const BitvecKernels popcnt = { &bitvec_count_popcnt_fixed<NumWords>,
+          &bitvec_and_count_popcnt_fixed<NumWords>, &bitvec_and_or_count_popcnt_fixed<NumWords>, "popcnt" };
+      static const BitvecKernels avx2 = { &bitvec_count_avx2_fixed<NumWords>,
+          &bitvec_and_count_avx2_fixed<NumWords>, &bitvec_and_or_count_avx2_fixed<NumWords>, "avx2" };
+      static const BitvecKernels avx512 = { &bitvec_count_avx512_fixed<NumWords>,
+          &bitvec_and_count_avx512_fixed<NumWords>, &bitvec_and_or_count_avx512_fixed<NumWords>, "avx512" };
+
+      // only return kernels that are supported by this CPU
+      if (!bitvec_kernels_by_name(name))
+        return 0;
+      if (name == "popcnt")
+        return &popcnt;
+      if (name == "avx2")
+        return &avx2;
+      if (name == "avx512")
+        return &avx512;
+#endif
+
+      return 0;
+    }
+
+    /**
+     * Get the fixed-width kernel table matching the kernel selected by
+     * bitvec_kernels().
+     */
+    template<int NumWords>
+    inline const BitvecKernels& bitvec_fixed_kernels()
+    {
+      static const BitvecKernels *kernels = bitvec_fixed_kernels_by_name<NumWords>(bitvec_kernels().name);
+      return *kernels;
+    }
+
+    /**
+     * Get the kernel table to use for bit vectors with @p numWords words. For
+     * common fingerprint sizes (1024, 2048 and 4096 bits) a fully unrolled
+     * fixed-width kernel is returned, for other sizes the generic kernel
+     * returned by bitvec_kernels() is used.
+     */
+    inline const BitvecKernels& bitvec_kernels_for_words(int numWords)
+    {
+      switch (numWords) {
+        case 16:
+          return bitvec_fixed_kernels<16>();
+        case 32:
+          return bitvec_fixed_kernels<32>();
+        case 64:
+          return bitvec_fixed_kernels<64>();
+        default:
+          return bitvec_kernels();
+      }
+    }
+
+  } // namespace impl
+
+}
+
+#endif
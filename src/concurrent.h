@@ -28,9 +28,9 @@
 #define HELIUM_CONCURRENT_H
 
 #include <Helium/contract.h>
+#include <Helium/threadpool.h>
 
 #include <vector>
-#include <thread>
 
 namespace Helium {
 
@@ -39,7 +39,8 @@ namespace Helium {
    *
    * The Concurrent class can be used to execute tasks that can be put in a
    * std::vector. The results will also be placed in a std::vector of the same
-   * size.
+   * size. The tasks are run on a ThreadPool (the global pool by default), the
+   * tasks are distributed over the worker threads in chunks.
    *
    * @tparam Callable A functor or function to do the acutal work.
    * @tparam Task The type of an individual task.
@@ -48,24 +49,16 @@ namespace Helium {
   template<typename Callable, typename Task, typename Result>
   class Concurrent
   {
-    private:
+    public:
       /**
-       * @brief Wrapper to call callable.
-       *
-       * This wrapper calls the callable and sets the done flag once finished.
+       * @brief Constructor.
        *
-       * @param callable The functor of function to do the actual work.
-       * @param task An individual task item.
-       * @param result Output for the result of the task item.
-       * @param done The done flag, entry from m_done.
+       * @param pool The thread pool to run the tasks on.
        */
-      static void runTask(Callable callable, const Task &task, Result &result, char &done)
+      Concurrent(ThreadPool &pool = ThreadPool::global()) : m_pool(pool)
       {
-        callable(task, result);
-        done = 1;
       }
 
-    public:
       /**
        * @pre @p tasks and @p results should have the same size (i.e. results
        *      should be resized before calling this function).
@@ -78,52 +71,17 @@ namespace Helium {
       {
         PRE(tasks.size() == results.size());
 
-        // determine number of threads
-        unsigned numThreads = std::thread::hardware_concurrency();
-        if (!numThreads)
-          numThreads = 2;
-        if (numThreads > tasks.size())
-          numThreads = tasks.size();
-
-        // keep track of the number of processed tasks
-        std::size_t next = numThreads;
-        std::size_t processed = 0;
-        m_done.resize(numThreads);
-
-        // create initial threads
-        for (int i = 0 ; i < numThreads; ++i)
-          m_threads.push_back(std::thread(runTask, callable, std::ref(tasks[i]), std::ref(results[i]), std::ref(m_done[i])));
-
-        // process all
-        while (true) {
-
-          // check for threads that have finished
-          for (int i = 0 ; i < numThreads; ++i) {
-            if (m_done[i]) {
-              processed++;
-              m_done[i] = 0;
-              m_threads[i].join();
-
-              // launch a new thread if there are more tasks remaining
-              if (next < tasks.size()) {
-                m_threads[i] = std::thread(runTask, callable, std::ref(tasks[next]), std::ref(results[next]), std::ref(m_done[i]));
-                ++next;
-              }
-            }
-          }
-
-          // stop if all tasks are processed
-          if (processed == tasks.size())
-            break;
+        // use small chunks to balance the load
+        std::size_t chunkSize = tasks.size() / (8 * m_pool.numThreads()) + 1;
 
-          // yield this thread to let the worker threads do their work
-          std::this_thread::yield();
-        }
+        m_pool.parallelFor(tasks.size(), chunkSize, [&] (std::size_t begin, std::size_t end) {
+          for (std::size_t i = begin; i < end; ++i)
+            callable(tasks[i], results[i]);
+        });
       }
 
     private:
-      std::vector<std::thread> m_threads; //!< The threads.
-      std::vector<char> m_done; //!< This flag is set when a thread is done processing it's task.
+      ThreadPool &m_pool; //!< The thread pool.
   };
 
 }
@@ -18,6 +18,7 @@
 
 #cmakedefine HAVE_CPP11
 #cmakedefine HAVE_OPENCL
+#cmakedefine HAVE_INSTRUMENTATION
 
 #ifdef _MSC_VER
 
@@ -26,7 +26,7 @@
  */
 #include <Helium/fileio/file.h>
 
-#include <cassert>
+#include <Helium/contract.h>
 
 namespace Helium {
 
@@ -71,10 +71,22 @@ namespace Helium {
     return (bool)m_ifs;
   }
 
-#define HEADER_SIZE 128000
+  const unsigned int BinaryOutputFile::DefaultHeaderSize;
+  const unsigned int BinaryOutputFile::DefaultBufferSize;
 
-  bool BinaryOutputFile::open(const std::string &filename)
+  bool BinaryOutputFile::open(const std::string &filename, unsigned int headerSize,
+      unsigned int bufferSize)
   {
+    PRE(headerSize > 0);
+    m_headerSize = headerSize;
+
+    // use a large stream buffer (must be set before opening the file)
+    if (m_ofs.is_open())
+      m_ofs.close();
+    m_buffer.resize(bufferSize);
+    if (bufferSize)
+      m_ofs.rdbuf()->pubsetbuf(&m_buffer[0], bufferSize);
+
     // try to open the file
     m_ofs.open(filename.c_str(), std::ios_base::out | std::ios_base::binary);
     if (!m_ofs)
@@ -85,7 +97,7 @@ namespace Helium {
     m_ofs.write(reinterpret_cast<const char*>(&magic), sizeof(unsigned int));
 
     // set position to start of binary data
-    m_ofs.seekp(2 * sizeof(unsigned int) + HEADER_SIZE);
+    m_ofs.seekp(2 * sizeof(unsigned int) + m_headerSize);
     m_offset = m_ofs.tellp();
 
     return (bool)m_ofs;
@@ -93,7 +105,10 @@ namespace Helium {
 
   bool BinaryOutputFile::writeHeader(const std::string &header)
   {
-    assert(header.size() < HEADER_SIZE - 1);
+    // the header must fit in the reserved space (including the zero
+    // termination character)
+    if (header.size() >= m_headerSize)
+      return false;
 
     // store current file stream position
     std::ios_base::streampos pos = m_ofs.tellp();
@@ -102,16 +117,13 @@ namespace Helium {
     m_ofs.seekp(sizeof(unsigned int));
 
     // write header size
-    unsigned int jsonSize = HEADER_SIZE;
+    unsigned int jsonSize = m_headerSize;
     m_ofs.write(reinterpret_cast<const char*>(&jsonSize), sizeof(unsigned int));
 
-    // write header
+    // write header and padding (at least one zero termination character)
     m_ofs.write(header.c_str(), header.size());
-
-    // write padding
-    const char padding = '\0';
-    for (unsigned int i = 0; i < HEADER_SIZE - header.size(); ++i)
-      m_ofs.write(&padding, 1);
+    const std::string padding(m_headerSize - header.size(), '\0');
+    m_ofs.write(padding.c_str(), padding.size());
 
     // restore file stream position
     m_ofs.seekp(pos);
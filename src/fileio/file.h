@@ -31,6 +31,7 @@
 
 #include <fstream>
 #include <stdexcept>
+#include <vector>
 
 namespace Helium {
 
@@ -176,23 +177,47 @@ namespace Helium {
   class BinaryOutputFile
   {
     public:
-      BinaryOutputFile()
+      /**
+       * The default number of bytes reserved for the JSON header.
+       */
+      static const unsigned int DefaultHeaderSize = 128000;
+      /**
+       * The default size (in bytes) of the stream buffer.
+       */
+      static const unsigned int DefaultBufferSize = 1 << 20;
+
+      BinaryOutputFile() : m_headerSize(DefaultHeaderSize)
       {
       }
 
-      BinaryOutputFile(const std::string &filename)
+      /**
+       * Constructor that opens the file.
+       *
+       * @param filename The filename for the file to open.
+       * @param headerSize The number of bytes to reserve for the JSON header.
+       * @param bufferSize The size of the stream buffer in bytes.
+       */
+      BinaryOutputFile(const std::string &filename, unsigned int headerSize = DefaultHeaderSize,
+          unsigned int bufferSize = DefaultBufferSize)
       {
-        open(filename);
+        open(filename, headerSize, bufferSize);
       }
 
       /**
-       * Open the file with the specified filename.
+       * Open the file with the specified filename. Since the binary data
+       * follows the JSON header, the space for the header is reserved when
+       * the file is opened. The header written using writeHeader() must be
+       * smaller than @p headerSize. Writes are collected in a stream buffer
+       * of @p bufferSize bytes and are written to the file in large blocks.
        *
        * @param filename The filename for the file to open.
+       * @param headerSize The number of bytes to reserve for the JSON header.
+       * @param bufferSize The size of the stream buffer in bytes.
        *
        * @return True if the file was opened successfully.
        */
-      bool open(const std::string &filename);
+      bool open(const std::string &filename, unsigned int headerSize = DefaultHeaderSize,
+          unsigned int bufferSize = DefaultBufferSize);
 
       /**
        * Close the file.
@@ -253,14 +278,24 @@ namespace Helium {
       }
 
       /**
-       * Write the JSON header to the file.
+       * Write the JSON header to the file. Nothing is written if the header
+       * does not fit in the space reserved by open().
        *
        * @param header The JSON header.
        *
-       * @return true if the header was written successfully.
+       * @return true if the header was written successfully, false if the
+       *         header does not fit or a write failed.
        */
       bool writeHeader(const std::string &header);
 
+      /**
+       * Get the number of bytes reserved for the JSON header.
+       */
+      unsigned int headerSize() const
+      {
+        return m_headerSize;
+      }
+
       /**
        * Get the std::ofstream to manipulate it directly.
        */
@@ -270,8 +305,10 @@ namespace Helium {
       }
 
     private:
+      std::vector<char> m_buffer; //!< Stream buffer (must outlive m_ofs)
       std::ofstream m_ofs; //!< File handle
       std::ios_base::streampos m_offset; //!< Offset where binary data starts
+      unsigned int m_headerSize; //!< Number of bytes reserved for the header
   };
 
 }
@@ -29,10 +29,24 @@
 
 #include <Helium/bitvec.h>
 #include <Helium/fileio/file.h>
+#include <Helium/contract.h>
+#include <Helium/roaring.h>
+#include <Helium/util/memory.h>
 
 #include <json/json.h>
 
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
 #include <stdexcept>
+#include <algorithm>
+
+#ifdef HAVE_CPP11
+#include <Helium/threadpool.h>
+#endif
 
 namespace Helium {
 
@@ -53,6 +67,10 @@ namespace Helium {
    * fingerprint storage classes can be added by following the fingerprint
    * storage concept described below.
    *
+   * Compressed column-major files are written using the
+   * CompressedColumnMajorFingerprintOutputFile class and read using the
+   * InMemoryCompressedColumnMajorFingerprintStorage class.
+   *
    * @section fingerprints_file_format Binary File Format
    *
    * Like all Helium binary files, the fingerprint file formats include a JSON
@@ -89,6 +107,33 @@ namespace Helium {
    * remaining attributes may then be used to specify parameters for this
    * fingerprint type.
    *
+   * Row-major order files may be sorted by population count (see the sort
+   * tool). For these files, the optional 'popcount_offsets' attribute
+   * contains num_bits + 2 offsets: the fingerprints with population count c
+   * are stored at positions [popcount_offsets[c], popcount_offsets[c + 1]).
+   *
+   * Column-major order files may contain the optional 'column_counts'
+   * attribute (see the transpose tool). This attribute contains num_bits
+   * counts: the number of fingerprints that have the bit set. These are used
+   * to intersect the rarest columns first when screening.
+   *
+   * Row-major order files written by the index and fps2hel tools also store
+   * statistics that would otherwise be recomputed each time the file is
+   * loaded. The 'column_counts' attribute is the same as above. The optional
+   * 'bit_counts' attribute is the position (relative to the start of the
+   * binary data) of num_fingerprints 32-bit population counts stored after
+   * the fingerprints. The optional 'part_counts' attribute is an object with
+   * 'k' and 'position' members: k * num_fingerprints 16-bit counts for the
+   * parts of the kD-grid used by SimilaritySearchIndex (see
+   * bitvec_part_count()) are stored at the position. All stored counts use
+   * the native byte order.
+   *
+   * Compressed column-major order files have 'compressed-column-major' as
+   * 'order' attribute. The columns are stored as RoaringBitmap objects (see
+   * RoaringBitmap::write()), one after the other. Sparse columns take much
+   * less space and are intersected faster while dense columns are stored as
+   * uncompressed 65536-bit blocks.
+   *
    * @section fingerprints_rowcol Row-Major vs. Column-Major Order
    *
    * Fingerprints can be stored in row-major order (i.e. each fingerprint is
@@ -227,6 +272,11 @@ query: 00001011 (bit 5, 7 & 8 are set)
    * unsigned int n = storage->numBits();
    * unsigned int n = storage->numFingerprints();
    * Helium::Word *fingerprint = storage->fingerprint(index);
+   * int count = storage->bitCount(index);
+   * const int *counts = storage->bitCounts();
+   * const std::vector<unsigned int> &offsets = storage->popcountOffsets();
+   * const std::vector<unsigned int> &columnCounts = storage->columnCounts();
+   * const uint16_t *partCounts = storage->partCounts(k);
    * @endcode
    *
    * In the code above, storage is a pointer to an instance of a type that is a
@@ -234,6 +284,20 @@ query: 00001011 (bit 5, 7 & 8 are set)
    * molecule for which to get the fingerprint bitstring and should be in the
    * range [0, num_fingerprints). The returned pointer should point to a memory
    * location containing (for example) 1024 bits for a 1024-bit fingerprint.
+   * The fingerprints must be stored with a constant stride (i.e.
+   * fingerprint(index + 1) - fingerprint(index) is the same for all indices
+   * and at least the number of words in a fingerprint) so blocks of
+   * fingerprints can be processed using functions such as
+   * bitvec_tanimoto_batch(). The words between fingerprints (if any) must be
+   * zero. The bit counts
+   * (i.e. population counts) are cached by the storage, bitCounts() returns
+   * an array containing num_fingerprints bit counts. For fingerprints sorted
+   * by population count, popcountOffsets() returns the num_bits + 2 bucket
+   * offsets (see 'popcount_offsets' above). For unsorted fingerprints an
+   * empty vector is returned. The columnCounts() and partCounts() functions
+   * return the statistics stored in the file (see 'column_counts' and
+   * 'part_counts' above). If these are not available, an empty vector or a
+   * null pointer is returned.
    *
    * @subsection fingerprints_storage_colmajor Column-Major Order
    *
@@ -245,19 +309,62 @@ query: 00001011 (bit 5, 7 & 8 are set)
    * unsigned int n = storage->numBits();
    * unsigned int n = storage->numFingerprints();
    * Helium::Word *bit = storage->bit(index);
+   * int count = storage->bitCount(fingerprintIndex);
+   * unsigned int count = storage->columnCount(index);
    * @endcode
    *
    * In the code above, storage is a pointer to an instance of a type that is a
    * model of the concept and index is an unsigned int. The index refers to the
    * bit in the fingerprint (e.g. in the range [0,1023] for a 1024-bit
    * fingerprint). The returned pointer should point to a memory location
-   * containing num_fingerprints bits.
+   * containing num_fingerprints bits. The bitCount() function returns the
+   * cached bit count for a fingerprint (i.e. not a bit index). The
+   * columnCount() function returns the number of fingerprints that have the
+   * bit set.
+   *
+   * @subsection fingerprints_storage_compressed Compressed Column-Major Order
+   *
+   * A class that is a model of the CompressedColumnMajorFingerprintStorageConcept
+   * supports the same operations as the ColumnMajorFingerprintStorageConcept
+   * except bit(). Instead, the compressed columns are accessed using:
+   *
+   * @code
+   * const Helium::RoaringBitmap &column = storage->column(index);
+   * @endcode
+   *
+   * The substructure_screen() functions have overloads for these storages
+   * that intersect the compressed columns directly.
    */
 
 
 
+  /**
+   * Get the number of bytes to reserve for the JSON header of a fingerprint
+   * file that contains @p numArrays attributes with a value for each bit
+   * (i.e. 'column_counts' and 'popcount_offsets'). The header is written
+   * using Json::StyledWriter which puts each value on a separate line, the
+   * default header size is reserved for the other attributes.
+   *
+   * @param numBits The number of bits in the fingerprints.
+   * @param numArrays The number of per bit attributes.
+   */
+  inline unsigned int fingerprint_header_size(unsigned int numBits, unsigned int numArrays = 1)
+  {
+    // newline, indentation, up to 10 digits and a comma
+    const unsigned int bytesPerValue = 24;
+    return BinaryOutputFile::DefaultHeaderSize + numArrays * (numBits + 2) * bytesPerValue;
+  }
+
   /**
    * @brief Output file for storing fingerprints in row-major order.
+   *
+   * When @p statistics is enabled, the bit count of each fingerprint, the
+   * number of fingerprints that have each bit set and optionally the bit
+   * counts for the parts of the kD-grid are collected while writing the
+   * fingerprints. These are written to the file using writeStatistics()
+   * (see 'bit_counts', 'column_counts' and 'part_counts' above) and the
+   * space for the 'column_counts' attribute is reserved in the header (see
+   * fingerprint_header_size()).
    */
   class RowMajorFingerprintOutputFile
   {
@@ -267,10 +374,20 @@ query: 00001011 (bit 5, 7 & 8 are set)
        *
        * @param filename The ouput filename.
        * @param numBits The number of bits in the fingerprints (e.g. 1024).
+       * @param statistics Collect the statistics for writeStatistics().
+       * @param numParts The number of parts for which the bit counts are
+       *        collected (0 for none, only used when @p statistics is true).
        */
-      RowMajorFingerprintOutputFile(const std::string &filename, unsigned int numBits) : m_file(filename)
+      RowMajorFingerprintOutputFile(const std::string &filename, unsigned int numBits, bool statistics = false,
+          unsigned int numParts = 0) : m_file(filename, statistics ? fingerprint_header_size(numBits) :
+            BinaryOutputFile::DefaultHeaderSize), m_numBits(numBits), m_numParts(statistics ? numParts : 0),
+          m_statistics(statistics)
       {
-        m_numBytes = bitvec_num_words_for_bits(numBits) * sizeof(Word);
+        PRE(m_numParts <= numBits);
+        m_numWords = bitvec_num_words_for_bits(numBits);
+        m_numBytes = m_numWords * sizeof(Word);
+        if (statistics)
+          m_columnCounts.resize(numBits, 0);
       }
 
       /**
@@ -282,9 +399,57 @@ query: 00001011 (bit 5, 7 & 8 are set)
        */
       bool writeFingerprint(Word *fingerprint)
       {
+        if (m_statistics) {
+          m_bitCounts.push_back(bitvec_count(fingerprint, m_numWords));
+          // visit the set bits
+          for (unsigned int i = 0; i < m_numWords; ++i)
+            for (Word word = fingerprint[i]; word; word &= word - 1) {
+              unsigned int bit = i * BitsPerWord + bitvec_count((word & (~word + 1)) - 1);
+              if (bit < m_numBits)
+                ++m_columnCounts[bit];
+            }
+          for (unsigned int i = 0; i < m_numParts; ++i)
+            m_partCounts.push_back(bitvec_part_count(fingerprint, m_numBits, m_numParts, i));
+        }
         return m_file.write(fingerprint, m_numBytes);
       }
 
+      /**
+       * Write the collected statistics after the fingerprints and add the
+       * 'bit_counts', 'column_counts' and 'part_counts' attributes to the
+       * JSON header @p data. This function should be called once after the
+       * last fingerprint is written and before writing the header.
+       *
+       * @pre The output file must be constructed with @p statistics set to
+       *      true.
+       *
+       * @param data The JSON header.
+       *
+       * @return True if the statistics were successfully written to the file.
+       */
+      bool writeStatistics(Json::Value &data)
+      {
+        PRE(m_statistics);
+        Json::Value counts(Json::arrayValue);
+        for (std::size_t i = 0; i < m_columnCounts.size(); ++i)
+          counts[Json::ArrayIndex(i)] = m_columnCounts[i];
+        data["column_counts"] = counts;
+
+        data["bit_counts"] = static_cast<Json::UInt64>(m_file.tell());
+        if (m_bitCounts.size() && !m_file.write(&m_bitCounts[0], m_bitCounts.size() * sizeof(int32_t)))
+          return false;
+
+        if (m_numParts) {
+          data["part_counts"] = Json::Value(Json::objectValue);
+          data["part_counts"]["k"] = m_numParts;
+          data["part_counts"]["position"] = static_cast<Json::UInt64>(m_file.tell());
+          if (m_partCounts.size() && !m_file.write(&m_partCounts[0], m_partCounts.size() * sizeof(uint16_t)))
+            return false;
+        }
+
+        return true;
+      }
+
       /**
        * Write the JSON header to the file.
        *
@@ -299,11 +464,28 @@ query: 00001011 (bit 5, 7 & 8 are set)
 
     private:
       BinaryOutputFile m_file; //!< The output file.
+      unsigned int m_numBits; //!< The number of bits in a fingerprint.
+      unsigned int m_numWords; //!< The number of words in a fingerprint.
       unsigned int m_numBytes; //!< The number of bytes in a fingerprint.
+      unsigned int m_numParts; //!< The number of parts for the part counts.
+      bool m_statistics; //!< True if the statistics are collected.
+      std::vector<int32_t> m_bitCounts; //!< The bit count for each fingerprint.
+      std::vector<unsigned int> m_columnCounts; //!< The number of fingerprints that have each bit set.
+      std::vector<uint16_t> m_partCounts; //!< The part counts (numParts per fingerprint).
   };
 
   /**
    * @brief Output file for storing fingerprints in column-major order.
+   *
+   * The fingerprints are collected in tiles of 64 fingerprints that are
+   * converted to column-major order using bitvec_transpose_64x64(). By
+   * default, all columns are kept in memory and written to the file by the
+   * destructor. When a stripe size is given, only the columns for a stripe
+   * of fingerprints are kept in memory. When a stripe is full, the part of
+   * each column for the stripe is written to its position in the file so
+   * files much larger than the available memory can be transposed. The
+   * space for the 'column_counts' attribute is reserved in the header (see
+   * fingerprint_header_size()).
    */
   class ColumnMajorFingerprintOutputFile
   {
@@ -314,14 +496,20 @@ query: 00001011 (bit 5, 7 & 8 are set)
        * @param filename The output filename.
        * @param numBits The number of bits in the fingerprint (e.g. 1024).
        * @param numFingerprints The number of fingerprints that will be written to the file.
+       * @param stripeSize The number of fingerprints per stripe (rounded up
+       *        to a multiple of 64), 0 to keep all columns in memory.
        */
       ColumnMajorFingerprintOutputFile(const std::string &filename, unsigned int numBits,
-          unsigned int numFingerprints) : m_file(filename), m_numBits(numBits),
-          m_numFingerprints(numFingerprints), m_current(0)
+          unsigned int numFingerprints, unsigned int stripeSize = 0) : m_file(filename,
+            fingerprint_header_size(numBits)), m_numBits(numBits),
+          m_numFingerprints(numFingerprints), m_current(0), m_flushed(0), m_columnCounts(numBits, 0)
       {
+        m_numWords = bitvec_num_words_for_bits(numBits);
+        m_columnWords = bitvec_num_words_for_bits(numFingerprints);
+        m_stripeWords = stripeSize ? std::min(m_columnWords, bitvec_num_words_for_bits(stripeSize)) : m_columnWords;
+        m_tile.resize(static_cast<std::size_t>(BitsPerWord) * m_numWords, 0);
         // allocate data
-        m_data = new Word[bitvec_num_words_for_bits(numFingerprints) * numBits];
-        bitvec_zero(m_data, bitvec_num_words_for_bits(numFingerprints) * numBits);
+        m_data.resize(static_cast<std::size_t>(m_stripeWords) * numBits, 0);
       }
 
       /**
@@ -329,9 +517,9 @@ query: 00001011 (bit 5, 7 & 8 are set)
        */
       ~ColumnMajorFingerprintOutputFile()
       {
-        // write the data
-        m_file.write(m_data, bitvec_num_words_for_bits(m_numFingerprints) * m_numBits * sizeof(Word));
-        delete [] m_data;
+        // write the remaining data
+        flushTile();
+        flushStripe();
       }
 
       /**
@@ -343,17 +531,23 @@ query: 00001011 (bit 5, 7 & 8 are set)
        */
       bool writeFingerprint(Word *fingerprint)
       {
-        // check each bit in the fingerprint
-        for (int i = 0; i < m_numBits; ++i) {
-          // skip this bit if it is not set
-          if (!bitvec_get(i, fingerprint))
-            continue;
+        if (m_current >= m_numFingerprints)
+          return false;
 
-          // set the correct bit
-          bitvec_set(m_current, m_data + i * bitvec_num_words_for_bits(m_numFingerprints));
-        }
+        // count the set bits
+        for (unsigned int i = 0; i < m_numWords; ++i)
+          for (Word word = fingerprint[i]; word; word &= word - 1)
+            ++m_columnCounts[i * BitsPerWord + __builtin_ctzll(word)];
+
+        std::copy(fingerprint, fingerprint + m_numWords,
+            &m_tile[static_cast<std::size_t>(m_current % BitsPerWord) * m_numWords]);
         ++m_current;
 
+        if (m_current % BitsPerWord == 0)
+          flushTile();
+        if ((m_current - m_flushed) == static_cast<std::size_t>(m_stripeWords) * BitsPerWord)
+          flushStripe();
+
         return true;
       }
 
@@ -369,110 +563,482 @@ query: 00001011 (bit 5, 7 & 8 are set)
         return m_file.writeHeader(header);
       }
 
+      /**
+       * Get the number of fingerprints written so far that have each bit
+       * set. These can be stored in the 'column_counts' header attribute.
+       */
+      const std::vector<unsigned int>& columnCounts() const
+      {
+        return m_columnCounts;
+      }
+
     private:
+      /**
+       * Transpose the current (possibly partial) tile into the stripe.
+       */
+      void flushTile()
+      {
+        unsigned int numRows = m_current % BitsPerWord ? m_current % BitsPerWord : BitsPerWord;
+        if (m_current == m_flushed || m_current - numRows < m_flushed)
+          return;
+
+        // the word in the stripe's columns for this tile
+        unsigned int index = (m_current - numRows - m_flushed) / BitsPerWord;
+        Word block[64];
+        for (unsigned int w = 0; w < m_numWords; ++w) {
+          // rows past the last fingerprint are zero
+          for (unsigned int r = 0; r < numRows; ++r)
+            block[r] = m_tile[static_cast<std::size_t>(r) * m_numWords + w];
+          std::fill(block + numRows, block + BitsPerWord, 0);
+
+          bitvec_transpose_64x64(block);
+
+          unsigned int numColumns = std::min<unsigned int>(BitsPerWord, m_numBits - w * BitsPerWord);
+          for (unsigned int c = 0; c < numColumns; ++c)
+            m_data[static_cast<std::size_t>(w * BitsPerWord + c) * m_stripeWords + index] = block[c];
+        }
+        // partial tiles are only flushed by the destructor
+      }
+
+      /**
+       * Write the columns for the current stripe to the file.
+       */
+      void flushStripe()
+      {
+        if (m_current == m_flushed)
+          return;
+
+        if (m_stripeWords == m_columnWords) {
+          // all columns are in memory
+          m_file.write(&m_data[0], m_data.size() * sizeof(Word));
+        } else {
+          unsigned int first = m_flushed / BitsPerWord;
+          unsigned int numWords = bitvec_num_words_for_bits(m_current - m_flushed);
+          for (unsigned int i = 0; i < m_numBits; ++i) {
+            m_file.seek((static_cast<uint64_t>(i) * m_columnWords + first) * sizeof(Word));
+            m_file.write(&m_data[static_cast<std::size_t>(i) * m_stripeWords], numWords * sizeof(Word));
+          }
+          std::fill(m_data.begin(), m_data.end(), 0);
+        }
+
+        m_flushed = m_current;
+      }
+
       BinaryOutputFile m_file; //!< The output file.
       unsigned int m_numBits; //!< The number of bits in the fingerprint.
+      unsigned int m_numWords; //!< The number of words in a fingerprint.
       unsigned int m_numFingerprints; //!< The number of fingerprints that will be written.
+      unsigned int m_columnWords; //!< The number of words in a column.
+      unsigned int m_stripeWords; //!< The number of words in a column for a stripe.
       unsigned int m_current; //!< The current fingerprint being written.
-      Word *m_data; //!< Pointer to all fingerprint bits.
+      unsigned int m_flushed; //!< The number of fingerprints in previous stripes.
+      std::vector<Word> m_tile; //!< The (row-major) fingerprints for the current tile.
+      std::vector<Word> m_data; //!< The columns for the current stripe.
+      std::vector<unsigned int> m_columnCounts; //!< The number of set bits in each column.
   };
 
-  class InMemoryRowMajorFingerprintStorage
+  /**
+   * @brief Access pattern hints for memory mapped fingerprint storages.
+   *
+   * The hints are passed to madvise() on platforms that support it and
+   * ignored elsewhere.
+   */
+  enum MemoryMapAdvice
+  {
+    /**
+     * No hint (i.e. the operating system default).
+     */
+    DefaultAdvice,
+    /**
+     * The data will be accessed sequentially (e.g. brute force searches or
+     * substructure screening).
+     */
+    SequentialAdvice,
+    /**
+     * The data will be accessed in random order (e.g. index searches).
+     */
+    RandomAdvice,
+    /**
+     * The data will be needed soon, the operating system starts reading it
+     * into the page cache.
+     */
+    WillNeedAdvice
+  };
+
+  /**
+   * @brief Output file for storing fingerprints in compressed column-major order.
+   *
+   * The fingerprints are collected in blocks of RoaringBitmap::ContainerBits
+   * fingerprints which are compressed when the block is full. Only the
+   * compressed columns and a single uncompressed block are kept in memory.
+   * The columns are written to the file by the destructor. The space for
+   * the 'column_counts' attribute is reserved in the header (see
+   * fingerprint_header_size()).
+   */
+  class CompressedColumnMajorFingerprintOutputFile
   {
     public:
-      InMemoryRowMajorFingerprintStorage() : m_fingerprints(0), m_numBits(0),
-          m_numFingerprints(0), m_init(false)
+      /**
+       * Constructor.
+       *
+       * @param filename The output filename.
+       * @param numBits The number of bits in the fingerprint (e.g. 1024).
+       * @param numFingerprints The number of fingerprints that will be written to the file.
+       */
+      CompressedColumnMajorFingerprintOutputFile(const std::string &filename, unsigned int numBits,
+          unsigned int numFingerprints) : m_file(filename, fingerprint_header_size(numBits)), m_numBits(numBits),
+          m_numFingerprints(numFingerprints), m_current(0), m_flushed(0), m_columns(numBits), m_columnCounts(numBits, 0),
+          m_block(static_cast<std::size_t>(numBits) * RoaringBitmap::ContainerWords, 0)
       {
       }
 
-      ~InMemoryRowMajorFingerprintStorage()
+      /**
+       * Destructor.
+       */
+      ~CompressedColumnMajorFingerprintOutputFile()
       {
-        if (m_fingerprints)
-          delete [] m_fingerprints;
+        // compress the last block and write the data
+        flush();
+        for (unsigned int i = 0; i < m_numBits; ++i)
+          m_columns[i].write(m_file);
       }
 
-      std::string header() const
+      /**
+       * Write a single fingerprint to the file.
+       *
+       * @param fingerprint Pointer to the fingerprint.
+       *
+       * @return True if the fingerprint was successfully written to the file.
+       */
+      bool writeFingerprint(Word *fingerprint)
       {
-        return m_json;
+        if (m_current >= m_numFingerprints)
+          return false;
+
+        unsigned int index = m_current % RoaringBitmap::ContainerBits;
+        for (unsigned int i = 0; i < m_numBits; ++i) {
+          // skip this bit if it is not set
+          if (!bitvec_get(i, fingerprint))
+            continue;
+
+          // set the correct bit
+          bitvec_set(index, &m_block[static_cast<std::size_t>(i) * RoaringBitmap::ContainerWords]);
+          ++m_columnCounts[i];
+        }
+        ++m_current;
+
+        if (m_current % RoaringBitmap::ContainerBits == 0)
+          flush();
+
+        return true;
       }
 
-      unsigned int numBits() const
+      /**
+       * Write the JSON header to the file.
+       *
+       * @param header The JSON header.
+       *
+       * @return True if the header was successfully written to the file.
+       */
+      bool writeHeader(const std::string &header)
       {
-        return m_numBits;
+        return m_file.writeHeader(header);
       }
 
-      unsigned int numFingerprints() const
+      /**
+       * Get the number of fingerprints written so far that have each bit
+       * set. These can be stored in the 'column_counts' header attribute.
+       */
+      const std::vector<unsigned int>& columnCounts() const
       {
-        return m_numFingerprints;
+        return m_columnCounts;
       }
 
-      Word* fingerprint(unsigned int index) const
+    private:
+      /**
+       * Compress the current block.
+       */
+      void flush()
       {
-        if (!m_init)
-          return 0;
-        return m_fingerprints + bitvec_num_words_for_bits(m_numBits) * index;
+        if (m_current == m_flushed)
+          return;
+
+        // blocks are flushed when full so m_flushed is a multiple of the block size
+        unsigned int key = m_flushed / RoaringBitmap::ContainerBits;
+        unsigned int numBits = m_current - m_flushed;
+        for (unsigned int i = 0; i < m_numBits; ++i) {
+          Word *block = &m_block[static_cast<std::size_t>(i) * RoaringBitmap::ContainerWords];
+          m_columns[i].append(key, block, numBits);
+          bitvec_zero(block, RoaringBitmap::ContainerWords);
+        }
+        m_flushed = m_current;
       }
 
-      void load(const std::string &filename)
+      BinaryOutputFile m_file; //!< The output file.
+      unsigned int m_numBits; //!< The number of bits in the fingerprint.
+      unsigned int m_numFingerprints; //!< The number of fingerprints that will be written.
+      unsigned int m_current; //!< The current fingerprint being written.
+      unsigned int m_flushed; //!< The number of fingerprints in compressed blocks.
+      std::vector<RoaringBitmap> m_columns; //!< The compressed columns.
+      std::vector<unsigned int> m_columnCounts; //!< The number of set bits for each column.
+      std::vector<Word> m_block; //!< The uncompressed columns for the current block.
+  };
+
+  //@cond dev
+
+  namespace impl {
+
+    /**
+     * Parse and check the JSON header of a fingerprint file.
+     *
+     * @param filename The file name (used for error messages).
+     * @param json The JSON header.
+     * @param order The required order ("row-major" or "column-major").
+     */
+    inline Json::Value parse_fingerprint_header(const std::string &filename, const std::string &json,
+        const std::string &order)
+    {
+      Json::Reader reader;
+      Json::Value data;
+      if (!reader.parse(json, data))
+        throw std::runtime_error(reader.getFormattedErrorMessages());
+
+      // make sure the required attributes are present
+      if (!data.isMember("filetype") || data["filetype"].asString() != "fingerprints")
+        throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'filetype' attribute or is not 'fingerprints'"));
+      if (!data.isMember("order"))
+        throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'order' attribute"));
+      if (!data.isMember("num_bits"))
+        throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_bits' attribute"));
+      if (!data.isMember("num_fingerprints"))
+        throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_fingerprints' attribute"));
+
+      // ensure this is a file with the correct order
+      if (data["order"].asString() != order)
+        throw std::runtime_error(make_string(filename, " is not a ", order, " order fingerprint file"));
+
+      return data;
+    }
+
+    /**
+     * Read and check the JSON header of a fingerprint file without loading
+     * the fingerprints.
+     */
+    inline Json::Value read_fingerprint_header(const std::string &filename, const std::string &order)
+    {
+      BinaryInputFile file(filename);
+      if (!file)
+        throw std::runtime_error(make_string("Could not open fingerprint file \"", filename, "\""));
+      return parse_fingerprint_header(filename, file.header(), order);
+    }
+
+    /**
+     * Get the number of bytes needed for the optional 'popcount_offsets'
+     * and 'column_counts' attributes.
+     */
+    inline std::size_t estimate_statistics_memory_usage(const Json::Value &data, unsigned int numBits)
+    {
+      std::size_t size = 0;
+      if (data.isMember("popcount_offsets"))
+        size += (numBits + 2) * sizeof(unsigned int);
+      if (data.isMember("column_counts"))
+        size += numBits * sizeof(unsigned int);
+      return size;
+    }
+
+    /**
+     * Read the optional 'popcount_offsets' attribute and check that the
+     * fingerprints are in the correct buckets. The offsets are cleared if
+     * the attribute is not present.
+     */
+    inline void read_popcount_offsets(const std::string &filename, const Json::Value &data, unsigned int numBits,
+        unsigned int numFingerprints, const int *bitCounts, std::vector<unsigned int> &popcountOffsets)
+    {
+      popcountOffsets.clear();
+      if (!data.isMember("popcount_offsets"))
+        return;
+
+      const Json::Value &offsets = data["popcount_offsets"];
+      if (offsets.size() != numBits + 2)
+        throw std::runtime_error(make_string("JSON header for file ", filename, " contains an invalid 'popcount_offsets' attribute"));
+      for (Json::ArrayIndex c = 0; c < offsets.size(); ++c)
+        popcountOffsets.push_back(offsets[c].asUInt());
+      // make sure the fingerprints are in the correct buckets
+      if (popcountOffsets[0] || popcountOffsets.back() != numFingerprints)
+        throw std::runtime_error(make_string("JSON header for file ", filename, " contains an invalid 'popcount_offsets' attribute"));
+      for (unsigned int c = 0; c <= numBits; ++c) {
+        if (popcountOffsets[c] > popcountOffsets[c + 1])
+          throw std::runtime_error(make_string("JSON header for file ", filename, " contains an invalid 'popcount_offsets' attribute"));
+        for (unsigned int i = popcountOffsets[c]; i < popcountOffsets[c + 1]; ++i)
+          if (bitCounts[i] != static_cast<int>(c))
+            throw std::runtime_error(make_string("Fingerprint file ", filename, " is not sorted by population count"));
+      }
+    }
+
+    /**
+     * Read the optional 'column_counts' attribute.
+     *
+     * @return False if the attribute is not present.
+     */
+    inline bool read_column_counts(const std::string &filename, const Json::Value &data, unsigned int numBits,
+        std::vector<unsigned int> &columnCounts)
+    {
+      columnCounts.clear();
+      if (!data.isMember("column_counts"))
+        return false;
+
+      const Json::Value &counts = data["column_counts"];
+      if (!counts.isArray() || counts.size() != numBits)
+        throw std::runtime_error(make_string("JSON header for file ", filename, " contains an invalid 'column_counts' attribute"));
+      for (Json::ArrayIndex i = 0; i < counts.size(); ++i)
+        columnCounts.push_back(counts[i].asUInt());
+      return true;
+    }
+
+    /**
+     * The positions of the optional arrays stored after the fingerprints of
+     * a row-major file (see the 'bit_counts' and 'part_counts' attributes).
+     * The positions are relative to the start of the binary data.
+     */
+    struct StoredStatistics
+    {
+      StoredStatistics() : hasBitCounts(false), bitCounts(0), numParts(0), partCounts(0)
       {
-        TIMER("InMemoryRowMajorFingerprintStorage::load():");
+      }
 
-        // open the file
-        BinaryInputFile file(filename);
-        if (!file)
-          throw std::runtime_error(make_string("Could not open fingerprint file \"", filename, "\""));
+      bool hasBitCounts;
+      std::size_t bitCounts; //!< Position of the bit counts
+      unsigned int numParts; //!< The number of parts or 0 if not stored
+      std::size_t partCounts; //!< Position of the part counts
 
-        // parse the JSON header
-        m_json = file.header();
-        Json::Reader reader;
-        Json::Value data;
-        if (!reader.parse(m_json, data))
-          throw std::runtime_error(reader.getFormattedErrorMessages());
-
-        // make sure the required attributes are present
-        if (!data.isMember("filetype") || data["filetype"].asString() != "fingerprints")
-          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'filetype' attribute or is not 'fingerprints'"));
-        if (!data.isMember("order"))
-          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'order' attribute"));
-        if (!data.isMember("num_bits"))
-          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_bits' attribute"));
-        if (!data.isMember("num_fingerprints"))
-          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_fingerprints' attribute"));
-
-        // ensure this is a row-major order file
-        if (data["order"].asString() != "row-major")
-          throw std::runtime_error(make_string(filename, " is not a row-major order fingerprint file"));
+      /**
+       * Get the position just after the last stored array.
+       */
+      std::size_t end(unsigned int numFingerprints) const
+      {
+        std::size_t result = 0;
+        if (hasBitCounts)
+          result = bitCounts + numFingerprints * sizeof(int32_t);
+        if (numParts)
+          result = std::max(result, partCounts + static_cast<std::size_t>(numFingerprints) * numParts * sizeof(uint16_t));
+        return result;
+      }
+    };
 
-        // get attributes from header
-        m_numBits = data["num_bits"].asUInt();
-        m_numFingerprints = data["num_fingerprints"].asUInt();
+    /**
+     * Parse and check the 'bit_counts' and 'part_counts' attributes.
+     *
+     * @param dataSize The size of the fingerprint data in bytes.
+     */
+    inline StoredStatistics read_stored_statistics(const std::string &filename, const Json::Value &data,
+        unsigned int numBits, std::size_t dataSize)
+    {
+      StoredStatistics stats;
+      if (data.isMember("bit_counts")) {
+        const Json::Value &position = data["bit_counts"];
+        if (!position.isIntegral() || position.asUInt64() < dataSize || position.asUInt64() % sizeof(int32_t))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " contains an invalid 'bit_counts' attribute"));
+        stats.hasBitCounts = true;
+        stats.bitCounts = position.asUInt64();
+      }
+      if (data.isMember("part_counts")) {
+        const Json::Value &parts = data["part_counts"];
+        if (!parts.isObject() || !parts["k"].isIntegral() || !parts["position"].isIntegral() ||
+            parts["k"].asUInt() < 1 || parts["k"].asUInt() > numBits || parts["position"].asUInt64() < dataSize ||
+            parts["position"].asUInt64() % sizeof(uint16_t))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " contains an invalid 'part_counts' attribute"));
+        stats.numParts = parts["k"].asUInt();
+        stats.partCounts = parts["position"].asUInt64();
+      }
+      return stats;
+    }
 
-        // allocate memory
-        m_fingerprints = new Word[bitvec_num_words_for_bits(m_numBits) * m_numFingerprints];
-        file.read(m_fingerprints, bitvec_num_words_for_bits(m_numBits) * m_numFingerprints * sizeof(Word));
+    /**
+     * Memory map the binary data of a fingerprint file.
+     *
+     * @param filename The fingerprint file.
+     * @param offset The offset of the binary data in the file.
+     * @param size The size of the binary data in bytes.
+     * @param advice The access pattern hint.
+     * @param mappedFile The mapped file.
+     *
+     * @return Pointer to the start of the binary data.
+     */
+    inline const Word* map_fingerprint_data(const std::string &filename, std::size_t offset, std::size_t size,
+        MemoryMapAdvice advice, boost::iostreams::mapped_file_source &mappedFile)
+    {
+      mappedFile.open(filename);
+      if (!mappedFile.is_open())
+        throw std::runtime_error(make_string("Could not memory map fingerprint file \"", filename, "\""));
+      if (mappedFile.size() < offset + size)
+        throw std::runtime_error(make_string("Fingerprint file \"", filename, "\" is truncated"));
+      // the file is mapped from the start and the header size is a multiple
+      // of 8 bytes so the fingerprints are aligned
+      if (offset % sizeof(Word))
+        throw std::runtime_error(make_string("Fingerprint file \"", filename, "\" has misaligned data"));
 
-        m_init = true;
+#if defined(__unix__) || defined(__APPLE__)
+      int flag = MADV_NORMAL;
+      switch (advice) {
+        case SequentialAdvice:
+          flag = MADV_SEQUENTIAL;
+          break;
+        case RandomAdvice:
+          flag = MADV_RANDOM;
+          break;
+        case WillNeedAdvice:
+          flag = MADV_WILLNEED;
+          break;
+        default:
+          break;
       }
+      // the hint is best effort, errors are ignored
+      if (flag != MADV_NORMAL && mappedFile.size())
+        madvise(const_cast<char*>(mappedFile.data()), mappedFile.size(), flag);
+#endif
 
-    private:
-      std::string m_json; //!< JSON header
-      Word *m_fingerprints;
-      unsigned int m_numBits;
-      unsigned int m_numFingerprints;
-      bool m_init;
-  };
+      return reinterpret_cast<const Word*>(mappedFile.data() + offset);
+    }
 
-  class InMemoryColumnMajorFingerprintStorage
+  }
+
+  //@endcond
+
+  /**
+   * Remove the attributes describing data that is only valid for the
+   * exact fingerprints in a file (i.e. 'bit_counts', 'part_counts',
+   * 'column_counts' and 'popcount_offsets'). This is used by tools that
+   * copy the JSON header of their input file.
+   */
+  inline void remove_fingerprint_statistics(Json::Value &data)
+  {
+    data.removeMember("bit_counts");
+    data.removeMember("part_counts");
+    data.removeMember("column_counts");
+    data.removeMember("popcount_offsets");
+  }
+
+  /**
+   * @brief Row-major fingerprint storage that loads all fingerprints in memory.
+   *
+   * The fingerprints are stored in cache line aligned memory (see
+   * aligned_new()) and each fingerprint is padded with zero words to a SIMD
+   * friendly stride (see aligned_stride()). The padding is never returned
+   * by the kernels (i.e. the bits are zero) but allows them to use aligned
+   * loads.
+   */
+  class InMemoryRowMajorFingerprintStorage
   {
     public:
-      InMemoryColumnMajorFingerprintStorage() : m_fingerprints(0), m_numBits(0),
-          m_numFingerprints(0), m_init(false)
+      InMemoryRowMajorFingerprintStorage() : m_fingerprints(0), m_bitCounts(0), m_numParts(0), m_numBits(0),
+          m_numFingerprints(0), m_capacity(0), m_numWords(0), m_stride(0), m_init(false)
       {
       }
 
-      ~InMemoryColumnMajorFingerprintStorage()
+      ~InMemoryRowMajorFingerprintStorage()
       {
-        delete [] m_fingerprints;
+        aligned_delete(m_fingerprints);
+        delete [] m_bitCounts;
       }
 
       std::string header() const
@@ -490,60 +1056,995 @@ query: 00001011 (bit 5, 7 & 8 are set)
         return m_numFingerprints;
       }
 
-      Word* bit(unsigned int index) const
+      Word* fingerprint(unsigned int index) const
       {
         if (!m_init)
           return 0;
-        return m_fingerprints + bitvec_num_words_for_bits(m_numFingerprints) * index;
+        return m_fingerprints + static_cast<std::size_t>(m_stride) * index;
       }
 
-      void load(const std::string &filename)
+      /**
+       * Get the number of words between consecutive fingerprints. This is at
+       * least the number of words in a fingerprint, the padding words are
+       * zero.
+       */
+      unsigned int stride() const
       {
-        TIMER("InMemoryColumnMajorFingerprintStorage::load():");
+        return m_stride;
+      }
 
-        // open the file
-        BinaryInputFile file(filename);
-        if (!file)
-          throw std::runtime_error(make_string("Could not open fingerprint file \"", filename, "\""));
+      /**
+       * Get the cached bit count for a fingerprint.
+       */
+      int bitCount(unsigned int index) const
+      {
+        return m_bitCounts[index];
+      }
 
-        // parse the JSON header
-        m_json = file.header();
-        Json::Reader reader;
-        Json::Value data;
-        if (!reader.parse(m_json, data))
-          throw std::runtime_error(reader.getFormattedErrorMessages());
-
-        // make sure the required attributes are present
-        if (!data.isMember("filetype") || data["filetype"].asString() != "fingerprints")
-          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'filetype' attribute or is not 'fingerprints'"));
-        if (!data.isMember("order"))
-          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'order' attribute"));
-        if (!data.isMember("num_bits"))
-          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_bits' attribute"));
-        if (!data.isMember("num_fingerprints"))
-          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_fingerprints' attribute"));
-
-        // ensure this is a row-major order file
-        if (data["order"].asString() != "column-major")
-          throw std::runtime_error(make_string(filename, " is not a column-major order fingerprint file"));
+      /**
+       * Get the cached bit counts for all fingerprints.
+       */
+      const int* bitCounts() const
+      {
+        return m_bitCounts;
+      }
 
-        // get attributes from header
-        m_numBits = data["num_bits"].asUInt();
-        m_numFingerprints = data["num_fingerprints"].asUInt();
+      /**
+       * Get the population count bucket offsets. The fingerprints with
+       * population count c are stored at positions [offsets[c], offsets[c + 1]).
+       *
+       * @return The num_bits + 2 offsets or an empty vector if the
+       *         fingerprints are not sorted by population count.
+       */
+      const std::vector<unsigned int>& popcountOffsets() const
+      {
+        return m_popcountOffsets;
+      }
 
-        // allocate memory
-        m_fingerprints = new Word[bitvec_num_words_for_bits(m_numFingerprints) * m_numBits];
-        file.read(m_fingerprints, bitvec_num_words_for_bits(m_numFingerprints) * m_numBits * sizeof(Word));
+      /**
+       * Get the number of fingerprints that have each bit set.
+       *
+       * @return The num_bits counts or an empty vector if the file does not
+       *         contain the 'column_counts' attribute.
+       */
+      const std::vector<unsigned int>& columnCounts() const
+      {
+        return m_columnCounts;
+      }
 
-        m_init = true;
+      /**
+       * Get the stored bit counts for the parts of the kD-grid (see
+       * bitvec_part_count()). The counts for fingerprint i are stored at
+       * [i * numParts, (i + 1) * numParts).
+       *
+       * @param numParts The number of parts.
+       *
+       * @return The part counts or 0 if the file does not contain the part
+       *         counts for @p numParts parts.
+       */
+      const uint16_t* partCounts(unsigned int numParts) const
+      {
+        if (numParts != m_numParts || m_partCounts.empty())
+          return 0;
+        return &m_partCounts[0];
       }
 
-    private:
-      std::string m_json; //!< JSON header
-      Word *m_fingerprints;
-      unsigned int m_numBits;
-      unsigned int m_numFingerprints;
-      bool m_init;
+      /**
+       * Append a fingerprint to the storage. The fingerprint is copied and
+       * gets index numFingerprints() - 1. The memory grows geometrically so
+       * appending is amortized constant time. Appending a fingerprint
+       * invalidates the pointers returned by fingerprint() and bitCounts()
+       * and the fingerprints are no longer sorted by population count (i.e.
+       * popcountOffsets() returns an empty vector).
+       *
+       * @pre The storage must be loaded (see load()).
+       *
+       * @param fingerprint The fingerprint to append.
+       *
+       * @return The index of the appended fingerprint.
+       */
+      unsigned int append(const Word *fingerprint)
+      {
+        PRE(m_init);
+
+        if (m_numFingerprints == m_capacity) {
+          m_capacity = std::max(1024u, 2 * m_capacity);
+          Word *fingerprints = aligned_new<Word>(static_cast<std::size_t>(m_stride) * m_capacity);
+          int *bitCounts = new int[m_capacity];
+          std::copy(m_fingerprints, m_fingerprints + static_cast<std::size_t>(m_stride) * m_numFingerprints, fingerprints);
+          std::copy(m_bitCounts, m_bitCounts + m_numFingerprints, bitCounts);
+          aligned_delete(m_fingerprints);
+          delete [] m_bitCounts;
+          m_fingerprints = fingerprints;
+          m_bitCounts = bitCounts;
+        }
+
+        std::copy(fingerprint, fingerprint + m_numWords, m_fingerprints + static_cast<std::size_t>(m_stride) * m_numFingerprints);
+        m_bitCounts[m_numFingerprints] = bitvec_count(fingerprint, m_numWords);
+        m_popcountOffsets.clear();
+
+        // keep the stored statistics up to date
+        if (m_columnCounts.size())
+          for (unsigned int i = 0; i < m_numBits; ++i)
+            if (bitvec_get(i, fingerprint))
+              ++m_columnCounts[i];
+        if (m_partCounts.size())
+          for (unsigned int i = 0; i < m_numParts; ++i)
+            m_partCounts.push_back(bitvec_part_count(fingerprint, m_numBits, m_numParts, i));
+
+        return m_numFingerprints++;
+      }
+
+      /**
+       * Get the memory used by the padded fingerprints, the cached bit counts
+       * and the statistics.
+       */
+      MemoryUsage memoryUsage() const
+      {
+        std::size_t heap = aligned_size<Word>(static_cast<std::size_t>(m_stride) * m_capacity) +
+            (m_bitCounts ? m_capacity * sizeof(int) : 0) + vector_memory_usage(m_popcountOffsets) +
+            vector_memory_usage(m_columnCounts) + vector_memory_usage(m_partCounts);
+        return MemoryUsage(heap, 0, heap);
+      }
+
+      /**
+       * Estimate the memory usage after loading a row-major fingerprint file
+       * from its header. Errors are reported by throwing a std::runtime_error.
+       */
+      static MemoryUsage estimateMemoryUsage(const std::string &filename)
+      {
+        Json::Value data = impl::read_fingerprint_header(filename, "row-major");
+        std::size_t n = data["num_fingerprints"].asUInt();
+        unsigned int numBits = data["num_bits"].asUInt();
+        std::size_t stride = aligned_stride(bitvec_num_words_for_bits(numBits), sizeof(Word));
+        std::size_t numParts = data.isMember("part_counts") ? data["part_counts"]["k"].asUInt() : 0;
+        std::size_t heap = aligned_size<Word>(stride * n) + n * sizeof(int) + n * numParts * sizeof(uint16_t) +
+            impl::estimate_statistics_memory_usage(data, numBits);
+        return MemoryUsage(heap, 0, heap);
+      }
+
+      void load(const std::string &filename)
+      {
+        TIMER("InMemoryRowMajorFingerprintStorage::load():");
+
+        // open the file and allocate memory
+        BinaryInputFile file;
+        Json::Value data = open(filename, file, true);
+
+        readRows(file, 0, m_numFingerprints);
+
+        // use the stored bit counts or cache them
+        impl::StoredStatistics stats = readStatistics(filename, data, file);
+        if (!stats.hasBitCounts)
+          for (unsigned int i = 0; i < m_numFingerprints; ++i)
+            m_bitCounts[i] = bitvec_count(m_fingerprints + static_cast<std::size_t>(m_stride) * i, m_numWords);
+
+        // population count bucket offsets for sorted files
+        impl::read_popcount_offsets(filename, data, m_numBits, m_numFingerprints, m_bitCounts, m_popcountOffsets);
+
+        m_init = true;
+      }
+
+#ifdef HAVE_CPP11
+      /**
+       * Load the fingerprints using the threads of a thread pool. The
+       * fingerprints are divided over the worker threads using
+       * ThreadPool::parallelForPartitioned() and each worker reads its part
+       * of the file. Since the memory is first touched by the worker, the
+       * pages are placed on the NUMA node of that worker. When the pool's
+       * threads are pinned (see ThreadPool::ThreadPool()), the threaded
+       * brute force searches using the same pool process the fingerprints
+       * on the node where they are stored.
+       *
+       * @note This function is only available when C++11 support is enabled.
+       *
+       * @param filename The fingerprint file.
+       * @param pool The thread pool to use.
+       */
+      void load(const std::string &filename, ThreadPool &pool)
+      {
+        TIMER("InMemoryRowMajorFingerprintStorage::load():");
+
+        // open the file and allocate memory without touching it
+        BinaryInputFile file;
+        Json::Value data = open(filename, file, false);
+        impl::StoredStatistics stats = readStatistics(filename, data, file);
+        file.close();
+
+        pool.parallelForPartitioned(m_numFingerprints, pool.chunkSize(m_numFingerprints, 1024),
+            [&] (std::size_t begin, std::size_t end) {
+          BinaryInputFile chunk(filename);
+          chunk.seek(static_cast<std::size_t>(m_numWords) * begin * sizeof(Word));
+          readRows(chunk, begin, end);
+          if (!stats.hasBitCounts)
+            for (std::size_t i = begin; i < end; ++i)
+              m_bitCounts[i] = bitvec_count(m_fingerprints + static_cast<std::size_t>(m_stride) * i, m_numWords);
+        });
+
+        // population count bucket offsets for sorted files
+        impl::read_popcount_offsets(filename, data, m_numBits, m_numFingerprints, m_bitCounts, m_popcountOffsets);
+
+        m_init = true;
+      }
+#endif
+
+    private:
+      /**
+       * Open the file, parse the header and allocate the memory.
+       */
+      Json::Value open(const std::string &filename, BinaryInputFile &file, bool zero)
+      {
+        // open the file
+        file.open(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open fingerprint file \"", filename, "\""));
+
+        // parse the JSON header
+        m_json = file.header();
+        Json::Value data = impl::parse_fingerprint_header(filename, m_json, "row-major");
+
+        // get attributes from header
+        m_numBits = data["num_bits"].asUInt();
+        m_numFingerprints = data["num_fingerprints"].asUInt();
+        m_capacity = m_numFingerprints;
+        m_numWords = bitvec_num_words_for_bits(m_numBits);
+        m_stride = aligned_stride(m_numWords, sizeof(Word));
+
+        // allocate memory
+        aligned_delete(m_fingerprints);
+        m_fingerprints = aligned_new<Word>(static_cast<std::size_t>(m_stride) * m_numFingerprints, zero);
+        delete [] m_bitCounts;
+        m_bitCounts = new int[m_numFingerprints];
+
+        return data;
+      }
+
+      /**
+       * Read the optional statistics stored after the fingerprints (see
+       * RowMajorFingerprintOutputFile::writeStatistics()).
+       */
+      impl::StoredStatistics readStatistics(const std::string &filename, const Json::Value &data, BinaryInputFile &file)
+      {
+        std::size_t dataSize = static_cast<std::size_t>(m_numWords) * m_numFingerprints * sizeof(Word);
+        impl::StoredStatistics stats = impl::read_stored_statistics(filename, data, m_numBits, dataSize);
+
+        impl::read_column_counts(filename, data, m_numBits, m_columnCounts);
+
+        if (stats.hasBitCounts && m_numFingerprints && (!file.seek(stats.bitCounts) ||
+              !file.read(m_bitCounts, m_numFingerprints * sizeof(int32_t))))
+          throw std::runtime_error(make_string("Fingerprint file \"", filename, "\" is truncated"));
+
+        m_numParts = stats.numParts;
+        m_partCounts.resize(static_cast<std::size_t>(m_numFingerprints) * m_numParts);
+        if (m_partCounts.size() && (!file.seek(stats.partCounts) ||
+              !file.read(&m_partCounts[0], m_partCounts.size() * sizeof(uint16_t))))
+          throw std::runtime_error(make_string("Fingerprint file \"", filename, "\" is truncated"));
+
+        return stats;
+      }
+
+      /**
+       * Read the fingerprints [begin,end) from the file (positioned at
+       * fingerprint begin) and copy them to the padded rows.
+       */
+      void readRows(BinaryInputFile &file, std::size_t begin, std::size_t end)
+      {
+        if (m_stride == m_numWords) {
+          file.read(m_fingerprints + static_cast<std::size_t>(m_stride) * begin,
+              static_cast<std::size_t>(m_numWords) * (end - begin) * sizeof(Word));
+          return;
+        }
+
+        // read blocks of fingerprints
+        const std::size_t blockSize = 4096;
+        std::vector<Word> block(static_cast<std::size_t>(m_numWords) * blockSize);
+        for (std::size_t i = begin; i < end; i += blockSize) {
+          std::size_t n = std::min(blockSize, end - i);
+          file.read(&block[0], static_cast<std::size_t>(m_numWords) * n * sizeof(Word));
+          for (std::size_t j = 0; j < n; ++j) {
+            Word *row = m_fingerprints + static_cast<std::size_t>(m_stride) * (i + j);
+            std::copy(&block[0] + static_cast<std::size_t>(m_numWords) * j, &block[0] + static_cast<std::size_t>(m_numWords) * (j + 1), row);
+            std::fill(row + m_numWords, row + m_stride, 0);
+          }
+        }
+      }
+
+      std::string m_json; //!< JSON header
+      Word *m_fingerprints;
+      int *m_bitCounts; //!< Cached bit count for each fingerprint
+      std::vector<unsigned int> m_popcountOffsets; //!< Population count bucket offsets (sorted files only)
+      std::vector<unsigned int> m_columnCounts; //!< Number of fingerprints that have each bit set (if stored)
+      std::vector<uint16_t> m_partCounts; //!< Bit counts for the parts of the kD-grid (if stored)
+      unsigned int m_numParts; //!< Number of parts for m_partCounts
+      unsigned int m_numBits;
+      unsigned int m_numFingerprints;
+      unsigned int m_capacity; //!< Number of fingerprints that fit in the allocated memory
+      unsigned int m_numWords; //!< Number of words per fingerprint
+      unsigned int m_stride; //!< Number of words between consecutive fingerprints
+      bool m_init;
+  };
+
+  /**
+   * @brief Column-major fingerprint storage that loads all fingerprints in memory.
+   *
+   * The columns are stored in cache line aligned memory (see aligned_new())
+   * and each column is padded with zero words to a multiple of the cache
+   * line size (see aligned_stride()).
+   */
+  class InMemoryColumnMajorFingerprintStorage
+  {
+    public:
+      InMemoryColumnMajorFingerprintStorage() : m_fingerprints(0), m_bitCounts(0), m_numBits(0),
+          m_numFingerprints(0), m_numWords(0), m_stride(0), m_init(false)
+      {
+      }
+
+      ~InMemoryColumnMajorFingerprintStorage()
+      {
+        aligned_delete(m_fingerprints);
+        delete [] m_bitCounts;
+      }
+
+      std::string header() const
+      {
+        return m_json;
+      }
+
+      unsigned int numBits() const
+      {
+        return m_numBits;
+      }
+
+      unsigned int numFingerprints() const
+      {
+        return m_numFingerprints;
+      }
+
+      Word* bit(unsigned int index) const
+      {
+        if (!m_init)
+          return 0;
+        return m_fingerprints + static_cast<std::size_t>(m_stride) * index;
+      }
+
+      /**
+       * Get the number of words between consecutive columns. This is at
+       * least the number of words in a column, the padding words are zero.
+       */
+      unsigned int stride() const
+      {
+        return m_stride;
+      }
+
+      /**
+       * Get the cached bit count for a fingerprint.
+       */
+      int bitCount(unsigned int index) const
+      {
+        return m_bitCounts[index];
+      }
+
+      /**
+       * Get the cached bit counts for all fingerprints.
+       */
+      const int* bitCounts() const
+      {
+        return m_bitCounts;
+      }
+
+      /**
+       * Get the number of fingerprints that have a bit set.
+       */
+      unsigned int columnCount(unsigned int index) const
+      {
+        return m_columnCounts[index];
+      }
+
+      /**
+       * Get the memory used by the padded columns, the cached bit counts and
+       * the column counts.
+       */
+      MemoryUsage memoryUsage() const
+      {
+        std::size_t heap = aligned_size<Word>(static_cast<std::size_t>(m_stride) * m_numBits) +
+            (m_bitCounts ? m_numFingerprints * sizeof(int) : 0) + vector_memory_usage(m_columnCounts);
+        return MemoryUsage(heap, 0, heap);
+      }
+
+      /**
+       * Estimate the memory usage after loading a column-major fingerprint
+       * file from its header. Errors are reported by throwing a
+       * std::runtime_error.
+       */
+      static MemoryUsage estimateMemoryUsage(const std::string &filename)
+      {
+        Json::Value data = impl::read_fingerprint_header(filename, "column-major");
+        std::size_t n = data["num_fingerprints"].asUInt();
+        std::size_t numBits = data["num_bits"].asUInt();
+        std::size_t stride = aligned_stride(bitvec_num_words_for_bits(n), sizeof(Word));
+        std::size_t heap = aligned_size<Word>(stride * numBits) + n * sizeof(int) + numBits * sizeof(unsigned int);
+        return MemoryUsage(heap, 0, heap);
+      }
+
+      void load(const std::string &filename)
+      {
+        TIMER("InMemoryColumnMajorFingerprintStorage::load():");
+
+        // open the file
+        BinaryInputFile file(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open fingerprint file \"", filename, "\""));
+
+        // parse the JSON header
+        m_json = file.header();
+        Json::Value data = impl::parse_fingerprint_header(filename, m_json, "column-major");
+
+        // get attributes from header
+        m_numBits = data["num_bits"].asUInt();
+        m_numFingerprints = data["num_fingerprints"].asUInt();
+        m_numWords = bitvec_num_words_for_bits(m_numFingerprints);
+        m_stride = aligned_stride(m_numWords, sizeof(Word));
+
+        // allocate memory and read the columns
+        aligned_delete(m_fingerprints);
+        m_fingerprints = aligned_new<Word>(static_cast<std::size_t>(m_stride) * m_numBits);
+        if (m_stride == m_numWords)
+          file.read(m_fingerprints, static_cast<std::size_t>(m_numWords) * m_numBits * sizeof(Word));
+        else
+          for (unsigned int i = 0; i < m_numBits; ++i)
+            file.read(m_fingerprints + static_cast<std::size_t>(m_stride) * i, m_numWords * sizeof(Word));
+
+        // cache the bit counts (by visiting the set bits in each column), the
+        // column counts are computed in the same pass so the optional
+        // 'column_counts' header attribute is not needed
+        delete [] m_bitCounts;
+        m_bitCounts = new int[m_numFingerprints];
+        std::fill(m_bitCounts, m_bitCounts + m_numFingerprints, 0);
+        m_columnCounts.assign(m_numBits, 0);
+        for (unsigned int i = 0; i < m_numBits; ++i) {
+          const Word *column = m_fingerprints + static_cast<std::size_t>(m_stride) * i;
+          for (unsigned int j = 0; j < m_numWords; ++j)
+            for (Word word = column[j]; word; word &= word - 1) {
+              // index of the lowest set bit
+              unsigned int index = j * BitsPerWord + bitvec_count((word & (~word + 1)) - 1);
+              if (index < m_numFingerprints) {
+                ++m_bitCounts[index];
+                ++m_columnCounts[i];
+              }
+            }
+        }
+
+        m_init = true;
+      }
+
+    private:
+      std::string m_json; //!< JSON header
+      Word *m_fingerprints;
+      int *m_bitCounts; //!< Cached bit count for each fingerprint
+      std::vector<unsigned int> m_columnCounts; //!< Number of set bits in each column
+      unsigned int m_numBits;
+      unsigned int m_numFingerprints;
+      unsigned int m_numWords; //!< Number of words per bit
+      unsigned int m_stride; //!< Number of words between consecutive columns
+      bool m_init;
+  };
+
+  /**
+   * @brief Row-major fingerprint storage backed by a memory mapped file.
+   *
+   * This class is a model of the RowMajorFingerprintStorageConcept. Instead
+   * of copying the fingerprints to memory, the file is memory mapped so the
+   * pages are loaded on demand and multiple processes searching the same
+   * file share a single copy in the page cache. Stored bit counts and part
+   * counts are used directly from the mapped file. If the file doesn't
+   * contain them, the bit counts are computed (i.e. the file is read once)
+   * and kept in memory. The mapped
+   * data is read-only, the pointers returned by fingerprint() must not be
+   * used to modify the fingerprints.
+   */
+  class MemoryMappedRowMajorFingerprintStorage
+  {
+    public:
+      MemoryMappedRowMajorFingerprintStorage() : m_fingerprints(0), m_storedBitCounts(0), m_partCounts(0),
+          m_numParts(0), m_numBits(0), m_numFingerprints(0), m_numWords(0)
+      {
+      }
+
+      /**
+       * Constructor, see load().
+       */
+      MemoryMappedRowMajorFingerprintStorage(const std::string &filename, MemoryMapAdvice advice = DefaultAdvice)
+        : m_fingerprints(0), m_storedBitCounts(0), m_partCounts(0), m_numParts(0), m_numBits(0),
+          m_numFingerprints(0), m_numWords(0)
+      {
+        load(filename, advice);
+      }
+
+      std::string header() const
+      {
+        return m_json;
+      }
+
+      unsigned int numBits() const
+      {
+        return m_numBits;
+      }
+
+      unsigned int numFingerprints() const
+      {
+        return m_numFingerprints;
+      }
+
+      Word* fingerprint(unsigned int index) const
+      {
+        if (!m_fingerprints)
+          return 0;
+        return const_cast<Word*>(m_fingerprints) + static_cast<std::size_t>(m_numWords) * index;
+      }
+
+      /**
+       * Get the cached bit count for a fingerprint.
+       */
+      int bitCount(unsigned int index) const
+      {
+        return bitCounts()[index];
+      }
+
+      /**
+       * Get the cached bit counts for all fingerprints.
+       */
+      const int* bitCounts() const
+      {
+        if (m_storedBitCounts)
+          return m_storedBitCounts;
+        return m_bitCounts.empty() ? 0 : &m_bitCounts[0];
+      }
+
+      /**
+       * Get the population count bucket offsets. The fingerprints with
+       * population count c are stored at positions [offsets[c], offsets[c + 1]).
+       *
+       * @return The num_bits + 2 offsets or an empty vector if the
+       *         fingerprints are not sorted by population count.
+       */
+      const std::vector<unsigned int>& popcountOffsets() const
+      {
+        return m_popcountOffsets;
+      }
+
+      /**
+       * Get the number of fingerprints that have each bit set.
+       *
+       * @return The num_bits counts or an empty vector if the file does not
+       *         contain the 'column_counts' attribute.
+       */
+      const std::vector<unsigned int>& columnCounts() const
+      {
+        return m_columnCounts;
+      }
+
+      /**
+       * Get the stored bit counts for the parts of the kD-grid (see
+       * bitvec_part_count()). The counts point into the mapped file.
+       *
+       * @param numParts The number of parts.
+       *
+       * @return The part counts or 0 if the file does not contain the part
+       *         counts for @p numParts parts.
+       */
+      const uint16_t* partCounts(unsigned int numParts) const
+      {
+        return numParts == m_numParts ? m_partCounts : 0;
+      }
+
+      /**
+       * Memory map a row-major fingerprint file. Errors are reported by
+       * throwing a std::runtime_error.
+       *
+       * @param filename The fingerprint file.
+       * @param advice The expected access pattern (see MemoryMapAdvice).
+       */
+      /**
+       * Get the size of the mapped file and the memory used by the cached
+       * bit counts and the statistics.
+       */
+      MemoryUsage memoryUsage() const
+      {
+        std::size_t heap = vector_memory_usage(m_bitCounts) + vector_memory_usage(m_popcountOffsets) +
+            vector_memory_usage(m_columnCounts);
+        MemoryUsage usage(heap, 0, heap);
+        usage += mapped_memory_usage(m_mappedFile.data(), m_mappedFile.size());
+        return usage;
+      }
+
+      /**
+       * Estimate the memory usage after loading a row-major fingerprint file
+       * from its header (nothing is resident yet). Errors are reported by
+       * throwing a std::runtime_error.
+       */
+      static MemoryUsage estimateMemoryUsage(const std::string &filename)
+      {
+        Json::Value data = impl::read_fingerprint_header(filename, "row-major");
+        unsigned int numBits = data["num_bits"].asUInt();
+        // the bit counts are cached if they are not stored in the file
+        std::size_t heap = impl::estimate_statistics_memory_usage(data, numBits) +
+            (data.isMember("bit_counts") ? 0 : data["num_fingerprints"].asUInt() * sizeof(int));
+        return MemoryUsage(heap, file_size(filename), heap);
+      }
+
+      void load(const std::string &filename, MemoryMapAdvice advice = DefaultAdvice)
+      {
+        TIMER("MemoryMappedRowMajorFingerprintStorage::load():");
+
+        // use a temporary BinaryInputFile to read the header
+        BinaryInputFile file(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open fingerprint file \"", filename, "\""));
+
+        // parse the JSON header
+        m_json = file.header();
+        Json::Value data = impl::parse_fingerprint_header(filename, m_json, "row-major");
+
+        // get attributes from header
+        m_numBits = data["num_bits"].asUInt();
+        m_numFingerprints = data["num_fingerprints"].asUInt();
+        m_numWords = bitvec_num_words_for_bits(m_numBits);
+
+        // the optional statistics stored after the fingerprints
+        std::size_t dataSize = static_cast<std::size_t>(m_numWords) * m_numFingerprints * sizeof(Word);
+        impl::StoredStatistics stats = impl::read_stored_statistics(filename, data, m_numBits, dataSize);
+        impl::read_column_counts(filename, data, m_numBits, m_columnCounts);
+
+        // memory map the binary data
+        std::size_t offset = file.stream().tellg();
+        file.close();
+        m_fingerprints = impl::map_fingerprint_data(filename, offset,
+            std::max(dataSize, stats.end(m_numFingerprints)), advice, m_mappedFile);
+
+        // use the stored bit counts or cache them
+        const char *base = reinterpret_cast<const char*>(m_fingerprints);
+        m_bitCounts.clear();
+        m_storedBitCounts = 0;
+        if (stats.hasBitCounts) {
+          m_storedBitCounts = reinterpret_cast<const int*>(base + stats.bitCounts);
+        } else {
+          m_bitCounts.resize(m_numFingerprints);
+          for (unsigned int i = 0; i < m_numFingerprints; ++i)
+            m_bitCounts[i] = bitvec_count(m_fingerprints + static_cast<std::size_t>(m_numWords) * i, m_numWords);
+        }
+
+        m_numParts = stats.numParts;
+        m_partCounts = m_numParts ? reinterpret_cast<const uint16_t*>(base + stats.partCounts) : 0;
+
+        // population count bucket offsets for sorted files
+        impl::read_popcount_offsets(filename, data, m_numBits, m_numFingerprints, bitCounts(), m_popcountOffsets);
+      }
+
+    private:
+      MemoryMappedRowMajorFingerprintStorage(const MemoryMappedRowMajorFingerprintStorage&);
+      MemoryMappedRowMajorFingerprintStorage& operator=(const MemoryMappedRowMajorFingerprintStorage&);
+
+      std::string m_json; //!< JSON header
+      boost::iostreams::mapped_file_source m_mappedFile;
+      const Word *m_fingerprints; //!< The fingerprints in the mapped file
+      std::vector<int> m_bitCounts; //!< Cached bit count for each fingerprint
+      const int *m_storedBitCounts; //!< The bit counts in the mapped file (if stored)
+      std::vector<unsigned int> m_popcountOffsets; //!< Population count bucket offsets (sorted files only)
+      std::vector<unsigned int> m_columnCounts; //!< Number of fingerprints that have each bit set (if stored)
+      const uint16_t *m_partCounts; //!< The part counts in the mapped file (if stored)
+      unsigned int m_numParts; //!< Number of parts for m_partCounts
+      unsigned int m_numBits;
+      unsigned int m_numFingerprints;
+      unsigned int m_numWords; //!< Number of words per fingerprint
+  };
+
+  /**
+   * @brief Column-major fingerprint storage backed by a memory mapped file.
+   *
+   * This class is a model of the ColumnMajorFingerprintStorageConcept. The
+   * file is memory mapped so only the columns for the query bits are loaded
+   * when screening and multiple processes share a single copy in the page
+   * cache. The column counts are taken from the optional 'column_counts'
+   * header attribute (see the transpose tool) and only computed if it is
+   * missing. The bit count for a fingerprint is not cached, bitCount()
+   * visits all columns. The mapped data is read-only.
+   */
+  class MemoryMappedColumnMajorFingerprintStorage
+  {
+    public:
+      MemoryMappedColumnMajorFingerprintStorage() : m_fingerprints(0), m_numBits(0), m_numFingerprints(0),
+          m_numWords(0)
+      {
+      }
+
+      /**
+       * Constructor, see load().
+       */
+      MemoryMappedColumnMajorFingerprintStorage(const std::string &filename, MemoryMapAdvice advice = DefaultAdvice)
+        : m_fingerprints(0), m_numBits(0), m_numFingerprints(0), m_numWords(0)
+      {
+        load(filename, advice);
+      }
+
+      std::string header() const
+      {
+        return m_json;
+      }
+
+      unsigned int numBits() const
+      {
+        return m_numBits;
+      }
+
+      unsigned int numFingerprints() const
+      {
+        return m_numFingerprints;
+      }
+
+      Word* bit(unsigned int index) const
+      {
+        if (!m_fingerprints)
+          return 0;
+        return const_cast<Word*>(m_fingerprints) + static_cast<std::size_t>(m_numWords) * index;
+      }
+
+      /**
+       * Get the bit count for a fingerprint. This is computed by checking
+       * the fingerprint's bit in all columns.
+       */
+      int bitCount(unsigned int index) const
+      {
+        int count = 0;
+        for (unsigned int i = 0; i < m_numBits; ++i)
+          if (bitvec_get(index, bit(i)))
+            ++count;
+        return count;
+      }
+
+      /**
+       * Get the number of fingerprints that have a bit set.
+       */
+      unsigned int columnCount(unsigned int index) const
+      {
+        return m_columnCounts[index];
+      }
+
+      /**
+       * Get the size of the mapped file and the memory used by the column
+       * counts.
+       */
+      MemoryUsage memoryUsage() const
+      {
+        std::size_t heap = vector_memory_usage(m_columnCounts);
+        MemoryUsage usage(heap, 0, heap);
+        usage += mapped_memory_usage(m_mappedFile.data(), m_mappedFile.size());
+        return usage;
+      }
+
+      /**
+       * Estimate the memory usage after loading a column-major fingerprint
+       * file from its header (nothing is resident yet). Errors are reported
+       * by throwing a std::runtime_error.
+       */
+      static MemoryUsage estimateMemoryUsage(const std::string &filename)
+      {
+        Json::Value data = impl::read_fingerprint_header(filename, "column-major");
+        std::size_t heap = data["num_bits"].asUInt() * sizeof(unsigned int);
+        return MemoryUsage(heap, file_size(filename), heap);
+      }
+
+      /**
+       * Memory map a column-major fingerprint file. Errors are reported by
+       * throwing a std::runtime_error.
+       *
+       * @param filename The fingerprint file.
+       * @param advice The expected access pattern (see MemoryMapAdvice).
+       */
+      void load(const std::string &filename, MemoryMapAdvice advice = DefaultAdvice)
+      {
+        TIMER("MemoryMappedColumnMajorFingerprintStorage::load():");
+
+        // use a temporary BinaryInputFile to read the header
+        BinaryInputFile file(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open fingerprint file \"", filename, "\""));
+
+        // parse the JSON header
+        m_json = file.header();
+        Json::Value data = impl::parse_fingerprint_header(filename, m_json, "column-major");
+
+        // get attributes from header
+        m_numBits = data["num_bits"].asUInt();
+        m_numFingerprints = data["num_fingerprints"].asUInt();
+        m_numWords = bitvec_num_words_for_bits(m_numFingerprints);
+
+        // memory map the binary data
+        std::size_t offset = file.stream().tellg();
+        file.close();
+        m_fingerprints = impl::map_fingerprint_data(filename, offset,
+            static_cast<std::size_t>(m_numWords) * m_numBits * sizeof(Word), advice, m_mappedFile);
+
+        // the column counts are stored in the header by the transpose tool
+        if (!impl::read_column_counts(filename, data, m_numBits, m_columnCounts)) {
+          for (unsigned int i = 0; i < m_numBits; ++i)
+            m_columnCounts.push_back(bitvec_count(bit(i), m_numWords));
+        }
+      }
+
+    private:
+      MemoryMappedColumnMajorFingerprintStorage(const MemoryMappedColumnMajorFingerprintStorage&);
+      MemoryMappedColumnMajorFingerprintStorage& operator=(const MemoryMappedColumnMajorFingerprintStorage&);
+
+      std::string m_json; //!< JSON header
+      boost::iostreams::mapped_file_source m_mappedFile;
+      const Word *m_fingerprints; //!< The columns in the mapped file
+      std::vector<unsigned int> m_columnCounts; //!< Number of set bits in each column
+      unsigned int m_numBits;
+      unsigned int m_numFingerprints;
+      unsigned int m_numWords; //!< Number of words per bit
+  };
+
+  /**
+   * @brief Compressed column-major fingerprint storage.
+   *
+   * This class is a model of the CompressedColumnMajorFingerprintStorageConcept.
+   * The compressed columns are loaded in main memory, the bit counts for the
+   * fingerprints and the column counts are computed while loading.
+   */
+  class InMemoryCompressedColumnMajorFingerprintStorage
+  {
+    public:
+      InMemoryCompressedColumnMajorFingerprintStorage() : m_numBits(0), m_numFingerprints(0)
+      {
+      }
+
+      std::string header() const
+      {
+        return m_json;
+      }
+
+      unsigned int numBits() const
+      {
+        return m_numBits;
+      }
+
+      unsigned int numFingerprints() const
+      {
+        return m_numFingerprints;
+      }
+
+      /**
+       * Get the compressed column for a bit.
+       */
+      const RoaringBitmap& column(unsigned int index) const
+      {
+        return m_columns[index];
+      }
+
+      /**
+       * Get the cached bit count for a fingerprint.
+       */
+      int bitCount(unsigned int index) const
+      {
+        return m_bitCounts[index];
+      }
+
+      /**
+       * Get the cached bit counts for all fingerprints.
+       */
+      const int* bitCounts() const
+      {
+        return m_bitCounts.empty() ? 0 : &m_bitCounts[0];
+      }
+
+      /**
+       * Get the number of fingerprints that have a bit set.
+       */
+      unsigned int columnCount(unsigned int index) const
+      {
+        return m_columnCounts[index];
+      }
+
+      /**
+       * Get the number of bytes used by the compressed columns.
+       */
+      std::size_t sizeInBytes() const
+      {
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < m_columns.size(); ++i)
+          size += m_columns[i].sizeInBytes();
+        return size;
+      }
+
+      /**
+       * Get the memory used by the compressed columns, the cached bit counts
+       * and the column counts.
+       */
+      MemoryUsage memoryUsage() const
+      {
+        std::size_t heap = sizeInBytes() + vector_memory_usage(m_columns) +
+            vector_memory_usage(m_bitCounts) + vector_memory_usage(m_columnCounts);
+        return MemoryUsage(heap, 0, heap);
+      }
+
+      /**
+       * Estimate the memory usage after loading a compressed column-major
+       * fingerprint file from its header. The compressed columns are
+       * assumed to take as much space as in the file. Errors are reported
+       * by throwing a std::runtime_error.
+       */
+      static MemoryUsage estimateMemoryUsage(const std::string &filename)
+      {
+        Json::Value data = impl::read_fingerprint_header(filename, "compressed-column-major");
+        std::size_t numBits = data["num_bits"].asUInt();
+        std::size_t heap = file_size(filename) + numBits * (sizeof(RoaringBitmap) + sizeof(unsigned int)) +
+            data["num_fingerprints"].asUInt() * sizeof(int);
+        return MemoryUsage(heap, 0, heap);
+      }
+
+      /**
+       * Load a compressed column-major fingerprint file. Errors are reported
+       * by throwing a std::runtime_error.
+       */
+      void load(const std::string &filename)
+      {
+        TIMER("InMemoryCompressedColumnMajorFingerprintStorage::load():");
+
+        // open the file
+        BinaryInputFile file(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open fingerprint file \"", filename, "\""));
+
+        // parse the JSON header
+        m_json = file.header();
+        Json::Value data = impl::parse_fingerprint_header(filename, m_json, "compressed-column-major");
+
+        // get attributes from header
+        m_numBits = data["num_bits"].asUInt();
+        m_numFingerprints = data["num_fingerprints"].asUInt();
+
+        // read the columns
+        m_columns.clear();
+        m_columns.resize(m_numBits);
+        for (unsigned int i = 0; i < m_numBits; ++i)
+          if (!m_columns[i].read(file))
+            throw std::runtime_error(make_string("Fingerprint file \"", filename, "\" contains an invalid column"));
+
+        // cache the bit counts and column counts
+        m_bitCounts.assign(m_numFingerprints, 0);
+        m_columnCounts.assign(m_numBits, 0);
+        for (unsigned int i = 0; i < m_numBits; ++i) {
+          const RoaringBitmap &column = m_columns[i];
+          for (unsigned int j = 0; j < column.numContainers(); ++j) {
+            const RoaringBitmap::Container &container = column.container(j);
+            unsigned int offset = container.key * RoaringBitmap::ContainerBits;
+            if (container.isBitmap()) {
+              for (unsigned int k = 0; k < RoaringBitmap::ContainerWords; ++k)
+                for (Word word = container.bitmap[k]; word; word &= word - 1)
+                  countBit(filename, offset + k * BitsPerWord + __builtin_ctzll(word));
+            } else {
+              for (std::size_t k = 0; k < container.array.size(); ++k)
+                countBit(filename, offset + container.array[k]);
+            }
+            m_columnCounts[i] += container.cardinality;
+          }
+        }
+      }
+
+    private:
+      void countBit(const std::string &filename, unsigned int index)
+      {
+        if (index >= m_numFingerprints)
+          throw std::runtime_error(make_string("Fingerprint file \"", filename, "\" contains an invalid column"));
+        ++m_bitCounts[index];
+      }
+
+      std::string m_json; //!< JSON header
+      std::vector<RoaringBitmap> m_columns; //!< The compressed columns
+      std::vector<int> m_bitCounts; //!< Cached bit count for each fingerprint
+      std::vector<unsigned int> m_columnCounts; //!< Number of set bits in each column
+      unsigned int m_numBits;
+      unsigned int m_numFingerprints;
   };
 
 }
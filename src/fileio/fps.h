@@ -28,85 +28,271 @@
 #define HELIUM_FILEIO_FPS_H
 
 #include <Helium/bitvec.h>
+#include <Helium/util/string.h>
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace Helium {
 
   /**
-   * @brief Class for reading FPS fingerprint files.
+   * @brief Streaming reader for FPS fingerprint files.
    *
-   * FPS is a text format for storing fingerprints. This class can read FPS1
-   * files and will store all read fingerprints and store them memory for this
-   * class' lifetime. This class expects to find a num_bits field in the FPS
-   * header (e.g. "#num_bits=1024").
+   * The file is read in large blocks and the fingerprints are decoded in
+   * chunks into a buffer provided by the caller (see read()), so files of
+   * any size can be processed using constant memory. The lines are parsed
+   * in the block buffer without creating a std::string per line. The
+   * identifiers after the hexadecimal fingerprints are ignored.
    *
-   * The FPS specification can be found here: https://code.google.com/p/chem-fingerprints/wiki/FPS
+   * Errors are reported by throwing a std::runtime_error.
+   *
+   * @code
+   * FpsReader reader("fingerprints.fps");
+   * unsigned int numWords = bitvec_num_words_for_bits(reader.numBits());
+   * std::vector<Word> chunk(1000 * numWords);
+   * while (unsigned int n = reader.read(&chunk[0], 1000)) {
+   *   // process the n fingerprints in chunk
+   * }
+   * @endcode
    */
-  class FpsFile
+  class FpsReader
   {
     public:
       /**
        * @brief Constructor.
        */
-      FpsFile() : m_numFingerprints(0), m_numBits(0)
+      FpsReader() : m_numBits(0), m_begin(0), m_end(0), m_line(0), m_eof(true)
       {
       }
 
       /**
-       * @brief Load the fingerprints form the specified filename.
+       * @brief Constructor, see open().
+       */
+      explicit FpsReader(const std::string &filename, std::size_t bufferSize = 1 << 20)
+        : m_numBits(0), m_begin(0), m_end(0), m_line(0), m_eof(true)
+      {
+        open(filename, bufferSize);
+      }
+
+      /**
+       * @brief Open an FPS file and read the header.
        *
-       * @param filename The FPS file.
+       * The header must contain a num_bits field (e.g. "#num_bits=1024").
        *
-       * @return True if the file was parsed successfully.
+       * @param filename The FPS file.
+       * @param bufferSize The size of the read buffer (in bytes).
        */
-      bool load(const std::string &filename)
+      void open(const std::string &filename, std::size_t bufferSize = 1 << 20)
       {
-        m_fingerprints.clear();
+        m_ifs.close();
+        m_ifs.clear();
+        m_ifs.open(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+        if (!m_ifs)
+          throw std::runtime_error(make_string("Could not open FPS file \"", filename, "\""));
 
-        std::ifstream ifs(filename.c_str());
-        if (!ifs)
-          return false;
-
-        m_numFingerprints = 0;
+        m_buffer.resize(std::max<std::size_t>(bufferSize, 4096));
+        m_begin = m_end = 0;
+        m_line = 0;
+        m_eof = false;
         m_numBits = 0;
-        unsigned int numWords = 0;
-
         m_type = "FPS";
 
-        std::string line;
         // read fps header
-        while (ifs && !ifs.eof() && ifs.peek() == '#') {
-          std::getline(ifs, line);
+        const char *begin, *end;
+        while (fill() && m_buffer[m_begin] == '#') {
+          nextLine(begin, end);
+          std::string line(begin, end);
           if (line.substr(0, 10) == "#num_bits=") {
             std::stringstream ss(line.substr(10));
             ss >> m_numBits;
-            numWords = bitvec_num_words_for_bits(m_numBits);
           } else if (line.substr(0, 6) == "#type=") {
             m_type = line.substr(6);
           }
         }
 
         if (!m_numBits)
-          return false;
+          throw std::runtime_error(make_string("Could not read num_bits header field from FPS file \"", filename, "\""));
+      }
 
-        // allocate bit vector
-        Word *fingerprint = new Word[numWords];
+      /**
+       * @brief Get the type of fingerprint (see FpsFile::type()).
+       */
+      const std::string& type() const
+      {
+        return m_type;
+      }
 
-        // process fingerprints
-        while (std::getline(ifs, line)) {
-          if (line.empty())
+      /**
+       * @brief Get the number of bits in the fingerprints.
+       */
+      unsigned int numBits() const
+      {
+        return m_numBits;
+      }
+
+      /**
+       * @brief Read the next chunk of fingerprints.
+       *
+       * @param fingerprints The buffer for the fingerprints, this must have
+       *        room for @p maxFingerprints fingerprints of
+       *        bitvec_num_words_for_bits(numBits()) words.
+       * @param maxFingerprints The maximum number of fingerprints to read.
+       *
+       * @return The number of fingerprints read, 0 at the end of the file.
+       */
+      unsigned int read(Word *fingerprints, unsigned int maxFingerprints)
+      {
+        unsigned int numWords = bitvec_num_words_for_bits(m_numBits);
+        std::size_t maxNibbles = 2 * numWords * sizeof(Word);
+        unsigned int count = 0;
+        const char *begin, *end;
+        while (count < maxFingerprints && nextLine(begin, end)) {
+          // the fingerprint ends at the first whitespace
+          const char *hex = begin;
+          while (hex != end && *hex != ' ' && *hex != '\t' && *hex != '\r')
+            ++hex;
+          if (hex == begin)
             continue;
 
-          std::size_t nibbles = line.find(' ');
-          if (nibbles == std::string::npos)
-            nibbles = line.find('\t');
-          if (nibbles == std::string::npos)
-            nibbles = line.size();
+          std::size_t nibbles = std::min<std::size_t>(hex - begin, maxNibbles);
+          if (!hex_to_bitvec(begin, nibbles, fingerprints + static_cast<std::size_t>(count) * numWords, numWords))
+            throw std::runtime_error(make_string("Invalid fingerprint on line ", m_line, " of FPS file"));
+          ++count;
+        }
+        return count;
+      }
 
-          // convert hex to fingerprint
-          hex_to_bitvec(line.substr(0, nibbles), fingerprint, numWords);
+    private:
+      /**
+       * Make sure there is data in the buffer.
+       *
+       * @return False at the end of the file.
+       */
+      bool fill()
+      {
+        if (m_begin < m_end)
+          return true;
+        if (m_eof)
+          return false;
+        m_begin = 0;
+        m_ifs.read(&m_buffer[0], m_buffer.size());
+        m_end = m_ifs.gcount();
+        if (m_end < m_buffer.size())
+          m_eof = true;
+        return m_end > 0;
+      }
+
+      /**
+       * Get the next line (without the newline). The line is valid until the
+       * next call.
+       *
+       * @return False at the end of the file.
+       */
+      bool nextLine(const char *&begin, const char *&end)
+      {
+        if (!fill())
+          return false;
+
+        for (std::size_t searched = m_begin; ;) {
+          const char *newline = static_cast<const char*>(std::memchr(&m_buffer[0] + searched, '\n', m_end - searched));
+          if (newline) {
+            begin = &m_buffer[m_begin];
+            end = newline;
+            m_begin = newline - &m_buffer[0] + 1;
+            ++m_line;
+            return true;
+          }
+
+          if (m_eof) {
+            // last line without newline
+            begin = &m_buffer[m_begin];
+            end = &m_buffer[0] + m_end;
+            m_begin = m_end;
+            ++m_line;
+            return true;
+          }
+
+          // move the partial line to the front and read more data
+          std::size_t size = m_end - m_begin;
+          std::memmove(&m_buffer[0], &m_buffer[m_begin], size);
+          m_begin = 0;
+          m_end = size;
+          searched = size;
+          if (m_end == m_buffer.size())
+            m_buffer.resize(2 * m_buffer.size()); // line longer than the buffer
+          m_ifs.read(&m_buffer[m_end], m_buffer.size() - m_end);
+          std::size_t n = m_ifs.gcount();
+          if (m_end + n < m_buffer.size())
+            m_eof = true;
+          m_end += n;
+        }
+      }
+
+      std::ifstream m_ifs; //!< The input file
+      std::string m_type; //!< The fingerprint type
+      unsigned int m_numBits; //!< The number of bits
+      std::vector<char> m_buffer; //!< The read buffer
+      std::size_t m_begin; //!< Start of the unparsed data in m_buffer
+      std::size_t m_end; //!< End of the data in m_buffer
+      std::size_t m_line; //!< The current line number
+      bool m_eof; //!< True if the end of the file has been read
+  };
+
+  /**
+   * @brief Class for reading FPS fingerprint files.
+   *
+   * FPS is a text format for storing fingerprints. This class can read FPS1
+   * files and will store all read fingerprints in memory for this class'
+   * lifetime (see FpsReader for processing large files). This class expects to find a num_bits field in the FPS
+   * header (e.g. "#num_bits=1024").
+   *
+   * The FPS specification can be found here: https://code.google.com/p/chem-fingerprints/wiki/FPS
+   */
+  class FpsFile
+  {
+    public:
+      /**
+       * @brief Constructor.
+       */
+      FpsFile() : m_numFingerprints(0), m_numBits(0)
+      {
+      }
 
-          std::copy(fingerprint, fingerprint + numWords, std::back_inserter(m_fingerprints));
-          ++m_numFingerprints;
+      /**
+       * @brief Load the fingerprints form the specified filename.
+       *
+       * @param filename The FPS file.
+       *
+       * @return True if the file was parsed successfully.
+       */
+      bool load(const std::string &filename)
+      {
+        m_fingerprints.clear();
+        m_numFingerprints = 0;
+        m_numBits = 0;
+
+        try {
+          FpsReader reader(filename);
+          m_type = reader.type();
+          m_numBits = reader.numBits();
+          unsigned int numWords = bitvec_num_words_for_bits(m_numBits);
+
+          // read the fingerprints in chunks
+          const unsigned int chunkSize = 1024;
+          while (true) {
+            m_fingerprints.resize((m_numFingerprints + chunkSize) * static_cast<std::size_t>(numWords));
+            unsigned int n = reader.read(&m_fingerprints[m_numFingerprints * static_cast<std::size_t>(numWords)], chunkSize);
+            m_numFingerprints += n;
+            if (n < chunkSize)
+              break;
+          }
+          m_fingerprints.resize(m_numFingerprints * static_cast<std::size_t>(numWords));
+        } catch (const std::exception&) {
+          m_numBits = 0;
+          return false;
         }
 
         return true;
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <Helium/fileio/molecules.h>
+
+namespace Helium {
+
+  void compress_molecule_file(const std::string &inFile, const std::string &outFile, unsigned int blockMolecules,
+      unsigned int indexStride)
+  {
+    PRE(blockMolecules > 0);
+    PRE(indexStride > 0 && blockMolecules % indexStride == 0);
+
+    BufferedMoleculeFile file(inFile);
+    BinaryOutputFile out(outFile);
+
+    std::vector<uint64_t> positions; // positions of the records in their block
+    std::vector<uint64_t> blockPositions; // file positions of the blocks
+    std::vector<char> block, compressed;
+
+    MoleculeView mol;
+    unsigned int numMolecules = file.numMolecules();
+    for (unsigned int i = 0; i < numMolecules; ++i) {
+      file.read_molecule(mol);
+      positions.push_back(block.size());
+      block.insert(block.end(), mol.data(), mol.data() + MoleculeView::record_size(mol.data()));
+
+      // write the block when it is full or after the last molecule
+      if ((i + 1) % blockMolecules == 0 || i + 1 == numMolecules) {
+        impl::compress_block(block, compressed);
+        blockPositions.push_back(out.stream().tellp());
+        out.write(&compressed[0], compressed.size());
+        block.clear();
+      }
+    }
+    // the end of the last block
+    blockPositions.push_back(out.stream().tellp());
+
+    // create JSON header
+    Json::Value data;
+    data["filetype"] = "molecules";
+    data["num_molecules"] = numMolecules;
+
+    // write the block and molecule positions
+    Json::UInt64 blocksPos = out.stream().tellp();
+    out.write(&blockPositions[0], blockPositions.size() * sizeof(uint64_t));
+    impl::write_molecule_indexes(out, positions, indexStride, data);
+    data["compression"] = "zlib";
+    data["block_molecules"] = blockMolecules;
+    data["num_blocks"] = static_cast<unsigned int>(blockPositions.size() - 1);
+    data["block_indexes"] = blocksPos;
+
+    // write JSON header
+    Json::StyledWriter writer;
+    if (!out.writeHeader(writer.write(data)))
+      throw std::runtime_error(make_string("Could not write file ", outFile));
+  }
+
+}
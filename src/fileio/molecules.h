@@ -29,12 +29,31 @@
 
 #include <Helium/hemol.h>
 #include <Helium/util.h>
+#include <Helium/contract.h>
 #include <Helium/fileio/file.h>
+#include <Helium/fileio/moleculeview.h>
+#include <Helium/util/memory.h>
 
 #include <json/json.h>
 
 #include <boost/iostreams/device/mapped_file.hpp>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_CPP11
+#include <future>
+#include <mutex>
+#endif
+
 namespace Helium {
 
   template<typename MoleculeType>
@@ -53,6 +72,8 @@ namespace Helium {
     if (!is)
       return false;
 
+    mol.reserve(numAtoms, numBonds);
+
     unsigned char element, cyclic, aromatic, mass, hydrogens;
     signed char charge;
     for (int i = 0; i < numAtoms; ++i) {
@@ -108,6 +129,8 @@ namespace Helium {
     unsigned short numAtoms = *reinterpret_cast<const unsigned short*>(data);
     unsigned short numBonds = *reinterpret_cast<const unsigned short*>(data + sizeof(unsigned short));
 
+    mol.reserve(numAtoms, numBonds);
+
     unsigned char element, cyclic, aromatic, mass, hydrogens;
     signed char charge;
     for (int i = 0; i < numAtoms; ++i) {
@@ -156,14 +179,528 @@ namespace Helium {
     return true;
   }
 
+  /**
+   * Let a MoleculeView point to the molecule record at @p data. The
+   * molecule is not decoded (see MoleculeView).
+   *
+   * @return True if successfull.
+   */
+  inline bool read_molecule(const char *data, MoleculeView &mol)
+  {
+    mol.assign(data);
+    return true;
+  }
+
+  /**
+   * Write a molecule record (see read_molecule()). Like the obhelium tool,
+   * hydrogen atoms are not written but added to the hydrogen count of
+   * their neighbor.
+   *
+   * @param os The output stream.
+   * @param mol The molecule.
+   */
+  template<typename MoleculeType>
+  void write_molecule(std::ostream &os, MoleculeType &mol)
+  {
+    typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
+    typedef typename molecule_traits<MoleculeType>::bond_type bond_type;
+
+    // map atom indices & count the number of heavy atoms
+    std::vector<unsigned short> indices(num_atoms(mol));
+    std::vector<int> hydrogens(num_atoms(mol));
+    unsigned short numAtoms = 0;
+    for (std::size_t i = 0; i < num_atoms(mol); ++i) {
+      atom_type atom = mol.atom(i);
+      indices[i] = numAtoms;
+      hydrogens[i] += atom.hydrogens();
+      if (atom.element() != 1)
+        ++numAtoms;
+    }
+
+    // count the number of bonds between heavy atoms
+    unsigned short numBonds = 0;
+    for (std::size_t i = 0; i < num_bonds(mol); ++i) {
+      bond_type bond = mol.bond(i);
+      atom_type source = get_source(mol, bond);
+      atom_type target = get_target(mol, bond);
+      if (source.element() == 1)
+        ++hydrogens[get_index(mol, target)];
+      else if (target.element() == 1)
+        ++hydrogens[get_index(mol, source)];
+      else
+        ++numBonds;
+    }
+
+    // write the number of atoms & bonds
+    write16<unsigned short>(os, numAtoms);
+    write16<unsigned short>(os, numBonds);
+
+    // write atoms (6 byte / atom)
+    for (std::size_t i = 0; i < num_atoms(mol); ++i) {
+      atom_type atom = mol.atom(i);
+      if (atom.element() == 1)
+        continue;
+      write8<unsigned char>(os, atom.element());
+      write8<unsigned char>(os, atom.isCyclic());
+      write8<unsigned char>(os, atom.isAromatic());
+      write8<unsigned char>(os, atom.mass());
+      write8<unsigned char>(os, hydrogens[i]);
+      write8<signed char>(os, atom.charge());
+    }
+
+    // write bonds (5 byte / bond)
+    for (std::size_t i = 0; i < num_bonds(mol); ++i) {
+      bond_type bond = mol.bond(i);
+      atom_type source = get_source(mol, bond);
+      atom_type target = get_target(mol, bond);
+      if (source.element() == 1 || target.element() == 1)
+        continue;
+
+      // write source & target indices
+      write16<unsigned short>(os, indices[get_index(mol, source)]);
+      write16<unsigned short>(os, indices[get_index(mol, target)]);
+      // write bond order + aromatic & cyclic properties
+      unsigned char props = bond.order() & 63;
+      if (bond.isAromatic())
+        props |= 128;
+      if (bond.isCyclic())
+        props |= 64;
+      write8<unsigned char>(os, props);
+    }
+  }
+
+  /**
+   * @page compressed_molecule_files Compressed Molecule Files
+   *
+   * Molecule files can also be stored with the molecule records compressed
+   * in blocks (see compress_molecule_file()). The JSON header then contains
+   * these additional attributes:
+   *
+   * - "compression": the compression method, only "zlib" is supported
+   * - "block_molecules": the number of molecules per block
+   * - "num_blocks": the number of blocks
+   * - "block_indexes": the file position of the block positions (num_blocks
+   *   + 1 64 bit file positions where the last one is the end of the last
+   *   block)
+   *
+   * Each block starts with the uncompressed size (4 bytes) followed by the
+   * zlib data. The "molecule_indexes" are the positions of the records
+   * inside their uncompressed block instead of file positions.
+   * MoleculeFile, MemoryMappedMoleculeFile and BufferedMoleculeFile read
+   * both formats, the most recently used uncompressed blocks are cached for
+   * random access.
+   */
+
+  /**
+   * @page sparse_molecule_indexes Sparse Molecule Indexes
+   *
+   * The "molecule_indexes" table contains a 64 bit position for every
+   * molecule by default. When the JSON header contains a
+   * "molecule_index_stride" attribute S, only the positions of the molecules
+   * 0, S, 2S, ... are stored (i.e. ceil(num_molecules / S) positions). The
+   * other molecules are found by skipping the records in between since the
+   * size of a record follows from its number of atoms and bonds. For
+   * compressed files, S must divide the "block_molecules" attribute.
+   *
+   * MoleculeFile and MemoryMappedMoleculeFile never copy the whole table:
+   * MoleculeFile reads it in pages when needed and MemoryMappedMoleculeFile
+   * reads the positions from the mapped file.
+   */
+
+  //@cond dev
+
+  namespace impl {
+
+    /**
+     * Compress a block of molecule records.
+     */
+    inline void compress_block(const std::vector<char> &block, std::vector<char> &compressed)
+    {
+#ifdef HAVE_ZLIB
+      uint32_t blockSize = block.size();
+      uLongf size = compressBound(blockSize);
+      compressed.resize(sizeof(uint32_t) + size);
+      std::memcpy(&compressed[0], &blockSize, sizeof(uint32_t));
+      if (compress2(reinterpret_cast<Bytef*>(&compressed[sizeof(uint32_t)]), &size,
+            reinterpret_cast<const Bytef*>(&block[0]), blockSize, Z_DEFAULT_COMPRESSION) != Z_OK)
+        throw std::runtime_error("Could not compress molecule block");
+      compressed.resize(sizeof(uint32_t) + size);
+#else
+      throw std::runtime_error("Compressed molecule files require zlib support");
+#endif
+    }
+
+    /**
+     * Decompress a block of molecule records.
+     */
+    inline void decompress_block(const char *data, std::size_t size, std::vector<char> &block)
+    {
+#ifdef HAVE_ZLIB
+      uint32_t blockSize;
+      if (size < sizeof(uint32_t))
+        throw std::runtime_error("Invalid compressed molecule block");
+      std::memcpy(&blockSize, data, sizeof(uint32_t));
+      block.resize(blockSize);
+      uLongf uncompressedSize = blockSize;
+      if (uncompress(reinterpret_cast<Bytef*>(&block[0]), &uncompressedSize,
+            reinterpret_cast<const Bytef*>(data + sizeof(uint32_t)), size - sizeof(uint32_t)) != Z_OK ||
+          uncompressedSize != blockSize)
+        throw std::runtime_error("Invalid compressed molecule block");
+#else
+      throw std::runtime_error("Compressed molecule files require zlib support");
+#endif
+    }
+
+    /**
+     * @brief The compressed blocks of a molecule file.
+     */
+    struct MoleculeBlocks
+    {
+      MoleculeBlocks() : blockMolecules(0)
+      {
+      }
+
+      bool compressed() const
+      {
+        return blockMolecules;
+      }
+
+      /**
+       * Get the compression attributes from the JSON header. The block
+       * positions are resized but not read.
+       *
+       * @return The file position of the block positions.
+       */
+      Json::UInt64 parse(const Json::Value &data, const std::string &filename)
+      {
+        blockMolecules = 0;
+        positions.clear();
+        if (!data.isMember("compression"))
+          return 0;
+
+        if (data["compression"].asString() != "zlib")
+          throw std::runtime_error(make_string("Unsupported compression '", data["compression"].asString(), "' in file ", filename));
+        if (!data.isMember("block_molecules") || !data.isMember("num_blocks") || !data.isMember("block_indexes"))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'block_molecules', 'num_blocks' or 'block_indexes' attribute"));
+        if (!data["block_molecules"].asUInt())
+          throw std::runtime_error(make_string("Invalid 'block_molecules' attribute in file ", filename));
+
+        blockMolecules = data["block_molecules"].asUInt();
+        positions.resize(data["num_blocks"].asUInt() + 1);
+        return data["block_indexes"].asUInt64();
+      }
+
+      unsigned int blockMolecules; //!< The number of molecules per block (0 if not compressed).
+      std::vector<uint64_t> positions; //!< The file positions of the blocks (+ end of the last block).
+    };
+
+    /**
+     * @brief Cache for uncompressed molecule blocks.
+     *
+     * The least recently used block is replaced when the cache is full.
+     */
+    class MoleculeBlockCache
+    {
+      public:
+        MoleculeBlockCache() : m_capacity(16), m_clock(0)
+        {
+        }
+
+        std::size_t capacity() const
+        {
+          return m_capacity;
+        }
+
+        void setCapacity(std::size_t capacity)
+        {
+          PRE(capacity > 0);
+          m_capacity = capacity;
+          m_entries.clear();
+        }
+
+        /**
+         * Get an uncompressed block. On a cache miss, @p reader is called as
+         * reader(index, buffer) and returns the compressed block as
+         * std::pair<const char*, std::size_t> (the buffer can be used to
+         * store the compressed data). The returned block is valid until the
+         * next call.
+         */
+        template<typename BlockReader>
+        const std::vector<char>& block(unsigned int index, BlockReader &reader)
+        {
+          ++m_clock;
+          std::size_t slot = 0;
+          for (std::size_t i = 0; i < m_entries.size(); ++i) {
+            if (m_entries[i].index == index) {
+              m_entries[i].lastUse = m_clock;
+              return m_entries[i].data;
+            }
+            if (m_entries[i].lastUse < m_entries[slot].lastUse)
+              slot = i;
+          }
+
+          if (m_entries.size() < m_capacity) {
+            slot = m_entries.size();
+            m_entries.resize(slot + 1);
+          }
+
+          Entry &entry = m_entries[slot];
+          entry.index = -1; // invalid if decompression fails
+          std::pair<const char*, std::size_t> compressed = reader(index, m_buffer);
+          decompress_block(compressed.first, compressed.second, entry.data);
+          entry.index = index;
+          entry.lastUse = m_clock;
+          return entry.data;
+        }
+
+        /**
+         * Get the number of bytes used by the cached blocks and the buffer.
+         */
+        std::size_t sizeInBytes() const
+        {
+          std::size_t size = vector_memory_usage(m_entries) + vector_memory_usage(m_buffer);
+          for (std::size_t i = 0; i < m_entries.size(); ++i)
+            size += vector_memory_usage(m_entries[i].data);
+          return size;
+        }
+
+      private:
+        struct Entry
+        {
+          Entry() : index(-1), lastUse(0)
+          {
+          }
+
+          unsigned int index; //!< The block index
+          unsigned long lastUse; //!< The clock value when last used
+          std::vector<char> data; //!< The uncompressed block
+        };
+
+        std::vector<Entry> m_entries;
+        std::vector<char> m_buffer; //!< Buffer for reading compressed blocks
+        std::size_t m_capacity; //!< The maximum number of cached blocks
+        unsigned long m_clock;
+    };
+
+    /**
+     * Read a molecule from a cached block. A MoleculeView gets its own copy
+     * of the record since the block may be replaced.
+     */
+    template<typename MoleculeType>
+    void read_block_molecule(const char *data, MoleculeType &mol)
+    {
+      Helium::read_molecule(data, mol);
+    }
+
+    inline void read_block_molecule(const char *data, MoleculeView &mol)
+    {
+      mol.copy(data);
+    }
+
+    /**
+     * @brief Read compressed blocks from a BinaryInputFile.
+     */
+    struct StreamBlockReader
+    {
+      StreamBlockReader(BinaryInputFile &file_, const MoleculeBlocks &blocks_) : file(file_), blocks(blocks_)
+      {
+      }
+
+      std::pair<const char*, std::size_t> operator()(unsigned int index, std::vector<char> &buffer)
+      {
+        std::size_t size = blocks.positions[index + 1] - blocks.positions[index];
+        buffer.resize(size);
+        file.stream().clear();
+        file.stream().seekg(blocks.positions[index]);
+        if (!file.read(&buffer[0], size))
+          throw std::runtime_error("Could not read compressed molecule block");
+        return std::make_pair(&buffer[0], size);
+      }
+
+      BinaryInputFile &file;
+      const MoleculeBlocks &blocks;
+    };
+
+    /**
+     * @brief Read compressed blocks from a memory mapped file.
+     */
+    struct MappedBlockReader
+    {
+      MappedBlockReader(const char *data_, const MoleculeBlocks &blocks_) : data(data_), blocks(blocks_)
+      {
+      }
+
+      std::pair<const char*, std::size_t> operator()(unsigned int index, std::vector<char> &buffer)
+      {
+        return std::make_pair(data + blocks.positions[index],
+                              static_cast<std::size_t>(blocks.positions[index + 1] - blocks.positions[index]));
+      }
+
+      const char *data;
+      const MoleculeBlocks &blocks;
+    };
+
+    /**
+     * @brief The molecule indexes attributes of a molecule file.
+     *
+     * See @ref sparse_molecule_indexes.
+     */
+    struct MoleculeIndexes
+    {
+      MoleculeIndexes() : numMolecules(0), position(0), stride(1)
+      {
+      }
+
+      /**
+       * Get the number of stored positions.
+       */
+      unsigned int size() const
+      {
+        return (numMolecules + stride - 1) / stride;
+      }
+
+      /**
+       * Get the molecule indexes attributes from the JSON header.
+       */
+      void parse(const Json::Value &data, const std::string &filename, const MoleculeBlocks &blocks)
+      {
+        numMolecules = data["num_molecules"].asUInt();
+        position = data["molecule_indexes"].asUInt64();
+        stride = data.isMember("molecule_index_stride") ? data["molecule_index_stride"].asUInt() : 1;
+        if (!stride || (blocks.compressed() && blocks.blockMolecules % stride))
+          throw std::runtime_error(make_string("Invalid 'molecule_index_stride' attribute in file ", filename));
+      }
+
+      unsigned int numMolecules; //!< The number of molecules.
+      Json::UInt64 position; //!< The file position of the molecule indexes.
+      unsigned int stride; //!< Only the position of every stride-th molecule is stored.
+    };
+
+    /**
+     * Get a stored molecule position from a molecule indexes table in memory.
+     */
+    inline uint64_t load_index(const char *indexes, std::size_t i)
+    {
+      // the table is not necessarily aligned
+      uint64_t position;
+      std::memcpy(&position, indexes + i * sizeof(uint64_t), sizeof(uint64_t));
+      return position;
+    }
+
+    /**
+     * Skip @p n molecule records in memory.
+     */
+    inline const char* skip_records(const char *data, unsigned int n)
+    {
+      for (unsigned int i = 0; i < n; ++i)
+        data += MoleculeView::record_size(data);
+      return data;
+    }
+
+    /**
+     * Skip @p n molecule records in a stream.
+     */
+    inline void skip_records(std::istream &is, unsigned int n)
+    {
+      for (unsigned int i = 0; i < n; ++i) {
+        unsigned short numAtoms, numBonds;
+        read16(is, numAtoms);
+        read16(is, numBonds);
+        is.seekg(6 * numAtoms + 5 * numBonds, std::ios_base::cur);
+      }
+    }
+
+    /**
+     * @brief Reads the molecule indexes table from a file in pages.
+     *
+     * Only the most recently used page is kept in memory.
+     */
+    class MoleculeIndexPage
+    {
+      public:
+        MoleculeIndexPage() : m_begin(0)
+        {
+        }
+
+        /**
+         * Forget the current page (e.g. when a new file is opened).
+         */
+        void clear()
+        {
+          m_begin = 0;
+          m_positions.clear();
+        }
+
+        /**
+         * Get the i-th stored position of the molecule indexes table.
+         */
+        uint64_t position(BinaryInputFile &file, const MoleculeIndexes &indexes, unsigned int i)
+        {
+          PRE(i < indexes.size());
+          if (i < m_begin || i >= m_begin + m_positions.size()) {
+            m_begin = i - i % pageSize;
+            // pageSize has no out-of-class definition, don't pass it by reference
+            unsigned int size = indexes.size() - m_begin;
+            m_positions.resize(size < pageSize ? size : pageSize);
+            file.stream().clear();
+            file.stream().seekg(indexes.position + m_begin * sizeof(uint64_t));
+            if (!file.read(&m_positions[0], m_positions.size() * sizeof(uint64_t)))
+              throw std::runtime_error("Could not read molecule indexes");
+          }
+          return m_positions[i - m_begin];
+        }
+
+      private:
+        static const unsigned int pageSize = 4096; //!< The number of positions per page.
+        unsigned int m_begin; //!< The index of the first position in m_positions.
+        std::vector<uint64_t> m_positions; //!< The positions in the current page.
+    };
+
+    /**
+     * Write the molecule indexes table at the current file position and add
+     * the attributes to the JSON header.
+     *
+     * @param file The molecule file.
+     * @param positions The positions of all molecules.
+     * @param stride Store every stride-th position (see @ref sparse_molecule_indexes).
+     * @param data The JSON header.
+     */
+    inline void write_molecule_indexes(BinaryOutputFile &file, const std::vector<uint64_t> &positions,
+        unsigned int stride, Json::Value &data)
+    {
+      PRE(stride > 0);
+      data["molecule_indexes"] = static_cast<Json::UInt64>(file.stream().tellp());
+      for (std::size_t i = 0; i < positions.size(); i += stride)
+        file.write(&positions[i], sizeof(uint64_t));
+      if (stride > 1)
+        data["molecule_index_stride"] = stride;
+    }
+
+  }
+
+  //@endcond
+
+  /**
+   * Compress a molecule file (see @ref compressed_molecule_files).
+   *
+   * @param inFile The molecule file to compress (may be compressed).
+   * @param outFile The compressed molecule file.
+   * @param blockMolecules The number of molecules per block.
+   * @param indexStride Only store the position of every indexStride-th
+   *        molecule (see @ref sparse_molecule_indexes), must divide
+   *        @p blockMolecules.
+   */
+  void compress_molecule_file(const std::string &inFile, const std::string &outFile, unsigned int blockMolecules = 256,
+      unsigned int indexStride = 1);
+
   class MoleculeFile
   {
     public:
-      MoleculeFile() : m_numMolecules(0)
+      MoleculeFile() : m_numMolecules(0), m_current(0)
       {
       }
 
-      MoleculeFile(const std::string &filename)
+      MoleculeFile(const std::string &filename) : m_current(0)
       {
         load(filename);
       }
@@ -188,17 +725,38 @@ namespace Helium {
         if (!data.isMember("molecule_indexes"))
           throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'molecule_indexes' attribute"));
 
-        // extract needed attributes
-        m_numMolecules = data["num_molecules"].asUInt();
-        Json::UInt64 positionsPos = data["molecule_indexes"].asUInt64();
+        // extract needed attributes, the molecule indexes are read when needed
+        Json::UInt64 blocksPos = m_blocks.parse(data, filename);
+        m_indexes.parse(data, filename, m_blocks);
+        m_numMolecules = m_indexes.numMolecules;
+        m_indexPage.clear();
 
-        // read the molecule indexes
-        m_positions.resize(m_numMolecules);
-        m_file.stream().seekg(positionsPos);
-        m_file.read(&m_positions[0], m_positions.size() * sizeof(uint64_t));
+        // read the block indexes for compressed files
+        if (m_blocks.compressed()) {
+          m_file.stream().seekg(blocksPos);
+          m_file.read(&m_blocks.positions[0], m_blocks.positions.size() * sizeof(uint64_t));
+        }
 
         // reset stream position to read first molecule
         m_file.seek(0);
+        m_current = 0;
+      }
+
+      /**
+       * Check if the molecule records are compressed.
+       */
+      bool isCompressed() const
+      {
+        return m_blocks.compressed();
+      }
+
+      /**
+       * Set the maximum number of uncompressed blocks to keep in memory for
+       * compressed files (default is 16).
+       */
+      void setBlockCacheSize(std::size_t numBlocks)
+      {
+        m_cache.setCapacity(numBlocks);
       }
 
       unsigned int numMolecules() const
@@ -214,9 +772,12 @@ namespace Helium {
       template<typename MoleculeType>
       bool read_molecule(MoleculeType &mol)
       {
+        if (m_blocks.compressed())
+          return m_current < m_numMolecules && read_molecule(m_current, mol);
         if (!(bool)m_file)
           return false;
         Helium::read_molecule(m_file.stream(), mol);
+        ++m_current;
         return true;
       }
 
@@ -228,13 +789,31 @@ namespace Helium {
       template<typename MoleculeType>
       bool read_molecule(unsigned int index, MoleculeType &mol)
       {
+        uint64_t position = m_indexPage.position(m_file, m_indexes, index / m_indexes.stride);
+        if (m_blocks.compressed()) {
+          impl::StreamBlockReader reader(m_file, m_blocks);
+          const std::vector<char> &block = m_cache.block(index / m_blocks.blockMolecules, reader);
+          impl::read_block_molecule(impl::skip_records(&block[0] + position, index % m_indexes.stride), mol);
+          m_current = index + 1;
+          return true;
+        }
         if (!(bool)m_file)
           return false;
-        m_file.stream().seekg(m_positions[index]);
+        m_file.stream().seekg(position);
+        impl::skip_records(m_file.stream(), index % m_indexes.stride);
         Helium::read_molecule(m_file.stream(), mol);
+        m_current = index + 1;
         return true;
       }
 
+      /**
+       * Get the index of the next molecule that will be read.
+       */
+      unsigned int current() const
+      {
+        return m_current;
+      }
+
       std::ifstream& stream()
       {
         return m_file.stream();
@@ -243,14 +822,18 @@ namespace Helium {
 
     private:
       BinaryInputFile m_file;
-      std::vector<uint64_t> m_positions;
+      impl::MoleculeIndexes m_indexes; //!< The molecule indexes attributes.
+      impl::MoleculeIndexPage m_indexPage; //!< The molecule positions (in their block if compressed) being used.
       unsigned int m_numMolecules;
+      unsigned int m_current; //!< The index of the next molecule.
+      impl::MoleculeBlocks m_blocks; //!< The blocks for compressed files.
+      impl::MoleculeBlockCache m_cache; //!< Cache of uncompressed blocks.
   };
 
   class MemoryMappedMoleculeFile
   {
     public:
-      MemoryMappedMoleculeFile() : m_numMolecules(0)
+      MemoryMappedMoleculeFile() : m_positions(0), m_numMolecules(0)
       {
       }
 
@@ -281,18 +864,23 @@ namespace Helium {
           throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'molecule_indexes' attribute"));
 
         // extract needed attributes
-        m_numMolecules = data["num_molecules"].asUInt();
-        Json::UInt64 positionsPos = data["molecule_indexes"].asUInt64();
+        Json::UInt64 blocksPos = m_blocks.parse(data, filename);
+        m_indexes.parse(data, filename, m_blocks);
+        m_numMolecules = m_indexes.numMolecules;
 
         // open the memory mapped file
         m_mappedFile.open(filename);
         assert(m_mappedFile.is_open());
         assert(m_mappedFile.data());
 
-        // read the molecule indexes
-        m_positions.resize(m_numMolecules);
-        for (unsigned int i = 0; i < m_positions.size(); ++i)
-          m_positions[i] = *reinterpret_cast<const uint64_t*>(m_mappedFile.data() + positionsPos + i * sizeof(uint64_t));
+        // the molecule indexes are read from the mapped file when needed
+        if (m_indexes.position + m_indexes.size() * sizeof(uint64_t) > m_mappedFile.size())
+          throw std::runtime_error(make_string("Invalid 'molecule_indexes' attribute in file ", filename));
+        m_positions = m_mappedFile.data() + m_indexes.position;
+
+        // read the block indexes for compressed files
+        for (std::size_t i = 0; i < m_blocks.positions.size(); ++i)
+          m_blocks.positions[i] = impl::load_index(m_mappedFile.data() + blocksPos, i);
       }
 
       unsigned int numMolecules() const
@@ -300,24 +888,405 @@ namespace Helium {
         return m_numMolecules;
       }
 
+      /**
+       * Check if the molecule records are compressed.
+       */
+      bool isCompressed() const
+      {
+        return m_blocks.compressed();
+      }
+
+      /**
+       * Get the size of the mapped file (including the molecule indexes)
+       * and the memory used by the block indexes and the block cache.
+       */
+      MemoryUsage memoryUsage() const
+      {
+        std::size_t heap = vector_memory_usage(m_blocks.positions) + m_cache.sizeInBytes();
+        MemoryUsage usage(heap, 0, heap);
+        usage += mapped_memory_usage(m_mappedFile.data(), m_mappedFile.size());
+        return usage;
+      }
+
+      /**
+       * Estimate the memory usage after loading a molecule file from its
+       * header. The block cache of compressed files is not included since
+       * it is only filled when molecules are read. Errors are reported by
+       * throwing a std::runtime_error.
+       */
+      static MemoryUsage estimateMemoryUsage(const std::string &filename)
+      {
+        BinaryInputFile file(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open molecule file \"", filename, "\""));
+
+        Json::Reader reader;
+        Json::Value data;
+        if (!reader.parse(file.header(), data))
+          throw std::runtime_error(reader.getFormattedErrorMessages());
+        if (!data.isMember("filetype") || data["filetype"].asString() != "molecules")
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'filetype' attribute or is not 'molecules'"));
+
+        impl::MoleculeBlocks blocks;
+        blocks.parse(data, filename);
+        std::size_t heap = vector_memory_usage(blocks.positions);
+        return MemoryUsage(heap, file_size(filename), heap);
+      }
+
+      /**
+       * Set the maximum number of uncompressed blocks to keep in memory for
+       * compressed files (default is 16).
+       */
+      void setBlockCacheSize(std::size_t numBlocks)
+      {
+        m_cache.setCapacity(numBlocks);
+      }
+
       /**
        * Read the molecule with the specified index from the file.
        *
+       * This function can be called concurrently. For compressed files, the
+       * access to the block cache is serialized (when C++11 support is
+       * enabled) and a MoleculeView gets a copy of the molecule record.
+       *
        * @return True if successfull.
        */
       template<typename MoleculeType>
       bool read_molecule(unsigned int index, MoleculeType &mol)
       {
-        Helium::read_molecule(m_mappedFile.data() + m_positions[index], mol);
+        if (m_blocks.compressed()) {
+#ifdef HAVE_CPP11
+          std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+          impl::MappedBlockReader reader(m_mappedFile.data(), m_blocks);
+          const std::vector<char> &block = m_cache.block(index / m_blocks.blockMolecules, reader);
+          impl::read_block_molecule(impl::skip_records(&block[0] + position(index), index % m_indexes.stride), mol);
+          return true;
+        }
+        Helium::read_molecule(impl::skip_records(m_mappedFile.data() + position(index), index % m_indexes.stride), mol);
         return true;
       }
 
+      /**
+       * Ask the operating system to start reading the records for the
+       * molecules with the specified indices. The pages of the records (or
+       * of the compressed blocks containing them) are merged into ranges and
+       * passed to madvise(MADV_WILLNEED) so the page faults on a cold page
+       * cache are overlapped with other work. This is only a hint, it does
+       * nothing on platforms without madvise().
+       *
+       * @param indices The sorted molecule indices.
+       */
+      void prefetch(const std::vector<unsigned int> &indices) const
+      {
+#ifdef MADV_WILLNEED
+        const std::size_t pageSize = boost::iostreams::mapped_file_source::alignment();
+        uint64_t rangeBegin = 0, rangeEnd = 0;
+        for (std::size_t i = 0; i < indices.size(); ++i) {
+          std::pair<uint64_t, uint64_t> record = recordRange(indices[i]);
+          uint64_t begin = record.first / pageSize * pageSize;
+          if (rangeEnd && begin <= rangeEnd) {
+            rangeEnd = std::max(rangeEnd, record.second);
+            continue;
+          }
+          if (rangeEnd)
+            madvise(const_cast<char*>(m_mappedFile.data()) + rangeBegin, rangeEnd - rangeBegin, MADV_WILLNEED);
+          rangeBegin = begin;
+          rangeEnd = record.second;
+        }
+        // the hint is best effort, errors are ignored
+        if (rangeEnd)
+          madvise(const_cast<char*>(m_mappedFile.data()) + rangeBegin, rangeEnd - rangeBegin, MADV_WILLNEED);
+#endif
+      }
+
     private:
+      /**
+       * Get the stored position for a molecule (see @ref sparse_molecule_indexes).
+       */
+      uint64_t position(unsigned int index) const
+      {
+        return impl::load_index(m_positions, index / m_indexes.stride);
+      }
+
+      /**
+       * Get the range of file positions containing the record for a
+       * molecule (i.e. its compressed block or the records up to the next
+       * stored position).
+       */
+      std::pair<uint64_t, uint64_t> recordRange(unsigned int index) const
+      {
+        if (m_blocks.compressed()) {
+          unsigned int block = index / m_blocks.blockMolecules;
+          return std::make_pair(m_blocks.positions[block], m_blocks.positions[block + 1]);
+        }
+        unsigned int stored = index / m_indexes.stride;
+        // the molecule indexes are stored after the last molecule
+        uint64_t end = stored + 1 < m_indexes.size() ? impl::load_index(m_positions, stored + 1) : m_indexes.position;
+        return std::make_pair(impl::load_index(m_positions, stored), end);
+      }
+
       boost::iostreams::mapped_file_source m_mappedFile;
-      std::vector<uint64_t> m_positions; //!< The positions of the molecules in the file.
+      const char *m_positions; //!< The molecule indexes table in the mapped file (positions in their block if compressed).
+      impl::MoleculeIndexes m_indexes; //!< The molecule indexes attributes.
       unsigned int m_numMolecules; //!< The number of molecules in the file.
+      impl::MoleculeBlocks m_blocks; //!< The blocks for compressed files.
+      impl::MoleculeBlockCache m_cache; //!< Cache of uncompressed blocks.
+#ifdef HAVE_CPP11
+      std::mutex m_cacheMutex; //!< Serializes the access to m_cache.
+#endif
   };
 
+  /**
+   * @brief Molecule file for fast sequential reading.
+   *
+   * The molecule records are read from the file in large blocks and decoded
+   * from the block in memory. This avoids the many small reads done by
+   * MoleculeFile::read_molecule(). Compressed files are read (and
+   * uncompressed) one compressed block at a time. When C++11 support is enabled, the next
+   * block is read on a background thread while the molecules in the current
+   * block are being processed.
+   *
+   * Reading into a MoleculeView is supported but the view is only valid
+   * until the next call to read_molecule().
+   */
+  class BufferedMoleculeFile
+  {
+    public:
+      /**
+       * Constructor.
+       *
+       * @param filename The molecule file.
+       * @param blockSize The (minimum) number of bytes to read at once.
+       */
+      BufferedMoleculeFile(const std::string &filename, std::size_t blockSize = 4 << 20)
+        : m_blockSize(blockSize), m_current(0), m_offset(0), m_blockEnd(0), m_nextEnd(0)
+      {
+        TIMER("BufferedMoleculeFile::load():");
+
+        m_file.open(filename);
+
+        // read the josn header
+        Json::Reader reader;
+        Json::Value data;
+        if (!reader.parse(m_file.header(), data))
+          throw std::runtime_error(reader.getFormattedErrorMessages());
+
+        // make sure the required attributes are present
+        if (!data.isMember("filetype") || data["filetype"].asString() != "molecules")
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'filetype' attribute or is not 'molecules'"));
+        if (!data.isMember("num_molecules"))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_molecules' attribute"));
+        if (!data.isMember("molecule_indexes"))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'molecule_indexes' attribute"));
+
+        // extract needed attributes
+        Json::UInt64 blocksPos = m_blocks.parse(data, filename);
+        m_indexes.parse(data, filename, m_blocks);
+        m_numMolecules = m_indexes.numMolecules;
+
+        if (m_blocks.compressed()) {
+          // read the block indexes, the molecules in a block are read in order
+          m_file.stream().seekg(blocksPos);
+          m_file.read(&m_blocks.positions[0], m_blocks.positions.size() * sizeof(uint64_t));
+        } else if (m_numMolecules) {
+          // read the (stored) molecule indexes
+          m_positions.resize(m_indexes.size());
+          m_file.stream().seekg(m_indexes.position);
+          m_file.read(&m_positions[0], m_positions.size() * sizeof(uint64_t));
+        }
+
+        if (!m_file)
+          throw std::runtime_error(make_string("Could not read molecule indexes from file ", filename));
+
+        // start reading the first block
+        prefetch();
+      }
+
+      ~BufferedMoleculeFile()
+      {
+#ifdef HAVE_CPP11
+        if (m_prefetch.valid())
+          m_prefetch.wait();
+#endif
+      }
+
+      unsigned int numMolecules() const
+      {
+        return m_numMolecules;
+      }
+
+      /**
+       * Get the index of the next molecule that will be read.
+       */
+      unsigned int current() const
+      {
+        return m_current;
+      }
+
+      /**
+       * Read the next molecule from the file.
+       *
+       * @return True if successfull, false if there are no more molecules.
+       */
+      template<typename MoleculeType>
+      bool read_molecule(MoleculeType &mol)
+      {
+        if (m_current >= m_numMolecules)
+          return false;
+        if (m_current == m_blockEnd)
+          nextBlock();
+        // the records in a block are stored contiguously
+        const char *data = &m_buffer[m_offset];
+        Helium::read_molecule(data, mol);
+        m_offset += MoleculeView::record_size(data);
+        ++m_current;
+        return true;
+      }
+
+    private:
+      /**
+       * Get the file position of the stored molecule position @p index
+       * (i.e. molecule index * stride) or the end of the last record.
+       */
+      uint64_t position(unsigned int index) const
+      {
+        // the molecule indexes are stored after the last molecule
+        return index < m_positions.size() ? m_positions[index] : m_indexes.position;
+      }
+
+      /**
+       * Read the block following the current block into m_nextBuffer.
+       */
+      void readBlock(unsigned int begin, unsigned int end)
+      {
+        if (m_blocks.compressed()) {
+          impl::StreamBlockReader reader(m_file, m_blocks);
+          std::pair<const char*, std::size_t> compressed = reader(begin / m_blocks.blockMolecules, m_compressed);
+          impl::decompress_block(compressed.first, compressed.second, m_nextBuffer);
+          return;
+        }
+
+        // blocks start at a stored position
+        unsigned int stride = m_indexes.stride;
+        uint64_t size = position((end + stride - 1) / stride) - position(begin / stride);
+        m_nextBuffer.resize(size);
+        m_file.stream().seekg(position(begin / stride));
+        if (!m_file.read(&m_nextBuffer[0], size))
+          throw std::runtime_error("Could not read molecules from file");
+      }
+
+      /**
+       * Start reading the block after the current block.
+       */
+      void prefetch()
+      {
+        unsigned int begin = m_blockEnd;
+        if (begin >= m_numMolecules)
+          return;
+
+        unsigned int end = begin + 1;
+        if (m_blocks.compressed()) {
+          // compressed files are read one block at a time
+          end = std::min(m_numMolecules, begin + m_blocks.blockMolecules);
+        } else {
+          // at least one stored position per block
+          unsigned int first = begin / m_indexes.stride;
+          unsigned int last = first + 1;
+          while (last < m_positions.size() && position(last + 1) - position(first) <= m_blockSize)
+            ++last;
+          end = std::min(m_numMolecules, last * m_indexes.stride);
+        }
+        m_nextEnd = end;
+
+#ifdef HAVE_CPP11
+        m_prefetch = std::async(std::launch::async, &BufferedMoleculeFile::readBlock, this, begin, end);
+#else
+        readBlock(begin, end);
+#endif
+      }
+
+      /**
+       * Make the prefetched block the current block and start reading the
+       * next one.
+       */
+      void nextBlock()
+      {
+#ifdef HAVE_CPP11
+        // rethrows exceptions from readBlock()
+        m_prefetch.get();
+#endif
+        m_buffer.swap(m_nextBuffer);
+        m_offset = 0;
+        m_blockEnd = m_nextEnd;
+        prefetch();
+      }
+
+      BinaryInputFile m_file;
+      std::vector<uint64_t> m_positions; //!< The stored positions of the molecules in the file (not used if compressed).
+      impl::MoleculeIndexes m_indexes; //!< The molecule indexes attributes.
+      unsigned int m_numMolecules; //!< The number of molecules in the file.
+      std::size_t m_blockSize; //!< The minimum number of bytes to read at once.
+      unsigned int m_current; //!< The index of the next molecule.
+      std::size_t m_offset; //!< The offset of the next record in m_buffer.
+      unsigned int m_blockEnd; //!< The index after the last molecule in m_buffer.
+      unsigned int m_nextEnd; //!< The index after the last molecule in m_nextBuffer.
+      std::vector<char> m_buffer; //!< The current block.
+      std::vector<char> m_nextBuffer; //!< The next block (being read).
+      std::vector<char> m_compressed; //!< Buffer for reading compressed blocks.
+      impl::MoleculeBlocks m_blocks; //!< The blocks for compressed files.
+#ifdef HAVE_CPP11
+      std::future<void> m_prefetch; //!< The background read of m_nextBuffer.
+#endif
+  };
+
+  /**
+   * @brief Traits for the molecule files.
+   *
+   * The molecule_type is the molecule type used by algorithms that only
+   * need read access to the molecules in the file (e.g.
+   * substructure_verify()). This is a MoleculeView for a
+   * MemoryMappedMoleculeFile since the records can be used directly and a
+   * HeMol for the other files.
+   */
+  template<typename MoleculeFileType>
+  struct molecule_file_traits
+  {
+    typedef HeMol molecule_type;
+  };
+
+  /**
+   * @brief Traits for MemoryMappedMoleculeFile.
+   */
+  template<>
+  struct molecule_file_traits<MemoryMappedMoleculeFile>
+  {
+    typedef MoleculeView molecule_type;
+  };
+
+  /**
+   * @brief Prefetch the records for molecules that will be read soon.
+   *
+   * This does nothing for molecule files that read the records on demand.
+   *
+   * @param moleculeFile The molecule file.
+   * @param indices The sorted molecule indices.
+   */
+  template<typename MoleculeFileType>
+  void prefetch_molecules(const MoleculeFileType &moleculeFile, const std::vector<unsigned int> &indices)
+  {
+  }
+
+  /**
+   * @overload
+   *
+   * See MemoryMappedMoleculeFile::prefetch().
+   */
+  inline void prefetch_molecules(const MemoryMappedMoleculeFile &moleculeFile, const std::vector<unsigned int> &indices)
+  {
+    moleculeFile.prefetch(indices);
+  }
+
   template<typename MoleculeType>
   void write_sdf(std::ostream &os, MoleculeType &mol)
   {
@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_MOLECULEVIEW_H
+#define HELIUM_MOLECULEVIEW_H
+
+#include <Helium/frozenmol.h>
+
+namespace Helium {
+
+  /**
+   * @class MoleculeView moleculeview.h <Helium/fileio/moleculeview.h>
+   * @brief Read-only molecule on top of an encoded molecule record.
+   *
+   * The atom and bond properties are read directly from the record bytes
+   * (e.g. the memory mapped data of a MemoryMappedMoleculeFile) without
+   * decoding the molecule into a HeMol. The record consists of the number of
+   * atoms and bonds (2 bytes each) followed by 6 bytes per atom (element,
+   * cyclic, aromatic, mass, hydrogens, charge) and 5 bytes per bond (source,
+   * target, cyclic/aromatic/order bit field).
+   *
+   * The incident bonds and neighbors are not stored in the record. These
+   * are computed the first time they are needed and stored in flat arrays
+   * (see FrozenMol) that are reused when the view is assigned a new record.
+   * The incident bonds have the same order as when the record is read into
+   * a HeMol.
+   *
+   * The record data must remain valid while the view is used (unless the
+   * view is given its own copy using copy()). Since the adjacency arrays
+   * are built lazily, a single MoleculeView should not be used concurrently
+   * from multiple threads.
+   */
+  class MoleculeView
+  {
+    public:
+      typedef impl::IndexAtom<MoleculeView> atom_type;
+      typedef impl::IndexBond<MoleculeView> bond_type;
+
+      // iterators
+      typedef impl::index_iterator<MoleculeView, atom_type> atom_iter;
+      typedef impl::index_iterator<MoleculeView, bond_type> bond_iter;
+      typedef impl::adjacency_iterator<MoleculeView, bond_type> incident_iter;
+      typedef impl::adjacency_iterator<MoleculeView, atom_type> nbr_iter;
+
+      /**
+       * Constructor for an empty molecule.
+       */
+      MoleculeView() : m_data(0), m_numAtoms(0), m_numBonds(0), m_adjacency(false)
+      {
+      }
+
+      /**
+       * Constructor.
+       *
+       * @param data Pointer to the start of the molecule record.
+       */
+      explicit MoleculeView(const char *data)
+      {
+        assign(data);
+      }
+
+      /**
+       * View a different molecule record.
+       *
+       * @param data Pointer to the start of the molecule record.
+       */
+      void assign(const char *data)
+      {
+        m_data = data;
+        m_numAtoms = *reinterpret_cast<const unsigned short*>(data);
+        m_numBonds = *reinterpret_cast<const unsigned short*>(data + sizeof(unsigned short));
+        m_adjacency = false;
+      }
+
+      /**
+       * View a copy of a molecule record. The copy is owned by the view so
+       * @p data does not have to remain valid.
+       *
+       * @param data Pointer to the start of the molecule record.
+       */
+      void copy(const char *data)
+      {
+        m_copy.assign(data, data + record_size(data));
+        assign(&m_copy[0]);
+      }
+
+      /**
+       * Get the size of a molecule record in bytes.
+       *
+       * @param data Pointer to the start of the molecule record.
+       */
+      static std::size_t record_size(const char *data)
+      {
+        unsigned short numAtoms = *reinterpret_cast<const unsigned short*>(data);
+        unsigned short numBonds = *reinterpret_cast<const unsigned short*>(data + sizeof(unsigned short));
+        return 2 * sizeof(unsigned short) + 6 * numAtoms + 5 * numBonds;
+      }
+
+      /**
+       * Get a pointer to the molecule record.
+       */
+      const char* data() const
+      {
+        return m_data;
+      }
+
+      Size numAtoms() const
+      {
+        return m_numAtoms;
+      }
+
+      Size numBonds() const
+      {
+        return m_numBonds;
+      }
+
+      std::pair<atom_iter, atom_iter> atoms() const
+      {
+        return std::make_pair(atom_iter(this, 0), atom_iter(this, m_numAtoms));
+      }
+
+      std::pair<bond_iter, bond_iter> bonds() const
+      {
+        return std::make_pair(bond_iter(this, 0), bond_iter(this, m_numBonds));
+      }
+
+      atom_type atom(Index index) const
+      {
+        return atom_type(this, index);
+      }
+
+      bond_type bond(Index index) const
+      {
+        return bond_type(this, index);
+      }
+
+      std::pair<incident_iter, incident_iter> incident(Index atom) const
+      {
+        if (!m_adjacency)
+          buildAdjacency();
+        const Index *begin = m_incident.empty() ? 0 : &m_incident[0];
+        return std::make_pair(incident_iter(this, begin + m_offsets[atom]),
+                              incident_iter(this, begin + m_offsets[atom + 1]));
+      }
+
+      std::pair<nbr_iter, nbr_iter> nbrs(Index atom) const
+      {
+        if (!m_adjacency)
+          buildAdjacency();
+        const Index *begin = m_nbrs.empty() ? 0 : &m_nbrs[0];
+        return std::make_pair(nbr_iter(this, begin + m_offsets[atom]),
+                              nbr_iter(this, begin + m_offsets[atom + 1]));
+      }
+
+      int degree(Index atom) const
+      {
+        if (!m_adjacency)
+          buildAdjacency();
+        return m_offsets[atom + 1] - m_offsets[atom];
+      }
+
+      int element(Index atom) const
+      {
+        return *reinterpret_cast<const unsigned char*>(atomData(atom));
+      }
+
+      bool isCyclic(const atom_type &atom) const
+      {
+        return *reinterpret_cast<const unsigned char*>(atomData(atom.index()) + 1);
+      }
+
+      bool isAromatic(const atom_type &atom) const
+      {
+        return *reinterpret_cast<const unsigned char*>(atomData(atom.index()) + 2);
+      }
+
+      int mass(Index atom) const
+      {
+        return *reinterpret_cast<const unsigned char*>(atomData(atom) + 3);
+      }
+
+      int hydrogens(Index atom) const
+      {
+        return *reinterpret_cast<const unsigned char*>(atomData(atom) + 4);
+      }
+
+      int charge(Index atom) const
+      {
+        return *reinterpret_cast<const signed char*>(atomData(atom) + 5);
+      }
+
+      Index source(Index bond) const
+      {
+        return *reinterpret_cast<const unsigned short*>(bondData(bond));
+      }
+
+      Index target(Index bond) const
+      {
+        return *reinterpret_cast<const unsigned short*>(bondData(bond) + sizeof(unsigned short));
+      }
+
+      bool isAromatic(const bond_type &bond) const
+      {
+        return bondProperties(bond.index()) & 128;
+      }
+
+      bool isCyclic(const bond_type &bond) const
+      {
+        return bondProperties(bond.index()) & 64;
+      }
+
+      int order(Index bond) const
+      {
+        return bondProperties(bond) & 63;
+      }
+
+      static Index null_index()
+      {
+        return -1;
+      }
+
+      static atom_type null_atom()
+      {
+        return atom_type(0, -1);
+      }
+
+      static bond_type null_bond()
+      {
+        return bond_type(0, -1);
+      }
+
+    private:
+      const char* atomData(Index atom) const
+      {
+        return m_data + 2 * sizeof(unsigned short) + 6 * atom;
+      }
+
+      const char* bondData(Index bond) const
+      {
+        return m_data + 2 * sizeof(unsigned short) + 6 * m_numAtoms + 5 * bond;
+      }
+
+      unsigned char bondProperties(Index bond) const
+      {
+        return *reinterpret_cast<const unsigned char*>(bondData(bond) + 2 * sizeof(unsigned short));
+      }
+
+      void buildAdjacency() const
+      {
+        // count the degrees
+        m_offsets.assign(m_numAtoms + 1, 0);
+        for (Index i = 0; i < m_numBonds; ++i) {
+          ++m_offsets[source(i) + 1];
+          ++m_offsets[target(i) + 1];
+        }
+        for (Index i = 0; i < m_numAtoms; ++i)
+          m_offsets[i + 1] += m_offsets[i];
+
+        // fill in the bonds in the order they are added to a HeMol
+        m_cursor.assign(m_offsets.begin(), m_offsets.end() - 1);
+        m_incident.resize(2 * m_numBonds);
+        m_nbrs.resize(2 * m_numBonds);
+        for (Index i = 0; i < m_numBonds; ++i) {
+          Index s = source(i), t = target(i);
+          m_incident[m_cursor[s]] = i;
+          m_nbrs[m_cursor[s]++] = t;
+          m_incident[m_cursor[t]] = i;
+          m_nbrs[m_cursor[t]++] = s;
+        }
+
+        m_adjacency = true;
+      }
+
+      const char *m_data; //!< The molecule record
+      std::vector<char> m_copy; //!< Copy of the molecule record (see copy())
+      Size m_numAtoms;
+      Size m_numBonds;
+
+      // lazily built adjacency
+      mutable std::vector<Index> m_offsets; //!< numAtoms + 1 offsets in m_incident and m_nbrs
+      mutable std::vector<Index> m_incident; //!< Incident bond indices
+      mutable std::vector<Index> m_nbrs; //!< Neighbor atom indices (parallel to m_incident)
+      mutable std::vector<Index> m_cursor; //!< Insert positions used by buildAdjacency()
+      mutable bool m_adjacency; //!< True if the adjacency arrays are valid
+  };
+
+  typedef impl::IndexAtom<MoleculeView> MoleculeViewAtom;
+  typedef impl::IndexBond<MoleculeView> MoleculeViewBond;
+
+  //@cond dev
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // Molecule
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline Size num_atoms(const MoleculeView &mol)
+  {
+    return mol.numAtoms();
+  }
+
+  inline std::pair<MoleculeView::atom_iter, MoleculeView::atom_iter> get_atoms(const MoleculeView &mol)
+  {
+    return mol.atoms();
+  }
+
+  inline MoleculeViewAtom get_atom(const MoleculeView &mol, Index index)
+  {
+    return mol.atom(index);
+  }
+
+  inline Size num_bonds(const MoleculeView &mol)
+  {
+    return mol.numBonds();
+  }
+
+  inline std::pair<MoleculeView::bond_iter, MoleculeView::bond_iter> get_bonds(const MoleculeView &mol)
+  {
+    return mol.bonds();
+  }
+
+  inline MoleculeViewBond get_bond(const MoleculeView &mol, Index index)
+  {
+    return mol.bond(index);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // MoleculeViewAtom
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline Index get_index(const MoleculeView &mol, const MoleculeViewAtom &atom)
+  {
+    return atom.index();
+  }
+
+  inline std::pair<MoleculeView::incident_iter, MoleculeView::incident_iter>
+  get_bonds(const MoleculeView &mol, const MoleculeViewAtom &atom)
+  {
+    return mol.incident(atom.index());
+  }
+
+  inline std::pair<MoleculeView::nbr_iter, MoleculeView::nbr_iter>
+  get_nbrs(const MoleculeView &mol, const MoleculeViewAtom &atom)
+  {
+    return mol.nbrs(atom.index());
+  }
+
+  inline bool is_aromatic(const MoleculeView &mol, const MoleculeViewAtom &atom)
+  {
+    return mol.isAromatic(atom);
+  }
+
+  inline bool is_cyclic(const MoleculeView &mol, const MoleculeViewAtom &atom)
+  {
+    return mol.isCyclic(atom);
+  }
+
+  inline int get_element(const MoleculeView &mol, const MoleculeViewAtom &atom)
+  {
+    return mol.element(atom.index());
+  }
+
+  inline int get_mass(const MoleculeView &mol, const MoleculeViewAtom &atom)
+  {
+    return mol.mass(atom.index());
+  }
+
+  inline int get_degree(const MoleculeView &mol, const MoleculeViewAtom &atom)
+  {
+    return mol.degree(atom.index());
+  }
+
+  inline int num_hydrogens(const MoleculeView &mol, const MoleculeViewAtom &atom)
+  {
+    return mol.hydrogens(atom.index());
+  }
+
+  inline int get_charge(const MoleculeView &mol, const MoleculeViewAtom &atom)
+  {
+    return mol.charge(atom.index());
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // MoleculeViewBond
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline Index get_index(const MoleculeView &mol, const MoleculeViewBond &bond)
+  {
+    return bond.index();
+  }
+
+  inline MoleculeViewAtom get_source(const MoleculeView &mol, const MoleculeViewBond &bond)
+  {
+    return mol.atom(mol.source(bond.index()));
+  }
+
+  inline MoleculeViewAtom get_target(const MoleculeView &mol, const MoleculeViewBond &bond)
+  {
+    return mol.atom(mol.target(bond.index()));
+  }
+
+  inline MoleculeViewAtom get_other(const MoleculeView &mol, const MoleculeViewBond &bond, const MoleculeViewAtom &atom)
+  {
+    Index source = mol.source(bond.index());
+    return mol.atom(source == atom.index() ? mol.target(bond.index()) : source);
+  }
+
+  inline bool is_aromatic(const MoleculeView &mol, const MoleculeViewBond &bond)
+  {
+    return mol.isAromatic(bond);
+  }
+
+  inline bool is_cyclic(const MoleculeView &mol, const MoleculeViewBond &bond)
+  {
+    return mol.isCyclic(bond);
+  }
+
+  inline bool get_order(const MoleculeView &mol, const MoleculeViewBond &bond)
+  {
+    return mol.order(bond.index());
+  }
+
+  inline MoleculeViewBond get_bond(const MoleculeView &mol, const MoleculeViewAtom &source, const MoleculeViewAtom &target)
+  {
+    MoleculeView::incident_iter bond, end_bonds;
+    MoleculeView::nbr_iter nbr, end_nbrs;
+    TIE(bond, end_bonds) = mol.incident(source.index());
+    TIE(nbr, end_nbrs) = mol.nbrs(source.index());
+    for (; bond != end_bonds; ++bond, ++nbr)
+      if (*nbr == target)
+        return *bond;
+    return mol.null_bond();
+  }
+
+  //@endcond
+
+}
+
+#endif
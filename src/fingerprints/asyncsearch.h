@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_ASYNCSEARCH_H
+#define HELIUM_ASYNCSEARCH_H
+
+#include <Helium/fingerprints/similarity.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace Helium {
+
+  /**
+   * @brief Asynchronous similarity search that coalesces concurrent requests.
+   *
+   * When many threads each call brute_force_similarity_search() for a single
+   * query, the fingerprints are streamed from main memory once per query.
+   * This class collects the queries submitted by any number of threads and
+   * searches them in batches using the cache-blocked multi-query engine
+   * (brute_force_similarity_search_batch()) so the fingerprints are only
+   * streamed once per batch. Throughput therefore increases with load
+   * instead of decreasing due to contention for memory bandwidth.
+   *
+   * A dispatcher thread waits for the first request and then for at most
+   * the coalescing window for more requests until the batch is full. The
+   * queue of pending requests is bounded: submit() blocks while the queue
+   * is full (backpressure) and trySubmit() fails instead. A full queue is
+   * dispatched immediately.
+   *
+   * The results are the same as for brute_force_similarity_search() (N = 0)
+   * or brute_force_knn_search() (N > 0). Requests with a different Tmin can
+   * be part of the same batch, the threshold requests are grouped by Tmin
+   * and each group is searched in a single pass. The k-nearest neighbor
+   * requests are searched using brute_force_knn_search() so only the N best
+   * hits are kept for each query.
+   *
+   * @note This class is only available when C++11 support is enabled.
+   */
+  template<typename RowMajorFingerprintStorageType>
+  class AsyncSimilaritySearch
+  {
+    public:
+      /**
+       * The hits for a request as (index, Tanimoto score) pairs.
+       */
+      typedef std::vector<std::pair<unsigned int, double> > Result;
+      /**
+       * Function called by the dispatcher thread with the result of a
+       * request. If the search failed, the hits are empty and the
+       * exception is passed as the second argument (0 otherwise). It
+       * should return quickly since the other results of the batch are
+       * delivered after it returns and it must not throw.
+       */
+      typedef std::function<void(const Result&, std::exception_ptr)> Callback;
+
+      /**
+       * @brief Constructor.
+       *
+       * @param storage The fingerprints to search, the storage must outlive
+       *        this object.
+       * @param maxBatchSize The maximum number of queries in a batch.
+       * @param window The maximum time to wait for more requests after the
+       *        first request of a batch arrived.
+       * @param maxQueued The maximum number of pending requests.
+       * @param pool If not 0, the batches are searched by the threads of
+       *        the pool (see brute_force_similarity_search_batch_threaded()).
+       */
+      AsyncSimilaritySearch(RowMajorFingerprintStorageType &storage, std::size_t maxBatchSize = 64,
+          std::chrono::microseconds window = std::chrono::microseconds(200), std::size_t maxQueued = 1024,
+          ThreadPool *pool = 0) : m_storage(storage), m_numWords(bitvec_num_words_for_bits(storage.numBits())),
+          m_maxBatchSize(maxBatchSize), m_window(window), m_maxQueued(maxQueued), m_pool(pool), m_stop(false),
+          m_numRequests(0), m_numBatches(0)
+      {
+        PRE(maxBatchSize > 0);
+        PRE(maxQueued > 0);
+        m_dispatcher = std::thread(&AsyncSimilaritySearch::dispatch, this);
+      }
+
+      /**
+       * @brief Destructor.
+       *
+       * The pending requests are completed before the dispatcher thread is
+       * stopped.
+       */
+      ~AsyncSimilaritySearch()
+      {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_stop = true;
+        }
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+        m_dispatcher.join();
+      }
+
+      /**
+       * @brief Submit a similarity search request.
+       *
+       * The query is copied. This function blocks while the queue is full.
+       *
+       * @param query The query fingerprint.
+       * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+       * @param N If not 0, only the N best hits are returned.
+       *
+       * @return The future result. Hits are sorted by ascending index
+       *         (N = 0) or by descending score (N > 0).
+       */
+      std::future<Result> submit(const Word *query, double Tmin, unsigned int N = 0)
+      {
+        Request request(query, m_numWords, Tmin, N);
+        std::future<Result> future = request.promise.get_future();
+        enqueue(request, true);
+        return future;
+      }
+
+      /**
+       * @brief Submit a similarity search request with a callback.
+       *
+       * Same as submit() but @p callback is called on the dispatcher thread
+       * with the result instead of using a future.
+       */
+      void submit(const Word *query, double Tmin, unsigned int N, const Callback &callback)
+      {
+        Request request(query, m_numWords, Tmin, N);
+        request.callback = callback;
+        enqueue(request, true);
+      }
+
+      /**
+       * @brief Submit a similarity search request without blocking.
+       *
+       * @return False if the queue is full, @p future is not changed in that
+       *         case.
+       */
+      bool trySubmit(const Word *query, double Tmin, std::future<Result> &future, unsigned int N = 0)
+      {
+        Request request(query, m_numWords, Tmin, N);
+        std::future<Result> result = request.promise.get_future();
+        if (!enqueue(request, false))
+          return false;
+        future = std::move(result);
+        return true;
+      }
+
+      /**
+       * Get the number of requests that have been searched.
+       */
+      std::size_t numRequests() const
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_numRequests;
+      }
+
+      /**
+       * Get the number of batches that have been searched.
+       */
+      std::size_t numBatches() const
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_numBatches;
+      }
+
+      /**
+       * Get the number of requests waiting to be searched.
+       */
+      std::size_t pending() const
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_queue.size();
+      }
+
+    private:
+      struct Request
+      {
+        Request(const Word *query_, int numWords, double Tmin_, unsigned int N_)
+          : query(query_, query_ + numWords), Tmin(Tmin_), N(N_), arrival(std::chrono::steady_clock::now())
+        {
+        }
+
+        std::vector<Word> query; //!< Copy of the query fingerprint
+        double Tmin;
+        unsigned int N;
+        std::promise<Result> promise; //!< Not used if there is a callback
+        Callback callback;
+        std::chrono::steady_clock::time_point arrival; //!< Time the request was submitted
+      };
+
+      /**
+       * Add a request to the queue, wait for space if @p block is true.
+       */
+      bool enqueue(Request &request, bool block)
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (block)
+          m_notFull.wait(lock, [this] { return m_stop || m_queue.size() < m_maxQueued; });
+        else if (m_queue.size() >= m_maxQueued)
+          return false;
+        if (m_stop)
+          throw std::runtime_error("AsyncSimilaritySearch is stopped");
+        m_queue.push_back(std::move(request));
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+      }
+
+      /**
+       * The dispatcher thread: collect a batch, search it and deliver the
+       * results.
+       */
+      void dispatch()
+      {
+        std::vector<Request> batch;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+          m_notEmpty.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+          if (m_queue.empty())
+            return; // stopped
+
+          // wait for more requests until the batch or queue is full
+          std::chrono::steady_clock::time_point deadline = m_queue.front().arrival + m_window;
+          while (!m_stop && m_queue.size() < std::min(m_maxBatchSize, m_maxQueued))
+            if (m_notEmpty.wait_until(lock, deadline) == std::cv_status::timeout)
+              break;
+
+          batch.clear();
+          while (!m_queue.empty() && batch.size() < m_maxBatchSize) {
+            batch.push_back(std::move(m_queue.front()));
+            m_queue.pop_front();
+          }
+          lock.unlock();
+          m_notFull.notify_all();
+
+          search(batch);
+
+          lock.lock();
+        }
+      }
+
+      void search(std::vector<Request> &batch)
+      {
+        TIMER("AsyncSimilaritySearch::search():");
+
+        std::vector<Result> results(batch.size());
+        std::vector<std::exception_ptr> errors(batch.size());
+
+        // group the threshold requests by Tmin, each group is searched in a
+        // single pass over the fingerprints
+        std::map<double, std::vector<std::size_t> > groups;
+        std::vector<std::size_t> knn;
+        for (std::size_t i = 0; i < batch.size(); ++i)
+          if (batch[i].N)
+            knn.push_back(i);
+          else
+            groups[batch[i].Tmin].push_back(i);
+
+        for (std::map<double, std::vector<std::size_t> >::const_iterator group = groups.begin();
+            group != groups.end(); ++group) {
+          const std::vector<std::size_t> &requests = group->second;
+          std::vector<Word*> queries(requests.size());
+          for (std::size_t i = 0; i < requests.size(); ++i)
+            queries[i] = &batch[requests[i]].query[0];
+          try {
+            std::vector<Result> hits = m_pool ?
+              brute_force_similarity_search_batch_threaded(queries, m_storage, group->first, *m_pool) :
+              brute_force_similarity_search_batch(queries, m_storage, group->first);
+            for (std::size_t i = 0; i < requests.size(); ++i)
+              results[requests[i]].swap(hits[i]);
+          } catch (...) {
+            for (std::size_t i = 0; i < requests.size(); ++i)
+              errors[requests[i]] = std::current_exception();
+          }
+        }
+
+        // the kNN requests only keep the N best hits (a batch would collect
+        // all hits above Tmin which may be every fingerprint for Tmin = 0)
+        if (!knn.empty()) {
+          std::function<void(std::size_t, std::size_t)> searchKnn = [&] (std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+              Request &request = batch[knn[i]];
+              try {
+                results[knn[i]] = brute_force_knn_search(&request.query[0], m_storage, request.N, request.Tmin);
+              } catch (...) {
+                errors[knn[i]] = std::current_exception();
+              }
+            }
+          };
+          if (m_pool)
+            m_pool->parallelFor(knn.size(), 1, searchKnn);
+          else
+            searchKnn(0, knn.size());
+        }
+
+        // the statistics are updated before the results are delivered
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_numRequests += batch.size();
+          ++m_numBatches;
+        }
+
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+          if (batch[i].callback)
+            batch[i].callback(results[i], errors[i]);
+          else if (errors[i])
+            batch[i].promise.set_exception(errors[i]);
+          else
+            batch[i].promise.set_value(std::move(results[i]));
+        }
+      }
+
+      RowMajorFingerprintStorageType &m_storage;
+      int m_numWords; //!< Number of words per fingerprint
+      std::size_t m_maxBatchSize;
+      std::chrono::microseconds m_window; //!< The coalescing window
+      std::size_t m_maxQueued; //!< The maximum number of pending requests
+      ThreadPool *m_pool; //!< The pool for searching a batch (may be 0)
+      bool m_stop;
+      std::size_t m_numRequests;
+      std::size_t m_numBatches;
+      std::deque<Request> m_queue; //!< The pending requests
+      mutable std::mutex m_mutex;
+      std::condition_variable m_notEmpty; //!< Signaled when a request is added (or stopping)
+      std::condition_variable m_notFull; //!< Signaled when requests are removed (or stopping)
+      std::thread m_dispatcher;
+  };
+
+}
+
+#endif
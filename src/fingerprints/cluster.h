@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_CLUSTER_H
+#define HELIUM_CLUSTER_H
+
+#include <Helium/fingerprints/similarity.h>
+
+#include <vector>
+#include <algorithm>
+
+namespace Helium {
+
+  /**
+   * @brief Sparse similarity neighbor lists.
+   *
+   * The neighbors of all fingerprints in a fingerprint storage with a
+   * Tanimoto score of at least a threshold. The neighbor lists are found
+   * using a frozen SimilaritySearchIndex and are stored in compressed sparse
+   * row (CSR) form: the neighbors of fingerprint i are the sorted indices
+   * [neighbors(i), neighbors(i) + numNeighbors(i)). A fingerprint is not a
+   * neighbor of itself and the lists are symmetric. The scores are not
+   * stored.
+   *
+   * @code
+   * InMemoryRowMajorFingerprintStorage storage;
+   * storage.load("fingerprints.fps.hel");
+   *
+   * SimilarityNeighbors neighbors(storage, 0.7);
+   * std::vector<std::vector<unsigned int> > clusters = butina_clustering(neighbors);
+   * @endcode
+   */
+  class SimilarityNeighbors
+  {
+    public:
+      /**
+       * @brief Constructor.
+       *
+       * @param storage The fingerprint storage.
+       * @param Tmin The minimum Tanimoto score for neighbors.
+       * @param k The number of parts for the kD-grid of the index (see
+       *        SimilaritySearchIndex).
+       * @param numThreads The number of tasks to divide the work in, 0 to use
+       *        the number of threads in the global ThreadPool. Without C++11
+       *        support a single thread is used.
+       */
+      template<typename RowMajorFingerprintStorageType>
+      SimilarityNeighbors(const RowMajorFingerprintStorageType &storage, double Tmin, int k = 3,
+          unsigned int numThreads = 1)
+      {
+        TIMER("SimilarityNeighbors():");
+
+        typedef SimilaritySearchIndex<RowMajorFingerprintStorageType> IndexType;
+        IndexType index(storage, k, numThreads);
+
+        unsigned int n = storage.numFingerprints();
+        unsigned int numChunks = (n + chunkSize - 1) / chunkSize;
+
+        // each chunk of queries has its own neighbor lists which are
+        // concatenated at the end
+        std::vector<Chunk> chunks(numChunks);
+#ifdef HAVE_CPP11
+        if (numThreads != 1) {
+          ThreadPool::global().parallelFor(numChunks, 1, [&] (std::size_t begin, std::size_t end) {
+            for (std::size_t c = begin; c < end; ++c)
+              searchChunk(index, storage, Tmin, c, chunks[c]);
+          });
+        }
+#else
+        numThreads = 1;
+#endif
+        if (numThreads == 1)
+          for (unsigned int c = 0; c < numChunks; ++c)
+            searchChunk(index, storage, Tmin, c, chunks[c]);
+
+        m_offsets.resize(n + 1);
+        std::size_t numEdges = 0;
+        for (unsigned int c = 0; c < numChunks; ++c)
+          numEdges += chunks[c].neighbors.size();
+        m_neighbors.reserve(numEdges);
+        for (unsigned int c = 0; c < numChunks; ++c) {
+          for (std::size_t i = 0; i < chunks[c].counts.size(); ++i)
+            m_offsets[c * chunkSize + i + 1] = m_offsets[c * chunkSize + i] + chunks[c].counts[i];
+          m_neighbors.insert(m_neighbors.end(), chunks[c].neighbors.begin(), chunks[c].neighbors.end());
+          std::vector<unsigned int>().swap(chunks[c].neighbors);
+        }
+      }
+
+      /**
+       * @brief Get the number of fingerprints.
+       */
+      unsigned int numFingerprints() const
+      {
+        return m_offsets.size() - 1;
+      }
+
+      /**
+       * @brief Get the number of neighbors of a fingerprint.
+       */
+      unsigned int numNeighbors(unsigned int index) const
+      {
+        return m_offsets[index + 1] - m_offsets[index];
+      }
+
+      /**
+       * @brief Get the (sorted) neighbors of a fingerprint.
+       */
+      const unsigned int* neighbors(unsigned int index) const
+      {
+        return m_neighbors.empty() ? 0 : &m_neighbors[0] + m_offsets[index];
+      }
+
+      /**
+       * @brief Get the total number of neighbors (i.e. twice the number of
+       * neighbor pairs).
+       */
+      std::size_t numEdges() const
+      {
+        return m_neighbors.size();
+      }
+
+    private:
+      enum { chunkSize = 1024 };
+
+      /**
+       * The neighbor lists for a chunk of queries.
+       */
+      struct Chunk
+      {
+        std::vector<unsigned int> counts;
+        std::vector<unsigned int> neighbors;
+      };
+
+      /**
+       * Hit sink that appends the neighbors of a query to a chunk.
+       */
+      struct AppendNeighbors
+      {
+        AppendNeighbors(unsigned int query_, std::vector<unsigned int> &neighbors_)
+          : query(query_), neighbors(neighbors_)
+        {
+        }
+
+        bool operator()(unsigned int index, double)
+        {
+          if (index != query)
+            neighbors.push_back(index);
+          return true;
+        }
+
+        unsigned int query;
+        std::vector<unsigned int> &neighbors;
+      };
+
+      template<typename IndexType, typename RowMajorFingerprintStorageType>
+      static void searchChunk(const IndexType &index, const RowMajorFingerprintStorageType &storage,
+          double Tmin, unsigned int c, Chunk &chunk)
+      {
+        unsigned int begin = c * chunkSize;
+        unsigned int end = std::min<unsigned int>(storage.numFingerprints(), begin + chunkSize);
+        chunk.counts.resize(end - begin);
+        for (unsigned int i = begin; i < end; ++i) {
+          std::size_t first = chunk.neighbors.size();
+          AppendNeighbors sink(i, chunk.neighbors);
+          index.search(storage.fingerprint(i), Tmin, sink);
+          std::sort(chunk.neighbors.begin() + first, chunk.neighbors.end());
+          chunk.counts[i - begin] = chunk.neighbors.size() - first;
+        }
+      }
+
+      std::vector<std::size_t> m_offsets; //!< The CSR offsets (numFingerprints() + 1)
+      std::vector<unsigned int> m_neighbors; //!< The neighbor indices
+  };
+
+  /**
+   * @brief Taylor-Butina clustering.
+   *
+   * The fingerprints are visited in order of decreasing number of neighbors
+   * (equal counts by ascending index). A fingerprint that is not assigned yet
+   * becomes the centroid of a new cluster and all its neighbors that are not
+   * assigned yet become members of that cluster. Fingerprints without
+   * neighbors are singleton clusters. The visiting order is computed using a
+   * counting sort so the clustering is linear in the number of neighbors.
+   *
+   * @param neighbors The neighbor lists.
+   *
+   * @return The clusters, the first element of each cluster is the centroid
+   *         and the other members are sorted by index. The clusters are in
+   *         the order in which they were selected.
+   */
+  inline std::vector<std::vector<unsigned int> > butina_clustering(const SimilarityNeighbors &neighbors)
+  {
+    TIMER("butina_clustering():");
+
+    unsigned int n = neighbors.numFingerprints();
+
+    // counting sort by decreasing number of neighbors
+    unsigned int maxCount = 0;
+    for (unsigned int i = 0; i < n; ++i)
+      maxCount = std::max(maxCount, neighbors.numNeighbors(i));
+    std::vector<unsigned int> offsets(maxCount + 2);
+    for (unsigned int i = 0; i < n; ++i)
+      ++offsets[maxCount - neighbors.numNeighbors(i) + 1];
+    for (unsigned int c = 1; c < offsets.size(); ++c)
+      offsets[c] += offsets[c - 1];
+    std::vector<unsigned int> order(n);
+    for (unsigned int i = 0; i < n; ++i)
+      order[offsets[maxCount - neighbors.numNeighbors(i)]++] = i;
+
+    std::vector<std::vector<unsigned int> > clusters;
+    std::vector<bool> assigned(n);
+    for (unsigned int i = 0; i < n; ++i) {
+      unsigned int centroid = order[i];
+      if (assigned[centroid])
+        continue;
+      assigned[centroid] = true;
+
+      clusters.resize(clusters.size() + 1);
+      std::vector<unsigned int> &cluster = clusters.back();
+      cluster.push_back(centroid);
+      const unsigned int *begin = neighbors.neighbors(centroid);
+      const unsigned int *end = begin + neighbors.numNeighbors(centroid);
+      for (const unsigned int *j = begin; j != end; ++j)
+        if (!assigned[*j]) {
+          assigned[*j] = true;
+          cluster.push_back(*j);
+        }
+    }
+
+    return clusters;
+  }
+
+  /**
+   * @brief Taylor-Butina clustering.
+   *
+   * Find the neighbor lists (see SimilarityNeighbors) and cluster the
+   * fingerprints (see butina_clustering(const SimilarityNeighbors&)).
+   *
+   * @param storage The fingerprint storage.
+   * @param Tmin The minimum Tanimoto score for neighbors.
+   * @param k The number of parts for the kD-grid of the index.
+   * @param numThreads The number of tasks for finding the neighbors, 0 to
+   *        use the number of threads in the global ThreadPool.
+   *
+   * @return The clusters, the first element of each cluster is the centroid.
+   */
+  template<typename RowMajorFingerprintStorageType>
+  std::vector<std::vector<unsigned int> > butina_clustering(const RowMajorFingerprintStorageType &storage,
+      double Tmin, int k = 3, unsigned int numThreads = 1)
+  {
+    return butina_clustering(SimilarityNeighbors(storage, Tmin, k, numThreads));
+  }
+
+}
+
+#endif
@@ -28,9 +28,11 @@
 #define HELIUM_FINGERPRINTS_H
 
 #include <Helium/bitvec.h>
+#include <Helium/lrucache.h>
 #include <Helium/algorithms/enumeratepaths.h>
 #include <Helium/algorithms/enumeratesubgraphs.h>
 #include <Helium/substructure.h>
+#include <Helium/frozenmol.h>
 #include <Helium/algorithms/extendedconnectivities.h>
 #include <Helium/algorithms/canonical.h>
 
@@ -40,6 +42,241 @@
 
 namespace Helium {
 
+  /**
+   * @class FragmentCache fingerprints.h <Helium/fingerprints/fingerprints.h>
+   * @brief Cache for the hashed canonical codes of fingerprint fragments.
+   *
+   * Computing the canonical code of the enumerated paths, trees and
+   * subgraphs dominates the time needed to compute a fingerprint. Many
+   * (especially small) fragments occur many times within and across
+   * molecules. When a cache is passed to the fingerprint functions, the
+   * hashed canonical codes are looked up using a key that describes the
+   * labeled fragment exactly:
+   *
+   * - paths: the elements along the path (the lowest of both directions)
+   * - trees & subgraphs: the elements, incident bonds and bond atoms of the
+   *   fragment using the fragment's own atom and bond indices (i.e. the
+   *   input for the canonicalization)
+   *
+   * Since the keys are exact, the fingerprints are identical to the
+   * fingerprints computed without a cache. The cache is not thread safe, a
+   * cache should be used by a single thread.
+   */
+  class FragmentCache
+  {
+    public:
+      /**
+       * Constructor.
+       *
+       * @param capacity The maximum number of fragments in the cache.
+       */
+      FragmentCache(std::size_t capacity = 100000) : m_cache(capacity)
+      {
+      }
+
+      /**
+       * Get the maximum number of fragments in the cache.
+       */
+      std::size_t capacity() const
+      {
+        return m_cache.capacity();
+      }
+
+      /**
+       * Get the number of lookups that found a fragment.
+       */
+      std::size_t hits() const
+      {
+        return m_cache.hits();
+      }
+
+      /**
+       * Get the number of lookups that did not find a fragment.
+       */
+      std::size_t misses() const
+      {
+        return m_cache.misses();
+      }
+
+      /**
+       * Remove all fragments.
+       */
+      void clear()
+      {
+        m_cache.clear();
+      }
+
+      /**
+       * Find the hashed canonical code for a fragment key.
+       */
+      bool find(const std::vector<unsigned long> &key, std::size_t &hash)
+      {
+        return m_cache.find(key, hash);
+      }
+
+      /**
+       * Insert the hashed canonical code for a fragment key.
+       */
+      void insert(const std::vector<unsigned long> &key, std::size_t hash)
+      {
+        m_cache.insert(key, hash, 1);
+      }
+
+    private:
+      LRUCache<std::vector<unsigned long>, std::size_t> m_cache;
+  };
+
+  namespace impl {
+
+    /**
+     * @brief Compute the hashed canonical codes of fragments.
+     *
+     * The buffers are reused for all fragments of a molecule. The
+     * temporary buffers for canonicalizing the fragments are allocated from
+     * an arena.
+     */
+    template<typename MoleculeType>
+    class FragmentHasher
+    {
+        typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
+        typedef typename molecule_traits<MoleculeType>::bond_iter bond_iter;
+        typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
+
+      public:
+        FragmentHasher(MoleculeType &mol, FragmentCache *cache, Arena *arena = 0) : m_mol(mol), m_cache(cache),
+            m_arena(arena ? arena : &m_ownArena)
+        {
+        }
+
+        /**
+         * Get the hashed canonical code for a path.
+         *
+         * @param path The atom indices along the path.
+         * @param atoms The atoms in the path.
+         * @param bonds The bonds in the path.
+         */
+        std::size_t path(const std::vector<unsigned int> &path, const std::vector<bool> &atoms,
+            const std::vector<bool> &bonds)
+        {
+          if (!m_cache)
+            return canonicalHash(atoms, bonds);
+
+          // the elements along the path in the lowest direction
+          m_key.assign(1, 0);
+          bool reverse = false;
+          for (std::size_t i = 0; i < path.size(); ++i) {
+            int forwardElement = get_element(m_mol, get_atom(m_mol, path[i]));
+            int reverseElement = get_element(m_mol, get_atom(m_mol, path[path.size() - i - 1]));
+            if (forwardElement != reverseElement) {
+              reverse = reverseElement < forwardElement;
+              break;
+            }
+          }
+          for (std::size_t i = 0; i < path.size(); ++i)
+            m_key.push_back(get_element(m_mol, get_atom(m_mol, path[reverse ? path.size() - i - 1 : i])));
+
+          return cachedHash(atoms, bonds);
+        }
+
+        /**
+         * Get the hashed canonical code for a tree or subgraph.
+         *
+         * @param atoms The atoms in the subgraph.
+         * @param bonds The bonds in the subgraph.
+         */
+        std::size_t subgraph(const std::vector<bool> &atoms, const std::vector<bool> &bonds)
+        {
+          if (!m_cache)
+            return canonicalHash(atoms, bonds);
+
+          // the fragment indices of the atoms and bonds
+          m_atomIndices.resize(num_atoms(m_mol));
+          m_bondIndices.resize(num_bonds(m_mol));
+          unsigned long numAtoms = 0, numBonds = 0;
+          for (std::size_t i = 0; i < atoms.size(); ++i)
+            m_atomIndices[i] = atoms[i] ? numAtoms++ : 0;
+          for (std::size_t i = 0; i < bonds.size(); ++i)
+            m_bondIndices[i] = bonds[i] ? numBonds++ : 0;
+
+          m_key.assign(1, 1);
+          m_key.push_back(numAtoms);
+          m_key.push_back(numBonds);
+          // element & incident bonds (in order) for each atom
+          atom_iter atom, end_atoms;
+          TIE(atom, end_atoms) = get_atoms(m_mol);
+          for (; atom != end_atoms; ++atom) {
+            if (!atoms[get_index(m_mol, *atom)])
+              continue;
+            m_key.push_back(get_element(m_mol, *atom));
+            std::size_t degreePos = m_key.size();
+            m_key.push_back(0);
+            incident_iter bond, end_bonds;
+            TIE(bond, end_bonds) = get_bonds(m_mol, *atom);
+            for (; bond != end_bonds; ++bond)
+              if (bonds[get_index(m_mol, *bond)]) {
+                m_key.push_back(m_bondIndices[get_index(m_mol, *bond)]);
+                ++m_key[degreePos];
+              }
+          }
+          // source & target for each bond
+          bond_iter bond, end_bonds;
+          TIE(bond, end_bonds) = get_bonds(m_mol);
+          for (; bond != end_bonds; ++bond) {
+            if (!bonds[get_index(m_mol, *bond)])
+              continue;
+            m_key.push_back(m_atomIndices[get_index(m_mol, get_source(m_mol, *bond))]);
+            m_key.push_back(m_atomIndices[get_index(m_mol, get_target(m_mol, *bond))]);
+          }
+
+          return cachedHash(atoms, bonds);
+        }
+
+      private:
+        /**
+         * Look up m_key in the cache, canonicalize the fragment when not
+         * found.
+         */
+        std::size_t cachedHash(const std::vector<bool> &atoms, const std::vector<bool> &bonds)
+        {
+          std::size_t hash;
+          if (m_cache->find(m_key, hash))
+            return hash;
+          hash = canonicalHash(atoms, bonds);
+          m_cache->insert(m_key, hash);
+          return hash;
+        }
+
+        /**
+         * Canonicalize the fragment and hash the canonical code.
+         */
+        std::size_t canonicalHash(const std::vector<bool> &atoms, const std::vector<bool> &bonds)
+        {
+          // create the (compact) fragment molecule
+          m_fragment.assign(m_mol, atoms, bonds);
+          // compute symmetry classes
+          extended_connectivities(m_fragment, m_symmetry, m_scratch);
+          // canonicalize the fragment & hash the canonical code
+          canonicalize(m_fragment, m_symmetry, m_labels, m_code, *m_arena);
+          return m_hash(m_code);
+        }
+
+        MoleculeType &m_mol; //!< The molecule
+        FragmentCache *m_cache; //!< The cache (may be 0)
+        boost::hash<std::vector<unsigned long> > m_hash; //!< The hash function
+        std::vector<unsigned long> m_key; //!< The key for the current fragment
+        std::vector<unsigned long> m_atomIndices; //!< The fragment atom indices
+        std::vector<unsigned long> m_bondIndices; //!< The fragment bond indices
+        FrozenMol m_fragment; //!< The current fragment (reused)
+        std::vector<unsigned long> m_symmetry; //!< The symmetry classes of the current fragment
+        ExtendedConnectivitiesScratch m_scratch; //!< Buffers for computing the symmetry classes
+        std::vector<Index> m_labels; //!< The canonical atom order of the current fragment
+        std::vector<unsigned long> m_code; //!< The canonical code of the current fragment
+        Arena m_ownArena; //!< The arena used when none is specified
+        Arena *m_arena; //!< The arena for canonicalizing the fragments
+    };
+
+  }
+
   /**
    * Compute the path-based fingerprint for the specified molecule. All paths
    * in the molecular graph will be enumerated upto the specified size. For each
@@ -56,20 +293,24 @@ namespace Helium {
    * @param hashPrime A prime number to hash the paths so they will fit in the
    *        fingerprint. The largest prime, less than or equal to the number of
    *        bits in the fingerprint is ideal.
+   * @param cache Optional cache for the hashed canonical codes (see FragmentCache).
+   * @param arena Optional arena for the temporary buffers (see Arena).
    */
   template<typename MoleculeType>
-  void path_fingerprint(MoleculeType &mol, Word *fingerprint, int size = 7, int numWords = 16, int hashPrime = 1021)
+  void path_fingerprint(MoleculeType &mol, Word *fingerprint, int size = 7, int numWords = 16, int hashPrime = 1021,
+      FragmentCache *cache = 0, Arena *arena = 0)
   {
     assert(hashPrime <= numWords * sizeof(Word) * 8);
-    boost::hash<std::vector<unsigned long> > hash;
+    impl::FragmentHasher<MoleculeType> hasher(mol, cache, arena);
     // set all bits to 0
     bitvec_zero(fingerprint, numWords);
     // enumerate the paths
     std::vector<std::vector<unsigned int> > paths = enumerate_paths(mol, size);
     // set the bits
+    std::vector<bool> atoms, bonds;
     for (std::size_t i = 0; i < paths.size(); ++i) {
-      std::vector<bool> atoms(num_atoms(mol));
-      std::vector<bool> bonds(num_bonds(mol));
+      atoms.assign(num_atoms(mol), false);
+      bonds.assign(num_bonds(mol), false);
 
       // set bits for atoms/bonds in the path
       for (std::size_t j = 0; j < paths[i].size(); ++j) {
@@ -78,17 +319,138 @@ namespace Helium {
           bonds[get_index(mol, get_bond(mol, get_atom(mol, paths[i][j]), get_atom(mol, paths[i][j + 1])))] = true;
       }
 
-      // create path molecule
-      Substructure<MoleculeType> substruct(mol, atoms, bonds);
-      // compute symmetry classes
-      std::vector<unsigned long> symmetry = extended_connectivities(substruct);
-      // canonicalize the path
-      std::vector<unsigned long> code = canonicalize(substruct, symmetry).second;
       // set the bit for the hashed canonical code modulo the hash prime.
-      bitvec_set(hash(code) % hashPrime, fingerprint);
+      bitvec_set(hasher.path(paths[i], atoms, bonds) % hashPrime, fingerprint);
     }
   }
 
+  namespace impl {
+
+    /**
+     * @brief Path fingerprint computed while enumerating the paths.
+     *
+     * The paths are enumerated using a depth-first search starting from each
+     * atom. While the path is extended, a polynomial hash of the elements along
+     * the path is updated in both directions:
+     *
+     * @code
+     * forward = forward * P + x
+     * reverse = reverse + x * P^n
+     * @endcode
+     *
+     * The lowest of both hashes is the hash for the path in the canonical
+     * direction (the two hashes are swapped when the path is traversed in the
+     * other direction). Since setting a bit is idempotent, paths found from
+     * both ends do not need to be removed.
+     */
+    template<typename MoleculeType>
+    class RollingPathFingerprint
+    {
+        typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
+        typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
+        typedef typename molecule_traits<MoleculeType>::nbr_iter nbr_iter;
+
+      public:
+        RollingPathFingerprint(MoleculeType &mol, Word *fingerprint, int size, int hashPrime)
+          : m_mol(mol), m_fingerprint(fingerprint), m_size(size), m_hashPrime(hashPrime),
+            m_visited(num_atoms(mol))
+        {
+          atom_iter atom, end_atoms;
+          TIE(atom, end_atoms) = get_atoms(mol);
+          for (; atom != end_atoms; ++atom)
+            enumerate(*atom, 1, 0, 0, 1);
+        }
+
+      private:
+        /**
+         * Extend the path ending in @p atom.
+         *
+         * @param atom The last atom in the path.
+         * @param length The number of atoms in the path (including @p atom).
+         * @param forward The forward hash of the path without @p atom.
+         * @param reverse The reverse hash of the path without @p atom.
+         * @param power P^(length - 1)
+         */
+        void enumerate(atom_type atom, int length, unsigned long forward, unsigned long reverse,
+            unsigned long power)
+        {
+          unsigned long x = get_element(m_mol, atom) + 1;
+          forward = forward * Prime + x;
+          reverse = reverse + x * power;
+
+          bitvec_set(hash(std::min(forward, reverse), length) % m_hashPrime, m_fingerprint);
+
+          if (length == m_size)
+            return;
+
+          m_visited[get_index(m_mol, atom)] = true;
+          nbr_iter nbr, end_nbrs;
+          TIE(nbr, end_nbrs) = get_nbrs(m_mol, atom);
+          for (; nbr != end_nbrs; ++nbr)
+            if (!m_visited[get_index(m_mol, *nbr)])
+              enumerate(*nbr, length + 1, forward, reverse, power * Prime);
+          m_visited[get_index(m_mol, atom)] = false;
+        }
+
+        /**
+         * Mix the bits of the path hash (the modulo only uses the low bits).
+         */
+        static unsigned long hash(unsigned long value, int length)
+        {
+          value ^= static_cast<unsigned long>(length) << 56;
+          value ^= value >> 33;
+          value *= 0xff51afd7ed558ccdUL;
+          value ^= value >> 33;
+          value *= 0xc4ceb9fe1a85ec53UL;
+          value ^= value >> 33;
+          return value;
+        }
+
+        static const unsigned long Prime = 1099511628211UL;
+
+        MoleculeType &m_mol; //!< The molecule
+        Word *m_fingerprint; //!< The fingerprint bit vector
+        int m_size; //!< Maximum number of atoms in the paths
+        int m_hashPrime; //!< The modulo prime number
+        std::vector<bool> m_visited; //!< The atoms in the current path
+    };
+
+  }
+
+  /**
+   * Compute a path-based fingerprint without materializing the paths. All
+   * paths in the molecular graph are enumerated upto the specified size and
+   * a rolling hash of the elements along the path (the lowest of both
+   * directions) is used to set a bit in the @p fingerprint.
+   *
+   * The same paths are considered equal as for path_fingerprint() (i.e. paths
+   * with the same elements) but the values used to set the bits differ. This
+   * means the fingerprints can not be mixed with path_fingerprint()
+   * fingerprints.
+   *
+   * @param mol The molecule which models the MoleculeConcept.
+   * @param fingerprint Pointer to the fingerprint memory. This memory must be
+   *        the correct size (see @p numWords).
+   * @param size Maximum number of atoms in the paths.
+   * @param numWords The number of words the fingerprint has. Each word has
+   *        8 * sizeof(Word) bits which is usually 64 bit. This means the
+   *        default value 16 results in fingerprints of 1024 bits.
+   * @param hashPrime A prime number to hash the paths so they will fit in the
+   *        fingerprint. The largest prime, less than or equal to the number of
+   *        bits in the fingerprint is ideal.
+   */
+  template<typename MoleculeType>
+  void rolling_path_fingerprint(MoleculeType &mol, Word *fingerprint, int size = 7, int numWords = 16,
+      int hashPrime = 1021)
+  {
+    assert(hashPrime <= numWords * sizeof(Word) * 8);
+    // set all bits to 0
+    bitvec_zero(fingerprint, numWords);
+    if (size < 1)
+      return;
+    impl::RollingPathFingerprint<MoleculeType>(mol, fingerprint, size, hashPrime);
+  }
+
   namespace impl {
 
     template<typename MoleculeType>
@@ -110,9 +472,11 @@ namespace Helium {
          * @param words The number of words for the @p fp bit vector.
          * @param prime The prime to use for taking the modulo (e.g. the largest
          *              prime smaller than the number of bits in the fingerprint.
+         * @param cache The cache for the hashed canonical codes (may be 0).
+         * @param arena The arena for the temporary buffers (may be 0).
          */
-        EnumerateSubgraphsCallback(MoleculeType &mol_, Word *fp, int words, int prime)
-            : mol(mol_), fingerprint(fp), numWords(words), hashPrime(prime)
+        EnumerateSubgraphsCallback(MoleculeType &mol_, Word *fp, int words, int prime, FragmentCache *cache,
+            Arena *arena) : mol(mol_), fingerprint(fp), numWords(words), hashPrime(prime), hasher(mol_, cache, arena)
         {
           bitvec_zero(fingerprint, numWords);
         }
@@ -120,30 +484,28 @@ namespace Helium {
         /**
          * Callback function, gets called for every subgraph found in the molecule.
          */
-        void operator()(const Subgraph &subgraph)
+        void operator()(const SubgraphView &subgraph)
         {
-          // create the subgraph molecule
-          Substructure<MoleculeType> substruct(mol, subgraph.atoms, subgraph.bonds);
-          // compute symmetry classes
-          std::vector<unsigned long> symmetry = extended_connectivities(substruct);
-          // canonicalize the subgraph
-          std::vector<unsigned long> code = canonicalize(substruct, symmetry).second;
+          subgraph.copy(atoms, bonds);
           // set the bit for the hashed canonical code modulo the hash prime.
-          bitvec_set(m_hash(code) % hashPrime, fingerprint);
+          bitvec_set(hasher.subgraph(atoms, bonds) % hashPrime, fingerprint);
         }
 
         MoleculeType &mol; //!< The molecule
         Word *fingerprint; //!< The fingerprint bit vector
-        boost::hash<std::vector<unsigned long> > m_hash; //!< The hash function
         int numWords; //!< The number of words for the fingerprint bit vector
         int hashPrime; //!< The modulo prime number
+        FragmentHasher<MoleculeType> hasher; //!< Computes the hashed canonical codes
+        std::vector<bool> atoms; //!< The subgraph atoms (reused)
+        std::vector<bool> bonds; //!< The subgraph bonds (reused)
       };
 
-      SubgraphsFingerprint(MoleculeType &mol, Word *fp, int size, bool trees, int numWords, int hashPrime)
-          : callback(mol, fp, numWords, hashPrime)
+      SubgraphsFingerprint(MoleculeType &mol, Word *fp, int size, bool trees, int numWords, int hashPrime,
+          FragmentCache *cache, Arena *arena)
+          : callback(mol, fp, numWords, hashPrime, cache, arena)
       {
         // enumerate subgraphs
-        enumerate_subgraphs(mol, callback, size, trees);
+        enumerate_subgraph_views(mol, callback, size, trees, 0, arena);
       }
 
       EnumerateSubgraphsCallback callback; //!< Subgraph enumerator callback
@@ -167,12 +529,15 @@ namespace Helium {
    * @param hashPrime A prime number to hash the trees so they will fit in the
    *        fingerprint. The largest prime, less than or equal to the number of
    *        bits in the fingerprint is ideal.
+   * @param cache Optional cache for the hashed canonical codes (see FragmentCache).
+   * @param arena Optional arena for the temporary buffers (see Arena).
    */
   template<typename MoleculeType>
-  void tree_fingerprint(MoleculeType &mol, Word *fingerprint, int size = 7, int numWords = 16, int hashPrime = 1021)
+  void tree_fingerprint(MoleculeType &mol, Word *fingerprint, int size = 7, int numWords = 16, int hashPrime = 1021,
+      FragmentCache *cache = 0, Arena *arena = 0)
   {
     assert(hashPrime <= numWords * sizeof(Word) * 8);
-    impl::SubgraphsFingerprint<MoleculeType>(mol, fingerprint, size, true, numWords, hashPrime);
+    impl::SubgraphsFingerprint<MoleculeType>(mol, fingerprint, size, true, numWords, hashPrime, cache, arena);
   }
 
   /**
@@ -191,12 +556,139 @@ namespace Helium {
    * @param hashPrime A prime number to hash the subgraphs so they will fit in the
    *        fingerprint. The largest prime, less than or equal to the number of
    *        bits in the fingerprint is ideal.
+   * @param cache Optional cache for the hashed canonical codes (see FragmentCache).
+   * @param arena Optional arena for the temporary buffers (see Arena).
    */
   template<typename MoleculeType>
-  void subgraph_fingerprint(MoleculeType &mol, Word *fingerprint, int size = 7, int numWords = 16, int hashPrime = 1021)
+  void subgraph_fingerprint(MoleculeType &mol, Word *fingerprint, int size = 7, int numWords = 16, int hashPrime = 1021,
+      FragmentCache *cache = 0, Arena *arena = 0)
   {
     assert(hashPrime <= numWords * sizeof(Word) * 8);
-    impl::SubgraphsFingerprint<MoleculeType>(mol, fingerprint, size, false, numWords, hashPrime);
+    impl::SubgraphsFingerprint<MoleculeType>(mol, fingerprint, size, false, numWords, hashPrime, cache, arena);
+  }
+
+
+  namespace impl {
+
+    /**
+     * @brief Circular (Morgan environment) fingerprint.
+     *
+     * Each atom starts with an identifier computed from its element, degree,
+     * charge and aromaticity (the number of hydrogens is not known for query
+     * molecules parsed from SMILES). In each iteration, the new identifier of
+     * an atom is the hash of the iteration, the atom's identifier and the
+     * sorted (bond label, neighbor identifier) pairs. The identifiers of all
+     * iterations (i.e. the environments with radius 0 to radius) are hashed
+     * into the fingerprint.
+     */
+    template<typename MoleculeType>
+    class CircularFingerprint
+    {
+        typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
+        typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
+        typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
+
+      public:
+        CircularFingerprint(MoleculeType &mol, Word *fingerprint, int radius, int hashPrime)
+        {
+          std::size_t n = num_atoms(mol);
+          m_ids.resize(n);
+          m_next.resize(n);
+
+          // flat adjacency & bond labels (in the same order)
+          extended_connectivities_adjacency(mol, m_scratch);
+          m_labels.clear();
+          atom_iter atom, end_atoms;
+          TIE(atom, end_atoms) = get_atoms(mol);
+          for (; atom != end_atoms; ++atom) {
+            m_ids[get_index(mol, *atom)] = initial(mol, *atom);
+            incident_iter bond, end_bonds;
+            TIE(bond, end_bonds) = get_bonds(mol, *atom);
+            for (; bond != end_bonds; ++bond)
+              m_labels.push_back(is_aromatic(mol, *bond) ? 4 : get_order(mol, *bond));
+          }
+
+          for (std::size_t i = 0; i < n; ++i)
+            bitvec_set(m_ids[i] % hashPrime, fingerprint);
+
+          for (int r = 1; r <= radius; ++r) {
+            for (std::size_t i = 0; i < n; ++i) {
+              // sort the (bond label, neighbor identifier) pairs
+              m_nbrs.clear();
+              for (unsigned int j = m_scratch.offsets[i]; j < m_scratch.offsets[i + 1]; ++j)
+                m_nbrs.push_back(std::make_pair(m_labels[j], m_ids[m_scratch.nbrs[j]]));
+              std::sort(m_nbrs.begin(), m_nbrs.end());
+
+              std::size_t id = r;
+              boost::hash_combine(id, m_ids[i]);
+              for (std::size_t j = 0; j < m_nbrs.size(); ++j) {
+                boost::hash_combine(id, m_nbrs[j].first);
+                boost::hash_combine(id, m_nbrs[j].second);
+              }
+              m_next[i] = id;
+              bitvec_set(id % hashPrime, fingerprint);
+            }
+            m_ids.swap(m_next);
+          }
+        }
+
+      private:
+        /**
+         * Compute the initial identifier for an atom.
+         */
+        static std::size_t initial(MoleculeType &mol, atom_type atom)
+        {
+          std::size_t id = 0;
+          boost::hash_combine(id, get_element(mol, atom));
+          boost::hash_combine(id, get_degree(mol, atom));
+          boost::hash_combine(id, get_charge(mol, atom));
+          boost::hash_combine(id, is_aromatic(mol, atom));
+          return id;
+        }
+
+        ExtendedConnectivitiesScratch m_scratch; //!< The flat adjacency
+        std::vector<int> m_labels; //!< The bond labels (same order as m_scratch.nbrs)
+        std::vector<std::size_t> m_ids; //!< The identifiers for the current radius
+        std::vector<std::size_t> m_next; //!< The identifiers for the next radius
+        std::vector<std::pair<int, std::size_t> > m_nbrs; //!< Sorted neighbor pairs
+    };
+
+  }
+
+  /**
+   * Compute the circular (ECFP-style) fingerprint for the specified molecule.
+   * For each atom, the environments upto the specified radius (i.e. the atoms
+   * within radius bonds) are described by an identifier that is hashed using
+   * the @p hashPrime number to set a bit in the @p fingerprint. The identifiers
+   * are computed iteratively from the neighbor identifiers, similar to the
+   * extended_connectivities(). This takes time linear in the number of
+   * atoms for each radius.
+   *
+   * Unlike the path, tree and subgraph fingerprints, the circular fingerprint
+   * of a substructure is not always a subset of the fingerprint of a
+   * superstructure (e.g. atom degrees differ). It is meant for similarity
+   * searches, not for substructure screening.
+   *
+   * @param mol The molecule which models the MoleculeConcept.
+   * @param fingerprint Pointer to the fingerprint memory. This memory must be
+   *        the correct size (see @p numWords).
+   * @param radius The maximum radius of the environments (e.g. 2 for ECFP4
+   *        like fingerprints).
+   * @param numWords The number of words the fingerprint has. Each word has
+   *        8 * sizeof(Word) bits which is usually 64 bit. This means the
+   *        default value 16 results in fingerprints of 1024 bits.
+   * @param hashPrime A prime number to hash the environments so they will fit
+   *        in the fingerprint. The largest prime, less than or equal to the
+   *        number of bits in the fingerprint is ideal.
+   */
+  template<typename MoleculeType>
+  void circular_fingerprint(MoleculeType &mol, Word *fingerprint, int radius = 2, int numWords = 16,
+      int hashPrime = 1021)
+  {
+    assert(hashPrime <= numWords * sizeof(Word) * 8);
+    // set all bits to 0
+    bitvec_zero(fingerprint, numWords);
+    impl::CircularFingerprint<MoleculeType>(mol, fingerprint, radius, hashPrime);
   }
 
 }
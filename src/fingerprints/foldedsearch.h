@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_FOLDEDSEARCH_H
+#define HELIUM_FOLDEDSEARCH_H
+
+#include <Helium/fingerprints/similarity.h>
+#include <Helium/util/memory.h>
+
+namespace Helium {
+
+  /**
+   * @brief Two-stage similarity search using folded fingerprints.
+   *
+   * A compact folded copy of the fingerprints (see bitvec_fold()) is kept in
+   * memory. A search first scans the folded copy, which is small enough to
+   * stay in the cache for libraries that do not fit in the cache at full
+   * width. Only the candidates that may have a score of at least Tmin are
+   * scored using the full width fingerprints in the storage.
+   *
+   * Folding maps each bit to exactly one folded bit. A folded bit that is set
+   * in A' but not in B' is only set by bits of A that are not set in B, so
+   * |A| - |A & B| >= |A'| - |A' & B'|. This gives the exact upper bound
+   *
+   * @code
+   * c = min(|A| - |A'| + |A' & B'|, |B| - |B'| + |A' & B'|)
+   * T <= c / (|A| + |B| - c)
+   * @endcode
+   *
+   * Since the bound is never lower than the score, the results are the same
+   * as for brute_force_similarity_search() and brute_force_knn_search().
+   * The popcount bucket bounds are also used when the storage is sorted by
+   * population count (see the sort tool).
+   *
+   * The storage must remain valid while the search object is used.
+   */
+  template<typename RowMajorFingerprintStorageType>
+  class FoldedSimilaritySearch
+  {
+    public:
+      /**
+       * Constructor.
+       *
+       * @param storage The full width fingerprints.
+       * @param foldedBits The number of bits for the folded fingerprints
+       *        (e.g. 128 or 256), must be a multiple of 64 and at most the
+       *        number of bits in the storage.
+       */
+      FoldedSimilaritySearch(RowMajorFingerprintStorageType &storage, unsigned int foldedBits = 256)
+        : m_storage(storage), m_foldedWords(foldedBits / BitsPerWord)
+      {
+        PRE(foldedBits && foldedBits % BitsPerWord == 0);
+        PRE(foldedBits <= storage.numBits());
+        TIMER("FoldedSimilaritySearch::FoldedSimilaritySearch():");
+        m_numWords = bitvec_num_words_for_bits(storage.numBits());
+        m_stride = aligned_stride(m_foldedWords, sizeof(Word));
+        std::size_t n = storage.numFingerprints();
+        m_folded = aligned_new<Word>(std::max<std::size_t>(1, n * m_stride));
+        m_foldedCounts.resize(n);
+        for (std::size_t i = 0; i < n; ++i) {
+          bitvec_fold(storage.fingerprint(i), m_numWords, m_folded + i * m_stride, m_foldedWords);
+          m_foldedCounts[i] = bitvec_count(m_folded + i * m_stride, m_foldedWords);
+        }
+      }
+
+      ~FoldedSimilaritySearch()
+      {
+        aligned_delete(m_folded);
+      }
+
+      /**
+       * Get the number of bits of the folded fingerprints.
+       */
+      unsigned int foldedBits() const
+      {
+        return m_foldedWords * BitsPerWord;
+      }
+
+      /**
+       * Get the memory used by the folded fingerprints (the storage is not
+       * included).
+       */
+      MemoryUsage memoryUsage() const
+      {
+        std::size_t heap = aligned_size<Word>(std::max<std::size_t>(1, m_foldedCounts.size() * m_stride)) +
+            vector_memory_usage(m_foldedCounts);
+        return MemoryUsage(heap, 0, heap);
+      }
+
+      /**
+       * Search all fingerprints with a Tanimoto score of at least @p Tmin.
+       *
+       * @param query The full width query fingerprint.
+       * @param Tmin The minimum Tanimoto score.
+       * @param token Optional cancellation token, it is checked once per
+       *        block of 1024 fingerprints.
+       *
+       * @return The hits sorted by index, the same as for
+       *         brute_force_similarity_search().
+       */
+      std::vector<std::pair<unsigned int, double> > search(const Word *query, double Tmin,
+          const CancellationToken *token = 0) const
+      {
+        TIMER("FoldedSimilaritySearch::search():");
+        ThresholdHits hits(Tmin);
+        searchRange(query, Tmin, hits, token);
+        return hits.hits;
+      }
+
+      /**
+       * Search the @p k nearest neighbors with a Tanimoto score of at least
+       * @p Tmin. The threshold for the folded bound is raised to the score of
+       * the k-th best hit found so far.
+       *
+       * @return The (at most) k best hits sorted by descending score (equal
+       *         scores by ascending index), the same as for
+       *         brute_force_knn_search().
+       */
+      std::vector<std::pair<unsigned int, double> > knnSearch(const Word *query, unsigned int k, double Tmin = 0.0,
+          const CancellationToken *token = 0) const
+      {
+        TIMER("FoldedSimilaritySearch::knnSearch():");
+        if (!k)
+          return std::vector<std::pair<unsigned int, double> >();
+        impl::KnnHits hits(Tmin, k);
+        searchRange(query, Tmin, hits, token);
+        return hits.sorted();
+      }
+
+    private:
+      FoldedSimilaritySearch(const FoldedSimilaritySearch&);
+      FoldedSimilaritySearch& operator=(const FoldedSimilaritySearch&);
+
+      /**
+       * Hit collector with a fixed threshold, the hits are kept in index
+       * order.
+       */
+      struct ThresholdHits
+      {
+        ThresholdHits(double Tmin_) : Tmin(Tmin_)
+        {
+        }
+
+        double threshold() const
+        {
+          return Tmin;
+        }
+
+        void add(unsigned int index, double T)
+        {
+          if (T >= Tmin)
+            hits.push_back(std::make_pair(index, T));
+        }
+
+        double Tmin;
+        std::vector<std::pair<unsigned int, double> > hits;
+      };
+
+      /**
+       * Scan the folded fingerprints in blocks. The candidates of a block
+       * are scored using the full width fingerprints before the next block
+       * is scanned so the threshold of the collector is up to date.
+       */
+      template<typename HitCollector>
+      void searchRange(const Word *query, double Tmin, HitCollector &hits, const CancellationToken *token) const
+      {
+        const unsigned int blockSize = 1024;
+        int A = bitvec_count(query, m_numWords);
+        std::vector<Word> foldedQuery(m_foldedWords);
+        bitvec_fold(query, m_numWords, &foldedQuery[0], m_foldedWords);
+        int foldedA = bitvec_count(&foldedQuery[0], m_foldedWords);
+
+        unsigned int begin, end;
+        impl::popcount_range(m_storage, A, Tmin, begin, end);
+
+        const impl::BitvecKernels &foldedKernels = impl::bitvec_kernels_for_words(m_foldedWords);
+        const int *bitCounts = m_storage.bitCounts();
+        std::vector<unsigned int> candidates;
+        candidates.reserve(blockSize);
+        for (unsigned int i = begin; i < end; i += blockSize) {
+          if (token && token->expired())
+            return;
+          unsigned int blockEnd = std::min(end, i + blockSize);
+          HELIUM_COUNT(FoldedBoundsComputed, blockEnd - i);
+
+          // stage 1: the upper bound from the folded fingerprints
+          double threshold = hits.threshold();
+          candidates.clear();
+          for (unsigned int j = i; j < blockEnd; ++j) {
+            int foldedC = foldedKernels.andCount(&foldedQuery[0], m_folded + static_cast<std::size_t>(j) * m_stride,
+                m_foldedWords);
+            int B = bitCounts[j];
+            int c = std::min(A - foldedA + foldedC, B - m_foldedCounts[j] + foldedC);
+            // the empty fingerprints have an undefined score (never a hit)
+            if (A + B - c > 0 && static_cast<double>(c) / (A + B - c) >= threshold)
+              candidates.push_back(j);
+          }
+
+          // stage 2: score the candidates using the full width fingerprints
+          HELIUM_COUNT(TanimotosComputed, candidates.size());
+          for (std::size_t j = 0; j < candidates.size(); ++j) {
+            unsigned int index = candidates[j];
+            hits.add(index, bitvec_tanimoto(query, m_storage.fingerprint(index), A, bitCounts[index], m_numWords));
+          }
+        }
+      }
+
+      RowMajorFingerprintStorageType &m_storage;
+      Word *m_folded; //!< The folded fingerprints (m_stride words each)
+      std::vector<int> m_foldedCounts; //!< The bit counts of the folded fingerprints
+      unsigned int m_foldedWords; //!< The number of words of a folded fingerprint
+      unsigned int m_stride; //!< The number of words between two folded fingerprints
+      unsigned int m_numWords; //!< The number of words of a full width fingerprint
+  };
+
+}
+
+#endif
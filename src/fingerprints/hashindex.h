@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_HASHINDEX_H
+#define HELIUM_HASHINDEX_H
+
+#include <Helium/bitvec.h>
+#include <Helium/contract.h>
+#include <Helium/util.h>
+#include <Helium/util/string.h>
+#include <Helium/fileio/file.h>
+#ifdef HAVE_CPP11
+#include <Helium/threadpool.h>
+#endif
+
+#include <json/json.h>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <vector>
+#include <limits>
+#include <stdexcept>
+
+namespace Helium {
+
+  /**
+   * @brief Hash index for exact fingerprint lookups and deduplication.
+   *
+   * The fingerprints are stored in an open addressing hash table keyed by
+   * their contents. Fingerprints with the same contents form a chain (sorted
+   * by index) and only the first fingerprint of each chain is stored in the
+   * table. Finding the fingerprints that are identical to a query (i.e.
+   * Tanimoto coefficient 1.0 for non-empty fingerprints) takes constant time
+   * and the groups of duplicate fingerprints are found by visiting the table
+   * once.
+   *
+   * The table can be saved to a file stored alongside the fingerprint file
+   * (see save()). Loading this file memory maps the table so the index is
+   * available without hashing the fingerprints again.
+   *
+   * @code
+   * InMemoryRowMajorFingerprintStorage storage;
+   * storage.load("fingerprints.fpi");
+   *
+   * FingerprintHashIndex<InMemoryRowMajorFingerprintStorage> index(storage);
+   * std::vector<unsigned int> matches = index.lookup(query);
+   * std::vector<std::vector<unsigned int> > groups = index.duplicates();
+   * @endcode
+   */
+  template<typename FingerprintStorageType>
+  class FingerprintHashIndex
+  {
+    public:
+      /**
+       * The value returned by find() and next() if there is no (other)
+       * fingerprint. This value is also used for empty table slots.
+       */
+      static const unsigned int NotFound = std::numeric_limits<unsigned int>::max();
+
+      /**
+       * @brief Constructor.
+       *
+       * Hash all fingerprints in the storage. When C++11 support is enabled,
+       * the hash values are computed using the global ThreadPool.
+       *
+       * @param storage The fingerprint storage to index.
+       */
+      FingerprintHashIndex(const FingerprintStorageType &storage) : m_storage(storage),
+          m_numBits(storage.numBits()), m_numWords(bitvec_num_words_for_bits(storage.numBits())),
+          m_numFingerprints(storage.numFingerprints()), m_numDistinct(0)
+      {
+        TIMER("Building FingerprintHashIndex:");
+        PRE(m_numFingerprints < NotFound);
+
+        // hash the fingerprints
+        std::vector<uint64_t> hashes(m_numFingerprints);
+#ifdef HAVE_CPP11
+        ThreadPool::global().parallelFor(m_numFingerprints, 4096, [&] (std::size_t begin, std::size_t end) {
+          for (std::size_t i = begin; i < end; ++i)
+            hashes[i] = hash(storage.fingerprint(i), m_numWords);
+        });
+#else
+        for (unsigned int i = 0; i < m_numFingerprints; ++i)
+          hashes[i] = hash(storage.fingerprint(i), m_numWords);
+#endif
+
+        // the load factor is at most 0.5
+        m_capacity = 16;
+        while (m_capacity < 2 * static_cast<std::size_t>(m_numFingerprints))
+          m_capacity *= 2;
+        m_ownSlots.resize(m_capacity, NotFound);
+        m_ownTags.resize(m_capacity, 0);
+        m_ownNext.resize(m_numFingerprints, NotFound);
+
+        // insert in reverse order so the chains are sorted by index
+        for (unsigned int i = m_numFingerprints; i-- > 0; ) {
+          const Word *fingerprint = storage.fingerprint(i);
+          uint32_t tag = hashes[i] >> 32;
+          std::size_t slot = hashes[i] & (m_capacity - 1);
+          while (m_ownSlots[slot] != NotFound) {
+            if (m_ownTags[slot] == tag && bitvec_equal(fingerprint, storage.fingerprint(m_ownSlots[slot]), m_numWords))
+              break;
+            slot = (slot + 1) & (m_capacity - 1);
+          }
+
+          if (m_ownSlots[slot] == NotFound) {
+            m_ownTags[slot] = tag;
+            ++m_numDistinct;
+          } else
+            m_ownNext[i] = m_ownSlots[slot];
+          m_ownSlots[slot] = i;
+        }
+
+        m_slots = &m_ownSlots[0];
+        m_tags = &m_ownTags[0];
+        m_next = m_numFingerprints ? &m_ownNext[0] : 0;
+      }
+
+      /**
+       * @brief Constructor.
+       *
+       * Load a hash index file created using save(). The file is memory
+       * mapped. Errors are reported by throwing a std::runtime_error.
+       *
+       * @param storage The indexed fingerprint storage, this must contain
+       *        the same fingerprints as the storage used to create the file.
+       * @param filename The hash index file.
+       */
+      FingerprintHashIndex(const FingerprintStorageType &storage, const std::string &filename)
+        : m_storage(storage), m_numBits(storage.numBits()), m_numWords(bitvec_num_words_for_bits(storage.numBits())),
+          m_numFingerprints(storage.numFingerprints()), m_numDistinct(0)
+      {
+        TIMER("Loading FingerprintHashIndex from file:");
+
+        // open the file
+        BinaryInputFile file(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open hash index file \"", filename, "\""));
+
+        // parse the JSON header
+        Json::Reader reader;
+        Json::Value data;
+        if (!reader.parse(file.header(), data))
+          throw std::runtime_error(reader.getFormattedErrorMessages());
+
+        // make sure the required attributes are present and match the storage
+        if (!data.isMember("filetype") || data["filetype"].asString() != "fingerprint-hash-index")
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'filetype' attribute or is not 'fingerprint-hash-index'"));
+        if (!data.isMember("num_bits") || data["num_bits"].asUInt() != m_numBits)
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_bits' attribute or it does not match the fingerprints"));
+        if (!data.isMember("num_fingerprints") || data["num_fingerprints"].asUInt() != m_numFingerprints)
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_fingerprints' attribute or it does not match the fingerprints"));
+        if (!data.isMember("capacity") || !data.isMember("num_distinct"))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'capacity' or 'num_distinct' attribute"));
+
+        m_capacity = data["capacity"].asUInt64();
+        m_numDistinct = data["num_distinct"].asUInt();
+        if (m_capacity < 2 * static_cast<std::size_t>(m_numFingerprints) || (m_capacity & (m_capacity - 1)))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " contains an invalid 'capacity' attribute"));
+
+        // memory map the binary data
+        std::size_t offset = file.stream().tellg();
+        file.close();
+        m_mappedFile.open(filename);
+        if (!m_mappedFile.is_open())
+          throw std::runtime_error(make_string("Could not memory map hash index file \"", filename, "\""));
+        if (m_mappedFile.size() < offset + (2 * m_capacity + m_numFingerprints) * sizeof(uint32_t))
+          throw std::runtime_error(make_string("Hash index file \"", filename, "\" is truncated"));
+
+        // set the pointers to the arrays (see save())
+        const uint32_t *pos = reinterpret_cast<const uint32_t*>(m_mappedFile.data() + offset);
+        m_slots = pos;
+        m_tags = pos + m_capacity;
+        m_next = pos + 2 * m_capacity;
+      }
+
+      /**
+       * Hash the words of a fingerprint.
+       *
+       * @param fingerprint The fingerprint.
+       * @param numWords The number of words in the fingerprint.
+       */
+      static uint64_t hash(const Word *fingerprint, int numWords)
+      {
+        uint64_t h = 0x9e3779b97f4a7c15ULL ^ numWords;
+        for (int i = 0; i < numWords; ++i) {
+          h ^= fingerprint[i];
+          h *= 0xbf58476d1ce4e5b9ULL;
+          h ^= h >> 31;
+        }
+        // finalize to spread the bits for the table slot and tag
+        h = (h ^ (h >> 30)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+      }
+
+      /**
+       * Get the number of distinct fingerprints (i.e. the number of chains).
+       */
+      unsigned int numDistinct() const
+      {
+        return m_numDistinct;
+      }
+
+      /**
+       * @brief Find the first fingerprint that is identical to a query.
+       *
+       * @param fingerprint The query fingerprint.
+       *
+       * @return The smallest index of the identical fingerprints or NotFound
+       *         if there are none.
+       */
+      unsigned int find(const Word *fingerprint) const
+      {
+        uint64_t h = hash(fingerprint, m_numWords);
+        uint32_t tag = h >> 32;
+        for (std::size_t slot = h & (m_capacity - 1); m_slots[slot] != NotFound; slot = (slot + 1) & (m_capacity - 1))
+          if (m_tags[slot] == tag && bitvec_equal(fingerprint, m_storage.fingerprint(m_slots[slot]), m_numWords))
+            return m_slots[slot];
+        return NotFound;
+      }
+
+      /**
+       * Get the next fingerprint with the same contents.
+       *
+       * @param index The index of a fingerprint.
+       *
+       * @return The next larger index of an identical fingerprint or NotFound.
+       */
+      unsigned int next(unsigned int index) const
+      {
+        PRE(index < m_numFingerprints);
+        return m_next[index];
+      }
+
+      /**
+       * @brief Find all fingerprints that are identical to a query.
+       *
+       * @param fingerprint The query fingerprint.
+       *
+       * @return The indices of the identical fingerprints, sorted by index.
+       */
+      std::vector<unsigned int> lookup(const Word *fingerprint) const
+      {
+        std::vector<unsigned int> result;
+        for (unsigned int i = find(fingerprint); i != NotFound; i = m_next[i])
+          result.push_back(i);
+        return result;
+      }
+
+      /**
+       * @brief Get the groups of duplicate fingerprints.
+       *
+       * @return The groups with more than one fingerprint. Each group is
+       *         sorted by index and the groups are sorted by their first
+       *         index.
+       */
+      std::vector<std::vector<unsigned int> > duplicates() const
+      {
+        TIMER("FingerprintHashIndex::duplicates():");
+        // a fingerprint starts a group if it is the head of a chain
+        std::vector<bool> isHead(m_numFingerprints);
+        for (std::size_t slot = 0; slot < m_capacity; ++slot)
+          if (m_slots[slot] != NotFound && m_next[m_slots[slot]] != NotFound)
+            isHead[m_slots[slot]] = true;
+
+        std::vector<std::vector<unsigned int> > groups;
+        for (unsigned int i = 0; i < m_numFingerprints; ++i) {
+          if (!isHead[i])
+            continue;
+          groups.resize(groups.size() + 1);
+          for (unsigned int j = i; j != NotFound; j = m_next[j])
+            groups.back().push_back(j);
+        }
+        return groups;
+      }
+
+      /**
+       * @brief Save the hash table to a file.
+       *
+       * The file contains a JSON header followed by the table slots, the
+       * tags (the high 32 bits of the hash values) and the chain links as
+       * arrays of 32-bit unsigned integers. Errors are reported by throwing
+       * a std::runtime_error.
+       *
+       * @param filename The hash index file.
+       */
+      void save(const std::string &filename) const
+      {
+        TIMER("FingerprintHashIndex::save():");
+        BinaryOutputFile file(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open hash index file \"", filename, "\""));
+
+        // write the arrays
+        bool ok = file.write(m_slots, m_capacity * sizeof(uint32_t)) &&
+          file.write(m_tags, m_capacity * sizeof(uint32_t));
+        if (ok && m_numFingerprints)
+          ok = file.write(m_next, m_numFingerprints * sizeof(uint32_t));
+
+        // create JSON header
+        Json::Value data;
+        data["filetype"] = "fingerprint-hash-index";
+        data["num_bits"] = m_numBits;
+        data["num_fingerprints"] = m_numFingerprints;
+        data["num_distinct"] = m_numDistinct;
+        data["capacity"] = static_cast<Json::UInt64>(m_capacity);
+
+        // write JSON header
+        Json::StyledWriter writer;
+        if (!ok || !file.writeHeader(writer.write(data)))
+          throw std::runtime_error(make_string("Could not write hash index file \"", filename, "\""));
+      }
+
+    private:
+      FingerprintHashIndex(const FingerprintHashIndex&);
+      FingerprintHashIndex& operator=(const FingerprintHashIndex&);
+
+      const FingerprintStorageType &m_storage; //!< The indexed fingerprints
+      unsigned int m_numBits; //!< The number of bits in the fingerprints
+      int m_numWords; //!< The number of words in the fingerprints
+      unsigned int m_numFingerprints; //!< The number of fingerprints
+      unsigned int m_numDistinct; //!< The number of distinct fingerprints
+      std::size_t m_capacity; //!< The number of table slots (a power of two)
+      const uint32_t *m_slots; //!< The first fingerprint of each chain (or NotFound)
+      const uint32_t *m_tags; //!< The high 32 bits of the hash for each slot
+      const uint32_t *m_next; //!< The next fingerprint in the chain (or NotFound)
+      std::vector<uint32_t> m_ownSlots; //!< The slots for a built index
+      std::vector<uint32_t> m_ownTags; //!< The tags for a built index
+      std::vector<uint32_t> m_ownNext; //!< The chain links for a built index
+      boost::iostreams::mapped_file_source m_mappedFile; //!< The mapped file for a loaded index
+  };
+
+  template<typename FingerprintStorageType>
+  const unsigned int FingerprintHashIndex<FingerprintStorageType>::NotFound;
+
+}
+
+#endif
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_LSH_H
+#define HELIUM_LSH_H
+
+#include <Helium/fingerprints/similarity.h>
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace Helium {
+
+  namespace impl {
+
+    /**
+     * SplitMix64 pseudo random number generator. This generator is used
+     * instead of std::rand() to get the same hash functions on all
+     * platforms.
+     */
+    inline uint64_t splitmix64(uint64_t &state)
+    {
+      uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      return z ^ (z >> 31);
+    }
+
+  }
+
+  /**
+   * @brief Approximate similarity search using banded MinHash signatures.
+   *
+   * Locality sensitive hashing (LSH) index for very large fingerprint
+   * libraries where exact search is too slow. For binary fingerprints, the
+   * Tanimoto coefficient is the Jaccard similarity of the sets of 1-bits and
+   * the probability that the MinHash values of two fingerprints are equal is
+   * their Tanimoto coefficient. The numBands * rowsPerBand MinHash values of
+   * a fingerprint are divided in bands and the rows of a band are combined
+   * into a single key. Two fingerprints are candidates if they have the same
+   * key in at least one band. For a Tanimoto coefficient T, the probability
+   * to be a candidate is (see candidateProbability()):
+   *
+   * \f[
+   *   P(T) = 1 - (1 - T^r)^b
+   * \f]
+   *
+   * More bands increase recall (and the number of candidates), more rows per
+   * band make the search more selective (faster but lower recall). The
+   * candidates are re-ranked by computing the exact Tanimoto coefficient
+   * using bitvec_tanimoto() so all reported hits and scores are exact but
+   * some hits may be missed.
+   *
+   * @code
+   * InMemoryRowMajorFingerprintStorage storage;
+   * storage.load("fingerprints.fpi");
+   *
+   * MinHashIndex<InMemoryRowMajorFingerprintStorage> index(storage, 16, 4);
+   * std::vector<std::pair<unsigned int, double> > hits = index.search(query, 0.8);
+   * @endcode
+   */
+  template<typename FingerprintStorageType>
+  class MinHashIndex
+  {
+    public:
+      /**
+       * @brief Constructor.
+       *
+       * When C++11 support is enabled, the signatures are computed using the
+       * global ThreadPool.
+       *
+       * @pre The @p numBands and @p rowsPerBand parameters must be greater
+       *      than 0.
+       *
+       * @param storage The fingerprint storage to index.
+       * @param numBands The number of bands (b).
+       * @param rowsPerBand The number of MinHash values per band (r).
+       * @param seed The seed for the random hash functions.
+       */
+      MinHashIndex(const FingerprintStorageType &storage, unsigned int numBands = 16,
+          unsigned int rowsPerBand = 4, uint64_t seed = 42) : m_storage(storage),
+          m_numBands(numBands), m_rowsPerBand(rowsPerBand), m_numBits(storage.numBits()),
+          m_numWords(bitvec_num_words_for_bits(storage.numBits()))
+      {
+        PRE(numBands > 0);
+        PRE(rowsPerBand > 0);
+        TIMER("Building MinHashIndex:");
+
+        // a random hash value for each (bit, hash function) pair, the minimum
+        // over the 1-bits of a fingerprint is the MinHash value
+        unsigned int numHashes = m_numBands * m_rowsPerBand;
+        m_hashes.resize(static_cast<std::size_t>(m_numBits) * numHashes);
+        for (std::size_t i = 0; i < m_hashes.size(); ++i)
+          m_hashes[i] = static_cast<unsigned int>(impl::splitmix64(seed) >> 32);
+
+        // compute the band keys for all fingerprints
+        unsigned int n = storage.numFingerprints();
+        std::vector<uint64_t> keys(static_cast<std::size_t>(n) * m_numBands);
+#ifdef HAVE_CPP11
+        ThreadPool::global().parallelFor(n, 1024, [&] (std::size_t begin, std::size_t end) {
+          computeKeys(keys, begin, end);
+        });
+#else
+        computeKeys(keys, 0, n);
+#endif
+
+        // sort the (key, fingerprint) pairs for each band
+        m_keys.resize(m_numBands);
+        m_indices.resize(m_numBands);
+#ifdef HAVE_CPP11
+        ThreadPool::global().parallelFor(m_numBands, 1, [&] (std::size_t begin, std::size_t end) {
+          for (std::size_t band = begin; band < end; ++band)
+            sortBand(keys, band);
+        });
+#else
+        for (unsigned int band = 0; band < m_numBands; ++band)
+          sortBand(keys, band);
+#endif
+      }
+
+      /**
+       * Get the number of bands (b).
+       */
+      unsigned int numBands() const
+      {
+        return m_numBands;
+      }
+
+      /**
+       * Get the number of MinHash values per band (r).
+       */
+      unsigned int rowsPerBand() const
+      {
+        return m_rowsPerBand;
+      }
+
+      /**
+       * @brief Get the probability for a fingerprint to be a candidate.
+       *
+       * This is the expected recall for hits with Tanimoto coefficient
+       * @p T and can be used to choose the number of bands and rows.
+       *
+       * @param T The Tanimoto coefficient.
+       * @param numBands The number of bands (b).
+       * @param rowsPerBand The number of MinHash values per band (r).
+       *
+       * @return The probability 1 - (1 - T^r)^b.
+       */
+      static double candidateProbability(double T, unsigned int numBands, unsigned int rowsPerBand)
+      {
+        return 1.0 - std::pow(1.0 - std::pow(T, static_cast<double>(rowsPerBand)), static_cast<double>(numBands));
+      }
+
+      /**
+       * @brief Get the candidates for a query.
+       *
+       * @param fingerprint The query fingerprint.
+       *
+       * @return The indices of the fingerprints that share at least one band
+       *         key with the query, sorted by index.
+       */
+      std::vector<unsigned int> candidates(const Word *fingerprint) const
+      {
+        std::vector<uint64_t> keys(m_numBands);
+        bandKeys(fingerprint, &keys[0]);
+
+        std::vector<unsigned int> result;
+        for (unsigned int band = 0; band < m_numBands; ++band) {
+          std::pair<std::vector<uint64_t>::const_iterator, std::vector<uint64_t>::const_iterator> range =
+            std::equal_range(m_keys[band].begin(), m_keys[band].end(), keys[band]);
+          result.insert(result.end(), m_indices[band].begin() + (range.first - m_keys[band].begin()),
+              m_indices[band].begin() + (range.second - m_keys[band].begin()));
+        }
+
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+      }
+
+      /**
+       * @brief Approximate search for all fingerprints with a Tanimoto score
+       * above a threshold.
+       *
+       * @param fingerprint The query fingerprint.
+       * @param threshold The minimum Tanimoto score.
+       *
+       * @return The hits as (index, Tanimoto score) pairs sorted by index.
+       */
+      std::vector<std::pair<unsigned int, double> > search(const Word *fingerprint, double threshold) const
+      {
+        TIMER("MinHashIndex::search():");
+        std::vector<unsigned int> cand = candidates(fingerprint);
+
+        // re-rank the candidates using the exact Tanimoto coefficient
+        int queryCount = bitvec_count(fingerprint, m_numWords);
+        const int *bitCounts = m_storage.bitCounts();
+        std::vector<std::pair<unsigned int, double> > result;
+        for (std::size_t i = 0; i < cand.size(); ++i) {
+          double T = bitvec_tanimoto(fingerprint, m_storage.fingerprint(cand[i]), queryCount, bitCounts[cand[i]], m_numWords);
+          if (T >= threshold)
+            result.push_back(std::make_pair(cand[i], T));
+        }
+
+        return result;
+      }
+
+      /**
+       * @brief Approximate k-nearest neighbor search.
+       *
+       * @param fingerprint The query fingerprint.
+       * @param k The number of nearest neighbors to find.
+       * @param threshold The minimum Tanimoto score for the hits.
+       *
+       * @return The (at most) k best hits as (index, Tanimoto score) pairs,
+       *         sorted by descending score (equal scores by ascending index).
+       */
+      std::vector<std::pair<unsigned int, double> > knnSearch(const Word *fingerprint, unsigned int k, double threshold = 0.0) const
+      {
+        TIMER("MinHashIndex::knnSearch():");
+        if (!k)
+          return std::vector<std::pair<unsigned int, double> >();
+
+        std::vector<std::pair<unsigned int, double> > hits = search(fingerprint, threshold);
+        impl::KnnHits collector(threshold, k);
+        for (std::size_t i = 0; i < hits.size(); ++i)
+          collector.add(hits[i].first, hits[i].second);
+        return collector.sorted();
+      }
+
+    private:
+      /**
+       * Compute the band keys for a fingerprint.
+       */
+      void bandKeys(const Word *fingerprint, uint64_t *keys) const
+      {
+        unsigned int numHashes = m_numBands * m_rowsPerBand;
+        std::vector<unsigned int> signature(numHashes, std::numeric_limits<unsigned int>::max());
+
+        // MinHash values: minimum hash value over the 1-bits
+        for (int w = 0; w < m_numWords; ++w) {
+          if (!fingerprint[w])
+            continue;
+          for (int j = 0; j < BitsPerWord; ++j) {
+            unsigned int bit = w * BitsPerWord + j;
+            if (!((fingerprint[w] >> j) & 1) || bit >= m_numBits)
+              continue;
+            const unsigned int *hashes = &m_hashes[static_cast<std::size_t>(bit) * numHashes];
+            for (unsigned int h = 0; h < numHashes; ++h)
+              signature[h] = std::min(signature[h], hashes[h]);
+          }
+        }
+
+        // combine the rows of each band into a single key
+        for (unsigned int band = 0; band < m_numBands; ++band) {
+          uint64_t key = band;
+          for (unsigned int r = 0; r < m_rowsPerBand; ++r) {
+            uint64_t state = key ^ signature[band * m_rowsPerBand + r];
+            key = impl::splitmix64(state);
+          }
+          keys[band] = key;
+        }
+      }
+
+      void computeKeys(std::vector<uint64_t> &keys, std::size_t begin, std::size_t end) const
+      {
+        for (std::size_t i = begin; i < end; ++i)
+          bandKeys(m_storage.fingerprint(i), &keys[i * m_numBands]);
+      }
+
+      void sortBand(const std::vector<uint64_t> &keys, std::size_t band)
+      {
+        unsigned int n = m_storage.numFingerprints();
+        std::vector<std::pair<uint64_t, unsigned int> > entries(n);
+        for (unsigned int i = 0; i < n; ++i)
+          entries[i] = std::make_pair(keys[static_cast<std::size_t>(i) * m_numBands + band], i);
+        std::sort(entries.begin(), entries.end());
+
+        m_keys[band].resize(n);
+        m_indices[band].resize(n);
+        for (unsigned int i = 0; i < n; ++i) {
+          m_keys[band][i] = entries[i].first;
+          m_indices[band][i] = entries[i].second;
+        }
+      }
+
+      const FingerprintStorageType &m_storage; //!< The indexed fingerprints
+      unsigned int m_numBands; //!< The number of bands (b)
+      unsigned int m_rowsPerBand; //!< The number of MinHash values per band (r)
+      unsigned int m_numBits; //!< The number of bits in the fingerprints
+      int m_numWords; //!< The number of words in the fingerprints
+      std::vector<unsigned int> m_hashes; //!< Hash values for each (bit, hash function) pair
+      std::vector<std::vector<uint64_t> > m_keys; //!< Sorted band keys for each band
+      std::vector<std::vector<unsigned int> > m_indices; //!< Fingerprint indices for the sorted band keys
+  };
+
+}
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_METRICS_H
+#define HELIUM_METRICS_H
+
+#include <Helium/bitvec.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace Helium {
+
+  /**
+   * @brief Bit counts for a partially known fingerprint.
+   *
+   * The SimilaritySearchIndex divides the fingerprints in k parts and only
+   * the bit counts of the parts are known while searching the kD-grid. At
+   * some depth, the bit counts of the queried fingerprint (\f$B\f$) are
+   * known for the previous parts, the bin (i.e. bit count) for the current
+   * part is to be selected and the remaining parts are unknown. A metric
+   * uses these bit counts to compute the range of bins that may contain
+   * fingerprints with a score of at least the threshold.
+   */
+  struct PartialBitCounts
+  {
+    int andCount; //!< Sum of min(|A_j|, |B_j|) for the previous parts
+    int orCount; //!< Sum of max(|A_j|, |B_j|) for the previous parts
+    int queryCount; //!< The query bit count (|A|)
+    int knownCount; //!< Sum of |B_j| for the previous parts
+    int current; //!< The query bit count for the current part (|A_i|)
+    int remaining; //!< Sum of |A_j| for the remaining parts
+    int numBins; //!< The largest bin for the current part
+    int numBits; //!< The number of bits in the bit vectors (m)
+  };
+
+  namespace impl {
+
+    /**
+     * Get the best possible score for the fingerprints in @p bin. The best
+     * score is reached when the previous parts overlap as much as possible
+     * and the remaining parts are equal to the query's parts.
+     */
+    template<typename Metric>
+    double optimistic_score(const PartialBitCounts &counts, int bin)
+    {
+      int andCount = counts.andCount + std::min(counts.current, bin) + counts.remaining;
+      int bitCountB = counts.knownCount + bin + counts.remaining;
+      return Metric::score(andCount, counts.queryCount, bitCountB, counts.numBits);
+    }
+
+    /**
+     * Compute the range [lower,upper] of bins that may contain fingerprints
+     * with a score of at least @p threshold for metrics where the best
+     * possible score does not decrease for bins up to |A_i| and does not
+     * increase for bins above |A_i|. The range is found using binary
+     * searches on both sides of |A_i|. The range is empty (lower > upper)
+     * if no bin can contain hits.
+     */
+    template<typename Metric>
+    void unimodal_bin_bounds(double threshold, const PartialBitCounts &counts, int &lower, int &upper)
+    {
+      int peak = std::min(counts.current, counts.numBins);
+      if (!(optimistic_score<Metric>(counts, peak) >= threshold)) {
+        lower = 1;
+        upper = 0;
+        return;
+      }
+
+      // first bin in [0,peak] with a score of at least threshold
+      int lo = 0, hi = peak;
+      while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (optimistic_score<Metric>(counts, mid) >= threshold)
+          hi = mid;
+        else
+          lo = mid + 1;
+      }
+      lower = lo;
+
+      // last bin in [peak,numBins] with a score of at least threshold
+      lo = peak;
+      hi = counts.numBins;
+      while (lo < hi) {
+        int mid = hi - (hi - lo) / 2;
+        if (optimistic_score<Metric>(counts, mid) >= threshold)
+          lo = mid;
+        else
+          hi = mid - 1;
+      }
+      upper = lo;
+    }
+
+  }
+
+  /**
+   * @page similarity_metrics Similarity metrics
+   *
+   * The SimilaritySearchIndex class takes a metric policy as template
+   * parameter. A metric policy is a class with the following static member
+   * functions:
+   *
+   * @code
+   * // The name of the metric (e.g. "tanimoto").
+   * static const char* name();
+   * // The score for two bit vectors, higher scores are more similar and the
+   * // score must not decrease when andCount increases.
+   * static double score(int andCount, int bitCountA, int bitCountB, int numBits);
+   * // The range [lower,upper] of bins that may contain hits (see PartialBitCounts).
+   * static void binBounds(double threshold, const PartialBitCounts &counts, int &lower, int &upper);
+   * @endcode
+   */
+
+  /**
+   * @brief Tanimoto similarity metric.
+   *
+   * \f[
+   *   T_{\mathrm{sim}} = \frac{| A \wedge B |}{|A| + |B| - | A \wedge B |}
+   * \f]
+   */
+  struct TanimotoMetric
+  {
+    static const char* name()
+    {
+      return "tanimoto";
+    }
+
+    static double score(int andCount, int bitCountA, int bitCountB, int)
+    {
+      return static_cast<double>(andCount) / (bitCountA + bitCountB - andCount);
+    }
+
+    static void binBounds(double threshold, const PartialBitCounts &counts, int &lower, int &upper)
+    {
+      const int A_i_min = counts.andCount;
+      const int A_i_max = counts.orCount;
+      const int A_i_last = counts.remaining;
+      const int A_i = counts.current;
+      const int N_i = counts.numBins;
+      lower = std::max(static_cast<int>(std::ceil(threshold * (A_i_max + A_i + A_i_last) - (A_i_min + A_i_last))), 0);
+      upper = threshold == 0.0 ? N_i : static_cast<int>(std::min(std::floor((A_i_min + A_i + A_i_last - threshold * (A_i_max + A_i_last)) / threshold), static_cast<double>(N_i)));
+    }
+  };
+
+  /**
+   * @brief Cosine similarity metric.
+   *
+   * \f[
+   *   C_{\mathrm{sim}} = \frac{| A \wedge B |}{\sqrt{|A| |B|}}
+   * \f]
+   */
+  struct CosineMetric
+  {
+    static const char* name()
+    {
+      return "cosine";
+    }
+
+    static double score(int andCount, int bitCountA, int bitCountB, int)
+    {
+      return static_cast<double>(andCount) / std::sqrt(static_cast<double>(bitCountA) * bitCountB);
+    }
+
+    static void binBounds(double threshold, const PartialBitCounts &counts, int &lower, int &upper)
+    {
+      impl::unimodal_bin_bounds<CosineMetric>(threshold, counts, lower, upper);
+    }
+  };
+
+  /**
+   * @brief Hamming similarity metric.
+   *
+   * The Hamming distance (see bitvec_hamming()) normalized to a similarity
+   * in the range [0,1]:
+   *
+   * \f[
+   *   H_{\mathrm{sim}} = 1 - \frac{|A| + |B| - 2 | A \wedge B |}{m}
+   * \f]
+   */
+  struct HammingMetric
+  {
+    static const char* name()
+    {
+      return "hamming";
+    }
+
+    static double score(int andCount, int bitCountA, int bitCountB, int numBits)
+    {
+      return 1.0 - static_cast<double>(bitCountA + bitCountB - 2 * andCount) / numBits;
+    }
+
+    static void binBounds(double threshold, const PartialBitCounts &counts, int &lower, int &upper)
+    {
+      impl::unimodal_bin_bounds<HammingMetric>(threshold, counts, lower, upper);
+    }
+  };
+
+  /**
+   * @brief Russell-Rao similarity metric.
+   *
+   * \f[
+   *   R_{\mathrm{sim}} = \frac{| A \wedge B |}{m}
+   * \f]
+   */
+  struct RussellRaoMetric
+  {
+    static const char* name()
+    {
+      return "russell-rao";
+    }
+
+    static double score(int andCount, int, int, int numBits)
+    {
+      return static_cast<double>(andCount) / numBits;
+    }
+
+    static void binBounds(double threshold, const PartialBitCounts &counts, int &lower, int &upper)
+    {
+      impl::unimodal_bin_bounds<RussellRaoMetric>(threshold, counts, lower, upper);
+    }
+  };
+
+  /**
+   * @brief Forbes similarity metric.
+   *
+   * \f[
+   *   F_{\mathrm{sim}} = \frac{| A \wedge B | m}{|A| |B|}
+   * \f]
+   */
+  struct ForbesMetric
+  {
+    static const char* name()
+    {
+      return "forbes";
+    }
+
+    static double score(int andCount, int bitCountA, int bitCountB, int numBits)
+    {
+      return static_cast<double>(andCount) * numBits / (static_cast<double>(bitCountA) * bitCountB);
+    }
+
+    static void binBounds(double threshold, const PartialBitCounts &counts, int &lower, int &upper)
+    {
+      impl::unimodal_bin_bounds<ForbesMetric>(threshold, counts, lower, upper);
+    }
+  };
+
+}
+
+#endif
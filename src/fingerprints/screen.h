@@ -0,0 +1,766 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_SCREEN_H
+#define HELIUM_SCREEN_H
+
+#include <Helium/bitvec.h>
+#include <Helium/util.h>
+#include <Helium/roaring.h>
+#include <Helium/fileio/fingerprints.h>
+
+#ifdef HAVE_CPP11
+#include <Helium/threadpool.h>
+#endif
+
+#include <vector>
+#include <algorithm>
+
+namespace Helium {
+
+  /**
+   * @brief Additional bitmap to intersect with the columns when screening.
+   *
+   * Screen operands are uncompressed bitmaps with a bit for each fingerprint
+   * (e.g. the property filters from PropertyFilterIndex). They are
+   * intersected together with the columns for the query bits, the count is
+   * used to order the operands by selectivity.
+   */
+  struct ScreenOperand
+  {
+    ScreenOperand(const Word *bitmap_ = 0, unsigned int count_ = 0) : bitmap(bitmap_), count(count_)
+    {
+    }
+
+    const Word *bitmap; //!< The bitmap
+    unsigned int count; //!< The number of set bits in the bitmap
+  };
+
+  namespace impl {
+
+    /**
+     * Functor to order bits by increasing column count.
+     */
+    template<typename ColumnMajorFingerprintStorageType>
+    struct RarestColumnFirst
+    {
+      RarestColumnFirst(const ColumnMajorFingerprintStorageType &storage_) : storage(storage_)
+      {
+      }
+
+      bool operator()(unsigned int bit1, unsigned int bit2) const
+      {
+        return storage.columnCount(bit1) < storage.columnCount(bit2);
+      }
+
+      const ColumnMajorFingerprintStorageType &storage;
+    };
+
+    /**
+     * Functor to order screen operands by increasing count.
+     */
+    struct RarestOperandFirst
+    {
+      bool operator()(const ScreenOperand &operand1, const ScreenOperand &operand2) const
+      {
+        return operand1.count < operand2.count;
+      }
+    };
+
+    /**
+     * Get the indices of the set bits in the query fingerprint. The bits are
+     * ordered by selectivity (i.e. the bit that is set in the fewest
+     * fingerprints comes first) so the intersection shrinks as fast as
+     * possible.
+     */
+    template<typename ColumnMajorFingerprintStorageType>
+    std::vector<unsigned int> screen_query_bits(const ColumnMajorFingerprintStorageType &storage, const Word *query)
+    {
+      std::vector<unsigned int> bits;
+      for (unsigned int i = 0; i < storage.numBits(); ++i)
+        if (bitvec_get(i, query))
+          bits.push_back(i);
+      std::stable_sort(bits.begin(), bits.end(), RarestColumnFirst<ColumnMajorFingerprintStorageType>(storage));
+      return bits;
+    }
+
+    /**
+     * Get the columns for the set query bits and the additional operands,
+     * ordered by selectivity.
+     */
+    template<typename ColumnMajorFingerprintStorageType>
+    std::vector<ScreenOperand> screen_columns(const ColumnMajorFingerprintStorageType &storage, const Word *query,
+        const std::vector<ScreenOperand> &operands)
+    {
+      std::vector<ScreenOperand> columns(operands);
+      for (unsigned int i = 0; i < storage.numBits(); ++i)
+        if (bitvec_get(i, query))
+          columns.push_back(ScreenOperand(storage.bit(i), storage.columnCount(i)));
+      std::stable_sort(columns.begin(), columns.end(), RarestOperandFirst());
+      return columns;
+    }
+
+    /**
+     * Screen the result words [begin,end). The columns are intersected one
+     * block of words at a time so the partial result stays in cache while
+     * the columns for all query bits are streamed through it. A block is
+     * abandoned as soon as it contains no more candidates, with the columns
+     * ordered by screen_columns() this usually happens after a few columns
+     * for selective queries.
+     */
+    inline void substructure_screen_range(unsigned int numFingerprints, const std::vector<ScreenOperand> &columns,
+        Word *result, unsigned int begin, unsigned int end)
+    {
+      const unsigned int blockSize = 2048;
+      unsigned int numWords = bitvec_num_words_for_bits(numFingerprints);
+      HELIUM_COUNT(FingerprintsScreened, std::min<unsigned int>(end * BitsPerWord, numFingerprints) -
+          std::min<unsigned int>(begin * BitsPerWord, numFingerprints));
+
+      for (unsigned int block = begin; block < end; block += blockSize) {
+        unsigned int blockEnd = std::min(end, block + blockSize);
+        if (columns.empty()) {
+          // all fingerprints are candidates
+          std::fill(result + block, result + blockEnd, ~Word(0));
+        } else {
+          const Word *column = columns[0].bitmap;
+          Word any = 0;
+          for (unsigned int j = block; j < blockEnd; ++j)
+            any |= result[j] = column[j];
+          for (std::size_t i = 1; i < columns.size() && any; ++i) {
+            column = columns[i].bitmap;
+            any = 0;
+            for (unsigned int j = block; j < blockEnd; ++j)
+              any |= result[j] &= column[j];
+          }
+        }
+        // clear the padding bits in the last word
+        if (blockEnd == numWords && numFingerprints % BitsPerWord)
+          result[numWords - 1] &= (Word(1) << (numFingerprints % BitsPerWord)) - 1;
+      }
+    }
+
+    /**
+     * Screen the compressed containers with keys [begin,end). For each key,
+     * the container of the rarest column is intersected with the containers
+     * of the other columns until the intersection is empty. Since the rarest
+     * column comes first, the intersections are usually done on small array
+     * containers. The (uncompressed) operands are intersected with the
+     * result for each key that has candidates.
+     */
+    template<typename CompressedColumnMajorFingerprintStorageType>
+    void compressed_substructure_screen_range(const CompressedColumnMajorFingerprintStorageType &storage,
+        const std::vector<unsigned int> &bits, const std::vector<ScreenOperand> &operands, Word *result,
+        unsigned int begin, unsigned int end)
+    {
+      unsigned int numWords = bitvec_num_words_for_bits(storage.numFingerprints());
+      RoaringBitmap::Container intersection, tmp;
+      HELIUM_COUNT(FingerprintsScreened,
+          std::min<unsigned int>(end * RoaringBitmap::ContainerWords * BitsPerWord, storage.numFingerprints()) -
+          std::min<unsigned int>(begin * RoaringBitmap::ContainerWords * BitsPerWord, storage.numFingerprints()));
+
+      for (unsigned int key = begin; key < end; ++key) {
+        Word *words = result + key * RoaringBitmap::ContainerWords;
+        unsigned int offset = key * RoaringBitmap::ContainerWords;
+        unsigned int blockWords = std::min<unsigned int>(RoaringBitmap::ContainerWords, numWords - offset);
+
+        if (bits.empty()) {
+          // all fingerprints are candidates
+          std::fill(words, words + blockWords, ~Word(0));
+        } else {
+          bitvec_zero(words, blockWords);
+          const RoaringBitmap::Container *container = storage.column(bits[0]).findContainer(key);
+          for (std::size_t i = 1; i < bits.size() && container; ++i) {
+            const RoaringBitmap::Container *other = storage.column(bits[i]).findContainer(key);
+            if (!other) {
+              container = 0;
+              break;
+            }
+            roaring_intersect(*container, *other, tmp);
+            intersection.swap(tmp);
+            container = intersection.cardinality ? &intersection : 0;
+          }
+          if (!container)
+            continue;
+          roaring_container_to_bitvec(*container, words, blockWords);
+        }
+
+        for (std::size_t i = 0; i < operands.size(); ++i)
+          for (unsigned int j = 0; j < blockWords; ++j)
+            words[j] &= operands[i].bitmap[offset + j];
+      }
+
+      // clear the padding bits in the last word
+      if (end * RoaringBitmap::ContainerWords >= numWords && storage.numFingerprints() % BitsPerWord)
+        result[numWords - 1] &= (Word(1) << (storage.numFingerprints() % BitsPerWord)) - 1;
+    }
+
+    /**
+     * Get the number of containers needed for the fingerprints.
+     */
+    inline unsigned int compressed_screen_num_keys(unsigned int numFingerprints)
+    {
+      return (numFingerprints + RoaringBitmap::ContainerBits - 1) / RoaringBitmap::ContainerBits;
+    }
+
+    /**
+     * Check if one of the screen operands has no set bits.
+     */
+    inline bool has_empty_operand(const std::vector<ScreenOperand> &operands)
+    {
+      for (std::size_t i = 0; i < operands.size(); ++i)
+        if (!operands[i].count)
+          return true;
+      return false;
+    }
+
+    /**
+     * The distinct columns and operands of a batch of queries (see
+     * substructure_screen_batch()). Each bitmap is listed once with the
+     * queries that need it, the bitmaps are ordered by selectivity.
+     */
+    struct ScreenBatch
+    {
+      std::vector<ScreenOperand> bitmaps; //!< The distinct bitmaps
+      std::vector<std::vector<unsigned int> > users; //!< The queries that need each bitmap
+      unsigned int numQueries;
+    };
+
+    /**
+     * Functor to order the bitmaps of a ScreenBatch by increasing count.
+     */
+    struct RarestBatchBitmapFirst
+    {
+      RarestBatchBitmapFirst(const std::vector<ScreenOperand> &bitmaps_) : bitmaps(bitmaps_)
+      {
+      }
+
+      bool operator()(unsigned int i, unsigned int j) const
+      {
+        return bitmaps[i].count < bitmaps[j].count;
+      }
+
+      const std::vector<ScreenOperand> &bitmaps;
+    };
+
+    /**
+     * Collect the distinct columns for the set query bits and the distinct
+     * operands (by bitmap) of all queries.
+     */
+    template<typename ColumnMajorFingerprintStorageType>
+    ScreenBatch screen_batch(const ColumnMajorFingerprintStorageType &storage, const std::vector<const Word*> &queries,
+        const std::vector<std::vector<ScreenOperand> > &operands)
+    {
+      std::vector<ScreenOperand> bitmaps;
+      std::vector<std::vector<unsigned int> > users;
+
+      // the columns are indexed by bit, shared query bits are only listed once
+      std::vector<int> columnIndex(storage.numBits(), -1);
+      for (std::size_t q = 0; q < queries.size(); ++q)
+        for (unsigned int i = 0; i < storage.numBits(); ++i) {
+          if (!bitvec_get(i, queries[q]))
+            continue;
+          if (columnIndex[i] < 0) {
+            columnIndex[i] = bitmaps.size();
+            bitmaps.push_back(ScreenOperand(storage.bit(i), storage.columnCount(i)));
+            users.resize(bitmaps.size());
+          }
+          users[columnIndex[i]].push_back(q);
+        }
+
+      // the operands (e.g. property filters) are shared if they use the same bitmap
+      for (std::size_t q = 0; q < operands.size(); ++q)
+        for (std::size_t i = 0; i < operands[q].size(); ++i) {
+          std::size_t j = 0;
+          while (j < bitmaps.size() && bitmaps[j].bitmap != operands[q][i].bitmap)
+            ++j;
+          if (j == bitmaps.size()) {
+            bitmaps.push_back(operands[q][i]);
+            users.resize(bitmaps.size());
+          }
+          if (users[j].empty() || users[j].back() != q)
+            users[j].push_back(q);
+        }
+
+      std::vector<unsigned int> order(bitmaps.size());
+      for (std::size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+      std::stable_sort(order.begin(), order.end(), RarestBatchBitmapFirst(bitmaps));
+
+      ScreenBatch batch;
+      batch.numQueries = queries.size();
+      for (std::size_t i = 0; i < order.size(); ++i) {
+        batch.bitmaps.push_back(bitmaps[order[i]]);
+        batch.users.push_back(std::vector<unsigned int>());
+        batch.users.back().swap(users[order[i]]);
+      }
+      return batch;
+    }
+
+    /**
+     * Get the number of words in a block for screening a batch of queries:
+     * the result blocks for all queries should fit in the L2 cache.
+     */
+    inline unsigned int screen_batch_block_size(unsigned int numQueries)
+    {
+      return std::max(64u, std::min(2048u, 32768u / std::max(1u, numQueries)));
+    }
+
+    /**
+     * Screen the result words [begin,end) for a batch of queries. For each
+     * block of words, the distinct bitmaps are read once and intersected
+     * with the result blocks of every query that needs them. Like
+     * substructure_screen_range(), a query's block is abandoned as soon as
+     * it contains no more candidates.
+     */
+    inline void substructure_screen_batch_range(unsigned int numFingerprints, const ScreenBatch &batch,
+        const std::vector<Word*> &results, unsigned int begin, unsigned int end)
+    {
+      const unsigned int blockSize = screen_batch_block_size(batch.numQueries);
+      unsigned int numWords = bitvec_num_words_for_bits(numFingerprints);
+      HELIUM_COUNT(FingerprintsScreened, batch.numQueries * (std::min<unsigned int>(end * BitsPerWord, numFingerprints) -
+          std::min<unsigned int>(begin * BitsPerWord, numFingerprints)));
+
+      // 0 = not initialized, 1 = has candidates, 2 = empty
+      std::vector<unsigned char> state(batch.numQueries);
+      for (unsigned int block = begin; block < end; block += blockSize) {
+        unsigned int blockEnd = std::min(end, block + blockSize);
+        std::fill(state.begin(), state.end(), 0);
+
+        for (std::size_t i = 0; i < batch.bitmaps.size(); ++i) {
+          const Word *bitmap = batch.bitmaps[i].bitmap;
+          const std::vector<unsigned int> &users = batch.users[i];
+          for (std::size_t u = 0; u < users.size(); ++u) {
+            unsigned int q = users[u];
+            if (state[q] == 2)
+              continue;
+            Word *result = results[q];
+            Word any = 0;
+            if (state[q])
+              for (unsigned int j = block; j < blockEnd; ++j)
+                any |= result[j] &= bitmap[j];
+            else
+              for (unsigned int j = block; j < blockEnd; ++j)
+                any |= result[j] = bitmap[j];
+            state[q] = any ? 1 : 2;
+          }
+        }
+
+        for (unsigned int q = 0; q < batch.numQueries; ++q) {
+          // all fingerprints are candidates for queries without bits
+          if (!state[q])
+            std::fill(results[q] + block, results[q] + blockEnd, ~Word(0));
+          // clear the padding bits in the last word
+          if (blockEnd == numWords && numFingerprints % BitsPerWord)
+            results[q][numWords - 1] &= (Word(1) << (numFingerprints % BitsPerWord)) - 1;
+        }
+      }
+    }
+
+  }
+
+  /**
+   * @brief Substructure screening using column-major fingerprints.
+   *
+   * A fingerprint can only contain the query as a substructure if all bits
+   * that are set in the query fingerprint are also set in the fingerprint.
+   * The candidates are found by intersecting the columns (see
+   * ColumnMajorFingerprintStorageConcept) for the set query bits. The rarest
+   * columns are intersected first and the bitmap is processed in blocks that
+   * are abandoned as soon as they are empty. The resulting bitmap has a bit
+   * for each fingerprint, a query without set bits matches all fingerprints.
+   *
+   * @param storage The column-major fingerprint storage.
+   * @param query The query fingerprint.
+   * @param operands Additional bitmaps to intersect (e.g. property filters).
+   * @param result The candidate bitmap, this must have room for
+   *        bitvec_num_words_for_bits(storage.numFingerprints()) words.
+   */
+  template<typename ColumnMajorFingerprintStorageType>
+  void substructure_screen(const ColumnMajorFingerprintStorageType &storage, const Word *query,
+      const std::vector<ScreenOperand> &operands, Word *result)
+  {
+    TIMER("substructure_screen():");
+    std::vector<ScreenOperand> columns = impl::screen_columns(storage, query, operands);
+    unsigned int numWords = bitvec_num_words_for_bits(storage.numFingerprints());
+    // the query can not match if one of its bits is never set
+    if (!columns.empty() && !columns[0].count) {
+      bitvec_zero(result, numWords);
+      return;
+    }
+    impl::substructure_screen_range(storage.numFingerprints(), columns, result, 0, numWords);
+  }
+
+  /**
+   * @overload
+   */
+  template<typename ColumnMajorFingerprintStorageType>
+  void substructure_screen(const ColumnMajorFingerprintStorageType &storage, const Word *query, Word *result)
+  {
+    substructure_screen(storage, query, std::vector<ScreenOperand>(), result);
+  }
+
+#ifdef HAVE_CPP11
+  /**
+   * @brief Threaded substructure screening using column-major fingerprints.
+   *
+   * The words of the candidate bitmap are divided in chunks that are
+   * screened by the threads of the thread pool. The result is the same as
+   * for substructure_screen().
+   *
+   * @note This function is only available when C++11 support is enabled.
+   *
+   * @param storage The column-major fingerprint storage.
+   * @param query The query fingerprint.
+   * @param operands Additional bitmaps to intersect (e.g. property filters).
+   * @param result The candidate bitmap, this must have room for
+   *        bitvec_num_words_for_bits(storage.numFingerprints()) words.
+   * @param pool The thread pool to use.
+   */
+  template<typename ColumnMajorFingerprintStorageType>
+  void substructure_screen_threaded(const ColumnMajorFingerprintStorageType &storage, const Word *query,
+      const std::vector<ScreenOperand> &operands, Word *result, ThreadPool &pool = ThreadPool::global())
+  {
+    TIMER("substructure_screen_threaded():");
+    std::vector<ScreenOperand> columns = impl::screen_columns(storage, query, operands);
+    unsigned int numWords = bitvec_num_words_for_bits(storage.numFingerprints());
+    if (!columns.empty() && !columns[0].count) {
+      bitvec_zero(result, numWords);
+      return;
+    }
+    unsigned int numFingerprints = storage.numFingerprints();
+    pool.parallelFor(numWords, 8192, [&] (std::size_t begin, std::size_t end) {
+      impl::substructure_screen_range(numFingerprints, columns, result, begin, end);
+    });
+  }
+
+  /**
+   * @overload
+   */
+  template<typename ColumnMajorFingerprintStorageType>
+  void substructure_screen_threaded(const ColumnMajorFingerprintStorageType &storage, const Word *query,
+      Word *result, ThreadPool &pool = ThreadPool::global())
+  {
+    substructure_screen_threaded(storage, query, std::vector<ScreenOperand>(), result, pool);
+  }
+#endif
+
+  /**
+   * @brief Substructure screening using compressed column-major fingerprints.
+   *
+   * This overload intersects the compressed columns directly (see
+   * InMemoryCompressedColumnMajorFingerprintStorage), the work for sparse
+   * columns is proportional to the number of set bits. The result is the
+   * same as for the uncompressed column-major storages.
+   *
+   * @param storage The compressed column-major fingerprint storage.
+   * @param query The query fingerprint.
+   * @param operands Additional bitmaps to intersect (e.g. property filters).
+   * @param result The candidate bitmap, this must have room for
+   *        bitvec_num_words_for_bits(storage.numFingerprints()) words.
+   */
+  inline void substructure_screen(const InMemoryCompressedColumnMajorFingerprintStorage &storage,
+      const Word *query, const std::vector<ScreenOperand> &operands, Word *result)
+  {
+    TIMER("substructure_screen():");
+    std::vector<unsigned int> bits = impl::screen_query_bits(storage, query);
+    unsigned int numWords = bitvec_num_words_for_bits(storage.numFingerprints());
+    if ((!bits.empty() && !storage.columnCount(bits[0])) || impl::has_empty_operand(operands)) {
+      bitvec_zero(result, numWords);
+      return;
+    }
+    impl::compressed_substructure_screen_range(storage, bits, operands, result, 0,
+        impl::compressed_screen_num_keys(storage.numFingerprints()));
+  }
+
+  /**
+   * @overload
+   */
+  inline void substructure_screen(const InMemoryCompressedColumnMajorFingerprintStorage &storage,
+      const Word *query, Word *result)
+  {
+    substructure_screen(storage, query, std::vector<ScreenOperand>(), result);
+  }
+
+#ifdef HAVE_CPP11
+  /**
+   * @brief Threaded substructure screening using compressed column-major fingerprints.
+   *
+   * The containers (i.e. blocks of RoaringBitmap::ContainerBits fingerprints)
+   * are screened by the threads of the thread pool.
+   *
+   * @note This function is only available when C++11 support is enabled.
+   *
+   * @param storage The compressed column-major fingerprint storage.
+   * @param query The query fingerprint.
+   * @param operands Additional bitmaps to intersect (e.g. property filters).
+   * @param result The candidate bitmap, this must have room for
+   *        bitvec_num_words_for_bits(storage.numFingerprints()) words.
+   * @param pool The thread pool to use.
+   */
+  inline void substructure_screen_threaded(const InMemoryCompressedColumnMajorFingerprintStorage &storage,
+      const Word *query, const std::vector<ScreenOperand> &operands, Word *result,
+      ThreadPool &pool = ThreadPool::global())
+  {
+    TIMER("substructure_screen_threaded():");
+    std::vector<unsigned int> bits = impl::screen_query_bits(storage, query);
+    unsigned int numWords = bitvec_num_words_for_bits(storage.numFingerprints());
+    if ((!bits.empty() && !storage.columnCount(bits[0])) || impl::has_empty_operand(operands)) {
+      bitvec_zero(result, numWords);
+      return;
+    }
+    pool.parallelFor(impl::compressed_screen_num_keys(storage.numFingerprints()), 1,
+        [&] (std::size_t begin, std::size_t end) {
+      impl::compressed_substructure_screen_range(storage, bits, operands, result, begin, end);
+    });
+  }
+
+  /**
+   * @overload
+   */
+  inline void substructure_screen_threaded(const InMemoryCompressedColumnMajorFingerprintStorage &storage,
+      const Word *query, Word *result, ThreadPool &pool = ThreadPool::global())
+  {
+    substructure_screen_threaded(storage, query, std::vector<ScreenOperand>(), result, pool);
+  }
+#endif
+
+  /**
+   * @brief Screen a batch of queries in one pass over the columns.
+   *
+   * The result for each query is the same as for substructure_screen() but
+   * the query bits (and operands) shared by several queries are only
+   * listed once. The candidate bitmaps are computed one block of words at a
+   * time: each distinct column block is read from memory once and applied
+   * to every query that needs it while the result blocks stay in cache.
+   * This is much faster than screening the queries one at a time when
+   * there are many queries (e.g. hundreds of substructure queries in a SAR
+   * workflow).
+   *
+   * @param storage The column-major fingerprint storage.
+   * @param queries The query fingerprints.
+   * @param operands Additional bitmaps to intersect for each query (e.g. the
+   *        property filters), empty or one list for each query.
+   * @param results The candidate bitmap for each query, these must have room
+   *        for bitvec_num_words_for_bits(storage.numFingerprints()) words.
+   */
+  template<typename ColumnMajorFingerprintStorageType>
+  void substructure_screen_batch(const ColumnMajorFingerprintStorageType &storage,
+      const std::vector<const Word*> &queries, const std::vector<std::vector<ScreenOperand> > &operands,
+      const std::vector<Word*> &results)
+  {
+    TIMER("substructure_screen_batch():");
+    PRE(operands.empty() || operands.size() == queries.size());
+    PRE(results.size() == queries.size());
+    impl::ScreenBatch batch = impl::screen_batch(storage, queries, operands);
+    impl::substructure_screen_batch_range(storage.numFingerprints(), batch, results, 0,
+        bitvec_num_words_for_bits(storage.numFingerprints()));
+  }
+
+  /**
+   * @overload
+   */
+  template<typename ColumnMajorFingerprintStorageType>
+  void substructure_screen_batch(const ColumnMajorFingerprintStorageType &storage,
+      const std::vector<const Word*> &queries, const std::vector<Word*> &results)
+  {
+    substructure_screen_batch(storage, queries, std::vector<std::vector<ScreenOperand> >(), results);
+  }
+
+#ifdef HAVE_CPP11
+  /**
+   * @brief Threaded batch screening using column-major fingerprints.
+   *
+   * The blocks of the candidate bitmaps are divided over the threads of the
+   * thread pool. The results are the same as for
+   * substructure_screen_batch().
+   *
+   * @note This function is only available when C++11 support is enabled.
+   */
+  template<typename ColumnMajorFingerprintStorageType>
+  void substructure_screen_batch_threaded(const ColumnMajorFingerprintStorageType &storage,
+      const std::vector<const Word*> &queries, const std::vector<std::vector<ScreenOperand> > &operands,
+      const std::vector<Word*> &results, ThreadPool &pool = ThreadPool::global())
+  {
+    TIMER("substructure_screen_batch_threaded():");
+    PRE(operands.empty() || operands.size() == queries.size());
+    PRE(results.size() == queries.size());
+    impl::ScreenBatch batch = impl::screen_batch(storage, queries, operands);
+    unsigned int numFingerprints = storage.numFingerprints();
+    // the chunks are a multiple of the block size
+    unsigned int blockSize = impl::screen_batch_block_size(queries.size());
+    unsigned int numBlocks = (bitvec_num_words_for_bits(numFingerprints) + blockSize - 1) / blockSize;
+    pool.parallelFor(numBlocks, 1, [&] (std::size_t begin, std::size_t end) {
+      impl::substructure_screen_batch_range(numFingerprints, batch, results, begin * blockSize,
+          std::min<std::size_t>(end * blockSize, bitvec_num_words_for_bits(numFingerprints)));
+    });
+  }
+#endif
+
+  /**
+   * @brief Substructure screening one block of the candidate bitmap at a time.
+   *
+   * The columns for the query are selected once by the constructor, each
+   * call to screen() then screens a block of blockWords() words. This
+   * allows the candidates in the first blocks to be processed (e.g. see
+   * substructure_search_pipelined()) while the remaining blocks are still
+   * being screened. Screening all blocks gives the same result as
+   * substructure_screen().
+   */
+  template<typename ColumnMajorFingerprintStorageType>
+  class SubstructureScreen
+  {
+    public:
+      /**
+       * Constructor.
+       *
+       * @param storage The column-major fingerprint storage.
+       * @param query The query fingerprint.
+       * @param operands Additional bitmaps to intersect (e.g. property filters).
+       */
+      SubstructureScreen(const ColumnMajorFingerprintStorageType &storage, const Word *query,
+          const std::vector<ScreenOperand> &operands = std::vector<ScreenOperand>())
+        : m_numFingerprints(storage.numFingerprints()), m_columns(impl::screen_columns(storage, query, operands))
+      {
+      }
+
+      /**
+       * Get the number of fingerprints.
+       */
+      unsigned int numFingerprints() const
+      {
+        return m_numFingerprints;
+      }
+
+      /**
+       * Get the number of words in a block.
+       */
+      unsigned int blockWords() const
+      {
+        return 2048;
+      }
+
+      /**
+       * Check if the query can not match any fingerprint (i.e. one of its
+       * bits is never set).
+       */
+      bool empty() const
+      {
+        return !m_columns.empty() && !m_columns[0].count;
+      }
+
+      /**
+       * Screen the result words [begin,end), @p begin must be a multiple of
+       * blockWords().
+       */
+      void screen(Word *result, unsigned int begin, unsigned int end) const
+      {
+        impl::substructure_screen_range(m_numFingerprints, m_columns, result, begin, end);
+      }
+
+    private:
+      unsigned int m_numFingerprints;
+      std::vector<ScreenOperand> m_columns;
+  };
+
+  /**
+   * @brief Substructure screening one block at a time using compressed
+   *        column-major fingerprints.
+   *
+   * A block contains the words for one RoaringBitmap container.
+   */
+  template<>
+  class SubstructureScreen<InMemoryCompressedColumnMajorFingerprintStorage>
+  {
+    public:
+      SubstructureScreen(const InMemoryCompressedColumnMajorFingerprintStorage &storage, const Word *query,
+          const std::vector<ScreenOperand> &operands = std::vector<ScreenOperand>())
+        : m_storage(storage), m_bits(impl::screen_query_bits(storage, query)), m_operands(operands)
+      {
+      }
+
+      unsigned int numFingerprints() const
+      {
+        return m_storage.numFingerprints();
+      }
+
+      unsigned int blockWords() const
+      {
+        return RoaringBitmap::ContainerWords;
+      }
+
+      bool empty() const
+      {
+        return (!m_bits.empty() && !m_storage.columnCount(m_bits[0])) || impl::has_empty_operand(m_operands);
+      }
+
+      void screen(Word *result, unsigned int begin, unsigned int end) const
+      {
+        unsigned int endKey = (end + RoaringBitmap::ContainerWords - 1) / RoaringBitmap::ContainerWords;
+        impl::compressed_substructure_screen_range(m_storage, m_bits, m_operands, result,
+            begin / RoaringBitmap::ContainerWords, endKey);
+      }
+
+    private:
+      const InMemoryCompressedColumnMajorFingerprintStorage &m_storage;
+      std::vector<unsigned int> m_bits;
+      std::vector<ScreenOperand> m_operands;
+  };
+
+  /**
+   * @brief Get the indices of the candidates in a candidate bitmap.
+   *
+   * @param candidates The candidate bitmap (see substructure_screen()).
+   * @param numFingerprints The number of fingerprints.
+   *
+   * @return The sorted candidate indices.
+   */
+  inline std::vector<unsigned int> screen_candidates(const Word *candidates, unsigned int numFingerprints)
+  {
+    std::vector<unsigned int> indices;
+    unsigned int numWords = bitvec_num_words_for_bits(numFingerprints);
+    for (unsigned int i = 0; i < numWords; ++i)
+      for (Word word = candidates[i]; word; word &= word - 1)
+        indices.push_back(i * BitsPerWord + __builtin_ctzll(word));
+    return indices;
+  }
+
+  /**
+   * @overload
+   *
+   * Only the candidates in the words [begin,end) are returned.
+   */
+  inline std::vector<unsigned int> screen_candidates(const Word *candidates, unsigned int begin, unsigned int end)
+  {
+    std::vector<unsigned int> indices;
+    for (unsigned int i = begin; i < end; ++i)
+      for (Word word = candidates[i]; word; word &= word - 1)
+        indices.push_back(i * BitsPerWord + __builtin_ctzll(word));
+    return indices;
+  }
+
+}
+
+#endif
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_SHARDS_H
+#define HELIUM_SHARDS_H
+
+#include <Helium/fingerprints/similarity.h>
+#include <Helium/fileio/fingerprints.h>
+
+#include <json/json.h>
+
+#include <fstream>
+#include <sstream>
+
+namespace Helium {
+
+  /**
+   * @brief Similarity search over a fingerprint library split in shards.
+   *
+   * The shards are listed in a manifest file (see readManifest()). A shard
+   * is either a row-major fingerprint file or a similarity index file
+   * created using SimilaritySearchIndex::save(). There is one frozen
+   * SimilaritySearchIndex for each shard. The fingerprints are numbered
+   * globally: the fingerprints in shard i are numbered starting at offset(i),
+   * the total number of fingerprints in the previous shards. The results are
+   * the same as searching a single storage containing all shards in order.
+   *
+   * When the index is constructed with more than one thread and C++11
+   * support is enabled, the shards are searched concurrently using the
+   * global ThreadPool.
+   *
+   * @code
+   * ShardedSimilaritySearchIndex<> index(ShardedSimilaritySearchIndex<>::readManifest("library.json"));
+   * std::vector<std::pair<unsigned int, double> > hits = index.knnSearch(query, 10, 0.7);
+   * @endcode
+   */
+  template<typename Metric = TanimotoMetric>
+  class ShardedSimilaritySearchIndex
+  {
+    public:
+      typedef SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage, Metric> IndexType;
+
+      /**
+       * @brief Read a shard manifest file.
+       *
+       * The manifest is a JSON file with a "shards" array containing the
+       * shard filenames. Relative filenames are relative to the directory
+       * containing the manifest.
+       *
+       * @code
+       * { "filetype": "similarity-shards", "shards": [ "part1.fpi", "part2.fpi" ] }
+       * @endcode
+       *
+       * @param filename The manifest filename.
+       *
+       * @return The shard filenames.
+       */
+      static std::vector<std::string> readManifest(const std::string &filename)
+      {
+        std::ifstream ifs(filename.c_str());
+        if (!ifs)
+          throw std::runtime_error(make_string("Could not open shard manifest file \"", filename, "\""));
+        std::stringstream ss;
+        ss << ifs.rdbuf();
+
+        Json::Reader reader;
+        Json::Value data;
+        if (!reader.parse(ss.str(), data))
+          throw std::runtime_error(reader.getFormattedErrorMessages());
+        if (!data.isObject() || data["filetype"].asString() != "similarity-shards")
+          throw std::runtime_error(make_string("Shard manifest file ", filename, " does not contain 'filetype' attribute or is not 'similarity-shards'"));
+        if (!data["shards"].isArray() || !data["shards"].size())
+          throw std::runtime_error(make_string("Shard manifest file ", filename, " does not contain a valid 'shards' attribute"));
+
+        std::string dir;
+        std::size_t slash = filename.rfind('/');
+        if (slash != std::string::npos)
+          dir = filename.substr(0, slash + 1);
+
+        std::vector<std::string> shards;
+        for (Json::ArrayIndex i = 0; i < data["shards"].size(); ++i) {
+          std::string shard = data["shards"][i].asString();
+          shards.push_back(shard.size() && shard[0] == '/' ? shard : dir + shard);
+        }
+        return shards;
+      }
+
+      /**
+       * @brief Check if a file is a shard manifest file.
+       */
+      static bool isManifest(const std::string &filename)
+      {
+        try {
+          readManifest(filename);
+          return true;
+        } catch (const std::exception &e) {
+          return false;
+        }
+      }
+
+      /**
+       * @brief Constructor.
+       *
+       * Load all shards. For fingerprint files, the index is built and the
+       * fingerprints are only kept in the (frozen) index.
+       *
+       * @param shards The shard filenames (see readManifest()).
+       * @param k The dimension of the kD-grid for shards that are
+       *        fingerprint files.
+       * @param numThreads The number of threads used to build the indexes
+       *        (0 for all threads in the global ThreadPool). The shards are
+       *        searched concurrently if this is not 1.
+       */
+      ShardedSimilaritySearchIndex(const std::vector<std::string> &shards, int k = 3,
+          unsigned int numThreads = 1) : m_numBits(0), m_parallel(numThreads != 1)
+      {
+        PRE(shards.size());
+        m_offsets.push_back(0);
+        try {
+          for (std::size_t i = 0; i < shards.size(); ++i) {
+            m_shards.push_back(loadShard(shards[i], k, numThreads));
+            if (!i)
+              m_numBits = m_shards[0]->numBits();
+            else if (m_shards[i]->numBits() != m_numBits)
+              throw std::runtime_error(make_string("Shard ", shards[i], " has ", m_shards[i]->numBits(),
+                    " bits, expected ", m_numBits, " bits"));
+            m_offsets.push_back(m_offsets.back() + m_shards[i]->numFingerprints());
+          }
+        } catch (...) {
+          for (std::size_t i = 0; i < m_shards.size(); ++i)
+            delete m_shards[i];
+          throw;
+        }
+      }
+
+      /**
+       * @brief Destructor.
+       */
+      ~ShardedSimilaritySearchIndex()
+      {
+        for (std::size_t i = 0; i < m_shards.size(); ++i)
+          delete m_shards[i];
+      }
+
+      /**
+       * Get the JSON header of the first shard.
+       */
+      std::string header() const
+      {
+        return m_shards[0]->header();
+      }
+
+      /**
+       * Get the number of bits in the fingerprints.
+       */
+      unsigned int numBits() const
+      {
+        return m_numBits;
+      }
+
+      /**
+       * Get the number of shards.
+       */
+      std::size_t numShards() const
+      {
+        return m_shards.size();
+      }
+
+      /**
+       * Get the total number of fingerprints in all shards.
+       */
+      unsigned int numFingerprints() const
+      {
+        return m_offsets.back();
+      }
+
+      /**
+       * Get the global index of the first fingerprint in a shard.
+       */
+      unsigned int offset(std::size_t shard) const
+      {
+        return m_offsets[shard];
+      }
+
+      /**
+       * Get the index for a shard.
+       */
+      const IndexType& shard(std::size_t shard) const
+      {
+        return *m_shards[shard];
+      }
+
+      /**
+       * @brief Search all shards for fingerprints with a score above a
+       * threshold.
+       *
+       * @param fingerprint The query fingerprint.
+       * @param threshold The minimum score.
+       *
+       * @return The hits as (global index, score) pairs, the hits for
+       *         earlier shards are first.
+       */
+      std::vector<std::pair<unsigned int, double> > search(const Word *fingerprint, double threshold) const
+      {
+        std::vector<std::vector<std::pair<unsigned int, double> > > hits(m_shards.size());
+        forEachShard(SearchShard(*this, fingerprint, threshold, 0, hits));
+
+        std::vector<std::pair<unsigned int, double> > result;
+        for (std::size_t i = 0; i < hits.size(); ++i)
+          std::copy(hits[i].begin(), hits[i].end(), std::back_inserter(result));
+        return result;
+      }
+
+      /**
+       * @brief Search all shards for the k nearest neighbors.
+       *
+       * The k best hits of each shard are merged.
+       *
+       * @param fingerprint The query fingerprint.
+       * @param k The number of nearest neighbors to find.
+       * @param threshold The minimum score for the hits.
+       *
+       * @return The (at most) k best hits as (global index, score) pairs,
+       *         sorted by descending score (equal scores by ascending index).
+       */
+      std::vector<std::pair<unsigned int, double> > knnSearch(const Word *fingerprint, unsigned int k, double threshold = 0.0) const
+      {
+        if (!k)
+          return std::vector<std::pair<unsigned int, double> >();
+
+        std::vector<std::vector<std::pair<unsigned int, double> > > hits(m_shards.size());
+        forEachShard(SearchShard(*this, fingerprint, threshold, k, hits));
+
+        impl::KnnHits collector(threshold, k);
+        for (std::size_t i = 0; i < hits.size(); ++i)
+          for (std::size_t j = 0; j < hits[i].size(); ++j)
+            collector.add(hits[i][j].first, hits[i][j].second);
+        return collector.sorted();
+      }
+
+    private:
+      /**
+       * Search a single shard and convert the hits to global indices.
+       */
+      struct SearchShard
+      {
+        SearchShard(const ShardedSimilaritySearchIndex &index_, const Word *fingerprint_, double threshold_,
+            unsigned int k_, std::vector<std::vector<std::pair<unsigned int, double> > > &hits_)
+          : index(index_), fingerprint(fingerprint_), threshold(threshold_), k(k_), hits(hits_)
+        {
+        }
+
+        void operator()(std::size_t shard) const
+        {
+          const IndexType &shardIndex = *index.m_shards[shard];
+          hits[shard] = k ? shardIndex.knnSearch(fingerprint, k, threshold) : shardIndex.search(fingerprint, threshold);
+          for (std::size_t j = 0; j < hits[shard].size(); ++j)
+            hits[shard][j].first += index.m_offsets[shard];
+        }
+
+        const ShardedSimilaritySearchIndex &index;
+        const Word *fingerprint;
+        double threshold;
+        unsigned int k; //!< Number of nearest neighbors, 0 for all hits above threshold
+        std::vector<std::vector<std::pair<unsigned int, double> > > &hits;
+      };
+
+      template<typename Function>
+      void forEachShard(const Function &f) const
+      {
+#ifdef HAVE_CPP11
+        if (m_parallel && m_shards.size() > 1) {
+          ThreadPool::global().parallelFor(m_shards.size(), 1, [&f] (std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i)
+              f(i);
+          });
+          return;
+        }
+#endif
+        for (std::size_t i = 0; i < m_shards.size(); ++i)
+          f(i);
+      }
+
+      static IndexType* loadShard(const std::string &filename, int k, unsigned int numThreads)
+      {
+        // similarity index file
+        BinaryInputFile file(filename);
+        Json::Reader reader;
+        Json::Value data;
+        if (reader.parse(file.header(), data) && data.isObject() && data["filetype"].asString() == "similarity-index")
+          return new IndexType(filename);
+        file.close();
+
+        // fingerprint file, the fingerprints are copied to the frozen index
+        InMemoryRowMajorFingerprintStorage storage;
+        storage.load(filename);
+        return new IndexType(storage, k, numThreads);
+      }
+
+      // do not allow ShardedSimilaritySearchIndex to be copied
+      ShardedSimilaritySearchIndex(const ShardedSimilaritySearchIndex &other);
+      ShardedSimilaritySearchIndex& operator=(const ShardedSimilaritySearchIndex &other);
+
+      std::vector<IndexType*> m_shards; //!< The index for each shard
+      std::vector<unsigned int> m_offsets; //!< Global index of the first fingerprint in each shard
+      unsigned int m_numBits; //!< The number of bits in the fingerprints
+      bool m_parallel; //!< Search the shards concurrently
+  };
+
+}
+
+#endif
@@ -28,18 +28,188 @@
 #define HELIUM_SIMILARITY_H
 
 #include <Helium/fingerprints/fingerprints.h>
+#include <Helium/fingerprints/metrics.h>
+#include <Helium/fileio/file.h>
+#include <Helium/timeout.h>
+#include <Helium/util/memory.h>
+
+#include <json/json.h>
+
+#include <boost/iostreams/device/mapped_file.hpp>
 
 #include <numeric>
+#include <algorithm>
+#include <limits>
+#include <iterator>
+#include <cmath>
+#include <cstdlib>
 
 #ifdef HAVE_CPP11
-#include <future>
-#endif
+#include <Helium/threadpool.h>
 
-#undef TIMER
-#define TIMER(msg)
+#include <atomic>
+#include <mutex>
+#endif
 
 namespace Helium {
 
+  namespace impl {
+
+    /**
+     * Hit collector for k-nearest neighbor searches. The best k hits are
+     * kept in a bounded (min-)heap. Once the heap is full, the threshold is
+     * raised to the score of the worst hit in the heap which tightens the
+     * bounds used to prune the search.
+     */
+    struct KnnHits
+    {
+      enum { nearestFirst = true };
+
+      /**
+       * Heap order: the worst hit (lowest score, highest index for equal
+       * scores) is at the top of the heap.
+       */
+      struct Worse
+      {
+        bool operator()(const std::pair<unsigned int, double> &left,
+            const std::pair<unsigned int, double> &right) const
+        {
+          if (left.second != right.second)
+            return left.second > right.second;
+          return left.first < right.first;
+        }
+      };
+
+      KnnHits(double threshold_, unsigned int k_) : Tmin(threshold_), k(k_)
+      {
+        heap.reserve(k);
+      }
+
+      double threshold() const
+      {
+        return heap.size() < k ? Tmin : std::max(Tmin, heap.front().second);
+      }
+
+      void add(unsigned int index, double S)
+      {
+        if (S < Tmin)
+          return;
+        std::pair<unsigned int, double> hit(index, S);
+        if (heap.size() < k) {
+          heap.push_back(hit);
+          std::push_heap(heap.begin(), heap.end(), Worse());
+        } else if (Worse()(hit, heap.front())) {
+          std::pop_heap(heap.begin(), heap.end(), Worse());
+          heap.back() = hit;
+          std::push_heap(heap.begin(), heap.end(), Worse());
+        }
+      }
+
+      bool done() const
+      {
+        return false;
+      }
+
+      /**
+       * Get the hits sorted by descending score.
+       */
+      std::vector<std::pair<unsigned int, double> > sorted()
+      {
+        std::sort_heap(heap.begin(), heap.end(), Worse());
+        return heap;
+      }
+
+      double Tmin;
+      unsigned int k;
+      std::vector<std::pair<unsigned int, double> > heap;
+    };
+
+    /**
+     * Get the range of positions [begin,end) in the storage that may contain
+     * fingerprints with a Tanimoto score of at least @p Tmin. If the
+     * fingerprints are sorted by population count, only the buckets with
+     * Tmin * |A| <= |B| <= |A| / Tmin are included (Swamidass & Baldi
+     * bounds). Otherwise, all fingerprints are included.
+     */
+    template<typename RowMajorFingerprintStorageType>
+    void popcount_range(RowMajorFingerprintStorageType &storage, int queryCount, double Tmin,
+        unsigned int &begin, unsigned int &end)
+    {
+      const std::vector<unsigned int> &offsets = storage.popcountOffsets();
+      begin = 0;
+      end = storage.numFingerprints();
+      if (offsets.empty() || Tmin <= 0.0)
+        return;
+      // the bounds are rounded outwards to be safe
+      int lower = std::max(0, static_cast<int>(std::floor(Tmin * queryCount)));
+      int upper = static_cast<int>(std::min(std::ceil(queryCount / Tmin), static_cast<double>(storage.numBits())));
+      begin = offsets[lower];
+      end = offsets[upper + 1];
+    }
+
+    /**
+     * Brute force similarity search for the fingerprints in the range
+     * [begin,end). The fingerprints are processed in blocks using
+     * bitvec_tanimoto_batch() and the cached bit counts from the storage.
+     * The search stops when the sink returns false or the optional @p token
+     * expires.
+     */
+    template<typename RowMajorFingerprintStorageType, typename HitSink>
+    bool brute_force_similarity_search_range(const Word *query, RowMajorFingerprintStorageType &storage,
+        unsigned int begin, unsigned int end, double Tmin, HitSink &sink, const CancellationToken *token = 0)
+    {
+      const unsigned int blockSize = 1024;
+      int numWords = bitvec_num_words_for_bits(storage.numBits());
+      int queryCount = bitvec_count(query, numWords);
+
+      // the rows may be padded (see the row-major storage concept)
+      int stride = end - begin > 1 ? storage.fingerprint(begin + 1) - storage.fingerprint(begin) : numWords;
+
+      std::vector<double> T(blockSize);
+      for (unsigned int i = begin; i < end; i += blockSize) {
+        // the token is checked once per block
+        if (token && token->expired())
+          return false;
+        int n = std::min(blockSize, end - i);
+        bitvec_tanimoto_batch(query, queryCount, storage.fingerprint(i), storage.bitCounts() + i, n, numWords, &T[0], stride);
+        HELIUM_COUNT(TanimotosComputed, n);
+        for (int j = 0; j < n; ++j)
+          if (T[j] >= Tmin && !sink(i + j, T[j]))
+            return false;
+      }
+
+      return true;
+    }
+
+    /**
+     * Hit sink that appends the hits to a vector.
+     */
+    struct PushBackHits
+    {
+      PushBackHits(std::vector<std::pair<unsigned int, double> > &hits_) : hits(hits_)
+      {
+      }
+
+      bool operator()(unsigned int index, double score)
+      {
+        hits.push_back(std::make_pair(index, score));
+        return true;
+      }
+
+      std::vector<std::pair<unsigned int, double> > &hits;
+    };
+
+    template<typename RowMajorFingerprintStorageType>
+    void brute_force_similarity_search_range(const Word *query, RowMajorFingerprintStorageType &storage,
+        unsigned int begin, unsigned int end, double Tmin, std::vector<std::pair<unsigned int, double> > &result,
+        const CancellationToken *token = 0)
+    {
+      PushBackHits sink(result);
+      brute_force_similarity_search_range(query, storage, begin, end, Tmin, sink, token);
+    }
+
+  }
+
   /**
    * @brief Brute force similarity search.
    *
@@ -62,59 +232,519 @@ namespace Helium {
       RowMajorFingerprintStorageType &storage, double Tmin)
   {
     TIMER("brute_force_fimilarity_search():");
-    int numWords = bitvec_num_words_for_bits(storage.numBits());
-
+    unsigned int begin, end;
+    impl::popcount_range(storage, bitvec_count(query, bitvec_num_words_for_bits(storage.numBits())), Tmin, begin, end);
     std::vector<std::pair<unsigned int, double> > result;
-    for (unsigned int i = 0; i < storage.numFingerprints(); ++i) {
-      const Word *fingerprint = storage.fingerprint(i);
-      double T = bitvec_tanimoto(query, fingerprint, numWords);
-      if (T >= Tmin)
-        result.push_back(std::make_pair(i, T));
-    }
-
+    impl::brute_force_similarity_search_range(query, storage, begin, end, Tmin, result);
     return result;
   }
 
-#ifdef HAVE_CPP11
+  /**
+   * @brief Streaming brute force similarity search.
+   *
+   * This function is the same as brute_force_similarity_search() except that
+   * hits are passed to the @p sink as soon as they are found instead of
+   * being collected in a vector. The sink is a function object with the
+   * signature bool(unsigned int index, double score). When it returns false,
+   * the search stops and no more hits are reported. Hits are reported in
+   * ascending index order.
+   *
+   * The search also stops when the optional @p token expires, it is checked
+   * once per block of 1024 fingerprints. The reported hits are partial if
+   * token->isCancelled() returns true afterwards.
+   *
+   * @param query The query fingerprint.
+   * @param storage The fingerprints to search.
+   * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   * @param sink The function object that receives the hits.
+   * @param token Optional cancellation token.
+   *
+   * @return False if the search was stopped by the sink or the token, true
+   *         otherwise.
+   */
+  template<typename RowMajorFingerprintStorageType, typename HitSink>
+  bool brute_force_similarity_search(const Word *query, RowMajorFingerprintStorageType &storage,
+      double Tmin, HitSink &sink, const CancellationToken *token = 0)
+  {
+    TIMER("brute_force_fimilarity_search():");
+    unsigned int begin, end;
+    impl::popcount_range(storage, bitvec_count(query, bitvec_num_words_for_bits(storage.numBits())), Tmin, begin, end);
+    return impl::brute_force_similarity_search_range(query, storage, begin, end, Tmin, sink, token);
+  }
+
+  /**
+   * @brief Brute force k-nearest neighbor search.
+   *
+   * If the fingerprints in the storage are sorted by population count (see
+   * RowMajorFingerprintStorageConcept), the population count buckets are
+   * searched starting from the query's population count and widening
+   * outward. The search stops when the best possible Tanimoto score for the
+   * remaining buckets, min(|A|,|B|) / max(|A|,|B|), is below the score of the
+   * k-th best hit found so far. Otherwise, all fingerprints are searched.
+   *
+   * @param query The query fingerprint.
+   * @param storage The fingerprints to search.
+   * @param k The number of nearest neighbors to find.
+   * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   *
+   * @return The (at most) k best hits as (index, Tanimoto score) pairs,
+   *         sorted by descending score (equal scores by ascending index).
+   */
+  template<typename RowMajorFingerprintStorageType>
+  std::vector<std::pair<unsigned int, double> > brute_force_knn_search(const Word *query,
+      RowMajorFingerprintStorageType &storage, unsigned int k, double Tmin = 0.0)
+  {
+    TIMER("brute_force_knn_search():");
+    if (!k)
+      return std::vector<std::pair<unsigned int, double> >();
+
+    impl::KnnHits collector(Tmin, k);
+    std::vector<std::pair<unsigned int, double> > hits;
+
+    const std::vector<unsigned int> &offsets = storage.popcountOffsets();
+    if (offsets.empty()) {
+      impl::brute_force_similarity_search_range(query, storage, 0, storage.numFingerprints(), Tmin, hits);
+      for (std::size_t i = 0; i < hits.size(); ++i)
+        collector.add(hits[i].first, hits[i].second);
+      return collector.sorted();
+    }
+
+    int A = bitvec_count(query, bitvec_num_words_for_bits(storage.numBits()));
+    int numBits = storage.numBits();
+    // start with the bucket for the query's population count
+    impl::brute_force_similarity_search_range(query, storage, offsets[A], offsets[A + 1], Tmin, hits);
+    for (std::size_t i = 0; i < hits.size(); ++i)
+      collector.add(hits[i].first, hits[i].second);
+
+    // widen outward, the bucket with the best possible score is searched next
+    int lower = A - 1, upper = A + 1;
+    while (lower >= 0 || upper <= numBits) {
+      double lowerBound = lower >= 0 ? (A ? static_cast<double>(lower) / A : 0.0) : -1.0;
+      double upperBound = upper <= numBits ? static_cast<double>(A) / upper : -1.0;
+      // stop when no remaining bucket can contain a better hit
+      if (std::max(lowerBound, upperBound) < collector.threshold())
+        break;
+      int c = upperBound >= lowerBound ? upper++ : lower--;
+
+      hits.clear();
+      impl::brute_force_similarity_search_range(query, storage, offsets[c], offsets[c + 1], collector.threshold(), hits);
+      for (std::size_t i = 0; i < hits.size(); ++i)
+        collector.add(hits[i].first, hits[i].second);
+    }
+
+    return collector.sorted();
+  }
 
   namespace impl {
 
     /**
-     * Functor for threaded brute force similarity search.
+     * Batch brute force similarity search for the fingerprints in the range
+     * [begin,end). The queries x fingerprints matrix is processed in tiles:
+     * a block of fingerprints that fits in the L2 cache is compared against
+     * small blocks of queries that stay in the L1 cache. This way, each
+     * fingerprint is only read once from main memory for all queries.
      */
     template<typename RowMajorFingerprintStorageType>
-    struct BruteForceSimilaritySearch
+    void brute_force_similarity_search_batch_range(const std::vector<Word*> &queries,
+        RowMajorFingerprintStorageType &storage, unsigned int begin, unsigned int end, double Tmin,
+        std::vector<std::vector<std::pair<unsigned int, double> > > &result)
+    {
+      const unsigned int queryBlockSize = 8;
+      int numWords = bitvec_num_words_for_bits(storage.numBits());
+      const unsigned int blockSize = std::max<unsigned int>(64, 256 * 1024 / (numWords * sizeof(Word)));
+      const BitvecKernels &kernels = bitvec_kernels_for_words(numWords);
+      const int *bitCounts = storage.bitCounts();
+
+      // population count and range of candidate fingerprints for each query
+      std::vector<int> queryCounts(queries.size());
+      std::vector<unsigned int> queryBegin(queries.size()), queryEnd(queries.size());
+      for (std::size_t q = 0; q < queries.size(); ++q) {
+        queryCounts[q] = bitvec_count(queries[q], numWords);
+        popcount_range(storage, queryCounts[q], Tmin, queryBegin[q], queryEnd[q]);
+        queryBegin[q] = std::max(queryBegin[q], begin);
+        queryEnd[q] = std::min(queryEnd[q], end);
+      }
+
+      for (unsigned int blockBegin = begin; blockBegin < end; blockBegin += blockSize) {
+        unsigned int blockEnd = std::min(end, blockBegin + blockSize);
+        for (std::size_t q0 = 0; q0 < queries.size(); q0 += queryBlockSize) {
+          std::size_t q1 = std::min<std::size_t>(queries.size(), q0 + queryBlockSize);
+          for (unsigned int i = blockBegin; i < blockEnd; ++i) {
+            const Word *fingerprint = storage.fingerprint(i);
+            for (std::size_t q = q0; q < q1; ++q) {
+              if (i < queryBegin[q] || i >= queryEnd[q])
+                continue;
+              int andCount = kernels.andCount(queries[q], fingerprint, numWords);
+              double T = static_cast<double>(andCount) / (queryCounts[q] + bitCounts[i] - andCount);
+              if (T >= Tmin)
+                result[q].push_back(std::make_pair(i, T));
+            }
+          }
+        }
+      }
+
+#ifdef HAVE_INSTRUMENTATION
+      for (std::size_t q = 0; q < queries.size(); ++q)
+        if (queryEnd[q] > queryBegin[q])
+          HELIUM_COUNT(TanimotosComputed, queryEnd[q] - queryBegin[q]);
+#endif
+    }
+
+  }
+
+  /**
+   * @brief Batch brute force similarity search.
+   *
+   * Perform a brute force similarity search for many queries at once. The
+   * results are the same as calling brute_force_similarity_search() for each
+   * query but the fingerprints are only streamed through the cache once for
+   * all queries.
+   *
+   * @param queries The query fingerprints.
+   * @param storage The fingerprints to search.
+   * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   *
+   * @return The lists of hits for each query (see
+   *         brute_force_similarity_search()).
+   */
+  template<typename RowMajorFingerprintStorageType>
+  std::vector<std::vector<std::pair<unsigned int, double> > > brute_force_similarity_search_batch(
+      const std::vector<Word*> &queries, RowMajorFingerprintStorageType &storage, double Tmin)
+  {
+    TIMER("brute_force_similarity_search_batch():");
+    std::vector<std::vector<std::pair<unsigned int, double> > > result(queries.size());
+    impl::brute_force_similarity_search_batch_range(queries, storage, 0, storage.numFingerprints(), Tmin, result);
+    return result;
+  }
+
+  namespace impl {
+
+    /**
+     * A hit for a row in an NxN similarity search.
+     */
+    struct NxNHit
     {
-      BruteForceSimilaritySearch(const Word *query_, RowMajorFingerprintStorageType &storage_,
-          unsigned int begin_, unsigned int end_, double Tmin_) : query(query_),
-          storage(storage_), begin(begin_), end(end_), Tmin(Tmin_)
+      NxNHit(unsigned int row_, unsigned int index_, double S_) : row(row_), index(index_), S(S_)
       {
       }
 
-      std::vector<std::pair<unsigned int, double> > operator()()
+      unsigned int row;
+      unsigned int index;
+      double S;
+    };
+
+    /**
+     * The rows of a symmetric NxN similarity search. Each row is a bounded
+     * top-N heap. The rows are divided in blocks of blockSize rows and the
+     * hits for a block are added while holding the block's lock.
+     */
+    struct NxNRows
+    {
+      NxNRows(unsigned int numRows, unsigned int blockSize_, double Tmin_, unsigned int N_)
+        : rows(numRows, KnnHits(Tmin_, N_)), blockSize(blockSize_), Tmin(Tmin_), N(N_)
+#ifdef HAVE_CPP11
+          , locks(numRows / blockSize_ + 1)
+#endif
       {
-        int numWords = bitvec_num_words_for_bits(storage.numBits());
+      }
 
-        std::vector<std::pair<unsigned int, double> > result;
+      void add(unsigned int block, const std::vector<NxNHit> &hits)
+      {
+#ifdef HAVE_CPP11
+        std::lock_guard<std::mutex> lock(locks[block]);
+#endif
+        for (std::size_t i = 0; i < hits.size(); ++i)
+          rows[hits[i].row].add(hits[i].index, hits[i].S);
+      }
+
+      std::vector<KnnHits> rows;
+      unsigned int blockSize;
+      double Tmin;
+      unsigned int N;
+#ifdef HAVE_CPP11
+      std::vector<std::mutex> locks;
+#endif
+    };
+
+    /**
+     * Get the number of fingerprints in a tile of the symmetric NxN
+     * similarity search. Two tiles should fit in the L2 cache.
+     */
+    inline unsigned int nxn_block_size(unsigned int numBits)
+    {
+      return std::max<unsigned int>(64, 128 * 1024 / (bitvec_num_words_for_bits(numBits) * sizeof(Word)));
+    }
+
+    /**
+     * Move the hits in @p local (for the rows starting at @p begin) to the
+     * shared rows and clear the local heaps.
+     */
+    inline void nxn_flush(std::vector<KnnHits> &local, unsigned int begin, NxNRows &rows,
+        std::vector<NxNHit> &hits)
+    {
+      hits.clear();
+      for (std::size_t r = 0; r < local.size(); ++r) {
+        for (std::size_t h = 0; h < local[r].heap.size(); ++h)
+          hits.push_back(NxNHit(begin + r, local[r].heap[h].first, local[r].heap[h].second));
+        local[r].heap.clear();
+      }
+      if (!hits.empty())
+        rows.add(begin / rows.blockSize, hits);
+    }
+
+    /**
+     * Process tile row @p I of the symmetric NxN similarity search. Only the
+     * tiles on and above the diagonal are computed and each hit (i,j) is
+     * added to both row i and row j. The hits are first collected in small
+     * local heaps for the tile's rows and columns which are merged into the
+     * shared rows afterwards.
+     *
+     * If the fingerprints are sorted by population count, the columns j > i
+     * with |B| > |A| / Tmin are skipped for row i.
+     */
+    template<typename RowMajorFingerprintStorageType>
+    void brute_force_nxn_tile_row(RowMajorFingerprintStorageType &storage, unsigned int I, NxNRows &rows)
+    {
+      int numWords = bitvec_num_words_for_bits(storage.numBits());
+      const BitvecKernels &kernels = bitvec_kernels_for_words(numWords);
+      const int *bitCounts = storage.bitCounts();
+      const std::vector<unsigned int> &offsets = storage.popcountOffsets();
+      const unsigned int n = storage.numFingerprints();
+      const unsigned int B = rows.blockSize;
+      const unsigned int rowBlockSize = 8;
+      const double Tmin = rows.Tmin;
+
+      unsigned int begin = I * B;
+      unsigned int end = std::min(n, begin + B);
+
+      // the end of the columns that may contain hits for each row
+      std::vector<unsigned int> limits(end - begin, n);
+      if (!offsets.empty() && Tmin > 0.0)
         for (unsigned int i = begin; i < end; ++i) {
-          const Word *fingerprint = storage.fingerprint(i);
-          double T = bitvec_tanimoto(query, fingerprint, numWords);
-          if (T >= Tmin)
-            result.push_back(std::make_pair(i, T));
+          // rounded outwards to be safe (see popcount_range())
+          int upper = static_cast<int>(std::min(std::ceil(bitCounts[i] / Tmin), static_cast<double>(storage.numBits())));
+          limits[i - begin] = offsets[upper + 1];
+        }
+      unsigned int maxLimit = *std::max_element(limits.begin(), limits.end());
+
+      std::vector<KnnHits> local(end - begin, KnnHits(Tmin, rows.N));
+      std::vector<KnnHits> columns(B, KnnHits(Tmin, rows.N));
+      std::vector<NxNHit> hits;
+
+      for (unsigned int J0 = begin; J0 < maxLimit; J0 += B) {
+        unsigned int J1 = std::min(n, J0 + B);
+        bool diagonal = J0 == begin;
+        // small blocks of rows stay in the L1 cache while the tile's
+        // columns are streamed from the L2 cache
+        for (unsigned int i0 = begin; i0 < end; i0 += rowBlockSize) {
+          unsigned int i1 = std::min(end, i0 + rowBlockSize);
+          unsigned int jBegin = diagonal ? i0 : J0;
+          unsigned int jEnd = std::min(J1, *std::max_element(&limits[i0 - begin], &limits[i1 - begin - 1] + 1));
+          for (unsigned int j = jBegin; j < jEnd; ++j) {
+            const Word *fingerprint = storage.fingerprint(j);
+            for (unsigned int i = i0; i < i1; ++i) {
+              if ((diagonal && j < i) || j >= limits[i - begin])
+                continue;
+              int andCount = kernels.andCount(storage.fingerprint(i), fingerprint, numWords);
+              double T = static_cast<double>(andCount) / (bitCounts[i] + bitCounts[j] - andCount);
+              if (!(T >= Tmin))
+                continue;
+              local[i - begin].add(j, T);
+              if (j == i)
+                continue;
+              if (diagonal)
+                local[j - begin].add(i, T);
+              else
+                columns[j - J0].add(i, T);
+            }
+          }
         }
 
-        return result;
+        // the heaps past the end of the last tile remain empty
+        if (!diagonal)
+          nxn_flush(columns, J0, rows, hits);
       }
 
-      const Word *query;
-      RowMajorFingerprintStorageType &storage;
-      unsigned int begin;
-      unsigned int end;
-      double Tmin;
-    };
+      nxn_flush(local, begin, rows, hits);
+    }
+
+  }
+
+  /**
+   * @brief Symmetric brute force NxN similarity search.
+   *
+   * Find the @p N nearest neighbors of every fingerprint in the storage
+   * (including the fingerprint itself). The result is the same as calling
+   * brute_force_knn_search() for each fingerprint in the storage but each
+   * pair is only computed once. The upper triangle of the NxN matrix is
+   * processed in cache blocked tiles and each hit is added to the bounded
+   * top-N heaps of both fingerprints.
+   *
+   * @param storage The fingerprints to search.
+   * @param N The number of nearest neighbors to find for each fingerprint.
+   * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   *
+   * @return The (at most) N best hits for each fingerprint as (index,
+   *         Tanimoto score) pairs, sorted by descending score (equal scores
+   *         by ascending index).
+   */
+  template<typename RowMajorFingerprintStorageType>
+  std::vector<std::vector<std::pair<unsigned int, double> > > brute_force_similarity_search_nxn(
+      RowMajorFingerprintStorageType &storage, unsigned int N, double Tmin)
+  {
+    TIMER("brute_force_similarity_search_nxn():");
+    std::vector<std::vector<std::pair<unsigned int, double> > > result(storage.numFingerprints());
+    if (!N)
+      return result;
+
+    impl::NxNRows rows(storage.numFingerprints(), impl::nxn_block_size(storage.numBits()), Tmin, N);
+    for (unsigned int I = 0; I * rows.blockSize < storage.numFingerprints(); ++I)
+      impl::brute_force_nxn_tile_row(storage, I, rows);
+
+    for (std::size_t i = 0; i < result.size(); ++i)
+      result[i] = rows.rows[i].sorted();
+
+    return result;
+  }
+
+  /**
+   * @brief Brute force similarity search for a tile of the NxN matrix.
+   *
+   * Compute the block of the NxN similarity matrix with the rows
+   * [rowBegin,rowEnd) and the columns [colBegin,colEnd). This is used to
+   * split an NxN similarity search into independent jobs, the N nearest
+   * neighbors of a fingerprint are obtained by merging the (at most) N best
+   * hits for its row from all tiles.
+   *
+   * If @p symmetric is false, the result contains the hits in the columns
+   * for each row. The tiles with the same rows and all columns cover the
+   * complete rows.
+   *
+   * If @p symmetric is true, only the pairs (i,j) with i <= j are computed
+   * and each hit is added to both row i and row j (see
+   * brute_force_similarity_search_nxn()). The result then also contains rows
+   * for the columns. Only the tiles on and above the diagonal are needed to
+   * cover the complete matrix and the tiles below the diagonal are empty.
+   *
+   * If the fingerprints are sorted by population count, only the columns
+   * in the population count range of each row are searched.
+   *
+   * @param storage The fingerprints to search.
+   * @param rowBegin The first row of the tile.
+   * @param rowEnd The end of the rows.
+   * @param colBegin The first column of the tile.
+   * @param colEnd The end of the columns.
+   * @param N The number of nearest neighbors to keep for each row.
+   * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   * @param symmetric Only compute each pair once.
+   *
+   * @return The rows with at least one hit sorted by ascending row index.
+   *         The hits for a row are sorted as in
+   *         brute_force_similarity_search_nxn().
+   */
+  template<typename RowMajorFingerprintStorageType>
+  std::vector<std::pair<unsigned int, std::vector<std::pair<unsigned int, double> > > >
+  brute_force_similarity_search_nxn_tile(RowMajorFingerprintStorageType &storage, unsigned int rowBegin,
+      unsigned int rowEnd, unsigned int colBegin, unsigned int colEnd, unsigned int N, double Tmin, bool symmetric)
+  {
+    TIMER("brute_force_similarity_search_nxn_tile():");
+    PRE(rowBegin <= rowEnd && rowEnd <= storage.numFingerprints());
+    PRE(colBegin <= colEnd && colEnd <= storage.numFingerprints());
+
+    std::vector<std::pair<unsigned int, std::vector<std::pair<unsigned int, double> > > > result;
+    if (!N || rowBegin == rowEnd || colBegin == colEnd)
+      return result;
+
+    int numWords = bitvec_num_words_for_bits(storage.numBits());
+    const impl::BitvecKernels &kernels = impl::bitvec_kernels_for_words(numWords);
+    const int *bitCounts = storage.bitCounts();
+    const unsigned int B = impl::nxn_block_size(storage.numBits());
+    const unsigned int rowBlockSize = 8;
+
+    // the columns that may contain hits for each row
+    std::vector<unsigned int> firsts(rowEnd - rowBegin), lasts(rowEnd - rowBegin);
+    for (unsigned int i = rowBegin; i < rowEnd; ++i) {
+      impl::popcount_range(storage, bitCounts[i], Tmin, firsts[i - rowBegin], lasts[i - rowBegin]);
+      firsts[i - rowBegin] = std::max(firsts[i - rowBegin], symmetric ? std::max(colBegin, i) : colBegin);
+      lasts[i - rowBegin] = std::min(lasts[i - rowBegin], colEnd);
+    }
+
+    // the hits for the columns that are not rows of the tile (symmetric only)
+    std::vector<impl::KnnHits> rows(rowEnd - rowBegin, impl::KnnHits(Tmin, N));
+    std::vector<impl::KnnHits> columns(symmetric ? colEnd - colBegin : 0, impl::KnnHits(Tmin, N));
+
+    // small blocks of rows stay in the L1 cache while a block of columns is
+    // streamed from the L2 cache
+    for (unsigned int J0 = colBegin; J0 < colEnd; J0 += B) {
+      unsigned int J1 = std::min(colEnd, J0 + B);
+      for (unsigned int i0 = rowBegin; i0 < rowEnd; i0 += rowBlockSize) {
+        unsigned int i1 = std::min(rowEnd, i0 + rowBlockSize);
+        unsigned int jBegin = std::max(J0, *std::min_element(&firsts[i0 - rowBegin], &firsts[i1 - rowBegin - 1] + 1));
+        unsigned int jEnd = std::min(J1, *std::max_element(&lasts[i0 - rowBegin], &lasts[i1 - rowBegin - 1] + 1));
+        for (unsigned int j = jBegin; j < jEnd; ++j) {
+          const Word *fingerprint = storage.fingerprint(j);
+          for (unsigned int i = i0; i < i1; ++i) {
+            if (j < firsts[i - rowBegin] || j >= lasts[i - rowBegin])
+              continue;
+            int andCount = kernels.andCount(storage.fingerprint(i), fingerprint, numWords);
+            double T = static_cast<double>(andCount) / (bitCounts[i] + bitCounts[j] - andCount);
+            if (!(T >= Tmin))
+              continue;
+            rows[i - rowBegin].add(j, T);
+            if (!symmetric || j == i)
+              continue;
+            if (j >= rowBegin && j < rowEnd)
+              rows[j - rowBegin].add(i, T);
+            else
+              columns[j - colBegin].add(i, T);
+          }
+        }
+      }
+    }
+
+    // merge the rows and columns by ascending index
+    std::size_t r = 0, c = 0;
+    while (r < rows.size() || c < columns.size()) {
+      bool useRow = c == columns.size() || (r < rows.size() && rowBegin + r < colBegin + c);
+      impl::KnnHits &hits = useRow ? rows[r] : columns[c];
+      unsigned int index = useRow ? rowBegin + r++ : colBegin + c++;
+      if (!hits.heap.empty())
+        result.push_back(std::make_pair(index, hits.sorted()));
+    }
 
+    return result;
+  }
+
+  /**
+   * @brief Merge the nearest neighbors for a row from several tiles.
+   *
+   * Add the @p other hits to @p hits and keep the @p N best hits (see
+   * brute_force_similarity_search_nxn_tile()). Both lists must be sorted by
+   * descending score (equal scores by ascending index) and the result is
+   * sorted in the same way. Hits for the same index found in overlapping
+   * tiles are only included once.
+   */
+  inline void merge_nxn_hits(std::vector<std::pair<unsigned int, double> > &hits,
+      const std::vector<std::pair<unsigned int, double> > &other, unsigned int N)
+  {
+    std::vector<std::pair<unsigned int, double> > merged;
+    merged.reserve(std::min<std::size_t>(N, hits.size() + other.size()));
+    std::size_t i = 0, j = 0;
+    while (merged.size() < N && (i < hits.size() || j < other.size())) {
+      const std::pair<unsigned int, double> &hit = (j == other.size() ||
+          (i < hits.size() && impl::KnnHits::Worse()(hits[i], other[j]))) ? hits[i++] : other[j++];
+      bool duplicate = false;
+      for (std::size_t k = merged.size(); k-- > 0 && merged[k].second == hit.second; )
+        if (merged[k].first == hit.first)
+          duplicate = true;
+      if (!duplicate)
+        merged.push_back(hit);
+    }
+    hits.swap(merged);
   }
 
+#ifdef HAVE_CPP11
+
   /**
    * @brief Brute force similarity search.
    *
@@ -122,9 +752,9 @@ namespace Helium {
    * all fingerprints in the fingerprint sotrage. If the tanimoto is above the
    * specified threshold, it is added to the list of results.
    *
-   * Each thread searches a portion of the fingerprints in the storage and the
-   * found hits are later combined. The number of threads is determined by the
-   * result of the std::thread::hardware_concurrency() function. Although this
+   * The fingerprints in the storage are divided in chunks which are searched
+   * by the threads of the thread pool and the found hits are later combined.
+   * Although this
    * function is faster than the single threaded brute force search (assuming
    * the number of fingerprints in the storage is large enough), the
    * SimularitySearchIndex class is still faster even using a single thread due
@@ -136,6 +766,7 @@ namespace Helium {
    * @param query The query fingerprint.
    * @param storage The fingerprints to search.
    * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   * @param pool The thread pool to use.
    *
    * @return The lists of hits as std::pair objects. The first element is the
    *         index of the fingerprint in the storage and the second element in
@@ -144,63 +775,401 @@ namespace Helium {
    */
   template<typename RowMajorFingerprintStorageType>
   std::vector<std::pair<unsigned int, double> > brute_force_similarity_search_threaded(const Word *query,
-      RowMajorFingerprintStorageType &storage, double Tmin)
+      RowMajorFingerprintStorageType &storage, double Tmin, ThreadPool &pool = ThreadPool::global())
   {
     TIMER("brute_force_fimilarity_search_threaded():");
 
-    unsigned numThreads = std::thread::hardware_concurrency();
-    // c++ implementations may return 0
-    if (!numThreads)
-      numThreads = 2;
+    // only search the population count buckets that may contain hits
+    unsigned int first, last;
+    impl::popcount_range(storage, bitvec_count(query, bitvec_num_words_for_bits(storage.numBits())), Tmin, first, last);
 
-    unsigned int numFingerprints = storage.numFingerprints();
-    unsigned int taskSize = numFingerprints / numThreads + 1;
+    // the chunks are defined over all fingerprints so each worker searches
+    // the same part of the storage (see ThreadPool::parallelForPartitioned())
+    std::size_t chunkSize = pool.chunkSize(storage.numFingerprints(), 1024);
+    std::size_t numChunks = (storage.numFingerprints() + chunkSize - 1) / chunkSize;
 
     typedef std::vector<std::pair<unsigned int, double> > SimilaritySearchResult;
 
-    //
-    // launch threads
-    //
-    std::vector<std::future<SimilaritySearchResult> > futures;
-    for (unsigned i = 0; i < numThreads; ++i) {
-      unsigned int begin = i * taskSize;
-      unsigned int end = std::min(numFingerprints, (i + 1) * taskSize);
-      futures.push_back(std::async(impl::BruteForceSimilaritySearch<RowMajorFingerprintStorageType>(query, storage, begin, end, Tmin)));
-    }
+    // each chunk has its own result so no locking is needed
+    std::vector<SimilaritySearchResult> results(numChunks);
+    pool.parallelForPartitioned(storage.numFingerprints(), chunkSize, [&] (std::size_t begin, std::size_t end) {
+      begin = std::max<std::size_t>(begin, first);
+      end = std::min<std::size_t>(end, last);
+      if (begin < end)
+        impl::brute_force_similarity_search_range(query, storage, begin, end, Tmin, results[begin / chunkSize]);
+    });
 
+    // the chunks are ordered so the hits remain sorted by index
     SimilaritySearchResult result;
-    for (unsigned i = 0; i < numThreads; ++i) {
-      SimilaritySearchResult tmp = futures[i].get();
-      std::copy(tmp.begin(), tmp.end(), std::back_inserter(result));
-    }
+    for (std::size_t i = 0; i < results.size(); ++i)
+      std::copy(results[i].begin(), results[i].end(), std::back_inserter(result));
 
     return result;
   }
 
-#endif
-
   /**
-   * @brief Similarity search fingerpint index.
+   * @brief Streaming threaded brute force similarity search.
+   *
+   * This function is the same as brute_force_similarity_search_threaded()
+   * except that hits are passed to the @p sink instead of being collected
+   * and combined in a single vector. Each chunk buffers its own hits which
+   * are passed on to the sink when the chunk is done. The calls to the sink
+   * are serialized (i.e. the sink does not need to be thread safe) but the
+   * chunks are reported in the order in which they finish. When the sink
+   * returns false or the optional @p token expires, the search stops and no
+   * more hits are reported.
+   *
+   * @note This function is only available when C++11 support is enabled.
+   *
+   * @param query The query fingerprint.
+   * @param storage The fingerprints to search.
+   * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   * @param sink The function object that receives the hits, it has the
+   *        signature bool(unsigned int index, double score).
+   * @param pool The thread pool to use.
+   * @param token Optional cancellation token.
    *
+   * @return False if the search was stopped by the sink or the token, true
+   *         otherwise.
    */
-  template<typename FingerprintStorageType>
-  class SimilaritySearchIndex
+  template<typename RowMajorFingerprintStorageType, typename HitSink>
+  bool brute_force_similarity_search_threaded(const Word *query, RowMajorFingerprintStorageType &storage,
+      double Tmin, HitSink &sink, ThreadPool &pool = ThreadPool::global(), const CancellationToken *token = 0)
   {
-      /**
-       * Base class for tree nodes in the kD-grid.
-       */
-      struct Node
-      {
-      };
+    TIMER("brute_force_fimilarity_search_threaded():");
 
-      /**
-       * An intermediate tree node in the kD-grid.
-       */
-      struct TreeNode : public Node
-      {
-        /**
-         * Constructor.
-         *
+    // only search the population count buckets that may contain hits
+    unsigned int first, last;
+    impl::popcount_range(storage, bitvec_count(query, bitvec_num_words_for_bits(storage.numBits())), Tmin, first, last);
+
+    std::mutex mutex;
+    std::atomic<bool> stopped(false);
+    pool.parallelForPartitioned(storage.numFingerprints(), pool.chunkSize(storage.numFingerprints(), 1024),
+        [&] (std::size_t begin, std::size_t end) {
+      begin = std::max<std::size_t>(begin, first);
+      end = std::min<std::size_t>(end, last);
+      if (stopped || begin >= end)
+        return;
+
+      std::vector<std::pair<unsigned int, double> > hits;
+      impl::brute_force_similarity_search_range(query, storage, begin, end, Tmin, hits, token);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      for (std::size_t j = 0; j < hits.size() && !stopped; ++j)
+        if (!sink(hits[j].first, hits[j].second))
+          stopped = true;
+      if (token && token->isCancelled())
+        stopped = true;
+    });
+
+    return !stopped;
+  }
+
+
+  /**
+   * @brief Threaded batch brute force similarity search.
+   *
+   * The threads of the thread pool search a portion of the fingerprints in
+   * the storage for all queries using the same cache blocking as
+   * brute_force_similarity_search_batch(). The results are the same as
+   * calling brute_force_similarity_search() for each query.
+   *
+   * @note This function is only available when C++11 support is enabled.
+   *
+   * @param queries The query fingerprints.
+   * @param storage The fingerprints to search.
+   * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   *
+   * @param pool The thread pool to use.
+   *
+   * @return The lists of hits for each query (see
+   *         brute_force_similarity_search()).
+   */
+  template<typename RowMajorFingerprintStorageType>
+  std::vector<std::vector<std::pair<unsigned int, double> > > brute_force_similarity_search_batch_threaded(
+      const std::vector<Word*> &queries, RowMajorFingerprintStorageType &storage, double Tmin,
+      ThreadPool &pool = ThreadPool::global())
+  {
+    TIMER("brute_force_similarity_search_batch_threaded():");
+
+    unsigned int numFingerprints = storage.numFingerprints();
+    unsigned int numChunks = std::min(numFingerprints, 4 * pool.numThreads());
+    if (!numChunks)
+      return std::vector<std::vector<std::pair<unsigned int, double> > >(queries.size());
+    unsigned int chunkSize = numFingerprints / numChunks + 1;
+
+    typedef std::vector<std::vector<std::pair<unsigned int, double> > > BatchResult;
+
+    // each chunk has its own results so no locking is needed
+    std::vector<BatchResult> results(numChunks, BatchResult(queries.size()));
+    // each worker searches the same part of the storage (see ThreadPool::parallelForPartitioned())
+    pool.parallelForPartitioned(numFingerprints, chunkSize, [&] (std::size_t begin, std::size_t end) {
+      impl::brute_force_similarity_search_batch_range(queries, storage, begin, end, Tmin, results[begin / chunkSize]);
+    });
+
+    // the ranges are ordered so the hits remain sorted by index
+    BatchResult result(queries.size());
+    for (std::size_t i = 0; i < results.size(); ++i)
+      for (std::size_t q = 0; q < queries.size(); ++q)
+        std::copy(results[i][q].begin(), results[i][q].end(), std::back_inserter(result[q]));
+
+    return result;
+  }
+
+
+  /**
+   * @brief Threaded symmetric brute force NxN similarity search.
+   *
+   * The tile rows of brute_force_similarity_search_nxn() are processed by
+   * the threads of the thread pool. The result is the same as the single
+   * threaded version.
+   *
+   * @note This function is only available when C++11 support is enabled.
+   *
+   * @param storage The fingerprints to search.
+   * @param N The number of nearest neighbors to find for each fingerprint.
+   * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   * @param pool The thread pool to use.
+   *
+   * @return The (at most) N best hits for each fingerprint (see
+   *         brute_force_similarity_search_nxn()).
+   */
+  template<typename RowMajorFingerprintStorageType>
+  std::vector<std::vector<std::pair<unsigned int, double> > > brute_force_similarity_search_nxn_threaded(
+      RowMajorFingerprintStorageType &storage, unsigned int N, double Tmin,
+      ThreadPool &pool = ThreadPool::global())
+  {
+    TIMER("brute_force_similarity_search_nxn_threaded():");
+    std::vector<std::vector<std::pair<unsigned int, double> > > result(storage.numFingerprints());
+    if (!N)
+      return result;
+
+    impl::NxNRows rows(storage.numFingerprints(), impl::nxn_block_size(storage.numBits()), Tmin, N);
+    // the first tile rows contain the most tiles and are handed out first
+    unsigned int numBlocks = (storage.numFingerprints() + rows.blockSize - 1) / rows.blockSize;
+    pool.parallelFor(numBlocks, 1, [&] (std::size_t begin, std::size_t end) {
+      for (std::size_t I = begin; I < end; ++I)
+        impl::brute_force_nxn_tile_row(storage, I, rows);
+    });
+
+    pool.parallelFor(result.size(), 1024, [&] (std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i)
+        result[i] = rows.rows[i].sorted();
+    });
+
+    return result;
+  }
+#endif
+
+  namespace impl {
+
+    /**
+     * Get the indices of the set bits in the query fingerprint.
+     */
+    inline std::vector<unsigned int> query_bits(const Word *query, unsigned int numBits)
+    {
+      std::vector<unsigned int> bits;
+      for (unsigned int i = 0; i < numBits; ++i)
+        if (bitvec_get(i, query))
+          bits.push_back(i);
+      return bits;
+    }
+
+    /**
+     * Bit-sliced similarity search for the fingerprints in the column words
+     * [begin,end). The columns for the set query bits are added to vertical
+     * counters one block of words at a time: plane p of the counters holds
+     * bit p of the intersection count for each fingerprint so a single word
+     * operation updates the counts of 64 fingerprints. Adding a column is a
+     * ripple-carry addition that stops as soon as there are no more carries
+     * in the block. The intersection counts are then extracted from the
+     * planes and combined with the cached bit counts from the storage. The
+     * search stops when the sink returns false or the optional @p token
+     * expires.
+     */
+    template<typename ColumnMajorFingerprintStorageType, typename HitSink>
+    bool bitsliced_similarity_search_range(const std::vector<unsigned int> &bits,
+        const ColumnMajorFingerprintStorageType &storage, unsigned int begin, unsigned int end, double Tmin,
+        HitSink &sink, const CancellationToken *token = 0)
+    {
+      const unsigned int blockWords = 16;
+      int queryCount = bits.size();
+      // the number of planes needed to count up to queryCount
+      unsigned int numPlanes = 1;
+      while ((1u << numPlanes) <= static_cast<unsigned int>(queryCount))
+        ++numPlanes;
+
+      std::vector<Word> planes(numPlanes * blockWords), carry(blockWords);
+      for (unsigned int block = begin; block < end; block += blockWords) {
+        // the token is checked once per block
+        if (token && token->expired())
+          return false;
+        unsigned int n = std::min(blockWords, end - block);
+        std::fill(planes.begin(), planes.end(), 0);
+        HELIUM_COUNT(TanimotosComputed, std::min<unsigned int>((block + n) * BitsPerWord, storage.numFingerprints()) -
+            block * BitsPerWord);
+
+        for (std::size_t i = 0; i < bits.size(); ++i) {
+          const Word *column = storage.bit(bits[i]) + block;
+          std::copy(column, column + n, carry.begin());
+          Word any = 1;
+          for (unsigned int p = 0; p < numPlanes && any; ++p) {
+            Word *plane = &planes[p * blockWords];
+            any = 0;
+            for (unsigned int j = 0; j < n; ++j) {
+              Word overflow = plane[j] & carry[j];
+              plane[j] ^= carry[j];
+              carry[j] = overflow;
+              any |= overflow;
+            }
+          }
+        }
+
+        for (unsigned int j = 0; j < n; ++j) {
+          unsigned int first = (block + j) * BitsPerWord;
+          unsigned int last = std::min<unsigned int>(first + BitsPerWord, storage.numFingerprints());
+          for (unsigned int index = first; index < last; ++index) {
+            int andCount = 0;
+            for (unsigned int p = 0; p < numPlanes; ++p)
+              andCount |= static_cast<int>((planes[p * blockWords + j] >> (index - first)) & 1) << p;
+            double T = static_cast<double>(andCount) / (queryCount + storage.bitCount(index) - andCount);
+            if (T >= Tmin && !sink(index, T))
+              return false;
+          }
+        }
+      }
+
+      return true;
+    }
+
+  }
+
+  /**
+   * @brief Bit-sliced similarity search using column-major fingerprints.
+   *
+   * This function computes the same hits as brute_force_similarity_search()
+   * but uses a column-major storage (see ColumnMajorFingerprintStorageConcept)
+   * instead of a row-major storage. Only the columns for the set query bits
+   * are read, these are summed using vertical counters to get the
+   * intersection counts for 64 fingerprints per word operation. The
+   * intersection counts are combined with the cached bit counts to compute
+   * the tanimoto coefficients. This allows the same (column-major) storage
+   * to be used for both substructure and similarity searches.
+   *
+   * @param query The query fingerprint.
+   * @param storage The column-major fingerprints to search.
+   * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   *
+   * @return The lists of hits as (index, tanimoto) pairs sorted by index.
+   */
+  template<typename ColumnMajorFingerprintStorageType>
+  std::vector<std::pair<unsigned int, double> > bitsliced_similarity_search(const Word *query,
+      const ColumnMajorFingerprintStorageType &storage, double Tmin)
+  {
+    TIMER("bitsliced_similarity_search():");
+    std::vector<std::pair<unsigned int, double> > result;
+    impl::PushBackHits sink(result);
+    impl::bitsliced_similarity_search_range(impl::query_bits(query, storage.numBits()), storage, 0,
+        bitvec_num_words_for_bits(storage.numFingerprints()), Tmin, sink);
+    return result;
+  }
+
+  /**
+   * @brief Streaming bit-sliced similarity search.
+   *
+   * This function is the same as bitsliced_similarity_search() except that
+   * hits are passed to the @p sink as soon as they are found (see the
+   * streaming brute_force_similarity_search()). Hits are reported in
+   * ascending index order.
+   *
+   * @param query The query fingerprint.
+   * @param storage The column-major fingerprints to search.
+   * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   * @param sink The function object that receives the hits.
+   * @param token Optional cancellation token.
+   *
+   * @return False if the search was stopped by the sink or the token, true
+   *         otherwise.
+   */
+  template<typename ColumnMajorFingerprintStorageType, typename HitSink>
+  bool bitsliced_similarity_search(const Word *query, const ColumnMajorFingerprintStorageType &storage,
+      double Tmin, HitSink &sink, const CancellationToken *token = 0)
+  {
+    TIMER("bitsliced_similarity_search():");
+    return impl::bitsliced_similarity_search_range(impl::query_bits(query, storage.numBits()), storage, 0,
+        bitvec_num_words_for_bits(storage.numFingerprints()), Tmin, sink, token);
+  }
+
+#ifdef HAVE_CPP11
+  /**
+   * @brief Threaded bit-sliced similarity search using column-major fingerprints.
+   *
+   * The words of the columns are divided in chunks which are searched by
+   * the threads of the thread pool. The result is the same as for
+   * bitsliced_similarity_search().
+   *
+   * @note This function is only available when C++11 support is enabled.
+   *
+   * @param query The query fingerprint.
+   * @param storage The column-major fingerprints to search.
+   * @param Tmin The minimum tanimoto score, must be in the range [0,1].
+   * @param pool The thread pool to use.
+   *
+   * @return The lists of hits as (index, tanimoto) pairs sorted by index.
+   */
+  template<typename ColumnMajorFingerprintStorageType>
+  std::vector<std::pair<unsigned int, double> > bitsliced_similarity_search_threaded(const Word *query,
+      const ColumnMajorFingerprintStorageType &storage, double Tmin, ThreadPool &pool = ThreadPool::global())
+  {
+    TIMER("bitsliced_similarity_search_threaded():");
+    std::vector<unsigned int> bits = impl::query_bits(query, storage.numBits());
+    unsigned int numWords = bitvec_num_words_for_bits(storage.numFingerprints());
+
+    typedef std::vector<std::pair<unsigned int, double> > SimilaritySearchResult;
+
+    // each chunk has its own result so no locking is needed
+    std::size_t chunkSize = pool.chunkSize(numWords, 16);
+    std::vector<SimilaritySearchResult> results((numWords + chunkSize - 1) / chunkSize);
+    pool.parallelFor(numWords, chunkSize, [&] (std::size_t begin, std::size_t end) {
+      impl::PushBackHits sink(results[begin / chunkSize]);
+      impl::bitsliced_similarity_search_range(bits, storage, begin, end, Tmin, sink);
+    });
+
+    // the chunks are ordered so the hits remain sorted by index
+    SimilaritySearchResult result;
+    for (std::size_t i = 0; i < results.size(); ++i)
+      std::copy(results[i].begin(), results[i].end(), std::back_inserter(result));
+
+    return result;
+  }
+#endif
+
+  /**
+   * @brief Similarity search fingerpint index.
+   *
+   * The @p Metric template parameter is the similarity metric policy (see
+   * @ref similarity_metrics). The policy supplies the score and the bit
+   * count bounds used to prune the kD-grid. The kD-grid itself does not
+   * depend on the metric so index files can be used with all metrics.
+   */
+  template<typename FingerprintStorageType, typename Metric = TanimotoMetric>
+  class SimilaritySearchIndex
+  {
+      /**
+       * Base class for tree nodes in the kD-grid.
+       */
+      struct Node
+      {
+      };
+
+      /**
+       * An intermediate tree node in the kD-grid.
+       */
+      struct TreeNode : public Node
+      {
+        /**
+         * Constructor.
+         *
          * @param size The number of children.
          */
         TreeNode(int size)
@@ -219,30 +1188,102 @@ namespace Helium {
         std::vector<unsigned int> fingerprints; //!< The fingerprint indices
       };
 
+      /**
+       * Compact (frozen) kD-grid. The nodes at each depth are stored in
+       * compressed sparse row (CSR) form: only non-empty children are stored
+       * and the children of a node are contiguous and sorted by bin. The
+       * fingerprints are copied in leaf order so all fingerprints in a leaf
+       * are contiguous in memory.
+       *
+       * The arrays are accessed through pointers which either point to the
+       * data owned by this object (freeze()) or to a memory mapped index file
+       * (see save()).
+       */
+      struct FrozenTree
+      {
+        /**
+         * For d < k, the children of node n at depth d are the nodes
+         * [first[d][n], first[d][n+1]) at depth d + 1. For d = k, the
+         * fingerprints in leaf n are at positions [first[k][n], first[k][n+1]).
+         */
+        std::vector<const unsigned int*> first;
+        /**
+         * The bin (i.e. bit count for the part) of node n at depth d is
+         * bins[d][n] (d > 0).
+         */
+        std::vector<const unsigned short*> bins;
+        const unsigned int *order; //!< Fingerprint index for each position
+        const Word *fingerprints; //!< Fingerprints in leaf order
+        std::vector<unsigned int> numNodes; //!< The number of nodes at each depth
+
+        // data for an index that is frozen in memory
+        std::vector<std::vector<unsigned int> > firstData;
+        std::vector<std::vector<unsigned short> > binsData;
+        std::vector<unsigned int> orderData;
+        std::vector<Word> fingerprintsData;
+        // data for an index loaded from file
+        boost::iostreams::mapped_file_source mappedFile;
+      };
+
+      /**
+       * Get a pointer to the data of a vector (0 if the vector is empty).
+       */
+      template<typename T>
+      static const T* data(const std::vector<T> &v)
+      {
+        return v.empty() ? 0 : &v[0];
+      }
+
+      /**
+       * Round @p bytes up to a multiple of 8 bytes. All arrays in an index
+       * file are padded to keep the fingerprints and indices aligned.
+       */
+      static std::size_t paddedSize(std::size_t bytes)
+      {
+        return (bytes + 7) & ~static_cast<std::size_t>(7);
+      }
+
+      static void writePadded(BinaryOutputFile &file, const void *data, std::size_t bytes)
+      {
+        const char padding[8] = { 0 };
+        if (bytes)
+          file.write(static_cast<const char*>(data), bytes);
+        file.write(padding, paddedSize(bytes) - bytes);
+      }
+
+      /**
+       * Get the size of the binary data in an index file (see save()).
+       */
+      std::size_t bodySize(const std::vector<unsigned int> &numNodes) const
+      {
+        std::size_t size = paddedSize(static_cast<std::size_t>(m_numFingerprints) * m_numWords * sizeof(Word));
+        size += paddedSize(m_numFingerprints * sizeof(unsigned int));
+        for (int d = 0; d <= m_k; ++d)
+          size += paddedSize((numNodes[d] + 1) * sizeof(unsigned int));
+        for (int d = 1; d <= m_k; ++d)
+          size += paddedSize(numNodes[d] * sizeof(unsigned short));
+        return size;
+      }
+
       /**
        * Get the bit count for the portion of the fingerprint at a certain
        * depth.
        */
       int bitCount(const Word *fingerprint, int depth) const
       {
-        int beginBit = depth * (m_numBits / m_k);
-        int endBit = (depth + 1) * (m_numBits / m_k);
-
-        if (depth == m_k - 1)
-          endBit = (depth + 1) * (m_numBits / m_k) + (m_numBits % ((depth + 1) * (m_numBits / m_k)));
-
-        return bitvec_count(fingerprint, beginBit, endBit);
+        return bitvec_part_count(fingerprint, m_numBits, m_k, depth);
       }
 
       int childSize() const
       {
-        return m_numBits / m_k + 1;
+        // the last part also contains the remaining bits
+        return m_numBits - (m_k - 1) * (m_numBits / m_k) + 1;
       }
 
-      std::vector<unsigned int>& findLeaf(const Word *fingerprint)
+      std::vector<unsigned int>& findLeaf(TreeNode *root, const Word *fingerprint)
       {
         int depth = 0;
-        TreeNode *node = m_tree;
+        TreeNode *node = root;
 
         while (depth < m_k) {
           int count = bitCount(fingerprint, depth);
@@ -269,126 +1310,1477 @@ namespace Helium {
         UNREACHABLE_RETURN_REF(std::vector<unsigned int>);
       }
 
-      void tanimotoDFS(const Word *fingerprint, double threshold, unsigned int maxResults,
-          TreeNode *node, int depth, int *n_j, int *bitCounts, int bitCount,
-          std::vector<std::pair<unsigned int, double> > &hits) const
+      /**
+       * Remove a fingerprint index from the leaf for @p fingerprint in the
+       * tree with the specified @p root.
+       *
+       * @return True if the index was found and removed.
+       */
+      bool removeFromLeaf(TreeNode *root, const Word *fingerprint, unsigned int index)
       {
-        // bound on the number of 1-bits in logical and (first part of bitstring)
-        int A_i_min = 0;
-        for (int i = 0; i < depth; ++i)
-          A_i_min += std::min(bitCounts[i], n_j[i]);
+        TreeNode *node = root;
+        for (int depth = 0; depth < m_k; ++depth) {
+          Node *child = node->children[bitCount(fingerprint, depth)];
+          if (!child)
+            return false;
+          if (depth == m_k - 1) {
+            std::vector<unsigned int> &fingerprints = static_cast<LeafNode*>(child)->fingerprints;
+            std::vector<unsigned int>::iterator i = std::find(fingerprints.begin(), fingerprints.end(), index);
+            if (i == fingerprints.end())
+              return false;
+            fingerprints.erase(i);
+            return true;
+          }
+          node = static_cast<TreeNode*>(child);
+        }
 
-        // bound on the number of 1-bits in logical or (first part of bitstring)
-        int A_i_max = 0;
-        for (int i = 0; i < depth; ++i)
-          A_i_max += std::max(bitCounts[i], n_j[i]);
+        return false;
+      }
 
-        // bound on last part of bitstring
-        int A_i_last = 0;
-        for (int i = depth + 1; i < m_k; ++i)
-          A_i_last += bitCounts[i];
+      /**
+       * Hit collector for threshold searches. All hits with a score
+       * above the threshold are collected until the maximum number of
+       * results is reached.
+       */
+      struct ThresholdHits
+      {
+        enum { nearestFirst = false };
 
-        // bitcount of current part
-        int A_i = bitCounts[depth];
-        // number of bins in the current part
-        int N_i = childSize() - 1;
+        ThresholdHits(double threshold_, unsigned int maxResults_,
+            std::vector<std::pair<unsigned int, double> > &hits_)
+          : Tmin(threshold_), maxResults(maxResults_), hits(hits_)
+        {
+        }
 
-        int n_lower = std::max(static_cast<int>(std::ceil(threshold * (A_i_max + A_i + A_i_last) - (A_i_min + A_i_last))), 0);
-        int n_upper = threshold == 0.0 ? N_i : std::min(static_cast<int>(std::floor((A_i_min + A_i + A_i_last - threshold * (A_i_max + A_i_last)) / threshold)), N_i);
-        assert(n_lower >= 0);
-        assert(n_upper <= N_i);
+        double threshold() const
+        {
+          return Tmin;
+        }
 
-        ++depth;
+        void add(unsigned int index, double S)
+        {
+          if (S >= Tmin)
+            hits.push_back(std::make_pair(index, S));
+        }
 
-        if (depth == m_k) {
-          int bitCountB = std::accumulate(n_j, n_j + m_k, 0);
+        bool done() const
+        {
+          return hits.size() == maxResults;
+        }
 
-          for (int i = n_lower; i < n_upper + 1; ++i) {
-            if (!node->children[i])
-              continue;
-            LeafNode *leaf = static_cast<LeafNode*>(node->children[i]);
+        double Tmin;
+        unsigned int maxResults;
+        std::vector<std::pair<unsigned int, double> > &hits;
+      };
 
-            assert(leaf);
-            for (std::size_t j = 0; j < leaf->fingerprints.size(); ++j) {
-              double S = bitvec_tanimoto(fingerprint, m_storage.fingerprint(leaf->fingerprints[j]), bitCount, bitCountB + i, bitvec_num_words_for_bits(m_numBits));
-              if (S >= threshold)
-                hits.push_back(std::make_pair(leaf->fingerprints[j], S));
-              if (hits.size() == maxResults)
-                return;
-            }
-          }
-          return;
+      /**
+       * Hit collector for streaming threshold searches. The hits are passed
+       * to the sink and the search is done when the sink returns false.
+       */
+      template<typename HitSink>
+      struct SinkHits
+      {
+        enum { nearestFirst = false };
+
+        SinkHits(double threshold_, HitSink &sink_)
+          : Tmin(threshold_), sink(sink_), stopped(false)
+        {
         }
 
-        for (int i = n_lower; i < n_upper + 1; ++i) {
-          if (!node->children[i])
-            continue;
-          n_j[depth - 1] = i;
-          tanimotoDFS(fingerprint, threshold, maxResults, static_cast<TreeNode*>(node->children[i]), depth, n_j, bitCounts, bitCount, hits);
-          if (hits.size() == maxResults)
-            return;
+        double threshold() const
+        {
+          return Tmin;
         }
-      }
 
-      void clearDFS(TreeNode *node, int depth)
-      {
-        ++depth;
+        void add(unsigned int index, double S)
+        {
+          if (S >= Tmin && !stopped)
+            stopped = !sink(index, S);
+        }
 
-        for (int i = 0; i < node->children.size(); ++i) {
-          if (!node->children[i])
-            continue;
-          if (depth < m_k)
-            clearDFS(static_cast<TreeNode*>(node->children[i]), depth); // recurse
-          else
-            delete node->children[i]; // delete leaf node
+        bool done() const
+        {
+          return stopped;
         }
 
-        delete node;
-      }
+        double Tmin;
+        HitSink &sink;
+        bool stopped;
+      };
 
-    public:
       /**
-       * @brief Constructor.
-       *
-       * @pre The @p k parameter must be greater than 1.
-       *
-       * @param storage The fingerprint storage to index.
-       * @param k The number of parts to divide the fingerprints in (optimal values range from 1 to 4.
+       * Hit collector wrapper that drops the removed fingerprints of a
+       * frozen index (see remove()).
        */
-      SimilaritySearchIndex(const FingerprintStorageType &storage, int k)
-          : m_storage(storage), m_k(k), m_numBits(storage.numBits())
+      template<typename HitCollector>
+      struct LiveHits
       {
-        PRE(k > 0);
-        TIMER("Loading SimilaritySearchIndex:");
+        enum { nearestFirst = HitCollector::nearestFirst };
 
-        m_tree = new TreeNode(m_numBits / m_k + 1);
+        LiveHits(HitCollector &collector_, const std::vector<bool> &removed_)
+          : collector(collector_), removed(removed_)
+        {
+        }
 
-        for (unsigned int i = 0; i < m_storage.numFingerprints(); ++i)
-          findLeaf(m_storage.fingerprint(i)).push_back(i);
-      }
+        double threshold() const
+        {
+          return collector.threshold();
+        }
+
+        void add(unsigned int index, double S)
+        {
+          if (index >= removed.size() || !removed[index])
+            collector.add(index, S);
+        }
+
+        bool done() const
+        {
+          return collector.done();
+        }
+
+        HitCollector &collector;
+        const std::vector<bool> &removed;
+      };
 
       /**
-       * @brief Destructor.
+       * Hit collector wrapper that stops the search when the cancellation
+       * token expires. The token is checked every 256 calls to done().
        */
-      ~SimilaritySearchIndex()
+      template<typename HitCollector>
+      struct CancellableHits
       {
-        clearDFS(m_tree, 0);
-        //delete m_tree;
-      }
+        enum { nearestFirst = HitCollector::nearestFirst };
 
-#ifdef HAVE_CPP11
-      // do not allow SimilaritySearchIndex to be copied
-      SimilaritySearchIndex(const SimilaritySearchIndex<FingerprintStorageType> &other) = delete;
-      SimilaritySearchIndex<FingerprintStorageType>& operator=(const SimilaritySearchIndex<FingerprintStorageType> &other) = delete;
-#endif
+        CancellableHits(HitCollector &collector_, const CancellationToken &token)
+          : collector(collector_), cancelled(&token)
+        {
+        }
 
-      std::vector<std::pair<unsigned int, double> > search(const Word *fingerprint, double threshold, unsigned int maxResults = 0) const
-      {
-        TIMER("SimilaritySearchIndex::search():");
+        double threshold() const
+        {
+          return collector.threshold();
+        }
 
-        if (!maxResults)
-          maxResults = std::numeric_limits<unsigned>::max();
+        void add(unsigned int index, double S)
+        {
+          collector.add(index, S);
+        }
+
+        bool done() const
+        {
+          return collector.done() || cancelled();
+        }
+
+        HitCollector &collector;
+        mutable CancellationCheck cancelled;
+      };
+
+      /**
+       * Hit collector that only counts the scored fingerprints.
+       */
+      struct ScoredCount
+      {
+        enum { nearestFirst = false };
+
+        ScoredCount(double threshold_) : Tmin(threshold_), count(0)
+        {
+        }
+
+        double threshold() const
+        {
+          return Tmin;
+        }
+
+        void add(unsigned int, double)
+        {
+          ++count;
+        }
+
+        bool done() const
+        {
+          return false;
+        }
+
+        double Tmin;
+        unsigned int count;
+      };
+
+      typedef impl::KnnHits KnnHits;
+
+#ifdef HAVE_CPP11
+      /**
+       * Hit collector for the subtree tasks of a parallel k-nearest neighbor
+       * search. The threshold is shared between the tasks: when a task has
+       * found k hits, the shared threshold is raised to its k-th best score so
+       * the other tasks can prune the kD-grid using the best hits found so far.
+       */
+      struct SharedKnnHits : public KnnHits
+      {
+        SharedKnnHits(double threshold_, unsigned int k_, std::atomic<double> &shared_)
+          : KnnHits(threshold_, k_), shared(shared_)
+        {
+        }
+
+        double threshold() const
+        {
+          return std::max(KnnHits::threshold(), shared.load(std::memory_order_relaxed));
+        }
+
+        void add(unsigned int index, double S)
+        {
+          if (S < shared.load(std::memory_order_relaxed))
+            return;
+          KnnHits::add(index, S);
+          if (this->heap.size() < this->k)
+            return;
+          // raise the shared threshold
+          double worst = this->heap.front().second;
+          double current = shared.load(std::memory_order_relaxed);
+          while (current < worst && !shared.compare_exchange_weak(current, worst, std::memory_order_relaxed))
+            ;
+        }
+
+        std::atomic<double> &shared;
+      };
+#endif
+
+      /**
+       * Compute the range [n_lower,n_upper] of bins at @p depth that may
+       * contain fingerprints with a score above @p threshold.
+       */
+      void binBounds(double threshold, int depth, const int *n_j, const int *bitCounts,
+          int &n_lower, int &n_upper) const
+      {
+        PartialBitCounts counts;
+        // bound on the number of 1-bits in logical and/or (first part of bitstring)
+        counts.andCount = 0;
+        counts.orCount = 0;
+        counts.knownCount = 0;
+        for (int i = 0; i < depth; ++i) {
+          counts.andCount += std::min(bitCounts[i], n_j[i]);
+          counts.orCount += std::max(bitCounts[i], n_j[i]);
+          counts.knownCount += n_j[i];
+        }
+
+        // bound on last part of bitstring
+        counts.remaining = 0;
+        for (int i = depth + 1; i < m_k; ++i)
+          counts.remaining += bitCounts[i];
+
+        counts.queryCount = std::accumulate(bitCounts, bitCounts + m_k, 0);
+        // bitcount of current part
+        counts.current = bitCounts[depth];
+        // number of bins in the current part
+        counts.numBins = childSize() - 1;
+        counts.numBits = metricBits();
+
+        Metric::binBounds(threshold, counts, n_lower, n_upper);
+        assert(n_lower >= 0);
+        assert(n_upper <= counts.numBins);
+      }
+
+      /**
+       * Get the number of bits (m) used by the metric.
+       */
+      int metricBits() const
+      {
+        return m_numWords * 8 * sizeof(Word);
+      }
+
+      /**
+       * Get the i-th bin to visit in the range [n_lower,n_upper]. When
+       * @p nearestFirst is true, the bins closest to the query's bit count
+       * @p A_i are visited first.
+       */
+      static int binOrder(int i, int n_lower, int n_upper, int A_i, bool nearestFirst)
+      {
+        if (!nearestFirst)
+          return n_lower + i;
+        int center = std::min(std::max(A_i, n_lower), n_upper);
+        // number of bins on both sides of center
+        int below = center - n_lower;
+        int above = n_upper - center;
+        int both = std::min(below, above);
+        if (i <= 2 * both)
+          return (i & 1) ? center + (i + 1) / 2 : center - i / 2;
+        int j = i - 2 * both;
+        return below > above ? center - both - j : center + both + j;
+      }
+
+      template<typename HitCollector>
+      void treeDFS(const Word *fingerprint, HitCollector &collector,
+          TreeNode *node, int depth, int *n_j, int *bitCounts, int bitCount) const
+      {
+        HELIUM_COUNT(KdGridNodesVisited, 1);
+        double threshold = collector.threshold();
+        int n_lower, n_upper;
+        binBounds(threshold, depth, n_j, bitCounts, n_lower, n_upper);
+        int A_i = bitCounts[depth];
+
+        ++depth;
+
+        if (depth == m_k) {
+          int bitCountB = std::accumulate(n_j, n_j + m_k - 1, 0);
+
+          for (int b = 0; b <= n_upper - n_lower; ++b) {
+            int i = binOrder(b, n_lower, n_upper, A_i, HitCollector::nearestFirst);
+            if (!node->children[i])
+              continue;
+            // the threshold may have been raised (k-NN search)
+            if (collector.threshold() != threshold) {
+              int lower, upper;
+              binBounds(collector.threshold(), depth - 1, n_j, bitCounts, lower, upper);
+              if (i < lower || i > upper)
+                continue;
+            }
+            LeafNode *leaf = static_cast<LeafNode*>(node->children[i]);
+
+            assert(leaf);
+            HELIUM_COUNT(LeavesScanned, 1);
+            HELIUM_COUNT(TanimotosComputed, leaf->fingerprints.size());
+            for (std::size_t j = 0; j < leaf->fingerprints.size(); ++j) {
+              int andCount = m_kernels->andCount(fingerprint, m_storage->fingerprint(leaf->fingerprints[j]), m_numWords);
+              double S = Metric::score(andCount, bitCount, bitCountB + i, metricBits());
+              collector.add(leaf->fingerprints[j], S);
+              if (collector.done())
+                return;
+            }
+          }
+          return;
+        }
+
+        for (int b = 0; b <= n_upper - n_lower; ++b) {
+          int i = binOrder(b, n_lower, n_upper, A_i, HitCollector::nearestFirst);
+          if (!node->children[i])
+            continue;
+          // the threshold may have been raised (k-NN search)
+          if (collector.threshold() != threshold) {
+            int lower, upper;
+            binBounds(collector.threshold(), depth - 1, n_j, bitCounts, lower, upper);
+            if (i < lower || i > upper)
+              continue;
+          }
+          n_j[depth - 1] = i;
+          treeDFS(fingerprint, collector, static_cast<TreeNode*>(node->children[i]), depth, n_j, bitCounts, bitCount);
+          if (collector.done())
+            return;
+        }
+      }
+
+      template<typename HitCollector>
+      void frozenDFS(const Word *fingerprint, HitCollector &collector,
+          unsigned int node, int depth, int *n_j, int *bitCounts, int bitCount) const
+      {
+        // no children (empty index)
+        if (m_frozen->first[depth][node] == m_frozen->first[depth][node + 1])
+          return;
+        HELIUM_COUNT(KdGridNodesVisited, 1);
+
+        double threshold = collector.threshold();
+        int n_lower, n_upper;
+        binBounds(threshold, depth, n_j, bitCounts, n_lower, n_upper);
+        int A_i = bitCounts[depth];
+
+        // children with bins in the range [n_lower,n_upper]
+        const unsigned short *bins = m_frozen->bins[depth + 1];
+        const unsigned short *lo = std::lower_bound(bins + m_frozen->first[depth][node],
+            bins + m_frozen->first[depth][node + 1], n_lower);
+        const unsigned short *hi = std::upper_bound(lo, bins + m_frozen->first[depth][node + 1], n_upper);
+
+        // visit the children (nearest bins first for k-NN search)
+        const unsigned short *right = HitCollector::nearestFirst ? std::lower_bound(lo, hi, A_i) : lo;
+        const unsigned short *left = right - 1;
+        while (right < hi || left >= lo) {
+          const unsigned short *child;
+          if (right < hi && (left < lo || *right - A_i <= A_i - *left))
+            child = right++;
+          else
+            child = left--;
+
+          int i = *child;
+          unsigned int c = child - bins;
+
+          // the threshold may have been raised (k-NN search)
+          if (collector.threshold() != threshold) {
+            int lower, upper;
+            binBounds(collector.threshold(), depth, n_j, bitCounts, lower, upper);
+            if (i < lower || i > upper)
+              continue;
+          }
+
+          if (depth + 1 == m_k) {
+            // scan the contiguous fingerprints in the leaf
+            int bitCountB = std::accumulate(n_j, n_j + m_k - 1, 0) + i;
+            const Word *fp = m_frozen->fingerprints + static_cast<std::size_t>(m_frozen->first[m_k][c]) * m_numWords;
+            HELIUM_COUNT(LeavesScanned, 1);
+            HELIUM_COUNT(TanimotosComputed, m_frozen->first[m_k][c + 1] - m_frozen->first[m_k][c]);
+            for (unsigned int j = m_frozen->first[m_k][c]; j < m_frozen->first[m_k][c + 1]; ++j, fp += m_numWords) {
+              int andCount = m_kernels->andCount(fingerprint, fp, m_numWords);
+              double S = Metric::score(andCount, bitCount, bitCountB, metricBits());
+              collector.add(m_frozen->order[j], S);
+              if (collector.done())
+                return;
+            }
+          } else {
+            n_j[depth] = i;
+            frozenDFS(fingerprint, collector, c, depth + 1, n_j, bitCounts, bitCount);
+            if (collector.done())
+              return;
+          }
+        }
+      }
+
+      /**
+       * Add the children of @p node to the frozen tree (pre-order).
+       */
+      void freezeDFS(TreeNode *node, int depth, FrozenTree &frozen)
+      {
+        for (std::size_t i = 0; i < node->children.size(); ++i) {
+          if (!node->children[i])
+            continue;
+          frozen.binsData[depth + 1].push_back(i);
+          if (depth + 1 == m_k) {
+            LeafNode *leaf = static_cast<LeafNode*>(node->children[i]);
+            frozen.firstData[m_k].push_back(frozen.orderData.size());
+            std::copy(leaf->fingerprints.begin(), leaf->fingerprints.end(), std::back_inserter(frozen.orderData));
+          } else {
+            frozen.firstData[depth + 1].push_back(frozen.binsData[depth + 2].size());
+            freezeDFS(static_cast<TreeNode*>(node->children[i]), depth + 1, frozen);
+          }
+        }
+      }
+
+      /**
+       * Append the fingerprint indices in the leaves of @p node.
+       */
+      void leavesDFS(TreeNode *node, int depth, std::vector<unsigned int> &indices) const
+      {
+        ++depth;
+
+        for (std::size_t i = 0; i < node->children.size(); ++i) {
+          if (!node->children[i])
+            continue;
+          if (depth < m_k) {
+            leavesDFS(static_cast<TreeNode*>(node->children[i]), depth, indices);
+          } else {
+            const std::vector<unsigned int> &fingerprints = static_cast<LeafNode*>(node->children[i])->fingerprints;
+            std::copy(fingerprints.begin(), fingerprints.end(), std::back_inserter(indices));
+          }
+        }
+      }
+
+      std::size_t sizeInBytesDFS(const TreeNode *node, int depth) const
+      {
+        ++depth;
+
+        std::size_t size = sizeof(TreeNode) + vector_memory_usage(node->children);
+        for (int i = 0; i < node->children.size(); ++i) {
+          if (!node->children[i])
+            continue;
+          if (depth < m_k) {
+            size += sizeInBytesDFS(static_cast<const TreeNode*>(node->children[i]), depth); // recurse
+          } else {
+            const LeafNode *leaf = static_cast<const LeafNode*>(node->children[i]);
+            size += sizeof(LeafNode) + vector_memory_usage(leaf->fingerprints);
+          }
+        }
+
+        return size;
+      }
+
+      void clearDFS(TreeNode *node, int depth)
+      {
+        ++depth;
+
+        for (int i = 0; i < node->children.size(); ++i) {
+          if (!node->children[i])
+            continue;
+          if (depth < m_k)
+            clearDFS(static_cast<TreeNode*>(node->children[i]), depth); // recurse
+          else
+            delete node->children[i]; // delete leaf node
+        }
+
+        delete node;
+      }
+
+      /**
+       * State for building the frozen index directly (see
+       * SimilaritySearchIndex(const FingerprintStorageType&, int, unsigned int)).
+       */
+      struct BuildState
+      {
+        unsigned int numThreads;
+        unsigned int taskSize;
+        int depth; //!< The part used for the current radix sort pass
+        std::vector<unsigned short> keys; //!< The bit count for each part (m_k per fingerprint)
+        std::vector<unsigned int> order; //!< The fingerprints sorted by key
+        std::vector<unsigned int> tmp; //!< Output for the current radix sort pass
+        std::vector<std::vector<unsigned int> > histograms; //!< Per thread bucket counts/offsets
+        FrozenTree *frozen;
+      };
+
+      typedef void (SimilaritySearchIndex::*BuildPhase)(BuildState&, unsigned int, unsigned int, unsigned int) const;
+
+      /**
+       * Run a build phase for the range [0,n) split over the build threads.
+       */
+      void runBuildPhase(BuildPhase phase, BuildState &state, unsigned int n) const
+      {
+        state.taskSize = n / state.numThreads + 1;
+#ifdef HAVE_CPP11
+        if (state.numThreads > 1) {
+          ThreadPool::global().parallelFor(state.numThreads, 1, [&] (std::size_t begin, std::size_t end) {
+            for (std::size_t t = begin; t < end; ++t)
+              (this->*phase)(state, t, std::min<unsigned int>(n, t * state.taskSize),
+                  std::min<unsigned int>(n, (t + 1) * state.taskSize));
+          });
+          return;
+        }
+#endif
+        for (unsigned int t = 0; t < state.numThreads; ++t)
+          (this->*phase)(state, t, std::min(n, t * state.taskSize), std::min(n, (t + 1) * state.taskSize));
+      }
+
+      void computeKeys(BuildState &state, unsigned int, unsigned int begin, unsigned int end) const
+      {
+        // use the part counts stored in the fingerprint file if available
+        const uint16_t *partCounts = m_storage->partCounts(m_k);
+        if (partCounts) {
+          std::copy(partCounts + static_cast<std::size_t>(begin) * m_k, partCounts + static_cast<std::size_t>(end) * m_k,
+              state.keys.begin() + static_cast<std::size_t>(begin) * m_k);
+          return;
+        }
+
+        for (unsigned int i = begin; i < end; ++i)
+          for (int d = 0; d < m_k; ++d)
+            state.keys[static_cast<std::size_t>(i) * m_k + d] = bitCount(m_storage->fingerprint(i), d);
+      }
+
+      void countKeys(BuildState &state, unsigned int thread, unsigned int begin, unsigned int end) const
+      {
+        std::vector<unsigned int> &histogram = state.histograms[thread];
+        std::fill(histogram.begin(), histogram.end(), 0);
+        for (unsigned int p = begin; p < end; ++p)
+          ++histogram[state.keys[static_cast<std::size_t>(state.order[p]) * m_k + state.depth]];
+      }
+
+      void scatterKeys(BuildState &state, unsigned int thread, unsigned int begin, unsigned int end) const
+      {
+        std::vector<unsigned int> &offsets = state.histograms[thread];
+        for (unsigned int p = begin; p < end; ++p)
+          state.tmp[offsets[state.keys[static_cast<std::size_t>(state.order[p]) * m_k + state.depth]]++] = state.order[p];
+      }
+
+      void copyFingerprints(BuildState &state, unsigned int, unsigned int begin, unsigned int end) const
+      {
+        for (unsigned int p = begin; p < end; ++p)
+          std::copy(m_storage->fingerprint(state.order[p]), m_storage->fingerprint(state.order[p]) + m_numWords,
+              &state.frozen->fingerprintsData[0] + static_cast<std::size_t>(p) * m_numWords);
+      }
+
+      /**
+       * Add the end offsets to the CSR arrays and set the pointers to the
+       * arrays of a frozen tree built in memory.
+       */
+      void finishFrozenTree(FrozenTree *frozen) const
+      {
+        for (int d = 0; d < m_k; ++d)
+          frozen->firstData[d].push_back(frozen->binsData[d + 1].size());
+        frozen->firstData[m_k].push_back(frozen->orderData.size());
+
+        for (int d = 0; d <= m_k; ++d) {
+          frozen->first.push_back(data(frozen->firstData[d]));
+          frozen->bins.push_back(data(frozen->binsData[d]));
+          frozen->numNodes.push_back(frozen->firstData[d].size() - 1);
+        }
+        frozen->order = data(frozen->orderData);
+        frozen->fingerprints = data(frozen->fingerprintsData);
+      }
+
+    public:
+      /**
+       * @brief Constructor.
+       *
+       * @pre The @p k parameter must be greater than 1.
+       *
+       * @param storage The fingerprint storage to index.
+       * @param k The number of parts to divide the fingerprints in (optimal values range from 1 to 4.
+       */
+      SimilaritySearchIndex(const FingerprintStorageType &storage, int k)
+          : m_storage(&storage), m_header(storage.header()), m_k(k), m_numBits(storage.numBits()),
+          m_numFingerprints(storage.numFingerprints()), m_numWords(bitvec_num_words_for_bits(m_numBits)),
+          m_kernels(&impl::bitvec_kernels_for_words(m_numWords)), m_frozen(0), m_delta(0), m_numDelta(0),
+          m_numRemoved(0)
+      {
+        PRE(k > 0);
+        TIMER("Loading SimilaritySearchIndex:");
+
+        m_tree = new TreeNode(childSize());
+
+        for (unsigned int i = 0; i < m_numFingerprints; ++i)
+          findLeaf(m_tree, m_storage->fingerprint(i)).push_back(i);
+      }
+
+      /**
+       * @brief Constructor.
+       *
+       * Build a frozen index (see freeze()) directly without building the
+       * pointer based kD-grid first. The bit counts for the parts of all
+       * fingerprints are computed in parallel, the fingerprints are sorted
+       * by these keys using a parallel (stable) radix sort and the compact
+       * kD-grid is built from the sorted keys. There are no allocations per
+       * fingerprint and the resulting index is the same as the index built
+       * using the SimilaritySearchIndex(const FingerprintStorageType&, int)
+       * constructor followed by freeze().
+       *
+       * @pre The @p k parameter must be greater than 1.
+       *
+       * @param storage The fingerprint storage to index.
+       * @param k The number of parts to divide the fingerprints in (optimal values range from 1 to 4.
+       * @param numThreads The number of tasks to divide the work in, 0 to use
+       *        the number of threads in the global ThreadPool. Without C++11
+       *        support a single thread is used.
+       */
+      SimilaritySearchIndex(const FingerprintStorageType &storage, int k, unsigned int numThreads)
+          : m_storage(&storage), m_header(storage.header()), m_tree(0), m_k(k), m_numBits(storage.numBits()),
+          m_numFingerprints(storage.numFingerprints()), m_numWords(bitvec_num_words_for_bits(m_numBits)),
+          m_kernels(&impl::bitvec_kernels_for_words(m_numWords)), m_frozen(0), m_delta(0), m_numDelta(0),
+          m_numRemoved(0)
+      {
+        PRE(k > 0);
+        TIMER("Building frozen SimilaritySearchIndex:");
+
+        BuildState state;
+#ifdef HAVE_CPP11
+        if (!numThreads)
+          numThreads = ThreadPool::global().numThreads();
+#else
+        numThreads = 1;
+#endif
+        state.numThreads = numThreads;
+        state.histograms.resize(numThreads, std::vector<unsigned int>(childSize()));
+
+        // compute the keys
+        state.keys.resize(static_cast<std::size_t>(m_numFingerprints) * m_k);
+        runBuildPhase(&SimilaritySearchIndex::computeKeys, state, m_numFingerprints);
+
+        // sort the fingerprints by key (LSD radix sort, one pass per part)
+        state.order.resize(m_numFingerprints);
+        state.tmp.resize(m_numFingerprints);
+        for (unsigned int i = 0; i < m_numFingerprints; ++i)
+          state.order[i] = i;
+        for (state.depth = m_k - 1; state.depth >= 0; --state.depth) {
+          runBuildPhase(&SimilaritySearchIndex::countKeys, state, m_numFingerprints);
+          // convert the counts to offsets (bucket-major, thread-minor keeps the sort stable)
+          unsigned int offset = 0;
+          for (int c = 0; c < childSize(); ++c)
+            for (unsigned int t = 0; t < numThreads; ++t) {
+              unsigned int count = state.histograms[t][c];
+              state.histograms[t][c] = offset;
+              offset += count;
+            }
+          runBuildPhase(&SimilaritySearchIndex::scatterKeys, state, m_numFingerprints);
+          state.order.swap(state.tmp);
+        }
+        std::vector<unsigned int>().swap(state.tmp);
+
+        // build the CSR arrays, a new node starts at each depth where the key
+        // differs from the key of the previous fingerprint
+        FrozenTree *frozen = new FrozenTree;
+        frozen->firstData.resize(m_k + 1);
+        frozen->binsData.resize(m_k + 1);
+        frozen->firstData[0].push_back(0);
+        for (unsigned int p = 0; p < m_numFingerprints; ++p) {
+          const unsigned short *key = &state.keys[static_cast<std::size_t>(state.order[p]) * m_k];
+          int depth = 0;
+          if (p) {
+            const unsigned short *previous = &state.keys[static_cast<std::size_t>(state.order[p - 1]) * m_k];
+            while (depth < m_k && key[depth] == previous[depth])
+              ++depth;
+          }
+          for (int d = depth; d < m_k; ++d) {
+            frozen->binsData[d + 1].push_back(key[d]);
+            if (d + 1 == m_k)
+              frozen->firstData[m_k].push_back(p);
+            else
+              frozen->firstData[d + 1].push_back(frozen->binsData[d + 2].size());
+          }
+        }
+        std::vector<unsigned short>().swap(state.keys);
+
+        // copy the fingerprints in leaf order
+        frozen->fingerprintsData.resize(static_cast<std::size_t>(m_numFingerprints) * m_numWords);
+        state.frozen = frozen;
+        runBuildPhase(&SimilaritySearchIndex::copyFingerprints, state, m_numFingerprints);
+
+        frozen->orderData.swap(state.order);
+        finishFrozenTree(frozen);
+        m_frozen = frozen;
+      }
+
+      /**
+       * @brief Constructor.
+       *
+       * Load a similarity index file created using save(). The file is memory
+       * mapped and the index is ready for searching without building the
+       * kD-grid. The loaded index is frozen (see freeze()) and does not need
+       * the fingerprint storage since the index file contains a copy of the
+       * fingerprints.
+       *
+       * @param filename The similarity index file.
+       */
+      SimilaritySearchIndex(const std::string &filename) : m_storage(0), m_tree(0), m_frozen(0), m_delta(0),
+          m_numDelta(0), m_numRemoved(0)
+      {
+        TIMER("Loading SimilaritySearchIndex from file:");
+
+        // open the file
+        BinaryInputFile file(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open similarity index file \"", filename, "\""));
+
+        // parse the JSON header
+        m_header = file.header();
+        Json::Reader reader;
+        Json::Value data;
+        if (!reader.parse(m_header, data))
+          throw std::runtime_error(reader.getFormattedErrorMessages());
+
+        // make sure the required attributes are present
+        if (!data.isMember("filetype") || data["filetype"].asString() != "similarity-index")
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'filetype' attribute or is not 'similarity-index'"));
+        if (!data.isMember("k"))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'k' attribute"));
+        if (!data.isMember("num_bits"))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_bits' attribute"));
+        if (!data.isMember("num_fingerprints"))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_fingerprints' attribute"));
+        if (!data.isMember("nodes") || data["nodes"].size() != data["k"].asUInt() + 1)
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain a valid 'nodes' attribute"));
+
+        // get attributes from header
+        m_k = data["k"].asInt();
+        m_numBits = data["num_bits"].asUInt();
+        m_numFingerprints = data["num_fingerprints"].asUInt();
+        m_numWords = bitvec_num_words_for_bits(m_numBits);
+        m_kernels = &impl::bitvec_kernels_for_words(m_numWords);
+
+        FrozenTree *frozen = new FrozenTree;
+        for (int d = 0; d <= m_k; ++d)
+          frozen->numNodes.push_back(data["nodes"][Json::ArrayIndex(d)].asUInt());
+
+        // memory map the binary data
+        std::size_t offset = file.stream().tellg();
+        file.close();
+        frozen->mappedFile.open(filename);
+        if (!frozen->mappedFile.is_open()) {
+          delete frozen;
+          throw std::runtime_error(make_string("Could not memory map similarity index file \"", filename, "\""));
+        }
+
+        if (frozen->mappedFile.size() < offset + bodySize(frozen->numNodes)) {
+          delete frozen;
+          throw std::runtime_error(make_string("Similarity index file \"", filename, "\" is truncated"));
+        }
+
+        // set the pointers to the arrays (see save())
+        const char *pos = frozen->mappedFile.data() + offset;
+        frozen->fingerprints = reinterpret_cast<const Word*>(pos);
+        pos += paddedSize(static_cast<std::size_t>(m_numFingerprints) * m_numWords * sizeof(Word));
+        frozen->order = reinterpret_cast<const unsigned int*>(pos);
+        pos += paddedSize(m_numFingerprints * sizeof(unsigned int));
+        for (int d = 0; d <= m_k; ++d) {
+          frozen->first.push_back(reinterpret_cast<const unsigned int*>(pos));
+          pos += paddedSize((frozen->numNodes[d] + 1) * sizeof(unsigned int));
+        }
+        frozen->bins.push_back(0);
+        for (int d = 1; d <= m_k; ++d) {
+          frozen->bins.push_back(reinterpret_cast<const unsigned short*>(pos));
+          pos += paddedSize(frozen->numNodes[d] * sizeof(unsigned short));
+        }
+
+        m_frozen = frozen;
+      }
+
+      /**
+       * @brief Destructor.
+       */
+      ~SimilaritySearchIndex()
+      {
+        if (m_tree)
+          clearDFS(m_tree, 0);
+        if (m_delta)
+          clearDFS(m_delta, 0);
+        delete m_frozen;
+      }
+
+      /**
+       * Get the memory used by the kD-grid (including the copy of the
+       * fingerprints in a frozen index and the pending updates). The
+       * fingerprint storage is not included.
+       */
+      MemoryUsage memoryUsage() const
+      {
+        std::size_t heap = m_header.capacity() + vector_memory_usage(m_frozenMembers) + vector_memory_usage(m_removed);
+        if (m_tree)
+          heap += sizeInBytesDFS(m_tree, 0);
+        if (m_delta)
+          heap += sizeInBytesDFS(m_delta, 0);
+
+        MemoryUsage usage;
+        if (m_frozen) {
+          heap += sizeof(FrozenTree) + vector_memory_usage(m_frozen->first) + vector_memory_usage(m_frozen->bins) +
+              vector_memory_usage(m_frozen->numNodes) + vector_memory_usage(m_frozen->firstData) +
+              vector_memory_usage(m_frozen->binsData) + vector_memory_usage(m_frozen->orderData) +
+              vector_memory_usage(m_frozen->fingerprintsData);
+          for (std::size_t d = 0; d < m_frozen->firstData.size(); ++d)
+            heap += vector_memory_usage(m_frozen->firstData[d]);
+          for (std::size_t d = 0; d < m_frozen->binsData.size(); ++d)
+            heap += vector_memory_usage(m_frozen->binsData[d]);
+          usage = mapped_memory_usage(m_frozen->mappedFile.data(), m_frozen->mappedFile.size());
+        }
+
+        usage += MemoryUsage(heap, 0, heap);
+        return usage;
+      }
+
+      /**
+       * Estimate the memory used by a frozen index (see freeze()) for
+       * @p numFingerprints fingerprints. The number of nodes at each depth is
+       * bounded by the number of fingerprints so this is an upper bound.
+       */
+      static MemoryUsage estimateMemoryUsage(unsigned int numFingerprints, unsigned int numBits, int k)
+      {
+        std::size_t n = numFingerprints;
+        std::size_t heap = sizeof(FrozenTree) + n * bitvec_num_words_for_bits(numBits) * sizeof(Word) +
+            n * sizeof(unsigned int) + (k + 1) * (n + 1) * sizeof(unsigned int) + k * n * sizeof(unsigned short);
+        return MemoryUsage(heap, 0, heap);
+      }
+
+      /**
+       * Estimate the memory used after loading a similarity index file (see
+       * SimilaritySearchIndex(const std::string&)). The whole file is
+       * memory mapped and nothing is resident yet.
+       */
+      static MemoryUsage estimateMemoryUsage(const std::string &filename)
+      {
+        std::size_t size = file_size(filename);
+        if (!size)
+          throw std::runtime_error(make_string("Could not open similarity index file \"", filename, "\""));
+        return MemoryUsage(sizeof(FrozenTree), size, sizeof(FrozenTree));
+      }
+
+      /**
+       * @brief Get the JSON header of the indexed fingerprint file.
+       *
+       * For an index loaded from file, this is the JSON header of the
+       * similarity index file. This header contains the 'num_bits' and
+       * 'fingerprint' attributes from the indexed fingerprint file.
+       */
+      const std::string& header() const
+      {
+        return m_header;
+      }
+
+      /**
+       * @brief Get the number of bits in the fingerprints.
+       */
+      unsigned int numBits() const
+      {
+        return m_numBits;
+      }
+
+      /**
+       * @brief Get the number of indexed fingerprints.
+       */
+      unsigned int numFingerprints() const
+      {
+        return m_numFingerprints + m_numDelta - m_numRemoved;
+      }
+
+      /**
+       * @brief Insert a fingerprint from the storage in the index.
+       *
+       * This is typically used after appending fingerprints to the storage
+       * (see InMemoryRowMajorFingerprintStorage::append()). For a non-frozen
+       * index, the index is added to the leaf of the kD-grid. A frozen
+       * index can not be modified in place, the fingerprint is added to a
+       * (pointer based) delta kD-grid that is searched together with the
+       * frozen kD-grid. Either way, the search results include the inserted
+       * fingerprint immediately. Use merge() to fold the delta into the
+       * frozen kD-grid.
+       *
+       * @pre The index must have a fingerprint storage (i.e. it is not loaded
+       *      from a similarity index file) and @p index must be a valid
+       *      index in the storage.
+       *
+       * @param index The index of the fingerprint in the storage.
+       *
+       * @return False if the fingerprint was already indexed.
+       */
+      bool insert(unsigned int index)
+      {
+        PRE(m_storage);
+        PRE(index < m_storage->numFingerprints());
+
+        const Word *fingerprint = m_storage->fingerprint(index);
+        if (!m_frozen) {
+          std::vector<unsigned int> &leaf = findLeaf(m_tree, fingerprint);
+          if (std::find(leaf.begin(), leaf.end(), index) != leaf.end())
+            return false;
+          leaf.push_back(index);
+          ++m_numFingerprints;
+          return true;
+        }
+
+        // a removed fingerprint from the frozen kD-grid is restored
+        if (isFrozenMember(index)) {
+          if (!m_removed[index])
+            return false;
+          m_removed[index] = false;
+          --m_numRemoved;
+          return true;
+        }
+
+        if (!m_delta)
+          m_delta = new TreeNode(childSize());
+        std::vector<unsigned int> &leaf = findLeaf(m_delta, fingerprint);
+        if (std::find(leaf.begin(), leaf.end(), index) != leaf.end())
+          return false;
+        leaf.push_back(index);
+        ++m_numDelta;
+        return true;
+      }
+
+      /**
+       * @brief Remove a fingerprint from the index.
+       *
+       * For a non-frozen index or a fingerprint in the delta kD-grid (see
+       * insert()), the index is removed from its leaf. A fingerprint in the
+       * frozen kD-grid is marked as removed (i.e. a tombstone) and is
+       * skipped by all searches until merge() drops it. Either way, the
+       * search results no longer include the fingerprint.
+       *
+       * @param index The index of the fingerprint in the storage.
+       *
+       * @return False if the fingerprint was not indexed.
+       */
+      bool remove(unsigned int index)
+      {
+        if (!m_frozen) {
+          PRE(m_storage);
+          if (index >= m_storage->numFingerprints() || !removeFromLeaf(m_tree, m_storage->fingerprint(index), index))
+            return false;
+          --m_numFingerprints;
+          return true;
+        }
+
+        if (isFrozenMember(index)) {
+          if (m_removed[index])
+            return false;
+          m_removed[index] = true;
+          ++m_numRemoved;
+          return true;
+        }
+
+        if (!m_delta || index >= m_storage->numFingerprints() || !removeFromLeaf(m_delta, m_storage->fingerprint(index), index))
+          return false;
+        --m_numDelta;
+        return true;
+      }
+
+      /**
+       * @brief Check if a frozen index has inserted or removed fingerprints
+       * that are not merged in the frozen kD-grid yet (see merge()).
+       */
+      bool hasPendingUpdates() const
+      {
+        return m_numDelta || m_numRemoved;
+      }
+
+      /**
+       * @brief Merge the pending updates in the frozen kD-grid.
+       *
+       * The frozen kD-grid is rebuilt from the remaining fingerprints in the
+       * frozen kD-grid and the fingerprints in the delta kD-grid. The delta
+       * only has to be merged once it grows large enough to slow down the
+       * searches, searching an index with pending updates gives the same
+       * results.
+       *
+       * @pre The index must have a fingerprint storage (i.e. it is not loaded
+       *      from a similarity index file).
+       */
+      void merge()
+      {
+        if (!m_frozen || !hasPendingUpdates())
+          return;
+        PRE(m_storage);
+        TIMER("SimilaritySearchIndex::merge():");
+
+        std::vector<unsigned int> indices;
+        indices.reserve(numFingerprints());
+        for (unsigned int i = 0; i < m_numFingerprints; ++i)
+          if (!m_numRemoved || !m_removed[m_frozen->order[i]])
+            indices.push_back(m_frozen->order[i]);
+        if (m_delta) {
+          leavesDFS(m_delta, 0, indices);
+          clearDFS(m_delta, 0);
+          m_delta = 0;
+        }
+
+        m_tree = new TreeNode(childSize());
+        for (std::size_t i = 0; i < indices.size(); ++i)
+          findLeaf(m_tree, m_storage->fingerprint(indices[i])).push_back(indices[i]);
+
+        delete m_frozen;
+        m_frozen = 0;
+        std::vector<bool>().swap(m_frozenMembers);
+        std::vector<bool>().swap(m_removed);
+        m_numFingerprints = indices.size();
+        m_numDelta = 0;
+        m_numRemoved = 0;
+
+        freeze();
+      }
+
+      /**
+       * @brief Freeze the index.
+       *
+       * Convert the kD-grid to a compact layout. Empty children are no longer
+       * stored (the child tables are stored in CSR form) and the fingerprints
+       * are copied so that the fingerprints for each leaf are contiguous in
+       * memory. Searching a frozen index streams sequentially through the
+       * fingerprints of the visited leaves. The results are the same as for
+       * the non-frozen index.
+       *
+       * @note The index uses a copy of the fingerprints after freezing.
+       */
+      void freeze()
+      {
+        if (m_frozen)
+          return;
+        TIMER("SimilaritySearchIndex::freeze():");
+
+        FrozenTree *frozen = new FrozenTree;
+        frozen->firstData.resize(m_k + 1);
+        frozen->binsData.resize(m_k + 1);
+        frozen->orderData.reserve(m_numFingerprints);
+
+        frozen->firstData[0].push_back(0);
+        freezeDFS(m_tree, 0, *frozen);
+
+        // copy the fingerprints in leaf order
+        frozen->fingerprintsData.resize(frozen->orderData.size() * static_cast<std::size_t>(m_numWords));
+        for (std::size_t i = 0; i < frozen->orderData.size(); ++i)
+          std::copy(m_storage->fingerprint(frozen->orderData[i]), m_storage->fingerprint(frozen->orderData[i]) + m_numWords,
+              &frozen->fingerprintsData[0] + i * m_numWords);
+
+        finishFrozenTree(frozen);
+
+        // the pointer based tree is no longer needed
+        clearDFS(m_tree, 0);
+        m_tree = 0;
+        m_frozen = frozen;
+      }
+
+      /**
+       * @brief Check if the index is frozen (see freeze()).
+       */
+      bool isFrozen() const
+      {
+        return m_frozen;
+      }
+
+      /**
+       * @brief Get the dimension of the kD-grid.
+       */
+      int k() const
+      {
+        return m_k;
+      }
+
+      /**
+       * @brief Get the number of (non-empty) leaves in the frozen kD-grid.
+       *
+       * @pre The index must be frozen (see freeze()).
+       */
+      unsigned int numLeaves() const
+      {
+        PRE(isFrozen());
+        return m_frozen->numNodes[m_k];
+      }
+
+      /**
+       * @brief Get the number of fingerprints scored by a threshold search.
+       *
+       * This is the number of fingerprints in the leaves of the kD-grid that
+       * are visited by search() (i.e. that are not pruned by the bounds for
+       * the bit counts of the parts). This is a measure of the search cost
+       * that does not depend on the timing (see tune_similarity_index_k()).
+       *
+       * @param fingerprint The query fingerprint.
+       * @param threshold The minimum score.
+       */
+      unsigned int numScored(const Word *fingerprint, double threshold) const
+      {
+        ScoredCount collector(threshold);
+        search(fingerprint, collector);
+        return collector.count;
+      }
+
+      /**
+       * @brief Save the index to a similarity index file.
+       *
+       * The file is a Helium binary file with a JSON header and can be loaded
+       * using the SimilaritySearchIndex(const std::string&) constructor.
+       * Below is an example of the JSON header.
+       *
+@code
+{
+  'filetype': 'similarity-index',
+  'k': 3,
+  'num_bits': 1024,
+  'num_fingerprints': 1000000,
+  'nodes': [1, 97, 3481, 61052],
+  'fingerprint': { ... }
+}
+@endcode
+       *
+       * The 'fingerprint' attribute is copied from the indexed fingerprint
+       * file. The 'nodes' attribute contains the number of nodes at each depth
+       * of the kD-grid. The binary data contains the arrays of the frozen
+       * index in native byte order, each padded to a multiple of 8 bytes: the
+       * fingerprints in leaf order, the fingerprint indices in leaf order, the
+       * k + 1 CSR offset arrays and the k bin arrays.
+       *
+       * @pre The index must be frozen (see freeze()). Pending updates must be
+       *      merged first (see merge()).
+       *
+       * @param filename The similarity index file to write.
+       * @param attributes Additional attributes for the JSON header (e.g.
+       *        'k_tuning', see tune_similarity_index_k()).
+       */
+      void save(const std::string &filename, const Json::Value &attributes = Json::Value(Json::objectValue)) const
+      {
+        PRE(isFrozen());
+        if (hasPendingUpdates())
+          throw std::runtime_error("Could not save similarity index with pending updates, call merge() first");
+        TIMER("SimilaritySearchIndex::save():");
+
+        BinaryOutputFile file(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open similarity index file \"", filename, "\""));
+
+        // write the arrays
+        writePadded(file, m_frozen->fingerprints, static_cast<std::size_t>(m_numFingerprints) * m_numWords * sizeof(Word));
+        writePadded(file, m_frozen->order, m_numFingerprints * sizeof(unsigned int));
+        for (int d = 0; d <= m_k; ++d)
+          writePadded(file, m_frozen->first[d], (m_frozen->numNodes[d] + 1) * sizeof(unsigned int));
+        for (int d = 1; d <= m_k; ++d)
+          writePadded(file, m_frozen->bins[d], m_frozen->numNodes[d] * sizeof(unsigned short));
+
+        // create JSON header
+        Json::Reader reader;
+        Json::Value header;
+        reader.parse(m_header, header);
+
+        Json::Value data;
+        data["filetype"] = "similarity-index";
+        data["k"] = m_k;
+        data["num_bits"] = m_numBits;
+        data["num_fingerprints"] = m_numFingerprints;
+        data["nodes"] = Json::Value(Json::arrayValue);
+        for (int d = 0; d <= m_k; ++d)
+          data["nodes"][Json::ArrayIndex(d)] = m_frozen->numNodes[d];
+        if (header.isObject() && header.isMember("fingerprint"))
+          data["fingerprint"] = header["fingerprint"];
+        for (Json::Value::const_iterator i = attributes.begin(); i != attributes.end(); ++i)
+          data[i.key().asString()] = *i;
+
+        // write JSON header
+        Json::StyledWriter writer;
+        if (!file.writeHeader(writer.write(data)))
+          throw std::runtime_error(make_string("Could not write similarity index file \"", filename, "\""));
+      }
+
+#ifdef HAVE_CPP11
+      // do not allow SimilaritySearchIndex to be copied
+      SimilaritySearchIndex(const SimilaritySearchIndex &other) = delete;
+      SimilaritySearchIndex& operator=(const SimilaritySearchIndex &other) = delete;
+#endif
+
+      /**
+       * @brief Search for all fingerprints with a score above a
+       * threshold.
+       *
+       * @param fingerprint The query fingerprint.
+       * @param threshold The minimum score.
+       * @param maxResults When non-zero, the search stops after this number
+       *        of hits is found. These are not the best hits but the first
+       *        hits found while searching the kD-grid (see knnSearch()).
+       *
+       * @return The hits as (index, score) pairs.
+       */
+      std::vector<std::pair<unsigned int, double> > search(const Word *fingerprint, double threshold, unsigned int maxResults = 0) const
+      {
+        TIMER("SimilaritySearchIndex::search():");
+
+        if (!maxResults)
+          maxResults = std::numeric_limits<unsigned>::max();
+
+        std::vector<std::pair<unsigned int, double> > hits;
+        ThresholdHits collector(threshold, maxResults, hits);
+        search(fingerprint, collector);
+
+        return hits;
+      }
+
+      /**
+       * @brief Streaming search for all fingerprints with a score above a
+       * threshold.
+       *
+       * The hits are passed to the @p sink as soon as they are found instead
+       * of being collected in a vector. The sink is a function object with
+       * the signature bool(unsigned int index, double score). When it returns
+       * false, the search stops and no more hits are reported.
+       *
+       * @param fingerprint The query fingerprint.
+       * @param threshold The minimum score.
+       * @param sink The function object that receives the hits.
+       *
+       * @return False if the search was stopped by the sink, true otherwise.
+       */
+      template<typename HitSink>
+      bool search(const Word *fingerprint, double threshold, HitSink &sink) const
+      {
+        TIMER("SimilaritySearchIndex::search():");
+
+        SinkHits<HitSink> collector(threshold, sink);
+        search(fingerprint, collector);
+
+        return !collector.stopped;
+      }
 
+      /**
+       * @brief Search for all fingerprints with a score above a threshold
+       * with a time budget.
+       *
+       * This is the same as search() except that the search stops when
+       * @p token expires. If token.isCancelled() returns true afterwards,
+       * the returned hits are partial.
+       *
+       * @param fingerprint The query fingerprint.
+       * @param threshold The minimum score.
+       * @param maxResults When non-zero, the search stops after this number
+       *        of hits is found.
+       * @param token The cancellation token.
+       *
+       * @return The hits as (index, score) pairs.
+       */
+      std::vector<std::pair<unsigned int, double> > search(const Word *fingerprint, double threshold,
+          unsigned int maxResults, const CancellationToken &token) const
+      {
+        TIMER("SimilaritySearchIndex::search():");
+
+        if (!maxResults)
+          maxResults = std::numeric_limits<unsigned>::max();
+
+        std::vector<std::pair<unsigned int, double> > hits;
+        ThresholdHits collector(threshold, maxResults, hits);
+        CancellableHits<ThresholdHits> cancellable(collector, token);
+        search(fingerprint, cancellable);
+
+        return hits;
+      }
+
+      /**
+       * @brief Search for the k nearest neighbors of a fingerprint.
+       *
+       * The best k hits are kept in a bounded heap. Once k hits are found,
+       * the working threshold is raised to the k-th best score so larger
+       * parts of the kD-grid are pruned as the search progresses.
+       *
+       * @param fingerprint The query fingerprint.
+       * @param k The number of nearest neighbors to find.
+       * @param threshold The minimum score for the hits.
+       *
+       * @return The (at most) k best hits as (index, score) pairs,
+       *         sorted by descending score (equal scores by ascending index).
+       */
+      std::vector<std::pair<unsigned int, double> > knnSearch(const Word *fingerprint, unsigned int k, double threshold = 0.0) const
+      {
+        TIMER("SimilaritySearchIndex::knnSearch():");
+
+        if (!k)
+          return std::vector<std::pair<unsigned int, double> >();
+
+        KnnHits collector(threshold, k);
+        search(fingerprint, collector);
+
+        return collector.sorted();
+      }
+
+      /**
+       * @brief Search for the k nearest neighbors of a fingerprint with a
+       * time budget.
+       *
+       * This is the same as knnSearch() except that the search stops when
+       * @p token expires. If token.isCancelled() returns true afterwards,
+       * the returned hits are the best hits found so far but not necessarily
+       * the k nearest neighbors.
+       *
+       * @param fingerprint The query fingerprint.
+       * @param k The number of nearest neighbors to find.
+       * @param threshold The minimum score for the hits.
+       * @param token The cancellation token.
+       *
+       * @return The (at most) k best hits as (index, score) pairs,
+       *         sorted by descending score (equal scores by ascending index).
+       */
+      std::vector<std::pair<unsigned int, double> > knnSearch(const Word *fingerprint, unsigned int k,
+          double threshold, const CancellationToken &token) const
+      {
+        TIMER("SimilaritySearchIndex::knnSearch():");
+
+        if (!k)
+          return std::vector<std::pair<unsigned int, double> >();
+
+        KnnHits collector(threshold, k);
+        CancellableHits<KnnHits> cancellable(collector, token);
+        search(fingerprint, cancellable);
+
+        return collector.sorted();
+      }
+
+#ifdef HAVE_CPP11
+      /**
+       * @brief Parallel search for all fingerprints with a score
+       * above a threshold.
+       *
+       * The top levels of the kD-grid are split in subtree tasks that are run
+       * on a work-stealing thread pool. The results are the same as for
+       * search() (including the order of the hits).
+       *
+       * @note This function is only available when C++11 support is enabled.
+       *
+       * @param fingerprint The query fingerprint.
+       * @param threshold The minimum score.
+       * @param pool The thread pool to run the tasks on.
+       *
+       * @return The hits as (index, score) pairs.
+       */
+      std::vector<std::pair<unsigned int, double> > parallelSearch(const Word *fingerprint, double threshold,
+          ThreadPool &pool = ThreadPool::global()) const
+      {
+        TIMER("SimilaritySearchIndex::parallelSearch():");
+
+        std::vector<int> bitCounts;
+        int count;
+        std::vector<SubtreeTask> tasks;
+        int splitDepth = subtreeTasks(fingerprint, threshold, bitCounts, count, tasks);
+        if (!splitDepth)
+          return search(fingerprint, threshold);
+
+        std::vector<std::vector<std::pair<unsigned int, double> > > hits(tasks.size());
+        ThreadPool::TaskGroup group;
+        for (std::size_t t = 0; t < tasks.size(); ++t)
+          pool.submit(group, [this, fingerprint, threshold, &hits, &tasks, &bitCounts, count, splitDepth, t] {
+            ThresholdHits collector(threshold, std::numeric_limits<unsigned>::max(), hits[t]);
+            searchSubtree(fingerprint, collector, tasks[t], bitCounts, count, splitDepth);
+          });
+        pool.wait(group);
+
+        // the tasks are in DFS order
+        std::vector<std::pair<unsigned int, double> > result;
+        for (std::size_t t = 0; t < hits.size(); ++t)
+          std::copy(hits[t].begin(), hits[t].end(), std::back_inserter(result));
+
+        ThresholdHits collector(threshold, std::numeric_limits<unsigned>::max(), result);
+        searchDelta(fingerprint, collector, bitCounts, count);
+        return result;
+      }
+
+      /**
+       * @brief Parallel search for the k nearest neighbors of a fingerprint.
+       *
+       * The top levels of the kD-grid are split in subtree tasks that are run
+       * on a work-stealing thread pool. The tasks share the working threshold
+       * (see knnSearch()) and the subtrees closest to the query are searched
+       * first. The results are the same as for knnSearch().
+       *
+       * @note This function is only available when C++11 support is enabled.
+       *
+       * @param fingerprint The query fingerprint.
+       * @param k The number of nearest neighbors to find.
+       * @param threshold The minimum score for the hits.
+       * @param pool The thread pool to run the tasks on.
+       *
+       * @return The (at most) k best hits as (index, score) pairs,
+       *         sorted by descending score (equal scores by ascending index).
+       */
+      std::vector<std::pair<unsigned int, double> > parallelKnnSearch(const Word *fingerprint, unsigned int k,
+          double threshold = 0.0, ThreadPool &pool = ThreadPool::global()) const
+      {
+        TIMER("SimilaritySearchIndex::parallelKnnSearch():");
+
+        if (!k)
+          return std::vector<std::pair<unsigned int, double> >();
+
+        std::vector<int> bitCounts;
+        int count;
+        std::vector<SubtreeTask> tasks;
+        int splitDepth = subtreeTasks(fingerprint, threshold, bitCounts, count, tasks);
+        if (!splitDepth)
+          return knnSearch(fingerprint, k, threshold);
+
+        // search the subtrees closest to the query first
+        std::vector<std::pair<int, std::size_t> > order;
+        for (std::size_t t = 0; t < tasks.size(); ++t)
+          order.push_back(std::make_pair(tasks[t].distance, t));
+        std::sort(order.begin(), order.end());
+
+        std::atomic<double> shared(threshold);
+        std::vector<std::vector<std::pair<unsigned int, double> > > hits(tasks.size());
+        ThreadPool::TaskGroup group;
+        for (std::size_t i = 0; i < order.size(); ++i) {
+          std::size_t t = order[i].second;
+          pool.submit(group, [this, fingerprint, threshold, k, &shared, &hits, &tasks, &bitCounts, count, splitDepth, t] {
+            SharedKnnHits collector(threshold, k, shared);
+            searchSubtree(fingerprint, collector, tasks[t], bitCounts, count, splitDepth);
+            hits[t].swap(collector.heap);
+          });
+        }
+        pool.wait(group);
+
+        // merge the hits
+        KnnHits collector(threshold, k);
+        for (std::size_t t = 0; t < hits.size(); ++t)
+          for (std::size_t i = 0; i < hits[t].size(); ++i)
+            collector.add(hits[t][i].first, hits[t][i].second);
+        searchDelta(fingerprint, collector, bitCounts, count);
+        return collector.sorted();
+      }
+#endif
+
+    private:
+      template<typename HitCollector>
+      void search(const Word *fingerprint, HitCollector &collector) const
+      {
+        if (m_numRemoved) {
+          LiveHits<HitCollector> live(collector, m_removed);
+          searchTrees(fingerprint, live);
+        } else {
+          searchTrees(fingerprint, collector);
+        }
+      }
+
+      /**
+       * Search the kD-grid and the delta kD-grid (see insert()).
+       */
+      template<typename HitCollector>
+      void searchTrees(const Word *fingerprint, HitCollector &collector) const
+      {
         int count = 0;
         std::vector<int> n_j(m_k);
         std::vector<int> bitCounts(m_k);
@@ -398,23 +2790,171 @@ namespace Helium {
           count += part;
         }
 
-        std::vector<std::pair<unsigned int, double> > hits;
-        tanimotoDFS(fingerprint, threshold, maxResults, m_tree, 0, &n_j[0], &bitCounts[0], count, hits);
+        if (m_frozen)
+          frozenDFS(fingerprint, collector, 0, 0, &n_j[0], &bitCounts[0], count);
+        else
+          treeDFS(fingerprint, collector, m_tree, 0, &n_j[0], &bitCounts[0], count);
 
-        return hits;
+        if (m_delta && !collector.done())
+          treeDFS(fingerprint, collector, m_delta, 0, &n_j[0], &bitCounts[0], count);
       }
 
-    private:
+      /**
+       * Check if a fingerprint is in the frozen kD-grid (removed or not).
+       * The membership bits (and tombstones) are created on first use.
+       */
+      bool isFrozenMember(unsigned int index)
+      {
+        if (m_frozenMembers.empty()) {
+          unsigned int size = 0;
+          for (unsigned int i = 0; i < m_numFingerprints; ++i)
+            size = std::max(size, m_frozen->order[i] + 1);
+          m_frozenMembers.resize(size);
+          m_removed.resize(size);
+          for (unsigned int i = 0; i < m_numFingerprints; ++i)
+            m_frozenMembers[m_frozen->order[i]] = true;
+        }
+
+        return index < m_frozenMembers.size() && m_frozenMembers[index];
+      }
+
+#ifdef HAVE_CPP11
+      /**
+       * A subtree of the kD-grid that is searched by a single task in a
+       * parallel search.
+       */
+      struct SubtreeTask
+      {
+        unsigned int node; //!< The node index (frozen index)
+        TreeNode *treeNode; //!< The node (pointer based index)
+        std::vector<int> n_j; //!< The bins of the parents
+        int distance; //!< Distance between the query's and subtree's bit counts
+      };
+
+      /**
+       * Collect the subtrees at @p splitDepth that may contain hits with a
+       * score above @p threshold (in DFS order).
+       */
+      void collectSubtrees(double threshold, int splitDepth, unsigned int node, TreeNode *treeNode, int depth,
+          std::vector<int> &n_j, std::vector<int> &bitCounts, std::vector<SubtreeTask> &tasks) const
+      {
+        if (depth == splitDepth) {
+          SubtreeTask task;
+          task.node = node;
+          task.treeNode = treeNode;
+          task.n_j = n_j;
+          task.distance = 0;
+          for (int d = 0; d < depth; ++d)
+            task.distance += std::abs(n_j[d] - bitCounts[d]);
+          tasks.push_back(task);
+          return;
+        }
+
+        int n_lower, n_upper;
+        binBounds(threshold, depth, &n_j[0], &bitCounts[0], n_lower, n_upper);
+
+        if (m_frozen) {
+          for (unsigned int c = m_frozen->first[depth][node]; c < m_frozen->first[depth][node + 1]; ++c) {
+            int i = m_frozen->bins[depth + 1][c];
+            if (i < n_lower || i > n_upper)
+              continue;
+            n_j[depth] = i;
+            collectSubtrees(threshold, splitDepth, c, 0, depth + 1, n_j, bitCounts, tasks);
+          }
+        } else {
+          for (int i = n_lower; i <= n_upper; ++i) {
+            if (!treeNode->children[i])
+              continue;
+            n_j[depth] = i;
+            collectSubtrees(threshold, splitDepth, 0, static_cast<TreeNode*>(treeNode->children[i]), depth + 1, n_j, bitCounts, tasks);
+          }
+        }
+      }
+
+      /**
+       * Search the subtree for a task in a parallel search.
+       */
+      template<typename HitCollector>
+      void searchSubtree(const Word *fingerprint, HitCollector &collector, SubtreeTask task,
+          std::vector<int> bitCounts, int count, int splitDepth) const
+      {
+        if (m_numRemoved) {
+          LiveHits<HitCollector> live(collector, m_removed);
+          searchSubtreeDFS(fingerprint, live, task, bitCounts, count, splitDepth);
+        } else {
+          searchSubtreeDFS(fingerprint, collector, task, bitCounts, count, splitDepth);
+        }
+      }
+
+      template<typename HitCollector>
+      void searchSubtreeDFS(const Word *fingerprint, HitCollector &collector, SubtreeTask &task,
+          std::vector<int> &bitCounts, int count, int splitDepth) const
+      {
+        task.n_j.resize(m_k);
+        if (m_frozen)
+          frozenDFS(fingerprint, collector, task.node, splitDepth, &task.n_j[0], &bitCounts[0], count);
+        else
+          treeDFS(fingerprint, collector, task.treeNode, splitDepth, &task.n_j[0], &bitCounts[0], count);
+      }
+
+      /**
+       * Get the subtree tasks for a parallel search.
+       *
+       * @return The split depth, 0 if the search should not be split.
+       */
+      int subtreeTasks(const Word *fingerprint, double threshold, std::vector<int> &bitCounts,
+          int &count, std::vector<SubtreeTask> &tasks) const
+      {
+        count = 0;
+        bitCounts.resize(m_k);
+        for (int i = 0; i < m_k; ++i) {
+          bitCounts[i] = bitCount(fingerprint, i);
+          count += bitCounts[i];
+        }
+
+        // the subtrees are split at depth 1 or 2, the last level contains the leaves
+        int splitDepth = std::min(m_k - 1, 2);
+        if (!splitDepth)
+          return 0;
+
+        std::vector<int> n_j(m_k);
+        collectSubtrees(threshold, splitDepth, 0, m_tree, 0, n_j, bitCounts, tasks);
+        return tasks.size() > 1 ? splitDepth : 0;
+      }
+
+      /**
+       * Search the delta kD-grid (see insert()) after a parallel search.
+       */
+      template<typename HitCollector>
+      void searchDelta(const Word *fingerprint, HitCollector &collector, std::vector<int> bitCounts, int count) const
+      {
+        if (!m_delta)
+          return;
+        std::vector<int> n_j(m_k);
+        treeDFS(fingerprint, collector, m_delta, 0, &n_j[0], &bitCounts[0], count);
+      }
+#endif
+
 #ifndef HAVE_CPP11
       // do not allow SimilaritySearchIndex to be copied
-      SimilaritySearchIndex(const SimilaritySearchIndex<FingerprintStorageType> &other);
-      SimilaritySearchIndex<FingerprintStorageType>& operator=(const SimilaritySearchIndex<FingerprintStorageType> &other);
+      SimilaritySearchIndex(const SimilaritySearchIndex &other);
+      SimilaritySearchIndex& operator=(const SimilaritySearchIndex &other);
 #endif
 
-      const FingerprintStorageType &m_storage; //!< Fingerprint storage
+      const FingerprintStorageType *m_storage; //!< Fingerprint storage (0 if loaded from file)
+      std::string m_header; //!< JSON header of the indexed fingerprint file
       TreeNode *m_tree; //!< Tree root node
       int m_k; //!< Dimentionality of the kD-grid
       unsigned int m_numBits; //!< Number of bits in the fingerprint
+      unsigned int m_numFingerprints; //!< Number of indexed fingerprints
+      int m_numWords; //!< Number of words in the fingerprint
+      const impl::BitvecKernels *m_kernels; //!< Popcount kernels for m_numWords
+      FrozenTree *m_frozen; //!< Compact kD-grid (0 if not frozen)
+      TreeNode *m_delta; //!< Inserted fingerprints for a frozen index (0 if none)
+      unsigned int m_numDelta; //!< Number of fingerprints in m_delta
+      std::vector<bool> m_frozenMembers; //!< Fingerprints in the frozen kD-grid (created on first update)
+      std::vector<bool> m_removed; //!< Removed fingerprints from the frozen kD-grid (tombstones)
+      unsigned int m_numRemoved; //!< Number of tombstones
 
   };
 
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_SIMILARITYTUNING_H
+#define HELIUM_SIMILARITYTUNING_H
+
+#include <Helium/fingerprints/similarity.h>
+#include <Helium/timeout.h>
+#include <Helium/contract.h>
+
+#include <json/json.h>
+
+#include <vector>
+#include <algorithm>
+
+namespace Helium {
+
+  /**
+   * @brief The measurements for a single kD-grid dimension.
+   *
+   * See tune_similarity_index_k().
+   */
+  struct SimilarityIndexTrial
+  {
+    int k; //!< The dimension of the kD-grid.
+    unsigned int numLeaves; //!< The number of non-empty leaves.
+    double leafOccupancy; //!< The mean number of fingerprints in a leaf.
+    double meanScored; //!< The mean number of fingerprints scored per query.
+    double meanMicroseconds; //!< The mean search time per query in microseconds.
+  };
+
+  /**
+   * @brief The result of tuning the kD-grid dimension of a SimilaritySearchIndex.
+   *
+   * See tune_similarity_index_k().
+   */
+  struct SimilarityIndexTuning
+  {
+    SimilarityIndexTuning() : k(0), Tmin(0.0), numQueries(0)
+    {
+    }
+
+    /**
+     * Get the tuning as JSON. This is stored as the 'k_tuning' attribute in
+     * the header of a similarity index file (see
+     * SimilaritySearchIndex::save()).
+     *
+@code
+{
+  'k': 3,
+  'Tmin': 0.7,
+  'num_queries': 100,
+  'trials': [
+    { 'k': 1, 'leaves': 151, 'leaf_occupancy': 662.3, 'scored': 20342.1, 'microseconds': 812.5 },
+    ...
+  ]
+}
+@endcode
+     */
+    Json::Value json() const
+    {
+      Json::Value data;
+      data["k"] = k;
+      data["Tmin"] = Tmin;
+      data["num_queries"] = numQueries;
+      data["trials"] = Json::Value(Json::arrayValue);
+      for (std::size_t i = 0; i < trials.size(); ++i) {
+        Json::Value &trial = data["trials"][Json::ArrayIndex(i)];
+        trial["k"] = trials[i].k;
+        trial["leaves"] = trials[i].numLeaves;
+        trial["leaf_occupancy"] = trials[i].leafOccupancy;
+        trial["scored"] = trials[i].meanScored;
+        trial["microseconds"] = trials[i].meanMicroseconds;
+      }
+      return data;
+    }
+
+    int k; //!< The selected dimension (i.e. the fastest trial).
+    double Tmin; //!< The threshold used for the sampled queries.
+    unsigned int numQueries; //!< The number of sampled queries.
+    std::vector<SimilarityIndexTrial> trials; //!< The measurements for each dimension.
+  };
+
+  /**
+   * @brief Select the fastest kD-grid dimension for a SimilaritySearchIndex.
+   *
+   * The best dimension depends on the fingerprint density, the number of
+   * fingerprints and the threshold. Small values give few large leaves
+   * where most fingerprints have to be scored, large values prune more
+   * fingerprints but the number of visited nodes grows quickly. For each
+   * k in [1,maxK], a frozen index is built and the queries sampled from the
+   * storage (evenly spaced over the fingerprints so the tuning is
+   * deterministic) are searched. The leaf occupancy, the mean number of
+   * scored fingerprints (see SimilaritySearchIndex::numScored()) and the
+   * mean search time are recorded. The queries are searched twice and the
+   * fastest run is used to reduce the noise. The dimension with the lowest
+   * search time is selected, ties are broken in favor of the smaller k.
+   *
+   * @code
+   * SimilarityIndexTuning tuning = tune_similarity_index_k(storage, 0.7);
+   * SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, tuning.k, 0);
+   * Json::Value attributes;
+   * attributes["k_tuning"] = tuning.json();
+   * index.save("library.fpi", attributes);
+   * @endcode
+   *
+   * @pre The @p maxK and @p numQueries parameters must be greater than 0.
+   *
+   * @param storage The fingerprint storage to index.
+   * @param Tmin The typical threshold for the searches.
+   * @param numQueries The number of queries to sample.
+   * @param maxK The largest dimension to try.
+   * @param numThreads The number of tasks for building the indexes (see
+   *        the parallel SimilaritySearchIndex constructor).
+   */
+  template<typename RowMajorFingerprintStorageType>
+  SimilarityIndexTuning tune_similarity_index_k(const RowMajorFingerprintStorageType &storage, double Tmin,
+      unsigned int numQueries = 100, int maxK = 5, unsigned int numThreads = 0)
+  {
+    PRE(maxK > 0);
+    PRE(numQueries > 0);
+
+    SimilarityIndexTuning tuning;
+    tuning.Tmin = Tmin;
+    tuning.k = 1;
+
+    // sample the queries
+    std::vector<unsigned int> queries;
+    unsigned int n = storage.numFingerprints();
+    for (unsigned int i = 0; i < std::min(numQueries, n); ++i)
+      queries.push_back(static_cast<unsigned long long>(i) * n / std::min(numQueries, n));
+    tuning.numQueries = queries.size();
+    if (queries.empty())
+      return tuning;
+
+    // a part needs at least one bit
+    maxK = std::min<int>(maxK, storage.numBits());
+
+    for (int k = 1; k <= maxK; ++k) {
+      SimilaritySearchIndex<RowMajorFingerprintStorageType> index(storage, k, numThreads);
+
+      SimilarityIndexTrial trial;
+      trial.k = k;
+      trial.numLeaves = index.numLeaves();
+      trial.leafOccupancy = static_cast<double>(n) / std::max(1u, trial.numLeaves);
+
+      // counting the scored fingerprints also warms up the caches
+      unsigned long long scored = 0;
+      for (std::size_t i = 0; i < queries.size(); ++i)
+        scored += index.numScored(storage.fingerprint(queries[i]), Tmin);
+      trial.meanScored = static_cast<double>(scored) / queries.size();
+
+      unsigned long long best = 0;
+      for (int run = 0; run < 2; ++run) {
+        unsigned long long start = impl::monotonic_nanoseconds();
+        for (std::size_t i = 0; i < queries.size(); ++i)
+          index.search(storage.fingerprint(queries[i]), Tmin);
+        unsigned long long elapsed = impl::monotonic_nanoseconds() - start;
+        if (!run || elapsed < best)
+          best = elapsed;
+      }
+      trial.meanMicroseconds = best / 1000.0 / queries.size();
+
+      if (tuning.trials.empty() || trial.meanMicroseconds < tuning.trials[tuning.k - 1].meanMicroseconds)
+        tuning.k = k;
+      tuning.trials.push_back(trial);
+    }
+
+    return tuning;
+  }
+
+}
+
+#endif
@@ -0,0 +1,756 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_FROZENMOL_H
+#define HELIUM_FROZENMOL_H
+
+#include <Helium/molecule.h>
+#include <Helium/contract.h>
+#include <Helium/tie.h>
+
+#include <vector>
+#include <ostream>
+
+namespace Helium {
+
+  //@cond dev
+
+  namespace impl {
+
+    /**
+     * @brief Class representing an atom in a molecule that stores its
+     * properties in arrays (e.g. FrozenMol, MoleculeView).
+     */
+    template<typename MoleculeType>
+    class IndexAtom
+    {
+      public:
+        IndexAtom(const MoleculeType *mol = 0, Index index = -1) : m_mol(mol), m_index(index)
+        {
+        }
+
+        const MoleculeType* mol() const
+        {
+          return m_mol;
+        }
+
+        Index index() const
+        {
+          return m_index;
+        }
+
+        bool operator==(const IndexAtom<MoleculeType> &other) const
+        {
+          return m_index == other.m_index;
+        }
+
+        bool operator!=(const IndexAtom<MoleculeType> &other) const
+        {
+          return m_index != other.m_index;
+        }
+
+        bool operator<(const IndexAtom<MoleculeType> &other) const
+        {
+          return m_index < other.m_index;
+        }
+
+        bool operator>(const IndexAtom<MoleculeType> &other) const
+        {
+          return m_index > other.m_index;
+        }
+
+      private:
+        const MoleculeType *m_mol;
+        Index m_index;
+    };
+
+    /**
+     * @brief Class representing a bond in a molecule that stores its
+     * properties in arrays (e.g. FrozenMol, MoleculeView).
+     */
+    template<typename MoleculeType>
+    class IndexBond
+    {
+      public:
+        IndexBond(const MoleculeType *mol = 0, Index index = -1) : m_mol(mol), m_index(index)
+        {
+        }
+
+        const MoleculeType* mol() const
+        {
+          return m_mol;
+        }
+
+        Index index() const
+        {
+          return m_index;
+        }
+
+        /**
+         * Get the atom on the other side of the bond (used by Substructure).
+         */
+        IndexAtom<MoleculeType> other(const IndexAtom<MoleculeType> &atom) const
+        {
+          Index source = m_mol->source(m_index);
+          return IndexAtom<MoleculeType>(m_mol, source == atom.index() ? m_mol->target(m_index) : source);
+        }
+
+        bool operator==(const IndexBond<MoleculeType> &other) const
+        {
+          return m_index == other.m_index;
+        }
+
+        bool operator!=(const IndexBond<MoleculeType> &other) const
+        {
+          return m_index != other.m_index;
+        }
+
+        bool operator<(const IndexBond<MoleculeType> &other) const
+        {
+          return m_index < other.m_index;
+        }
+
+        bool operator>(const IndexBond<MoleculeType> &other) const
+        {
+          return m_index > other.m_index;
+        }
+
+      private:
+        const MoleculeType *m_mol;
+        Index m_index;
+    };
+
+    /**
+     * @brief Iterator over consecutive atom or bond indices.
+     */
+    template<typename MoleculeType, typename HandleType>
+    class index_iterator
+    {
+      public:
+        index_iterator() : m_mol(0), m_index(0)
+        {
+        }
+
+        index_iterator(const MoleculeType *mol, Index index) : m_mol(mol), m_index(index)
+        {
+        }
+
+        HandleType operator*() const
+        {
+          return HandleType(m_mol, m_index);
+        }
+
+        index_iterator<MoleculeType, HandleType>& operator++()
+        {
+          ++m_index;
+          return *this;
+        }
+
+        index_iterator<MoleculeType, HandleType> operator++(int)
+        {
+          index_iterator<MoleculeType, HandleType> tmp = *this;
+          ++m_index;
+          return tmp;
+        }
+
+        bool operator==(const index_iterator<MoleculeType, HandleType> &other) const
+        {
+          return m_index == other.m_index;
+        }
+
+        bool operator!=(const index_iterator<MoleculeType, HandleType> &other) const
+        {
+          return m_index != other.m_index;
+        }
+
+      private:
+        const MoleculeType *m_mol;
+        Index m_index;
+    };
+
+    /**
+     * @brief Iterator over a range of a flat incident bond or neighbor
+     * atom index array.
+     */
+    template<typename MoleculeType, typename HandleType>
+    class adjacency_iterator
+    {
+      public:
+        adjacency_iterator() : m_mol(0), m_iter(0)
+        {
+        }
+
+        adjacency_iterator(const MoleculeType *mol, const Index *iter) : m_mol(mol), m_iter(iter)
+        {
+        }
+
+        HandleType operator*() const
+        {
+          return HandleType(m_mol, *m_iter);
+        }
+
+        adjacency_iterator<MoleculeType, HandleType>& operator++()
+        {
+          ++m_iter;
+          return *this;
+        }
+
+        adjacency_iterator<MoleculeType, HandleType> operator++(int)
+        {
+          adjacency_iterator<MoleculeType, HandleType> tmp = *this;
+          ++m_iter;
+          return tmp;
+        }
+
+        bool operator==(const adjacency_iterator<MoleculeType, HandleType> &other) const
+        {
+          return m_iter == other.m_iter;
+        }
+
+        bool operator!=(const adjacency_iterator<MoleculeType, HandleType> &other) const
+        {
+          return m_iter != other.m_iter;
+        }
+
+      private:
+        const MoleculeType *m_mol;
+        const Index *m_iter;
+    };
+
+    // in namespace impl to be found by argument dependent lookup
+    template<typename MoleculeType>
+    std::ostream& operator<<(std::ostream &os, const IndexAtom<MoleculeType> &atom)
+    {
+      os << "Atom(" << atom.index() << ")";
+      return os;
+    }
+
+    template<typename MoleculeType>
+    std::ostream& operator<<(std::ostream &os, const IndexBond<MoleculeType> &bond)
+    {
+      os << "Bond(" << bond.index() << ")";
+      return os;
+    }
+
+  }
+
+  //@endcond
+
+  /**
+   * @class FrozenMol frozenmol.h <Helium/frozenmol.h>
+   * @brief Immutable molecule with a compact (CSR) adjacency representation.
+   *
+   * The incident bonds and neighbors of all atoms are stored in two flat
+   * arrays indexed by a per atom offset array (compressed sparse row) and
+   * all atom and bond properties are stored in byte-wide arrays. Compared to
+   * HeMol, iterating over the incident bonds or neighbors of an atom does
+   * not need a separate heap allocation per atom or a get_other() call and
+   * the properties do not need the bit masking of std::vector<bool>.
+   *
+   * A FrozenMol is created from any model of the Molecule concept (e.g.
+   * HeMol) and can not be modified afterwards. The atoms, bonds and the
+   * order of the incident bonds are the same as in the original molecule
+   * so algorithms produce the same results for both. The assign() member
+   * function reuses the allocated arrays when processing many molecules.
+   */
+  class FrozenMol
+  {
+    public:
+      typedef impl::IndexAtom<FrozenMol> atom_type;
+      typedef impl::IndexBond<FrozenMol> bond_type;
+
+      // iterators
+      typedef impl::index_iterator<FrozenMol, atom_type> atom_iter;
+      typedef impl::index_iterator<FrozenMol, bond_type> bond_iter;
+      typedef impl::adjacency_iterator<FrozenMol, bond_type> incident_iter;
+      typedef impl::adjacency_iterator<FrozenMol, atom_type> nbr_iter;
+
+      /**
+       * Constructor for an empty molecule.
+       */
+      FrozenMol()
+      {
+        m_offsets.push_back(0);
+      }
+
+      /**
+       * Constructor.
+       *
+       * @param mol The molecule to copy.
+       */
+      template<typename MoleculeType>
+      explicit FrozenMol(MoleculeType &mol)
+      {
+        assign(mol);
+      }
+
+      /**
+       * Replace the molecule with a copy of @p mol.
+       *
+       * @param mol The molecule to copy.
+       */
+      template<typename MoleculeType>
+      void assign(MoleculeType &mol);
+
+      /**
+       * Replace the molecule with a copy of the subgraph of @p mol induced by
+       * the @p atoms and @p bonds masks. The atoms and bonds get dense
+       * indices in the fragment (in the same order as in @p mol) and the
+       * incident bonds keep their relative order, so the fragment behaves
+       * the same as a Substructure for the same masks. Iterating over the
+       * fragment does not need to skip hidden atoms and bonds of the
+       * (possibly much larger) molecule.
+       *
+       * @param mol The molecule containing the fragment.
+       * @param atoms The atoms in the fragment (indexed by atom index).
+       * @param bonds The bonds in the fragment (indexed by bond index).
+       */
+      template<typename MoleculeType>
+      void assign(MoleculeType &mol, const std::vector<bool> &atoms, const std::vector<bool> &bonds);
+
+      Size numAtoms() const
+      {
+        return m_element.size();
+      }
+
+      Size numBonds() const
+      {
+        return m_source.size();
+      }
+
+      std::pair<atom_iter, atom_iter> atoms() const
+      {
+        return std::make_pair(atom_iter(this, 0), atom_iter(this, numAtoms()));
+      }
+
+      std::pair<bond_iter, bond_iter> bonds() const
+      {
+        return std::make_pair(bond_iter(this, 0), bond_iter(this, numBonds()));
+      }
+
+      atom_type atom(Index index) const
+      {
+        return atom_type(this, index);
+      }
+
+      bond_type bond(Index index) const
+      {
+        return bond_type(this, index);
+      }
+
+      std::pair<incident_iter, incident_iter> incident(Index atom) const
+      {
+        const Index *begin = m_incident.empty() ? 0 : &m_incident[0];
+        return std::make_pair(incident_iter(this, begin + m_offsets[atom]),
+                              incident_iter(this, begin + m_offsets[atom + 1]));
+      }
+
+      std::pair<nbr_iter, nbr_iter> nbrs(Index atom) const
+      {
+        const Index *begin = m_nbrs.empty() ? 0 : &m_nbrs[0];
+        return std::make_pair(nbr_iter(this, begin + m_offsets[atom]),
+                              nbr_iter(this, begin + m_offsets[atom + 1]));
+      }
+
+      int degree(Index atom) const
+      {
+        return m_offsets[atom + 1] - m_offsets[atom];
+      }
+
+      bool isAromatic(const atom_type &atom) const
+      {
+        return m_atomAromatic[atom.index()];
+      }
+
+      bool isCyclic(const atom_type &atom) const
+      {
+        return m_atomCyclic[atom.index()];
+      }
+
+      int element(Index atom) const
+      {
+        return m_element[atom];
+      }
+
+      int mass(Index atom) const
+      {
+        return m_mass[atom];
+      }
+
+      int hydrogens(Index atom) const
+      {
+        return m_hydrogens[atom];
+      }
+
+      int charge(Index atom) const
+      {
+        return m_charge[atom];
+      }
+
+      Index source(Index bond) const
+      {
+        return m_source[bond];
+      }
+
+      Index target(Index bond) const
+      {
+        return m_target[bond];
+      }
+
+      bool isAromatic(const bond_type &bond) const
+      {
+        return m_bondAromatic[bond.index()];
+      }
+
+      bool isCyclic(const bond_type &bond) const
+      {
+        return m_bondCyclic[bond.index()];
+      }
+
+      int order(Index bond) const
+      {
+        return m_order[bond];
+      }
+
+      static Index null_index()
+      {
+        return -1;
+      }
+
+      static atom_type null_atom()
+      {
+        return atom_type(0, -1);
+      }
+
+      static bond_type null_bond()
+      {
+        return bond_type(0, -1);
+      }
+
+    private:
+      void clear();
+
+      // adjacency
+      std::vector<Index> m_offsets; //!< numAtoms + 1 offsets in m_incident and m_nbrs
+      std::vector<Index> m_incident; //!< Incident bond indices
+      std::vector<Index> m_nbrs; //!< Neighbor atom indices (parallel to m_incident)
+
+      // atoms
+      std::vector<unsigned char> m_atomAromatic;
+      std::vector<unsigned char> m_atomCyclic;
+      std::vector<unsigned char> m_element;
+      std::vector<unsigned char> m_mass;
+      std::vector<unsigned char> m_hydrogens;
+      std::vector<signed char> m_charge;
+
+      // bonds
+      std::vector<Index> m_source;
+      std::vector<Index> m_target;
+      std::vector<unsigned char> m_bondAromatic;
+      std::vector<unsigned char> m_bondCyclic;
+      std::vector<unsigned char> m_order;
+
+      // fragments
+      std::vector<Index> m_atomIndices; //!< Fragment atom indices (see assign())
+      std::vector<Index> m_bondIndices; //!< Fragment bond indices (see assign())
+  };
+
+  typedef impl::IndexAtom<FrozenMol> FrozenAtom;
+  typedef impl::IndexBond<FrozenMol> FrozenBond;
+
+  //@cond dev
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // Molecule
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline Size num_atoms(const FrozenMol &mol)
+  {
+    return mol.numAtoms();
+  }
+
+  inline std::pair<FrozenMol::atom_iter, FrozenMol::atom_iter> get_atoms(const FrozenMol &mol)
+  {
+    return mol.atoms();
+  }
+
+  inline FrozenAtom get_atom(const FrozenMol &mol, Index index)
+  {
+    return mol.atom(index);
+  }
+
+  inline Size num_bonds(const FrozenMol &mol)
+  {
+    return mol.numBonds();
+  }
+
+  inline std::pair<FrozenMol::bond_iter, FrozenMol::bond_iter> get_bonds(const FrozenMol &mol)
+  {
+    return mol.bonds();
+  }
+
+  inline FrozenBond get_bond(const FrozenMol &mol, Index index)
+  {
+    return mol.bond(index);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // FrozenAtom
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline Index get_index(const FrozenMol &mol, const FrozenAtom &atom)
+  {
+    return atom.index();
+  }
+
+  inline std::pair<FrozenMol::incident_iter, FrozenMol::incident_iter>
+  get_bonds(const FrozenMol &mol, const FrozenAtom &atom)
+  {
+    return mol.incident(atom.index());
+  }
+
+  inline std::pair<FrozenMol::nbr_iter, FrozenMol::nbr_iter>
+  get_nbrs(const FrozenMol &mol, const FrozenAtom &atom)
+  {
+    return mol.nbrs(atom.index());
+  }
+
+  inline bool is_aromatic(const FrozenMol &mol, const FrozenAtom &atom)
+  {
+    return mol.isAromatic(atom);
+  }
+
+  inline bool is_cyclic(const FrozenMol &mol, const FrozenAtom &atom)
+  {
+    return mol.isCyclic(atom);
+  }
+
+  inline int get_element(const FrozenMol &mol, const FrozenAtom &atom)
+  {
+    return mol.element(atom.index());
+  }
+
+  inline int get_mass(const FrozenMol &mol, const FrozenAtom &atom)
+  {
+    return mol.mass(atom.index());
+  }
+
+  inline int get_degree(const FrozenMol &mol, const FrozenAtom &atom)
+  {
+    return mol.degree(atom.index());
+  }
+
+  inline int num_hydrogens(const FrozenMol &mol, const FrozenAtom &atom)
+  {
+    return mol.hydrogens(atom.index());
+  }
+
+  inline int get_charge(const FrozenMol &mol, const FrozenAtom &atom)
+  {
+    return mol.charge(atom.index());
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  //
+  // FrozenBond
+  //
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline Index get_index(const FrozenMol &mol, const FrozenBond &bond)
+  {
+    return bond.index();
+  }
+
+  inline FrozenAtom get_source(const FrozenMol &mol, const FrozenBond &bond)
+  {
+    return mol.atom(mol.source(bond.index()));
+  }
+
+  inline FrozenAtom get_target(const FrozenMol &mol, const FrozenBond &bond)
+  {
+    return mol.atom(mol.target(bond.index()));
+  }
+
+  inline FrozenAtom get_other(const FrozenMol &mol, const FrozenBond &bond, const FrozenAtom &atom)
+  {
+    Index source = mol.source(bond.index());
+    return mol.atom(source == atom.index() ? mol.target(bond.index()) : source);
+  }
+
+  inline bool is_aromatic(const FrozenMol &mol, const FrozenBond &bond)
+  {
+    return mol.isAromatic(bond);
+  }
+
+  inline bool is_cyclic(const FrozenMol &mol, const FrozenBond &bond)
+  {
+    return mol.isCyclic(bond);
+  }
+
+  inline bool get_order(const FrozenMol &mol, const FrozenBond &bond)
+  {
+    return mol.order(bond.index());
+  }
+
+  inline FrozenBond get_bond(const FrozenMol &mol, const FrozenAtom &source, const FrozenAtom &target)
+  {
+    FrozenMol::incident_iter bond, end_bonds;
+    FrozenMol::nbr_iter nbr, end_nbrs;
+    TIE(bond, end_bonds) = mol.incident(source.index());
+    TIE(nbr, end_nbrs) = mol.nbrs(source.index());
+    for (; bond != end_bonds; ++bond, ++nbr)
+      if (*nbr == target)
+        return *bond;
+    return mol.null_bond();
+  }
+
+  //@endcond
+
+  inline void FrozenMol::clear()
+  {
+    // clear() keeps the allocated memory
+    m_offsets.clear();
+    m_incident.clear();
+    m_nbrs.clear();
+    m_atomAromatic.clear();
+    m_atomCyclic.clear();
+    m_element.clear();
+    m_mass.clear();
+    m_hydrogens.clear();
+    m_charge.clear();
+    m_source.clear();
+    m_target.clear();
+    m_bondAromatic.clear();
+    m_bondCyclic.clear();
+    m_order.clear();
+    m_offsets.push_back(0);
+  }
+
+  template<typename MoleculeType>
+  void FrozenMol::assign(MoleculeType &mol)
+  {
+    typedef typename molecule_traits<MoleculeType>::atom_iter atom_iter;
+    typedef typename molecule_traits<MoleculeType>::bond_iter bond_iter;
+    typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
+
+    clear();
+
+
+    atom_iter atom, end_atoms;
+    TIE(atom, end_atoms) = get_atoms(mol);
+    for (; atom != end_atoms; ++atom) {
+      m_atomAromatic.push_back(is_aromatic(mol, *atom));
+      m_atomCyclic.push_back(is_cyclic(mol, *atom));
+      m_element.push_back(get_element(mol, *atom));
+      m_mass.push_back(get_mass(mol, *atom));
+      m_hydrogens.push_back(num_hydrogens(mol, *atom));
+      m_charge.push_back(get_charge(mol, *atom));
+
+      // the incident bonds are stored in the same order
+      incident_iter bond, end_bonds;
+      TIE(bond, end_bonds) = get_bonds(mol, *atom);
+      for (; bond != end_bonds; ++bond) {
+        m_incident.push_back(get_index(mol, *bond));
+        m_nbrs.push_back(get_index(mol, get_other(mol, *bond, *atom)));
+      }
+      m_offsets.push_back(m_incident.size());
+    }
+
+    bond_iter bond, end_bonds;
+    TIE(bond, end_bonds) = get_bonds(mol);
+    for (; bond != end_bonds; ++bond) {
+      m_source.push_back(get_index(mol, get_source(mol, *bond)));
+      m_target.push_back(get_index(mol, get_target(mol, *bond)));
+      m_bondAromatic.push_back(is_aromatic(mol, *bond));
+      m_bondCyclic.push_back(is_cyclic(mol, *bond));
+      m_order.push_back(get_order(mol, *bond));
+    }
+  }
+
+  template<typename MoleculeType>
+  void FrozenMol::assign(MoleculeType &mol, const std::vector<bool> &atoms, const std::vector<bool> &bonds)
+  {
+    typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
+    typedef typename molecule_traits<MoleculeType>::bond_type bond_type;
+    typedef typename molecule_traits<MoleculeType>::incident_iter incident_iter;
+
+    PRE(atoms.size() == num_atoms(mol));
+    PRE(bonds.size() == num_bonds(mol));
+
+    clear();
+
+    // the fragment indices of the atoms and bonds
+    m_atomIndices.resize(atoms.size());
+    m_bondIndices.resize(bonds.size());
+    Index numAtoms = 0, numBonds = 0;
+    for (std::size_t i = 0; i < atoms.size(); ++i)
+      m_atomIndices[i] = atoms[i] ? numAtoms++ : null_index();
+    for (std::size_t i = 0; i < bonds.size(); ++i)
+      m_bondIndices[i] = bonds[i] ? numBonds++ : null_index();
+
+    for (std::size_t i = 0; i < atoms.size(); ++i) {
+      if (!atoms[i])
+        continue;
+      atom_type atom = get_atom(mol, i);
+      m_atomAromatic.push_back(is_aromatic(mol, atom));
+      m_atomCyclic.push_back(is_cyclic(mol, atom));
+      m_element.push_back(get_element(mol, atom));
+      m_mass.push_back(get_mass(mol, atom));
+      m_hydrogens.push_back(num_hydrogens(mol, atom));
+      m_charge.push_back(get_charge(mol, atom));
+
+      // the incident fragment bonds are stored in the same order
+      incident_iter bond, end_bonds;
+      TIE(bond, end_bonds) = get_bonds(mol, atom);
+      for (; bond != end_bonds; ++bond) {
+        Index index = get_index(mol, *bond);
+        if (!bonds[index])
+          continue;
+        m_incident.push_back(m_bondIndices[index]);
+        m_nbrs.push_back(m_atomIndices[get_index(mol, get_other(mol, *bond, atom))]);
+      }
+      m_offsets.push_back(m_incident.size());
+    }
+
+    for (std::size_t i = 0; i < bonds.size(); ++i) {
+      if (!bonds[i])
+        continue;
+      bond_type bond = get_bond(mol, i);
+      m_source.push_back(m_atomIndices[get_index(mol, get_source(mol, bond))]);
+      m_target.push_back(m_atomIndices[get_index(mol, get_target(mol, bond))]);
+      m_bondAromatic.push_back(is_aromatic(mol, bond));
+      m_bondCyclic.push_back(is_cyclic(mol, bond));
+      m_order.push_back(get_order(mol, bond));
+    }
+  }
+
+}
+
+#endif
@@ -30,14 +30,17 @@ namespace Helium {
 
   molecule_traits<HeMol>::atom_type HeMol::addAtom()
   {
+    m_cache.invalidate();
     Index index = m_element.size();
-    m_adjList.resize(m_adjList.size() + 1);
-    m_atomAromatic.resize(m_atomAromatic.size() + 1);
-    m_atomCyclic.resize(m_atomCyclic.size() + 1);
-    m_element.resize(m_element.size() + 1);
-    m_mass.resize(m_mass.size() + 1);
-    m_hydrogens.resize(m_hydrogens.size() + 1);
-    m_charge.resize(m_charge.size() + 1);
+    // reuse the incident bond lists kept by clear()
+    if (m_adjList.size() == index)
+      m_adjList.resize(index + 1);
+    m_atomAromatic.push_back(false);
+    m_atomCyclic.push_back(false);
+    m_element.push_back(0);
+    m_mass.push_back(0);
+    m_hydrogens.push_back(0);
+    m_charge.push_back(0);
 
     return atom_type(this, index);
   }
@@ -45,13 +48,14 @@ namespace Helium {
   molecule_traits<HeMol>::bond_type HeMol::addBond(const molecule_traits<HeMol>::atom_type &source,
                                                    const molecule_traits<HeMol>::atom_type &target)
   {
+    m_cache.invalidate();
     Index index = m_order.size();
 
     m_source.push_back(source.index());
     m_target.push_back(target.index());
-    m_bondAromatic.resize(m_bondAromatic.size() + 1);
-    m_bondCyclic.resize(m_bondCyclic.size() + 1);
-    m_order.resize(m_order.size() + 1);
+    m_bondAromatic.push_back(false);
+    m_bondCyclic.push_back(false);
+    m_order.push_back(0);
 
     bond_type bond(this, index);
 
@@ -61,9 +65,55 @@ namespace Helium {
     return bond;
   }
 
+  void HeMol::reserve(Size numAtoms, Size numBonds)
+  {
+    if (m_adjList.size() < numAtoms)
+      m_adjList.resize(numAtoms);
+    m_atomAromatic.reserve(numAtoms);
+    m_atomCyclic.reserve(numAtoms);
+    m_element.reserve(numAtoms);
+    m_mass.reserve(numAtoms);
+    m_hydrogens.reserve(numAtoms);
+    m_charge.reserve(numAtoms);
+
+    m_source.reserve(numBonds);
+    m_target.reserve(numBonds);
+    m_bondAromatic.reserve(numBonds);
+    m_bondCyclic.reserve(numBonds);
+    m_order.reserve(numBonds);
+  }
+
+  void HeMol::assign(Size numAtoms, const std::vector<std::pair<Index, Index> > &bonds)
+  {
+    clear();
+    reserve(numAtoms, bonds.size());
+
+    m_atomAromatic.resize(numAtoms);
+    m_atomCyclic.resize(numAtoms);
+    m_element.resize(numAtoms);
+    m_mass.resize(numAtoms);
+    m_hydrogens.resize(numAtoms);
+    m_charge.resize(numAtoms);
+
+    m_bondAromatic.resize(bonds.size());
+    m_bondCyclic.resize(bonds.size());
+    m_order.resize(bonds.size());
+
+    for (std::size_t i = 0; i < bonds.size(); ++i) {
+      assert(bonds[i].first < numAtoms && bonds[i].second < numAtoms);
+      m_source.push_back(bonds[i].first);
+      m_target.push_back(bonds[i].second);
+      m_adjList[bonds[i].first].push_back(bond_type(this, i));
+      m_adjList[bonds[i].second].push_back(bond_type(this, i));
+    }
+  }
+
   void HeMol::clear()
   {
-    m_adjList.clear();
+    m_cache.invalidate();
+    // keep the allocated incident bond lists
+    for (std::size_t i = 0; i < m_element.size(); ++i)
+      m_adjList[i].clear();
     m_atomAromatic.clear();
     m_atomCyclic.clear();
     m_element.clear();
@@ -80,7 +130,9 @@ namespace Helium {
 
   void HeMol::renumberAtoms(const std::vector<Index> &permutation)
   {
-    assert(permutation.size() == m_adjList.size());
+    assert(permutation.size() == m_element.size());
+    m_cache.invalidate();
+    m_adjList.resize(m_element.size());
     impl::apply_permutation(m_adjList, permutation);
     impl::apply_permutation(m_atomAromatic, permutation);
     impl::apply_permutation(m_atomCyclic, permutation);
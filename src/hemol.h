@@ -122,6 +122,7 @@ namespace Helium {
         void setAromatic(bool value)
         {
           m_mol->m_atomAromatic[m_index] = value;
+          m_mol->m_cache.invalidate();
         }
 
         bool isCyclic() const
@@ -132,6 +133,7 @@ namespace Helium {
         void setCyclic(bool value)
         {
           m_mol->m_atomCyclic[m_index] = value;
+          m_mol->m_cache.invalidate();
         }
 
         int element() const
@@ -142,6 +144,7 @@ namespace Helium {
         void setElement(int value)
         {
           m_mol->m_element[m_index] = value;
+          m_mol->m_cache.invalidate();
         }
 
         int mass() const
@@ -152,6 +155,7 @@ namespace Helium {
         void setMass(int value)
         {
           m_mol->m_mass[m_index] = value;
+          m_mol->m_cache.invalidate();
         }
 
         int degree() const
@@ -167,6 +171,7 @@ namespace Helium {
         void setHydrogens(int value)
         {
           m_mol->m_hydrogens[m_index] = value;
+          m_mol->m_cache.invalidate();
         }
 
         int charge() const
@@ -177,6 +182,7 @@ namespace Helium {
         void setCharge(int value)
         {
           m_mol->m_charge[m_index] = value;
+          m_mol->m_cache.invalidate();
         }
 
         bool operator==(const atom_type &other) const
@@ -245,6 +251,7 @@ namespace Helium {
         void setAromatic(bool value)
         {
           m_mol->m_bondAromatic[m_index] = value;
+          m_mol->m_cache.invalidate();
         }
 
         bool isCyclic() const
@@ -255,6 +262,7 @@ namespace Helium {
         void setCyclic(bool value)
         {
           m_mol->m_bondCyclic[m_index] = value;
+          m_mol->m_cache.invalidate();
         }
 
         int order() const
@@ -265,6 +273,7 @@ namespace Helium {
         void setOrder(int value)
         {
           m_mol->m_order[m_index] = value;
+          m_mol->m_cache.invalidate();
         }
 
         bool operator==(const bond_type &other) const
@@ -372,6 +381,46 @@ namespace Helium {
         Index m_index;
     };
 
+    /**
+     * @brief Lazily computed derived properties of a HeMol.
+     *
+     * The properties are computed by the functions in
+     * Helium/algorithms/cachedproperties.h. Any change to the molecule
+     * invalidates all properties.
+     */
+    struct HeMolCache
+    {
+      enum Property
+      {
+        CycleMembership = 1,
+        ExtendedConnectivities = 2
+      };
+
+      HeMolCache() : valid(0)
+      {
+      }
+
+      bool isValid(Property property) const
+      {
+        return valid & property;
+      }
+
+      void validate(Property property)
+      {
+        valid |= property;
+      }
+
+      void invalidate()
+      {
+        valid = 0;
+      }
+
+      unsigned int valid; //!< The valid properties (bitwise or of Property values)
+      std::vector<bool> cyclicAtoms; //!< The cyclic atoms (cycle_membership())
+      std::vector<bool> cyclicBonds; //!< The cyclic bonds (cycle_membership())
+      std::vector<unsigned long> ec; //!< The extended connectivities (extended_connectivities())
+    };
+
     template<typename T>
     void apply_permutation(std::vector<T> &elements, const std::vector<Index> &permutation)
     {
@@ -451,16 +500,51 @@ namespace Helium {
 
       bond_type addBond(const atom_type &source, const atom_type &target);
 
+      /**
+       * Reserve memory for the specified number of atoms and bonds. Adding
+       * atoms and bonds up to these numbers will not allocate memory.
+       *
+       * @param numAtoms The number of atoms.
+       * @param numBonds The number of bonds.
+       */
+      void reserve(Size numAtoms, Size numBonds);
+
+      /**
+       * Replace the molecule by @p numAtoms atoms and the bonds between the
+       * specified pairs of atom indices. The atom and bond properties are
+       * set to their default values (i.e. all zero) and can be set using
+       * the atom_type and bond_type member functions.
+       *
+       * @param numAtoms The number of atoms.
+       * @param bonds The source and target atom indices for the bonds.
+       */
+      void assign(Size numAtoms, const std::vector<std::pair<Index, Index> > &bonds);
+
+      /**
+       * Remove all atoms and bonds. The allocated memory (including the
+       * memory for the incident bonds of the atoms) is kept to allow the
+       * molecule to be reused without allocations (e.g. when reading many
+       * molecules from a file).
+       */
       void clear();
 
       void renumberAtoms(const std::vector<Index> &permutation);
 
+      /**
+       * Get the cache for derived properties (see
+       * Helium/algorithms/cachedproperties.h).
+       */
+      impl::HeMolCache& cache() const
+      {
+        return m_cache;
+      }
+
      private:
       template<typename> friend class impl::HeAtom;
       template<typename> friend class impl::HeBond;
 
       // atoms
-      std::vector<std::vector<bond_type> > m_adjList;
+      std::vector<std::vector<bond_type> > m_adjList; // may contain unused (empty) lists at the end
       std::vector<bool> m_atomAromatic;
       std::vector<bool> m_atomCyclic;
       std::vector<unsigned char> m_element;
@@ -474,6 +558,8 @@ namespace Helium {
       std::vector<bool> m_bondAromatic;
       std::vector<bool> m_bondCyclic;
       std::vector<unsigned char> m_order;
+
+      mutable impl::HeMolCache m_cache; //!< Derived properties
   };
 
   typedef impl::HeAtom<HeMol> HeAtom;
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_INSTRUMENTATION_H
+#define HELIUM_INSTRUMENTATION_H
+
+#include <Helium/config.h>
+
+#include <json/json.h>
+
+#include <map>
+#include <string>
+
+#ifdef HAVE_INSTRUMENTATION
+#include <Helium/timeout.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#endif
+
+namespace Helium {
+
+  /**
+   * @file instrumentation.h
+   * @brief Hot-path counters and phase timers.
+   *
+   * The search functions update counters (e.g. the number of Tanimoto
+   * coefficients computed) and time their phases (the TIMER() calls). Each
+   * thread updates its own counters so there is no contention between the
+   * threads of a ThreadPool. A ProfileScope sums the counters of all threads
+   * at the start and end of a query to get the Profile for the query.
+   *
+   * The instrumentation is only compiled when Helium is configured with
+   * ENABLE_INSTRUMENTATION (which requires ENABLE_CPP11). Otherwise the
+   * HELIUM_COUNT() and HELIUM_PHASE() macros expand to nothing and the
+   * profiles are always empty.
+   *
+   * @code
+   * ProfileScope scope;
+   * index.search(query, 0.7);
+   * std::cout << scope.profile().json() << std::endl;
+   * @endcode
+   */
+
+  /**
+   * The instrumentation counters.
+   */
+  enum ProfileCounter
+  {
+    KdGridNodesVisited, //!< Inner kD-grid nodes visited by SimilaritySearchIndex
+    LeavesScanned, //!< kD-grid leaves scanned by SimilaritySearchIndex
+    TanimotosComputed, //!< Similarity scores computed (brute force, bit-sliced and index search)
+    FingerprintsScreened, //!< Fingerprints screened by substructure_screen()
+    CandidatesVerified, //!< Molecules matched by IsomorphismMatcher or DomainIsomorphismMatcher
+    IsomorphismBacktracks, //!< Backtracking steps in IsomorphismMatcher or DomainIsomorphismMatcher
+    FoldedBoundsComputed, //!< Folded fingerprint bounds computed by FoldedSimilaritySearch
+    NumProfileCounters
+  };
+
+  /**
+   * Get the name for a counter (as used by Profile::json()).
+   */
+  inline const char* profile_counter_name(ProfileCounter counter)
+  {
+    static const char *names[NumProfileCounters] = { "kd_grid_nodes_visited", "leaves_scanned",
+      "tanimotos_computed", "fingerprints_screened", "candidates_verified", "isomorphism_backtracks",
+      "folded_bounds_computed" };
+    return names[counter];
+  }
+
+  /**
+   * Check if Helium was built with instrumentation (ENABLE_INSTRUMENTATION).
+   */
+  inline bool instrumentation_enabled()
+  {
+#ifdef HAVE_INSTRUMENTATION
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * @brief Counters and phase times for a query (or any other part of a
+   * program).
+   */
+  struct Profile
+  {
+    /**
+     * The number of calls and the total time for a phase. Nested phases are
+     * included in the time of the enclosing phase.
+     */
+    struct Phase
+    {
+      Phase() : calls(0), nanoseconds(0)
+      {
+      }
+
+      unsigned long long calls;
+      unsigned long long nanoseconds;
+    };
+
+    Profile()
+    {
+      for (int i = 0; i < NumProfileCounters; ++i)
+        counters[i] = 0;
+    }
+
+    Profile& operator+=(const Profile &other)
+    {
+      for (int i = 0; i < NumProfileCounters; ++i)
+        counters[i] += other.counters[i];
+      for (std::map<std::string, Phase>::const_iterator i = other.phases.begin(); i != other.phases.end(); ++i) {
+        phases[i->first].calls += i->second.calls;
+        phases[i->first].nanoseconds += i->second.nanoseconds;
+      }
+      return *this;
+    }
+
+    /**
+     * Subtract an earlier snapshot, phases without calls are removed.
+     */
+    Profile& operator-=(const Profile &other)
+    {
+      for (int i = 0; i < NumProfileCounters; ++i)
+        counters[i] -= other.counters[i];
+      for (std::map<std::string, Phase>::const_iterator i = other.phases.begin(); i != other.phases.end(); ++i) {
+        Phase &phase = phases[i->first];
+        phase.calls -= i->second.calls;
+        phase.nanoseconds -= i->second.nanoseconds;
+        if (!phase.calls)
+          phases.erase(i->first);
+      }
+      return *this;
+    }
+
+    /**
+     * Get the counters and phases as JSON:
+     *
+     * @code
+     * { "counters": { "leaves_scanned": 12, ... },
+     *   "phases": { "SimilaritySearchIndex::search": { "calls": 1, "ms": 0.25 } } }
+     * @endcode
+     *
+     * The phase names are the TIMER() messages without the trailing "():".
+     */
+    Json::Value json() const
+    {
+      Json::Value data;
+      data["counters"] = Json::Value(Json::objectValue);
+      for (int i = 0; i < NumProfileCounters; ++i)
+        data["counters"][profile_counter_name(static_cast<ProfileCounter>(i))] = Json::UInt64(counters[i]);
+      data["phases"] = Json::Value(Json::objectValue);
+      for (std::map<std::string, Phase>::const_iterator i = phases.begin(); i != phases.end(); ++i) {
+        std::string name = i->first;
+        std::size_t end = name.find_last_not_of(" :");
+        name.erase(end == std::string::npos ? 0 : end + 1);
+        if (name.size() > 2 && name.compare(name.size() - 2, 2, "()") == 0)
+          name.erase(name.size() - 2);
+        Json::Value &phase = data["phases"][name];
+        phase["calls"] = Json::UInt64(i->second.calls + (phase.isMember("calls") ? phase["calls"].asUInt64() : 0));
+        phase["ms"] = i->second.nanoseconds / 1e6 + (phase.isMember("ms") ? phase["ms"].asDouble() : 0.0);
+      }
+      return data;
+    }
+
+    unsigned long long counters[NumProfileCounters];
+    std::map<std::string, Phase> phases;
+  };
+
+#ifdef HAVE_INSTRUMENTATION
+  namespace impl {
+
+    /**
+     * The counters and phase times for a single thread. The counters are
+     * only written by the owning thread (relaxed load and store, no locked
+     * instructions), the phases are protected by a mutex since they are
+     * only updated when a phase ends.
+     */
+    struct ThreadProfile
+    {
+      ThreadProfile()
+      {
+        for (int i = 0; i < NumProfileCounters; ++i)
+          counters[i].store(0, std::memory_order_relaxed);
+      }
+
+      void add(ProfileCounter counter, unsigned long long n)
+      {
+        counters[counter].store(counters[counter].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+      }
+
+      void addPhase(const char *name, unsigned long long nanoseconds)
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        Profile::Phase &phase = phases[name];
+        ++phase.calls;
+        phase.nanoseconds += nanoseconds;
+      }
+
+      void snapshot(Profile &profile)
+      {
+        for (int i = 0; i < NumProfileCounters; ++i)
+          profile.counters[i] += counters[i].load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex);
+        // phases with equal messages (e.g. overloads) are merged
+        for (std::map<const char*, Profile::Phase>::const_iterator i = phases.begin(); i != phases.end(); ++i) {
+          Profile::Phase &phase = profile.phases[i->first];
+          phase.calls += i->second.calls;
+          phase.nanoseconds += i->second.nanoseconds;
+        }
+      }
+
+      std::atomic<unsigned long long> counters[NumProfileCounters];
+      std::map<const char*, Profile::Phase> phases; //!< Keyed by the TIMER() message literal
+      std::mutex mutex;
+    };
+
+    /**
+     * All thread profiles. The profiles are never deleted so the totals
+     * include the work done by threads that have exited.
+     */
+    struct ProfileRegistry
+    {
+      static ProfileRegistry& instance()
+      {
+        static ProfileRegistry *registry = new ProfileRegistry;
+        return *registry;
+      }
+
+      ThreadProfile* create()
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        profiles.push_back(new ThreadProfile);
+        return profiles.back();
+      }
+
+      std::vector<ThreadProfile*> profiles;
+      std::mutex mutex;
+    };
+
+    inline ThreadProfile& thread_profile()
+    {
+      static thread_local ThreadProfile *profile = ProfileRegistry::instance().create();
+      return *profile;
+    }
+
+    /**
+     * Add the time between construction and destruction to a phase.
+     */
+    class PhaseTimer
+    {
+      public:
+        PhaseTimer(const char *name) : m_name(name), m_start(monotonic_nanoseconds())
+        {
+        }
+
+        ~PhaseTimer()
+        {
+          thread_profile().addPhase(m_name, monotonic_nanoseconds() - m_start);
+        }
+
+      private:
+        const char *m_name;
+        unsigned long long m_start;
+    };
+
+  }
+#endif
+
+  /**
+   * Get the sum of the counters and phases of all threads since the start
+   * of the program. This is an empty profile when the instrumentation is
+   * disabled.
+   */
+  inline Profile profile_snapshot()
+  {
+    Profile profile;
+#ifdef HAVE_INSTRUMENTATION
+    impl::ProfileRegistry &registry = impl::ProfileRegistry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (std::size_t i = 0; i < registry.profiles.size(); ++i)
+      registry.profiles[i]->snapshot(profile);
+#endif
+    return profile;
+  }
+
+  /**
+   * @brief Profile the work done (by all threads) while the scope is alive.
+   *
+   * Work done by other queries running at the same time is included, the
+   * scope should only be used when the queries are run one at a time (the
+   * search itself can use any number of threads).
+   */
+  class ProfileScope
+  {
+    public:
+      ProfileScope() : m_start(profile_snapshot())
+      {
+      }
+
+      /**
+       * Get the profile for the work done since the scope was created.
+       */
+      Profile profile() const
+      {
+        Profile profile = profile_snapshot();
+        profile -= m_start;
+        return profile;
+      }
+
+    private:
+      Profile m_start;
+  };
+
+}
+
+#define HELIUM_PROFILE_CONCAT_IMPL(a, b) a##b
+#define HELIUM_PROFILE_CONCAT(a, b) HELIUM_PROFILE_CONCAT_IMPL(a, b)
+
+#ifdef HAVE_INSTRUMENTATION
+  /**
+   * Add @p n to a ProfileCounter for the calling thread.
+   */
+  #define HELIUM_COUNT(counter, n) ::Helium::impl::thread_profile().add(::Helium::counter, n)
+  /**
+   * Time the rest of the enclosing scope as a phase, @p name must be a
+   * string literal.
+   */
+  #define HELIUM_PHASE(name) \
+    ::Helium::impl::PhaseTimer HELIUM_PROFILE_CONCAT(heliumPhaseTimer, __LINE__)(name)
+#else
+  #define HELIUM_COUNT(counter, n) do {} while (0)
+  #define HELIUM_PHASE(name)
+#endif
+
+#endif
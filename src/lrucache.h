@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_LRUCACHE_H
+#define HELIUM_LRUCACHE_H
+
+#include <list>
+#include <map>
+
+namespace Helium {
+
+  /**
+   * @class LRUCache lrucache.h <Helium/lrucache.h>
+   * @brief Memory bounded least recently used cache.
+   *
+   * The size of each value is specified when it is inserted (e.g. the
+   * number of bytes used by a vector of hits) and the least recently used
+   * values are evicted when the total size exceeds the capacity. A value
+   * that is larger than the capacity is not stored. Both find() and
+   * insert() mark the value as most recently used.
+   *
+   * The cache is not thread safe, concurrent access must be serialized by
+   * the caller.
+   *
+   * @tparam Key The key type, must be less than comparable.
+   * @tparam Value The value type, must be copyable.
+   */
+  template<typename Key, typename Value>
+  class LRUCache
+  {
+      struct Entry
+      {
+        Entry(const Key &key_, const Value &value_, std::size_t size_)
+          : key(key_), value(value_), size(size_)
+        {
+        }
+
+        Key key;
+        Value value;
+        std::size_t size;
+      };
+
+      typedef std::list<Entry> EntryList;
+      typedef std::map<Key, typename EntryList::iterator> EntryMap;
+
+    public:
+      /**
+       * Constructor.
+       *
+       * @param capacity The maximum total size of the values, 0 disables
+       *        the cache.
+       */
+      LRUCache(std::size_t capacity = 0) : m_capacity(capacity), m_size(0),
+          m_hits(0), m_misses(0)
+      {
+      }
+
+      /**
+       * Get the maximum total size of the values.
+       */
+      std::size_t capacity() const
+      {
+        return m_capacity;
+      }
+
+      /**
+       * Set the maximum total size of the values. Values are evicted if
+       * the new capacity is smaller than the current size.
+       */
+      void setCapacity(std::size_t capacity)
+      {
+        m_capacity = capacity;
+        evict();
+      }
+
+      /**
+       * Get the total size of the values in the cache.
+       */
+      std::size_t size() const
+      {
+        return m_size;
+      }
+
+      /**
+       * Get the number of values in the cache.
+       */
+      std::size_t numEntries() const
+      {
+        return m_map.size();
+      }
+
+      /**
+       * Get the number of find() calls that found a value.
+       */
+      std::size_t hits() const
+      {
+        return m_hits;
+      }
+
+      /**
+       * Get the number of find() calls that did not find a value.
+       */
+      std::size_t misses() const
+      {
+        return m_misses;
+      }
+
+      /**
+       * Find a value.
+       *
+       * @param key The key.
+       * @param value Output parameter for the value.
+       *
+       * @return True if the value was found.
+       */
+      bool find(const Key &key, Value &value)
+      {
+        typename EntryMap::iterator i = m_map.find(key);
+        if (i == m_map.end()) {
+          ++m_misses;
+          return false;
+        }
+        ++m_hits;
+        m_entries.splice(m_entries.begin(), m_entries, i->second);
+        value = i->second->value;
+        return true;
+      }
+
+      /**
+       * Insert a value. An existing value for the same key is replaced.
+       *
+       * @param key The key.
+       * @param value The value.
+       * @param size The size of the value.
+       */
+      void insert(const Key &key, const Value &value, std::size_t size)
+      {
+        erase(key);
+        if (size > m_capacity)
+          return;
+        m_entries.push_front(Entry(key, value, size));
+        m_map[key] = m_entries.begin();
+        m_size += size;
+        evict();
+      }
+
+      /**
+       * Remove the value for @p key (if any).
+       */
+      void erase(const Key &key)
+      {
+        typename EntryMap::iterator i = m_map.find(key);
+        if (i == m_map.end())
+          return;
+        m_size -= i->second->size;
+        m_entries.erase(i->second);
+        m_map.erase(i);
+      }
+
+      /**
+       * Remove all values.
+       */
+      void clear()
+      {
+        m_entries.clear();
+        m_map.clear();
+        m_size = 0;
+      }
+
+    private:
+      void evict()
+      {
+        while (m_size > m_capacity && !m_entries.empty()) {
+          m_size -= m_entries.back().size;
+          m_map.erase(m_entries.back().key);
+          m_entries.pop_back();
+        }
+      }
+
+      EntryList m_entries; //!< Most recently used first
+      EntryMap m_map; //!< Key -> entry
+      std::size_t m_capacity;
+      std::size_t m_size;
+      std::size_t m_hits;
+      std::size_t m_misses;
+  };
+
+}
+
+#endif
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_PROPERTYFILTERS_H
+#define HELIUM_PROPERTYFILTERS_H
+
+#include <Helium/molecule.h>
+#include <Helium/hemol.h>
+#include <Helium/algorithms/components.h>
+#include <Helium/algorithms/cycles.h>
+#include <Helium/fileio/file.h>
+#include <Helium/fingerprints/screen.h>
+#include <Helium/util.h>
+
+#include <json/json.h>
+
+#include <stdexcept>
+#include <vector>
+
+namespace Helium {
+
+  /**
+   * @file propertyfilters.h
+   * @brief Molecule property filters for substructure searches.
+   */
+
+  //@cond dev
+
+  namespace impl {
+
+    /**
+     * The elements for which the number of atoms is stored.
+     */
+    inline const std::vector<int>& property_filter_elements()
+    {
+      static const int elements[] = { 6, 7, 8, 9, 15, 16, 17, 35, 53 };
+      static const std::vector<int> result(elements, elements + sizeof(elements) / sizeof(int));
+      return result;
+    }
+
+  }
+
+  //@endcond
+
+  /**
+   * @brief Compute the property values used by the property filters.
+   *
+   * The values are the number of atoms, the number of bonds, the number of
+   * rings (i.e. the cyclomatic number) and the number of atoms for each
+   * element in impl::property_filter_elements(). A query can only be a
+   * substructure of a molecule if none of its values exceeds the
+   * molecule's values. The element counts assume the atom matcher only
+   * matches atoms with the same element (e.g. DefaultAtomMatcher).
+   *
+   * @param mol The molecule.
+   *
+   * @return The property values.
+   */
+  template<typename MoleculeType>
+  std::vector<unsigned int> property_filter_values(MoleculeType &mol)
+  {
+    const std::vector<int> &elements = impl::property_filter_elements();
+    std::vector<unsigned int> values(3 + elements.size(), 0);
+    values[0] = num_atoms(mol);
+    values[1] = num_bonds(mol);
+    // isolated atoms (e.g. counter ions) are components too
+    values[2] = num_atoms(mol) ? cyclomatic_number(mol, unique_elements(connected_atom_components(mol))) : 0;
+
+    FOREACH_ATOM (atom, mol, MoleculeType) {
+      std::vector<int>::const_iterator element = std::find(elements.begin(), elements.end(), get_element(mol, *atom));
+      if (element != elements.end())
+        ++values[3 + (element - elements.begin())];
+    }
+
+    return values;
+  }
+
+  /**
+   * @brief Property filter index for substructure searches.
+   *
+   * For each property (see property_filter_values()) and threshold t in the
+   * range [1, numThresholds(property)], the index contains a cumulative
+   * bitmap with the molecules for which the property value is at least t.
+   * For a query with value v, threshold min(v, numThresholds(property)) is
+   * used to remove the molecules with smaller values. These bitmaps are
+   * intersected together with the fingerprint columns when screening (see
+   * operands() and substructure_screen()).
+   *
+   * The index is stored in a Helium binary file with a JSON header
+   * containing the 'filetype' ('property_filters'), 'num_molecules' and
+   * 'properties' attributes. The last is an array with the 'name' and
+   * 'thresholds' for each property, the bitmaps follow the header in the
+   * same order.
+   */
+  class PropertyFilterIndex
+  {
+    public:
+      PropertyFilterIndex() : m_numMolecules(0)
+      {
+      }
+
+      /**
+       * Get the number of molecules.
+       */
+      unsigned int numMolecules() const
+      {
+        return m_numMolecules;
+      }
+
+      /**
+       * Get the number of properties.
+       */
+      unsigned int numProperties() const
+      {
+        return m_thresholds.size();
+      }
+
+      /**
+       * Get the name of a property (e.g. "atoms", "rings" or "N").
+       */
+      std::string propertyName(unsigned int property) const
+      {
+        if (property == 0)
+          return "atoms";
+        if (property == 1)
+          return "bonds";
+        if (property == 2)
+          return "rings";
+        // symbols for impl::property_filter_elements()
+        static const char *symbols[] = { "C", "N", "O", "F", "P", "S", "Cl", "Br", "I" };
+        return symbols[property - 3];
+      }
+
+      /**
+       * Get the number of thresholds for a property.
+       */
+      unsigned int numThresholds(unsigned int property) const
+      {
+        return m_thresholds[property];
+      }
+
+      /**
+       * Get the bitmap with the molecules for which the property value is at
+       * least @p threshold.
+       *
+       * @param property The property.
+       * @param threshold The threshold, in the range [1, numThresholds(property)].
+       */
+      const Word* bitmap(unsigned int property, unsigned int threshold) const
+      {
+        PRE(threshold >= 1 && threshold <= m_thresholds[property]);
+        return &m_bitmaps[(m_offsets[property] + threshold - 1) * numWords()];
+      }
+
+      /**
+       * Get the number of set bits in a bitmap.
+       */
+      unsigned int count(unsigned int property, unsigned int threshold) const
+      {
+        PRE(threshold >= 1 && threshold <= m_thresholds[property]);
+        return m_counts[m_offsets[property] + threshold - 1];
+      }
+
+      /**
+       * Build the index.
+       *
+       * @param moleculeFile The molecule file, this must have the
+       *        numMolecules() and read_molecule(index, mol) member functions.
+       * @param maxThreshold The maximum number of thresholds per property.
+       */
+      template<typename MoleculeFileType>
+      void build(MoleculeFileType &moleculeFile, unsigned int maxThreshold = 32)
+      {
+        TIMER("PropertyFilterIndex::build():");
+        PRE(maxThreshold >= 1 && maxThreshold <= 255);
+        m_numMolecules = moleculeFile.numMolecules();
+        unsigned int numProperties = 3 + impl::property_filter_elements().size();
+
+        // compute the (clamped) property values
+        std::vector<unsigned char> values(static_cast<std::size_t>(m_numMolecules) * numProperties);
+        m_thresholds.assign(numProperties, 1);
+        HeMol mol;
+        for (unsigned int i = 0; i < m_numMolecules; ++i) {
+          moleculeFile.read_molecule(i, mol);
+          std::vector<unsigned int> molValues = property_filter_values(mol);
+          for (unsigned int j = 0; j < numProperties; ++j) {
+            unsigned int value = std::min(molValues[j], maxThreshold);
+            values[static_cast<std::size_t>(i) * numProperties + j] = value;
+            m_thresholds[j] = std::max(m_thresholds[j], value);
+          }
+        }
+
+        // create the cumulative bitmaps
+        initBitmaps();
+        for (unsigned int i = 0; i < m_numMolecules; ++i)
+          for (unsigned int j = 0; j < numProperties; ++j)
+            for (unsigned int t = 1; t <= values[static_cast<std::size_t>(i) * numProperties + j]; ++t)
+              bitvec_set(i, &m_bitmaps[(m_offsets[j] + t - 1) * numWords()]);
+        computeCounts();
+      }
+
+      /**
+       * Save the index to a file. Errors are reported by throwing a
+       * std::runtime_error.
+       */
+      void save(const std::string &filename) const
+      {
+        BinaryOutputFile file(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open property filter file \"", filename, "\""));
+
+        Json::Value data;
+        data["filetype"] = "property_filters";
+        data["num_molecules"] = m_numMolecules;
+        data["properties"] = Json::Value(Json::arrayValue);
+        for (unsigned int i = 0; i < numProperties(); ++i) {
+          Json::Value property;
+          property["name"] = propertyName(i);
+          property["thresholds"] = m_thresholds[i];
+          data["properties"].append(property);
+        }
+        Json::StyledWriter writer;
+        if (!file.writeHeader(writer.write(data)))
+          throw std::runtime_error(make_string("Could not write property filter file \"", filename, "\""));
+
+        if (!m_bitmaps.empty() && !file.write(&m_bitmaps[0], m_bitmaps.size() * sizeof(Word)))
+          throw std::runtime_error(make_string("Could not write property filter file \"", filename, "\""));
+      }
+
+      /**
+       * Load the index from a file. Errors are reported by throwing a
+       * std::runtime_error.
+       */
+      void load(const std::string &filename)
+      {
+        TIMER("PropertyFilterIndex::load():");
+        BinaryInputFile file(filename);
+        if (!file)
+          throw std::runtime_error(make_string("Could not open property filter file \"", filename, "\""));
+
+        Json::Reader reader;
+        Json::Value data;
+        if (!reader.parse(file.header(), data))
+          throw std::runtime_error(reader.getFormattedErrorMessages());
+        if (!data.isMember("filetype") || data["filetype"].asString() != "property_filters")
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'filetype' attribute or is not 'property_filters'"));
+        if (!data.isMember("num_molecules"))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_molecules' attribute"));
+        if (!data.isMember("properties"))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'properties' attribute"));
+
+        m_numMolecules = data["num_molecules"].asUInt();
+        const Json::Value &properties = data["properties"];
+        if (properties.size() != 3 + impl::property_filter_elements().size())
+          throw std::runtime_error(make_string("JSON header for file ", filename, " contains an invalid 'properties' attribute"));
+        m_thresholds.clear();
+        for (Json::ArrayIndex i = 0; i < properties.size(); ++i) {
+          if (properties[i]["name"].asString() != propertyName(i) || properties[i]["thresholds"].asUInt() < 1)
+            throw std::runtime_error(make_string("JSON header for file ", filename, " contains an invalid 'properties' attribute"));
+          m_thresholds.push_back(properties[i]["thresholds"].asUInt());
+        }
+
+        initBitmaps();
+        if (!m_bitmaps.empty() && !file.read(&m_bitmaps[0], m_bitmaps.size() * sizeof(Word)))
+          throw std::runtime_error(make_string("Property filter file \"", filename, "\" is truncated"));
+        computeCounts();
+      }
+
+      /**
+       * Get the screen operands for a query. Bitmaps that do not remove
+       * any molecules are skipped.
+       *
+       * @param query The query molecule.
+       */
+      template<typename QueryType>
+      std::vector<ScreenOperand> operands(QueryType &query) const
+      {
+        std::vector<unsigned int> values = property_filter_values(query);
+        std::vector<ScreenOperand> result;
+        for (unsigned int i = 0; i < numProperties(); ++i) {
+          if (!values[i])
+            continue;
+          unsigned int threshold = std::min(values[i], m_thresholds[i]);
+          if (count(i, threshold) < m_numMolecules)
+            result.push_back(ScreenOperand(bitmap(i, threshold), count(i, threshold)));
+        }
+        return result;
+      }
+
+    private:
+      unsigned int numWords() const
+      {
+        return bitvec_num_words_for_bits(m_numMolecules);
+      }
+
+      void initBitmaps()
+      {
+        m_offsets.clear();
+        unsigned int numBitmaps = 0;
+        for (std::size_t i = 0; i < m_thresholds.size(); ++i) {
+          m_offsets.push_back(numBitmaps);
+          numBitmaps += m_thresholds[i];
+        }
+        m_bitmaps.assign(static_cast<std::size_t>(numBitmaps) * numWords(), 0);
+      }
+
+      void computeCounts()
+      {
+        unsigned int numBitmaps = m_offsets.back() + m_thresholds.back();
+        m_counts.assign(numBitmaps, 0);
+        if (numWords())
+          for (unsigned int i = 0; i < numBitmaps; ++i)
+            m_counts[i] = bitvec_count(&m_bitmaps[static_cast<std::size_t>(i) * numWords()], numWords());
+      }
+
+      std::vector<Word> m_bitmaps; //!< The bitmaps for all properties and thresholds
+      std::vector<unsigned int> m_thresholds; //!< The number of thresholds for each property
+      std::vector<unsigned int> m_offsets; //!< The index of the first bitmap for each property
+      std::vector<unsigned int> m_counts; //!< The number of set bits in each bitmap
+      unsigned int m_numMolecules;
+  };
+
+}
+
+#endif
@@ -0,0 +1,505 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_ROARING_H
+#define HELIUM_ROARING_H
+
+#include <Helium/bitvec.h>
+#include <Helium/contract.h>
+
+#include <vector>
+#include <algorithm>
+
+namespace Helium {
+
+  /**
+   * @file roaring.h
+   * @brief Compressed bitmaps using Roaring-style containers.
+   */
+
+  /**
+   * @brief Compressed bitmap using Roaring-style containers.
+   *
+   * The bit indices are split in a 16-bit key (the high bits) and a 16-bit
+   * value (the low bits). The bits for each key are stored in a container,
+   * containers with no set bits are not stored. Sparse containers (i.e. up
+   * to ArrayMaxSize set bits) store the sorted values, dense containers
+   * store a 65536-bit bitmap. Intersections work directly on the containers
+   * so the cost for sparse bitmaps is proportional to the number of set bits
+   * instead of the number of bits in the bitmap.
+   *
+   * These bitmaps are used to store the columns of compressed column-major
+   * fingerprint files (see InMemoryCompressedColumnMajorFingerprintStorage).
+   */
+  class RoaringBitmap
+  {
+    public:
+      enum
+      {
+        /**
+         * The number of bits in a container.
+         */
+        ContainerBits = 65536,
+        /**
+         * The number of words in a bitmap container.
+         */
+        ContainerWords = ContainerBits / (8 * sizeof(Word)),
+        /**
+         * The maximum number of values in an array container. Above this,
+         * the bitmap is smaller than the array.
+         */
+        ArrayMaxSize = 4096
+      };
+
+      /**
+       * @brief A container for the bits with the same key.
+       */
+      struct Container
+      {
+        Container(uint16_t key_ = 0) : key(key_), cardinality(0)
+        {
+        }
+
+        /**
+         * Check if this is a bitmap container.
+         */
+        bool isBitmap() const
+        {
+          return !bitmap.empty();
+        }
+
+        /**
+         * Check if a value is in the container.
+         */
+        bool contains(uint16_t value) const
+        {
+          if (isBitmap())
+            return bitvec_get(value, &bitmap[0]);
+          return std::binary_search(array.begin(), array.end(), value);
+        }
+
+        /**
+         * Convert between array and bitmap representation depending on the
+         * cardinality.
+         */
+        void optimize()
+        {
+          if (isBitmap() && cardinality <= ArrayMaxSize) {
+            array.clear();
+            array.reserve(cardinality);
+            for (unsigned int i = 0; i < ContainerWords; ++i)
+              for (Word word = bitmap[i]; word; word &= word - 1)
+                array.push_back(i * BitsPerWord + __builtin_ctzll(word));
+            std::vector<Word>().swap(bitmap);
+          } else if (!isBitmap() && cardinality > ArrayMaxSize) {
+            bitmap.assign(ContainerWords, 0);
+            for (std::size_t i = 0; i < array.size(); ++i)
+              bitvec_set(array[i], &bitmap[0]);
+            std::vector<uint16_t>().swap(array);
+          }
+        }
+
+        void swap(Container &other)
+        {
+          std::swap(key, other.key);
+          std::swap(cardinality, other.cardinality);
+          array.swap(other.array);
+          bitmap.swap(other.bitmap);
+        }
+
+        uint16_t key; //!< The high 16 bits of the bit indices
+        unsigned int cardinality; //!< The number of set bits
+        std::vector<uint16_t> array; //!< Sorted values (array containers)
+        std::vector<Word> bitmap; //!< ContainerWords words (bitmap containers)
+      };
+
+      /**
+       * Constructor for an empty bitmap.
+       */
+      RoaringBitmap()
+      {
+      }
+
+      /**
+       * Constructor.
+       *
+       * @param bitvec The uncompressed bitmap.
+       * @param numBits The number of bits in @p bitvec.
+       */
+      RoaringBitmap(const Word *bitvec, unsigned int numBits)
+      {
+        for (unsigned int i = 0; i < numBits; i += ContainerBits)
+          append(i / ContainerBits, bitvec + i / BitsPerWord, std::min<unsigned int>(ContainerBits, numBits - i));
+      }
+
+      /**
+       * Append the bits for a key. The keys must be appended in increasing
+       * order, nothing is stored when no bits are set.
+       *
+       * @param key The key.
+       * @param words The uncompressed bits for the key.
+       * @param numBits The number of bits in @p words (at most ContainerBits),
+       *        the remaining bits in the last word are ignored.
+       */
+      void append(uint16_t key, const Word *words, unsigned int numBits)
+      {
+        PRE(numBits <= ContainerBits);
+        PRE(m_containers.empty() || m_containers.back().key < key);
+        unsigned int numWords = bitvec_num_words_for_bits(numBits);
+        if (!numWords)
+          return;
+        // mask the padding bits in the last word
+        Word last = words[numWords - 1];
+        if (numBits % BitsPerWord)
+          last &= (Word(1) << (numBits % BitsPerWord)) - 1;
+        unsigned int cardinality = bitvec_count(words, numWords - 1) + bitvec_count(last);
+        if (!cardinality)
+          return;
+
+        m_containers.push_back(Container(key));
+        Container &container = m_containers.back();
+        container.cardinality = cardinality;
+        if (cardinality > ArrayMaxSize) {
+          container.bitmap.assign(ContainerWords, 0);
+          std::copy(words, words + numWords - 1, container.bitmap.begin());
+          container.bitmap[numWords - 1] = last;
+        } else {
+          container.array.reserve(cardinality);
+          for (unsigned int i = 0; i < numWords; ++i)
+            for (Word word = i + 1 < numWords ? words[i] : last; word; word &= word - 1)
+              container.array.push_back(i * BitsPerWord + __builtin_ctzll(word));
+        }
+      }
+
+      /**
+       * Get the number of set bits.
+       */
+      unsigned int count() const
+      {
+        unsigned int result = 0;
+        for (std::size_t i = 0; i < m_containers.size(); ++i)
+          result += m_containers[i].cardinality;
+        return result;
+      }
+
+      /**
+       * Check if no bits are set.
+       */
+      bool empty() const
+      {
+        return m_containers.empty();
+      }
+
+      /**
+       * Check if a bit is set.
+       */
+      bool contains(unsigned int index) const
+      {
+        const Container *container = findContainer(index / ContainerBits);
+        return container && container->contains(index % ContainerBits);
+      }
+
+      /**
+       * Get the number of containers.
+       */
+      unsigned int numContainers() const
+      {
+        return m_containers.size();
+      }
+
+      /**
+       * Get a container, the containers are sorted by key.
+       */
+      const Container& container(unsigned int index) const
+      {
+        return m_containers[index];
+      }
+
+      /**
+       * Find the container for a key.
+       *
+       * @return Pointer to the container or 0 if no bits are set for the key.
+       */
+      const Container* findContainer(uint16_t key) const
+      {
+        std::vector<Container>::const_iterator container =
+          std::lower_bound(m_containers.begin(), m_containers.end(), Container(key), CompareKeys());
+        if (container == m_containers.end() || container->key != key)
+          return 0;
+        return &*container;
+      }
+
+      /**
+       * Convert to an uncompressed bitmap.
+       *
+       * @param bitvec The output bitmap, this must have room for
+       *        bitvec_num_words_for_bits(numBits) words.
+       * @param numBits The number of bits.
+       */
+      void toBitvec(Word *bitvec, unsigned int numBits) const;
+
+      /**
+       * Get the number of bytes used to store the set bits.
+       */
+      std::size_t sizeInBytes() const
+      {
+        std::size_t size = m_containers.size() * sizeof(Container);
+        for (std::size_t i = 0; i < m_containers.size(); ++i)
+          size += m_containers[i].isBitmap() ? ContainerWords * sizeof(Word) :
+            m_containers[i].array.size() * sizeof(uint16_t);
+        return size;
+      }
+
+      /**
+       * Compute the intersection of two bitmaps.
+       */
+      static RoaringBitmap intersect(const RoaringBitmap &bitmap1, const RoaringBitmap &bitmap2);
+
+      /**
+       * Write the bitmap to a binary file (e.g. BinaryOutputFile). The format
+       * is the number of containers (32-bit) followed by the key (16-bit),
+       * type (16-bit, 0 for arrays and 1 for bitmaps) and cardinality
+       * (32-bit) for each container followed by its values or bitmap.
+       */
+      template<typename OutputFileType>
+      bool write(OutputFileType &file) const
+      {
+        uint32_t numContainers = m_containers.size();
+        if (!file.write(&numContainers, sizeof(uint32_t)))
+          return false;
+        for (std::size_t i = 0; i < m_containers.size(); ++i) {
+          const Container &container = m_containers[i];
+          uint16_t type = container.isBitmap();
+          uint32_t cardinality = container.cardinality;
+          if (!file.write(&container.key, sizeof(uint16_t)) || !file.write(&type, sizeof(uint16_t)) ||
+              !file.write(&cardinality, sizeof(uint32_t)))
+            return false;
+          if (container.isBitmap()) {
+            if (!file.write(&container.bitmap[0], ContainerWords * sizeof(Word)))
+              return false;
+          } else if (!file.write(&container.array[0], container.array.size() * sizeof(uint16_t)))
+            return false;
+        }
+        return true;
+      }
+
+      /**
+       * Read a bitmap written using write() from a binary file (e.g.
+       * BinaryInputFile).
+       *
+       * @return False if the bitmap could not be read or is invalid.
+       */
+      template<typename InputFileType>
+      bool read(InputFileType &file)
+      {
+        m_containers.clear();
+        uint32_t numContainers;
+        if (!file.read(&numContainers, sizeof(uint32_t)) || numContainers > ContainerBits)
+          return false;
+        m_containers.resize(numContainers);
+        for (uint32_t i = 0; i < numContainers; ++i) {
+          Container &container = m_containers[i];
+          uint16_t type;
+          uint32_t cardinality;
+          if (!file.read(&container.key, sizeof(uint16_t)) || !file.read(&type, sizeof(uint16_t)) ||
+              !file.read(&cardinality, sizeof(uint32_t)))
+            return false;
+          if (!cardinality || cardinality > ContainerBits || (i && container.key <= m_containers[i - 1].key))
+            return false;
+          container.cardinality = cardinality;
+          if (type) {
+            container.bitmap.resize(ContainerWords);
+            if (!file.read(&container.bitmap[0], ContainerWords * sizeof(Word)) ||
+                bitvec_count(&container.bitmap[0], ContainerWords) != static_cast<int>(cardinality))
+              return false;
+          } else {
+            container.array.resize(cardinality);
+            if (!file.read(&container.array[0], cardinality * sizeof(uint16_t)))
+              return false;
+            for (uint32_t j = 1; j < cardinality; ++j)
+              if (container.array[j - 1] >= container.array[j])
+                return false;
+          }
+        }
+        return true;
+      }
+
+    private:
+      struct CompareKeys
+      {
+        bool operator()(const Container &container1, const Container &container2) const
+        {
+          return container1.key < container2.key;
+        }
+      };
+
+      std::vector<Container> m_containers; //!< The containers sorted by key
+  };
+
+  //@cond dev
+
+  namespace impl {
+
+    /**
+     * Intersect two sorted arrays of very different size. The large array is
+     * searched for each value in the small array, the search range starts
+     * at the previous position and grows exponentially.
+     */
+    inline void roaring_gallop_intersect(const std::vector<uint16_t> &small, const std::vector<uint16_t> &large,
+        std::vector<uint16_t> &result)
+    {
+      std::vector<uint16_t>::const_iterator pos = large.begin();
+      for (std::size_t i = 0; i < small.size() && pos != large.end(); ++i) {
+        // find a range that contains the value
+        std::size_t step = 1;
+        std::vector<uint16_t>::const_iterator end = pos;
+        while (static_cast<std::size_t>(large.end() - end) > step && *(end + step) < small[i]) {
+          end += step;
+          step *= 2;
+        }
+        end = static_cast<std::size_t>(large.end() - end) > step ? end + step + 1 : large.end();
+        pos = std::lower_bound(pos, end, small[i]);
+        if (pos != large.end() && *pos == small[i])
+          result.push_back(small[i]);
+      }
+    }
+
+    /**
+     * Intersect two containers with the same key.
+     *
+     * @param container1 The first container.
+     * @param container2 The second container.
+     * @param result The intersection (must be a different object).
+     */
+    inline void roaring_intersect(const RoaringBitmap::Container &container1,
+        const RoaringBitmap::Container &container2, RoaringBitmap::Container &result)
+    {
+      PRE(&result != &container1 && &result != &container2);
+      result.key = container1.key;
+      result.array.clear();
+
+      if (container1.isBitmap() && container2.isBitmap()) {
+        // word-wise AND, the result may be sparse enough for an array
+        result.bitmap.resize(RoaringBitmap::ContainerWords);
+        unsigned int cardinality = 0;
+        for (unsigned int i = 0; i < RoaringBitmap::ContainerWords; ++i)
+          cardinality += bitvec_count(result.bitmap[i] = container1.bitmap[i] & container2.bitmap[i]);
+        result.cardinality = cardinality;
+        result.optimize();
+        return;
+      }
+
+      result.bitmap.clear();
+      if (container1.isBitmap() || container2.isBitmap()) {
+        // probe the bitmap for each value in the array
+        const RoaringBitmap::Container &array = container1.isBitmap() ? container2 : container1;
+        const Word *bitmap = container1.isBitmap() ? &container1.bitmap[0] : &container2.bitmap[0];
+        for (std::size_t i = 0; i < array.array.size(); ++i)
+          if (bitvec_get(array.array[i], bitmap))
+            result.array.push_back(array.array[i]);
+      } else {
+        const std::vector<uint16_t> &array1 = container1.array;
+        const std::vector<uint16_t> &array2 = container2.array;
+        // galloping is faster when the sizes differ a lot
+        if (array1.size() * 32 < array2.size())
+          roaring_gallop_intersect(array1, array2, result.array);
+        else if (array2.size() * 32 < array1.size())
+          roaring_gallop_intersect(array2, array1, result.array);
+        else
+          std::set_intersection(array1.begin(), array1.end(), array2.begin(), array2.end(),
+              std::back_inserter(result.array));
+      }
+      result.cardinality = result.array.size();
+    }
+
+    /**
+     * Write the bits in a container to an uncompressed bitmap.
+     *
+     * @param container The container.
+     * @param words The output bitmap, the bits are OR-ed in.
+     * @param numWords The number of words in @p words (at most
+     *        RoaringBitmap::ContainerWords).
+     */
+    inline void roaring_container_to_bitvec(const RoaringBitmap::Container &container, Word *words,
+        unsigned int numWords)
+    {
+      if (container.isBitmap()) {
+        for (unsigned int i = 0; i < numWords; ++i)
+          words[i] |= container.bitmap[i];
+      } else {
+        for (std::size_t i = 0; i < container.array.size(); ++i)
+          if (container.array[i] / BitsPerWord < numWords)
+            bitvec_set(container.array[i], words);
+      }
+    }
+
+  }
+
+  //@endcond
+
+  inline void RoaringBitmap::toBitvec(Word *bitvec, unsigned int numBits) const
+  {
+    unsigned int numWords = bitvec_num_words_for_bits(numBits);
+    bitvec_zero(bitvec, numWords);
+    for (std::size_t i = 0; i < m_containers.size(); ++i) {
+      unsigned int offset = m_containers[i].key * ContainerWords;
+      if (offset < numWords)
+        impl::roaring_container_to_bitvec(m_containers[i], bitvec + offset,
+            std::min<unsigned int>(ContainerWords, numWords - offset));
+    }
+    // clear the padding bits in the last word
+    if (numBits % BitsPerWord)
+      bitvec[numWords - 1] &= (Word(1) << (numBits % BitsPerWord)) - 1;
+  }
+
+  inline RoaringBitmap RoaringBitmap::intersect(const RoaringBitmap &bitmap1, const RoaringBitmap &bitmap2)
+  {
+    RoaringBitmap result;
+    std::size_t i = 0, j = 0;
+    while (i < bitmap1.m_containers.size() && j < bitmap2.m_containers.size()) {
+      const Container &container1 = bitmap1.m_containers[i];
+      const Container &container2 = bitmap2.m_containers[j];
+      if (container1.key < container2.key) {
+        ++i;
+      } else if (container2.key < container1.key) {
+        ++j;
+      } else {
+        Container container;
+        impl::roaring_intersect(container1, container2, container);
+        if (container.cardinality) {
+          result.m_containers.push_back(Container());
+          result.m_containers.back().swap(container);
+        }
+        ++i;
+        ++j;
+      }
+    }
+    return result;
+  }
+
+}
+
+#endif
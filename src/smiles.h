@@ -38,18 +38,22 @@ namespace Helium {
     template<typename MoleculeType>
     struct SmileyCallback : public Smiley::CallbackBase
     {
-      SmileyCallback(MoleculeType &mol_) : mol(mol_)
+      SmileyCallback() : mol(0)
+      {
+      }
+
+      SmileyCallback(MoleculeType &mol_) : mol(&mol_)
       {
       }
 
       void clear()
       {
-        mol.clear();
+        mol->clear();
       }
 
       void addAtom(int element, bool aromatic, int isotope, int hCount, int charge, int atomClass)
       {
-        typename molecule_traits<MoleculeType>::atom_type atom = mol.addAtom();
+        typename molecule_traits<MoleculeType>::atom_type atom = mol->addAtom();
         atom.setElement(element);
         atom.setAromatic(aromatic);
         atom.setMass(isotope);
@@ -59,17 +63,127 @@ namespace Helium {
 
       void addBond(int source, int target, int order, bool isUp, bool isDown)
       {
-        typename molecule_traits<MoleculeType>::bond_type bond = mol.addBond(mol.atom(source), mol.atom(target));
+        typename molecule_traits<MoleculeType>::bond_type bond = mol->addBond(mol->atom(source), mol->atom(target));
         if (order == 5)
           bond.setAromatic(true);
         bond.setOrder(order);
       }
 
-      MoleculeType &mol;
+      MoleculeType *mol;
     };
 
   }
 
+  /**
+   * @brief An error found while parsing a SMILES string.
+   */
+  struct SmilesError
+  {
+    SmilesError() : syntaxError(false), pos(0), length(0)
+    {
+    }
+
+    std::string smiles; //!< The SMILES string
+    std::string what; //!< Description of the error
+    bool syntaxError; //!< True for syntax errors, false for semantics errors
+    std::size_t pos; //!< The position of the error in the SMILES
+    std::size_t length; //!< The length of the error in the SMILES
+  };
+
+  /**
+   * Print a SMILES error with the position of the error marked below the
+   * SMILES.
+   *
+   * @param os The output stream.
+   * @param error The error.
+   */
+  inline void print_smiles_error(std::ostream &os, const SmilesError &error)
+  {
+    os << (error.syntaxError ? "Syntax" : "Semantics") << "Error: " << error.what << "." << std::endl;
+    os << error.smiles << std::endl;
+    os << std::string(error.pos, ' ') << std::string(error.length, '^') << std::endl;
+  }
+
+  /**
+   * @class SmilesParser smiles.h <Helium/smiles.h>
+   * @brief Reusable SMILES parser.
+   *
+   * The parser state is kept between calls to parse() so parsing many
+   * SMILES (e.g. a whole .smi file) does not need to create a new parser
+   * for each molecule. Unlike parse_smiles(), errors are not printed but
+   * returned by error().
+   *
+   * Copying a SmilesParser creates a new parser. A single SmilesParser
+   * should not be used concurrently from multiple threads.
+   *
+   * @tparam MoleculeType The type of the molecule, this must be a model of the
+   *         EditableMolecule concept.
+   */
+  template<typename MoleculeType>
+  class SmilesParser
+  {
+    public:
+      /**
+       * Constructor.
+       */
+      SmilesParser() : m_parser(m_callback)
+      {
+      }
+
+      /**
+       * Copy constructor, only the last error is copied.
+       */
+      SmilesParser(const SmilesParser &other) : m_parser(m_callback), m_error(other.m_error)
+      {
+      }
+
+      /**
+       * Assignment operator, only the last error is copied.
+       */
+      SmilesParser& operator=(const SmilesParser &other)
+      {
+        m_error = other.m_error;
+        return *this;
+      }
+
+      /**
+       * Parse a SMILES string. The molecule is cleared first.
+       *
+       * @param smiles The SMILES string.
+       * @param mol The molecule.
+       *
+       * @return False if the SMILES is invalid (see error()).
+       */
+      bool parse(const std::string &smiles, MoleculeType &mol)
+      {
+        m_callback.mol = &mol;
+        try {
+          m_parser.parse(smiles);
+        } catch (Smiley::Exception &e) {
+          m_error.smiles = smiles;
+          m_error.what = e.what();
+          m_error.syntaxError = e.type() == Smiley::Exception::SyntaxError;
+          m_error.pos = e.pos();
+          m_error.length = e.length();
+          return false;
+        }
+        return true;
+      }
+
+      /**
+       * Get the error for the last invalid SMILES.
+       */
+      const SmilesError& error() const
+      {
+        return m_error;
+      }
+
+    private:
+      impl::SmileyCallback<MoleculeType> m_callback; //!< The callback (adds atoms & bonds to the molecule)
+      Smiley::Parser<impl::SmileyCallback<MoleculeType> > m_parser; //!< The parser
+      SmilesError m_error; //!< The last error
+  };
+
   /**
    * @brief Parse a SMILES string.
    *
@@ -82,25 +196,9 @@ namespace Helium {
   template<typename MoleculeType>
   void parse_smiles(const std::string &smiles, MoleculeType &mol)
   {
-    impl::SmileyCallback<MoleculeType> callback(mol);
-    Smiley::Parser<impl::SmileyCallback<MoleculeType> > parser(callback);
-
-    //parser.parse(smiles);
-    try {
-      parser.parse(smiles);
-    } catch (Smiley::Exception &e) {
-      if (e.type() == Smiley::Exception::SyntaxError)
-        std::cerr << "Syntax";
-      else
-        std::cerr << "Semantics";
-      std::cerr << "Error: " << e.what() << "." << std::endl;
-      std::cerr << smiles << std::endl;
-      for (std::size_t i = 0; i < e.pos(); ++i)
-        std::cerr << " ";
-      for (std::size_t i = 0; i < e.length(); ++i)
-        std::cerr << "^";
-      std::cerr << std::endl;
-    }
+    SmilesParser<MoleculeType> parser;
+    if (!parser.parse(smiles, mol))
+      print_smiles_error(std::cerr, parser.error());
   }
 
 }
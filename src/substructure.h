@@ -471,7 +471,8 @@ namespace Helium {
   std::pair<typename molecule_traits<SubstructureType>::incident_iter, typename molecule_traits<SubstructureType>::incident_iter>
   get_bonds(const SubstructureType &mol, typename molecule_traits<SubstructureType>::atom_type atom)
   {
-    molecule_traits<HeMol>::incident_iter begin, end;
+    typedef typename SubstructureType::molecule_type molecule_type;
+    typename molecule_traits<molecule_type>::incident_iter begin, end;
     TIE(begin, end) = get_bonds(mol.mol(), atom);
     typedef typename molecule_traits<SubstructureType>::incident_iter incident_iter;
     return std::make_pair(incident_iter(&mol, begin, end), incident_iter(&mol, end, end));
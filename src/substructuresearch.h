@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_SUBSTRUCTURESEARCH_H
+#define HELIUM_SUBSTRUCTURESEARCH_H
+
+#include <Helium/hemol.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/algorithms/isomorphism.h>
+#include <Helium/fingerprints/screen.h>
+#include <Helium/contract.h>
+#include <Helium/timeout.h>
+#include <Helium/util.h>
+
+#ifdef HAVE_CPP11
+#include <Helium/threadpool.h>
+#include <mutex>
+#endif
+
+#include <vector>
+#include <deque>
+
+namespace Helium {
+
+  /**
+   * @brief Verify the screened candidates of a substructure search with a time budget.
+   *
+   * The candidates are read from the molecule file and matched against the
+   * query using an IsomorphismMatcher. The molecule file must have the
+   * numMolecules() and read_molecule(index, mol) member functions (e.g.
+   * MoleculeFile or MemoryMappedMoleculeFile). The molecules are read into
+   * the molecule_file_traits<MoleculeFileType>::molecule_type (i.e. a
+   * MoleculeView on the mapped records for a MemoryMappedMoleculeFile).
+   *
+   * The verification stops once @p token expires, the result is partial if
+   * token.isCancelled() returns true afterwards. Each candidate also gets
+   * its own budget of @p candidateTimeout milliseconds so a single
+   * pathological molecule can not stall the search. Candidates for which
+   * this budget expired are neither hits nor rejected and are added to
+   * @p timedOut instead.
+   *
+   * @param moleculeFile The molecule file.
+   * @param query The query.
+   * @param candidates The candidate bitmap (see substructure_screen()).
+   * @param token The cancellation token for the whole verification.
+   * @param candidateTimeout The time budget per candidate in milliseconds,
+   *        0 for no limit.
+   * @param timedOut Output parameter for the sorted indices of the
+   *        molecules that timed out.
+   *
+   * @return The sorted indices of the molecules that contain the query.
+   */
+  template<template<typename, typename> class AtomMatcher, template<typename, typename> class BondMatcher,
+           typename MoleculeFileType, typename QueryType>
+  std::vector<unsigned int> substructure_verify(MoleculeFileType &moleculeFile, QueryType &query, const Word *candidates,
+      const CancellationToken &token, unsigned int candidateTimeout, std::vector<unsigned int> &timedOut)
+  {
+    TIMER("substructure_verify():");
+    std::vector<unsigned int> indices = screen_candidates(candidates, moleculeFile.numMolecules());
+
+    typedef typename molecule_file_traits<MoleculeFileType>::molecule_type MoleculeType;
+    IsomorphismQuery<QueryType> compiled(query);
+    IsomorphismMatcher<AtomMatcher, BondMatcher, MoleculeType, QueryType> matcher(compiled);
+
+    MoleculeType mol;
+    std::vector<unsigned int> hits;
+    for (std::size_t i = 0; i < indices.size(); ++i) {
+      if (token.expired())
+        break;
+      moleculeFile.read_molecule(indices[i], mol);
+      CancellationToken candidateToken(candidateTimeout, &token);
+      matcher.setCancellationToken(&candidateToken);
+      bool found = matcher.match(mol);
+      if (matcher.cancelled()) {
+        if (token.isCancelled())
+          break;
+        timedOut.push_back(indices[i]);
+      } else if (found)
+        hits.push_back(indices[i]);
+    }
+
+    return hits;
+  }
+
+  /**
+   * @brief Verify the screened candidates of a substructure search.
+   *
+   * This is the same as the function above without a time budget.
+   *
+   * @param moleculeFile The molecule file.
+   * @param query The query.
+   * @param candidates The candidate bitmap (see substructure_screen()).
+   *
+   * @return The sorted indices of the molecules that contain the query.
+   */
+  template<template<typename, typename> class AtomMatcher, template<typename, typename> class BondMatcher,
+           typename MoleculeFileType, typename QueryType>
+  std::vector<unsigned int> substructure_verify(MoleculeFileType &moleculeFile, QueryType &query, const Word *candidates)
+  {
+    CancellationToken token;
+    std::vector<unsigned int> timedOut;
+    return substructure_verify<AtomMatcher, BondMatcher>(moleculeFile, query, candidates, token, 0, timedOut);
+  }
+
+  /**
+   * @overload
+   *
+   * The DefaultAtomMatcher and DefaultBondMatcher are used.
+   */
+  template<typename MoleculeFileType, typename QueryType>
+  std::vector<unsigned int> substructure_verify(MoleculeFileType &moleculeFile, QueryType &query, const Word *candidates,
+      const CancellationToken &token, unsigned int candidateTimeout, std::vector<unsigned int> &timedOut)
+  {
+    return substructure_verify<DefaultAtomMatcher, DefaultBondMatcher>(moleculeFile, query, candidates,
+        token, candidateTimeout, timedOut);
+  }
+
+  /**
+   * @overload
+   *
+   * The DefaultAtomMatcher and DefaultBondMatcher are used.
+   */
+  template<typename MoleculeFileType, typename QueryType>
+  std::vector<unsigned int> substructure_verify(MoleculeFileType &moleculeFile, QueryType &query, const Word *candidates)
+  {
+    return substructure_verify<DefaultAtomMatcher, DefaultBondMatcher>(moleculeFile, query, candidates);
+  }
+
+#ifdef HAVE_CPP11
+  /**
+   * @brief Threaded verification of the screened candidates of a substructure search.
+   *
+   * The set bits of the candidate bitmap are divided in chunks that are
+   * handed out dynamically to the threads since the cost of an isomorphism
+   * search varies a lot between molecules. Each task reuses a single
+   * molecule (see molecule_file_traits) for reading the molecules and its
+   * own IsomorphismMatcher for the query that is compiled once. The hits
+   * are merged in index order. The result is the same as for
+   * substructure_verify().
+   *
+   * The molecule file's read_molecule() must be safe to call concurrently
+   * (e.g. MemoryMappedMoleculeFile, but not MoleculeFile).
+   *
+   * @note This function is only available when C++11 support is enabled.
+   *
+   * @param moleculeFile The molecule file.
+   * @param query The query.
+   * @param candidates The candidate bitmap (see substructure_screen()).
+   * @param token The cancellation token for the whole verification.
+   * @param candidateTimeout The time budget per candidate in milliseconds,
+   *        0 for no limit.
+   * @param timedOut Output parameter for the sorted indices of the
+   *        molecules that timed out.
+   * @param pool The thread pool to use.
+   * @param chunkSize The number of candidates in a chunk.
+   *
+   * @return The sorted indices of the molecules that contain the query.
+   */
+  template<template<typename, typename> class AtomMatcher, template<typename, typename> class BondMatcher,
+           typename MoleculeFileType, typename QueryType>
+  std::vector<unsigned int> substructure_verify_threaded(MoleculeFileType &moleculeFile, QueryType &query,
+      const Word *candidates, const CancellationToken &token, unsigned int candidateTimeout,
+      std::vector<unsigned int> &timedOut, ThreadPool &pool = ThreadPool::global(), std::size_t chunkSize = 64)
+  {
+    TIMER("substructure_verify_threaded():");
+    PRE(chunkSize > 0);
+    std::vector<unsigned int> indices = screen_candidates(candidates, moleculeFile.numMolecules());
+
+    // the hits for each chunk, concatenating these keeps the index order
+    std::size_t numChunks = (indices.size() + chunkSize - 1) / chunkSize;
+    std::vector<std::vector<unsigned int> > chunkHits(numChunks);
+    std::vector<std::vector<unsigned int> > chunkTimedOut(numChunks);
+
+    // the query is compiled once, each task has its own matcher
+    typedef typename molecule_file_traits<MoleculeFileType>::molecule_type MoleculeType;
+    IsomorphismQuery<QueryType> compiled(query);
+
+    std::atomic<std::size_t> next(0);
+    std::size_t numTasks = std::min<std::size_t>(pool.numThreads(), numChunks);
+    ThreadPool::TaskGroup group;
+    for (std::size_t t = 0; t < numTasks; ++t)
+      pool.submit(group, [&] {
+        IsomorphismMatcher<AtomMatcher, BondMatcher, MoleculeType, QueryType> matcher(compiled);
+        MoleculeType mol;
+        while (!token.expired()) {
+          std::size_t chunk = next++;
+          if (chunk >= numChunks)
+            break;
+          std::size_t end = std::min(indices.size(), (chunk + 1) * chunkSize);
+          for (std::size_t i = chunk * chunkSize; i < end; ++i) {
+            moleculeFile.read_molecule(indices[i], mol);
+            CancellationToken candidateToken(candidateTimeout, &token);
+            matcher.setCancellationToken(&candidateToken);
+            bool found = matcher.match(mol);
+            if (matcher.cancelled()) {
+              if (token.isCancelled())
+                return;
+              chunkTimedOut[chunk].push_back(indices[i]);
+            } else if (found)
+              chunkHits[chunk].push_back(indices[i]);
+          }
+        }
+      });
+    pool.wait(group);
+
+    std::vector<unsigned int> hits;
+    for (std::size_t i = 0; i < numChunks; ++i) {
+      hits.insert(hits.end(), chunkHits[i].begin(), chunkHits[i].end());
+      timedOut.insert(timedOut.end(), chunkTimedOut[i].begin(), chunkTimedOut[i].end());
+    }
+
+    return hits;
+  }
+
+  /**
+   * @brief Threaded verification of the screened candidates of a substructure search.
+   *
+   * This is the same as the function above without a time budget.
+   *
+   * @note This function is only available when C++11 support is enabled.
+   *
+   * @param moleculeFile The molecule file.
+   * @param query The query.
+   * @param candidates The candidate bitmap (see substructure_screen()).
+   * @param pool The thread pool to use.
+   * @param chunkSize The number of candidates in a chunk.
+   *
+   * @return The sorted indices of the molecules that contain the query.
+   */
+  template<template<typename, typename> class AtomMatcher, template<typename, typename> class BondMatcher,
+           typename MoleculeFileType, typename QueryType>
+  std::vector<unsigned int> substructure_verify_threaded(MoleculeFileType &moleculeFile, QueryType &query,
+      const Word *candidates, ThreadPool &pool = ThreadPool::global(), std::size_t chunkSize = 64)
+  {
+    CancellationToken token;
+    std::vector<unsigned int> timedOut;
+    return substructure_verify_threaded<AtomMatcher, BondMatcher>(moleculeFile, query, candidates,
+        token, 0, timedOut, pool, chunkSize);
+  }
+
+  /**
+   * @overload
+   *
+   * The DefaultAtomMatcher and DefaultBondMatcher are used.
+   */
+  template<typename MoleculeFileType, typename QueryType>
+  std::vector<unsigned int> substructure_verify_threaded(MoleculeFileType &moleculeFile, QueryType &query,
+      const Word *candidates, const CancellationToken &token, unsigned int candidateTimeout,
+      std::vector<unsigned int> &timedOut, ThreadPool &pool = ThreadPool::global(), std::size_t chunkSize = 64)
+  {
+    return substructure_verify_threaded<DefaultAtomMatcher, DefaultBondMatcher>(moleculeFile, query,
+        candidates, token, candidateTimeout, timedOut, pool, chunkSize);
+  }
+
+  /**
+   * @overload
+   *
+   * The DefaultAtomMatcher and DefaultBondMatcher are used.
+   */
+  template<typename MoleculeFileType, typename QueryType>
+  std::vector<unsigned int> substructure_verify_threaded(MoleculeFileType &moleculeFile, QueryType &query,
+      const Word *candidates, ThreadPool &pool = ThreadPool::global(), std::size_t chunkSize = 64)
+  {
+    return substructure_verify_threaded<DefaultAtomMatcher, DefaultBondMatcher>(moleculeFile, query,
+        candidates, pool, chunkSize);
+  }
+
+  /**
+   * @brief Pipelined substructure search.
+   *
+   * Screening, reading the molecule records and verification are
+   * overlapped instead of done one after the other. The threads screen the
+   * candidate bitmap one block at a time (see SubstructureScreen). The
+   * candidates of a screened block are passed to prefetch_molecules() (i.e.
+   * madvise(MADV_WILLNEED) for a MemoryMappedMoleculeFile) and queued in
+   * chunks. A thread verifies the oldest queued chunk when there are enough
+   * queued chunks for all threads or when all blocks are screened, otherwise
+   * it screens the next block. The records for the verified chunks have
+   * been requested a while before so the page faults on a cold page cache
+   * no longer stall the verification. The hits and candidates are the same
+   * as for substructure_screen() followed by substructure_verify().
+   *
+   * The molecule file's read_molecule() must be safe to call concurrently
+   * (e.g. MemoryMappedMoleculeFile, but not MoleculeFile).
+   *
+   * @note This function is only available when C++11 support is enabled.
+   *
+   * @param screen The substructure screen for the query.
+   * @param moleculeFile The molecule file.
+   * @param query The query.
+   * @param candidates Output parameter for the candidate bitmap, this must
+   *        have room for bitvec_num_words_for_bits(screen.numFingerprints())
+   *        words. The bitmap is always complete: blocks that were not
+   *        screened before @p token expired are screened (but not
+   *        verified) before returning, as for substructure_screen().
+   * @param token The cancellation token for the whole search.
+   * @param candidateTimeout The time budget per candidate in milliseconds,
+   *        0 for no limit.
+   * @param timedOut Output parameter for the sorted indices of the
+   *        molecules that timed out.
+   * @param pool The thread pool to use.
+   * @param chunkSize The number of candidates in a chunk.
+   *
+   * @return The sorted indices of the molecules that contain the query.
+   */
+  template<template<typename, typename> class AtomMatcher, template<typename, typename> class BondMatcher,
+           typename ScreenType, typename MoleculeFileType, typename QueryType>
+  std::vector<unsigned int> substructure_search_pipelined(const ScreenType &screen, MoleculeFileType &moleculeFile,
+      QueryType &query, Word *candidates, const CancellationToken &token, unsigned int candidateTimeout,
+      std::vector<unsigned int> &timedOut, ThreadPool &pool = ThreadPool::global(), std::size_t chunkSize = 64)
+  {
+    TIMER("substructure_search_pipelined():");
+    PRE(chunkSize > 0);
+    unsigned int numWords = bitvec_num_words_for_bits(screen.numFingerprints());
+    bitvec_zero(candidates, numWords);
+    std::vector<unsigned int> hits;
+    if (screen.empty())
+      return hits;
+
+    unsigned int blockWords = screen.blockWords();
+    unsigned int numBlocks = (numWords + blockWords - 1) / blockWords;
+    // verify when there is at least one queued chunk for each thread
+    std::size_t lookahead = pool.numThreads();
+
+    typedef typename molecule_file_traits<MoleculeFileType>::molecule_type MoleculeType;
+    IsomorphismQuery<QueryType> compiled(query);
+
+    std::mutex mutex;
+    unsigned int nextBlock = 0;
+    std::deque<std::vector<unsigned int> > ready;
+
+    std::size_t numTasks = std::min<std::size_t>(pool.numThreads(), numBlocks);
+    ThreadPool::TaskGroup group;
+    for (std::size_t t = 0; t < numTasks; ++t)
+      pool.submit(group, [&] {
+        IsomorphismMatcher<AtomMatcher, BondMatcher, MoleculeType, QueryType> matcher(compiled);
+        MoleculeType mol;
+        std::vector<unsigned int> chunk, taskHits, taskTimedOut;
+        while (!token.expired()) {
+          unsigned int block = numBlocks;
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!ready.empty() && (ready.size() >= lookahead || nextBlock == numBlocks)) {
+              chunk.swap(ready.front());
+              ready.pop_front();
+            } else if (nextBlock < numBlocks)
+              block = nextBlock++;
+            else
+              break; // the other threads verify the chunks they are still screening
+          }
+
+          if (block < numBlocks) {
+            // screen the block and queue its candidates
+            unsigned int begin = block * blockWords;
+            unsigned int end = std::min(numWords, begin + blockWords);
+            screen.screen(candidates, begin, end);
+            std::vector<unsigned int> indices = screen_candidates(candidates, begin, end);
+            prefetch_molecules(moleculeFile, indices);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (std::size_t i = 0; i < indices.size(); i += chunkSize)
+              ready.push_back(std::vector<unsigned int>(indices.begin() + i,
+                    indices.begin() + std::min(indices.size(), i + chunkSize)));
+            continue;
+          }
+
+          // verify the chunk
+          for (std::size_t i = 0; i < chunk.size(); ++i) {
+            moleculeFile.read_molecule(chunk[i], mol);
+            CancellationToken candidateToken(candidateTimeout, &token);
+            matcher.setCancellationToken(&candidateToken);
+            bool found = matcher.match(mol);
+            if (matcher.cancelled()) {
+              if (token.isCancelled())
+                break;
+              taskTimedOut.push_back(chunk[i]);
+            } else if (found)
+              taskHits.push_back(chunk[i]);
+          }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        hits.insert(hits.end(), taskHits.begin(), taskHits.end());
+        timedOut.insert(timedOut.end(), taskTimedOut.begin(), taskTimedOut.end());
+      });
+    pool.wait(group);
+
+    // finish the screen when cancelled, the candidates are the same as for
+    // substructure_screen() followed by a cancelled substructure_verify()
+    if (nextBlock < numBlocks) {
+      unsigned int first = nextBlock;
+      pool.parallelFor(numBlocks - first, 1, [&] (std::size_t begin, std::size_t end) {
+        for (unsigned int block = first + begin; block < first + end; ++block)
+          screen.screen(candidates, block * blockWords, std::min(numWords, (block + 1) * blockWords));
+      });
+    }
+
+    // the chunks are verified in any order
+    std::sort(hits.begin(), hits.end());
+    std::sort(timedOut.begin(), timedOut.end());
+    return hits;
+  }
+
+  /**
+   * @overload
+   *
+   * The DefaultAtomMatcher and DefaultBondMatcher are used.
+   */
+  template<typename ScreenType, typename MoleculeFileType, typename QueryType>
+  std::vector<unsigned int> substructure_search_pipelined(const ScreenType &screen, MoleculeFileType &moleculeFile,
+      QueryType &query, Word *candidates, const CancellationToken &token, unsigned int candidateTimeout,
+      std::vector<unsigned int> &timedOut, ThreadPool &pool = ThreadPool::global(), std::size_t chunkSize = 64)
+  {
+    return substructure_search_pipelined<DefaultAtomMatcher, DefaultBondMatcher>(screen, moleculeFile, query,
+        candidates, token, candidateTimeout, timedOut, pool, chunkSize);
+  }
+#endif
+
+}
+
+#endif
@@ -2719,6 +2719,8 @@ namespace Smiley {
         m_ringBonds.clear();
         m_chiralInfo.clear();
         m_chiralInfo.push_back(ChiralInfo());
+        m_aromaticAtoms.clear();
+        resetBondInfo();
 
         parseChain();
 
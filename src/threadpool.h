@@ -0,0 +1,560 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_THREADPOOL_H
+#define HELIUM_THREADPOOL_H
+
+#include <Helium/contract.h>
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Helium {
+
+  /**
+   * @brief Work-stealing thread pool.
+   *
+   * Each worker thread has its own task queue. Tasks submitted by a worker
+   * thread are added to the back of its own queue and the worker takes tasks
+   * from the back of its queue (i.e. depth-first). Idle workers steal tasks
+   * from the front of the other queues. Tasks submitted by other threads are
+   * distributed over the queues in a round-robin fashion.
+   *
+   * Tasks are added to a TaskGroup which can be used to wait for the
+   * completion of all tasks in the group. While waiting, the waiting thread
+   * also executes queued tasks. For data parallel loops, parallelFor()
+   * distributes chunks of a range over the worker threads.
+   *
+   * The worker threads are created once and are reused for all tasks. The
+   * global() pool can be shared by all code in a process.
+   *
+   * On multi-socket hosts, the worker threads can be pinned to the CPUs of
+   * the NUMA nodes (see numaNodes()). The workers are divided over the nodes
+   * in contiguous blocks (i.e. workers [0,n/2) on node 0 and [n/2,n) on
+   * node 1 for two nodes). Combined with parallelForPartitioned(), which
+   * gives each worker the same part of a range every time, data that is
+   * first touched by a worker stays on the node where it is processed.
+   *
+   * @code
+   * ThreadPool &pool = ThreadPool::global();
+   * ThreadPool::TaskGroup group;
+   * for (int i = 0; i < 10; ++i)
+   *   pool.submit(group, std::bind(work, i));
+   * pool.wait(group);
+   * @endcode
+   *
+   * @note This class is only available when C++11 support is enabled.
+   */
+  class ThreadPool
+  {
+    public:
+      /**
+       * @brief A group of tasks to wait for.
+       */
+      class TaskGroup
+      {
+        public:
+          TaskGroup() : m_pending(0)
+          {
+          }
+
+          /**
+           * Get the number of tasks that are queued or running.
+           */
+          std::size_t pending() const
+          {
+            return m_pending;
+          }
+
+        private:
+          friend class ThreadPool;
+
+          TaskGroup(const TaskGroup&) = delete;
+          TaskGroup& operator=(const TaskGroup&) = delete;
+
+          std::atomic<std::size_t> m_pending; //!< Number of queued or running tasks
+          std::mutex m_mutex;
+          std::condition_variable m_done; //!< Notified when m_pending becomes 0
+      };
+
+      /**
+       * @brief Constructor.
+       *
+       * @param numThreads The number of worker threads, 0 to use
+       *        std::thread::hardware_concurrency() threads.
+       * @param pinThreads If true, the worker threads are pinned to the CPUs
+       *        of the NUMA nodes (only supported on Linux, ignored elsewhere).
+       */
+      explicit ThreadPool(unsigned int numThreads = 0, bool pinThreads = false) : m_stop(false), m_queued(0), m_next(0)
+      {
+        if (!numThreads)
+          numThreads = std::thread::hardware_concurrency();
+        // c++ implementations may return 0
+        if (!numThreads)
+          numThreads = 2;
+
+        // assign the workers to the nodes in contiguous blocks
+        std::vector<std::vector<unsigned int> > nodes = numaNodes();
+        std::vector<unsigned int> cpus(numThreads);
+        for (unsigned int i = 0; i < numThreads; ++i) {
+          unsigned int node = static_cast<std::size_t>(i) * nodes.size() / numThreads;
+          unsigned int first = (static_cast<std::size_t>(node) * numThreads + nodes.size() - 1) / nodes.size();
+          m_nodes.push_back(node);
+          cpus[i] = nodes[node][(i - first) % nodes[node].size()];
+        }
+
+        for (unsigned int i = 0; i < numThreads; ++i)
+          m_queues.push_back(std::unique_ptr<Queue>(new Queue));
+        for (unsigned int i = 0; i < numThreads; ++i)
+          m_threads.push_back(std::thread(&ThreadPool::worker, this, i, pinThreads ? static_cast<int>(cpus[i]) : -1));
+      }
+
+      /**
+       * @brief Destructor.
+       *
+       * The queued tasks are discarded, the running tasks are completed.
+       */
+      ~ThreadPool()
+      {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_stop = true;
+        }
+        m_wakeup.notify_all();
+        for (std::size_t i = 0; i < m_threads.size(); ++i)
+          m_threads[i].join();
+      }
+
+      /**
+       * @brief Get the global thread pool.
+       *
+       * The global pool is created on first use and uses
+       * std::thread::hardware_concurrency() threads.
+       */
+      static ThreadPool& global()
+      {
+        static ThreadPool pool;
+        return pool;
+      }
+
+      /**
+       * @brief Get the number of worker threads.
+       */
+      unsigned int numThreads() const
+      {
+        return m_threads.size();
+      }
+
+      /**
+       * @brief Get a chunk size for dividing a range over the worker threads.
+       *
+       * The range is divided in about 8 chunks per worker thread to balance
+       * the load.
+       *
+       * @param n The number of elements in the range.
+       * @param minChunkSize The minimum chunk size.
+       */
+      std::size_t chunkSize(std::size_t n, std::size_t minChunkSize = 1) const
+      {
+        return std::max(minChunkSize, n / (8 * numThreads()) + 1);
+      }
+
+      /**
+       * @brief Get the NUMA node for a worker thread.
+       *
+       * This is the node the worker is pinned to when the pool was created
+       * with pinThreads set to true.
+       *
+       * @param worker The worker index in the range [0,numThreads()).
+       */
+      unsigned int workerNode(unsigned int worker) const
+      {
+        PRE(worker < m_nodes.size());
+        return m_nodes[worker];
+      }
+
+      /**
+       * @brief Get the CPUs of the NUMA nodes.
+       *
+       * On Linux, the nodes are read from /sys/devices/system/node. On other
+       * platforms or when this information is not available, there is a
+       * single node containing std::thread::hardware_concurrency() CPUs.
+       *
+       * @return The CPU numbers for each node, nodes without CPUs are
+       *         skipped.
+       */
+      static std::vector<std::vector<unsigned int> > numaNodes()
+      {
+        std::vector<std::vector<unsigned int> > nodes;
+#ifdef __linux__
+        // node numbers may have gaps (e.g. offline nodes)
+        for (int node = 0, missing = 0; missing < 64; ++node) {
+          std::ostringstream filename;
+          filename << "/sys/devices/system/node/node" << node << "/cpulist";
+          std::ifstream ifs(filename.str().c_str());
+          std::string list;
+          if (!(ifs >> list)) {
+            ++missing;
+            continue;
+          }
+          missing = 0;
+
+          // format: 0-3,8-11
+          std::vector<unsigned int> cpus;
+          std::istringstream ss(list);
+          std::string range;
+          while (std::getline(ss, range, ',')) {
+            unsigned int first = 0, last = 0;
+            char dash;
+            std::istringstream rs(range);
+            if (!(rs >> first))
+              continue;
+            if (!(rs >> dash >> last))
+              last = first;
+            for (unsigned int cpu = first; cpu <= last; ++cpu)
+              cpus.push_back(cpu);
+          }
+          if (cpus.size())
+            nodes.push_back(cpus);
+        }
+#endif
+        if (nodes.empty()) {
+          unsigned int numCpus = std::max(1u, std::thread::hardware_concurrency());
+          nodes.resize(1);
+          for (unsigned int cpu = 0; cpu < numCpus; ++cpu)
+            nodes[0].push_back(cpu);
+        }
+        return nodes;
+      }
+
+      /**
+       * @brief Submit a task.
+       *
+       * @param group The group to add the task to.
+       * @param task The task to run.
+       */
+      void submit(TaskGroup &group, std::function<void()> task)
+      {
+        // tasks submitted by a worker go to its own queue
+        submit(group, task, currentWorker().pool == this ? currentWorker().index : m_next++ % m_queues.size());
+      }
+
+      /**
+       * @brief Wait for all tasks in a group to complete.
+       *
+       * The calling thread executes queued tasks while waiting. Once there
+       * are no more queued tasks, the calling thread blocks until the
+       * remaining (running) tasks in the group are completed.
+       *
+       * @param group The group to wait for.
+       */
+      void wait(TaskGroup &group)
+      {
+        while (group.m_pending && runOne())
+          ;
+        // always lock, the last task may still be notifying the group
+        std::unique_lock<std::mutex> lock(group.m_mutex);
+        group.m_done.wait(lock, [&group] { return group.m_pending == 0; });
+      }
+
+      /**
+       * @brief Run a function for all chunks in the range [0,n).
+       *
+       * The range is divided in chunks of @p chunkSize elements. The chunks
+       * are distributed dynamically using an atomic counter: one task per
+       * worker thread is submitted and each task processes chunks until all
+       * chunks are taken. This function blocks until all chunks are
+       * processed.
+       *
+       * @code
+       * pool.parallelFor(v.size(), 1024, [&v] (std::size_t begin, std::size_t end) {
+       *   for (std::size_t i = begin; i < end; ++i)
+       *     v[i] *= 2;
+       * });
+       * @endcode
+       *
+       * @pre The @p chunkSize parameter must be greater than 0.
+       *
+       * @param n The number of elements.
+       * @param chunkSize The number of elements in a chunk.
+       * @param f The function, called as f(begin, end) for each chunk.
+       */
+      template<typename Function>
+      void parallelFor(std::size_t n, std::size_t chunkSize, Function f)
+      {
+        PRE(chunkSize > 0);
+        if (!n)
+          return;
+
+        std::atomic<std::size_t> next(0);
+        std::size_t numChunks = (n + chunkSize - 1) / chunkSize;
+        std::size_t numTasks = std::min<std::size_t>(numThreads(), numChunks);
+
+        TaskGroup group;
+        for (std::size_t i = 0; i < numTasks; ++i)
+          submit(group, [&next, &f, n, chunkSize] {
+            while (true) {
+              std::size_t begin = next.fetch_add(chunkSize);
+              if (begin >= n)
+                break;
+              f(begin, std::min(n, begin + chunkSize));
+            }
+          });
+        wait(group);
+      }
+
+      /**
+       * @brief Run a function for all chunks in the range [0,n) with a fixed
+       * assignment of the range to the worker threads.
+       *
+       * The chunks are divided in numThreads() contiguous partitions. Worker
+       * thread i processes the chunks in partition i first and only then
+       * takes the remaining chunks of other partitions. Calling this function
+       * again with the same @p n and @p chunkSize (or with chunks of a
+       * similar size) gives each worker the same part of the range. This is
+       * used for first-touch NUMA placement: memory initialized for a
+       * partition is later processed by the same (pinned) worker. The
+       * calling thread may also process chunks, it starts with partition 0.
+       *
+       * @pre The @p chunkSize parameter must be greater than 0.
+       *
+       * @param n The number of elements.
+       * @param chunkSize The number of elements in a chunk.
+       * @param f The function, called as f(begin, end) for each chunk.
+       */
+      template<typename Function>
+      void parallelForPartitioned(std::size_t n, std::size_t chunkSize, Function f)
+      {
+        PRE(chunkSize > 0);
+        if (!n)
+          return;
+
+        std::size_t numChunks = (n + chunkSize - 1) / chunkSize;
+        std::size_t numParts = numThreads();
+        // the next chunk for each partition
+        std::unique_ptr<std::atomic<std::size_t>[]> next(new std::atomic<std::size_t>[numParts]);
+        for (std::size_t p = 0; p < numParts; ++p)
+          next[p] = p * numChunks / numParts;
+
+        TaskGroup group;
+        for (std::size_t i = 0; i < numParts; ++i)
+          submit(group, [this, &next, &f, n, chunkSize, numChunks, numParts] {
+            std::size_t home = currentWorker().pool == this ? currentWorker().index : 0;
+            for (std::size_t j = 0; j < numParts; ++j) {
+              std::size_t p = (home + j) % numParts;
+              std::size_t end = (p + 1) * numChunks / numParts;
+              while (true) {
+                std::size_t chunk = next[p].fetch_add(1);
+                if (chunk >= end)
+                  break;
+                f(chunk * chunkSize, std::min(n, (chunk + 1) * chunkSize));
+              }
+            }
+          }, i);
+        wait(group);
+      }
+
+    private:
+      ThreadPool(const ThreadPool&) = delete;
+      ThreadPool& operator=(const ThreadPool&) = delete;
+
+      /**
+       * A queued task.
+       */
+      struct Item
+      {
+        Item() : group(0)
+        {
+        }
+
+        Item(TaskGroup *group_, const std::function<void()> &task_) : group(group_), task(task_)
+        {
+        }
+
+        TaskGroup *group;
+        std::function<void()> task;
+      };
+
+      /**
+       * A task queue for a worker thread.
+       */
+      struct Queue
+      {
+        std::mutex mutex;
+        std::deque<Item> tasks;
+      };
+
+      /**
+       * The pool and index of the current thread (if it is a worker thread).
+       */
+      struct WorkerInfo
+      {
+        ThreadPool *pool;
+        unsigned int index;
+      };
+
+      static WorkerInfo& currentWorker()
+      {
+        static thread_local WorkerInfo info = { 0, 0 };
+        return info;
+      }
+
+      /**
+       * Submit a task to queue @p queue.
+       */
+      void submit(TaskGroup &group, std::function<void()> task, std::size_t queue)
+      {
+        ++group.m_pending;
+        {
+          // m_queued is incremented first so it never underflows
+          std::lock_guard<std::mutex> lock(m_mutex);
+          ++m_queued;
+        }
+        {
+          std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+          m_queues[queue]->tasks.push_back(Item(&group, task));
+        }
+        m_wakeup.notify_one();
+      }
+
+      /**
+       * Take a task from the back of queue @p index.
+       */
+      bool pop(unsigned int index, Item &item)
+      {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        if (m_queues[index]->tasks.empty())
+          return false;
+        item = m_queues[index]->tasks.back();
+        m_queues[index]->tasks.pop_back();
+        return true;
+      }
+
+      /**
+       * Steal a task from the front of queue @p index.
+       */
+      bool steal(unsigned int index, Item &item)
+      {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        if (m_queues[index]->tasks.empty())
+          return false;
+        item = m_queues[index]->tasks.front();
+        m_queues[index]->tasks.pop_front();
+        return true;
+      }
+
+      /**
+       * Run a single queued task.
+       *
+       * @return True if a task was run.
+       */
+      bool runOne()
+      {
+        if (!m_queued)
+          return false;
+
+        bool isWorker = currentWorker().pool == this;
+        unsigned int self = isWorker ? currentWorker().index : 0;
+
+        Item item;
+        bool found = isWorker && pop(self, item);
+        for (std::size_t i = 0; !found && i < m_queues.size(); ++i)
+          found = steal((self + i) % m_queues.size(), item);
+        if (!found)
+          return false;
+
+        --m_queued;
+        item.task();
+
+        // the group may be destroyed as soon as a waiter sees m_pending == 0,
+        // decrement and notify while holding the mutex wait() acquires last
+        {
+          std::lock_guard<std::mutex> lock(item.group->m_mutex);
+          if (--item.group->m_pending == 0)
+            item.group->m_done.notify_all();
+        }
+
+        return true;
+      }
+
+      /**
+       * Worker thread main loop, the thread is pinned to @p cpu unless it is
+       * negative.
+       */
+      void worker(unsigned int index, int cpu)
+      {
+        currentWorker().pool = this;
+        currentWorker().index = index;
+
+#ifdef __linux__
+        // pinning is best effort, errors are ignored
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+          cpu_set_t set;
+          CPU_ZERO(&set);
+          CPU_SET(cpu, &set);
+          pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+        }
+#endif
+
+        while (true) {
+          if (runOne())
+            continue;
+
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_wakeup.wait(lock, [this] { return m_stop || m_queued > 0; });
+          if (m_stop)
+            return;
+        }
+      }
+
+      std::vector<std::unique_ptr<Queue> > m_queues; //!< One task queue per worker
+      std::vector<std::thread> m_threads; //!< The worker threads
+      std::mutex m_mutex; //!< Mutex for m_wakeup
+      std::condition_variable m_wakeup; //!< Notified when tasks are submitted or the pool is stopped
+      bool m_stop; //!< Set when the pool is destroyed
+      std::atomic<std::size_t> m_queued; //!< Number of queued tasks
+      std::atomic<unsigned int> m_next; //!< Next queue for tasks submitted by non-worker threads
+      std::vector<unsigned int> m_nodes; //!< The NUMA node for each worker
+  };
+
+}
+
+#endif
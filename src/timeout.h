@@ -29,6 +29,17 @@
 
 #include <boost/timer/timer.hpp>
 
+#include <ctime>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#define HELIUM_HAVE_RDTSC
+#endif
+
+#ifdef HAVE_CPP11
+#include <atomic>
+#endif
+
 namespace Helium {
 
   struct timeout_error : std::exception {};
@@ -60,6 +71,195 @@ namespace Helium {
       unsigned long m_ns;
   };
 
+  namespace impl {
+
+    /**
+     * Get the value of the monotonic clock in nanoseconds.
+     */
+    inline unsigned long long monotonic_nanoseconds()
+    {
+      timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    /**
+     * Read the cheapest available monotonic tick counter. This is the time
+     * stamp counter on x86 and the monotonic clock in nanoseconds elsewhere.
+     */
+    inline unsigned long long monotonic_ticks()
+    {
+#ifdef HELIUM_HAVE_RDTSC
+      return __rdtsc();
+#else
+      return monotonic_nanoseconds();
+#endif
+    }
+
+#ifdef HELIUM_HAVE_RDTSC
+    inline unsigned long long calibrate_ticks_per_millisecond()
+    {
+      unsigned long long ns0 = monotonic_nanoseconds();
+      unsigned long long t0 = __rdtsc();
+      unsigned long long ns1 = ns0;
+      while (ns1 - ns0 < 2000000ULL)
+        ns1 = monotonic_nanoseconds();
+      unsigned long long t1 = __rdtsc();
+      unsigned long long ticks = (t1 - t0) * 1000000ULL / (ns1 - ns0);
+      return ticks ? ticks : 1;
+    }
+#endif
+
+    /**
+     * Get the number of ticks per millisecond. The time stamp counter is
+     * calibrated once against the monotonic clock over a 2ms interval.
+     */
+    inline unsigned long long ticks_per_millisecond()
+    {
+#ifdef HELIUM_HAVE_RDTSC
+      static const unsigned long long ticks = calibrate_ticks_per_millisecond();
+      return ticks;
+#else
+      return 1000000ULL;
+#endif
+    }
+
+  }
+
+  /**
+   * @class CancellationToken timeout.h <Helium/timeout.h>
+   * @brief Cheap deadline and cancellation flag for long running searches.
+   *
+   * Unlike Timeout, checking a CancellationToken only reads the time stamp
+   * counter (or the monotonic clock as fallback) and never throws unless
+   * check() is used. A token can be cancelled explicitly from another thread
+   * and may have a parent token (e.g. a per candidate budget nested in a
+   * per query budget) in which case it expires together with its parent.
+   * Algorithms that accept a token stop early once it has expired and the
+   * results they produced are partial when isCancelled() returns true.
+   */
+  class CancellationToken
+  {
+    public:
+      /**
+       * Constructor.
+       *
+       * @param ms The number of milliseconds after which the token expires.
+       *        A value of 0 means there is no deadline.
+       * @param parent Optional parent token.
+       */
+      CancellationToken(unsigned int ms = 0, const CancellationToken *parent = 0)
+        : m_parent(parent), m_deadline(0), m_cancelled(false)
+      {
+        if (ms)
+          m_deadline = impl::monotonic_ticks() + ms * impl::ticks_per_millisecond();
+      }
+
+      /**
+       * Cancel the token. This function is thread safe when compiled with
+       * C++11 support.
+       */
+      void cancel()
+      {
+        m_cancelled = true;
+      }
+
+      /**
+       * Check if the token has been cancelled, the deadline has passed or
+       * the parent token has expired. Once expired, isCancelled() will
+       * return true.
+       */
+      bool expired() const
+      {
+        if (m_cancelled)
+          return true;
+        if ((m_parent && m_parent->expired()) ||
+            (m_deadline && impl::monotonic_ticks() > m_deadline))
+          m_cancelled = true;
+        return m_cancelled;
+      }
+
+      /**
+       * Check if the token was cancelled or found expired by a previous call
+       * to expired(). This does not read the clock.
+       */
+      bool isCancelled() const
+      {
+        return m_cancelled;
+      }
+
+      /**
+       * Throw a timeout_error if the token has expired.
+       */
+      void check() const
+      {
+        if (expired())
+          throw timeout_error();
+      }
+
+    private:
+      CancellationToken(const CancellationToken&);
+      CancellationToken& operator=(const CancellationToken&);
+
+      const CancellationToken *m_parent; //!< Optional parent token
+      unsigned long long m_deadline; //!< Deadline in ticks, 0 for none
+#ifdef HAVE_CPP11
+      mutable std::atomic<bool> m_cancelled; //!< Cancelled or expired
+#else
+      mutable volatile bool m_cancelled; //!< Cancelled or expired
+#endif
+  };
+
+  /**
+   * @class CancellationCheck timeout.h <Helium/timeout.h>
+   * @brief Amortized check of a CancellationToken inside hot loops.
+   *
+   * The clock is only read every @p interval calls, the other calls only
+   * increment a counter. A null token never expires.
+   */
+  class CancellationCheck
+  {
+    public:
+      /**
+       * Constructor.
+       *
+       * @param token The token to check, may be null.
+       * @param interval The number of calls between reading the clock.
+       */
+      CancellationCheck(const CancellationToken *token = 0, unsigned int interval = 256)
+        : m_token(token), m_interval(interval), m_count(0), m_expired(false)
+      {
+      }
+
+      /**
+       * Returns true when the token has expired.
+       */
+      bool operator()()
+      {
+        if (m_expired)
+          return true;
+        if (!m_token || ++m_count < m_interval)
+          return false;
+        m_count = 0;
+        m_expired = m_token->expired();
+        return m_expired;
+      }
+
+      /**
+       * Returns true if a previous call found the token expired.
+       */
+      bool expired() const
+      {
+        return m_expired;
+      }
+
+    private:
+      const CancellationToken *m_token;
+      unsigned int m_interval;
+      unsigned int m_count;
+      bool m_expired;
+  };
+
 }
 
 #endif
@@ -42,17 +42,22 @@
 #include <Helium/util/string.h>
 #include <Helium/util/vector.h>
 #include <Helium/util/functor.h>
+#include <Helium/instrumentation.h>
 
 #define UNREACHABLE_RETURN_REF(type) \
   assert(0); \
   return *(new type);
 
+// ENABLE_TIMERS prints the time for each TIMER() scope, with instrumentation
+// the time is added to the phases of the calling thread (see instrumentation.h)
 //#define ENABLE_TIMERS
 #ifdef ENABLE_TIMERS
   #include <boost/timer/timer.hpp>
   #define TIMER(message) \
     std::cout << message; \
     boost::timer::auto_cpu_timer t;
+#elif defined(HAVE_INSTRUMENTATION)
+  #define TIMER(message) HELIUM_PHASE(message)
 #else
   #define TIMER(message)
 #endif
@@ -0,0 +1,303 @@
+#ifndef HELIUM_UTIL_ARENA_H
+#define HELIUM_UTIL_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <ostream>
+#include <vector>
+
+namespace Helium {
+
+  /**
+   * @brief Bump allocator for the temporary buffers of the algorithms.
+   *
+   * Memory is taken from large blocks by incrementing an offset, releasing
+   * memory only moves the offset back (see Arena::Scope and reset()). An
+   * arena is meant to be reused: once the blocks are large enough for the
+   * biggest molecule, allocating from the arena never calls malloc. This
+   * makes it suitable for the inner loops of fingerprinting and matching
+   * where the same algorithms run many times per molecule. An arena should
+   * only be used by a single thread (e.g. one arena per thread or task).
+   *
+   * @code
+   * Arena arena;
+   * for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+   *   file.read_molecule(i, mol);
+   *   arena.reset();
+   *   tree_fingerprint(mol, fingerprint, 7, 16, 1021, 0, &arena);
+   * }
+   * @endcode
+   */
+  class Arena
+  {
+    public:
+      /**
+       * The alignment of all allocations.
+       */
+      static const std::size_t Alignment = 16;
+
+      /**
+       * @brief Releases the memory allocated during its lifetime.
+       *
+       * All memory allocated from the arena after the scope is created is
+       * released when it is destroyed. Scopes can be nested like the stack
+       * frames of a recursive algorithm. Containers created before a scope
+       * must not grow inside it since the grown buffer would be released
+       * when the scope ends.
+       */
+      class Scope
+      {
+        public:
+          Scope(Arena &arena) : m_arena(arena), m_block(arena.m_block), m_offset(arena.m_offset)
+          {
+          }
+
+          ~Scope()
+          {
+            m_arena.m_block = m_block;
+            m_arena.m_offset = m_offset;
+          }
+
+        private:
+          Scope(const Scope&);
+          Scope& operator=(const Scope&);
+
+          Arena &m_arena;
+          std::size_t m_block;
+          std::size_t m_offset;
+      };
+
+      /**
+       * Constructor.
+       *
+       * @param blockSize The size of the first block in bytes, blocks
+       *        added later double in size.
+       */
+      Arena(std::size_t blockSize = 4096) : m_blockSize(blockSize), m_block(0), m_offset(0)
+      {
+      }
+
+      ~Arena()
+      {
+        for (std::size_t i = 0; i < m_blocks.size(); ++i)
+          std::free(m_blocks[i].data);
+      }
+
+      /**
+       * Allocate @p size bytes aligned to Alignment bytes. The memory is not
+       * initialized.
+       */
+      void* allocate(std::size_t size)
+      {
+        size = (size + Alignment - 1) / Alignment * Alignment;
+        while (m_block == m_blocks.size() || m_offset + size > m_blocks[m_block].size) {
+          if (m_block < m_blocks.size())
+            ++m_block;
+          if (m_block == m_blocks.size())
+            addBlock(size);
+          m_offset = 0;
+        }
+        void *memory = m_blocks[m_block].data + m_offset;
+        m_offset += size;
+        return memory;
+      }
+
+      /**
+       * Allocate (uninitialized) memory for @p n elements of type T.
+       */
+      template<typename T>
+      T* allocate(std::size_t n)
+      {
+        return static_cast<T*>(allocate(n * sizeof(T)));
+      }
+
+      /**
+       * Release all memory allocated from the arena. The blocks are kept
+       * and merged into a single block if there are multiple.
+       */
+      void reset()
+      {
+        if (m_blocks.size() > 1) {
+          std::size_t size = capacity();
+          for (std::size_t i = 0; i < m_blocks.size(); ++i)
+            std::free(m_blocks[i].data);
+          m_blocks.clear();
+          addBlock(size);
+        }
+        m_block = 0;
+        m_offset = 0;
+      }
+
+      /**
+       * Get the number of bytes currently allocated from the arena.
+       */
+      std::size_t used() const
+      {
+        std::size_t size = m_offset;
+        for (std::size_t i = 0; i < m_block && i < m_blocks.size(); ++i)
+          size += m_blocks[i].size;
+        return size;
+      }
+
+      /**
+       * Get the total size of the blocks in bytes.
+       */
+      std::size_t capacity() const
+      {
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < m_blocks.size(); ++i)
+          size += m_blocks[i].size;
+        return size;
+      }
+
+    private:
+      Arena(const Arena&);
+      Arena& operator=(const Arena&);
+
+      struct Block
+      {
+        char *data;
+        std::size_t size;
+      };
+
+      void addBlock(std::size_t minSize)
+      {
+        std::size_t size = std::max(minSize, m_blocks.empty() ? m_blockSize : 2 * m_blocks.back().size);
+        Block block;
+        block.data = static_cast<char*>(std::malloc(size));
+        if (!block.data)
+          throw std::bad_alloc();
+        block.size = size;
+        m_blocks.push_back(block);
+      }
+
+      std::vector<Block> m_blocks; // the blocks
+      std::size_t m_blockSize; // the size of the first block
+      std::size_t m_block; // the current block
+      std::size_t m_offset; // the offset of the free memory in the current block
+  };
+
+  /**
+   * @brief STL allocator using an Arena.
+   *
+   * Deallocating is a no-op, the memory is released by the Arena::Scope
+   * the container was used in or by Arena::reset().
+   */
+  template<typename T>
+  class ArenaAllocator
+  {
+    public:
+      typedef T value_type;
+      typedef T* pointer;
+      typedef const T* const_pointer;
+      typedef T& reference;
+      typedef const T& const_reference;
+      typedef std::size_t size_type;
+      typedef std::ptrdiff_t difference_type;
+
+      template<typename U>
+      struct rebind
+      {
+        typedef ArenaAllocator<U> other;
+      };
+
+      ArenaAllocator(Arena &arena) : m_arena(&arena)
+      {
+      }
+
+      template<typename U>
+      ArenaAllocator(const ArenaAllocator<U> &other) : m_arena(other.arena())
+      {
+      }
+
+      pointer allocate(size_type n, const void* = 0)
+      {
+        return m_arena->allocate<T>(n);
+      }
+
+      void deallocate(pointer, size_type)
+      {
+      }
+
+      size_type max_size() const
+      {
+        return std::numeric_limits<size_type>::max() / sizeof(T);
+      }
+
+      void construct(pointer p, const T &value)
+      {
+        new (p) T(value);
+      }
+
+      void destroy(pointer p)
+      {
+        p->~T();
+      }
+
+      pointer address(reference value) const
+      {
+        return &value;
+      }
+
+      const_pointer address(const_reference value) const
+      {
+        return &value;
+      }
+
+      /**
+       * Get the arena.
+       */
+      Arena* arena() const
+      {
+        return m_arena;
+      }
+
+    private:
+      Arena *m_arena;
+  };
+
+  template<typename T, typename U>
+  bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+  {
+    return a.arena() == b.arena();
+  }
+
+  template<typename T, typename U>
+  bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+  {
+    return a.arena() != b.arena();
+  }
+
+  /**
+   * @brief A std::vector using an ArenaAllocator.
+   *
+   * @code
+   * ArenaVector<Index>::type atoms((ArenaAllocator<Index>(arena)));
+   * @endcode
+   */
+  template<typename T>
+  struct ArenaVector
+  {
+    typedef std::vector<T, ArenaAllocator<T> > type;
+  };
+
+  //@cond dev
+
+  template<typename T>
+  std::ostream& operator<<(std::ostream &os, const std::vector<T, ArenaAllocator<T> > &v)
+  {
+    os << "[ ";
+    for (std::size_t i = 0; i < v.size(); ++i)
+      os << v[i] << " ";
+    os << "]";
+    return os;
+  }
+
+  //@endcond
+
+}
+
+#endif
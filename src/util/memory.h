@@ -0,0 +1,241 @@
+#ifndef HELIUM_UTIL_MEMORY_H
+#define HELIUM_UTIL_MEMORY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Helium {
+
+  /**
+   * The cache line size in bytes. Memory returned by aligned_new() is
+   * aligned to (at least) this size which is also enough for SIMD loads.
+   */
+  const std::size_t CacheLineSize = 64;
+
+  /**
+   * The huge page size in bytes. Large allocations are aligned to this size
+   * so the operating system can back them with (transparent) huge pages.
+   */
+  const std::size_t HugePageSize = 2 * 1024 * 1024;
+
+  /**
+   * Get the number of bytes allocated by aligned_new() for @p n elements of
+   * type T (i.e. rounded up to the alignment).
+   */
+  template<typename T>
+  std::size_t aligned_size(std::size_t n)
+  {
+    std::size_t size = n * sizeof(T);
+    std::size_t alignment = size >= HugePageSize ? HugePageSize : CacheLineSize;
+    // round the size up so the last huge page is not shared
+    return (size + alignment - 1) / alignment * alignment;
+  }
+
+  /**
+   * Allocate (zero-initialized) memory for @p n elements of type T. The memory
+   * is aligned to CacheLineSize bytes. Allocations of at least HugePageSize
+   * bytes are aligned to HugePageSize and, on platforms that support it,
+   * madvise(MADV_HUGEPAGE) is used to request huge pages. This reduces the
+   * number of TLB misses when scanning large arrays. The memory must be
+   * released using aligned_delete().
+   *
+   * T must be a POD type (i.e. no constructors are called).
+   *
+   * When @p zero is false, the memory is not touched by this function. The
+   * operating system places each page on the NUMA node of the thread that
+   * first writes to it so the memory can be initialized by the threads that
+   * will use it (first-touch placement).
+   *
+   * @param n The number of elements.
+   * @param zero If true, the memory is set to zero.
+   *
+   * @return Pointer to the allocated memory (or 0 if n is 0).
+   */
+  template<typename T>
+  T* aligned_new(std::size_t n, bool zero = true)
+  {
+    if (!n)
+      return 0;
+
+    std::size_t size = aligned_size<T>(n);
+    std::size_t alignment = size >= HugePageSize ? HugePageSize : CacheLineSize;
+
+    void *memory = 0;
+#if defined(_WIN32)
+    memory = _aligned_malloc(size, alignment);
+#else
+    if (posix_memalign(&memory, alignment, size))
+      memory = 0;
+#endif
+    if (!memory)
+      throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+    // the hint is best effort, errors are ignored
+    if (alignment == HugePageSize)
+      madvise(memory, size, MADV_HUGEPAGE);
+#endif
+
+    if (zero)
+      std::memset(memory, 0, size);
+    return static_cast<T*>(memory);
+  }
+
+  /**
+   * Release memory allocated using aligned_new().
+   *
+   * @param memory The memory to release (may be 0).
+   */
+  template<typename T>
+  void aligned_delete(T *memory)
+  {
+#if defined(_WIN32)
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+  }
+
+  /**
+   * Round a number of words up to a SIMD friendly stride. Strides smaller
+   * than a cache line are rounded up to a power of two so rows never cross
+   * a cache line boundary, larger strides are rounded up to a multiple of
+   * the cache line size.
+   *
+   * @param numWords The number of words.
+   * @param wordSize The size of a single word in bytes.
+   */
+  inline std::size_t aligned_stride(std::size_t numWords, std::size_t wordSize)
+  {
+    std::size_t lineWords = CacheLineSize / wordSize;
+    if (numWords >= lineWords)
+      return (numWords + lineWords - 1) / lineWords * lineWords;
+    std::size_t stride = 1;
+    while (stride < numWords)
+      stride *= 2;
+    return numWords ? stride : 0;
+  }
+
+  /**
+   * @brief The memory used by an object.
+   *
+   * The heap memory is allocated by the object and assumed to be resident.
+   * The mapped memory is the size of the memory mapped files of which only
+   * the pages that have been accessed (or prefetched) are resident. Memory
+   * of other objects that is only referenced (e.g. the fingerprint storage
+   * of a SimilaritySearchIndex) is not included.
+   */
+  struct MemoryUsage
+  {
+    MemoryUsage(std::size_t heap_ = 0, std::size_t mapped_ = 0, std::size_t resident_ = 0)
+      : heap(heap_), mapped(mapped_), resident(resident_)
+    {
+    }
+
+    MemoryUsage& operator+=(const MemoryUsage &other)
+    {
+      heap += other.heap;
+      mapped += other.mapped;
+      resident += other.resident;
+      return *this;
+    }
+
+    /**
+     * Get the total address space used (heap + mapped).
+     */
+    std::size_t total() const
+    {
+      return heap + mapped;
+    }
+
+    std::size_t heap; //!< Bytes allocated on the heap
+    std::size_t mapped; //!< Bytes of memory mapped files
+    std::size_t resident; //!< Resident bytes (the heap plus the resident pages of the mapped files)
+  };
+
+  /**
+   * Get the number of bytes allocated by a std::vector.
+   */
+  template<typename T>
+  std::size_t vector_memory_usage(const std::vector<T> &v)
+  {
+    return v.capacity() * sizeof(T);
+  }
+
+  /**
+   * @overload
+   */
+  inline std::size_t vector_memory_usage(const std::vector<bool> &v)
+  {
+    return v.capacity() / 8;
+  }
+
+  /**
+   * Get the number of resident bytes of a memory mapped region using
+   * mincore(). On platforms without mincore() the region is assumed to
+   * be resident.
+   *
+   * @param address The start of the region.
+   * @param size The size of the region in bytes.
+   */
+  inline std::size_t mapped_resident_bytes(const void *address, std::size_t size)
+  {
+    if (!address || !size)
+      return 0;
+#if defined(__unix__) || defined(__APPLE__)
+    const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    // mincore() requires a page aligned address
+    std::size_t begin = reinterpret_cast<std::size_t>(address) / pageSize * pageSize;
+    std::size_t end = reinterpret_cast<std::size_t>(address) + size;
+    std::size_t numPages = (end - begin + pageSize - 1) / pageSize;
+#ifdef __APPLE__
+    std::vector<char> pages(numPages);
+#else
+    std::vector<unsigned char> pages(numPages);
+#endif
+    if (mincore(reinterpret_cast<void*>(begin), end - begin, &pages[0]))
+      return size;
+    std::size_t resident = 0;
+    for (std::size_t i = 0; i < numPages; ++i)
+      if (pages[i] & 1)
+        ++resident;
+    return std::min(size, resident * pageSize);
+#else
+    return size;
+#endif
+  }
+
+  /**
+   * Get the memory usage of a memory mapped region (see
+   * mapped_resident_bytes()).
+   */
+  inline MemoryUsage mapped_memory_usage(const void *address, std::size_t size)
+  {
+    return MemoryUsage(0, size, mapped_resident_bytes(address, size));
+  }
+
+  /**
+   * Get the size of a file in bytes (0 if it can not be opened).
+   */
+  inline std::size_t file_size(const std::string &filename)
+  {
+    std::ifstream ifs(filename.c_str(), std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+    if (!ifs)
+      return 0;
+    return static_cast<std::size_t>(ifs.tellg());
+  }
+
+}
+
+#endif
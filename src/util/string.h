@@ -157,14 +157,16 @@ namespace Helium {
     //std::cout << "tokenize: \"" << str << "\"" << std::endl;
 
     while ((nextpos = str.find(delimiter, currpos)) != std::string::npos) {
-      if (repeat)
-        while (nextpos < str.size() && str[nextpos] == delimiter[0])
-          ++nextpos;
-      if (nextpos == str.size())
-        return tokens;
-      tokens.push_back(str.substr(currpos, nextpos - currpos - 1));
+      tokens.push_back(str.substr(currpos, nextpos - currpos));
       //std::cout << "token: \"" << tokens.back() << "\"" << std::endl;
-      currpos = nextpos;
+      currpos = nextpos + delimiter.size();
+      if (repeat) {
+        // skip repeated delimiters
+        while (!str.compare(currpos, delimiter.size(), delimiter))
+          currpos += delimiter.size();
+        if (currpos == str.size())
+          return tokens;
+      }
     }
     tokens.push_back(str.substr(currpos, str.length() - currpos));
     //std::cout << "token: \"" << tokens.back() << "\"" << std::endl;
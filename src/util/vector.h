@@ -24,8 +24,8 @@ namespace std {
   template<typename T>
   bool operator<(const std::vector<T> &v1, const std::vector<T> &v2)
   {
-    if (v1.size() < v2.size())
-      return true;
+    if (v1.size() != v2.size())
+      return v1.size() < v2.size();
     for (std::size_t i = 0; i < v1.size(); ++i) {
       if (v1[i] < v2[i])
         return true;
@@ -38,8 +38,8 @@ namespace std {
   template<typename T>
   bool operator>(const std::vector<T> &v1, const std::vector<T> &v2)
   {
-    if (v1.size() > v2.size())
-      return true;
+    if (v1.size() != v2.size())
+      return v1.size() > v2.size();
     for (std::size_t i = 0; i < v1.size(); ++i) {
       if (v1[i] > v2[i])
         return true;
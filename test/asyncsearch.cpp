@@ -0,0 +1,241 @@
+#include <Helium/config.h>
+
+#include "test.h"
+
+#ifdef HAVE_CPP11
+
+#include <Helium/fingerprints/asyncsearch.h>
+#include <Helium/fileio/fingerprints.h>
+
+#include <cstdlib>
+#include <atomic>
+#include <stdexcept>
+
+using namespace Helium;
+
+const unsigned int numBits = 1024;
+const unsigned int numWords = numBits / BitsPerWord;
+const unsigned int numFingerprints = 2000;
+
+void compare_hits(const std::vector<std::pair<unsigned int, double> > &expected,
+    const std::vector<std::pair<unsigned int, double> > &result)
+{
+  COMPARE(expected.size(), result.size());
+  if (expected.size() == result.size())
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+      COMPARE(expected[i].first, result[i].first);
+      COMPARE(expected[i].second, result[i].second);
+    }
+}
+
+void test_futures(InMemoryRowMajorFingerprintStorage &storage, ThreadPool *pool)
+{
+  std::cout << "Testing AsyncSimilaritySearch::submit() (pool = " << (pool != 0) << ")..." << std::endl;
+  // a long window so the requests are coalesced
+  AsyncSimilaritySearch<InMemoryRowMajorFingerprintStorage> async(storage, 16, std::chrono::milliseconds(50), 1024, pool);
+
+  const unsigned int numQueries = 100;
+  std::vector<std::future<std::vector<std::pair<unsigned int, double> > > > futures;
+  for (unsigned int q = 0; q < numQueries; ++q) {
+    // requests with different thresholds and N are batched together
+    double Tmin = 0.3 + 0.1 * (q % 5);
+    futures.push_back(async.submit(storage.fingerprint(q * 7), Tmin, q % 3 ? 0 : 10));
+  }
+
+  for (unsigned int q = 0; q < numQueries; ++q) {
+    double Tmin = 0.3 + 0.1 * (q % 5);
+    if (q % 3)
+      compare_hits(brute_force_similarity_search(storage.fingerprint(q * 7), storage, Tmin), futures[q].get());
+    else
+      compare_hits(brute_force_knn_search(storage.fingerprint(q * 7), storage, 10, Tmin), futures[q].get());
+  }
+
+  COMPARE(numQueries, async.numRequests());
+  ASSERT(async.numBatches() >= numQueries / 16);
+  ASSERT(async.numBatches() < numQueries);
+  COMPARE(0, async.pending());
+}
+
+void test_concurrent_callers(InMemoryRowMajorFingerprintStorage &storage, std::size_t maxQueued)
+{
+  std::cout << "Testing AsyncSimilaritySearch with concurrent callers (queue = " << maxQueued << ")..." << std::endl;
+  AsyncSimilaritySearch<InMemoryRowMajorFingerprintStorage> async(storage, 8, std::chrono::microseconds(500), maxQueued);
+
+  const unsigned int numThreads = 4;
+  const unsigned int numQueries = 50;
+  std::atomic<unsigned int> numCallbacks(0), numFailures(0);
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < numThreads; ++t)
+    threads.push_back(std::thread([&, t] {
+      for (unsigned int q = 0; q < numQueries; ++q) {
+        unsigned int index = (t * numQueries + q) % numFingerprints;
+        std::vector<std::pair<unsigned int, double> > expected =
+          brute_force_similarity_search(storage.fingerprint(index), storage, 0.5);
+        if (q % 2) {
+          // submit() blocks while the queue is full
+          if (async.submit(storage.fingerprint(index), 0.5).get() != expected)
+            ++numFailures;
+        } else {
+          async.submit(storage.fingerprint(index), 0.5, 0,
+              [&numCallbacks, &numFailures, expected] (const std::vector<std::pair<unsigned int, double> > &hits,
+                  std::exception_ptr error) {
+                if (error || hits != expected)
+                  ++numFailures;
+                ++numCallbacks;
+              });
+        }
+        ASSERT(async.pending() <= maxQueued);
+      }
+    }));
+
+  for (std::size_t t = 0; t < threads.size(); ++t)
+    threads[t].join();
+
+  // wait for the remaining callbacks
+  while (numCallbacks < numThreads * numQueries / 2)
+    std::this_thread::yield();
+
+  COMPARE(0, numFailures.load());
+  COMPARE(numThreads * numQueries / 2, numCallbacks.load());
+}
+
+void test_try_submit(InMemoryRowMajorFingerprintStorage &storage)
+{
+  std::cout << "Testing AsyncSimilaritySearch::trySubmit()..." << std::endl;
+  AsyncSimilaritySearch<InMemoryRowMajorFingerprintStorage> async(storage, 4, std::chrono::microseconds(100), 2);
+
+  std::vector<std::future<std::vector<std::pair<unsigned int, double> > > > futures;
+  unsigned int rejected = 0;
+  for (unsigned int q = 0; q < 200; ++q) {
+    std::future<std::vector<std::pair<unsigned int, double> > > future;
+    if (async.trySubmit(storage.fingerprint(q), 0.6, future, 5))
+      futures.push_back(std::move(future));
+    else
+      ++rejected;
+  }
+
+  COMPARE(200, futures.size() + rejected);
+  for (std::size_t i = 0; i < futures.size(); ++i)
+    ASSERT(futures[i].get().size() <= 5);
+}
+
+void test_knn_requests(InMemoryRowMajorFingerprintStorage &storage, ThreadPool *pool)
+{
+  std::cout << "Testing AsyncSimilaritySearch kNN requests (pool = " << (pool != 0) << ")..." << std::endl;
+  AsyncSimilaritySearch<InMemoryRowMajorFingerprintStorage> async(storage, 16, std::chrono::milliseconds(50), 1024, pool);
+
+  // a kNN request with Tmin = 0 in the same batch as threshold requests
+  std::vector<std::future<std::vector<std::pair<unsigned int, double> > > > futures;
+  for (unsigned int q = 0; q < 12; ++q)
+    futures.push_back(async.submit(storage.fingerprint(q * 11), q % 4 ? 0.6 + 0.1 * (q % 2) : 0.0, q % 4 ? 0 : 5));
+
+  for (unsigned int q = 0; q < 12; ++q) {
+    if (q % 4)
+      compare_hits(brute_force_similarity_search(storage.fingerprint(q * 11), storage, 0.6 + 0.1 * (q % 2)), futures[q].get());
+    else
+      compare_hits(brute_force_knn_search(storage.fingerprint(q * 11), storage, 5, 0.0), futures[q].get());
+  }
+}
+
+/**
+ * Storage that fails when the fingerprints are accessed.
+ */
+struct FailingStorage
+{
+  FailingStorage(InMemoryRowMajorFingerprintStorage &storage_) : storage(storage_)
+  {
+  }
+
+  unsigned int numBits() const
+  {
+    return storage.numBits();
+  }
+
+  unsigned int numFingerprints() const
+  {
+    return storage.numFingerprints();
+  }
+
+  Word* fingerprint(unsigned int) const
+  {
+    throw std::runtime_error("storage failed");
+  }
+
+  const int* bitCounts() const
+  {
+    return storage.bitCounts();
+  }
+
+  const std::vector<unsigned int>& popcountOffsets() const
+  {
+    return storage.popcountOffsets();
+  }
+
+  InMemoryRowMajorFingerprintStorage &storage;
+};
+
+void test_errors(InMemoryRowMajorFingerprintStorage &storage)
+{
+  std::cout << "Testing AsyncSimilaritySearch errors..." << std::endl;
+  FailingStorage failing(storage);
+  AsyncSimilaritySearch<FailingStorage> async(failing, 8, std::chrono::milliseconds(20));
+
+  // the errors are reported to the futures and the callbacks
+  std::atomic<unsigned int> numErrors(0);
+  std::vector<std::future<std::vector<std::pair<unsigned int, double> > > > futures;
+  for (unsigned int q = 0; q < 6; ++q) {
+    unsigned int N = q % 2 ? 0 : 3;
+    futures.push_back(async.submit(storage.fingerprint(q), 0.5, N));
+    async.submit(storage.fingerprint(q), 0.5, N,
+        [&numErrors] (const std::vector<std::pair<unsigned int, double> > &hits, std::exception_ptr error) {
+          if (error && hits.empty())
+            ++numErrors;
+        });
+  }
+
+  for (std::size_t i = 0; i < futures.size(); ++i) {
+    bool failed = false;
+    try {
+      futures[i].get();
+    } catch (const std::runtime_error&) {
+      failed = true;
+    }
+    ASSERT(failed);
+  }
+
+  // the callbacks of the batch are called after the futures are set
+  while (numErrors < 6)
+    std::this_thread::yield();
+  COMPARE(6, numErrors.load());
+}
+
+int main()
+{
+  // every 20th fingerprint has 4 near duplicates
+  FingerprintFixture fixture(numBits, 7);
+  fixture.duplicateStride = 20;
+  fixture.groupSize = 5;
+  std::vector<Word> fingerprints = fixture.random(numFingerprints);
+  fixture.write("tmp_async.fps.hel", fingerprints, 0, numFingerprints);
+
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_async.fps.hel");
+
+  test_futures(storage, 0);
+  ThreadPool pool(3);
+  test_futures(storage, &pool);
+  test_concurrent_callers(storage, 1024);
+  test_concurrent_callers(storage, 3);
+  test_try_submit(storage);
+  test_knn_requests(storage, 0);
+  test_knn_requests(storage, &pool);
+  test_errors(storage);
+}
+
+#else
+
+int main()
+{
+}
+
+#endif
@@ -2,8 +2,126 @@
 
 #include "test.h"
 
+#include <cstdlib>
+#include <vector>
+
 using namespace Helium;
 
+void test_kernels(const std::string &name)
+{
+  const impl::BitvecKernels *kernels = impl::bitvec_kernels_by_name(name);
+  if (!kernels) {
+    std::cout << "Kernel " << name << " not supported, skipping" << std::endl;
+    return;
+  }
+  std::cout << "Testing kernel: " << kernels->name << std::endl;
+
+  // check all sizes up to 4 Harley-Seal blocks (and the AVX-512 tails)
+  std::srand(42);
+  for (int numWords = 0; numWords <= 260; ++numWords) {
+    std::vector<Word> bv1(numWords + 1), bv2(numWords + 1);
+    for (int i = 0; i < numWords; ++i) {
+      bv1[i] = (static_cast<Word>(std::rand()) << 40) ^ (static_cast<Word>(std::rand()) << 20) ^ std::rand();
+      bv2[i] = (static_cast<Word>(std::rand()) << 40) ^ (static_cast<Word>(std::rand()) << 20) ^ std::rand();
+    }
+    // guard word, should never be counted
+    bv1[numWords] = bv2[numWords] = ~static_cast<Word>(0);
+
+    int count = 0, andCount = 0, orCount = 0;
+    for (int i = 0; i < numWords; ++i) {
+      count += impl::popcount_swar(bv1[i]);
+      andCount += impl::popcount_swar(bv1[i] & bv2[i]);
+      orCount += impl::popcount_swar(bv1[i] | bv2[i]);
+    }
+
+    COMPARE(count, kernels->count(&bv1[0], numWords));
+    COMPARE(andCount, kernels->andCount(&bv1[0], &bv2[0], numWords));
+    int andCount2, orCount2;
+    kernels->andOrCount(&bv1[0], &bv2[0], numWords, andCount2, orCount2);
+    COMPARE(andCount, andCount2);
+    COMPARE(orCount, orCount2);
+  }
+}
+
+
+template<int NumWords>
+void test_fixed_kernels()
+{
+  std::cout << "Testing fixed-width functions: " << NumWords << " words" << std::endl;
+  std::srand(7);
+  for (int n = 0; n < 10; ++n) {
+    Word bv1[NumWords], bv2[NumWords];
+    for (int i = 0; i < NumWords; ++i) {
+      bv1[i] = (static_cast<Word>(std::rand()) << 40) ^ (static_cast<Word>(std::rand()) << 20) ^ std::rand();
+      bv2[i] = bv1[i] & ((static_cast<Word>(std::rand()) << 40) ^ std::rand());
+    }
+
+    COMPARE(bitvec_count(bv1, NumWords), bitvec_count<NumWords>(bv1));
+    COMPARE(bitvec_union_count(bv1, bv2, NumWords), bitvec_union_count<NumWords>(bv1, bv2));
+    COMPARE(bitvec_tanimoto(bv1, bv2, NumWords), bitvec_tanimoto<NumWords>(bv1, bv2));
+    COMPARE(bitvec_tanimoto(bv1, bv2, NumWords), bitvec_tanimoto<NumWords>(bv1, bv2,
+          bitvec_count(bv1, NumWords), bitvec_count(bv2, NumWords)));
+    COMPARE(true, bitvec_is_subset_superset<NumWords>(bv2, bv1));
+    COMPARE(bitvec_is_subset_superset(bv1, bv2, NumWords), bitvec_is_subset_superset<NumWords>(bv1, bv2));
+
+    const char *names[] = { "scalar", "popcnt", "avx2", "avx512" };
+    for (int i = 0; i < 4; ++i) {
+      const impl::BitvecKernels *kernels = impl::bitvec_fixed_kernels_by_name<NumWords>(names[i]);
+      if (!kernels)
+        continue;
+      COMPARE(bitvec_count(bv1, NumWords), kernels->count(bv1, NumWords));
+      COMPARE(bitvec_union_count(bv1, bv2, NumWords), kernels->andCount(bv1, bv2, NumWords));
+      int andCount, orCount;
+      kernels->andOrCount(bv1, bv2, NumWords, andCount, orCount);
+      COMPARE(bitvec_union_count(bv1, bv2, NumWords), andCount);
+      COMPARE(bitvec_count(bv1, NumWords), orCount); // bv2 is a subset of bv1
+    }
+  }
+}
+
+void test_fold(int numBits, int foldedBits, int modulus)
+{
+  std::cout << "Testing bitvec_fold(" << numBits << " -> " << foldedBits << ", " << modulus << ")" << std::endl;
+  int numWords = bitvec_num_words_for_bits(numBits);
+  int foldedWords = bitvec_num_words_for_bits(foldedBits);
+
+  std::srand(numBits + modulus);
+  std::vector<Word> bitvec(numWords, 0), expected(foldedWords), folded(foldedWords, ~static_cast<Word>(0));
+  for (int i = 0; i < numBits / 4; ++i)
+    bitvec_set(std::rand() % numBits, &bitvec[0]);
+
+  bitvec_zero(&expected[0], foldedWords);
+  for (int j = 0; j < numBits; ++j)
+    if (bitvec_get(j, &bitvec[0]))
+      bitvec_set(j % modulus, &expected[0]);
+
+  bitvec_fold(&bitvec[0], numBits, &folded[0], foldedWords, modulus);
+  COMPARE(bitvec_to_hex(&expected[0], foldedWords), bitvec_to_hex(&folded[0], foldedWords));
+
+  if (modulus == foldedWords * BitsPerWord && (numBits % BitsPerWord) == 0) {
+    bitvec_fold(&bitvec[0], numWords, &folded[0], foldedWords);
+    COMPARE(bitvec_to_hex(&expected[0], foldedWords), bitvec_to_hex(&folded[0], foldedWords));
+  }
+}
+
+void test_transpose()
+{
+  std::cout << "Testing bitvec_transpose_64x64()" << std::endl;
+  std::srand(64);
+  std::vector<Word> matrix(64, 0), transposed;
+  for (int i = 0; i < 1024; ++i)
+    bitvec_set(std::rand() % 4096, &matrix[0]);
+
+  transposed = matrix;
+  bitvec_transpose_64x64(&transposed[0]);
+  for (int i = 0; i < 64; ++i)
+    for (int j = 0; j < 64; ++j)
+      COMPARE(bitvec_get(j, &matrix[i]), bitvec_get(i, &transposed[j]));
+
+  // transposing twice gives the original matrix
+  bitvec_transpose_64x64(&transposed[0]);
+  COMPARE(bitvec_to_hex(&matrix[0], 64), bitvec_to_hex(&transposed[0], 64));
+}
 
 int main()
 {
@@ -20,4 +138,26 @@ int main()
 
   hex_to_bitvec("01ab02cd03ef", &bitvec, 1);
   COMPARE("01ab02cd03ef0000", bitvec_to_hex(&bitvec, 1));
+
+  test_kernels("scalar");
+  test_kernels("popcnt");
+  test_kernels("avx2");
+  test_kernels("avx512");
+  ASSERT(impl::bitvec_kernels().name != 0);
+
+  test_fixed_kernels<16>();
+  test_fixed_kernels<32>();
+  test_fixed_kernels<64>();
+
+  test_fold(2048, 1024, 1024);
+  test_fold(4096, 1024, 1024);
+  test_fold(1024, 512, 509);
+  test_fold(1021, 512, 509);
+  test_fold(16384, 1024, 1021);
+  test_fold(1024, 128, 127);
+  test_fold(1024, 64, 61);
+  test_fold(1024, 64, 64);
+  test_fold(200, 64, 37);
+
+  test_transpose();
 }
@@ -1,6 +1,7 @@
 #include <Helium/algorithms/canonical.h>
 #include <Helium/fileio/molecules.h>
 #include <Helium/algorithms/extendedconnectivities.h>
+#include <Helium/algorithms/cachedproperties.h>
 #include <Helium/algorithms/components.h>
 #include <Helium/smiles.h>
 
@@ -74,8 +75,117 @@ void shuffle_test(const std::string &filename)
   std::cout << "smallest: " << idx << std::endl;
 }
 
+void test_canonical_key()
+{
+  std::cout << "Testing canonical_key()..." << std::endl;
+  HeMol mol1, mol2, mol3, mol4, mol5, mol6;
+  parse_smiles("OC(=O)c1ccccc1", mol1);
+  parse_smiles("c1ccc(cc1)C(O)=O", mol2);
+  parse_smiles("[O-]C(=O)c1ccccc1", mol3);
+  parse_smiles("OC(=O)C1CCCCC1", mol4);
+  parse_smiles("CC.O", mol5);
+
+  std::vector<unsigned long> key = canonical_key(mol1);
+  ASSERT(!key.empty());
+  COMPARE(key, canonical_key(mol2));
+  // the canonical code does not include charges and aromaticity
+  COMPARE(canonicalize(mol1, extended_connectivities(mol1)).second,
+      canonicalize(mol3, extended_connectivities(mol3)).second);
+  ASSERT(key != canonical_key(mol3));
+  COMPARE(canonicalize(mol1, extended_connectivities(mol1)).second,
+      canonicalize(mol4, extended_connectivities(mol4)).second);
+  ASSERT(key != canonical_key(mol4));
+  // multiple components are not supported
+  ASSERT(canonical_key(mol5).empty());
+  ASSERT(canonical_key(mol6).empty());
+
+  // the cached extended connectivities give the same key and stay valid
+  COMPARE(key, canonical_key(mol1, cached_extended_connectivities(mol1)));
+  ASSERT(mol1.cache().isValid(impl::HeMolCache::ExtendedConnectivities));
+  COMPARE(key, canonical_key(mol2, cached_extended_connectivities(mol2)));
+  ASSERT(canonical_key(mol5, cached_extended_connectivities(mol5)).empty());
+  ASSERT(canonical_key(mol6, cached_extended_connectivities(mol6)).empty());
+}
+
+/**
+ * Reference implementation using std::set to count and renumber the values.
+ */
+std::vector<unsigned long> reference_extended_connectivities(HeMol &mol)
+{
+  std::vector<unsigned long> ec;
+  for (std::size_t i = 0; i < num_atoms(mol); ++i)
+    ec.push_back(atom_invariant(mol, get_atom(mol, i)));
+  unsigned int numClasses = unique_elements(ec);
+  for (int i = 0; i < 100; ++i) {
+    impl::extended_connectivities_iterate(mol, ec);
+    unsigned int nextNumClasses = unique_elements(ec);
+    if (numClasses == nextNumClasses)
+      break;
+    numClasses = nextNumClasses;
+  }
+  renumber(ec);
+  return ec;
+}
+
+void test_extended_connectivities(const std::string &filename)
+{
+  std::cout << "Testing extended_connectivities()..." << std::endl;
+  MoleculeFile file(filename);
+
+  HeMol mol;
+  std::vector<unsigned long> ec;
+  ExtendedConnectivitiesScratch scratch;
+  for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+    file.read_molecule(mol);
+    extended_connectivities(mol, ec, scratch);
+    COMPARE(reference_extended_connectivities(mol), ec);
+    COMPARE(ec, extended_connectivities(mol));
+  }
+
+  // empty molecule
+  mol.clear();
+  extended_connectivities(mol, ec, scratch);
+  ASSERT(ec.empty());
+}
+
+void test_canonicalize_arena(const std::string &filename)
+{
+  std::cout << "Testing canonicalize() with an arena..." << std::endl;
+  MoleculeFile file(filename);
+
+  HeMol mol;
+  Arena arena;
+  std::vector<Index> labels;
+  std::vector<unsigned long> code;
+  std::size_t capacity = 0;
+  for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+    file.read_molecule(mol);
+    std::vector<unsigned long> symmetry = extended_connectivities(mol);
+    std::pair<std::vector<Index>, std::vector<unsigned long> > expected = canonicalize(mol, symmetry);
+    canonicalize(mol, symmetry, labels, code, arena);
+    COMPARE(expected.first, labels);
+    COMPARE(expected.second, code);
+    // all memory is released
+    COMPARE(0, arena.used());
+    capacity = std::max(capacity, arena.capacity());
+  }
+
+  // the arena does not grow once it is large enough
+  for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+    file.read_molecule(i, mol);
+    arena.reset();
+    canonicalize(mol, extended_connectivities(mol), labels, code, arena);
+  }
+  ASSERT(arena.capacity() <= capacity);
+}
+
 int main()
 {
+  test_extended_connectivities(datadir() + "1K.hel");
+
+  test_canonical_key();
+  test_canonicalize_arena(datadir() + "1K.hel");
+
   shuffle_test_smiles("Clc1ccc2c(CCN2C(=O)C)c1");
 
   test_canonicalize("CCC(C)C");
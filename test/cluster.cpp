@@ -0,0 +1,98 @@
+#include <Helium/fingerprints/cluster.h>
+#include <Helium/fileio/fingerprints.h>
+
+#include "test.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+using namespace Helium;
+
+const unsigned int numBits = 1024;
+const unsigned int numWords = numBits / BitsPerWord;
+const unsigned int numFingerprints = 2000;
+
+void test_neighbors(const std::vector<Word> &fingerprints, double Tmin, unsigned int numThreads)
+{
+  std::cout << "Testing SimilarityNeighbors(Tmin = " << Tmin << ", numThreads = " << numThreads << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_cluster.fps.hel");
+  SimilarityNeighbors neighbors(storage, Tmin, 3, numThreads);
+  COMPARE(numFingerprints, neighbors.numFingerprints());
+
+  std::size_t numEdges = 0;
+  for (unsigned int i = 0; i < numFingerprints; ++i) {
+    std::vector<unsigned int> expected;
+    for (unsigned int j = 0; j < numFingerprints; ++j)
+      if (j != i && bitvec_tanimoto(&fingerprints[i * numWords], &fingerprints[j * numWords], numWords) >= Tmin)
+        expected.push_back(j);
+    numEdges += expected.size();
+
+    COMPARE(expected.size(), neighbors.numNeighbors(i));
+    if (expected.size() == neighbors.numNeighbors(i))
+      for (std::size_t j = 0; j < expected.size(); ++j)
+        COMPARE(expected[j], neighbors.neighbors(i)[j]);
+  }
+  COMPARE(numEdges, neighbors.numEdges());
+}
+
+void test_butina(double Tmin)
+{
+  std::cout << "Testing butina_clustering(Tmin = " << Tmin << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_cluster.fps.hel");
+  SimilarityNeighbors neighbors(storage, Tmin);
+  std::vector<std::vector<unsigned int> > clusters = butina_clustering(neighbors);
+
+  // each fingerprint is in exactly one cluster
+  std::vector<int> count(numFingerprints);
+  for (std::size_t c = 0; c < clusters.size(); ++c)
+    for (std::size_t i = 0; i < clusters[c].size(); ++i)
+      ++count[clusters[c][i]];
+  for (unsigned int i = 0; i < numFingerprints; ++i)
+    COMPARE(1, count[i]);
+
+  std::vector<bool> assigned(numFingerprints);
+  unsigned int previous = numFingerprints;
+  for (std::size_t c = 0; c < clusters.size(); ++c) {
+    unsigned int centroid = clusters[c][0];
+    // centroids are selected by decreasing number of neighbors
+    ASSERT(neighbors.numNeighbors(centroid) <= previous);
+    previous = neighbors.numNeighbors(centroid);
+    assigned[centroid] = true;
+    // the members are the unassigned neighbors of the centroid
+    const unsigned int *begin = neighbors.neighbors(centroid);
+    const unsigned int *end = begin + neighbors.numNeighbors(centroid);
+    for (std::size_t i = 1; i < clusters[c].size(); ++i) {
+      ASSERT(std::binary_search(begin, end, clusters[c][i]));
+      assigned[clusters[c][i]] = true;
+    }
+    for (const unsigned int *j = begin; j != end; ++j)
+      ASSERT(assigned[*j]);
+  }
+
+  // the groups of near duplicates are clustered together
+  std::vector<std::vector<unsigned int> > direct = butina_clustering(storage, Tmin);
+  COMPARE(clusters.size(), direct.size());
+  ASSERT(clusters.size() < numFingerprints);
+}
+
+int main()
+{
+  // every 25th fingerprint has 4 near duplicates
+  FingerprintFixture fixture(numBits, 11);
+  fixture.minBitsSet = 20;
+  fixture.duplicateStride = 25;
+  fixture.groupSize = 5;
+  std::vector<Word> fingerprints = fixture.random(numFingerprints);
+  fixture.write("tmp_cluster.fps.hel", fingerprints, 0, numFingerprints);
+
+  test_neighbors(fingerprints, 0.7, 1);
+  test_neighbors(fingerprints, 0.3, 1);
+#ifdef HAVE_CPP11
+  test_neighbors(fingerprints, 0.3, 0);
+#endif
+
+  test_butina(0.7);
+  test_butina(0.4);
+}
@@ -61,6 +61,26 @@ int main()
   COMPARE(1, components[3]);
   COMPARE(1, components[4]);
 
+  // isolated atoms are numbered after the bond components
+  parse_smiles("CC.C.C", mol);
+  components = connected_atom_components(mol);
+  COMPARE(4, components.size());
+  COMPARE(0, components[0]);
+  COMPARE(0, components[1]);
+  COMPARE(1, components[2]);
+  COMPARE(2, components[3]);
+
+  // reuse a workspace
+  TraversalWorkspace<HeMol> workspace;
+  parse_smiles("C1CC1.CC", mol);
+  COMPARE(2, connected_bond_components(mol, components, workspace));
+  COMPARE(4, components.size());
+  COMPARE(1, components[3]);
+  parse_smiles("CC.C", mol);
+  COMPARE(2, connected_atom_components(mol, components, workspace));
+  COMPARE(3, components.size());
+  COMPARE(1, components[2]);
+
   //
   // num_connected_components
   //
@@ -20,11 +20,18 @@ void test_cycle_membership(const std::string &filename)
   MoleculeFile file(filename);
 
   HeMol mol;
+  CycleMembershipScratch scratch;
   for (unsigned int i = 0; i < file.numMolecules(); ++i) {
     file.read_molecule(mol);
     std::vector<bool> cyclic_atoms, cyclic_bonds;
     cycle_membership(mol, cyclic_atoms, cyclic_bonds);
 
+    // the scratch buffers are reused for all molecules
+    std::vector<bool> scratch_atoms, scratch_bonds;
+    cycle_membership(mol, scratch_atoms, scratch_bonds, scratch);
+    ASSERT(scratch_atoms == cyclic_atoms);
+    ASSERT(scratch_bonds == cyclic_bonds);
+
     HeMol::atom_iter atom, end_atom;
     TIE(atom, end_atom) = get_atoms(mol);
     for (; atom != end_atom; ++atom) {
@@ -59,6 +66,31 @@ void test_relevant_cycles(const std::string &smiles, std::vector<std::pair<unsig
 
   for (std::size_t i = 0; i < expected.size(); ++i)
     COMPARE(expected[i].second, cycleSizeCounts[expected[i].first]);
+
+  // the atoms are in ring order
+  for (std::size_t i = 0; i < cycles.size(); ++i)
+    for (std::size_t j = 0; j < cycles[i].size(); ++j) {
+      HeMol::atom_type atom = get_atom(mol, cycles[i][j]);
+      HeMol::atom_type next = get_atom(mol, cycles[i][(j + 1) % cycles[i].size()]);
+      ASSERT(get_bond(mol, atom, next) != molecule_traits<HeMol>::null_bond());
+    }
+}
+
+void test_sssr(const std::string &smiles, std::vector<std::pair<unsigned int, unsigned int> > &expected)
+{
+  std::cout << "Testing SSSR: " << smiles << std::endl;
+  HeMol mol;
+  parse_smiles(smiles, mol);
+
+  std::vector<std::vector<Index> > cycles = sssr(mol);
+  COMPARE(cyclomatic_number(mol), cycles.size());
+
+  std::map<unsigned int, unsigned int> cycleSizeCounts;
+  for (std::size_t i = 0; i < cycles.size(); ++i)
+    cycleSizeCounts[cycles[i].size()]++;
+
+  for (std::size_t i = 0; i < expected.size(); ++i)
+    COMPARE(expected[i].second, cycleSizeCounts[expected[i].first]);
 }
 
 int main()
@@ -95,4 +127,39 @@ int main()
   cycles.push_back(std::make_pair(6, 1));
   test_relevant_cycles("C1C(N)C1Cc1ccc(O)cc1", cycles);
 
+  // naphthalene: the 10 membered ring is not relevant
+  cycles.clear();
+  cycles.push_back(std::make_pair(6, 2));
+  cycles.push_back(std::make_pair(10, 0));
+  test_relevant_cycles("c1ccc2ccccc2c1", cycles);
+  test_sssr("c1ccc2ccccc2c1", cycles);
+
+  // cubane: all 6 faces are relevant, the SSSR has 5
+  cycles.clear();
+  cycles.push_back(std::make_pair(4, 6));
+  test_relevant_cycles("C12C3C4C1C5C2C3C45", cycles);
+  cycles.clear();
+  cycles.push_back(std::make_pair(4, 5));
+  test_sssr("C12C3C4C1C5C2C3C45", cycles);
+
+  // bicyclo[2.2.2]octane: 3 relevant 6 membered rings
+  cycles.clear();
+  cycles.push_back(std::make_pair(6, 3));
+  test_relevant_cycles("C1CC2CCC1CC2", cycles);
+  cycles.clear();
+  cycles.push_back(std::make_pair(6, 2));
+  test_sssr("C1CC2CCC1CC2", cycles);
+
+  // fused 4 membered ring: both 6 membered rings on each side are relevant
+  cycles.clear();
+  cycles.push_back(std::make_pair(4, 1));
+  cycles.push_back(std::make_pair(6, 4));
+  test_relevant_cycles("CC(C)C1CCC2(C)C3CC=C(C)C2C13", cycles);
+
+  // azepane ring next to a cage (not found by searching cycles of increasing size)
+  cycles.clear();
+  cycles.push_back(std::make_pair(6, 5));
+  cycles.push_back(std::make_pair(7, 1));
+  test_relevant_cycles("O=C1NC2(Nc3ccccc13)CC1(C)CCC2CC1C(=O)N1CCCCCC1", cycles);
+
 }
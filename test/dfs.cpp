@@ -0,0 +1,145 @@
+#include <Helium/algorithms/dfs.h>
+#include <Helium/algorithms/components.h>
+#include <Helium/smiles.h>
+#include <Helium/fileio/molecules.h>
+
+#include <sstream>
+
+#include "test.h"
+
+using namespace Helium;
+
+/**
+ * Record all visitor calls.
+ */
+template<typename MoleculeType>
+struct TraceVisitor : public DFSVisitor<MoleculeType>
+{
+  typedef typename molecule_traits<MoleculeType>::atom_type atom_type;
+  typedef typename molecule_traits<MoleculeType>::bond_type bond_type;
+
+  void initialize(MoleculeType &mol)
+  {
+    trace << "initialize ";
+  }
+
+  void atom(MoleculeType &mol, atom_type prev, atom_type atom)
+  {
+    trace << "atom(";
+    if (prev != molecule_traits<MoleculeType>::null_atom())
+      trace << get_index(mol, prev);
+    trace << "," << get_index(mol, atom) << ") ";
+  }
+
+  void bond(MoleculeType &mol, atom_type prev, bond_type bond)
+  {
+    trace << "bond(";
+    if (prev != molecule_traits<MoleculeType>::null_atom())
+      trace << get_index(mol, prev);
+    trace << "," << get_index(mol, bond) << ") ";
+  }
+
+  void backtrack(MoleculeType &mol, atom_type atom)
+  {
+    trace << "backtrack(" << get_index(mol, atom) << ") ";
+  }
+
+  void back_bond(MoleculeType &mol, bond_type bond)
+  {
+    trace << "back_bond(" << get_index(mol, bond) << ") ";
+  }
+
+  std::stringstream trace;
+};
+
+/**
+ * Recursive reference implementation.
+ */
+template<typename MoleculeType, typename AtomType, typename DFSVisitorType>
+void recursive_dfs_visit(MoleculeType &mol, AtomType atom, DFSVisitorType &visitor, std::vector<bool> &visited,
+    AtomType prev = molecule_traits<MoleculeType>::null_atom())
+{
+  visited[get_index(mol, atom)] = true;
+  visitor.atom(mol, prev, atom);
+
+  FOREACH_INCIDENT (bond, atom, mol, MoleculeType) {
+    AtomType nbr = get_other(mol, *bond, atom);
+
+    if (visited[get_index(mol, nbr)]) {
+      if (!visited[num_atoms(mol) + get_index(mol, *bond)])
+        visitor.back_bond(mol, *bond);
+      visited[num_atoms(mol) + get_index(mol, *bond)] = true;
+      continue;
+    }
+
+    visited[num_atoms(mol) + get_index(mol, *bond)] = true;
+    visitor.bond(mol, prev, *bond);
+
+    recursive_dfs_visit(mol, nbr, visitor, visited, atom);
+  }
+
+  visitor.backtrack(mol, atom);
+}
+
+template<typename MoleculeType, typename DFSVisitorType>
+void recursive_depth_first_search(MoleculeType &mol, DFSVisitorType &visitor)
+{
+  visitor.initialize(mol);
+
+  std::vector<bool> visited(num_atoms(mol) + num_bonds(mol));
+
+  FOREACH_ATOM (atom, mol, MoleculeType) {
+    if (!visited[get_index(mol, *atom)])
+      recursive_dfs_visit(mol, *atom, visitor, visited);
+  }
+}
+
+void test_dfs_order(const std::string &filename)
+{
+  std::cout << "Testing depth_first_search() order..." << std::endl;
+  MoleculeFile file(filename);
+
+  HeMol mol;
+  TraversalWorkspace<HeMol> workspace;
+  std::vector<unsigned int> components;
+  for (unsigned int i = 0; i < 1000; ++i) {
+    file.read_molecule(mol);
+
+    TraceVisitor<HeMol> ref, visitor;
+    recursive_depth_first_search(mol, ref);
+    depth_first_search(mol, visitor, workspace);
+    COMPARE(ref.trace.str(), visitor.trace.str());
+
+    COMPARE(connected_bond_components(mol), (connected_bond_components(mol, components, workspace), components));
+    COMPARE(connected_atom_components(mol), (connected_atom_components(mol, components, workspace), components));
+  }
+}
+
+void test_deep_chain()
+{
+  std::cout << "Testing deep chain..." << std::endl;
+  const int n = 200000;
+  HeMol mol;
+  parse_smiles("C1" + std::string(n - 1, 'C') + "1.C", mol);
+
+  TraversalWorkspace<HeMol> workspace;
+  DFSAtomOrderVisitor<HeMol> atomOrder;
+  depth_first_search(mol, atomOrder, workspace);
+  COMPARE(n + 1, atomOrder.atoms.size());
+
+  DFSClosureRecorderVisitor<HeMol> closures;
+  depth_first_search(mol, closures, workspace);
+  COMPARE(1, closures.back_bonds.size());
+
+  COMPARE(1, num_connected_components(mol, workspace));
+  std::vector<unsigned int> components;
+  COMPARE(2, connected_atom_components(mol, components, workspace));
+  COMPARE(0, components[0]);
+  COMPARE(1, components[n]);
+}
+
+int main()
+{
+  test_dfs_order(datadir() + "100K.hel");
+  test_deep_chain();
+}
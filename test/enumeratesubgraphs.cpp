@@ -3,6 +3,8 @@
 
 #include "test.h"
 
+#include <algorithm>
+
 using namespace Helium;
 
 std::ostream& operator<<(std::ostream &os, const Subgraph &subgraph)
@@ -20,7 +22,7 @@ std::ostream& operator<<(std::ostream &os, const Subgraph &subgraph)
 
 struct EnumerateSubgraphsCallback
 {
-  EnumerateSubgraphsCallback() : count(0)
+  EnumerateSubgraphsCallback(bool print_ = true) : count(0), print(print_)
   {
   }
 
@@ -28,7 +30,29 @@ struct EnumerateSubgraphsCallback
   {
     ++count;
     subgraphs.insert(std::make_pair(subgraph.atoms, subgraph.bonds));
-    std::cout << subgraph << std::endl;
+    if (print)
+      std::cout << subgraph << std::endl;
+  }
+
+  int count;
+  bool print;
+  std::set<std::pair<std::vector<bool>, std::vector<bool> > > subgraphs;
+};
+
+struct EnumerateSubgraphViewsCallback
+{
+  EnumerateSubgraphViewsCallback() : count(0)
+  {
+  }
+
+  void operator()(const SubgraphView &subgraph)
+  {
+    ++count;
+    std::vector<bool> atoms, bonds;
+    subgraph.copy(atoms, bonds);
+    COMPARE(std::count(atoms.begin(), atoms.end(), true), subgraph.numAtoms());
+    COMPARE(std::count(bonds.begin(), bonds.end(), true), subgraph.numBonds());
+    subgraphs.insert(std::make_pair(atoms, bonds));
   }
 
   int count;
@@ -79,6 +103,27 @@ void testEnumerateSubgraphs(const std::string &smiles, int size = 7, bool trees
   // make sure there are no duplicates...
   COMPARE(callback_correct.subgraphs.size(), callback_correct.count);
   COMPARE(callback_fast.subgraphs.size(), callback_fast.count);
+
+  // the bit vector based enumeration should find the same subgraphs
+  EnumerateSubgraphViewsCallback callback_views;
+  enumerate_subgraph_views(mol, callback_views, size, trees);
+  COMPARE(callback_fast.count, callback_views.count);
+  ASSERT(callback_fast.subgraphs == callback_views.subgraphs);
+}
+
+void testEnumerateSubgraphViews(const std::string &smiles, int size, bool trees)
+{
+  std::cout << "Testing views: " << smiles.size() << " characters" << std::endl;
+  HeMol mol;
+  parse_smiles(smiles, mol);
+
+  EnumerateSubgraphsCallback callback_fast(false);
+  EnumerateSubgraphViewsCallback callback_views;
+  enumerate_subgraphs(mol, callback_fast, size, trees);
+  enumerate_subgraph_views(mol, callback_views, size, trees);
+
+  COMPARE(callback_fast.count, callback_views.count);
+  ASSERT(callback_fast.subgraphs == callback_views.subgraphs);
 }
 
 int main()
@@ -102,4 +147,21 @@ int main()
   
   
   testEnumerateSubgraphs("ClC1CC1", 7, true);
+
+  // ring-rich molecules (most subgraphs are not trees)
+  testEnumerateSubgraphs("C12C3C4C1C5C2C3C45", 6, true);
+  testEnumerateSubgraphs("C1C2CC3CC1CC(C2)C3", 7, true);
+  testEnumerateSubgraphs("c1ccc2cc3ccccc3cc2c1", 6, true);
+
+  // molecules requiring more than one word per bit vector
+  std::string rings;
+  for (int i = 0; i < 15; ++i)
+    rings += "C1CC(C)C1";
+  testEnumerateSubgraphViews(rings, 5, false);
+  testEnumerateSubgraphViews(rings, 5, true);
+  testEnumerateSubgraphViews(rings + rings, 4, false);
+  testEnumerateSubgraphViews(rings + rings, 5, true);
+  // more than 256 atoms uses enumerate_subgraphs()
+  testEnumerateSubgraphViews(rings + rings + rings + rings + rings, 3, false);
+  testEnumerateSubgraphViews(rings + rings + rings + rings + rings, 4, true);
 }
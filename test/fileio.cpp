@@ -1,8 +1,12 @@
 #include "../src/fileio/molecules.h"
 #include "../src/fileio/file.h"
+#include "../src/fileio/fps.h"
+#include "../src/util/vector.h"
 
 #include "test.h"
 
+#include <sstream>
+
 using namespace Helium;
 
 void test_binary_file()
@@ -34,6 +38,41 @@ void test_binary_file()
 
 }
 
+void test_header_size()
+{
+  std::cout << "Testing BinaryOutputFile header size..." << std::endl;
+  const std::string header = "{ \"foo\": 42 }";
+  std::vector<int> data(100000);
+  for (std::size_t i = 0; i < data.size(); ++i)
+    data[i] = i;
+
+  {
+    // small stream buffer, compact header
+    BinaryOutputFile out("tmp.hel", header.size() + 1, 1000);
+    COMPARE(header.size() + 1, out.headerSize());
+    for (std::size_t i = 0; i < data.size(); ++i)
+      ASSERT(out.write(&data[i], sizeof(int)));
+    COMPARE(data.size() * sizeof(int), out.tell());
+    ASSERT(out.writeHeader(header));
+  }
+
+  BinaryInputFile in("tmp.hel");
+  ASSERT(in);
+  COMPARE(header, in.header());
+  COMPARE(0, in.tell());
+  std::vector<int> values(data.size());
+  ASSERT(in.read(&values[0], values.size() * sizeof(int)));
+  COMPARE(data, values);
+  in.stream().seekg(0, std::ios_base::end);
+  COMPARE(2 * sizeof(unsigned int) + header.size() + 1 + data.size() * sizeof(int), in.stream().tellg());
+  in.close();
+
+  // header does not fit
+  BinaryOutputFile out("tmp.hel", header.size());
+  ASSERT(!out.writeHeader(header));
+  ASSERT(out.writeHeader(header.substr(0, header.size() - 1)));
+}
+
 void test_molecule_file()
 {
   MoleculeFile molFile1(datadir() + "10K.hel");
@@ -50,8 +89,248 @@ void test_molecule_file()
 
 }
 
+void test_write_molecule()
+{
+  MoleculeFile molFile(datadir() + "10K.hel");
+
+  HeMol mol1, mol2;
+  for (unsigned int i = 0; i < 1000; ++i) {
+    std::streamoff begin = molFile.stream().tellg();
+    molFile.read_molecule(mol1);
+    std::streamoff end = molFile.stream().tellg();
+
+    // the record has the same size as the original record
+    std::ostringstream os1;
+    write_molecule(os1, mol1);
+    COMPARE(os1.str().size(), static_cast<std::size_t>(end - begin));
+
+    // reading the record back gives the same record
+    read_molecule(os1.str().data(), mol2);
+    std::ostringstream os2;
+    write_molecule(os2, mol2);
+    ASSERT(os1.str() == os2.str());
+  }
+}
+
+void test_buffered_molecule_file(std::size_t blockSize)
+{
+  std::cout << "Testing BufferedMoleculeFile (blockSize = " << blockSize << ")..." << std::endl;
+  MoleculeFile molFile1(datadir() + "10K.hel");
+  BufferedMoleculeFile molFile2(datadir() + "10K.hel", blockSize);
+  COMPARE(molFile1.numMolecules(), molFile2.numMolecules());
+
+  HeMol mol1, mol2;
+  MoleculeView view;
+  for (unsigned int i = 0; i < molFile1.numMolecules(); ++i) {
+    COMPARE(i, molFile2.current());
+    molFile1.read_molecule(mol1);
+    ASSERT(molFile2.read_molecule(mol2));
+    COMPARE(num_atoms(mol1), num_atoms(mol2));
+    COMPARE(num_bonds(mol1), num_bonds(mol2));
+    FOREACH_ATOM (atom, mol1, HeMol)
+      COMPARE(get_element(mol1, *atom), get_element(mol2, mol2.atom(get_index(mol1, *atom))));
+    FOREACH_BOND (bond, mol1, HeMol)
+      COMPARE(get_index(mol1, get_source(mol1, *bond)), get_index(mol2, get_source(mol2, mol2.bond(get_index(mol1, *bond)))));
+  }
+  ASSERT(!molFile2.read_molecule(mol2));
+
+  // read into a MoleculeView
+  BufferedMoleculeFile molFile3(datadir() + "10K.hel", blockSize);
+  MoleculeFile molFile4(datadir() + "10K.hel");
+  while (molFile3.read_molecule(view)) {
+    molFile4.read_molecule(mol1);
+    COMPARE(num_atoms(mol1), num_atoms(view));
+    COMPARE(num_bonds(mol1), num_bonds(view));
+  }
+  COMPARE(molFile3.numMolecules(), molFile3.current());
+}
+
+void test_sparse_molecule_indexes(unsigned int stride)
+{
+  std::cout << "Testing sparse molecule indexes (stride = " << stride << ")..." << std::endl;
+
+  // copy 1K.hel with a sparse index
+  {
+    BufferedMoleculeFile in(datadir() + "1K.hel");
+    BinaryOutputFile out("tmp_sparse.hel");
+    std::vector<uint64_t> positions;
+    MoleculeView view;
+    while (in.read_molecule(view)) {
+      positions.push_back(out.stream().tellp());
+      out.write(view.data(), MoleculeView::record_size(view.data()));
+    }
+    Json::Value data;
+    data["filetype"] = "molecules";
+    data["num_molecules"] = in.numMolecules();
+    impl::write_molecule_indexes(out, positions, stride, data);
+    Json::StyledWriter writer;
+    ASSERT(out.writeHeader(writer.write(data)));
+  }
+
+  MoleculeFile ref(datadir() + "1K.hel");
+  MoleculeFile file("tmp_sparse.hel");
+  MemoryMappedMoleculeFile mapped("tmp_sparse.hel");
+  BufferedMoleculeFile buffered("tmp_sparse.hel", 1000);
+  COMPARE(ref.numMolecules(), file.numMolecules());
+  COMPARE(ref.numMolecules(), mapped.numMolecules());
+  COMPARE(ref.numMolecules(), buffered.numMolecules());
+
+  // sequential
+  HeMol mol1, mol2, mol3;
+  for (unsigned int i = 0; i < ref.numMolecules(); ++i) {
+    ref.read_molecule(mol1);
+    ASSERT(buffered.read_molecule(mol2));
+    COMPARE(num_atoms(mol1), num_atoms(mol2));
+    COMPARE(num_bonds(mol1), num_bonds(mol2));
+  }
+  ASSERT(!buffered.read_molecule(mol2));
+
+  // random access
+  MoleculeView view;
+  for (unsigned int i = 0; i < ref.numMolecules(); ++i) {
+    unsigned int index = (i * 7919) % ref.numMolecules();
+    ref.read_molecule(index, mol1);
+    file.read_molecule(index, mol2);
+    mapped.read_molecule(index, view);
+    COMPARE(num_atoms(mol1), num_atoms(mol2));
+    COMPARE(num_bonds(mol1), num_bonds(mol2));
+    COMPARE(num_atoms(mol1), num_atoms(view));
+    COMPARE(num_bonds(mol1), num_bonds(view));
+    FOREACH_ATOM (atom, mol1, HeMol)
+      COMPARE(get_element(mol1, *atom), get_element(mol2, mol2.atom(get_index(mol1, *atom))));
+    FOREACH_BOND (bond, mol1, HeMol)
+      COMPARE(get_index(mol1, get_target(mol1, *bond)), get_index(view, get_target(view, view.bond(get_index(mol1, *bond)))));
+  }
+}
+
+void test_compressed_molecule_file(unsigned int blockMolecules, unsigned int indexStride)
+{
+  std::cout << "Testing compressed molecule files (blockMolecules = " << blockMolecules
+            << ", indexStride = " << indexStride << ")..." << std::endl;
+  compress_molecule_file(datadir() + "1K.hel", "tmp_compressed.hel", blockMolecules, indexStride);
+
+  MoleculeFile ref(datadir() + "1K.hel");
+  MoleculeFile file("tmp_compressed.hel");
+  MemoryMappedMoleculeFile mapped("tmp_compressed.hel");
+  BufferedMoleculeFile buffered("tmp_compressed.hel");
+  ASSERT(!ref.isCompressed());
+  ASSERT(file.isCompressed());
+  ASSERT(mapped.isCompressed());
+  COMPARE(ref.numMolecules(), file.numMolecules());
+  COMPARE(ref.numMolecules(), mapped.numMolecules());
+  COMPARE(ref.numMolecules(), buffered.numMolecules());
+
+  // sequential
+  HeMol mol1, mol2, mol3, mol4;
+  for (unsigned int i = 0; i < ref.numMolecules(); ++i) {
+    ref.read_molecule(mol1);
+    ASSERT(file.read_molecule(mol2));
+    ASSERT(buffered.read_molecule(mol3));
+    mapped.read_molecule(i, mol4);
+    COMPARE(num_atoms(mol1), num_atoms(mol2));
+    COMPARE(num_bonds(mol1), num_bonds(mol2));
+    COMPARE(num_atoms(mol1), num_atoms(mol3));
+    COMPARE(num_bonds(mol1), num_bonds(mol3));
+    COMPARE(num_atoms(mol1), num_atoms(mol4));
+    COMPARE(num_bonds(mol1), num_bonds(mol4));
+    FOREACH_ATOM (atom, mol1, HeMol)
+      COMPARE(get_element(mol1, *atom), get_element(mol2, mol2.atom(get_index(mol1, *atom))));
+  }
+  ASSERT(!file.read_molecule(mol2));
+  ASSERT(!buffered.read_molecule(mol3));
+
+  // random access with a small cache
+  file.setBlockCacheSize(2);
+  mapped.setBlockCacheSize(2);
+  MoleculeView view;
+  for (unsigned int i = 0; i < ref.numMolecules(); ++i) {
+    unsigned int index = (i * 7919) % ref.numMolecules();
+    ref.read_molecule(index, mol1);
+    file.read_molecule(index, mol2);
+    mapped.read_molecule(index, view);
+    COMPARE(num_atoms(mol1), num_atoms(mol2));
+    COMPARE(num_bonds(mol1), num_bonds(mol2));
+    COMPARE(num_atoms(mol1), num_atoms(view));
+    COMPARE(num_bonds(mol1), num_bonds(view));
+    FOREACH_BOND (bond, mol1, HeMol)
+      COMPARE(get_index(mol1, get_target(mol1, *bond)), get_index(view, get_target(view, view.bond(get_index(mol1, *bond)))));
+  }
+}
+
+void test_fps_reader(std::size_t bufferSize)
+{
+  std::cout << "Testing FpsReader(buffer = " << bufferSize << ")..." << std::endl;
+  const unsigned int numBits = 128, numWords = 2, numFingerprints = 500;
+
+  // write an FPS file (with identifiers, empty and CRLF lines)
+  std::vector<Word> fingerprints(numFingerprints * numWords);
+  std::srand(42);
+  for (std::size_t i = 0; i < fingerprints.size(); ++i)
+    fingerprints[i] = (static_cast<Word>(std::rand()) << 32) ^ std::rand();
+  {
+    std::ofstream ofs("tmp.fps");
+    ofs << "#FPS1\n#num_bits=" << numBits << "\n#type=Test/1\n";
+    for (unsigned int i = 0; i < numFingerprints; ++i) {
+      ofs << bitvec_to_hex(&fingerprints[i * numWords], numWords);
+      if (i % 3 == 0)
+        ofs << "\tmol" << i << "\n";
+      else if (i % 3 == 1)
+        ofs << "\r\n\n";
+      else if (i + 1 < numFingerprints)
+        ofs << "\n"; // no newline at the end of the file
+    }
+  }
+
+  FpsReader reader("tmp.fps", bufferSize);
+  COMPARE(numBits, reader.numBits());
+  COMPARE("Test/1", reader.type());
+  std::vector<Word> chunk(7 * numWords);
+  unsigned int count = 0;
+  while (unsigned int n = reader.read(&chunk[0], 7)) {
+    for (unsigned int i = 0; i < n; ++i, ++count)
+      for (unsigned int j = 0; j < numWords; ++j)
+        COMPARE(fingerprints[count * numWords + j], chunk[i * numWords + j]);
+  }
+  COMPARE(numFingerprints, count);
+
+  FpsFile file;
+  ASSERT(file.load("tmp.fps"));
+  COMPARE(numFingerprints, file.numFingerprints());
+  COMPARE(fingerprints[(numFingerprints - 1) * numWords], file.fingerprint(numFingerprints - 1)[0]);
+
+  // invalid hexadecimal digit
+  {
+    std::ofstream ofs("tmp.fps");
+    ofs << "#num_bits=64\n0123456789abcdef\n0123456789abcdeg\n";
+  }
+  FpsReader invalid("tmp.fps", bufferSize);
+  bool thrown = false;
+  try {
+    invalid.read(&chunk[0], 7);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  ASSERT(thrown);
+  ASSERT(!file.load("tmp.fps"));
+}
+
 int main()
 {
   test_binary_file();
+  test_header_size();
   test_molecule_file();
+  test_write_molecule();
+  test_buffered_molecule_file(4 << 20);
+  test_buffered_molecule_file(1000);
+  test_buffered_molecule_file(1);
+  test_sparse_molecule_indexes(1);
+  test_sparse_molecule_indexes(16);
+  test_sparse_molecule_indexes(999);
+  test_fps_reader(1 << 20);
+  test_fps_reader(1);
+#ifdef HAVE_ZLIB
+  test_compressed_molecule_file(256, 1);
+  test_compressed_molecule_file(7, 1);
+  test_compressed_molecule_file(256, 64);
+#endif
 }
@@ -1,5 +1,6 @@
 #include "../src/fingerprints/fingerprints.h"
 #include "../src/smiles.h"
+#include "../src/fileio/molecules.h"
 
 #include "test.h"
 
@@ -21,6 +22,10 @@ void test_path_fingerprint(const std::string &substructure, const std::string &s
   //print(superFp, 16);
 
   ASSERT(bitvec_is_subset_superset(subFp, superFp, 16));
+
+  rolling_path_fingerprint(sub, subFp);
+  rolling_path_fingerprint(super, superFp);
+  ASSERT(bitvec_is_subset_superset(subFp, superFp, 16));
 }
 
 void test_tree_fingerprint(const std::string &substructure, const std::string &superstructure)
@@ -53,8 +58,151 @@ void test_fingerprint(const std::string &substructure, const std::string &supers
 }
 
 
+void test_fragment_cache(const std::string &filename)
+{
+  std::cout << "Testing FragmentCache..." << std::endl;
+  MoleculeFile file(filename);
+  // a small cache to test eviction
+  FragmentCache cache(500);
+
+  HeMol mol;
+  Word fp1[16], fp2[16];
+  for (unsigned int i = 0; i < 200; ++i) {
+    file.read_molecule(mol);
+
+    path_fingerprint(mol, fp1);
+    path_fingerprint(mol, fp2, 7, 16, 1021, &cache);
+    ASSERT(std::equal(fp1, fp1 + 16, fp2));
+
+    tree_fingerprint(mol, fp1, 5);
+    tree_fingerprint(mol, fp2, 5, 16, 1021, &cache);
+    ASSERT(std::equal(fp1, fp1 + 16, fp2));
+
+    subgraph_fingerprint(mol, fp1, 4);
+    subgraph_fingerprint(mol, fp2, 4, 16, 1021, &cache);
+    ASSERT(std::equal(fp1, fp1 + 16, fp2));
+  }
+  ASSERT(cache.hits() > cache.misses());
+
+  // the same fingerprints using an arena for the temporary buffers
+  Arena arena;
+  for (unsigned int i = 0; i < 200; ++i) {
+    file.read_molecule(i, mol);
+    arena.reset();
+
+    path_fingerprint(mol, fp1);
+    path_fingerprint(mol, fp2, 7, 16, 1021, 0, &arena);
+    ASSERT(std::equal(fp1, fp1 + 16, fp2));
+
+    tree_fingerprint(mol, fp1, 5);
+    tree_fingerprint(mol, fp2, 5, 16, 1021, &cache, &arena);
+    ASSERT(std::equal(fp1, fp1 + 16, fp2));
+
+    subgraph_fingerprint(mol, fp1, 4);
+    subgraph_fingerprint(mol, fp2, 4, 16, 1021, 0, &arena);
+    ASSERT(std::equal(fp1, fp1 + 16, fp2));
+    COMPARE(0, arena.used());
+  }
+
+  // paths are the same in both directions
+  HeMol mol1, mol2;
+  parse_smiles("CCO", mol1);
+  parse_smiles("OCC", mol2);
+  cache.clear();
+  path_fingerprint(mol1, fp1, 7, 16, 1021, &cache);
+  std::size_t misses = cache.misses();
+  path_fingerprint(mol2, fp2, 7, 16, 1021, &cache);
+  COMPARE(misses, cache.misses());
+  ASSERT(std::equal(fp1, fp1 + 16, fp2));
+}
+
+void test_rolling_path_fingerprint(const std::string &filename)
+{
+  std::cout << "Testing rolling_path_fingerprint..." << std::endl;
+
+  // paths are the same in both directions
+  HeMol mol1, mol2;
+  Word fp1[16], fp2[16];
+  parse_smiles("CCOCN", mol1);
+  parse_smiles("NCOCC", mol2);
+  rolling_path_fingerprint(mol1, fp1);
+  rolling_path_fingerprint(mol2, fp2);
+  ASSERT(std::equal(fp1, fp1 + 16, fp2));
+  // 12 unique paths: C, O, N, CC, CO, CN, CCO, COC, OCN, CCOC, COCN, CCOCN
+  ASSERT(bitvec_count(fp1, 16) <= 12);
+  ASSERT(bitvec_count(fp1, 16) >= 10);
+
+  // different paths, same elements
+  parse_smiles("CCON", mol2);
+  rolling_path_fingerprint(mol2, fp2);
+  ASSERT(!std::equal(fp1, fp1 + 16, fp2));
+
+  // the molecule is a superstructure of each path
+  MoleculeFile file(filename);
+  HeMol mol;
+  for (unsigned int i = 0; i < 100; ++i) {
+    file.read_molecule(mol);
+    rolling_path_fingerprint(mol, fp1, 5);
+
+    std::vector<std::vector<unsigned int> > paths = enumerate_paths(mol, 5);
+    for (std::size_t j = 0; j < paths.size(); ++j) {
+      std::vector<bool> atoms(num_atoms(mol)), bonds(num_bonds(mol));
+      for (std::size_t k = 0; k < paths[j].size(); ++k) {
+        atoms[paths[j][k]] = true;
+        if (k + 1 < paths[j].size())
+          bonds[get_index(mol, get_bond(mol, get_atom(mol, paths[j][k]), get_atom(mol, paths[j][k + 1])))] = true;
+      }
+      Substructure<HeMol> path(mol, atoms, bonds);
+      rolling_path_fingerprint(path, fp2, 5);
+      ASSERT(bitvec_is_subset_superset(fp2, fp1, 16));
+    }
+  }
+}
+
+void test_circular_fingerprint()
+{
+  std::cout << "Testing circular_fingerprint..." << std::endl;
+  HeMol mol1, mol2;
+  Word fp1[16], fp2[16];
+
+  // independent of the atom order
+  parse_smiles("c1ccccc1CO", mol1);
+  parse_smiles("OCc1ccccc1", mol2);
+  circular_fingerprint(mol1, fp1);
+  circular_fingerprint(mol2, fp2);
+  ASSERT(std::equal(fp1, fp1 + 16, fp2));
+
+  // all benzene atoms have the same environments
+  parse_smiles("c1ccccc1", mol1);
+  circular_fingerprint(mol1, fp1, 0);
+  COMPARE(1, bitvec_count(fp1, 16));
+  circular_fingerprint(mol1, fp1, 2);
+  ASSERT(bitvec_count(fp1, 16) <= 3);
+  ASSERT(bitvec_count(fp1, 16) >= 2);
+
+  // larger radius, more environments
+  parse_smiles("CCCCCCO", mol2);
+  circular_fingerprint(mol2, fp1, 1);
+  circular_fingerprint(mol2, fp2, 3);
+  ASSERT(bitvec_count(fp1, 16) < bitvec_count(fp2, 16));
+  ASSERT(bitvec_is_subset_superset(fp1, fp2, 16));
+
+  // same atoms, different environments
+  parse_smiles("CC(C)C", mol1);
+  parse_smiles("CCCC", mol2);
+  circular_fingerprint(mol1, fp1, 1);
+  circular_fingerprint(mol2, fp2, 1);
+  ASSERT(!std::equal(fp1, fp1 + 16, fp2));
+}
+
 int main()
 {
+  test_circular_fingerprint();
+
+  test_rolling_path_fingerprint(datadir() + "1K.hel");
+
+  test_fragment_cache(datadir() + "1K.hel");
+
   test_fingerprint("C", "CC");
   test_fingerprint("CC", "CC(C)C");
   test_fingerprint("CCC", "CC(C)C");
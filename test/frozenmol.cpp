@@ -0,0 +1,179 @@
+#include <Helium/frozenmol.h>
+#include <Helium/hemol.h>
+#include <Helium/smiles.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/algorithms/isomorphism.h>
+#include <Helium/algorithms/enumeratesubgraphs.h>
+#include <Helium/algorithms/canonical.h>
+#include <Helium/algorithms/extendedconnectivities.h>
+#include <Helium/algorithms/components.h>
+#include <Helium/fingerprints/fingerprints.h>
+
+#include "test.h"
+
+using namespace Helium;
+
+struct SubgraphCounter
+{
+  SubgraphCounter() : count(0)
+  {
+  }
+
+  void operator()(const Subgraph &subgraph)
+  {
+    ++count;
+  }
+
+  int count;
+};
+
+void compare_molecules(HeMol &mol, const FrozenMol &frozen)
+{
+  COMPARE(num_atoms(mol), num_atoms(frozen));
+  COMPARE(num_bonds(mol), num_bonds(frozen));
+
+  FOREACH_ATOM (atom, mol, HeMol) {
+    FrozenAtom frozenAtom = get_atom(frozen, get_index(mol, *atom));
+    COMPARE(get_index(mol, *atom), get_index(frozen, frozenAtom));
+    COMPARE(get_element(mol, *atom), get_element(frozen, frozenAtom));
+    COMPARE(get_mass(mol, *atom), get_mass(frozen, frozenAtom));
+    COMPARE(num_hydrogens(mol, *atom), num_hydrogens(frozen, frozenAtom));
+    COMPARE(get_charge(mol, *atom), get_charge(frozen, frozenAtom));
+    COMPARE(get_degree(mol, *atom), get_degree(frozen, frozenAtom));
+    COMPARE(is_aromatic(mol, *atom), is_aromatic(frozen, frozenAtom));
+    COMPARE(is_cyclic(mol, *atom), is_cyclic(frozen, frozenAtom));
+
+    // incident bonds and neighbors in the same order
+    std::vector<Index> bonds, frozenBonds, nbrs, frozenNbrs;
+    FOREACH_INCIDENT (bond, *atom, mol, HeMol)
+      bonds.push_back(get_index(mol, *bond));
+    FOREACH_INCIDENT (frozenBond, frozenAtom, frozen, FrozenMol)
+      frozenBonds.push_back(get_index(frozen, *frozenBond));
+    FOREACH_NBR (nbr, *atom, mol, HeMol)
+      nbrs.push_back(get_index(mol, *nbr));
+    FOREACH_NBR (frozenNbr, frozenAtom, frozen, FrozenMol)
+      frozenNbrs.push_back(get_index(frozen, *frozenNbr));
+    COMPARE(bonds, frozenBonds);
+    COMPARE(nbrs, frozenNbrs);
+  }
+
+  FOREACH_BOND (bond, mol, HeMol) {
+    FrozenBond frozenBond = get_bond(frozen, get_index(mol, *bond));
+    COMPARE(get_index(mol, get_source(mol, *bond)), get_index(frozen, get_source(frozen, frozenBond)));
+    COMPARE(get_index(mol, get_target(mol, *bond)), get_index(frozen, get_target(frozen, frozenBond)));
+    COMPARE(get_order(mol, *bond), get_order(frozen, frozenBond));
+    COMPARE(is_aromatic(mol, *bond), is_aromatic(frozen, frozenBond));
+    COMPARE(is_cyclic(mol, *bond), is_cyclic(frozen, frozenBond));
+
+    FrozenAtom source = get_source(frozen, frozenBond);
+    FrozenAtom target = get_target(frozen, frozenBond);
+    COMPARE(frozenBond, get_bond(frozen, source, target));
+    COMPARE(frozenBond, get_bond(frozen, target, source));
+    COMPARE(target, get_other(frozen, frozenBond, source));
+    COMPARE(source, get_other(frozen, frozenBond, target));
+  }
+}
+
+void test_attributes()
+{
+  HeMol mol;
+  parse_smiles("[13CH3]C(=O)[O-].c1ccccc1", mol);
+  FrozenMol frozen(mol);
+  compare_molecules(mol, frozen);
+
+  COMPARE(6, num_atoms(frozen) - 4);
+  COMPARE(13, get_mass(frozen, get_atom(frozen, 0)));
+  COMPARE(-1, get_charge(frozen, get_atom(frozen, 3)));
+  COMPARE(FrozenMol::null_bond(), get_bond(frozen, get_atom(frozen, 0), get_atom(frozen, 4)));
+
+  // empty molecule
+  FrozenMol empty;
+  COMPARE(0, num_atoms(empty));
+  COMPARE(0, num_bonds(empty));
+}
+
+void test_file(const std::string &filename)
+{
+  MoleculeFile file(filename);
+
+  HeMol benzene, amide;
+  parse_smiles("c1ccccc1", benzene);
+  parse_smiles("NC=O", amide);
+
+  HeMol mol;
+  FrozenMol frozen;
+  for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+    file.read_molecule(mol);
+    frozen.assign(mol);
+    compare_molecules(mol, frozen);
+
+    // isomorphism
+    CountMapping count, frozenCount;
+    isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher>(mol, benzene, count);
+    isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher>(frozen, benzene, frozenCount);
+    COMPARE(count.count, frozenCount.count);
+    CountMapping count2, frozenCount2;
+    isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher>(mol, amide, count2);
+    isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher>(frozen, amide, frozenCount2);
+    COMPARE(count2.count, frozenCount2.count);
+
+    // fingerprints
+    Word fp[16], frozenFp[16];
+    path_fingerprint(mol, fp);
+    path_fingerprint(frozen, frozenFp);
+    COMPARE(std::vector<Word>(fp, fp + 16), std::vector<Word>(frozenFp, frozenFp + 16));
+
+    if (i % 10)
+      continue;
+
+    // subgraphs
+    SubgraphCounter subgraphs, frozenSubgraphs;
+    enumerate_subgraphs(mol, subgraphs, 5);
+    enumerate_subgraphs(frozen, frozenSubgraphs, 5);
+    COMPARE(subgraphs.count, frozenSubgraphs.count);
+
+    // canonicalization
+    if (unique_elements(connected_bond_components(mol)) > 1)
+      continue;
+    COMPARE(extended_connectivities(mol), extended_connectivities(frozen));
+    COMPARE(canonicalize(mol, extended_connectivities(mol)),
+            canonicalize(frozen, extended_connectivities(frozen)));
+  }
+}
+
+void test_fragments(const std::string &filename)
+{
+  std::cout << "Testing fragments..." << std::endl;
+  MoleculeFile file(filename);
+
+  HeMol mol;
+  FrozenMol fragment;
+  for (unsigned int i = 0; i < file.numMolecules(); i += 10) {
+    file.read_molecule(i, mol);
+
+    std::vector<std::vector<unsigned int> > paths = enumerate_paths(mol, 5);
+    for (std::size_t j = 0; j < paths.size(); ++j) {
+      std::vector<bool> atoms(num_atoms(mol)), bonds(num_bonds(mol));
+      for (std::size_t k = 0; k < paths[j].size(); ++k) {
+        atoms[paths[j][k]] = true;
+        if (k)
+          bonds[get_index(mol, get_bond(mol, get_atom(mol, paths[j][k - 1]), get_atom(mol, paths[j][k])))] = true;
+      }
+
+      Substructure<HeMol> substruct(mol, atoms, bonds);
+      fragment.assign(mol, atoms, bonds);
+      COMPARE(num_atoms(substruct), num_atoms(fragment));
+      COMPARE(num_bonds(substruct), num_bonds(fragment));
+      COMPARE(extended_connectivities(substruct), extended_connectivities(fragment));
+      COMPARE(canonicalize(substruct, extended_connectivities(substruct)),
+              canonicalize(fragment, extended_connectivities(fragment)));
+    }
+  }
+}
+
+int main()
+{
+  test_attributes();
+  test_file(datadir() + "1K.hel");
+  test_fragments(datadir() + "1K.hel");
+}
@@ -0,0 +1,129 @@
+#include <Helium/fingerprints/hashindex.h>
+#include <Helium/fileio/fingerprints.h>
+
+#include "test.h"
+#include "../src/util/vector.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+using namespace Helium;
+
+const unsigned int numBits = 166;
+const unsigned int numWords = 3;
+const unsigned int numFingerprints = 3000;
+
+std::vector<unsigned int> naive_lookup(const std::vector<Word> &fingerprints, const Word *query)
+{
+  std::vector<unsigned int> result;
+  for (unsigned int i = 0; i < numFingerprints; ++i)
+    if (bitvec_equal(query, &fingerprints[i * numWords], numWords))
+      result.push_back(i);
+  return result;
+}
+
+std::vector<std::vector<unsigned int> > naive_duplicates(const std::vector<Word> &fingerprints)
+{
+  std::vector<std::vector<unsigned int> > groups;
+  std::vector<bool> visited(numFingerprints);
+  for (unsigned int i = 0; i < numFingerprints; ++i) {
+    if (visited[i])
+      continue;
+    std::vector<unsigned int> group = naive_lookup(fingerprints, &fingerprints[i * numWords]);
+    for (std::size_t j = 0; j < group.size(); ++j)
+      visited[group[j]] = true;
+    if (group.size() > 1)
+      groups.push_back(group);
+  }
+  return groups;
+}
+
+template<typename IndexType>
+void check_index(const IndexType &index, const std::vector<Word> &fingerprints)
+{
+  std::vector<std::vector<unsigned int> > expected = naive_duplicates(fingerprints);
+  COMPARE(expected, index.duplicates());
+
+  unsigned int numDuplicates = 0;
+  for (std::size_t i = 0; i < expected.size(); ++i)
+    numDuplicates += expected[i].size() - 1;
+  COMPARE(numFingerprints - numDuplicates, index.numDistinct());
+
+  for (unsigned int i = 0; i < numFingerprints; i += 7) {
+    const Word *query = &fingerprints[i * numWords];
+    std::vector<unsigned int> lookup = naive_lookup(fingerprints, query);
+    COMPARE(lookup, index.lookup(query));
+    COMPARE(lookup[0], index.find(query));
+    for (std::size_t j = 0; j < lookup.size(); ++j)
+      COMPARE(j + 1 < lookup.size() ? lookup[j + 1] : IndexType::NotFound, index.next(lookup[j]));
+  }
+
+  // a fingerprint that is not in the storage
+  std::vector<Word> query(numWords, ~Word(0));
+  query[numWords - 1] = 1;
+  COMPARE(IndexType::NotFound, index.find(&query[0]));
+  ASSERT(index.lookup(&query[0]).empty());
+}
+
+void test_in_memory(const std::vector<Word> &fingerprints)
+{
+  std::cout << "Testing FingerprintHashIndex (in memory)..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_hashindex.fps.hel");
+  FingerprintHashIndex<InMemoryRowMajorFingerprintStorage> index(storage);
+  check_index(index, fingerprints);
+}
+
+void test_save_load(const std::vector<Word> &fingerprints)
+{
+  std::cout << "Testing FingerprintHashIndex::save()..." << std::endl;
+  MemoryMappedRowMajorFingerprintStorage storage("tmp_hashindex.fps.hel");
+  {
+    FingerprintHashIndex<MemoryMappedRowMajorFingerprintStorage> index(storage);
+    check_index(index, fingerprints);
+    index.save("tmp_hashindex.hash");
+  }
+
+  FingerprintHashIndex<MemoryMappedRowMajorFingerprintStorage> index(storage, "tmp_hashindex.hash");
+  check_index(index, fingerprints);
+
+  // the file must match the fingerprint storage
+  MemoryMappedRowMajorFingerprintStorage other("tmp_hashindex_small.fps.hel");
+  bool thrown = false;
+  try {
+    FingerprintHashIndex<MemoryMappedRowMajorFingerprintStorage> wrong(other, "tmp_hashindex.hash");
+  } catch (const std::runtime_error &e) {
+    thrown = true;
+  }
+  ASSERT(thrown);
+}
+
+void test_empty()
+{
+  std::cout << "Testing FingerprintHashIndex (empty storage)..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_hashindex_empty.fps.hel");
+  FingerprintHashIndex<InMemoryRowMajorFingerprintStorage> index(storage);
+  COMPARE(0, index.numDistinct());
+  ASSERT(index.duplicates().empty());
+  std::vector<Word> query(numWords, 0);
+  COMPARE(FingerprintHashIndex<InMemoryRowMajorFingerprintStorage>::NotFound, index.find(&query[0]));
+}
+
+int main()
+{
+  // every 10th fingerprint has 2 exact duplicates
+  FingerprintFixture fixture(numBits, 11);
+  fixture.maxBitsSet = 40;
+  fixture.duplicateStride = 10;
+  fixture.groupSize = 3;
+  fixture.nearDuplicates = false;
+  std::vector<Word> fingerprints = fixture.random(numFingerprints);
+  fixture.write("tmp_hashindex.fps.hel", fingerprints, 0, numFingerprints);
+  fixture.write("tmp_hashindex_small.fps.hel", fingerprints, 0, 10);
+  fixture.write("tmp_hashindex_empty.fps.hel", fingerprints, 0, 0);
+
+  test_in_memory(fingerprints);
+  test_save_load(fingerprints);
+  test_empty();
+}
@@ -0,0 +1,156 @@
+#include <Helium/instrumentation.h>
+#include <Helium/fingerprints/similarity.h>
+#include <Helium/fingerprints/screen.h>
+#include <Helium/fileio/fingerprints.h>
+#include <Helium/algorithms/isomorphism.h>
+#include <Helium/hemol.h>
+#include <Helium/smiles.h>
+
+#include "test.h"
+
+#include <cstdlib>
+
+using namespace Helium;
+
+const unsigned int numBits = 256;
+const unsigned int numWords = numBits / BitsPerWord;
+const unsigned int numFingerprints = 3001;
+
+void write_fingerprint_files()
+{
+  std::srand(7);
+  std::vector<Word> fp(numWords);
+  RowMajorFingerprintOutputFile rowMajor("tmp_instrumentation_rows.fps.hel", numBits);
+  ColumnMajorFingerprintOutputFile columnMajor("tmp_instrumentation_columns.fps.hel", numBits, numFingerprints);
+  for (unsigned int i = 0; i < numFingerprints; ++i) {
+    bitvec_zero(&fp[0], numWords);
+    int numSet = 10 + std::rand() % 60;
+    for (int j = 0; j < numSet; ++j)
+      bitvec_set(std::rand() % numBits, &fp[0]);
+    rowMajor.writeFingerprint(&fp[0]);
+    columnMajor.writeFingerprint(&fp[0]);
+  }
+  std::string header = make_string("{ \"filetype\": \"fingerprints\", \"num_bits\": ", numBits,
+      ", \"num_fingerprints\": ", numFingerprints, ", \"order\": ");
+  rowMajor.writeHeader(header + "\"row-major\" }");
+  columnMajor.writeHeader(header + "\"column-major\" }");
+}
+
+unsigned long long counter(const Profile &profile, ProfileCounter c)
+{
+  return profile.counters[c];
+}
+
+/**
+ * The expected value for a counter, all counters are 0 without instrumentation.
+ */
+unsigned long long expected(unsigned long long value)
+{
+  return instrumentation_enabled() ? value : 0;
+}
+
+void test_profile()
+{
+  std::cout << "Testing Profile..." << std::endl;
+  Profile a, b;
+  a.counters[LeavesScanned] = 5;
+  a.phases["SimilaritySearchIndex::search():"].calls = 2;
+  a.phases["SimilaritySearchIndex::search():"].nanoseconds = 3000000;
+  b.counters[LeavesScanned] = 2;
+  b.phases["SimilaritySearchIndex::search():"].calls = 2;
+  b.phases["SimilaritySearchIndex::search():"].nanoseconds = 1000000;
+
+  Profile sum = a;
+  sum += b;
+  COMPARE(7, sum.counters[LeavesScanned]);
+  COMPARE(4, sum.phases["SimilaritySearchIndex::search():"].calls);
+
+  // phases without calls are removed
+  a -= b;
+  COMPARE(3, a.counters[LeavesScanned]);
+  COMPARE(0, a.phases.size());
+
+  Json::Value data = sum.json();
+  COMPARE(7, data["counters"]["leaves_scanned"].asUInt());
+  COMPARE(0, data["counters"]["tanimotos_computed"].asUInt());
+  ASSERT(data["phases"].isMember("SimilaritySearchIndex::search"));
+  COMPARE(4, data["phases"]["SimilaritySearchIndex::search"]["calls"].asUInt());
+  COMPARE(4.0, data["phases"]["SimilaritySearchIndex::search"]["ms"].asDouble());
+}
+
+void test_similarity_counters()
+{
+  std::cout << "Testing similarity search counters..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_instrumentation_rows.fps.hel");
+  const Word *query = storage.fingerprint(17);
+
+  {
+    ProfileScope scope;
+    brute_force_similarity_search(query, storage, 0.5);
+    Profile profile = scope.profile();
+    COMPARE(expected(numFingerprints), counter(profile, TanimotosComputed));
+    COMPARE(expected(0), counter(profile, LeavesScanned));
+    COMPARE(instrumentation_enabled(), profile.json()["phases"].isMember("brute_force_fimilarity_search"));
+  }
+
+#ifdef HAVE_CPP11
+  {
+    // the counters of the pool threads are included
+    ThreadPool pool(3);
+    ProfileScope scope;
+    brute_force_similarity_search_threaded(query, storage, 0.5, pool);
+    COMPARE(expected(numFingerprints), counter(scope.profile(), TanimotosComputed));
+  }
+#endif
+
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, 3);
+  for (int frozen = 0; frozen < 2; ++frozen) {
+    if (frozen)
+      index.freeze();
+    unsigned int numScored = index.numScored(query, 0.6);
+    ProfileScope scope;
+    index.search(query, 0.6);
+    Profile profile = scope.profile();
+    COMPARE(expected(numScored), counter(profile, TanimotosComputed));
+    ASSERT(!instrumentation_enabled() || counter(profile, LeavesScanned) > 0);
+    ASSERT(!instrumentation_enabled() || counter(profile, KdGridNodesVisited) > 0);
+    COMPARE(instrumentation_enabled(), profile.json()["phases"].isMember("SimilaritySearchIndex::search"));
+  }
+}
+
+void test_substructure_counters()
+{
+  std::cout << "Testing substructure search counters..." << std::endl;
+  InMemoryColumnMajorFingerprintStorage storage;
+  storage.load("tmp_instrumentation_columns.fps.hel");
+
+  std::vector<Word> query(numWords), candidates(numWords * numFingerprints);
+  bitvec_set(3, &query[0]);
+  {
+    ProfileScope scope;
+    substructure_screen(storage, &query[0], &candidates[0]);
+    COMPARE(expected(numFingerprints), counter(scope.profile(), FingerprintsScreened));
+  }
+
+  HeMol mol, pattern;
+  parse_smiles("c1ccccc1CCCO", mol);
+  parse_smiles("CCO", pattern);
+  IsomorphismQuery<HeMol> compiled(pattern);
+  IsomorphismMatcher<DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol> matcher(compiled);
+  {
+    ProfileScope scope;
+    ASSERT(matcher.match(mol));
+    Profile profile = scope.profile();
+    COMPARE(expected(1), counter(profile, CandidatesVerified));
+    ASSERT(!instrumentation_enabled() || counter(profile, IsomorphismBacktracks) > 0);
+  }
+}
+
+int main()
+{
+  write_fingerprint_files();
+  test_profile();
+  test_similarity_counters();
+  test_substructure_counters();
+}
@@ -1,6 +1,9 @@
 #include <Helium/algorithms/isomorphism.h>
+#include <Helium/fileio/molecules.h>
 #include <Helium/smiles.h>
 
+#include <set>
+
 #include "test.h"
 
 using namespace Helium;
@@ -13,10 +16,155 @@ void test_isomorphisms(const std::string &smiles)
   isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol>(mol, mol);
 }
 
+void test_count(const std::string &smiles, const std::string &querySmiles, int expected)
+{
+  std::cout << "Testing: " << querySmiles << " in " << smiles << std::endl;
+  HeMol mol, query;
+  parse_smiles(smiles, mol);
+  parse_smiles(querySmiles, query);
+
+  CountMapping count;
+  isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol>(mol, query, count);
+  COMPARE(expected, count.count);
+
+  MappingList mappings;
+  isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol>(mol, query, mappings);
+  COMPARE(expected, mappings.maps.size());
+  for (std::size_t i = 0; i < mappings.maps.size(); ++i) {
+    COMPARE(num_atoms(query), mappings.maps[i].size());
+    for (std::size_t j = 0; j < mappings.maps[i].size(); ++j)
+      COMPARE(get_element(query, get_atom(query, j)), get_element(mol, get_atom(mol, mappings.maps[i][j])));
+  }
+
+  CountMapping domainCount;
+  isomorphism_search<DomainIsomorphismMatcher, DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol>(mol, query, domainCount);
+  COMPARE(expected, domainCount.count);
+}
+
+/**
+ * Get the sorted atom sets of the mappings.
+ */
+std::vector<IsomorphismMapping> mapping_keys(const IsomorphismMappings &maps)
+{
+  std::vector<IsomorphismMapping> keys;
+  for (std::size_t i = 0; i < maps.size(); ++i) {
+    keys.push_back(maps[i]);
+    std::sort(keys.back().begin(), keys.back().end());
+  }
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
+
+/**
+ * Check if a mapping is a valid subgraph isomorphism.
+ */
+bool valid_mapping(HeMol &mol, HeMol &query, const IsomorphismMapping &map)
+{
+  if (map.size() != num_atoms(query))
+    return false;
+  if (std::set<Index>(map.begin(), map.end()).size() != map.size())
+    return false;
+  FOREACH_ATOM (atom, query, HeMol)
+    if (get_element(query, *atom) != get_element(mol, get_atom(mol, map[get_index(query, *atom)])))
+      return false;
+  FOREACH_BOND (bond, query, HeMol) {
+    HeBond other = get_bond(mol, get_atom(mol, map[get_index(query, get_source(query, *bond))]),
+        get_atom(mol, map[get_index(query, get_target(query, *bond))]));
+    if (other == molecule_traits<HeMol>::null_bond() || get_order(mol, other) != get_order(query, *bond))
+      return false;
+  }
+  return true;
+}
+
+void test_domain_matcher(const std::string &filename, const std::string &querySmiles)
+{
+  std::cout << "Testing DomainIsomorphismMatcher: " << querySmiles << std::endl;
+  MemoryMappedMoleculeFile file(filename);
+  HeMol query;
+  parse_smiles(querySmiles, query);
+
+  IsomorphismQuery<HeMol> compiled(query);
+  IsomorphismMatcher<DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol> matcher(compiled);
+  DomainIsomorphismMatcher<DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol> domainMatcher(compiled);
+
+  HeMol mol;
+  int hits = 0;
+  for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+    file.read_molecule(i, mol);
+
+    MappingList expected, mappings;
+    matcher.match(mol, expected);
+    domainMatcher.match(mol, mappings);
+    COMPARE(expected.maps.size(), mappings.maps.size());
+    ASSERT(mapping_keys(expected.maps) == mapping_keys(mappings.maps));
+    for (std::size_t j = 0; j < mappings.maps.size(); ++j)
+      ASSERT(valid_mapping(mol, query, mappings.maps[j]));
+
+    SingleMapping single;
+    COMPARE(!expected.maps.empty(), domainMatcher.match(mol, single));
+    if (!expected.maps.empty())
+      ASSERT(valid_mapping(mol, query, single.map));
+    COMPARE(!expected.maps.empty(), domainMatcher.match(mol));
+    if (!expected.maps.empty())
+      ++hits;
+  }
+  std::cout << "    hits: " << hits << std::endl;
+}
+
+void test_matcher(const std::string &filename, const std::string &querySmiles)
+{
+  std::cout << "Testing IsomorphismMatcher: " << querySmiles << std::endl;
+  MemoryMappedMoleculeFile file(filename);
+  HeMol query;
+  parse_smiles(querySmiles, query);
+
+  // the same matcher is reused for all molecules
+  IsomorphismQuery<HeMol> compiled(query);
+  IsomorphismMatcher<DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol> matcher(compiled);
+
+  HeMol mol;
+  for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+    file.read_molecule(i, mol);
+
+    CountMapping expected, count;
+    isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol>(mol, query, expected);
+    matcher.match(mol, count);
+    COMPARE(expected.count, count.count);
+    COMPARE(expected.count > 0, matcher.match(mol));
+  }
+}
+
 int main()
 {
   test_isomorphisms("C");
   test_isomorphisms("CCC");
   test_isomorphisms("C1CCCC1");
   test_isomorphisms("CC1C(C)CC(N)C1");
+
+  test_count("CCC", "C", 3);
+  test_count("CCC", "CC", 2);
+  test_count("CCC", "C.C", 3);
+  test_count("CCC", "N", 0);
+  test_count("OCCO", "CO", 2);
+  test_count("OCCO", "OCCO", 1);
+  test_count("c1ccccc1", "c1ccccc1", 1);
+  test_count("c1ccccc1CCc1ccccc1", "c1ccccc1", 2);
+  test_count("CC1C(C)CC(N)C1", "CC(C)C", 2);
+
+  test_matcher(datadir() + "1K.hel", "c1ccccc1");
+  test_matcher(datadir() + "1K.hel", "C(=O)N");
+
+  // symmetric queries
+  test_count("C1CCCCCCCCCCC1", "C1CCCCCCCCCCC1", 1);
+  test_count("C1CCCCCCCCCCC1", "CCCCCC", 12);
+  test_count("C1CCC2C(C1)CCC1C2CCC2CCCC21", "C1CCC2C(C1)CCC1C2CCC2CCCC21", 1);
+  test_count("C1CCC2C(C1)CCC1C2CCC2CCCC21", "C1CCCCC1", 3);
+
+  test_domain_matcher(datadir() + "1K.hel", "C");
+  test_domain_matcher(datadir() + "1K.hel", "c1ccccc1");
+  test_domain_matcher(datadir() + "1K.hel", "C(=O)N");
+  test_domain_matcher(datadir() + "1K.hel", "c1ccccc1.c1ccccc1");
+  test_domain_matcher(datadir() + "1K.hel", "c1ccc2ccccc2c1");
+  test_domain_matcher(datadir() + "1K.hel", "C1CCC2C(C1)CCC1C2CCC2CCCC21");
+  test_domain_matcher(datadir() + "1K.hel", "CC(C)(C)C");
 }
@@ -0,0 +1,81 @@
+#include <Helium/lrucache.h>
+
+#include "test.h"
+
+#include <string>
+
+using namespace Helium;
+
+void test_lru_order()
+{
+  std::cout << "Testing LRUCache eviction order..." << std::endl;
+  LRUCache<int, std::string> cache(30);
+  cache.insert(1, "one", 10);
+  cache.insert(2, "two", 10);
+  cache.insert(3, "three", 10);
+  COMPARE(3, cache.numEntries());
+  COMPARE(30, cache.size());
+
+  // 1 becomes the most recently used value, 2 is evicted
+  std::string value;
+  ASSERT(cache.find(1, value));
+  COMPARE("one", value);
+  cache.insert(4, "four", 10);
+  ASSERT(!cache.find(2, value));
+  ASSERT(cache.find(1, value));
+  ASSERT(cache.find(3, value));
+  ASSERT(cache.find(4, value));
+  COMPARE(4, cache.hits());
+  COMPARE(1, cache.misses());
+
+  // a large value evicts multiple values
+  cache.insert(5, "five", 25);
+  COMPARE(1, cache.numEntries());
+  COMPARE(25, cache.size());
+  ASSERT(cache.find(5, value));
+  COMPARE("five", value);
+}
+
+void test_lru_size()
+{
+  std::cout << "Testing LRUCache size bounds..." << std::endl;
+  LRUCache<int, int> cache(100);
+  // values larger than the capacity are not stored
+  cache.insert(1, 1, 101);
+  COMPARE(0, cache.numEntries());
+
+  // replacing a value updates the size
+  cache.insert(1, 1, 40);
+  cache.insert(1, 2, 60);
+  COMPARE(1, cache.numEntries());
+  COMPARE(60, cache.size());
+  int value = 0;
+  ASSERT(cache.find(1, value));
+  COMPARE(2, value);
+
+  cache.insert(2, 3, 40);
+  cache.erase(1);
+  COMPARE(40, cache.size());
+  ASSERT(!cache.find(1, value));
+
+  // shrinking the capacity evicts the least recently used values
+  cache.insert(3, 4, 50);
+  cache.setCapacity(50);
+  COMPARE(1, cache.numEntries());
+  ASSERT(cache.find(3, value));
+
+  cache.clear();
+  COMPARE(0, cache.numEntries());
+  COMPARE(0, cache.size());
+
+  // a cache without capacity stores nothing
+  LRUCache<int, int> disabled;
+  disabled.insert(1, 1, 1);
+  ASSERT(!disabled.find(1, value));
+}
+
+int main()
+{
+  test_lru_order();
+  test_lru_size();
+}
@@ -0,0 +1,84 @@
+#include <Helium/fingerprints/lsh.h>
+#include <Helium/fileio/fingerprints.h>
+
+#include "test.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+using namespace Helium;
+
+const unsigned int numBits = 1024;
+const unsigned int numWords = numBits / BitsPerWord;
+const unsigned int numFingerprints = 2000;
+
+void test_candidate_probability()
+{
+  std::cout << "Testing MinHashIndex::candidateProbability()..." << std::endl;
+  typedef MinHashIndex<InMemoryRowMajorFingerprintStorage> IndexType;
+  COMPARE(1.0, IndexType::candidateProbability(1.0, 16, 4));
+  COMPARE(0.0, IndexType::candidateProbability(0.0, 16, 4));
+  // more bands increase and more rows decrease the probability
+  ASSERT(IndexType::candidateProbability(0.7, 32, 4) > IndexType::candidateProbability(0.7, 16, 4));
+  ASSERT(IndexType::candidateProbability(0.7, 16, 8) < IndexType::candidateProbability(0.7, 16, 4));
+}
+
+void test_search(const std::vector<Word> &fingerprints, unsigned int numBands, unsigned int rowsPerBand,
+    double Tmin, double minRecall)
+{
+  std::cout << "Testing MinHashIndex::search(bands = " << numBands << ", rows = " << rowsPerBand
+            << ", Tmin = " << Tmin << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_lsh.fps.hel");
+  MinHashIndex<InMemoryRowMajorFingerprintStorage> index(storage, numBands, rowsPerBand);
+  COMPARE(numBands, index.numBands());
+  COMPARE(rowsPerBand, index.rowsPerBand());
+
+  std::size_t numExpected = 0, numFound = 0;
+  for (unsigned int q = 0; q < numFingerprints; q += 13) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected = brute_force_similarity_search(query, storage, Tmin);
+    std::vector<std::pair<unsigned int, double> > result = index.search(query, Tmin);
+
+    // the query itself is always found
+    ASSERT(std::find(result.begin(), result.end(), std::make_pair(q, 1.0)) != result.end());
+
+    // all hits are exact (i.e. hits of the brute force search)
+    for (std::size_t i = 0; i < result.size(); ++i)
+      ASSERT(std::find(expected.begin(), expected.end(), result[i]) != expected.end());
+    numExpected += expected.size();
+    numFound += result.size();
+
+    // k-NN search returns the best hits of search()
+    std::vector<std::pair<unsigned int, double> > knn = index.knnSearch(query, 3, Tmin);
+    COMPARE(std::min<std::size_t>(3, result.size()), knn.size());
+    for (std::size_t i = 1; i < knn.size(); ++i)
+      ASSERT(knn[i - 1].second >= knn[i].second);
+    for (std::size_t i = 0; i < result.size(); ++i)
+      if (knn.size() == 3)
+        ASSERT(result[i].second <= knn[0].second);
+  }
+
+  double recall = static_cast<double>(numFound) / numExpected;
+  std::cout << "    recall = " << recall << std::endl;
+  ASSERT(recall >= minRecall);
+}
+
+int main()
+{
+  // every 20th fingerprint has 9 near duplicates
+  FingerprintFixture fixture(numBits, 7);
+  fixture.minBitsSet = 20;
+  fixture.duplicateStride = 20;
+  fixture.groupSize = 10;
+  std::vector<Word> fingerprints = fixture.random(numFingerprints);
+  fixture.write("tmp_lsh.fps.hel", fingerprints, 0, numFingerprints);
+
+  test_candidate_probability();
+
+  // the near duplicates have a Tanimoto coefficient above 0.9
+  test_search(fingerprints, 16, 4, 0.9, 0.95);
+  test_search(fingerprints, 8, 8, 0.9, 0.8);
+  // many bands with a single row find almost all hits
+  test_search(fingerprints, 64, 1, 0.5, 0.95);
+}
@@ -1,8 +1,123 @@
 #include "../src/hemol.h"
+#include <Helium/smiles.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/algorithms/cachedproperties.h>
+
+#include "test.h"
 
 using namespace Helium;
 
-int main()
+void test_reserve_clear()
+{
+  HeMol mol;
+  mol.reserve(3, 2);
+  HeAtom a = mol.addAtom();
+  HeAtom b = mol.addAtom();
+  HeAtom c = mol.addAtom();
+  mol.addBond(a, b);
+  mol.addBond(b, c);
+  COMPARE(3, num_atoms(mol));
+  COMPARE(2, num_bonds(mol));
+  COMPARE(2, get_degree(mol, b));
+
+  // clear keeps the incident bond lists but they are empty
+  mol.clear();
+  COMPARE(0, num_atoms(mol));
+  COMPARE(0, num_bonds(mol));
+  a = mol.addAtom();
+  b = mol.addAtom();
+  COMPARE(0, get_degree(mol, a));
+  COMPARE(0, get_degree(mol, b));
+  mol.addBond(a, b);
+  COMPARE(1, get_degree(mol, a));
+  COMPARE(1, get_degree(mol, b));
+  COMPARE(Index(0), get_index(mol, get_bond(mol, a, b)));
+}
+
+void test_assign()
+{
+  HeMol mol;
+  parse_smiles("CCCCCC", mol);
+
+  std::vector<std::pair<Index, Index> > bonds;
+  bonds.push_back(std::make_pair(0, 1));
+  bonds.push_back(std::make_pair(1, 2));
+  bonds.push_back(std::make_pair(2, 0));
+  mol.assign(3, bonds);
+
+  COMPARE(3, num_atoms(mol));
+  COMPARE(3, num_bonds(mol));
+  FOREACH_ATOM (atom, mol, HeMol) {
+    COMPARE(2, get_degree(mol, *atom));
+    COMPARE(0, get_element(mol, *atom));
+  }
+  COMPARE(Index(2), get_index(mol, get_bond(mol, mol.atom(0), mol.atom(2))));
+  COMPARE(Index(1), get_index(mol, get_source(mol, get_bond(mol, 1))));
+  COMPARE(Index(2), get_index(mol, get_target(mol, get_bond(mol, 1))));
+}
+
+void test_reuse(const std::string &filename)
+{
+  // reading into the same molecule gives the same result as a new molecule
+  MoleculeFile file(filename);
+  HeMol reused;
+  for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+    HeMol mol;
+    file.read_molecule(i, mol);
+    file.read_molecule(i, reused);
+    COMPARE(num_atoms(mol), num_atoms(reused));
+    COMPARE(num_bonds(mol), num_bonds(reused));
+    FOREACH_ATOM (atom, mol, HeMol) {
+      COMPARE(get_element(mol, *atom), get_element(reused, reused.atom(get_index(mol, *atom))));
+      COMPARE(get_degree(mol, *atom), get_degree(reused, reused.atom(get_index(mol, *atom))));
+    }
+  }
+}
+
+void test_cached_properties(const std::string &filename)
 {
+  std::cout << "Testing cached properties..." << std::endl;
+  MoleculeFile file(filename);
+
   HeMol mol;
+  for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+    file.read_molecule(mol);
+    std::vector<bool> cyclicAtoms, cyclicBonds;
+    cycle_membership(mol, cyclicAtoms, cyclicBonds);
+    std::vector<unsigned long> ec = extended_connectivities(mol);
+
+    // compute & reuse
+    for (int j = 0; j < 2; ++j) {
+      ASSERT(cached_cyclic_atoms(mol) == cyclicAtoms);
+      ASSERT(cached_cyclic_bonds(mol) == cyclicBonds);
+      ASSERT(cached_extended_connectivities(mol) == ec);
+      COMPARE(unique_elements(ec), cached_num_symmetry_classes(mol));
+    }
+  }
+
+  // changing the molecule invalidates the cache
+  parse_smiles("CCCC", mol);
+  COMPARE(2, cached_num_symmetry_classes(mol));
+  ASSERT(!cached_cyclic_atoms(mol)[0]);
+  mol.addBond(mol.atom(0), mol.atom(3));
+  ASSERT(cached_cyclic_atoms(mol)[0]);
+  COMPARE(4, cached_cyclic_bonds(mol).size());
+  COMPARE(1, cached_num_symmetry_classes(mol));
+  mol.atom(0).setElement(7);
+  ASSERT(cached_extended_connectivities(mol) == extended_connectivities(mol));
+  ASSERT(cached_extended_connectivities(mol) != std::vector<unsigned long>(4));
+
+  // copies keep their own cache
+  HeMol copy = mol;
+  copy.clear();
+  COMPARE(4, cached_cyclic_atoms(mol).size());
+  COMPARE(0, cached_cyclic_atoms(copy).size());
+}
+
+int main()
+{
+  test_reserve_clear();
+  test_assign();
+  test_reuse(datadir() + "1K.hel");
+  test_cached_properties(datadir() + "1K.hel");
 }
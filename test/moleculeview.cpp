@@ -0,0 +1,87 @@
+#include <Helium/fileio/moleculeview.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/smiles.h>
+#include <Helium/algorithms/isomorphism.h>
+#include <Helium/algorithms/extendedconnectivities.h>
+#include <Helium/fingerprints/fingerprints.h>
+
+#include "test.h"
+
+using namespace Helium;
+
+void compare_molecules(HeMol &mol, const MoleculeView &view)
+{
+  COMPARE(num_atoms(mol), num_atoms(view));
+  COMPARE(num_bonds(mol), num_bonds(view));
+
+  FOREACH_ATOM (atom, mol, HeMol) {
+    MoleculeViewAtom viewAtom = get_atom(view, get_index(mol, *atom));
+    COMPARE(get_element(mol, *atom), get_element(view, viewAtom));
+    COMPARE(get_mass(mol, *atom), get_mass(view, viewAtom));
+    COMPARE(num_hydrogens(mol, *atom), num_hydrogens(view, viewAtom));
+    COMPARE(get_charge(mol, *atom), get_charge(view, viewAtom));
+    COMPARE(get_degree(mol, *atom), get_degree(view, viewAtom));
+    COMPARE(is_aromatic(mol, *atom), is_aromatic(view, viewAtom));
+    COMPARE(is_cyclic(mol, *atom), is_cyclic(view, viewAtom));
+
+    // incident bonds and neighbors in the same order
+    std::vector<Index> bonds, viewBonds, nbrs, viewNbrs;
+    FOREACH_INCIDENT (bond, *atom, mol, HeMol)
+      bonds.push_back(get_index(mol, *bond));
+    FOREACH_INCIDENT (viewBond, viewAtom, view, MoleculeView)
+      viewBonds.push_back(get_index(view, *viewBond));
+    FOREACH_NBR (nbr, *atom, mol, HeMol)
+      nbrs.push_back(get_index(mol, *nbr));
+    FOREACH_NBR (viewNbr, viewAtom, view, MoleculeView)
+      viewNbrs.push_back(get_index(view, *viewNbr));
+    COMPARE(bonds, viewBonds);
+    COMPARE(nbrs, viewNbrs);
+  }
+
+  FOREACH_BOND (bond, mol, HeMol) {
+    MoleculeViewBond viewBond = get_bond(view, get_index(mol, *bond));
+    COMPARE(get_index(mol, get_source(mol, *bond)), get_index(view, get_source(view, viewBond)));
+    COMPARE(get_index(mol, get_target(mol, *bond)), get_index(view, get_target(view, viewBond)));
+    COMPARE(get_order(mol, *bond), get_order(view, viewBond));
+    COMPARE(is_aromatic(mol, *bond), is_aromatic(view, viewBond));
+    COMPARE(is_cyclic(mol, *bond), is_cyclic(view, viewBond));
+    COMPARE(viewBond, get_bond(view, get_source(view, viewBond), get_target(view, viewBond)));
+  }
+}
+
+void test_file(const std::string &filename)
+{
+  MemoryMappedMoleculeFile file(filename);
+
+  HeMol benzene;
+  parse_smiles("c1ccccc1", benzene);
+
+  HeMol mol;
+  MoleculeView view;
+  for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+    file.read_molecule(i, mol);
+    file.read_molecule(i, view);
+
+    // degree first to check the lazily built adjacency
+    if (num_atoms(mol))
+      COMPARE(get_degree(mol, mol.atom(0)), get_degree(view, view.atom(0)));
+    compare_molecules(mol, view);
+
+    CountMapping count, viewCount;
+    isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher>(mol, benzene, count);
+    isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher>(view, benzene, viewCount);
+    COMPARE(count.count, viewCount.count);
+
+    Word fp[16], viewFp[16];
+    path_fingerprint(mol, fp);
+    path_fingerprint(view, viewFp);
+    COMPARE(std::vector<Word>(fp, fp + 16), std::vector<Word>(viewFp, viewFp + 16));
+
+    COMPARE(extended_connectivities(mol), extended_connectivities(view));
+  }
+}
+
+int main()
+{
+  test_file(datadir() + "1K.hel");
+}
@@ -0,0 +1,108 @@
+#include <Helium/propertyfilters.h>
+#include <Helium/substructuresearch.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/smiles.h>
+
+#include "test.h"
+
+using namespace Helium;
+
+void test_values()
+{
+  std::cout << "Testing property_filter_values()..." << std::endl;
+  HeMol mol;
+  parse_smiles("c1ccccc1C(=O)NCCl", mol);
+  std::vector<unsigned int> values = property_filter_values(mol);
+  COMPARE(3 + impl::property_filter_elements().size(), values.size());
+  COMPARE(11, values[0]); // atoms
+  COMPARE(11, values[1]); // bonds
+  COMPARE(1, values[2]); // rings
+  COMPARE(8, values[3]); // C
+  COMPARE(1, values[4]); // N
+  COMPARE(1, values[5]); // O
+  COMPARE(1, values[9]); // Cl
+
+  // isolated atoms are components
+  parse_smiles("c1ccccc1.[Cl-]", mol);
+  COMPARE(1, property_filter_values(mol)[2]);
+}
+
+void test_index(const PropertyFilterIndex &index, MemoryMappedMoleculeFile &file, unsigned int maxThreshold)
+{
+  COMPARE(file.numMolecules(), index.numMolecules());
+  COMPARE(3 + impl::property_filter_elements().size(), index.numProperties());
+  COMPARE("atoms", index.propertyName(0));
+  COMPARE("Cl", index.propertyName(9));
+
+  HeMol mol;
+  for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+    file.read_molecule(i, mol);
+    std::vector<unsigned int> values = property_filter_values(mol);
+    for (unsigned int j = 0; j < index.numProperties(); ++j) {
+      ASSERT(index.numThresholds(j) <= maxThreshold);
+      for (unsigned int t = 1; t <= index.numThresholds(j); ++t)
+        COMPARE(values[j] >= t, bitvec_get(i, index.bitmap(j, t)));
+    }
+  }
+  // the thresholds do not exceed the largest value
+  ASSERT(index.count(0, index.numThresholds(0)) > 0);
+}
+
+void test_build(unsigned int maxThreshold)
+{
+  std::cout << "Testing PropertyFilterIndex::build(max = " << maxThreshold << ")..." << std::endl;
+  MemoryMappedMoleculeFile file(datadir() + "1K.hel");
+  PropertyFilterIndex index;
+  index.build(file, maxThreshold);
+  test_index(index, file, maxThreshold);
+
+  index.save("tmp_filters.hel");
+  PropertyFilterIndex loaded;
+  loaded.load("tmp_filters.hel");
+  test_index(loaded, file, maxThreshold);
+}
+
+void test_search(const std::string &smiles)
+{
+  std::cout << "Testing PropertyFilterIndex::operands(" << smiles << ")..." << std::endl;
+  MemoryMappedMoleculeFile file(datadir() + "1K.hel");
+  PropertyFilterIndex index;
+  index.build(file, 16);
+
+  HeMol query;
+  parse_smiles(smiles, query);
+  std::vector<ScreenOperand> operands = index.operands(query);
+
+  // intersect all operands
+  unsigned int numWords = bitvec_num_words_for_bits(file.numMolecules());
+  std::vector<Word> candidates(numWords, ~Word(0));
+  for (std::size_t i = 0; i < operands.size(); ++i) {
+    COMPARE(operands[i].count, bitvec_count(operands[i].bitmap, numWords));
+    for (unsigned int j = 0; j < numWords; ++j)
+      candidates[j] &= operands[i].bitmap[j];
+  }
+  candidates[numWords - 1] &= (Word(1) << (file.numMolecules() % BitsPerWord)) - 1;
+
+  // the filters never remove hits
+  std::vector<Word> all(numWords, ~Word(0));
+  all[numWords - 1] &= (Word(1) << (file.numMolecules() % BitsPerWord)) - 1;
+  std::vector<unsigned int> expected = substructure_verify(file, query, &all[0]);
+  std::vector<unsigned int> hits = substructure_verify(file, query, &candidates[0]);
+  ASSERT(hits == expected);
+  std::cout << "    filtered " << file.numMolecules() - bitvec_count(&candidates[0], numWords) << " molecules" << std::endl;
+}
+
+int main()
+{
+  test_values();
+
+  test_build(32);
+  test_build(4);
+
+  test_search("c1ccccc1");
+  test_search("C(=O)O");
+  test_search("ClCCCl");
+  test_search("C1CC1.C1CC1.c1ccccc1");
+  test_search("NC(=O)c1ccc(Br)cc1");
+  test_search("c1ccncc1");
+}
@@ -0,0 +1,115 @@
+#include <Helium/roaring.h>
+#include <Helium/fileio/file.h>
+
+#include "test.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace Helium;
+
+// more than two containers and not a multiple of the word size
+const unsigned int numBits = 3 * RoaringBitmap::ContainerBits - 77;
+const unsigned int numWords = (numBits + BitsPerWord - 1) / BitsPerWord;
+
+/**
+ * Generate a random bitmap with @p numSet bits set in each container. Bits
+ * after numBits are never set.
+ */
+std::vector<Word> random_bitmap(const unsigned int *numSet)
+{
+  std::vector<Word> bitmap(numWords, 0);
+  for (unsigned int key = 0; key < 3; ++key)
+    for (unsigned int i = 0; i < numSet[key]; ++i) {
+      unsigned int index = key * RoaringBitmap::ContainerBits + std::rand() % RoaringBitmap::ContainerBits;
+      if (index < numBits)
+        bitvec_set(index, &bitmap[0]);
+    }
+  return bitmap;
+}
+
+void compare(const std::vector<Word> &expected, const RoaringBitmap &bitmap)
+{
+  COMPARE(bitvec_count(&expected[0], numWords), bitmap.count());
+  std::vector<Word> result(numWords, ~Word(0));
+  bitmap.toBitvec(&result[0], numBits);
+  ASSERT(expected == result);
+  for (unsigned int i = 0; i < numBits; i += 97)
+    COMPARE(bitvec_get(i, &expected[0]), bitmap.contains(i));
+}
+
+void test_bitmap(const unsigned int *numSet)
+{
+  std::cout << "Testing RoaringBitmap(" << numSet[0] << ", " << numSet[1] << ", " << numSet[2] << ")..." << std::endl;
+  std::vector<Word> dense = random_bitmap(numSet);
+  RoaringBitmap bitmap(&dense[0], numBits);
+  compare(dense, bitmap);
+  // empty containers are not stored
+  for (unsigned int i = 0; i < bitmap.numContainers(); ++i) {
+    ASSERT(bitmap.container(i).cardinality > 0);
+    COMPARE(bitmap.container(i).cardinality > RoaringBitmap::ArrayMaxSize, bitmap.container(i).isBitmap());
+  }
+}
+
+void test_intersect(const unsigned int *numSet1, const unsigned int *numSet2)
+{
+  std::cout << "Testing RoaringBitmap::intersect()..." << std::endl;
+  std::vector<Word> dense1 = random_bitmap(numSet1);
+  std::vector<Word> dense2 = random_bitmap(numSet2);
+  std::vector<Word> expected(numWords);
+  for (unsigned int i = 0; i < numWords; ++i)
+    expected[i] = dense1[i] & dense2[i];
+
+  RoaringBitmap bitmap1(&dense1[0], numBits);
+  RoaringBitmap bitmap2(&dense2[0], numBits);
+  compare(expected, RoaringBitmap::intersect(bitmap1, bitmap2));
+  compare(expected, RoaringBitmap::intersect(bitmap2, bitmap1));
+}
+
+void test_file()
+{
+  std::cout << "Testing RoaringBitmap::write() and read()..." << std::endl;
+  unsigned int numSet[3] = { 100, 0, 30000 };
+  std::vector<Word> dense = random_bitmap(numSet);
+  RoaringBitmap bitmap(&dense[0], numBits);
+  {
+    BinaryOutputFile file("tmp_roaring.hel");
+    file.writeHeader("{}");
+    ASSERT(bitmap.write(file));
+    ASSERT(RoaringBitmap().write(file));
+  }
+
+  BinaryInputFile file("tmp_roaring.hel");
+  RoaringBitmap result, empty;
+  ASSERT(result.read(file));
+  ASSERT(empty.read(file));
+  compare(dense, result);
+  ASSERT(empty.empty());
+  // no more data
+  ASSERT(!RoaringBitmap().read(file));
+}
+
+int main()
+{
+  std::srand(11);
+
+  unsigned int sparse[3] = { 10, 50, 3 };
+  unsigned int mixed[3] = { 20000, 0, 4000 };
+  unsigned int dense[3] = { 40000, 60000, 30000 };
+  test_bitmap(sparse);
+  test_bitmap(mixed);
+  test_bitmap(dense);
+
+  // array-array (merge and galloping), array-bitmap and bitmap-bitmap
+  unsigned int medium[3] = { 3000, 500, 2000 };
+  test_intersect(sparse, medium);
+  test_intersect(medium, medium);
+  test_intersect(sparse, dense);
+  test_intersect(mixed, dense);
+  test_intersect(dense, dense);
+  // bitmap-bitmap with a sparse result
+  unsigned int low[3] = { 5000, 8000, 6000 };
+  test_intersect(low, low);
+
+  test_file();
+}
@@ -0,0 +1,342 @@
+#include <Helium/fingerprints/screen.h>
+#include <Helium/fileio/fingerprints.h>
+
+#include "test.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+using namespace Helium;
+
+const unsigned int numBits = 256;
+const unsigned int numWords = numBits / BitsPerWord;
+// not a multiple of the word size to test the padding bits
+const unsigned int numFingerprints = 20001;
+
+void write_fingerprint_files(std::vector<Word> &fingerprints)
+{
+  ColumnMajorFingerprintOutputFile file("tmp_screen.fps.hel", numBits, numFingerprints);
+  for (unsigned int i = 0; i < numFingerprints; ++i)
+    file.writeFingerprint(&fingerprints[i * numWords]);
+  file.writeHeader(fingerprint_header("column-major", numBits, numFingerprints));
+
+  CompressedColumnMajorFingerprintOutputFile compressed("tmp_screen_compressed.fps.hel", numBits, numFingerprints);
+  for (unsigned int i = 0; i < numFingerprints; ++i)
+    compressed.writeFingerprint(&fingerprints[i * numWords]);
+  compressed.writeHeader(fingerprint_header("compressed-column-major", numBits, numFingerprints));
+
+  for (unsigned int i = 0; i < numBits; ++i) {
+    unsigned int count = 0;
+    for (unsigned int j = 0; j < numFingerprints; ++j)
+      if (bitvec_get(i, &fingerprints[j * numWords]))
+        ++count;
+    COMPARE(count, file.columnCounts()[i]);
+  }
+}
+
+void test_column_counts(const std::vector<Word> &fingerprints)
+{
+  std::cout << "Testing columnCount()..." << std::endl;
+  InMemoryColumnMajorFingerprintStorage storage;
+  storage.load("tmp_screen.fps.hel");
+
+  for (unsigned int i = 0; i < numBits; ++i) {
+    unsigned int count = 0;
+    for (unsigned int j = 0; j < numFingerprints; ++j)
+      if (bitvec_get(i, &fingerprints[j * numWords]))
+        ++count;
+    COMPARE(count, storage.columnCount(i));
+  }
+  COMPARE(0, storage.columnCount(numBits - 1));
+}
+
+void test_stripes(const std::vector<Word> &fingerprints, unsigned int stripeSize)
+{
+  std::cout << "Testing ColumnMajorFingerprintOutputFile(stripe = " << stripeSize << ")..." << std::endl;
+  {
+    ColumnMajorFingerprintOutputFile file("tmp_screen_stripes.fps.hel", numBits, numFingerprints, stripeSize);
+    for (unsigned int i = 0; i < numFingerprints; ++i)
+      file.writeFingerprint(const_cast<Word*>(&fingerprints[i * numWords]));
+    file.writeHeader(fingerprint_header("column-major", numBits, numFingerprints));
+  }
+
+  InMemoryColumnMajorFingerprintStorage storage;
+  storage.load("tmp_screen_stripes.fps.hel");
+  for (unsigned int i = 0; i < numBits; ++i)
+    for (unsigned int j = 0; j < numFingerprints; ++j)
+      COMPARE(bitvec_get(i, &fingerprints[j * numWords]), bitvec_get(j, storage.bit(i)));
+}
+
+void test_screen(const std::vector<Word> &fingerprints, int numQueryBits, bool lastBit = false)
+{
+  std::cout << "Testing substructure_screen(bits = " << numQueryBits << ")..." << std::endl;
+  InMemoryColumnMajorFingerprintStorage storage;
+  storage.load("tmp_screen.fps.hel");
+
+  std::vector<Word> query(numWords, 0);
+  for (int i = 0; i < numQueryBits; ++i)
+    bitvec_set(std::rand() % numBits, &query[0]);
+  if (lastBit)
+    bitvec_set(numBits - 1, &query[0]);
+
+  std::vector<unsigned int> expected;
+  for (unsigned int i = 0; i < numFingerprints; ++i)
+    if (bitvec_is_subset_superset(&query[0], &fingerprints[i * numWords], numWords))
+      expected.push_back(i);
+
+  unsigned int resultWords = bitvec_num_words_for_bits(numFingerprints);
+  std::vector<Word> result(resultWords);
+  substructure_screen(storage, &query[0], &result[0]);
+  std::vector<unsigned int> candidates = screen_candidates(&result[0], numFingerprints);
+  COMPARE(expected.size(), candidates.size());
+  COMPARE(expected.size(), bitvec_count(&result[0], resultWords));
+  if (expected.size() == candidates.size())
+    for (std::size_t i = 0; i < expected.size(); ++i)
+      COMPARE(expected[i], candidates[i]);
+
+#ifdef HAVE_CPP11
+  ThreadPool pool(3);
+  std::vector<Word> threaded(resultWords);
+  substructure_screen_threaded(storage, &query[0], &threaded[0], pool);
+  ASSERT(std::equal(result.begin(), result.end(), threaded.begin()));
+#endif
+
+  // the memory mapped storage gives the same result
+  MemoryMappedColumnMajorFingerprintStorage mapped("tmp_screen.fps.hel", SequentialAdvice);
+  std::vector<Word> mappedResult(resultWords);
+  substructure_screen(mapped, &query[0], &mappedResult[0]);
+  ASSERT(std::equal(result.begin(), result.end(), mappedResult.begin()));
+}
+
+void test_compressed_screen(const std::vector<Word> &fingerprints, const std::string &filename,
+    unsigned int n, int numQueryBits)
+{
+  std::cout << "Testing compressed substructure_screen(bits = " << numQueryBits << ")..." << std::endl;
+  InMemoryCompressedColumnMajorFingerprintStorage storage;
+  storage.load(filename);
+  COMPARE(numBits, storage.numBits());
+  COMPARE(n, storage.numFingerprints());
+
+  for (unsigned int i = 0; i < n; i += 101)
+    COMPARE(bitvec_count(&fingerprints[i * numWords], numWords), storage.bitCount(i));
+
+  std::vector<Word> query(numWords, 0);
+  for (int i = 0; i < numQueryBits; ++i)
+    bitvec_set(std::rand() % numBits, &query[0]);
+
+  std::vector<unsigned int> expected;
+  for (unsigned int i = 0; i < n; ++i)
+    if (bitvec_is_subset_superset(&query[0], &fingerprints[i * numWords], numWords))
+      expected.push_back(i);
+
+  unsigned int resultWords = bitvec_num_words_for_bits(n);
+  std::vector<Word> result(resultWords);
+  substructure_screen(storage, &query[0], &result[0]);
+  std::vector<unsigned int> candidates = screen_candidates(&result[0], n);
+  COMPARE(expected.size(), candidates.size());
+  COMPARE(expected.size(), bitvec_count(&result[0], resultWords));
+  if (expected.size() == candidates.size())
+    for (std::size_t i = 0; i < expected.size(); ++i)
+      COMPARE(expected[i], candidates[i]);
+
+#ifdef HAVE_CPP11
+  ThreadPool pool(3);
+  std::vector<Word> threaded(resultWords);
+  substructure_screen_threaded(storage, &query[0], &threaded[0], pool);
+  ASSERT(std::equal(result.begin(), result.end(), threaded.begin()));
+#endif
+
+  SubstructureScreen<InMemoryCompressedColumnMajorFingerprintStorage> screen(storage, &query[0]);
+  std::vector<Word> blocks(resultWords, ~Word(0));
+  for (unsigned int begin = 0; begin < resultWords; begin += screen.blockWords())
+    screen.screen(&blocks[0], begin, std::min(resultWords, begin + screen.blockWords()));
+  ASSERT(blocks == result);
+}
+
+template<typename StorageType>
+void test_operands(const std::vector<Word> &fingerprints, const std::string &filename, int numQueryBits)
+{
+  std::cout << "Testing substructure_screen(" << filename << ", operands)..." << std::endl;
+  StorageType storage;
+  storage.load(filename);
+
+  std::vector<Word> query(numWords, 0);
+  for (int i = 0; i < numQueryBits; ++i)
+    bitvec_set(std::rand() % numBits, &query[0]);
+
+  // two random operands, one selects every third fingerprint
+  unsigned int resultWords = bitvec_num_words_for_bits(numFingerprints);
+  std::vector<Word> operand1(resultWords, 0), operand2(resultWords, 0);
+  for (unsigned int i = 0; i < numFingerprints; ++i) {
+    if (std::rand() % 2)
+      bitvec_set(i, &operand1[0]);
+    if (i % 3 == 0)
+      bitvec_set(i, &operand2[0]);
+  }
+  std::vector<ScreenOperand> operands;
+  operands.push_back(ScreenOperand(&operand1[0], bitvec_count(&operand1[0], resultWords)));
+  operands.push_back(ScreenOperand(&operand2[0], bitvec_count(&operand2[0], resultWords)));
+
+  std::vector<unsigned int> expected;
+  for (unsigned int i = 0; i < numFingerprints; ++i)
+    if (bitvec_is_subset_superset(&query[0], &fingerprints[i * numWords], numWords) &&
+        bitvec_get(i, &operand1[0]) && bitvec_get(i, &operand2[0]))
+      expected.push_back(i);
+
+  std::vector<Word> result(resultWords);
+  substructure_screen(storage, &query[0], operands, &result[0]);
+  ASSERT(screen_candidates(&result[0], numFingerprints) == expected);
+
+#ifdef HAVE_CPP11
+  ThreadPool pool(3);
+  std::vector<Word> threaded(resultWords);
+  substructure_screen_threaded(storage, &query[0], operands, &threaded[0], pool);
+  ASSERT(std::equal(result.begin(), result.end(), threaded.begin()));
+#endif
+
+  // screening the blocks in any order gives the same result
+  SubstructureScreen<StorageType> screen(storage, &query[0], operands);
+  ASSERT(!screen.empty());
+  std::vector<Word> blocks(resultWords, ~Word(0));
+  for (unsigned int begin = (resultWords - 1) / screen.blockWords() * screen.blockWords(); ;
+       begin -= screen.blockWords()) {
+    screen.screen(&blocks[0], begin, std::min(resultWords, begin + screen.blockWords()));
+    if (!begin)
+      break;
+  }
+  ASSERT(blocks == result);
+
+  // an empty operand removes all candidates
+  std::vector<Word> empty(resultWords, 0);
+  operands.push_back(ScreenOperand(&empty[0], 0));
+  substructure_screen(storage, &query[0], operands, &result[0]);
+  COMPARE(0, bitvec_count(&result[0], resultWords));
+  ASSERT(SubstructureScreen<StorageType>(storage, &query[0], operands).empty());
+}
+
+void test_screen_batch(unsigned int numQueries)
+{
+  std::cout << "Testing substructure_screen_batch(queries = " << numQueries << ")..." << std::endl;
+  InMemoryColumnMajorFingerprintStorage storage;
+  storage.load("tmp_screen.fps.hel");
+
+  // the queries share bits and operands, one query has no bits and one can not match
+  unsigned int resultWords = bitvec_num_words_for_bits(numFingerprints);
+  std::vector<Word> queries(numQueries * numWords, 0);
+  std::vector<Word> operand(resultWords, 0);
+  for (unsigned int i = 0; i < numFingerprints; ++i)
+    if (std::rand() % 2)
+      bitvec_set(i, &operand[0]);
+  std::vector<const Word*> queryPtrs;
+  std::vector<std::vector<ScreenOperand> > operands(numQueries);
+  for (unsigned int q = 0; q < numQueries; ++q) {
+    Word *query = &queries[q * numWords];
+    if (q)
+      bitvec_set(std::rand() % 8, query);
+    if (q > 1)
+      for (unsigned int i = 0; i < q % 7; ++i)
+        bitvec_set(std::rand() % numBits, query);
+    if (q == 2)
+      bitvec_set(numBits - 1, query);
+    if (q % 3 == 1)
+      operands[q].push_back(ScreenOperand(&operand[0], bitvec_count(&operand[0], resultWords)));
+    queryPtrs.push_back(query);
+  }
+
+  std::vector<Word> results(numQueries * resultWords, 0), threaded(numQueries * resultWords, 0);
+  std::vector<Word*> resultPtrs, threadedPtrs;
+  for (unsigned int q = 0; q < numQueries; ++q) {
+    resultPtrs.push_back(&results[q * resultWords]);
+    threadedPtrs.push_back(&threaded[q * resultWords]);
+  }
+  substructure_screen_batch(storage, queryPtrs, operands, resultPtrs);
+
+  // the result is the same as for screening each query
+  std::vector<Word> expected(resultWords);
+  for (unsigned int q = 0; q < numQueries; ++q) {
+    substructure_screen(storage, queryPtrs[q], operands[q], &expected[0]);
+    ASSERT(std::equal(expected.begin(), expected.end(), resultPtrs[q]));
+  }
+  COMPARE(numFingerprints, bitvec_count(resultPtrs[0], resultWords));
+  if (numQueries > 2)
+    COMPARE(0, bitvec_count(resultPtrs[2], resultWords));
+
+#ifdef HAVE_CPP11
+  ThreadPool pool(3);
+  substructure_screen_batch_threaded(storage, queryPtrs, operands, threadedPtrs, pool);
+  ASSERT(results == threaded);
+#endif
+
+  // the memory mapped storage gives the same result without operands
+  MemoryMappedColumnMajorFingerprintStorage mapped("tmp_screen.fps.hel", SequentialAdvice);
+  substructure_screen_batch(mapped, queryPtrs, resultPtrs);
+  for (unsigned int q = 0; q < numQueries; ++q) {
+    substructure_screen(storage, queryPtrs[q], &expected[0]);
+    ASSERT(std::equal(expected.begin(), expected.end(), resultPtrs[q]));
+  }
+}
+
+/**
+ * Sparse fingerprints spanning multiple compressed containers.
+ */
+std::vector<Word> write_sparse_fingerprint_file(unsigned int n)
+{
+  std::vector<Word> fingerprints(n * numWords, 0);
+  for (unsigned int i = 0; i < n; ++i) {
+    // a few common bits and rare bits
+    bitvec_set(std::rand() % 4, &fingerprints[i * numWords]);
+    if (std::rand() % 10 == 0)
+      bitvec_set(4 + std::rand() % (numBits - 4), &fingerprints[i * numWords]);
+  }
+
+  CompressedColumnMajorFingerprintOutputFile file("tmp_screen_sparse.fps.hel", numBits, n);
+  for (unsigned int i = 0; i < n; ++i)
+    file.writeFingerprint(&fingerprints[i * numWords]);
+  file.writeHeader(fingerprint_header("compressed-column-major", numBits, n));
+  return fingerprints;
+}
+
+int main()
+{
+  // a high bit density so small queries have many candidates, the last bit
+  // is never set
+  FingerprintFixture fixture(numBits, 3);
+  fixture.usedBits = numBits - 1;
+  std::vector<Word> fingerprints = fixture.random(numFingerprints);
+  write_fingerprint_files(fingerprints);
+
+  // a query without set bits matches all fingerprints
+  test_screen(fingerprints, 0);
+  test_screen(fingerprints, 1);
+  test_screen(fingerprints, 4);
+  test_screen(fingerprints, 10);
+  test_screen(fingerprints, 60);
+
+  // a query with a bit that is never set has no candidates
+  test_screen(fingerprints, 2, true);
+
+  test_column_counts(fingerprints);
+
+  test_stripes(fingerprints, 0);
+  test_stripes(fingerprints, 64);
+  test_stripes(fingerprints, 1000);
+
+  test_compressed_screen(fingerprints, "tmp_screen_compressed.fps.hel", numFingerprints, 0);
+  test_compressed_screen(fingerprints, "tmp_screen_compressed.fps.hel", numFingerprints, 4);
+  test_compressed_screen(fingerprints, "tmp_screen_compressed.fps.hel", numFingerprints, 30);
+
+  test_operands<InMemoryColumnMajorFingerprintStorage>(fingerprints, "tmp_screen.fps.hel", 0);
+  test_operands<InMemoryColumnMajorFingerprintStorage>(fingerprints, "tmp_screen.fps.hel", 5);
+  test_operands<InMemoryCompressedColumnMajorFingerprintStorage>(fingerprints, "tmp_screen_compressed.fps.hel", 0);
+  test_operands<InMemoryCompressedColumnMajorFingerprintStorage>(fingerprints, "tmp_screen_compressed.fps.hel", 5);
+
+  test_screen_batch(1);
+  test_screen_batch(3);
+  test_screen_batch(40);
+
+  const unsigned int numSparse = 2 * RoaringBitmap::ContainerBits + 1001;
+  std::vector<Word> sparse = write_sparse_fingerprint_file(numSparse);
+  test_compressed_screen(sparse, "tmp_screen_sparse.fps.hel", numSparse, 0);
+  test_compressed_screen(sparse, "tmp_screen_sparse.fps.hel", numSparse, 1);
+  test_compressed_screen(sparse, "tmp_screen_sparse.fps.hel", numSparse, 2);
+}
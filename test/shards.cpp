@@ -0,0 +1,99 @@
+#include <Helium/fingerprints/shards.h>
+
+#include "test.h"
+
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+
+using namespace Helium;
+
+const unsigned int numBits = 1024;
+const unsigned int numWords = numBits / BitsPerWord;
+const unsigned int numFingerprints = 2000;
+
+/**
+ * Write the complete library and three shards, the second shard is a
+ * similarity index file.
+ */
+void write_shards(const FingerprintFixture &fixture, const std::vector<Word> &fingerprints)
+{
+  fixture.write("tmp_shards_all.fps.hel", fingerprints, 0, numFingerprints);
+  fixture.write("tmp_shard1.fps.hel", fingerprints, 0, 700);
+  fixture.write("tmp_shard2.fps.hel", fingerprints, 700, 1500);
+  fixture.write("tmp_shard3.fps.hel", fingerprints, 1500, numFingerprints);
+
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_shard2.fps.hel");
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, 3, 1);
+  index.save("tmp_shard2.sim.hel");
+
+  std::ofstream ofs("tmp_shards.json");
+  ofs << "{ \"filetype\": \"similarity-shards\", \"shards\": [ \"tmp_shard1.fps.hel\", "
+      << "\"tmp_shard2.sim.hel\", \"tmp_shard3.fps.hel\" ] }" << std::endl;
+}
+
+void test_manifest()
+{
+  std::cout << "Testing ShardedSimilaritySearchIndex::readManifest()..." << std::endl;
+  ASSERT(ShardedSimilaritySearchIndex<>::isManifest("tmp_shards.json"));
+  ASSERT(!ShardedSimilaritySearchIndex<>::isManifest("tmp_shard1.fps.hel"));
+  ASSERT(!ShardedSimilaritySearchIndex<>::isManifest("tmp_does_not_exist.json"));
+
+  std::vector<std::string> shards = ShardedSimilaritySearchIndex<>::readManifest("tmp_shards.json");
+  COMPARE(3, shards.size());
+  COMPARE(std::string("tmp_shard2.sim.hel"), shards[1]);
+}
+
+void test_search(const std::vector<Word> &fingerprints, unsigned int numThreads)
+{
+  std::cout << "Testing ShardedSimilaritySearchIndex (threads = " << numThreads << ")..." << std::endl;
+  ShardedSimilaritySearchIndex<> index(ShardedSimilaritySearchIndex<>::readManifest("tmp_shards.json"), 3, numThreads);
+  COMPARE(3, index.numShards());
+  COMPARE(numBits, index.numBits());
+  COMPARE(numFingerprints, index.numFingerprints());
+  COMPARE(0, index.offset(0));
+  COMPARE(700, index.offset(1));
+  COMPARE(1500, index.offset(2));
+
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_shards_all.fps.hel");
+
+  for (unsigned int q = 0; q < numFingerprints; q += 97) {
+    const Word *query = &fingerprints[q * numWords];
+
+    // the hits are the same as for the complete library
+    std::vector<std::pair<unsigned int, double> > expected = brute_force_similarity_search(query, storage, 0.5);
+    std::vector<std::pair<unsigned int, double> > result = index.search(query, 0.5);
+    std::sort(result.begin(), result.end());
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        COMPARE(expected[i].first, result[i].first);
+        COMPARE(expected[i].second, result[i].second);
+      }
+
+    expected = brute_force_knn_search(query, storage, 10, 0.1);
+    result = index.knnSearch(query, 10, 0.1);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        COMPARE(expected[i].first, result[i].first);
+        COMPARE(expected[i].second, result[i].second);
+      }
+  }
+}
+
+int main()
+{
+  // every 20th fingerprint has 4 near duplicates
+  FingerprintFixture fixture(numBits, 3);
+  fixture.duplicateStride = 20;
+  fixture.groupSize = 5;
+  std::vector<Word> fingerprints = fixture.random(numFingerprints);
+  write_shards(fixture, fingerprints);
+
+  test_manifest();
+  test_search(fingerprints, 1);
+  test_search(fingerprints, 0);
+}
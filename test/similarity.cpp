@@ -0,0 +1,1211 @@
+#include <Helium/fingerprints/similarity.h>
+#include <Helium/fingerprints/similaritytuning.h>
+#include <Helium/fingerprints/foldedsearch.h>
+#include <Helium/fileio/fingerprints.h>
+
+#include "test.h"
+#include "../src/util/vector.h"
+#ifdef HAVE_OPENCL
+#include "../tools/openclsimilarity.h"
+#endif
+
+#include <cstdlib>
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <fstream>
+
+using namespace Helium;
+
+const unsigned int numBits = 1024;
+const unsigned int numWords = numBits / BitsPerWord;
+const unsigned int numFingerprints = 2000;
+
+void write_fingerprint_files(const std::vector<Word> &fingerprints)
+{
+  RowMajorFingerprintOutputFile rowMajor("tmp_row_major.fps.hel", numBits);
+  ColumnMajorFingerprintOutputFile columnMajor("tmp_column_major.fps.hel", numBits, numFingerprints);
+  for (unsigned int i = 0; i < numFingerprints; ++i) {
+    rowMajor.writeFingerprint(const_cast<Word*>(&fingerprints[i * numWords]));
+    columnMajor.writeFingerprint(const_cast<Word*>(&fingerprints[i * numWords]));
+  }
+  rowMajor.writeHeader(fingerprint_header("row-major", numBits, numFingerprints));
+  columnMajor.writeHeader(fingerprint_header("column-major", numBits, numFingerprints));
+}
+
+std::vector<std::pair<unsigned int, double> > naive_search(const Word *query,
+    const std::vector<Word> &fingerprints, double Tmin)
+{
+  std::vector<std::pair<unsigned int, double> > result;
+  for (unsigned int i = 0; i < numFingerprints; ++i) {
+    double T = bitvec_tanimoto(query, &fingerprints[i * numWords], numWords);
+    if (T >= Tmin)
+      result.push_back(std::make_pair(i, T));
+  }
+  return result;
+}
+
+void test_storage_bit_counts(const std::vector<Word> &fingerprints)
+{
+  std::cout << "Testing storage bit counts..." << std::endl;
+  InMemoryRowMajorFingerprintStorage rowMajor;
+  rowMajor.load("tmp_row_major.fps.hel");
+  InMemoryColumnMajorFingerprintStorage columnMajor;
+  columnMajor.load("tmp_column_major.fps.hel");
+
+  COMPARE(numFingerprints, rowMajor.numFingerprints());
+  COMPARE(numFingerprints, columnMajor.numFingerprints());
+  for (unsigned int i = 0; i < numFingerprints; ++i) {
+    int count = bitvec_count(&fingerprints[i * numWords], numWords);
+    COMPARE(count, rowMajor.bitCount(i));
+    COMPARE(count, rowMajor.bitCounts()[i]);
+    COMPARE(count, columnMajor.bitCount(i));
+  }
+}
+
+void test_padded_storages()
+{
+  std::cout << "Testing padded storages..." << std::endl;
+  // 166 bits (3 words) are padded to 4 words, 1100 fingerprints (18 words) to 24 words
+  const unsigned int bits = 166, words = 3, n = 1100;
+  std::vector<Word> fingerprints(n * words);
+  for (unsigned int i = 0; i < n; ++i)
+    for (int j = 0; j < 20; ++j)
+      bitvec_set(std::rand() % bits, &fingerprints[i * words]);
+  {
+    RowMajorFingerprintOutputFile rowMajor("tmp_padded_row_major.fps.hel", bits);
+    ColumnMajorFingerprintOutputFile columnMajor("tmp_padded_column_major.fps.hel", bits, n);
+    for (unsigned int i = 0; i < n; ++i) {
+      rowMajor.writeFingerprint(&fingerprints[i * words]);
+      columnMajor.writeFingerprint(&fingerprints[i * words]);
+    }
+    rowMajor.writeHeader(fingerprint_header("row-major", bits, n));
+    columnMajor.writeHeader(fingerprint_header("column-major", bits, n));
+  }
+
+  InMemoryRowMajorFingerprintStorage rowMajor;
+  rowMajor.load("tmp_padded_row_major.fps.hel");
+  COMPARE(4, rowMajor.stride());
+  COMPARE(0, reinterpret_cast<std::size_t>(rowMajor.fingerprint(0)) % CacheLineSize);
+  for (unsigned int i = 0; i < n; ++i) {
+    for (unsigned int j = 0; j < words; ++j)
+      COMPARE(fingerprints[i * words + j], rowMajor.fingerprint(i)[j]);
+    COMPARE(0, rowMajor.fingerprint(i)[words]);
+    COMPARE(bitvec_count(&fingerprints[i * words], words), rowMajor.bitCount(i));
+  }
+  // the brute force search handles the padded rows
+  for (unsigned int q = 0; q < 5; ++q) {
+    const Word *query = &fingerprints[q * 97 * words];
+    std::vector<std::pair<unsigned int, double> > hits = brute_force_similarity_search(query, rowMajor, 0.3);
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+      double T = bitvec_tanimoto(query, &fingerprints[i * words], words);
+      if (T < 0.3)
+        continue;
+      ASSERT(count < hits.size());
+      if (count < hits.size()) {
+        COMPARE(i, hits[count].first);
+        COMPARE(T, hits[count].second);
+      }
+      ++count;
+    }
+    COMPARE(count, hits.size());
+  }
+
+  // appending keeps the stride
+  for (unsigned int i = 0; i < n; ++i)
+    COMPARE(n + i, rowMajor.append(&fingerprints[i * words]));
+  COMPARE(0, reinterpret_cast<std::size_t>(rowMajor.fingerprint(0)) % CacheLineSize);
+  for (unsigned int i = 0; i < n; ++i) {
+    COMPARE(fingerprints[i * words + 2], rowMajor.fingerprint(n + i)[2]);
+    COMPARE(0, rowMajor.fingerprint(n + i)[words]);
+  }
+
+  InMemoryColumnMajorFingerprintStorage columnMajor;
+  columnMajor.load("tmp_padded_column_major.fps.hel");
+  COMPARE(24, columnMajor.stride());
+  COMPARE(0, reinterpret_cast<std::size_t>(columnMajor.bit(0)) % CacheLineSize);
+  for (unsigned int i = 0; i < bits; ++i) {
+    unsigned int count = 0;
+    for (unsigned int j = 0; j < n; ++j) {
+      bool expected = bitvec_get(i, &fingerprints[j * words]);
+      COMPARE(expected, bitvec_get(j, columnMajor.bit(i)));
+      count += expected;
+    }
+    COMPARE(count, columnMajor.columnCount(i));
+    for (unsigned int j = 18; j < 24; ++j)
+      COMPARE(0, columnMajor.bit(i)[j]);
+  }
+  for (unsigned int i = 0; i < n; ++i)
+    COMPARE(rowMajor.bitCount(i), columnMajor.bitCount(i));
+}
+
+void test_brute_force(const std::vector<Word> &fingerprints, double Tmin)
+{
+  std::cout << "Testing brute_force_similarity_search(Tmin = " << Tmin << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_row_major.fps.hel");
+
+  for (unsigned int q = 0; q < 20; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected = naive_search(query, fingerprints, Tmin);
+    std::vector<std::pair<unsigned int, double> > result = brute_force_similarity_search(query, storage, Tmin);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        COMPARE(expected[i].first, result[i].first);
+        COMPARE(expected[i].second, result[i].second);
+      }
+  }
+}
+
+void test_memory_mapped_storages(const std::vector<Word> &fingerprints, double Tmin)
+{
+  std::cout << "Testing memory mapped storages(Tmin = " << Tmin << ")..." << std::endl;
+  MemoryMappedRowMajorFingerprintStorage rowMajor("tmp_row_major.fps.hel", SequentialAdvice);
+  MemoryMappedColumnMajorFingerprintStorage columnMajor("tmp_column_major.fps.hel", RandomAdvice);
+
+  COMPARE(numBits, rowMajor.numBits());
+  COMPARE(numBits, columnMajor.numBits());
+  COMPARE(numFingerprints, rowMajor.numFingerprints());
+  COMPARE(numFingerprints, columnMajor.numFingerprints());
+  ASSERT(rowMajor.popcountOffsets().empty());
+  for (unsigned int i = 0; i < numFingerprints; ++i) {
+    ASSERT(std::equal(rowMajor.fingerprint(i), rowMajor.fingerprint(i) + numWords, &fingerprints[i * numWords]));
+    int count = bitvec_count(&fingerprints[i * numWords], numWords);
+    COMPARE(count, rowMajor.bitCount(i));
+    COMPARE(count, columnMajor.bitCount(i));
+  }
+  for (unsigned int i = 0; i < numBits; ++i) {
+    unsigned int count = 0;
+    for (unsigned int j = 0; j < numFingerprints; ++j)
+      if (bitvec_get(i, &fingerprints[j * numWords])) {
+        ASSERT(bitvec_get(j, columnMajor.bit(i)));
+        ++count;
+      }
+    COMPARE(count, columnMajor.columnCount(i));
+  }
+
+  for (unsigned int q = 0; q < 10; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected = naive_search(query, fingerprints, Tmin);
+    std::vector<std::pair<unsigned int, double> > result = brute_force_similarity_search(query, rowMajor, Tmin);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        COMPARE(expected[i].first, result[i].first);
+        COMPARE(expected[i].second, result[i].second);
+      }
+  }
+
+  // sorted files have popcount offsets
+  InMemoryRowMajorFingerprintStorage inMemorySorted;
+  inMemorySorted.load("tmp_sorted.fps.hel");
+  MemoryMappedRowMajorFingerprintStorage sorted("tmp_sorted.fps.hel");
+  ASSERT(!sorted.popcountOffsets().empty());
+  ASSERT(inMemorySorted.popcountOffsets() == sorted.popcountOffsets());
+
+  // wrong order
+  bool thrown = false;
+  try {
+    MemoryMappedRowMajorFingerprintStorage wrong("tmp_column_major.fps.hel");
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  ASSERT(thrown);
+}
+
+void test_batch_brute_force(const std::string &filename, double Tmin)
+{
+  std::cout << "Testing brute_force_similarity_search_batch(" << filename << ", Tmin = " << Tmin << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load(filename);
+
+  std::vector<Word*> queries;
+  for (unsigned int q = 0; q < 50; ++q)
+    queries.push_back(storage.fingerprint(q * 7));
+
+  std::vector<std::vector<std::pair<unsigned int, double> > > result = brute_force_similarity_search_batch(queries, storage, Tmin);
+  COMPARE(queries.size(), result.size());
+#ifdef HAVE_CPP11
+  std::vector<std::vector<std::pair<unsigned int, double> > > threaded = brute_force_similarity_search_batch_threaded(queries, storage, Tmin);
+  COMPARE(queries.size(), threaded.size());
+#endif
+
+  for (std::size_t q = 0; q < queries.size(); ++q) {
+    std::vector<std::pair<unsigned int, double> > expected = brute_force_similarity_search(queries[q], storage, Tmin);
+    COMPARE(expected.size(), result[q].size());
+    if (expected.size() == result[q].size())
+      for (std::size_t i = 0; i < expected.size(); ++i) {
+        COMPARE(expected[i].first, result[q][i].first);
+        COMPARE(expected[i].second, result[q][i].second);
+      }
+#ifdef HAVE_CPP11
+    COMPARE(expected.size(), threaded[q].size());
+    if (expected.size() == threaded[q].size())
+      for (std::size_t i = 0; i < expected.size(); ++i)
+        COMPARE(expected[i].first, threaded[q][i].first);
+#endif
+  }
+}
+
+void test_nxn_brute_force(const std::string &filename, unsigned int N, double Tmin)
+{
+  std::cout << "Testing brute_force_similarity_search_nxn(" << filename << ", N = " << N << ", Tmin = " << Tmin << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load(filename);
+
+  std::vector<std::vector<std::pair<unsigned int, double> > > result = brute_force_similarity_search_nxn(storage, N, Tmin);
+  COMPARE(storage.numFingerprints(), result.size());
+#ifdef HAVE_CPP11
+  ThreadPool pool(3);
+  std::vector<std::vector<std::pair<unsigned int, double> > > threaded = brute_force_similarity_search_nxn_threaded(storage, N, Tmin, pool);
+  COMPARE(storage.numFingerprints(), threaded.size());
+#endif
+
+  for (unsigned int i = 0; i < storage.numFingerprints(); ++i) {
+    std::vector<std::pair<unsigned int, double> > expected = brute_force_knn_search(storage.fingerprint(i), storage, N, Tmin);
+    COMPARE(expected.size(), result[i].size());
+    if (expected.size() == result[i].size())
+      for (std::size_t j = 0; j < expected.size(); ++j) {
+        COMPARE(expected[j].first, result[i][j].first);
+        COMPARE(expected[j].second, result[i][j].second);
+      }
+#ifdef HAVE_CPP11
+    COMPARE(expected.size(), threaded[i].size());
+    if (expected.size() == threaded[i].size())
+      for (std::size_t j = 0; j < expected.size(); ++j)
+        COMPARE(expected[j].first, threaded[i][j].first);
+#endif
+  }
+}
+
+void test_nxn_tiles(const std::string &filename, unsigned int N, double Tmin, unsigned int numTiles, bool symmetric)
+{
+  std::cout << "Testing brute_force_similarity_search_nxn_tile(" << filename << ", N = " << N << ", Tmin = " << Tmin
+            << ", tiles = " << numTiles << ", symmetric = " << symmetric << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load(filename);
+  const unsigned int n = storage.numFingerprints();
+
+  std::vector<std::vector<std::pair<unsigned int, double> > > expected = brute_force_similarity_search_nxn(storage, N, Tmin);
+
+  // combine the tiles (the symmetric tiles below the diagonal are empty)
+  std::vector<std::vector<std::pair<unsigned int, double> > > result(n);
+  unsigned int tileSize = (n + numTiles - 1) / numTiles;
+  for (unsigned int I = 0; I < numTiles; ++I)
+    for (unsigned int J = 0; J < numTiles; ++J) {
+      std::vector<std::pair<unsigned int, std::vector<std::pair<unsigned int, double> > > > tile =
+        brute_force_similarity_search_nxn_tile(storage, std::min(n, I * tileSize), std::min(n, (I + 1) * tileSize),
+            std::min(n, J * tileSize), std::min(n, (J + 1) * tileSize), N, Tmin, symmetric);
+      if (symmetric && J < I)
+        COMPARE(0, tile.size());
+      for (std::size_t r = 0; r < tile.size(); ++r) {
+        if (r)
+          ASSERT(tile[r - 1].first < tile[r].first);
+        merge_nxn_hits(result[tile[r].first], tile[r].second, N);
+      }
+    }
+
+  // merging the same hits again has no effect
+  std::vector<std::pair<unsigned int, double> > duplicate = expected[0];
+  merge_nxn_hits(duplicate, expected[0], N);
+  COMPARE(expected[0].size(), duplicate.size());
+
+  for (unsigned int i = 0; i < n; ++i) {
+    COMPARE(expected[i].size(), result[i].size());
+    if (expected[i].size() == result[i].size())
+      for (std::size_t j = 0; j < expected[i].size(); ++j) {
+        COMPARE(expected[i][j].first, result[i][j].first);
+        COMPARE(expected[i][j].second, result[i][j].second);
+      }
+  }
+}
+
+#ifdef HAVE_CPP11
+void test_partitioned_load(const std::string &filename, double Tmin)
+{
+  std::cout << "Testing partitioned load(" << filename << ", Tmin = " << Tmin << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage expected, storage;
+  expected.load(filename);
+  // pinned threads (more threads than CPUs are spread over the CPUs)
+  ThreadPool pool(4, true);
+  storage.load(filename, pool);
+
+  COMPARE(expected.numFingerprints(), storage.numFingerprints());
+  COMPARE(expected.stride(), storage.stride());
+  COMPARE(expected.popcountOffsets().size(), storage.popcountOffsets().size());
+  unsigned int words = bitvec_num_words_for_bits(storage.numBits());
+  for (unsigned int i = 0; i < storage.numFingerprints(); ++i) {
+    COMPARE(expected.bitCount(i), storage.bitCount(i));
+    for (unsigned int j = 0; j < storage.stride(); ++j)
+      COMPARE(j < words ? expected.fingerprint(i)[j] : 0, storage.fingerprint(i)[j]);
+  }
+
+  for (unsigned int q = 0; q < 10; ++q) {
+    const Word *query = expected.fingerprint(q * 11);
+    std::vector<std::pair<unsigned int, double> > hits = brute_force_similarity_search(query, expected, Tmin);
+    std::vector<std::pair<unsigned int, double> > threaded = brute_force_similarity_search_threaded(query, storage, Tmin, pool);
+    COMPARE(hits.size(), threaded.size());
+    if (hits.size() == threaded.size())
+      for (std::size_t i = 0; i < hits.size(); ++i)
+        COMPARE(hits[i].first, threaded[i].first);
+  }
+}
+#endif
+
+bool better_hit(const std::pair<unsigned int, double> &left, const std::pair<unsigned int, double> &right)
+{
+  if (left.second != right.second)
+    return left.second > right.second;
+  return left.first < right.first;
+}
+
+/**
+ * Hit sink that collects at most maxHits hits.
+ */
+struct CollectHits
+{
+  CollectHits(unsigned int maxHits_ = 0) : maxHits(maxHits_)
+  {
+  }
+
+  bool operator()(unsigned int index, double score)
+  {
+    hits.push_back(std::make_pair(index, score));
+    return hits.size() != maxHits;
+  }
+
+  unsigned int maxHits;
+  std::vector<std::pair<unsigned int, double> > hits;
+};
+
+void test_bitsliced_search(const std::vector<Word> &fingerprints, double Tmin)
+{
+  std::cout << "Testing bitsliced_similarity_search(Tmin = " << Tmin << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage rowMajor;
+  rowMajor.load("tmp_row_major.fps.hel");
+  InMemoryColumnMajorFingerprintStorage columnMajor;
+  columnMajor.load("tmp_column_major.fps.hel");
+#ifdef HAVE_CPP11
+  ThreadPool pool(3);
+#endif
+
+  for (unsigned int q = 0; q < 20; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected = brute_force_similarity_search(query, rowMajor, Tmin);
+    COMPARE(expected, bitsliced_similarity_search(query, columnMajor, Tmin));
+#ifdef HAVE_CPP11
+    COMPARE(expected, bitsliced_similarity_search_threaded(query, columnMajor, Tmin, pool));
+#endif
+  }
+
+  // the streaming search stops when the sink returns false
+  std::vector<std::pair<unsigned int, double> > expected = brute_force_similarity_search(&fingerprints[0], rowMajor, Tmin);
+  CollectHits first(3);
+  ASSERT(!bitsliced_similarity_search(&fingerprints[0], columnMajor, Tmin, first));
+  COMPARE(3, first.hits.size());
+  ASSERT(std::equal(first.hits.begin(), first.hits.end(), expected.begin()));
+}
+
+void test_streaming_search(const std::vector<Word> &fingerprints, double Tmin)
+{
+  std::cout << "Testing streaming searches (Tmin = " << Tmin << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_row_major.fps.hel");
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, 3);
+#ifdef HAVE_CPP11
+  ThreadPool pool(3);
+#endif
+
+  for (unsigned int q = 0; q < 20; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected = naive_search(query, fingerprints, Tmin);
+
+    // all hits are reported
+    CollectHits all;
+    ASSERT(brute_force_similarity_search(query, storage, Tmin, all));
+    COMPARE(expected.size(), all.hits.size());
+    if (expected.size() == all.hits.size())
+      for (std::size_t i = 0; i < all.hits.size(); ++i) {
+        COMPARE(expected[i].first, all.hits[i].first);
+        COMPARE(expected[i].second, all.hits[i].second);
+      }
+
+    CollectHits indexAll;
+    ASSERT(index.search(query, Tmin, indexAll));
+    std::sort(indexAll.hits.begin(), indexAll.hits.end());
+    COMPARE(expected.size(), indexAll.hits.size());
+
+#ifdef HAVE_CPP11
+    CollectHits threadedAll;
+    ASSERT(brute_force_similarity_search_threaded(query, storage, Tmin, threadedAll, pool));
+    std::sort(threadedAll.hits.begin(), threadedAll.hits.end());
+    COMPARE(expected.size(), threadedAll.hits.size());
+#endif
+
+    // the sink stops the search
+    if (expected.size() < 3)
+      continue;
+    CollectHits first(3);
+    ASSERT(!brute_force_similarity_search(query, storage, Tmin, first));
+    COMPARE(3, first.hits.size());
+    for (std::size_t i = 0; i < first.hits.size(); ++i)
+      COMPARE(expected[i].first, first.hits[i].first);
+
+    CollectHits indexFirst(3);
+    ASSERT(!index.search(query, Tmin, indexFirst));
+    COMPARE(3, indexFirst.hits.size());
+
+#ifdef HAVE_CPP11
+    CollectHits threadedFirst(3);
+    ASSERT(!brute_force_similarity_search_threaded(query, storage, Tmin, threadedFirst, pool));
+    COMPARE(3, threadedFirst.hits.size());
+#endif
+  }
+}
+
+void test_index_search(const std::vector<Word> &fingerprints, int k, double Tmin, bool frozen = false)
+{
+  std::cout << "Testing SimilaritySearchIndex::search(k = " << k << ", Tmin = " << Tmin << ", frozen = " << frozen << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_row_major.fps.hel");
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, k);
+  if (frozen) {
+    index.freeze();
+    ASSERT(index.isFrozen());
+  }
+
+  for (unsigned int q = 0; q < 20; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected = naive_search(query, fingerprints, Tmin);
+    std::vector<std::pair<unsigned int, double> > result = index.search(query, Tmin);
+    std::sort(result.begin(), result.end());
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(expected[i].first, result[i].first);
+  }
+}
+
+void test_stored_statistics(const std::vector<Word> &fingerprints, int k)
+{
+  std::cout << "Testing stored statistics (k = " << k << ")..." << std::endl;
+  {
+    RowMajorFingerprintOutputFile file("tmp_statistics.fps.hel", numBits, true, k);
+    for (unsigned int i = 0; i < numFingerprints; ++i)
+      file.writeFingerprint(const_cast<Word*>(&fingerprints[i * numWords]));
+    Json::Reader reader;
+    Json::Value data;
+    reader.parse(fingerprint_header("row-major", numBits, numFingerprints), data);
+    ASSERT(file.writeStatistics(data));
+    Json::FastWriter writer;
+    ASSERT(file.writeHeader(writer.write(data)));
+  }
+
+  // the expected column counts
+  std::vector<unsigned int> columnCounts(numBits, 0);
+  for (unsigned int i = 0; i < numFingerprints; ++i)
+    for (unsigned int j = 0; j < numBits; ++j)
+      if (bitvec_get(j, &fingerprints[i * numWords]))
+        ++columnCounts[j];
+
+  InMemoryRowMajorFingerprintStorage inMemory;
+  inMemory.load("tmp_statistics.fps.hel");
+  MemoryMappedRowMajorFingerprintStorage mapped("tmp_statistics.fps.hel");
+  COMPARE(columnCounts, inMemory.columnCounts());
+  COMPARE(columnCounts, mapped.columnCounts());
+  ASSERT(inMemory.partCounts(k));
+  ASSERT(mapped.partCounts(k));
+  ASSERT(!inMemory.partCounts(k + 1));
+  ASSERT(!mapped.partCounts(k + 1));
+  for (unsigned int i = 0; i < numFingerprints; ++i) {
+    const Word *fingerprint = &fingerprints[i * numWords];
+    COMPARE(bitvec_count(fingerprint, numWords), inMemory.bitCount(i));
+    COMPARE(bitvec_count(fingerprint, numWords), mapped.bitCount(i));
+    for (int j = 0; j < k; ++j) {
+      COMPARE(bitvec_part_count(fingerprint, numBits, k, j), inMemory.partCounts(k)[i * k + j]);
+      COMPARE(bitvec_part_count(fingerprint, numBits, k, j), mapped.partCounts(k)[i * k + j]);
+    }
+  }
+
+  // files without statistics
+  InMemoryRowMajorFingerprintStorage plain;
+  plain.load("tmp_row_major.fps.hel");
+  ASSERT(plain.columnCounts().empty());
+  ASSERT(!plain.partCounts(k));
+
+  // appending updates the statistics
+  inMemory.append(&fingerprints[0]);
+  for (unsigned int j = 0; j < numBits; ++j)
+    COMPARE(columnCounts[j] + (bitvec_get(j, &fingerprints[0]) ? 1 : 0), inMemory.columnCounts()[j]);
+  for (int j = 0; j < k; ++j)
+    COMPARE(inMemory.partCounts(k)[j], inMemory.partCounts(k)[numFingerprints * k + j]);
+
+  // the index built from the stored part counts gives the same results
+  MemoryMappedRowMajorFingerprintStorage storage("tmp_statistics.fps.hel");
+  SimilaritySearchIndex<MemoryMappedRowMajorFingerprintStorage> index(storage, k);
+  for (unsigned int q = 0; q < 20; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected = naive_search(query, fingerprints, 0.5);
+    std::vector<std::pair<unsigned int, double> > result = index.search(query, 0.5);
+    std::sort(result.begin(), result.end());
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(expected[i].first, result[i].first);
+  }
+}
+
+void test_knn_search(const std::vector<Word> &fingerprints, int k, unsigned int N, double Tmin, bool frozen = false)
+{
+  std::cout << "Testing SimilaritySearchIndex::knnSearch(k = " << k << ", N = " << N << ", Tmin = " << Tmin << ", frozen = " << frozen << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_row_major.fps.hel");
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, k);
+  if (frozen)
+    index.freeze();
+
+  for (unsigned int q = 0; q < 50; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected = naive_search(query, fingerprints, Tmin);
+    std::sort(expected.begin(), expected.end(), better_hit);
+    expected.resize(std::min<std::size_t>(N, expected.size()));
+
+    std::vector<std::pair<unsigned int, double> > result = index.knnSearch(query, N, Tmin);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        COMPARE(expected[i].first, result[i].first);
+        COMPARE(expected[i].second, result[i].second);
+      }
+  }
+}
+
+double hamming_similarity(const Word *bitvec1, const Word *bitvec2, int numWords)
+{
+  return 1.0 - bitvec_hamming(bitvec1, bitvec2, numWords) / numBits;
+}
+
+template<typename Metric>
+void test_metric_search(const std::vector<Word> &fingerprints, double (*reference)(const Word*, const Word*, int),
+    int k, unsigned int N, double Tmin, bool frozen)
+{
+  std::cout << "Testing SimilaritySearchIndex<" << Metric::name() << ">(k = " << k << ", N = " << N
+            << ", Tmin = " << Tmin << ", frozen = " << frozen << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_row_major.fps.hel");
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage, Metric> index(storage, k);
+  if (frozen)
+    index.freeze();
+
+  for (unsigned int q = 0; q < 30; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected;
+    for (unsigned int i = 0; i < numFingerprints; ++i) {
+      double S = reference(query, &fingerprints[i * numWords], numWords);
+      if (S >= Tmin)
+        expected.push_back(std::make_pair(i, S));
+    }
+
+    std::vector<std::pair<unsigned int, double> > result = index.search(query, Tmin);
+    std::sort(result.begin(), result.end());
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        COMPARE(expected[i].first, result[i].first);
+        COMPARE(expected[i].second, result[i].second);
+      }
+
+    std::sort(expected.begin(), expected.end(), better_hit);
+    expected.resize(std::min<std::size_t>(N, expected.size()));
+    result = index.knnSearch(query, N, Tmin);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(expected[i].first, result[i].first);
+  }
+}
+
+/**
+ * Write the fingerprints sorted by population count, the sorted fingerprints
+ * are returned.
+ */
+std::vector<Word> write_sorted_fingerprint_file(const std::vector<Word> &fingerprints)
+{
+  std::vector<Word> sorted;
+  std::vector<unsigned int> offsets;
+  for (unsigned int c = 0; c <= numBits; ++c) {
+    offsets.push_back(sorted.size() / numWords);
+    for (unsigned int i = 0; i < numFingerprints; ++i)
+      if (bitvec_count(&fingerprints[i * numWords], numWords) == static_cast<int>(c))
+        std::copy(&fingerprints[i * numWords], &fingerprints[i * numWords] + numWords, std::back_inserter(sorted));
+  }
+  offsets.push_back(numFingerprints);
+
+  RowMajorFingerprintOutputFile file("tmp_sorted.fps.hel", numBits);
+  for (unsigned int i = 0; i < numFingerprints; ++i)
+    file.writeFingerprint(&sorted[i * numWords]);
+
+  std::stringstream ss;
+  ss << "{ \"filetype\": \"fingerprints\", \"order\": \"row-major\", \"num_bits\": " << numBits
+     << ", \"num_fingerprints\": " << numFingerprints << ", \"popcount_offsets\": [";
+  for (std::size_t c = 0; c < offsets.size(); ++c)
+    ss << (c ? ", " : "") << offsets[c];
+  ss << "] }";
+  file.writeHeader(ss.str());
+
+  return sorted;
+}
+
+void test_sorted_brute_force(const std::vector<Word> &fingerprints, const std::vector<Word> &sorted, double Tmin, unsigned int N)
+{
+  std::cout << "Testing brute force search on sorted fingerprints (Tmin = " << Tmin << ", N = " << N << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_sorted.fps.hel");
+  COMPARE(numBits + 2, storage.popcountOffsets().size());
+
+  for (unsigned int q = 0; q < 20; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected = naive_search(query, sorted, Tmin);
+
+    std::vector<std::pair<unsigned int, double> > result = brute_force_similarity_search(query, storage, Tmin);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(expected[i].first, result[i].first);
+
+#ifdef HAVE_CPP11
+    result = brute_force_similarity_search_threaded(query, storage, Tmin);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(expected[i].first, result[i].first);
+#endif
+
+    std::sort(expected.begin(), expected.end(), better_hit);
+    expected.resize(std::min<std::size_t>(N, expected.size()));
+    result = brute_force_knn_search(query, storage, N, Tmin);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        COMPARE(expected[i].first, result[i].first);
+        COMPARE(expected[i].second, result[i].second);
+      }
+  }
+}
+
+void test_folded_search(const std::string &filename, unsigned int foldedBits, double Tmin, unsigned int N)
+{
+  std::cout << "Testing FoldedSimilaritySearch(" << filename << ", bits = " << foldedBits << ", Tmin = " << Tmin
+            << ", N = " << N << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load(filename);
+  FoldedSimilaritySearch<InMemoryRowMajorFingerprintStorage> folded(storage, foldedBits);
+  COMPARE(foldedBits, folded.foldedBits());
+  ASSERT(folded.memoryUsage().heap >= storage.numFingerprints() * foldedBits / 8);
+
+  // the results are exactly the same as for the full width search
+  for (unsigned int q = 0; q < 40; ++q) {
+    const Word *query = storage.fingerprint(q * 37);
+    ASSERT(folded.search(query, Tmin) == brute_force_similarity_search(query, storage, Tmin));
+    ASSERT(folded.knnSearch(query, N, Tmin) == brute_force_knn_search(query, storage, N, Tmin));
+  }
+
+  // an expired token stops the search
+  CancellationToken token(1);
+  token.cancel();
+  ASSERT(folded.search(storage.fingerprint(0), Tmin, &token).empty());
+}
+
+void compare_updated_index(const SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> &index,
+    const InMemoryRowMajorFingerprintStorage &storage, const std::vector<bool> &live)
+{
+  COMPARE(std::count(live.begin(), live.end(), true), index.numFingerprints());
+#ifdef HAVE_CPP11
+  ThreadPool pool(3);
+#endif
+
+  for (unsigned int q = 0; q < storage.numFingerprints(); q += 50) {
+    const Word *query = storage.fingerprint(q);
+    // the scores for an empty query are undefined
+    if (!bitvec_count(query, numWords))
+      continue;
+    std::vector<std::pair<unsigned int, double> > expected;
+    for (unsigned int i = 0; i < storage.numFingerprints(); ++i) {
+      double T = bitvec_tanimoto(query, storage.fingerprint(i), numWords);
+      if (live[i] && T >= 0.4)
+        expected.push_back(std::make_pair(i, T));
+    }
+
+    std::vector<std::pair<unsigned int, double> > result = index.search(query, 0.4);
+    std::sort(result.begin(), result.end());
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(expected[i].first, result[i].first);
+
+    std::sort(expected.begin(), expected.end(), better_hit);
+    expected.resize(std::min<std::size_t>(10, expected.size()));
+    result = index.knnSearch(query, 10, 0.4);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(expected[i].first, result[i].first);
+
+#ifdef HAVE_CPP11
+    std::vector<std::pair<unsigned int, double> > parallel = index.parallelKnnSearch(query, 10, 0.4, pool);
+    COMPARE(result.size(), parallel.size());
+    if (result.size() == parallel.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(result[i].first, parallel[i].first);
+
+    result = index.search(query, 0.4);
+    parallel = index.parallelSearch(query, 0.4, pool);
+    COMPARE(result.size(), parallel.size());
+    if (result.size() == parallel.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(result[i].first, parallel[i].first);
+#endif
+  }
+}
+
+void test_incremental_updates(const std::vector<Word> &fingerprints, int k, bool frozen)
+{
+  std::cout << "Testing SimilaritySearchIndex::insert/remove(k = " << k << ", frozen = " << frozen << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_row_major.fps.hel");
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, k);
+  if (frozen)
+    index.freeze();
+  std::vector<bool> live(numFingerprints, true);
+
+  // remove some fingerprints
+  for (unsigned int i = 0; i < numFingerprints; i += 7) {
+    ASSERT(index.remove(i));
+    live[i] = false;
+  }
+  ASSERT(!index.remove(7));
+
+  // append fingerprints similar to the first ones
+  std::vector<Word> fingerprint(numWords);
+  for (unsigned int i = 0; i < 100; ++i) {
+    std::copy(&fingerprints[i * numWords], &fingerprints[i * numWords] + numWords, &fingerprint[0]);
+    bitvec_set(i, &fingerprint[0]);
+    unsigned int index_ = storage.append(&fingerprint[0]);
+    COMPARE(numFingerprints + i, index_);
+    ASSERT(index.insert(index_));
+    live.push_back(true);
+  }
+  ASSERT(!index.insert(numFingerprints));
+
+  // restore and remove again
+  ASSERT(index.insert(14));
+  live[14] = true;
+  ASSERT(index.remove(numFingerprints + 5));
+  live[numFingerprints + 5] = false;
+  ASSERT(!index.remove(numFingerprints + 5));
+
+  COMPARE(frozen, index.hasPendingUpdates());
+  compare_updated_index(index, storage, live);
+
+  index.merge();
+  ASSERT(!index.hasPendingUpdates());
+  COMPARE(frozen, index.isFrozen());
+  compare_updated_index(index, storage, live);
+}
+
+void test_index_file(const std::vector<Word> &fingerprints, int k)
+{
+  std::cout << "Testing SimilaritySearchIndex::save(k = " << k << ")..." << std::endl;
+  {
+    InMemoryRowMajorFingerprintStorage storage;
+    storage.load("tmp_row_major.fps.hel");
+    SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, k);
+    index.freeze();
+    index.save("tmp_similarity_index.hel");
+  }
+
+  // the loaded index does not need the fingerprint storage
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index("tmp_similarity_index.hel");
+  ASSERT(index.isFrozen());
+  COMPARE(numBits, index.numBits());
+  COMPARE(numFingerprints, index.numFingerprints());
+
+  for (unsigned int q = 0; q < 20; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected = naive_search(query, fingerprints, 0.5);
+    std::vector<std::pair<unsigned int, double> > result = index.search(query, 0.5);
+    std::sort(result.begin(), result.end());
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(expected[i].first, result[i].first);
+
+    std::sort(expected.begin(), expected.end(), better_hit);
+    expected.resize(std::min<std::size_t>(10, expected.size()));
+    result = index.knnSearch(query, 10, 0.5);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(expected[i].first, result[i].first);
+  }
+}
+
+void test_memory_usage(int k)
+{
+  std::cout << "Testing memoryUsage(k = " << k << ")..." << std::endl;
+  const std::string rowMajorFile = "tmp_row_major.fps.hel";
+  const std::string columnMajorFile = "tmp_column_major.fps.hel";
+
+  InMemoryRowMajorFingerprintStorage rowMajor;
+  rowMajor.load(rowMajorFile);
+  MemoryUsage usage = rowMajor.memoryUsage();
+  COMPARE(InMemoryRowMajorFingerprintStorage::estimateMemoryUsage(rowMajorFile).heap, usage.heap);
+  COMPARE(0, usage.mapped);
+  COMPARE(usage.heap, usage.resident);
+  ASSERT(usage.heap >= numFingerprints * (numWords * sizeof(Word) + sizeof(int)));
+
+  InMemoryColumnMajorFingerprintStorage columnMajor;
+  columnMajor.load(columnMajorFile);
+  ASSERT(columnMajor.memoryUsage().heap >= InMemoryColumnMajorFingerprintStorage::estimateMemoryUsage(columnMajorFile).heap);
+
+  // the mapped files are fully accounted for, only the touched pages are resident
+  MemoryMappedRowMajorFingerprintStorage mappedRowMajor(rowMajorFile);
+  usage = mappedRowMajor.memoryUsage();
+  MemoryUsage estimate = MemoryMappedRowMajorFingerprintStorage::estimateMemoryUsage(rowMajorFile);
+  COMPARE(file_size(rowMajorFile), usage.mapped);
+  COMPARE(estimate.mapped, usage.mapped);
+  COMPARE(estimate.heap, usage.heap);
+  ASSERT(usage.resident <= usage.heap + usage.mapped);
+
+  MemoryMappedColumnMajorFingerprintStorage mappedColumnMajor(columnMajorFile);
+  usage = mappedColumnMajor.memoryUsage();
+  COMPARE(file_size(columnMajorFile), usage.mapped);
+  COMPARE(MemoryMappedColumnMajorFingerprintStorage::estimateMemoryUsage(columnMajorFile).mapped, usage.mapped);
+
+  // the dynamic kD-grid does not include the storage
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(rowMajor, k);
+  usage = index.memoryUsage();
+  ASSERT(usage.heap > numFingerprints * sizeof(unsigned int));
+  COMPARE(0, usage.mapped);
+
+  // the frozen index contains a copy of the fingerprints
+  index.freeze();
+  usage = index.memoryUsage();
+  ASSERT(usage.heap >= numFingerprints * numWords * sizeof(Word));
+  ASSERT(usage.heap <= SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage>::estimateMemoryUsage(numFingerprints, numBits, k).heap);
+
+  index.save("tmp_memory_usage_index.hel");
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> loaded("tmp_memory_usage_index.hel");
+  usage = loaded.memoryUsage();
+  COMPARE(file_size("tmp_memory_usage_index.hel"), usage.mapped);
+  COMPARE(SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage>::estimateMemoryUsage("tmp_memory_usage_index.hel").mapped, usage.mapped);
+  ASSERT(usage.resident <= usage.total());
+}
+
+void test_k_tuning(const std::vector<Word> &fingerprints, double Tmin)
+{
+  std::cout << "Testing tune_similarity_index_k(Tmin = " << Tmin << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_row_major.fps.hel");
+
+  SimilarityIndexTuning tuning = tune_similarity_index_k(storage, Tmin, 20, 4, 2);
+  COMPARE(20, tuning.numQueries);
+  COMPARE(4, tuning.trials.size());
+  ASSERT(tuning.k >= 1 && tuning.k <= 4);
+  for (std::size_t i = 0; i < tuning.trials.size(); ++i) {
+    const SimilarityIndexTrial &trial = tuning.trials[i];
+    COMPARE(i + 1, trial.k);
+    ASSERT(trial.numLeaves > 0 && trial.numLeaves <= numFingerprints);
+    COMPARE(static_cast<double>(numFingerprints) / trial.numLeaves, trial.leafOccupancy);
+    ASSERT(trial.meanScored <= numFingerprints);
+    ASSERT(tuning.trials[tuning.k - 1].meanMicroseconds <= trial.meanMicroseconds);
+  }
+
+  // the scored fingerprints include all hits
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, tuning.k, 2);
+  COMPARE(tuning.k, index.k());
+  COMPARE(tuning.trials[tuning.k - 1].numLeaves, index.numLeaves());
+  for (unsigned int q = 0; q < 20; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    ASSERT(index.numScored(query, Tmin) >= naive_search(query, fingerprints, Tmin).size());
+  }
+
+  // the tuning is stored in the header of the index file
+  Json::Value attributes;
+  attributes["k_tuning"] = tuning.json();
+  index.save("tmp_tuned_index.hel", attributes);
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> loaded("tmp_tuned_index.hel");
+  COMPARE(tuning.k, loaded.k());
+  Json::Reader reader;
+  Json::Value header;
+  ASSERT(reader.parse(loaded.header(), header));
+  COMPARE(tuning.k, header["k"].asInt());
+  COMPARE(tuning.k, header["k_tuning"]["k"].asInt());
+  COMPARE(4, header["k_tuning"]["trials"].size());
+  COMPARE(20, header["k_tuning"]["num_queries"].asUInt());
+}
+
+std::string read_file(const std::string &filename)
+{
+  std::ifstream ifs(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  return ss.str();
+}
+
+void test_parallel_build(const std::vector<Word> &fingerprints, int k, unsigned int numThreads)
+{
+  std::cout << "Testing SimilaritySearchIndex parallel build (k = " << k << ", threads = " << numThreads << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_row_major.fps.hel");
+
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> expected(storage, k);
+  expected.freeze();
+  expected.save("tmp_similarity_index.hel");
+
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, k, numThreads);
+  ASSERT(index.isFrozen());
+  index.save("tmp_similarity_index_parallel.hel");
+
+  // the layout must be the same as for the frozen tree
+  ASSERT(read_file("tmp_similarity_index.hel") == read_file("tmp_similarity_index_parallel.hel"));
+
+  for (unsigned int q = 0; q < 20; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expectedHits = expected.knnSearch(query, 10, 0.3);
+    std::vector<std::pair<unsigned int, double> > hits = index.knnSearch(query, 10, 0.3);
+    COMPARE(expectedHits.size(), hits.size());
+    if (expectedHits.size() == hits.size())
+      for (std::size_t i = 0; i < hits.size(); ++i)
+        COMPARE(expectedHits[i].first, hits[i].first);
+  }
+}
+
+#ifdef HAVE_CPP11
+void test_parallel_search(const std::vector<Word> &fingerprints, int k, bool frozen)
+{
+  std::cout << "Testing SimilaritySearchIndex::parallelSearch(k = " << k << ", frozen = " << frozen << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_row_major.fps.hel");
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, k);
+  if (frozen)
+    index.freeze();
+
+  ThreadPool pool(3);
+  for (unsigned int q = 0; q < 20; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+
+    std::vector<std::pair<unsigned int, double> > expected = index.search(query, 0.4);
+    std::vector<std::pair<unsigned int, double> > result = index.parallelSearch(query, 0.4, pool);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i)
+        COMPARE(expected[i].first, result[i].first);
+
+    expected = index.knnSearch(query, 10, 0.1);
+    result = index.parallelKnnSearch(query, 10, 0.1, pool);
+    COMPARE(expected.size(), result.size());
+    if (expected.size() == result.size())
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        COMPARE(expected[i].first, result[i].first);
+        COMPARE(expected[i].second, result[i].second);
+      }
+  }
+}
+#endif
+
+void test_cancelled_search(const std::vector<Word> &fingerprints, double Tmin)
+{
+  std::cout << "Testing cancelled similarity searches (Tmin = " << Tmin << ")..." << std::endl;
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_row_major.fps.hel");
+  SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, 3);
+
+  for (unsigned int q = 0; q < 20; ++q) {
+    const Word *query = &fingerprints[q * numWords];
+    std::vector<std::pair<unsigned int, double> > expected = naive_search(query, fingerprints, Tmin);
+
+    // a token without deadline does not change the results
+    CancellationToken token;
+    CollectHits all;
+    ASSERT(brute_force_similarity_search(query, storage, Tmin, all, &token));
+    COMPARE(expected.size(), all.hits.size());
+    COMPARE(expected.size(), index.search(query, Tmin, 0, token).size());
+    COMPARE(index.knnSearch(query, 5, Tmin).size(), index.knnSearch(query, 5, Tmin, token).size());
+    ASSERT(!token.isCancelled());
+
+    // a cancelled token stops the searches
+    CancellationToken cancelled;
+    cancelled.cancel();
+    CollectHits none;
+    ASSERT(!brute_force_similarity_search(query, storage, Tmin, none, &cancelled));
+    COMPARE(0, none.hits.size());
+    ASSERT(index.search(query, Tmin, 0, cancelled).size() <= expected.size());
+    ASSERT(index.knnSearch(query, 5, Tmin, cancelled).size() <= 5);
+#ifdef HAVE_CPP11
+    ThreadPool pool(2);
+    CollectHits threaded;
+    ASSERT(!brute_force_similarity_search_threaded(query, storage, Tmin, threaded, pool, &cancelled));
+    COMPARE(0, threaded.hits.size());
+#endif
+    ASSERT(cancelled.isCancelled());
+  }
+}
+
+#ifdef HAVE_OPENCL
+void test_opencl_knn_search(const std::vector<Word> &fingerprints, unsigned int k, double Tmin)
+{
+  std::cout << "Testing OpenCLSimilaritySearch::knnSearch(k = " << k << ", Tmin = " << Tmin << ")..." << std::endl;
+  // OpenCLSimilaritySearch terminates the program on errors
+  std::vector<cl::Platform> platforms;
+  std::vector<cl::Device> devices;
+  if (cl::Platform::get(&platforms) != CL_SUCCESS || platforms.empty() ||
+      platforms[0].getDevices(CL_DEVICE_TYPE_ALL, &devices) != CL_SUCCESS || devices.empty()) {
+    std::cout << "    no OpenCL device, skipped" << std::endl;
+    return;
+  }
+
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_row_major.fps.hel");
+  OpenCLSimilaritySearch search(storage, 1, 1);
+
+  std::vector<Word*> queries;
+  for (unsigned int q = 0; q < 50; ++q)
+    queries.push_back(const_cast<Word*>(&fingerprints[q * 13 * numWords]));
+  std::vector<std::vector<std::pair<unsigned int, double> > > result = search.knnSearch(queries, k, Tmin);
+  REQUIRE(result.size() == queries.size());
+
+  for (std::size_t q = 0; q < queries.size(); ++q) {
+    std::vector<std::pair<unsigned int, double> > expected = brute_force_knn_search(queries[q], storage, k, Tmin);
+    COMPARE(expected.size(), result[q].size());
+    if (expected.size() == result[q].size())
+      for (std::size_t i = 0; i < expected.size(); ++i) {
+        COMPARE(expected[i].first, result[q][i].first);
+        COMPARE(expected[i].second, result[q][i].second);
+      }
+  }
+}
+#endif
+
+int main()
+{
+  // every 20th fingerprint has 4 near duplicates
+  FingerprintFixture fixture(numBits, 42);
+  fixture.duplicateStride = 20;
+  fixture.groupSize = 5;
+  std::vector<Word> fingerprints = fixture.random(numFingerprints);
+  write_fingerprint_files(fingerprints);
+
+  test_storage_bit_counts(fingerprints);
+  test_padded_storages();
+
+  test_brute_force(fingerprints, 0.0);
+  test_brute_force(fingerprints, 0.5);
+  test_brute_force(fingerprints, 0.9);
+
+  test_bitsliced_search(fingerprints, 0.0);
+  test_bitsliced_search(fingerprints, 0.5);
+  test_bitsliced_search(fingerprints, 0.9);
+
+  std::vector<Word> sorted = write_sorted_fingerprint_file(fingerprints);
+  test_sorted_brute_force(fingerprints, sorted, 0.0, 10);
+  test_sorted_brute_force(fingerprints, sorted, 0.5, 5);
+  test_sorted_brute_force(fingerprints, sorted, 0.8, 100);
+
+  test_folded_search("tmp_row_major.fps.hel", 256, 0.0, 10);
+  test_folded_search("tmp_row_major.fps.hel", 256, 0.6, 5);
+  test_folded_search("tmp_row_major.fps.hel", 128, 0.8, 20);
+  test_folded_search("tmp_sorted.fps.hel", 256, 0.5, 10);
+  test_folded_search("tmp_sorted.fps.hel", 64, 0.7, 3);
+
+  test_memory_mapped_storages(fingerprints, 0.0);
+  test_memory_mapped_storages(fingerprints, 0.6);
+
+  test_batch_brute_force("tmp_row_major.fps.hel", 0.0);
+  test_batch_brute_force("tmp_row_major.fps.hel", 0.6);
+  test_batch_brute_force("tmp_sorted.fps.hel", 0.6);
+
+#ifdef HAVE_CPP11
+  test_partitioned_load("tmp_row_major.fps.hel", 0.5);
+  test_partitioned_load("tmp_sorted.fps.hel", 0.6);
+#endif
+
+  test_nxn_brute_force("tmp_row_major.fps.hel", 10, 0.0);
+  test_nxn_brute_force("tmp_row_major.fps.hel", 3, 0.6);
+  test_nxn_brute_force("tmp_sorted.fps.hel", 10, 0.5);
+
+  test_nxn_tiles("tmp_row_major.fps.hel", 10, 0.0, 1, false);
+  test_nxn_tiles("tmp_row_major.fps.hel", 5, 0.5, 3, false);
+  test_nxn_tiles("tmp_row_major.fps.hel", 10, 0.4, 4, true);
+  test_nxn_tiles("tmp_sorted.fps.hel", 10, 0.6, 3, true);
+  test_nxn_tiles("tmp_sorted.fps.hel", 3, 0.5, 2, false);
+
+  test_streaming_search(fingerprints, 0.0);
+  test_streaming_search(fingerprints, 0.6);
+
+  test_cancelled_search(fingerprints, 0.0);
+  test_cancelled_search(fingerprints, 0.6);
+
+  test_index_search(fingerprints, 3, 0.0);
+  test_index_search(fingerprints, 3, 0.7);
+  test_index_search(fingerprints, 4, 0.5);
+
+  test_stored_statistics(fingerprints, 3);
+  test_stored_statistics(fingerprints, 4);
+
+  test_knn_search(fingerprints, 3, 1, 0.0);
+  test_knn_search(fingerprints, 3, 10, 0.0);
+  test_knn_search(fingerprints, 4, 10, 0.3);
+  test_knn_search(fingerprints, 2, 100, 0.1);
+
+#ifdef HAVE_OPENCL
+  test_opencl_knn_search(fingerprints, 1, 0.0);
+  test_opencl_knn_search(fingerprints, 10, 0.0);
+  test_opencl_knn_search(fingerprints, OpenCLSimilaritySearch::MaxHits, 0.3);
+#endif
+
+  // frozen index
+  test_index_search(fingerprints, 3, 0.0, true);
+  test_index_search(fingerprints, 3, 0.7, true);
+  test_index_search(fingerprints, 1, 0.5, true);
+  test_knn_search(fingerprints, 3, 10, 0.0, true);
+  test_knn_search(fingerprints, 4, 10, 0.3, true);
+  test_knn_search(fingerprints, 1, 5, 0.0, true);
+
+  test_metric_search<CosineMetric>(fingerprints, bitvec_cosine, 3, 10, 0.0, false);
+  test_metric_search<CosineMetric>(fingerprints, bitvec_cosine, 3, 5, 0.6, true);
+  test_metric_search<CosineMetric>(fingerprints, bitvec_cosine, 1, 10, 0.4, true);
+  test_metric_search<HammingMetric>(fingerprints, hamming_similarity, 3, 10, 0.85, false);
+  test_metric_search<HammingMetric>(fingerprints, hamming_similarity, 4, 10, 0.9, true);
+  test_metric_search<RussellRaoMetric>(fingerprints, bitvec_russell_rao, 3, 10, 0.1, false);
+  test_metric_search<RussellRaoMetric>(fingerprints, bitvec_russell_rao, 2, 10, 0.05, true);
+  test_metric_search<ForbesMetric>(fingerprints, bitvec_forbes, 3, 10, 5.0, false);
+  test_metric_search<ForbesMetric>(fingerprints, bitvec_forbes, 3, 10, 2.0, true);
+
+  test_incremental_updates(fingerprints, 3, false);
+  test_incremental_updates(fingerprints, 3, true);
+  test_incremental_updates(fingerprints, 1, true);
+
+  test_index_file(fingerprints, 3);
+  test_index_file(fingerprints, 1);
+
+  test_memory_usage(3);
+  test_memory_usage(1);
+
+  test_k_tuning(fingerprints, 0.5);
+  test_k_tuning(fingerprints, 0.8);
+
+  test_parallel_build(fingerprints, 3, 1);
+  test_parallel_build(fingerprints, 3, 3);
+  test_parallel_build(fingerprints, 1, 2);
+  test_parallel_build(fingerprints, 4, 0);
+
+#ifdef HAVE_CPP11
+  test_parallel_search(fingerprints, 3, false);
+  test_parallel_search(fingerprints, 3, true);
+  test_parallel_search(fingerprints, 2, true);
+  test_parallel_search(fingerprints, 1, true);
+#endif
+}
@@ -12,4 +12,38 @@ int main()
   parse_smiles("c1ccccc1", mol);
   COMPARE(6, mol.numAtoms());
   COMPARE(6, mol.numBonds());
+
+  // reuse the parser
+  SmilesParser<HeMol> parser;
+  ASSERT(parser.parse("CCO", mol));
+  COMPARE(3, mol.numAtoms());
+  COMPARE(2, mol.numBonds());
+  ASSERT(parser.parse("C1CC1", mol));
+  COMPARE(3, mol.numAtoms());
+  COMPARE(3, mol.numBonds());
+
+  // errors
+  ASSERT(!parser.parse("CC(C", mol));
+  COMPARE("CC(C", parser.error().smiles);
+  COMPARE(true, parser.error().syntaxError);
+  COMPARE(2, parser.error().pos);
+  ASSERT(!parser.parse("C1CC", mol));
+  COMPARE(false, parser.error().syntaxError);
+  COMPARE(1, parser.error().pos);
+
+  // the parser can be used after an error
+  ASSERT(parser.parse("c1ccccc1", mol));
+  COMPARE(6, mol.numAtoms());
+
+  // no state is kept from the previous SMILES
+  ASSERT(parser.parse("CCCCCC", mol));
+  FOREACH_BOND (bond, mol, HeMol)
+    COMPARE(false, is_aromatic(mol, *bond));
+
+  // copies are independent parsers
+  SmilesParser<HeMol> copy(parser);
+  HeMol mol2;
+  ASSERT(copy.parse("CC", mol2));
+  COMPARE(2, mol2.numAtoms());
+  COMPARE(6, mol.numAtoms());
 }
@@ -0,0 +1,124 @@
+#include <Helium/substructuresearch.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/smiles.h>
+
+#include "test.h"
+
+using namespace Helium;
+
+void test_verify(const std::string &smiles, int step)
+{
+  std::cout << "Testing substructure_verify(" << smiles << ", step = " << step << ")..." << std::endl;
+  MemoryMappedMoleculeFile file(datadir() + "1K.hel");
+
+  HeMol query;
+  parse_smiles(smiles, query);
+
+  // every step-th molecule is a candidate
+  std::vector<Word> candidates(bitvec_num_words_for_bits(file.numMolecules()), 0);
+  for (unsigned int i = 0; i < file.numMolecules(); i += step)
+    bitvec_set(i, &candidates[0]);
+
+  std::vector<unsigned int> expected;
+  HeMol mol;
+  for (unsigned int i = 0; i < file.numMolecules(); i += step) {
+    file.read_molecule(i, mol);
+    if (isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher>(mol, query))
+      expected.push_back(i);
+  }
+
+  std::vector<unsigned int> hits = substructure_verify(file, query, &candidates[0]);
+  ASSERT(hits == expected);
+
+#ifdef HAVE_CPP11
+  ThreadPool pool(3);
+  // small chunks so the chunks are handed out in a different order
+  std::vector<unsigned int> threaded = substructure_verify_threaded(file, query, &candidates[0], pool, 7);
+  ASSERT(threaded == expected);
+#endif
+}
+
+#ifdef HAVE_CPP11
+/**
+ * Screen where every step-th molecule is a candidate, small blocks are used
+ * so the pipeline has many blocks.
+ */
+struct StepScreen
+{
+  StepScreen(unsigned int numFingerprints_, int step_) : numFingerprints_(numFingerprints_), step(step_)
+  {
+  }
+
+  unsigned int numFingerprints() const
+  {
+    return numFingerprints_;
+  }
+
+  unsigned int blockWords() const
+  {
+    return 2;
+  }
+
+  bool empty() const
+  {
+    return false;
+  }
+
+  void screen(Word *result, unsigned int begin, unsigned int end) const
+  {
+    for (unsigned int i = begin * BitsPerWord; i < std::min(numFingerprints_, end * BitsPerWord); ++i)
+      if (i % step == 0)
+        bitvec_set(i, result);
+  }
+
+  unsigned int numFingerprints_;
+  unsigned int step;
+};
+
+void test_pipelined(const std::string &smiles, int step)
+{
+  std::cout << "Testing substructure_search_pipelined(" << smiles << ", step = " << step << ")..." << std::endl;
+  MemoryMappedMoleculeFile file(datadir() + "1K.hel");
+
+  HeMol query;
+  parse_smiles(smiles, query);
+
+  StepScreen screen(file.numMolecules(), step);
+  std::vector<Word> expectedCandidates(bitvec_num_words_for_bits(file.numMolecules()), 0);
+  screen.screen(&expectedCandidates[0], 0, expectedCandidates.size());
+  std::vector<unsigned int> expected = substructure_verify(file, query, &expectedCandidates[0]);
+
+  ThreadPool pool(3);
+  std::vector<Word> candidates(expectedCandidates.size(), ~Word(0));
+  CancellationToken token;
+  std::vector<unsigned int> timedOut;
+  // small chunks so the chunks are verified in a different order
+  std::vector<unsigned int> hits = substructure_search_pipelined(screen, file, query, &candidates[0],
+      token, 0, timedOut, pool, 5);
+  ASSERT(hits == expected);
+  ASSERT(candidates == expectedCandidates);
+  ASSERT(timedOut.empty());
+
+  // a cancelled search still screens all blocks
+  std::fill(candidates.begin(), candidates.end(), ~Word(0));
+  CancellationToken cancelled;
+  cancelled.cancel();
+  hits = substructure_search_pipelined(screen, file, query, &candidates[0], cancelled, 0, timedOut, pool, 5);
+  ASSERT(hits.empty());
+  ASSERT(candidates == expectedCandidates);
+}
+#endif
+
+int main()
+{
+  test_verify("c1ccccc1", 1);
+  test_verify("c1ccccc1", 3);
+  test_verify("C(=O)O", 1);
+  test_verify("N", 2);
+
+#ifdef HAVE_CPP11
+  test_pipelined("c1ccccc1", 1);
+  test_pipelined("C(=O)O", 3);
+  test_pipelined("N", 2);
+#endif
+}
@@ -1,5 +1,11 @@
+#include <Helium/bitvec.h>
+#include <Helium/fileio/fingerprints.h>
+#include <Helium/util/string.h>
+
 #include <iostream>
 #include <cstdlib>
+#include <algorithm>
+#include <vector>
 
 #ifdef _MSC_VER
 #define FUNCTION_SIGNATURE __FUNCSIG__
@@ -42,3 +48,71 @@ std::string datadir()
 {
   return HEDATADIR + std::string("/");
 }
+
+/**
+ * The JSON header of a fingerprint file.
+ */
+std::string fingerprint_header(const std::string &order, unsigned int numBits, unsigned int n)
+{
+  return Helium::make_string("{ \"filetype\": \"fingerprints\", \"order\": \"", order,
+      "\", \"num_bits\": ", numBits, ", \"num_fingerprints\": ", n, " }");
+}
+
+/**
+ * Random fingerprint fixture shared by the fingerprint tests. Every
+ * fingerprint has between minBitsSet and maxBitsSet (exclusive) random bits
+ * set from the first usedBits bits. When duplicateStride is not 0, every
+ * duplicateStride-th fingerprint is followed by groupSize - 1 copies with
+ * one extra random bit set (or exact copies if nearDuplicates is false).
+ */
+struct FingerprintFixture
+{
+  FingerprintFixture(unsigned int numBits_, unsigned int seed_)
+    : numBits(numBits_), numWords(Helium::bitvec_num_words_for_bits(numBits_)),
+      seed(seed_), minBitsSet(0), maxBitsSet(200), usedBits(numBits_),
+      duplicateStride(0), groupSize(0), nearDuplicates(true)
+  {
+  }
+
+  std::vector<Helium::Word> random(unsigned int n) const
+  {
+    std::srand(seed);
+    std::vector<Helium::Word> fingerprints(n * numWords, 0);
+    for (unsigned int i = 0; i < n; ++i) {
+      unsigned int numSet = minBitsSet + std::rand() % (maxBitsSet - minBitsSet);
+      for (unsigned int j = 0; j < numSet; ++j)
+        Helium::bitvec_set(std::rand() % usedBits, &fingerprints[i * numWords]);
+    }
+    if (!duplicateStride)
+      return fingerprints;
+    for (unsigned int i = 0; i + groupSize <= n; i += duplicateStride)
+      for (unsigned int j = i + 1; j < i + groupSize; ++j) {
+        std::copy(&fingerprints[i * numWords], &fingerprints[i * numWords] + numWords, &fingerprints[j * numWords]);
+        if (nearDuplicates)
+          Helium::bitvec_set(std::rand() % usedBits, &fingerprints[j * numWords]);
+      }
+    return fingerprints;
+  }
+
+  /**
+   * Write fingerprints [begin, end) to a row-major fingerprint file.
+   */
+  void write(const std::string &filename, const std::vector<Helium::Word> &fingerprints,
+      unsigned int begin, unsigned int end) const
+  {
+    Helium::RowMajorFingerprintOutputFile file(filename, numBits);
+    for (unsigned int i = begin; i < end; ++i)
+      file.writeFingerprint(const_cast<Helium::Word*>(&fingerprints[i * numWords]));
+    file.writeHeader(fingerprint_header("row-major", numBits, end - begin));
+  }
+
+  unsigned int numBits;
+  unsigned int numWords;
+  unsigned int seed;
+  unsigned int minBitsSet;
+  unsigned int maxBitsSet;
+  unsigned int usedBits;
+  unsigned int duplicateStride;
+  unsigned int groupSize;
+  bool nearDuplicates;
+};
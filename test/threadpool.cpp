@@ -0,0 +1,151 @@
+#include <Helium/config.h>
+
+#include "test.h"
+
+#ifdef HAVE_CPP11
+
+#include <Helium/threadpool.h>
+
+using namespace Helium;
+
+void test_tasks(unsigned int numThreads)
+{
+  std::cout << "Testing ThreadPool (threads = " << numThreads << ")..." << std::endl;
+  ThreadPool pool(numThreads);
+  ASSERT(pool.numThreads() > 0);
+
+  std::vector<int> values(1000, 0);
+  ThreadPool::TaskGroup group;
+  for (std::size_t i = 0; i < values.size(); ++i)
+    pool.submit(group, [&values, i] { values[i] = i * 2; });
+  pool.wait(group);
+  COMPARE(0, group.pending());
+  for (std::size_t i = 0; i < values.size(); ++i)
+    COMPARE(static_cast<int>(i * 2), values[i]);
+
+  // the pool can be reused
+  std::atomic<int> sum(0);
+  ThreadPool::TaskGroup group2;
+  for (int i = 1; i <= 100; ++i)
+    pool.submit(group2, [&sum, i] { sum += i; });
+  pool.wait(group2);
+  COMPARE(5050, sum.load());
+}
+
+void test_nested_tasks(unsigned int numThreads)
+{
+  std::cout << "Testing ThreadPool nested tasks (threads = " << numThreads << ")..." << std::endl;
+  ThreadPool pool(numThreads);
+
+  // tasks submitting and waiting for other tasks
+  std::atomic<int> count(0);
+  ThreadPool::TaskGroup outer;
+  for (int i = 0; i < 20; ++i)
+    pool.submit(outer, [&pool, &count] {
+      ThreadPool::TaskGroup inner;
+      for (int j = 0; j < 20; ++j)
+        pool.submit(inner, [&count] { ++count; });
+      pool.wait(inner);
+    });
+  pool.wait(outer);
+  COMPARE(400, count.load());
+}
+
+void test_short_lived_groups(unsigned int numThreads)
+{
+  std::cout << "Testing ThreadPool short lived groups (threads = " << numThreads << ")..." << std::endl;
+  ThreadPool pool(numThreads);
+
+  // the group is destroyed right after wait() returns, the last worker must
+  // be done with it by then
+  std::atomic<int> count(0);
+  for (int i = 0; i < 2000; ++i) {
+    ThreadPool::TaskGroup group;
+    for (int j = 0; j < 2; ++j)
+      pool.submit(group, [&count] { ++count; });
+    pool.wait(group);
+    COMPARE(0, group.pending());
+  }
+  COMPARE(4000, count.load());
+}
+
+void test_parallel_for(unsigned int numThreads)
+{
+  std::cout << "Testing ThreadPool::parallelFor() (threads = " << numThreads << ")..." << std::endl;
+  ThreadPool pool(numThreads);
+
+  // every element is visited exactly once for all chunk sizes
+  std::size_t chunkSizes[] = { 1, 7, 1000, 5000 };
+  for (int c = 0; c < 4; ++c) {
+    std::vector<int> values(1000, 0);
+    pool.parallelFor(values.size(), chunkSizes[c], [&values] (std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i)
+        ++values[i];
+    });
+    for (std::size_t i = 0; i < values.size(); ++i)
+      COMPARE(1, values[i]);
+  }
+
+  // empty range
+  int calls = 0;
+  pool.parallelFor(0, 10, [&calls] (std::size_t, std::size_t) { ++calls; });
+  COMPARE(0, calls);
+}
+
+void test_parallel_for_partitioned(unsigned int numThreads, bool pinThreads)
+{
+  std::cout << "Testing ThreadPool::parallelForPartitioned() (threads = " << numThreads << ", pinned = " << pinThreads << ")..." << std::endl;
+  ThreadPool pool(numThreads, pinThreads);
+
+  std::vector<std::vector<unsigned int> > nodes = ThreadPool::numaNodes();
+  ASSERT(nodes.size() > 0);
+  for (unsigned int i = 0; i < pool.numThreads(); ++i)
+    ASSERT(pool.workerNode(i) < nodes.size());
+  // the workers are assigned to the nodes in contiguous blocks
+  for (unsigned int i = 1; i < pool.numThreads(); ++i)
+    ASSERT(pool.workerNode(i - 1) <= pool.workerNode(i));
+
+  // every element is visited exactly once for all chunk sizes
+  std::size_t chunkSizes[] = { 1, 7, 1000, 5000 };
+  for (int c = 0; c < 4; ++c) {
+    std::vector<int> values(1000, 0);
+    pool.parallelForPartitioned(values.size(), chunkSizes[c], [&values, c, &chunkSizes] (std::size_t begin, std::size_t end) {
+      ASSERT(begin % chunkSizes[c] == 0);
+      for (std::size_t i = begin; i < end; ++i)
+        ++values[i];
+    });
+    for (std::size_t i = 0; i < values.size(); ++i)
+      COMPARE(1, values[i]);
+  }
+
+  // empty range
+  int calls = 0;
+  pool.parallelForPartitioned(0, 10, [&calls] (std::size_t, std::size_t) { ++calls; });
+  COMPARE(0, calls);
+
+  COMPARE(1024, pool.chunkSize(100, 1024));
+  COMPARE(1000000 / (8 * pool.numThreads()) + 1, pool.chunkSize(1000000));
+}
+
+int main()
+{
+  test_tasks(1);
+  test_tasks(4);
+  test_tasks(0);
+  test_nested_tasks(1);
+  test_nested_tasks(3);
+  test_short_lived_groups(4);
+  test_parallel_for(1);
+  test_parallel_for(4);
+  test_parallel_for_partitioned(1, false);
+  test_parallel_for_partitioned(4, false);
+  test_parallel_for_partitioned(5, true);
+}
+
+#else
+
+int main()
+{
+}
+
+#endif
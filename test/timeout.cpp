@@ -0,0 +1,178 @@
+#include <Helium/timeout.h>
+#include <Helium/substructuresearch.h>
+#include <Helium/algorithms/enumeratesubgraphs.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/smiles.h>
+
+#include "test.h"
+
+using namespace Helium;
+
+void test_token()
+{
+  std::cout << "Testing CancellationToken..." << std::endl;
+  // no deadline
+  CancellationToken forever;
+  ASSERT(!forever.expired());
+  ASSERT(!forever.isCancelled());
+  forever.check();
+
+  // explicit cancel
+  CancellationToken cancelled;
+  cancelled.cancel();
+  ASSERT(cancelled.expired());
+  ASSERT(cancelled.isCancelled());
+  bool thrown = false;
+  try {
+    cancelled.check();
+  } catch (const timeout_error &e) {
+    thrown = true;
+  }
+  ASSERT(thrown);
+
+  // deadline
+  unsigned long long start = impl::monotonic_nanoseconds();
+  CancellationToken deadline(20);
+  ASSERT(!deadline.isCancelled());
+  while (!deadline.expired())
+    ASSERT(impl::monotonic_nanoseconds() - start < 5000000000ULL);
+  // allow for some calibration error
+  ASSERT(impl::monotonic_nanoseconds() - start >= 15000000ULL);
+  ASSERT(deadline.isCancelled());
+
+  // a child expires with its parent
+  CancellationToken parent;
+  CancellationToken child(0, &parent);
+  ASSERT(!child.expired());
+  parent.cancel();
+  ASSERT(child.expired());
+  ASSERT(!CancellationToken(0, &forever).expired());
+}
+
+void test_check()
+{
+  std::cout << "Testing CancellationCheck..." << std::endl;
+  CancellationCheck none;
+  for (int i = 0; i < 1000; ++i)
+    ASSERT(!none());
+
+  CancellationToken token;
+  token.cancel();
+  // the token is only read every 4 calls
+  CancellationCheck check(&token, 4);
+  ASSERT(!check());
+  ASSERT(!check());
+  ASSERT(!check());
+  ASSERT(check());
+  ASSERT(check.expired());
+  ASSERT(check());
+}
+
+void test_matcher()
+{
+  std::cout << "Testing IsomorphismMatcher::setCancellationToken()..." << std::endl;
+  HeMol mol, query;
+  // enough search steps for the token to be checked
+  parse_smiles(std::string(200, 'C'), mol);
+  parse_smiles("CCCCC", query);
+
+  IsomorphismQuery<HeMol> compiled(query);
+  IsomorphismMatcher<DefaultAtomMatcher, DefaultBondMatcher, HeMol, HeMol> matcher(compiled);
+  MappingList expected;
+  ASSERT(matcher.match(mol, expected));
+  ASSERT(!matcher.cancelled());
+
+  // the search unwinds after the first check
+  CancellationToken token;
+  token.cancel();
+  matcher.setCancellationToken(&token);
+  MappingList partial;
+  matcher.match(mol, partial);
+  ASSERT(matcher.cancelled());
+  ASSERT(partial.maps.size() < expected.maps.size());
+
+  // a token that does not expire gives the same result
+  CancellationToken forever;
+  matcher.setCancellationToken(&forever);
+  MappingList mappings;
+  ASSERT(matcher.match(mol, mappings));
+  ASSERT(!matcher.cancelled());
+  COMPARE(expected.maps.size(), mappings.maps.size());
+}
+
+struct CountSubgraphs
+{
+  CountSubgraphs() : count(0)
+  {
+  }
+
+  void operator()(const Subgraph &subgraph)
+  {
+    ++count;
+  }
+
+  unsigned int count;
+};
+
+void test_enumerate_subgraphs()
+{
+  std::cout << "Testing enumerate_subgraphs() with a CancellationToken..." << std::endl;
+  HeMol mol;
+  parse_smiles("c1ccc2ccccc2c1CC(=O)O", mol);
+
+  CountSubgraphs all;
+  ASSERT(enumerate_subgraphs(mol, all, 7));
+
+  CancellationToken forever;
+  CountSubgraphs same;
+  ASSERT(enumerate_subgraphs(mol, same, 7, false, &forever));
+  COMPARE(all.count, same.count);
+
+  CancellationToken token;
+  token.cancel();
+  CountSubgraphs partial;
+  ASSERT(!enumerate_subgraphs(mol, partial, 7, false, &token));
+  ASSERT(partial.count < all.count);
+}
+
+void test_verify()
+{
+  std::cout << "Testing substructure_verify() with a CancellationToken..." << std::endl;
+  MemoryMappedMoleculeFile file(datadir() + "1K.hel");
+  HeMol query;
+  parse_smiles("c1ccccc1", query);
+
+  std::vector<Word> candidates(bitvec_num_words_for_bits(file.numMolecules()), 0);
+  for (unsigned int i = 0; i < file.numMolecules(); ++i)
+    bitvec_set(i, &candidates[0]);
+  std::vector<unsigned int> expected = substructure_verify(file, query, &candidates[0]);
+
+  // generous budgets do not change the results
+  CancellationToken forever;
+  std::vector<unsigned int> timedOut;
+  ASSERT(expected == substructure_verify(file, query, &candidates[0], forever, 10000, timedOut));
+  ASSERT(timedOut.empty());
+  ASSERT(!forever.isCancelled());
+
+  // a cancelled token gives a partial result
+  CancellationToken token;
+  token.cancel();
+  ASSERT(substructure_verify(file, query, &candidates[0], token, 0, timedOut).empty());
+  ASSERT(timedOut.empty());
+
+#ifdef HAVE_CPP11
+  ThreadPool pool(3);
+  ASSERT(expected == substructure_verify_threaded(file, query, &candidates[0], forever, 10000, timedOut, pool, 7));
+  ASSERT(timedOut.empty());
+  ASSERT(substructure_verify_threaded(file, query, &candidates[0], token, 0, timedOut, pool, 7).empty());
+#endif
+}
+
+int main()
+{
+  test_token();
+  test_check();
+  test_matcher();
+  test_enumerate_subgraphs();
+  test_verify();
+}
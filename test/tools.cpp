@@ -0,0 +1,556 @@
+#include <Helium/config.h>
+#include <Helium/bitvec.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/fileio/fingerprints.h>
+#include <Helium/fingerprints/fingerprints.h>
+#include <Helium/util/string.h>
+
+#include "test.h"
+#include "../tools/hitwriter.h"
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace Helium;
+
+#ifndef HELIUM_TOOL
+#define HELIUM_TOOL "helium"
+#endif
+#ifndef BENCHMARK_TOOL
+#define BENCHMARK_TOOL "benchmark"
+#endif
+#ifndef MICROBENCHMARK_TOOL
+#define MICROBENCHMARK_TOOL "microbenchmark"
+#endif
+
+/**
+ * Run a tool with the given arguments, the output (stdout and stderr) is
+ * written to @p output.
+ *
+ * @return The exit status (0 if successful).
+ */
+int run(const std::string &tool, const std::string &args, const std::string &output = "tmp_tools.out")
+{
+  std::string command = "\"" + tool + "\" " + args + " > " + output + " 2>&1";
+  return std::system(command.c_str());
+}
+
+/**
+ * Run the helium tool with the given arguments.
+ */
+int helium(const std::string &args, const std::string &output = "tmp_tools.out")
+{
+  return run(HELIUM_TOOL, args, output);
+}
+
+/**
+ * Run the helium tool with the given arguments, only stdout is written to
+ * @p output (e.g. for binary output).
+ *
+ * @return The exit status (0 if successful).
+ */
+int helium_stdout(const std::string &args, const std::string &output)
+{
+  std::string command = std::string("\"") + HELIUM_TOOL + "\" " + args + " > " + output + " 2> tmp_tools.err";
+  return std::system(command.c_str());
+}
+
+/**
+ * Get the contents of a file.
+ */
+std::string read_file(const std::string &filename)
+{
+  std::ifstream ifs(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+  return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+void test_substructure_fingerprint_types()
+{
+  std::cout << "Testing substructure search fingerprint types..." << std::endl;
+  std::string molecules = datadir() + "1K.hel";
+
+  // paths fingerprints can be used to screen
+  REQUIRE(helium("index -paths " + molecules + " tmp_tools_paths.fps") == 0);
+  REQUIRE(helium("transpose tmp_tools_paths.fps tmp_tools_paths_cm.fps") == 0);
+  COMPARE(0, helium("substructure CCO " + molecules + " tmp_tools_paths_cm.fps"));
+
+  // the bits of a query's circular fingerprint are not a subset of the bits
+  // of the molecules containing it, the file is refused
+  REQUIRE(helium("index -circular " + molecules + " tmp_tools_circular.fps") == 0);
+  REQUIRE(helium("transpose tmp_tools_circular.fps tmp_tools_circular_cm.fps") == 0);
+  ASSERT(helium("substructure CCO " + molecules + " tmp_tools_circular_cm.fps") != 0);
+  ASSERT(read_file("tmp_tools.out").find("can not be used for substructure searches") != std::string::npos);
+  ASSERT(read_file("tmp_tools.out").find("\"hits\"") == std::string::npos);
+}
+
+void test_index_pipeline()
+{
+  std::cout << "Testing the index pipeline..." << std::endl;
+  std::string molecules = datadir() + "1K.hel";
+
+  // a single chunk on a single thread is computed in the serial order
+  REQUIRE(helium("index -threads 1 -chunk 1000000 -paths " + molecules + " tmp_tools_serial.fps") == 0);
+  // small chunks are completed out of order by the worker threads
+  REQUIRE(helium("index -threads 4 -chunk 7 -paths " + molecules + " tmp_tools_pipelined.fps") == 0);
+
+  std::string serial = read_file("tmp_tools_serial.fps");
+  ASSERT(!serial.empty());
+  ASSERT(serial == read_file("tmp_tools_pipelined.fps"));
+
+  // both are the same as computing the fingerprints one by one
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_tools_pipelined.fps");
+  MoleculeFile file(molecules);
+  REQUIRE(storage.numFingerprints() == file.numMolecules());
+  HeMol mol;
+  std::vector<Word> fingerprint(16);
+  for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+    file.read_molecule(i, mol);
+    path_fingerprint(mol, &fingerprint[0], 7, 16, 1021);
+    ASSERT(std::equal(fingerprint.begin(), fingerprint.end(), storage.fingerprint(i)));
+  }
+}
+
+void test_sort()
+{
+  std::cout << "Testing the sort tool..." << std::endl;
+  // a small buffer so the buckets are flushed many times
+  REQUIRE(helium("sort -memory 1 tmp_tools_paths.fps tmp_tools_sorted.fps") == 0);
+
+  InMemoryRowMajorFingerprintStorage input, sorted;
+  input.load("tmp_tools_paths.fps");
+  sorted.load("tmp_tools_sorted.fps");
+  REQUIRE(input.numFingerprints() == sorted.numFingerprints());
+  unsigned int numWords = bitvec_num_words_for_bits(input.numBits());
+
+  // the offsets of the population count buckets
+  std::vector<unsigned int> offsets(input.numBits() + 2, 0);
+  for (unsigned int i = 0; i < input.numFingerprints(); ++i)
+    ++offsets[input.bitCount(i) + 1];
+  for (unsigned int c = 0; c <= input.numBits(); ++c)
+    offsets[c + 1] += offsets[c];
+  COMPARE(offsets.size(), sorted.popcountOffsets().size());
+  ASSERT(offsets == sorted.popcountOffsets());
+
+  // each fingerprint is written once, in input order within its bucket
+  std::vector<unsigned int> positions(offsets.begin(), offsets.end() - 1);
+  for (unsigned int i = 0; i < input.numFingerprints(); ++i) {
+    unsigned int j = positions[input.bitCount(i)]++;
+    ASSERT(std::equal(input.fingerprint(i), input.fingerprint(i) + numWords, sorted.fingerprint(j)));
+  }
+  for (unsigned int c = 0; c <= input.numBits(); ++c)
+    COMPARE(offsets[c + 1], positions[c]);
+}
+
+void test_reorder()
+{
+  std::cout << "Testing the reorder tool..." << std::endl;
+  std::string molecules = datadir() + "1K.hel";
+  REQUIRE(helium("reorder -order atoms -row_major tmp_tools_paths.fps tmp_tools_reordered.fps " +
+        molecules + " tmp_tools_reordered.hel tmp_tools_permutation.json") == 0);
+
+  Json::Reader reader;
+  Json::Value data;
+  REQUIRE(reader.parse(read_file("tmp_tools_permutation.json"), data));
+  const Json::Value &indices = data["original_indices"];
+
+  MoleculeFile input(molecules), output("tmp_tools_reordered.hel");
+  InMemoryRowMajorFingerprintStorage inputFingerprints, outputFingerprints;
+  inputFingerprints.load("tmp_tools_paths.fps");
+  outputFingerprints.load("tmp_tools_reordered.fps");
+  unsigned int numWords = bitvec_num_words_for_bits(inputFingerprints.numBits());
+  REQUIRE(indices.size() == input.numMolecules());
+  REQUIRE(output.numMolecules() == input.numMolecules());
+  REQUIRE(outputFingerprints.numFingerprints() == input.numMolecules());
+
+  // the permutation is complete and stable (equal atom counts keep their order)
+  std::vector<bool> seen(input.numMolecules());
+  HeMol mol, original;
+  unsigned int prevAtoms = 0, prevIndex = 0;
+  for (unsigned int i = 0; i < output.numMolecules(); ++i) {
+    unsigned int index = indices[i].asUInt();
+    REQUIRE(index < input.numMolecules());
+    ASSERT(!seen[index]);
+    seen[index] = true;
+
+    output.read_molecule(i, mol);
+    input.read_molecule(index, original);
+    COMPARE(num_atoms(original), num_atoms(mol));
+    COMPARE(num_bonds(original), num_bonds(mol));
+    for (unsigned int j = 0; j < num_atoms(mol); ++j)
+      COMPARE(get_element(original, get_atom(original, j)), get_element(mol, get_atom(mol, j)));
+    ASSERT(num_atoms(mol) >= prevAtoms);
+    if (i && num_atoms(mol) == prevAtoms)
+      ASSERT(index > prevIndex);
+    prevAtoms = num_atoms(mol);
+    prevIndex = index;
+
+    // the fingerprints are permuted the same way
+    ASSERT(std::equal(inputFingerprints.fingerprint(index), inputFingerprints.fingerprint(index) + numWords,
+          outputFingerprints.fingerprint(i)));
+  }
+}
+
+/**
+ * Parse the NDJSON hits, the last line is the summary.
+ */
+std::vector<Json::Value> read_ndjson(const std::string &filename)
+{
+  std::vector<Json::Value> lines;
+  std::ifstream ifs(filename.c_str());
+  std::string line;
+  Json::Reader reader;
+  while (std::getline(ifs, line)) {
+    Json::Value value;
+    ASSERT(reader.parse(line, value));
+    lines.push_back(value);
+  }
+  return lines;
+}
+
+struct BinaryHit
+{
+  uint32_t query;
+  uint32_t index;
+  double score;
+};
+
+/**
+ * Parse the binary hits and the summary that follows them.
+ */
+std::vector<BinaryHit> read_binary_hits(const std::string &filename, Json::Value &summary)
+{
+  std::vector<BinaryHit> hits;
+  std::string data = read_file(filename);
+  REQUIRE(data.size() >= 8);
+  COMPARE(std::string("HELHITS1"), data.substr(0, 8));
+  std::size_t pos = 8;
+  while (pos + 16 <= data.size()) {
+    BinaryHit hit;
+    std::copy(data.data() + pos, data.data() + pos + 4, reinterpret_cast<char*>(&hit.query));
+    std::copy(data.data() + pos + 4, data.data() + pos + 8, reinterpret_cast<char*>(&hit.index));
+    std::copy(data.data() + pos + 8, data.data() + pos + 16, reinterpret_cast<char*>(&hit.score));
+    pos += 16;
+    if (hit.query == 0xFFFFFFFF) {
+      // the summary JSON follows the record
+      REQUIRE(pos + hit.index == data.size());
+      Json::Reader reader;
+      ASSERT(reader.parse(data.substr(pos), summary));
+      return hits;
+    }
+    hits.push_back(hit);
+  }
+  ASSERT(!"binary hits without summary");
+  return hits;
+}
+
+void test_stream_output()
+{
+  std::cout << "Testing the streamed hit output..." << std::endl;
+  std::string molecules = datadir() + "1K.hel";
+  Json::Reader reader;
+
+  // substructure search: the same hits as the JSON document
+  Json::Value data;
+  REQUIRE(helium_stdout("substructure CCO " + molecules + " tmp_tools_paths_cm.fps", "tmp_tools_hits.json") == 0);
+  REQUIRE(reader.parse(read_file("tmp_tools_hits.json"), data));
+  const Json::Value &hits = data["hits"];
+  ASSERT(hits.size() > 0);
+
+  REQUIRE(helium_stdout("substructure -stream ndjson CCO " + molecules + " tmp_tools_paths_cm.fps",
+        "tmp_tools_hits.ndjson") == 0);
+  std::vector<Json::Value> lines = read_ndjson("tmp_tools_hits.ndjson");
+  REQUIRE(lines.size() == hits.size() + 1);
+  for (Json::ArrayIndex i = 0; i < hits.size(); ++i) {
+    COMPARE(0, lines[i]["query"].asInt());
+    COMPARE(hits[i]["index"].asUInt(), lines[i]["index"].asUInt());
+  }
+  COMPARE(hits.size(), lines.back()["summary"]["num_hits"].asUInt());
+  COMPARE(data["screened"].asUInt(), lines.back()["summary"]["screened"].asUInt());
+
+  REQUIRE(helium_stdout("substructure -stream binary CCO " + molecules + " tmp_tools_paths_cm.fps",
+        "tmp_tools_hits.bin") == 0);
+  Json::Value summary;
+  std::vector<BinaryHit> binaryHits = read_binary_hits("tmp_tools_hits.bin", summary);
+  REQUIRE(binaryHits.size() == hits.size());
+  for (Json::ArrayIndex i = 0; i < hits.size(); ++i) {
+    COMPARE(0, binaryHits[i].query);
+    COMPARE(hits[i]["index"].asUInt(), binaryHits[i].index);
+    COMPARE(0.0, binaryHits[i].score);
+  }
+  COMPARE(hits.size(), summary["num_hits"].asUInt());
+
+  // similarity search: the scores are included
+  REQUIRE(helium_stdout("similarity -brute -Tmin 0.4 CCO tmp_tools_paths.fps", "tmp_tools_hits.json") == 0);
+  REQUIRE(reader.parse(read_file("tmp_tools_hits.json"), data));
+  const Json::Value &similar = data["hits"][0];
+  ASSERT(similar.size() > 0);
+
+  REQUIRE(helium_stdout("similarity -brute -Tmin 0.4 -stream ndjson CCO tmp_tools_paths.fps",
+        "tmp_tools_hits.ndjson") == 0);
+  lines = read_ndjson("tmp_tools_hits.ndjson");
+  REQUIRE(lines.size() == similar.size() + 1);
+  for (Json::ArrayIndex i = 0; i < similar.size(); ++i) {
+    COMPARE(similar[i]["index"].asUInt(), lines[i]["index"].asUInt());
+    COMPARE(similar[i]["tanimoto"].asDouble(), lines[i]["tanimoto"].asDouble());
+  }
+  COMPARE(similar.size(), lines.back()["summary"]["num_hits"].asUInt());
+
+  REQUIRE(helium_stdout("similarity -brute -Tmin 0.4 -stream binary CCO tmp_tools_paths.fps",
+        "tmp_tools_hits.bin") == 0);
+  binaryHits = read_binary_hits("tmp_tools_hits.bin", summary);
+  REQUIRE(binaryHits.size() == similar.size());
+  for (Json::ArrayIndex i = 0; i < similar.size(); ++i) {
+    COMPARE(similar[i]["index"].asUInt(), binaryHits[i].index);
+    // the JSON document is written with 16 significant digits
+    ASSERT(std::abs(similar[i]["tanimoto"].asDouble() - binaryHits[i].score) < 1e-12);
+  }
+  COMPARE(similar.size(), summary["num_hits"].asUInt());
+
+  // the summary counts the hits since the previous summary
+  std::stringstream ss;
+  HitWriter writer(ss, HitWriter::NDJSON, "tanimoto");
+  writer.write(0, 3, 0.5);
+  writer.write(0, 7, 0.25);
+  COMPARE(2, writer.numHits());
+  writer.writeSummary(Json::Value(Json::objectValue));
+  COMPARE(0, writer.numHits());
+  writer.writeSummary(Json::Value(Json::objectValue));
+  COMPARE("{\"query\":0,\"index\":3,\"tanimoto\":" + Json::valueToString(0.5) + "}\n"
+          "{\"query\":0,\"index\":7,\"tanimoto\":" + Json::valueToString(0.25) + "}\n"
+          "{\"summary\":{\"num_hits\":2}}\n"
+          "{\"summary\":{\"num_hits\":0}}\n", ss.str());
+}
+
+/**
+ * Write a baseline file with the same median wall time for all benchmarks.
+ */
+void write_baseline(const Json::Value &results, double median, const std::string &filename)
+{
+  Json::Value baseline = results;
+  for (Json::ArrayIndex i = 0; i < baseline["benchmarks"].size(); ++i)
+    baseline["benchmarks"][i]["wall_ms"]["median"] = median;
+  std::ofstream ofs(filename.c_str());
+  Json::FastWriter writer;
+  ofs << writer.write(baseline);
+}
+
+void test_benchmark()
+{
+  std::cout << "Testing the benchmark tool..." << std::endl;
+  REQUIRE(run(BENCHMARK_TOOL, "-data 1K -repeat 3 -threads 1,2 -filter fingerprints.path "
+        "-output tmp_tools_benchmark.json") == 0);
+
+  Json::Reader reader;
+  Json::Value data;
+  REQUIRE(reader.parse(read_file("tmp_tools_benchmark.json"), data));
+  COMPARE(std::string("1K"), data["data"].asString());
+  COMPARE(3, data["repeat"].asInt());
+
+  // the threaded case is run for each thread count
+  const Json::Value &benchmarks = data["benchmarks"];
+  REQUIRE(benchmarks.size() == 2);
+  for (Json::ArrayIndex i = 0; i < benchmarks.size(); ++i) {
+    COMPARE(std::string("fingerprints.path"), benchmarks[i]["benchmark"].asString());
+    COMPARE(i + 1, benchmarks[i]["threads"].asUInt());
+    COMPARE(make_string("fingerprints.path/threads=", i + 1), benchmarks[i]["key"].asString());
+
+    const Json::Value &wall = benchmarks[i]["wall_ms"];
+    REQUIRE(wall["samples"].size() == 3);
+    std::vector<double> samples;
+    for (Json::ArrayIndex j = 0; j < wall["samples"].size(); ++j)
+      samples.push_back(wall["samples"][j].asDouble());
+    std::sort(samples.begin(), samples.end());
+    // nearest rank percentiles of 3 samples
+    COMPARE(samples[0], wall["min"].asDouble());
+    COMPARE(samples[0], wall["p10"].asDouble());
+    COMPARE(samples[1], wall["median"].asDouble());
+    COMPARE(samples[2], wall["p90"].asDouble());
+    COMPARE(samples[2], wall["max"].asDouble());
+    ASSERT(samples[0] > 0.0);
+    COMPARE(3, benchmarks[i]["cpu_ms"]["samples"].size());
+  }
+
+  // a slow baseline passes, a fast baseline is a regression (exit code 1)
+  write_baseline(data, 1e9, "tmp_tools_slow.json");
+  write_baseline(data, 1e-9, "tmp_tools_fast.json");
+  COMPARE(0, run(BENCHMARK_TOOL, "-data 1K -repeat 1 -threads 1,2 -filter fingerprints.path "
+        "-output tmp_tools_benchmark2.json -baseline tmp_tools_slow.json"));
+  ASSERT(read_file("tmp_tools.out").find("REGRESSION") == std::string::npos);
+  ASSERT(run(BENCHMARK_TOOL, "-data 1K -repeat 1 -threads 1,2 -filter fingerprints.path "
+        "-output tmp_tools_benchmark2.json -baseline tmp_tools_fast.json") != 0);
+  ASSERT(read_file("tmp_tools.out").find("fingerprints.path/threads=2: ") != std::string::npos);
+  ASSERT(read_file("tmp_tools.out").find("REGRESSION") != std::string::npos);
+}
+
+void test_microbenchmark()
+{
+  std::cout << "Testing the microbenchmark tool..." << std::endl;
+  REQUIRE(run(MICROBENCHMARK_TOOL, "-kernels scalar -widths 512,1024 -sizes 16K,64K -min-time 1 -trials 1 "
+        "-no-storage -json tmp_tools_microbenchmark.json") == 0);
+
+  Json::Reader reader;
+  Json::Value data;
+  REQUIRE(reader.parse(read_file("tmp_tools_microbenchmark.json"), data));
+  COMPARE(std::string(impl::bitvec_kernels().name), data["selected_kernel"].asString());
+
+  // the selected scalar kernels are measured for each width and working set,
+  // the fixed-width variant only exists for 1024 bits
+  std::set<std::string> measured;
+  const Json::Value &measurements = data["measurements"];
+  for (Json::ArrayIndex i = 0; i < measurements.size(); ++i) {
+    const Json::Value &m = measurements[i];
+    std::string kernel = m["kernel"].asString();
+    std::string variant = m["variant"].asString();
+    ASSERT(m["bits"].asInt() == 512 || m["bits"].asInt() == 1024);
+    ASSERT(m["working_set"].asUInt64() == 16 * 1024 || m["working_set"].asUInt64() == 64 * 1024);
+    COMPARE(std::string("sequential"), m["pattern"].asString());
+    ASSERT(m["ns_per_op"].asDouble() > 0.0);
+    ASSERT(m["gb_per_second"].asDouble() > 0.0);
+    if (kernel == "bitvec_count" || kernel == "bitvec_tanimoto")
+      ASSERT(variant == "scalar" || variant == "scalar/fixed");
+    measured.insert(make_string(kernel, " ", variant, " ", m["bits"].asInt(), " ", m["working_set"].asUInt64()));
+  }
+  COMPARE(measurements.size(), measured.size());
+  const char *sizes[] = { "16384", "65536" };
+  for (int s = 0; s < 2; ++s) {
+    ASSERT(measured.count(make_string("bitvec_count scalar 512 ", sizes[s])));
+    ASSERT(measured.count(make_string("bitvec_tanimoto scalar 512 ", sizes[s])));
+    ASSERT(!measured.count(make_string("bitvec_count scalar/fixed 512 ", sizes[s])));
+    ASSERT(measured.count(make_string("bitvec_count scalar 1024 ", sizes[s])));
+    ASSERT(measured.count(make_string("bitvec_count scalar/fixed 1024 ", sizes[s])));
+    ASSERT(measured.count(make_string("bitvec_tanimoto scalar/fixed 1024 ", sizes[s])));
+  }
+
+  // invalid arguments are reported
+  ASSERT(run(MICROBENCHMARK_TOOL, "-kernels unknown -json tmp_tools_microbenchmark2.json") != 0);
+  ASSERT(read_file("tmp_tools.out").find("Kernel \"unknown\" is not supported") != std::string::npos);
+  ASSERT(run(MICROBENCHMARK_TOOL, "-widths 100") != 0);
+  ASSERT(read_file("tmp_tools.out").find("must be a multiple of 64") != std::string::npos);
+}
+
+void test_wide_fingerprints()
+{
+  std::cout << "Testing wide fingerprint files..." << std::endl;
+  std::string molecules = datadir() + "1K.hel";
+
+  // the column counts of 16384 bits do not fit in the default header size
+  REQUIRE(helium("index -bits 16384 -paths " + molecules + " tmp_tools_wide.fps") == 0);
+  InMemoryRowMajorFingerprintStorage storage;
+  storage.load("tmp_tools_wide.fps");
+  COMPARE(16384, storage.numBits());
+  COMPARE(1000, storage.numFingerprints());
+  const std::vector<unsigned int> &columnCounts = storage.columnCounts();
+  REQUIRE(columnCounts.size() == 16384);
+  std::vector<unsigned int> expected(16384, 0);
+  for (unsigned int i = 0; i < storage.numFingerprints(); ++i)
+    for (unsigned int bit = 0; bit < 16384; ++bit)
+      if (bitvec_get(bit, storage.fingerprint(i)))
+        ++expected[bit];
+  ASSERT(expected == columnCounts);
+
+  // the column counts are also stored when transposing
+  const char *orders[] = { "", "-compressed " };
+  for (int i = 0; i < 2; ++i) {
+    REQUIRE(helium(std::string("transpose ") + orders[i] + "tmp_tools_wide.fps tmp_tools_wide_cm.fps") == 0);
+    Json::Reader reader;
+    Json::Value data;
+    REQUIRE(reader.parse(BinaryInputFile("tmp_tools_wide_cm.fps").header(), data));
+    const Json::Value &counts = data["column_counts"];
+    REQUIRE(counts.size() == 16384);
+    for (unsigned int bit = 0; bit < 16384; ++bit)
+      COMPARE(expected[bit], counts[bit].asUInt());
+  }
+
+  // the population count offsets are added to the copied column counts
+  REQUIRE(helium("sort tmp_tools_wide.fps tmp_tools_wide_sorted.fps") == 0);
+  InMemoryRowMajorFingerprintStorage sorted;
+  sorted.load("tmp_tools_wide_sorted.fps");
+  REQUIRE(sorted.numFingerprints() == storage.numFingerprints());
+  const std::vector<unsigned int> &offsets = sorted.popcountOffsets();
+  REQUIRE(offsets.size() == 16386);
+  COMPARE(0, offsets.front());
+  COMPARE(storage.numFingerprints(), offsets.back());
+  for (unsigned int c = 0; c <= 16384; ++c)
+    for (unsigned int i = offsets[c]; i < offsets[c + 1]; ++i)
+      COMPARE(c, sorted.bitCount(i));
+  ASSERT(expected == sorted.columnCounts());
+}
+
+void test_server()
+{
+  std::cout << "Testing the server tool..." << std::endl;
+  std::string molecules = datadir() + "1K.hel";
+  {
+    std::ofstream ofs("tmp_tools_requests.txt");
+    ofs << "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"substructure\",\"params\":{\"query\":\"C((\"}}\n";
+    ofs << "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"substructure\",\"params\":{\"query\":\"C\"}}\n";
+    ofs << "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"substructure\",\"params\":{\"query\":\"[Na+]\"}}\n";
+    ofs << "{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"similarity\",\"params\":{\"query\":\"c1cc\"}}\n";
+  }
+  REQUIRE(helium_stdout("server -cache 10 -substructure " + molecules + " tmp_tools_paths_cm.fps "
+        "-similarity tmp_tools_paths.fps < tmp_tools_requests.txt", "tmp_tools_responses.txt") == 0);
+
+  // every response is valid JSON
+  std::vector<Json::Value> responses = read_ndjson("tmp_tools_responses.txt");
+  REQUIRE(responses.size() == 4);
+  for (std::size_t i = 0; i < responses.size(); ++i)
+    COMPARE(i + 1, responses[i]["id"].asUInt());
+
+  // malformed SMILES are invalid params, the partial molecule is not searched
+  COMPARE(-32602, responses[0]["error"]["code"].asInt());
+  ASSERT(responses[0]["error"]["message"].asString().find("C((") != std::string::npos);
+  ASSERT(!responses[0].isMember("result"));
+  COMPARE(-32602, responses[3]["error"]["code"].asInt());
+
+  // the malformed query did not add "C" to the cache
+  const Json::Value &carbon = responses[1]["result"];
+  ASSERT(!carbon["cached"].asBool());
+  COMPARE(1000, carbon["confirmed"].asUInt());
+
+  // nothing screened
+  const Json::Value &sodium = responses[2]["result"];
+  COMPARE(0, sodium["screened"].asUInt());
+  COMPARE(0.0, sodium["false_positives"].asDouble());
+}
+
+void test_merge()
+{
+  std::cout << "Testing the merge tool..." << std::endl;
+  REQUIRE(helium_stdout("similarityNxN -brute -Tmin 0.3 -N 5 tmp_tools_paths.fps", "tmp_tools_nxn.json") == 0);
+  REQUIRE(helium("similarityNxN -brute -Tmin 0.3 -N 5 -cols 0:500 -output tmp_tools_nxn_0.nxn tmp_tools_paths.fps") == 0);
+  REQUIRE(helium("similarityNxN -brute -Tmin 0.3 -N 5 -cols 500:1000 -output tmp_tools_nxn_1.nxn tmp_tools_paths.fps") == 0);
+  REQUIRE(helium("merge -json tmp_tools_merged.json tmp_tools_nxn_0.nxn tmp_tools_nxn_1.nxn") == 0);
+
+  // the merged tiles are the same as the full search, including the scores
+  Json::Reader reader;
+  Json::Value expected, merged;
+  REQUIRE(reader.parse(read_file("tmp_tools_nxn.json"), expected));
+  REQUIRE(reader.parse(read_file("tmp_tools_merged.json"), merged));
+  COMPARE(1000, expected["hits"].size());
+  ASSERT(expected == merged);
+}
+
+int main()
+{
+  test_substructure_fingerprint_types();
+  test_index_pipeline();
+  test_sort();
+  test_reorder();
+  test_server();
+  test_merge();
+  test_stream_output();
+  test_benchmark();
+  test_microbenchmark();
+  test_wide_fingerprints();
+}
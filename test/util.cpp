@@ -1,4 +1,5 @@
 #include <Helium/util.h>
+#include <Helium/util/arena.h>
 
 #include "test.h"
 
@@ -49,9 +50,72 @@ void test_combinations()
   COMPARE(56, count);
 }
 
+void test_tokenize()
+{
+  std::vector<std::string> tokens = tokenize("a,bc,d", ",");
+  COMPARE(3, tokens.size());
+  COMPARE("a", tokens[0]);
+  COMPARE("bc", tokens[1]);
+  COMPARE("d", tokens[2]);
+
+  tokens = tokenize("a  b c ", " ", true);
+  COMPARE(3, tokens.size());
+  COMPARE("a", tokens[0]);
+  COMPARE("b", tokens[1]);
+  COMPARE("c", tokens[2]);
+
+  tokens = tokenize("abc", ",");
+  COMPARE(1, tokens.size());
+  COMPARE("abc", tokens[0]);
+}
+
+void test_arena()
+{
+  Arena arena(64);
+  COMPARE(0, arena.used());
+  COMPARE(0, arena.capacity());
+
+  // allocations are aligned and do not overlap
+  char *a = arena.allocate<char>(3);
+  int *b = arena.allocate<int>(10);
+  COMPARE(0, reinterpret_cast<std::size_t>(a) % Arena::Alignment);
+  COMPARE(0, reinterpret_cast<std::size_t>(b) % Arena::Alignment);
+  ASSERT(reinterpret_cast<char*>(b) >= a + 3);
+  COMPARE(64, arena.used());
+
+  // scopes release their allocations
+  {
+    Arena::Scope scope(arena);
+    // does not fit in the first block
+    double *c = arena.allocate<double>(100);
+    for (int i = 0; i < 100; ++i)
+      c[i] = i;
+    ASSERT(arena.capacity() > 64);
+    {
+      Arena::Scope inner(arena);
+      ArenaVector<int>::type v((ArenaAllocator<int>(arena)));
+      for (int i = 0; i < 1000; ++i)
+        v.push_back(i);
+      COMPARE(999, v.back());
+    }
+    COMPARE(99.0, c[99]);
+  }
+  COMPARE(64, arena.used());
+
+  // reset merges the blocks into one
+  std::size_t capacity = arena.capacity();
+  arena.reset();
+  COMPARE(0, arena.used());
+  COMPARE(capacity, arena.capacity());
+  arena.allocate<char>(capacity);
+  COMPARE(capacity, arena.capacity());
+}
+
 int main()
 {
+  test_arena();
   test_factorial();
   test_num_combinations();
   test_combinations();
+  test_tokenize();
 }
@@ -62,7 +62,10 @@ class ParseArgs
         const std::string &str7 = std::string(), const std::string &str8 = std::string(),
         const std::string &str9 = std::string(), const std::string &str10 = std::string(),
         const std::string &str11 = std::string(), const std::string &str12 = std::string(),
-        const std::string &str13 = std::string(), const std::string &str14 = std::string())
+        const std::string &str13 = std::string(), const std::string &str14 = std::string(),
+        const std::string &str15 = std::string(), const std::string &str16 = std::string(),
+        const std::string &str17 = std::string(), const std::string &str18 = std::string(),
+        const std::string &str19 = std::string(), const std::string &str20 = std::string())
     {
       std::vector<std::string> result;
       if (!str1.empty()) result.push_back(str1);
@@ -79,6 +82,12 @@ class ParseArgs
       if (!str12.empty()) result.push_back(str12);
       if (!str13.empty()) result.push_back(str13);
       if (!str14.empty()) result.push_back(str14);
+      if (!str15.empty()) result.push_back(str15);
+      if (!str16.empty()) result.push_back(str16);
+      if (!str17.empty()) result.push_back(str17);
+      if (!str18.empty()) result.push_back(str18);
+      if (!str19.empty()) result.push_back(str19);
+      if (!str20.empty()) result.push_back(str20);
       return result;
     }
 
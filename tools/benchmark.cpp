@@ -1,171 +1,636 @@
-#include "../src/molecule.h"
-#include "../src/fileio.h"
-#include "../src/bitvec.h"
-
-#include "../src/enumeratesubgraphs.h"
-#include "../src/substructure.h"
-#include "../src/extendedconnectivities.h"
-#include "../src/canonical.h"
-
-#include <numeric>
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <Helium/config.h>
+#include <Helium/hemol.h>
+#include <Helium/smiles.h>
+#include <Helium/timeout.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/fileio/fingerprints.h>
+#include <Helium/fingerprints/fingerprints.h>
+#include <Helium/fingerprints/similarity.h>
+#include <Helium/fingerprints/screen.h>
+#include <Helium/algorithms/enumeratesubgraphs.h>
+#include <Helium/algorithms/extendedconnectivities.h>
+#include <Helium/algorithms/canonical.h>
+#include <Helium/substructuresearch.h>
+
+#ifdef HAVE_CPP11
+#include <Helium/threadpool.h>
+#include <thread>
+#endif
 
 #include <boost/timer/timer.hpp>
 #include <boost/date_time/gregorian/gregorian.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
-#include "args.h"
+#include <json/json.h>
 
-const boost::timer::nanosecond_type one_milisecond(1000000L);
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <numeric>
 
-using namespace Helium;
+#include "args.h"
 
-std::string get_filename(const std::string &filename)
-{
-  return HEDATADIR + std::string("/") + filename;
-}
+using namespace Helium;
 
 using namespace boost::gregorian;
 using namespace boost::posix_time;
 
-class BenchmarkRecorder
-{
-  public:
+namespace {
 
-    BenchmarkRecorder() : m_first(true)
-    {
-      std::stringstream filename;
+  const int fingerprintWords = 16;
+  const int fingerprintBits = fingerprintWords * BitsPerWord;
+  const double similarityTmin = 0.7;
+  const unsigned int numSimilarityQueries = 20;
 
-      date d(day_clock::local_day());
-      filename << d.month() << "_" << d.day() << "_" << d.year() << "_";
+  const char *substructureQueries[] = { "c1ccccc1", "C(=O)O", "c1ccccc1Cl", "C1CCNCC1", "c1ccc2ccccc2c1", "NC(=O)", 0 };
 
-      ptime t(microsec_clock::local_time());
-      time_duration now = t.time_of_day();
-      filename << now.hours() << "_" << now.minutes() << "_" << now.seconds();
+  std::string data_filename(const std::string &filename)
+  {
+    return HEDATADIR + filename;
+  }
 
-      filename << ".benchmark";
+  /**
+   * The data shared by the benchmark cases. The fingerprints and the
+   * storages are created once when the first case that needs them runs,
+   * this set up is not timed.
+   */
+  struct BenchmarkData
+  {
+    BenchmarkData(const std::string &dataSet_) : dataSet(dataSet_), pool(0), numThreads(1), index(0)
+    {
+      filename = data_filename(dataSet + ".hel");
+      rowMajorFile = "benchmark_tmp_" + dataSet + "_rows.fps.hel";
+      columnMajorFile = "benchmark_tmp_" + dataSet + "_columns.fps.hel";
+    }
 
-      m_ofs.open(filename.str().c_str());
+    ~BenchmarkData()
+    {
+      delete index;
+      if (!fingerprints.empty()) {
+        std::remove(rowMajorFile.c_str());
+        std::remove(columnMajorFile.c_str());
+      }
+    }
 
-      m_ofs << "{ \"time\": \"" << d.month() << " " << d.day() << " " << d.year() << ", ";
-      if (now.hours() < 10)
-        m_ofs << 0;
-      m_ofs << now.hours() << ":";
-      if (now.minutes() < 10)
-        m_ofs << 0;
-      m_ofs << now.minutes() << ":";
-      if (now.seconds() < 10)
-        m_ofs << 0;
-      m_ofs << now.seconds() << "\", " << "\"benchmarks\": [";
+    /**
+     * Compute the fingerprints and write the fingerprint files.
+     */
+    void prepareFingerprints()
+    {
+      if (!fingerprints.empty())
+        return;
+      std::cerr << "Computing the fingerprints for " << filename << "..." << std::endl;
+      molecules.load(filename);
+      unsigned int n = molecules.numMolecules();
+      fingerprints.resize(static_cast<std::size_t>(n) * fingerprintWords);
+      HeMol mol;
+      for (unsigned int i = 0; i < n; ++i) {
+        molecules.read_molecule(i, mol);
+        path_fingerprint(mol, &fingerprints[static_cast<std::size_t>(i) * fingerprintWords]);
+      }
+
+      std::string header = make_string("{ \"filetype\": \"fingerprints\", \"order\": \"row-major\", \"num_bits\": ",
+          fingerprintBits, ", \"num_fingerprints\": ", n, " }");
+      {
+        RowMajorFingerprintOutputFile file(rowMajorFile, fingerprintBits);
+        for (unsigned int i = 0; i < n; ++i)
+          file.writeFingerprint(&fingerprints[static_cast<std::size_t>(i) * fingerprintWords]);
+        file.writeHeader(header);
+      }
+      {
+        ColumnMajorFingerprintOutputFile file(columnMajorFile, fingerprintBits, n);
+        for (unsigned int i = 0; i < n; ++i)
+          file.writeFingerprint(&fingerprints[static_cast<std::size_t>(i) * fingerprintWords]);
+        file.writeHeader(make_string("{ \"filetype\": \"fingerprints\", \"order\": \"column-major\", \"num_bits\": ",
+              fingerprintBits, ", \"num_fingerprints\": ", n, " }"));
+      }
+      rowMajor.load(rowMajorFile);
+      columnMajor.load(columnMajorFile);
+
+      // the similarity queries are evenly spaced over the fingerprints
+      for (unsigned int i = 0; i < numSimilarityQueries && n; ++i)
+        similarityQueries.push_back(rowMajor.fingerprint(static_cast<unsigned long long>(i) * n / numSimilarityQueries));
+
+      // the molecules are not copied once parsed
+      int numQueries = 0;
+      while (substructureQueries[numQueries])
+        ++numQueries;
+      queryMolecules.resize(numQueries);
+      queryFingerprints.resize(numQueries, std::vector<Word>(fingerprintWords));
+      for (int i = 0; i < numQueries; ++i) {
+        parse_smiles(substructureQueries[i], queryMolecules[i]);
+        path_fingerprint(queryMolecules[i], &queryFingerprints[i][0]);
+      }
     }
 
-    ~BenchmarkRecorder()
+    /**
+     * Build the similarity search index.
+     */
+    void prepareIndex()
     {
-      m_ofs << "]}";
+      prepareFingerprints();
+      if (!index)
+        index = new SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage>(rowMajor, 3, 0);
     }
 
-    void record(const std::string &label, int ms)
+    std::string dataSet; //!< The data set (e.g. 10K)
+    std::string filename; //!< The molecule file
+    std::string rowMajorFile; //!< The temporary row-major fingerprint file
+    std::string columnMajorFile; //!< The temporary column-major fingerprint file
+#ifdef HAVE_CPP11
+    ThreadPool *pool; //!< The pool for the threaded cases (0 for the other cases)
+#else
+    void *pool;
+#endif
+    unsigned int numThreads; //!< The number of threads for the threaded cases
+    MemoryMappedMoleculeFile molecules;
+    std::vector<Word> fingerprints;
+    InMemoryRowMajorFingerprintStorage rowMajor;
+    InMemoryColumnMajorFingerprintStorage columnMajor;
+    SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> *index;
+    std::vector<const Word*> similarityQueries;
+    std::vector<HeMol> queryMolecules;
+    std::vector<std::vector<Word> > queryFingerprints;
+  };
+
+  /*
+   * Molecule file and graph algorithm cases.
+   */
+
+  void benchmark_read(BenchmarkData &data)
+  {
+    BufferedMoleculeFile file(data.filename);
+    HeMol mol;
+    while (file.read_molecule(mol));
+  }
+
+  struct CountSubgraphs
+  {
+    CountSubgraphs() : count(0)
     {
-      if (m_first)
-        m_first = false;
-      else
-        m_ofs << ", ";
+    }
 
-      m_ofs << "{ \"benchmark\": \"" << label << "\", \"ms\": " << ms << "}";
+    void operator()(const Subgraph &subgraph)
+    {
+      ++count;
     }
 
-  private:
-    std::ofstream m_ofs;
-    bool m_first;
-};
+    int count;
+  };
 
-BenchmarkRecorder recorder;
+  void benchmark_enumerate_subgraphs(BenchmarkData &data)
+  {
+    BufferedMoleculeFile file(data.filename);
+    HeMol mol;
+    while (file.read_molecule(mol)) {
+      CountSubgraphs callback;
+      enumerate_subgraphs(mol, callback, 7);
+    }
+  }
 
+  void benchmark_canonicalize(BenchmarkData &data)
+  {
+    BufferedMoleculeFile file(data.filename);
+    HeMol mol;
+    while (file.read_molecule(mol))
+      canonicalize(mol, extended_connectivities(mol));
+  }
 
-/**
- *
- * Benchmark reading *.hem files.
- *
- */
+  /*
+   * Fingerprint cases.
+   */
+
+  void benchmark_path_fingerprints(BenchmarkData &data)
+  {
+    data.prepareFingerprints();
+    unsigned int n = data.molecules.numMolecules();
+#ifdef HAVE_CPP11
+    data.pool->parallelFor(n, 256, [&] (std::size_t begin, std::size_t end) {
+#else
+    std::size_t begin = 0, end = n;
+    {
+#endif
+      HeMol mol;
+      std::vector<Word> fingerprint(fingerprintWords);
+      for (std::size_t i = begin; i < end; ++i) {
+        data.molecules.read_molecule(i, mol);
+        path_fingerprint(mol, &fingerprint[0]);
+      }
+#ifdef HAVE_CPP11
+    });
+#else
+    }
+#endif
+  }
 
-void benchmark_read(const std::string &filename)
-{
-  boost::timer::cpu_timer timer;
+  void benchmark_index_build(BenchmarkData &data)
+  {
+    data.prepareFingerprints();
+    SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(data.rowMajor, 3, data.numThreads);
+  }
 
-  // open molecule file
-  MoleculeFile file(get_filename(filename));
-  HeMol mol;
+  /*
+   * Similarity search cases.
+   */
+
+  void benchmark_brute_force(BenchmarkData &data)
+  {
+    data.prepareFingerprints();
+    for (std::size_t i = 0; i < data.similarityQueries.size(); ++i)
+#ifdef HAVE_CPP11
+      brute_force_similarity_search_threaded(data.similarityQueries[i], data.rowMajor, similarityTmin, *data.pool);
+#else
+      brute_force_similarity_search(data.similarityQueries[i], data.rowMajor, similarityTmin);
+#endif
+  }
 
-  // read molecules
-  while (file.read_molecule(mol));
+  void benchmark_bitsliced(BenchmarkData &data)
+  {
+    data.prepareFingerprints();
+    for (std::size_t i = 0; i < data.similarityQueries.size(); ++i)
+#ifdef HAVE_CPP11
+      bitsliced_similarity_search_threaded(data.similarityQueries[i], data.columnMajor, similarityTmin, *data.pool);
+#else
+      bitsliced_similarity_search(data.similarityQueries[i], data.columnMajor, similarityTmin);
+#endif
+  }
 
-  boost::timer::cpu_times elapsed = timer.elapsed();
-  int ms = (elapsed.system + elapsed.user) / one_milisecond;
-  std::cout << "read_file (" << file.current() << " molecules): " << ms << " ms" << std::endl;
-  recorder.record("read_file", ms);
-}
+  void benchmark_index_search(BenchmarkData &data)
+  {
+    data.prepareIndex();
+    for (std::size_t i = 0; i < data.similarityQueries.size(); ++i)
+      data.index->search(data.similarityQueries[i], similarityTmin);
+  }
 
-/**
- *
- * Benchmark subgraph enumeration.
- *
- */
+  void benchmark_knn_search(BenchmarkData &data)
+  {
+    data.prepareIndex();
+    for (std::size_t i = 0; i < data.similarityQueries.size(); ++i)
+      data.index->knnSearch(data.similarityQueries[i], 10);
+  }
 
-template<typename MoleculeType>
-struct EnumerateSubgraphsCallback
-{
-  EnumerateSubgraphsCallback() : count(0) {}
-  void operator()(const Subgraph &subgraph) { ++count; }
-  int count;
-};
+  /*
+   * Substructure search cases.
+   */
+
+  void benchmark_screen(BenchmarkData &data)
+  {
+    data.prepareFingerprints();
+    std::vector<Word> candidates(bitvec_num_words_for_bits(data.columnMajor.numFingerprints()) + 1);
+    for (std::size_t i = 0; i < data.queryFingerprints.size(); ++i)
+#ifdef HAVE_CPP11
+      substructure_screen_threaded(data.columnMajor, &data.queryFingerprints[i][0], &candidates[0], *data.pool);
+#else
+      substructure_screen(data.columnMajor, &data.queryFingerprints[i][0], &candidates[0]);
+#endif
+  }
 
-void benchmark_enumerate_subgraphs(const std::string &filename, int size = 7)
-{
-  boost::timer::cpu_timer timer;
+  void benchmark_verify(BenchmarkData &data)
+  {
+    data.prepareFingerprints();
+    std::vector<Word> candidates(bitvec_num_words_for_bits(data.columnMajor.numFingerprints()) + 1);
+    for (std::size_t i = 0; i < data.queryFingerprints.size(); ++i) {
+      substructure_screen(data.columnMajor, &data.queryFingerprints[i][0], &candidates[0]);
+#ifdef HAVE_CPP11
+      substructure_verify_threaded(data.molecules, data.queryMolecules[i], &candidates[0], *data.pool);
+#else
+      substructure_verify(data.molecules, data.queryMolecules[i], &candidates[0]);
+#endif
+    }
+  }
 
-  // open molecule file
-  MoleculeFile file(get_filename(filename));
-  HeMol mol;
+#ifdef HAVE_CPP11
+  void benchmark_pipelined(BenchmarkData &data)
+  {
+    data.prepareFingerprints();
+    std::vector<Word> candidates(bitvec_num_words_for_bits(data.columnMajor.numFingerprints()) + 1);
+    CancellationToken token;
+    for (std::size_t i = 0; i < data.queryFingerprints.size(); ++i) {
+      std::vector<unsigned int> timedOut;
+      SubstructureScreen<InMemoryColumnMajorFingerprintStorage> screen(data.columnMajor, &data.queryFingerprints[i][0]);
+      substructure_search_pipelined(screen, data.molecules, data.queryMolecules[i], &candidates[0],
+          token, 0, timedOut, *data.pool);
+    }
+  }
+#endif
+
+  /**
+   * A benchmark case.
+   */
+  struct BenchmarkCase
+  {
+    const char *name; //!< The name (group.case)
+    bool threaded; //!< Run the case for each thread count in the sweep
+    void (*run)(BenchmarkData&); //!< The benchmark function
+    const char *description;
+  };
+
+  const BenchmarkCase benchmarkCases[] = {
+    { "molecules.read", false, benchmark_read, "Read all molecules using a BufferedMoleculeFile" },
+    { "molecules.enumerate_subgraphs", false, benchmark_enumerate_subgraphs, "Enumerate the subgraphs with up to 7 atoms" },
+    { "molecules.canonicalize", false, benchmark_canonicalize, "Canonicalize all molecules" },
+    { "fingerprints.path", true, benchmark_path_fingerprints, "Compute the path fingerprints for all molecules" },
+    { "similarity.index_build", true, benchmark_index_build, "Build a frozen SimilaritySearchIndex (k = 3)" },
+    { "similarity.brute_force", true, benchmark_brute_force, "Brute force search for 20 queries (Tmin = 0.7)" },
+    { "similarity.bitsliced", true, benchmark_bitsliced, "Bit-sliced column-major search for 20 queries (Tmin = 0.7)" },
+    { "similarity.index_search", false, benchmark_index_search, "Index search for 20 queries (Tmin = 0.7)" },
+    { "similarity.knn_search", false, benchmark_knn_search, "Index k-NN search for 20 queries (k = 10)" },
+    { "substructure.screen", true, benchmark_screen, "Screen 6 queries using the column-major fingerprints" },
+    { "substructure.verify", true, benchmark_verify, "Screen and verify 6 queries" },
+#ifdef HAVE_CPP11
+    { "substructure.pipelined", true, benchmark_pipelined, "Pipelined screening and verification of 6 queries" },
+#endif
+    { 0, false, 0, 0 }
+  };
+
+  /**
+   * The measurements for a case: the wall and CPU times in milliseconds for
+   * each repetition.
+   */
+  struct BenchmarkResult
+  {
+    std::string key;
+    std::string name;
+    unsigned int numThreads;
+    std::vector<double> wall;
+    std::vector<double> cpu;
+  };
+
+  /**
+   * Get the q-th percentile of the samples (nearest rank).
+   */
+  double percentile(std::vector<double> samples, double q)
+  {
+    std::sort(samples.begin(), samples.end());
+    std::size_t rank = static_cast<std::size_t>(std::ceil(q * samples.size()));
+    return samples[std::max<std::size_t>(rank, 1) - 1];
+  }
 
-  // read molecules
-  while (file.read_molecule(mol)) {
-    EnumerateSubgraphsCallback<HeMol> callback;
-    enumerate_subgraphs(mol, callback, size);
+  Json::Value statistics(const std::vector<double> &samples)
+  {
+    Json::Value data;
+    data["min"] = *std::min_element(samples.begin(), samples.end());
+    data["max"] = *std::max_element(samples.begin(), samples.end());
+    data["mean"] = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    data["median"] = percentile(samples, 0.5);
+    data["p10"] = percentile(samples, 0.1);
+    data["p90"] = percentile(samples, 0.9);
+    data["samples"] = Json::Value(Json::arrayValue);
+    for (std::size_t i = 0; i < samples.size(); ++i)
+      data["samples"][Json::ArrayIndex(i)] = samples[i];
+    return data;
   }
 
-  boost::timer::cpu_times elapsed = timer.elapsed();
-  int ms = (elapsed.system + elapsed.user) / one_milisecond;
-  std::cout << "subgraph_enumeration (" << file.current() << " molecules): " << ms << " ms" << std::endl;
-  recorder.record("subgraph_enumeration", ms);
-}
+  /**
+   * Run a case once, the times are in milliseconds.
+   */
+  void measure(const BenchmarkCase &benchmark, BenchmarkData &data, double &wall, double &cpu)
+  {
+    boost::timer::cpu_timer timer;
+    unsigned long long start = impl::monotonic_nanoseconds();
+    benchmark.run(data);
+    wall = (impl::monotonic_nanoseconds() - start) / 1e6;
+    boost::timer::cpu_times elapsed = timer.elapsed();
+    cpu = (elapsed.user + elapsed.system) / 1e6;
+  }
 
-void benchmark_canonicalize(const std::string &filename)
-{
-  boost::timer::cpu_timer timer;
+  std::string default_output_filename()
+  {
+    std::stringstream filename;
+    date d(day_clock::local_day());
+    filename << d.month() << "_" << d.day() << "_" << d.year() << "_";
+    time_duration now = microsec_clock::local_time().time_of_day();
+    filename << now.hours() << "_" << now.minutes() << "_" << now.seconds() << ".benchmark";
+    return filename.str();
+  }
 
-  // open molecule file
-  MoleculeFile file(get_filename(filename));
-  HeMol mol;
+  std::vector<unsigned int> default_thread_counts()
+  {
+    std::vector<unsigned int> counts(1, 1);
+#ifdef HAVE_CPP11
+    unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int n = 2; n < hardware; n *= 2)
+      counts.push_back(n);
+    if (hardware > 1)
+      counts.push_back(hardware);
+#endif
+    return counts;
+  }
 
-  // read molecules
-  while (file.read_molecule(mol)) {
-    canonicalize(mol, extended_connectivities(mol));
+  /**
+   * Compare the median wall times with a baseline file written by a
+   * previous run.
+   *
+   * @return The number of cases that are slower than the baseline by more
+   *         than @p tolerance percent.
+   */
+  int compare_baseline(const std::vector<BenchmarkResult> &results, const std::string &filename, double tolerance)
+  {
+    std::ifstream ifs(filename.c_str());
+    Json::Reader reader;
+    Json::Value baseline;
+    if (!ifs || !reader.parse(ifs, baseline))
+      throw std::runtime_error(make_string("Could not read baseline file ", filename));
+
+    std::map<std::string, double> medians;
+    const Json::Value &benchmarks = baseline["benchmarks"];
+    for (Json::ArrayIndex i = 0; i < benchmarks.size(); ++i)
+      medians[benchmarks[i]["key"].asString()] = benchmarks[i]["wall_ms"]["median"].asDouble();
+
+    int regressions = 0;
+    std::cout << std::endl << "Comparison with " << filename << " (median wall time):" << std::endl;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      std::map<std::string, double>::const_iterator b = medians.find(results[i].key);
+      if (b == medians.end()) {
+        std::cout << "  " << results[i].key << ": not in baseline" << std::endl;
+        continue;
+      }
+      double median = percentile(results[i].wall, 0.5);
+      double change = b->second > 0.0 ? 100.0 * (median - b->second) / b->second : 0.0;
+      bool regression = change > tolerance;
+      regressions += regression;
+      std::cout << "  " << results[i].key << ": " << median << " ms vs " << b->second << " ms ("
+                << (change >= 0.0 ? "+" : "") << change << "%)" << (regression ? " REGRESSION" : "") << std::endl;
+    }
+    return regressions;
+  }
+
+  void usage(const char *command)
+  {
+    std::cerr << "Usage: " << command << " [options]" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Run the benchmark suite on one of the bundled data sets. Each case is run once to warm" << std::endl;
+    std::cerr << "up and then repeated, the wall and CPU times are reported as median and percentiles." << std::endl;
+    std::cerr << "The threaded cases are run for each thread count in the sweep. The results are written" << std::endl;
+    std::cerr << "as JSON and can be compared with a previous run." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "    -data <set>      The data set: 1K, 10K, 100K or 1M (default is 10K)" << std::endl;
+    std::cerr << "    -repeat <n>      The number of timed repetitions (default is 5)" << std::endl;
+    std::cerr << "    -threads <list>  Comma separated thread counts for the threaded cases (default is" << std::endl;
+    std::cerr << "                     1 and powers of 2 up to the number of cores)" << std::endl;
+    std::cerr << "    -filter <text>   Only run the cases with a name containing text" << std::endl;
+    std::cerr << "    -output <file>   The JSON output file (default is a date stamped .benchmark file)" << std::endl;
+    std::cerr << "    -baseline <file> Compare the median wall times with a previous output file, the exit" << std::endl;
+    std::cerr << "                     code is 1 if a case is slower than the tolerance" << std::endl;
+    std::cerr << "    -tolerance <pct> The allowed slowdown in percent (default is 10)" << std::endl;
+    std::cerr << "    -list            List the cases" << std::endl;
+    std::cerr << std::endl;
   }
 
-  boost::timer::cpu_times elapsed = timer.elapsed();
-  int ms = (elapsed.system + elapsed.user) / one_milisecond;
-  std::cout << "canonicalize (" << file.current() << " molecules): " << ms << " ms" << std::endl;
-  recorder.record("canonicalize", ms);
 }
 
+int main(int argc, char **argv)
+{
+  ParseArgs args(argc, argv, ParseArgs::Args("-data(set)", "-repeat(n)", "-threads(list)", "-filter(text)",
+        "-output(file)", "-baseline(file)", "-tolerance(pct)", "-list", "-help"), ParseArgs::Args());
+  if (!args.IsValid() || args.IsArg("-help")) {
+    usage(argv[0]);
+    return -1;
+  }
 
+  const std::string dataSet = args.IsArg("-data") ? args.GetArgString("-data", 0) : std::string("10K");
+  const int repeat = args.IsArg("-repeat") ? args.GetArgInt("-repeat", 0) : 5;
+  const std::string filter = args.IsArg("-filter") ? args.GetArgString("-filter", 0) : std::string();
+  const std::string output = args.IsArg("-output") ? args.GetArgString("-output", 0) : default_output_filename();
+  const double tolerance = args.IsArg("-tolerance") ? args.GetArgDouble("-tolerance", 0) : 10.0;
+
+  if (args.IsArg("-list")) {
+    for (int i = 0; benchmarkCases[i].name; ++i)
+      std::cout << benchmarkCases[i].name << (benchmarkCases[i].threaded ? " (threaded)" : "")
+                << ": " << benchmarkCases[i].description << std::endl;
+    return 0;
+  }
+
+  if (repeat < 1) {
+    std::cerr << "The number of repetitions must be at least 1" << std::endl;
+    return -1;
+  }
 
+  std::vector<unsigned int> threadCounts = default_thread_counts();
+  if (args.IsArg("-threads")) {
+    threadCounts.clear();
+    std::vector<std::string> counts = tokenize(args.GetArgString("-threads", 0), ",");
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+      int n = std::atoi(counts[i].c_str());
+      if (n < 1) {
+        std::cerr << "Invalid thread count \"" << counts[i] << "\"" << std::endl;
+        return -1;
+      }
+      threadCounts.push_back(n);
+    }
+  }
+#ifndef HAVE_CPP11
+  // the threaded cases run on the calling thread
+  threadCounts.assign(1, 1);
+#endif
+
+  std::vector<BenchmarkResult> results;
+  try {
+    BenchmarkData data(dataSet);
+    if (!std::ifstream(data.filename.c_str())) {
+      std::cerr << "Data set " << data.filename << " not found" << std::endl;
+      return -1;
+    }
 
+    for (int i = 0; benchmarkCases[i].name; ++i) {
+      const BenchmarkCase &benchmark = benchmarkCases[i];
+      if (std::string(benchmark.name).find(filter) == std::string::npos)
+        continue;
+
+      std::vector<unsigned int> counts = benchmark.threaded ? threadCounts : std::vector<unsigned int>(1, 1);
+      for (std::size_t t = 0; t < counts.size(); ++t) {
+        BenchmarkResult result;
+        result.name = benchmark.name;
+        result.numThreads = counts[t];
+        result.key = benchmark.threaded ? make_string(benchmark.name, "/threads=", counts[t]) : result.name;
+
+#ifdef HAVE_CPP11
+        // the pool is created before timing
+        ThreadPool pool(counts[t]);
+        data.pool = &pool;
+#endif
+        data.numThreads = counts[t];
+
+        double wall, cpu;
+        measure(benchmark, data, wall, cpu); // warm up
+        for (int r = 0; r < repeat; ++r) {
+          measure(benchmark, data, wall, cpu);
+          result.wall.push_back(wall);
+          result.cpu.push_back(cpu);
+        }
+        data.pool = 0;
+
+        std::cout << result.key << ": " << percentile(result.wall, 0.5) << " ms wall ["
+                  << percentile(result.wall, 0.1) << ", " << percentile(result.wall, 0.9) << "], "
+                  << percentile(result.cpu, 0.5) << " ms cpu" << std::endl;
+        results.push_back(result);
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
 
+  //
+  // write the results
+  //
+  Json::Value data;
+  data["time"] = to_simple_string(microsec_clock::local_time());
+  data["data"] = dataSet;
+  data["repeat"] = repeat;
+  data["benchmarks"] = Json::Value(Json::arrayValue);
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    Json::Value &benchmark = data["benchmarks"][Json::ArrayIndex(i)];
+    benchmark["key"] = results[i].key;
+    benchmark["benchmark"] = results[i].name;
+    benchmark["threads"] = results[i].numThreads;
+    benchmark["wall_ms"] = statistics(results[i].wall);
+    benchmark["cpu_ms"] = statistics(results[i].cpu);
+  }
+  std::ofstream ofs(output.c_str());
+  Json::StyledWriter writer;
+  ofs << writer.write(data);
+  if (!ofs) {
+    std::cerr << "Could not write " << output << std::endl;
+    return -1;
+  }
 
+  if (args.IsArg("-baseline")) {
+    try {
+      return compare_baseline(results, args.GetArgString("-baseline", 0), tolerance) ? 1 : 0;
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return -1;
+    }
+  }
 
-int main(int argc, char**argv)
-{
-  benchmark_read("1M.hem");
-  benchmark_enumerate_subgraphs("10K.hem");
-  benchmark_canonicalize("10K.hem");
+  return 0;
 }
@@ -0,0 +1,147 @@
+/**
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "tool.h"
+
+#include <Helium/fingerprints/cluster.h>
+#include <Helium/fileio/fingerprints.h>
+
+#include <json/json.h>
+
+#include "args.h"
+
+namespace Helium {
+
+  class ClusterTool : public HeliumTool
+  {
+    public:
+      /**
+       * Perform tool action.
+       */
+      int run(int argc, char **argv)
+      {
+        //
+        // Argument handling
+        //
+        ParseArgs args(argc, argv, ParseArgs::Args("-Tmin(number)", "-k(number)",
+#ifdef HAVE_CPP11
+              "-mt",
+#endif
+              "-benchmark"), ParseArgs::Args("fingerprint_file"));
+        // optional arguments
+        const double Tmin = args.IsArg("-Tmin") ? args.GetArgDouble("-Tmin", 0) - 10e-5 : 0.7 - 10e-5;
+        const int k = args.IsArg("-k") ? args.GetArgInt("-k", 0) : 3;
+        const bool benchmark = args.IsArg("-benchmark");
+        unsigned int numThreads = 1;
+#ifdef HAVE_CPP11
+        if (args.IsArg("-mt"))
+          numThreads = 0;
+#endif
+        // required arguments
+        std::string filename = args.GetArgString("fingerprint_file");
+
+        if (k < 1) {
+          std::cerr << "The dimension of the kD-grid must be at least 1" << std::endl;
+          return -1;
+        }
+
+        //
+        // open fingerprint file
+        //
+        InMemoryRowMajorFingerprintStorage storage;
+        try {
+          storage.load(filename);
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+
+        //
+        // find the neighbors and cluster the fingerprints
+        //
+        SimilarityNeighbors neighbors(storage, Tmin, k, numThreads);
+        std::vector<std::vector<unsigned int> > clusters = butina_clustering(neighbors);
+
+        if (benchmark)
+          return 0;
+
+        //
+        // print results
+        //
+        Json::Value data;
+        data["num_fingerprints"] = storage.numFingerprints();
+        data["num_clusters"] = Json::UInt(clusters.size());
+        data["clusters"] = Json::Value(Json::arrayValue);
+        for (std::size_t i = 0; i < clusters.size(); ++i) {
+          Json::Value &cluster = data["clusters"][Json::ArrayIndex(i)];
+          cluster["centroid"] = clusters[i][0];
+          cluster["members"] = Json::Value(Json::arrayValue);
+          for (std::size_t j = 1; j < clusters[i].size(); ++j)
+            cluster["members"][Json::ArrayIndex(j - 1)] = clusters[i][j];
+        }
+
+        Json::StyledWriter writer;
+        std::cout << writer.write(data);
+
+        return 0;
+      }
+
+  };
+
+  class ClusterToolFactory : public HeliumToolFactory
+  {
+    public:
+      HELIUM_TOOL("cluster", "Cluster the fingerprints in a fingerprint file", 1, ClusterTool);
+
+      /**
+       * Get usage information.
+       */
+      std::string usage(const std::string &command) const
+      {
+        std::stringstream ss;
+        ss << "Usage: " << command << " [options] <fingerprint_file>" << std::endl;
+        ss << std::endl;
+        ss << "Cluster the fingerprints in a fingerprint file using the Taylor-Butina algorithm. The" << std::endl;
+        ss << "fingerprint file must store the fingerprints in row-major order. The neighbors of all" << std::endl;
+        ss << "fingerprints are found using a similarity search index and are kept in memory. The" << std::endl;
+        ss << "fingerprints with the most neighbors are selected as centroids first, the unassigned" << std::endl;
+        ss << "neighbors of a centroid are the members of its cluster." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -Tmin <n>     The minimum tanimoto score for neighbors (default is 0.7)" << std::endl;
+        ss << "    -k <n>        Specify the dimension for the kD-grid (default is 3)" << std::endl;
+#ifdef HAVE_CPP11
+        ss << "    -mt           Find the neighbors using multiple threads (default is not to use threads)" << std::endl;
+#endif
+        ss << "    -benchmark    Cluster the fingerprints without printing the results" << std::endl;
+        ss << std::endl;
+        return ss.str();
+      }
+  };
+
+  ClusterToolFactory theClusterToolFactory;
+
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "tool.h"
+
+#include <Helium/fileio/molecules.h>
+
+#include "args.h"
+
+namespace Helium {
+
+  /**
+   * Tool for compressing molecule files.
+   */
+  class CompressTool : public HeliumTool
+  {
+    public:
+      /**
+       * Perform tool action.
+       */
+      int run(int argc, char**argv)
+      {
+        ParseArgs args(argc, argv, ParseArgs::Args("-block_size(number)", "-index_stride(number)"), ParseArgs::Args("in_file", "out_file"));
+        // optional arguments
+        const int blockSize = args.IsArg("-block_size") ? args.GetArgInt("-block_size", 0) : 256;
+        const int indexStride = args.IsArg("-index_stride") ? args.GetArgInt("-index_stride", 0) : 1;
+        // required arguments
+        std::string inFile = args.GetArgString("in_file");
+        std::string outFile = args.GetArgString("out_file");
+
+        if (blockSize < 1) {
+          std::cerr << "The block size must be at least 1" << std::endl;
+          return -1;
+        }
+        if (indexStride < 1 || blockSize % indexStride) {
+          std::cerr << "The index stride must be at least 1 and divide the block size" << std::endl;
+          return -1;
+        }
+
+        try {
+          compress_molecule_file(inFile, outFile, blockSize, indexStride);
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+
+        return 0;
+      }
+
+  };
+
+  class CompressToolFactory : public HeliumToolFactory
+  {
+    public:
+      HELIUM_TOOL("compress", "Compress molecule files", 2, CompressTool);
+
+      /**
+       * Get usage information.
+       */
+      std::string usage(const std::string &command) const
+      {
+        std::stringstream ss;
+        ss << "Usage: " << command << " [options] <in_file> <out_file>" << std::endl;
+        ss << std::endl;
+        ss << "Compress the molecule records in blocks using zlib. All tools can read the" << std::endl;
+        ss << "compressed files, blocks are uncompressed when needed." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -block_size <number>    The number of molecules per block (default is 256)" << std::endl;
+        ss << "    -index_stride <number>  Only store the position of every n-th molecule (default is 1)" << std::endl;
+        ss << std::endl;
+        return ss.str();
+      }
+  };
+
+  CompressToolFactory theCompressToolFactory;
+
+}
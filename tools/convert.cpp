@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "tool.h"
+
+#include <Helium/hemol.h>
+#include <Helium/smiles.h>
+#include <Helium/algorithms/cycles.h>
+#include <Helium/fileio/molecules.h>
+
+#include "args.h"
+#include "moleculepipeline.h"
+
+#include <fstream>
+#include <algorithm>
+
+namespace Helium {
+
+  namespace {
+
+    /**
+     * Get the number of implicit hydrogens for an unbracketed atom using
+     * the default valences of the SMILES organic subset.
+     */
+    int implicit_hydrogens(HeMol &mol, const HeAtom &atom)
+    {
+      static const int valences[][3] = {
+        { 0, 0, 0 }, // dummy
+        { 3, 0, 0 }, // B
+        { 4, 0, 0 }, // C
+        { 3, 5, 0 }, // N
+        { 2, 0, 0 }, // O
+        { 3, 5, 0 }, // P
+        { 2, 4, 6 }, // S
+        { 1, 0, 0 }  // F, Cl, Br, I
+      };
+
+      int row = 0;
+      switch (atom.element()) {
+        case 5: row = 1; break;
+        case 6: row = 2; break;
+        case 7: row = 3; break;
+        case 8: row = 4; break;
+        case 15: row = 5; break;
+        case 16: row = 6; break;
+        case 9: case 17: case 35: case 53: row = 7; break;
+        default: return 0;
+      }
+
+      // aromatic bonds count as single bonds, an aromatic atom has one more
+      int valence = atom.isAromatic() ? 1 : 0;
+      FOREACH_INCIDENT (bond, atom, mol, HeMol)
+        valence += (*bond).isAromatic() ? 1 : (*bond).order();
+
+      // aromatic atoms only use their lowest valence (e.g. pyrrole n has no H)
+      if (atom.isAromatic())
+        return std::max(0, valences[row][0] - valence);
+
+      for (int i = 0; i < 3 && valences[row][i]; ++i)
+        if (valences[row][i] >= valence)
+          return valences[row][i] - valence;
+      return 0;
+    }
+
+    /**
+     * @brief A SMILES and its line number in the input file.
+     */
+    struct SmilesLine
+    {
+      SmilesLine() : line(0)
+      {
+      }
+
+      std::string smiles; //!< The SMILES
+      std::size_t line; //!< The line number (starting from 1)
+    };
+
+    /**
+     * Read one SMILES line (the SMILES is the first word).
+     */
+    struct SmilesReader
+    {
+      SmilesReader(std::istream &is_) : is(is_), line(0)
+      {
+      }
+
+      bool operator()(SmilesLine &smiles)
+      {
+        while (std::getline(is, buffer)) {
+          ++line;
+          // the SMILES ends at the first whitespace
+          std::size_t begin = buffer.find_first_not_of(" \t\r");
+          if (begin == std::string::npos)
+            continue;
+          std::size_t end = buffer.find_first_of(" \t\r", begin);
+          smiles.smiles.assign(buffer, begin, end == std::string::npos ? std::string::npos : end - begin);
+          smiles.line = line;
+          return true;
+        }
+        return false;
+      }
+
+      std::istream &is;
+      std::string buffer; //!< The current line
+      std::size_t line; //!< The current line number
+    };
+
+    /**
+     * Convert a SMILES to a molecule record, the cyclic flags and
+     * implicit hydrogens are perceived. The parser, molecule and buffers
+     * are reused for all SMILES in a chunk (see write_molecule_file()).
+     * Invalid SMILES throw an exception with the line number and error.
+     */
+    struct SmilesConverter
+    {
+      bool operator()(const SmilesLine &smiles, std::ostream &os)
+      {
+        if (!parser.parse(smiles.smiles, mol)) {
+          const SmilesError &error = parser.error();
+          throw std::runtime_error(make_string("Invalid SMILES on line ", smiles.line, " (",
+                error.syntaxError ? "syntax" : "semantics", " error at position ", error.pos,
+                ": ", error.what, "): ", smiles.smiles));
+        }
+
+        // unbracketed atoms have mass and hydrogen count -1
+        FOREACH_ATOM (atom, mol, HeMol) {
+          if ((*atom).mass() == 255)
+            (*atom).setMass(0);
+          if ((*atom).hydrogens() == 255)
+            (*atom).setHydrogens(implicit_hydrogens(mol, *atom));
+        }
+
+        // perceive cycles
+        cycle_membership(mol, cyclicAtoms, cyclicBonds, scratch);
+        FOREACH_ATOM (cyclicAtom, mol, HeMol)
+          (*cyclicAtom).setCyclic(cyclicAtoms[get_index(mol, *cyclicAtom)]);
+        FOREACH_BOND (bond, mol, HeMol)
+          (*bond).setCyclic(cyclicBonds[get_index(mol, *bond)]);
+
+        write_molecule(os, mol);
+        return true;
+      }
+
+      SmilesParser<HeMol> parser; //!< The reused parser
+      HeMol mol; //!< The reused molecule
+      std::vector<bool> cyclicAtoms; //!< The cyclic atoms
+      std::vector<bool> cyclicBonds; //!< The cyclic bonds
+      CycleMembershipScratch scratch; //!< Buffers for cycle_membership()
+    };
+
+  }
+
+  /**
+   * Tool for converting SMILES files to Helium molecule files.
+   */
+  class ConvertTool : public HeliumTool
+  {
+    public:
+      /**
+       * Perform tool action.
+       */
+      int run(int argc, char**argv)
+      {
+        ParseArgs args(argc, argv, ParseArgs::Args("-threads(number)", "-chunk(number)", "-index_stride(number)", "-errors(file)"), ParseArgs::Args("in_file", "out_file"));
+        // optional arguments
+        const int numThreads = args.IsArg("-threads") ? args.GetArgInt("-threads", 0) : 0;
+        const int chunkSize = args.IsArg("-chunk") ? args.GetArgInt("-chunk", 0) : 1000;
+        const int indexStride = args.IsArg("-index_stride") ? args.GetArgInt("-index_stride", 0) : 1;
+        std::string errorsFile = args.IsArg("-errors") ? args.GetArgString("-errors", 0) : std::string();
+        // required arguments
+        std::string inFile = args.GetArgString("in_file");
+        std::string outFile = args.GetArgString("out_file");
+
+        if (numThreads < 0 || chunkSize < 1 || indexStride < 1) {
+          std::cerr << "Invalid number of threads, chunk size or index stride" << std::endl;
+          return -1;
+        }
+
+        std::ifstream ifs(inFile.c_str());
+        if (!ifs) {
+          std::cerr << "Could not open file " << inFile << std::endl;
+          return -1;
+        }
+
+        try {
+          SmilesReader reader(ifs);
+          SmilesConverter converter;
+          std::vector<MoleculeError> errors;
+          unsigned int numMolecules = write_molecule_file<SmilesLine>(outFile, reader, converter, numThreads,
+              chunkSize, indexStride, &errors);
+          std::cerr << "Converted " << numMolecules << " molecules" << std::endl;
+
+          // report the invalid SMILES
+          if (!errors.empty()) {
+            std::cerr << "Skipped " << errors.size() << " invalid SMILES" << std::endl;
+            if (errorsFile.empty()) {
+              for (std::size_t i = 0; i < errors.size(); ++i)
+                std::cerr << errors[i].message << std::endl;
+            } else {
+              std::ofstream ofs(errorsFile.c_str());
+              if (!ofs)
+                throw std::runtime_error(make_string("Could not open file ", errorsFile));
+              for (std::size_t i = 0; i < errors.size(); ++i)
+                ofs << errors[i].message << std::endl;
+            }
+          }
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+
+        return 0;
+      }
+
+  };
+
+  class ConvertToolFactory : public HeliumToolFactory
+  {
+    public:
+      HELIUM_TOOL("convert", "Convert SMILES files to molecule files", 2, ConvertTool);
+
+      /**
+       * Get usage information.
+       */
+      std::string usage(const std::string &command) const
+      {
+        std::stringstream ss;
+        ss << "Usage: " << command << " [options] <in_file> <out_file>" << std::endl;
+        ss << std::endl;
+        ss << "Convert a SMILES file (one SMILES per line, the SMILES is the first word) to a" << std::endl;
+        ss << "molecule file without OpenBabel. The SMILES should be normalized since only ring" << std::endl;
+        ss << "membership and implicit hydrogens are perceived (e.g. aromaticity is used as is)." << std::endl;
+        ss << "Invalid SMILES are skipped and reported with their line number. The molecules are" << std::endl;
+        ss << "converted using multiple threads." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -threads <number>       The number of threads (default is the number of cores)" << std::endl;
+        ss << "    -chunk <number>         The number of molecules per chunk (default is 1000)" << std::endl;
+        ss << "    -index_stride <number>  Only store the position of every n-th molecule (default is 1)" << std::endl;
+        ss << "    -errors <file>          Write the invalid SMILES to a file instead of stderr" << std::endl;
+        ss << std::endl;
+        return ss.str();
+      }
+  };
+
+  ConvertToolFactory theConvertToolFactory;
+
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "tool.h"
+
+#include <Helium/fingerprints/hashindex.h>
+#include <Helium/fileio/fingerprints.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/algorithms/canonical.h>
+#include <Helium/algorithms/cachedproperties.h>
+#include <Helium/hemol.h>
+
+#include <json/json.h>
+
+#include "args.h"
+
+namespace Helium {
+
+  class DedupTool : public HeliumTool
+  {
+    public:
+      /**
+       * Hash a canonical key (see canonical_key()).
+       */
+      static uint64_t hash_key(const std::vector<unsigned long> &key)
+      {
+        uint64_t h = 0x9e3779b97f4a7c15ULL ^ key.size();
+        for (std::size_t i = 0; i < key.size(); ++i) {
+          h ^= key[i];
+          h *= 0xbf58476d1ce4e5b9ULL;
+          h ^= h >> 31;
+        }
+        return h;
+      }
+
+      /**
+       * Find the groups of duplicate molecules in a molecule file. The
+       * canonical keys are hashed in a single pass, the molecules in runs of
+       * equal hash values are read again to compare the keys.
+       */
+      static std::vector<std::vector<unsigned int> > molecule_duplicates(MoleculeFile &file, unsigned int &numSkipped)
+      {
+        std::vector<std::pair<uint64_t, unsigned int> > hashes;
+        hashes.reserve(file.numMolecules());
+        numSkipped = 0;
+
+        HeMol mol;
+        for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+          file.read_molecule(i, mol);
+          std::vector<unsigned long> key = canonical_key(mol, cached_extended_connectivities(mol));
+          if (key.empty())
+            ++numSkipped;
+          else
+            hashes.push_back(std::make_pair(hash_key(key), i));
+        }
+
+        std::sort(hashes.begin(), hashes.end());
+
+        std::vector<std::vector<unsigned int> > groups;
+        for (std::size_t begin = 0, end = 0; begin < hashes.size(); begin = end) {
+          end = begin + 1;
+          while (end < hashes.size() && hashes[end].first == hashes[begin].first)
+            ++end;
+          if (end - begin < 2)
+            continue;
+
+          // compare the keys, hash collisions are split in separate groups
+          std::vector<std::pair<std::vector<unsigned long>, unsigned int> > keys;
+          for (std::size_t i = begin; i < end; ++i) {
+            file.read_molecule(hashes[i].second, mol);
+            keys.push_back(std::make_pair(canonical_key(mol, cached_extended_connectivities(mol)), hashes[i].second));
+          }
+          std::sort(keys.begin(), keys.end());
+          for (std::size_t i = 0, j = 0; i < keys.size(); i = j) {
+            j = i + 1;
+            while (j < keys.size() && keys[j].first == keys[i].first)
+              ++j;
+            if (j - i < 2)
+              continue;
+            groups.resize(groups.size() + 1);
+            for (std::size_t k = i; k < j; ++k)
+              groups.back().push_back(keys[k].second);
+          }
+        }
+
+        std::sort(groups.begin(), groups.end());
+        return groups;
+      }
+
+      /**
+       * Perform tool action.
+       */
+      int run(int argc, char **argv)
+      {
+        //
+        // Argument handling
+        //
+        ParseArgs args(argc, argv, ParseArgs::Args("-index(file)", "-save(file)", "-canonical", "-summary"),
+            ParseArgs::Args("in_file"));
+        // optional arguments
+        const bool canonical = args.IsArg("-canonical");
+        const bool summary = args.IsArg("-summary");
+        std::string indexFile = args.IsArg("-index") ? args.GetArgString("-index", 0) : std::string();
+        std::string saveFile = args.IsArg("-save") ? args.GetArgString("-save", 0) : std::string();
+        // required arguments
+        std::string filename = args.GetArgString("in_file");
+
+        if (canonical && (!indexFile.empty() || !saveFile.empty())) {
+          std::cerr << "Options -index and -save can not be used with -canonical" << std::endl;
+          return -1;
+        }
+
+        Json::Value data;
+        std::vector<std::vector<unsigned int> > groups;
+
+        try {
+          if (canonical) {
+            //
+            // group the molecules by canonical key
+            //
+            MoleculeFile file(filename);
+            unsigned int numSkipped;
+            groups = molecule_duplicates(file, numSkipped);
+            data["num_molecules"] = file.numMolecules();
+            data["num_skipped"] = numSkipped;
+          } else {
+            //
+            // group the fingerprints using the hash index
+            //
+            MemoryMappedRowMajorFingerprintStorage storage(filename, SequentialAdvice);
+            typedef FingerprintHashIndex<MemoryMappedRowMajorFingerprintStorage> IndexType;
+            unsigned int numDistinct;
+            if (indexFile.empty()) {
+              IndexType index(storage);
+              if (!saveFile.empty())
+                index.save(saveFile);
+              groups = index.duplicates();
+              numDistinct = index.numDistinct();
+            } else {
+              IndexType index(storage, indexFile);
+              if (!saveFile.empty())
+                index.save(saveFile);
+              groups = index.duplicates();
+              numDistinct = index.numDistinct();
+            }
+            data["num_fingerprints"] = storage.numFingerprints();
+            data["num_distinct"] = numDistinct;
+          }
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+
+        //
+        // print results
+        //
+        std::size_t numDuplicates = 0;
+        for (std::size_t i = 0; i < groups.size(); ++i)
+          numDuplicates += groups[i].size() - 1;
+        data["num_groups"] = Json::UInt(groups.size());
+        data["num_duplicates"] = Json::UInt(numDuplicates);
+        if (!summary) {
+          data["groups"] = Json::Value(Json::arrayValue);
+          for (std::size_t i = 0; i < groups.size(); ++i) {
+            Json::Value &group = data["groups"][Json::ArrayIndex(i)];
+            group = Json::Value(Json::arrayValue);
+            for (std::size_t j = 0; j < groups[i].size(); ++j)
+              group[Json::ArrayIndex(j)] = groups[i][j];
+          }
+        }
+
+        Json::StyledWriter writer;
+        std::cout << writer.write(data);
+
+        return 0;
+      }
+
+  };
+
+  class DedupToolFactory : public HeliumToolFactory
+  {
+    public:
+      HELIUM_TOOL("dedup", "Find exact duplicates in a fingerprint or molecule file", 1, DedupTool);
+
+      /**
+       * Get usage information.
+       */
+      std::string usage(const std::string &command) const
+      {
+        std::stringstream ss;
+        ss << "Usage: " << command << " [options] <in_file>" << std::endl;
+        ss << std::endl;
+        ss << "Find the groups of identical fingerprints in a fingerprint file. The fingerprint file" << std::endl;
+        ss << "must store the fingerprints in row-major order. The fingerprints are hashed in a single" << std::endl;
+        ss << "pass and the hash table can be saved to a file stored alongside the fingerprint file" << std::endl;
+        ss << "for later runs. Each group lists the indices of the fingerprints, the first one is the" << std::endl;
+        ss << "fingerprint that is kept when removing the duplicates." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -index <file> Use a hash index file created using -save" << std::endl;
+        ss << "    -save <file>  Save the hash index to a file" << std::endl;
+        ss << "    -canonical    The input file is a molecule file, the molecules are grouped by" << std::endl;
+        ss << "                  canonical key (molecules with multiple components are skipped)" << std::endl;
+        ss << "    -summary      Only print the number of groups and duplicates" << std::endl;
+        ss << std::endl;
+        return ss.str();
+      }
+  };
+
+  DedupToolFactory theDedupToolFactory;
+
+}
@@ -1,73 +1,100 @@
-#include "../src/molecule.h"
-#include "../src/fileio.h"
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "tool.h"
 
-#include "../src/fingerprints.h"
-
-#include <numeric>
-#include <boost/functional/hash.hpp>
+#include <Helium/propertyfilters.h>
+#include <Helium/fileio/molecules.h>
 
 #include "args.h"
 
-using namespace Helium;
-
-int main(int argc, char**argv)
-{
-  if (argc < 3) {
-    std::cerr << "Usage: " << argv[0] << " [options] <method> <in_file> <out_file>" << std::endl;
-    std::cerr << std::endl;
-    std::cerr << "Methods:" << std::endl;
-    std::cerr << "    -paths        Create hashed fingerprints from paths" << std::endl;
-    std::cerr << "    -trees        Create hashed fingerprints from trees" << std::endl;
-    std::cerr << "    -subgraphs    Create hashed fingerprints from subgraphs" << std::endl;
-    std::cerr << std::endl;
-    std::cerr << "Options:" << std::endl;
-    std::cerr << "    -k <number>   The maximum size of the path/tree/subgraph (default is 7)" << std::endl;
+namespace Helium {
 
-    std::cerr << std::endl;
-    return 0;
-  }
+  /**
+   * Tool for creating property filter indexes for substructure searches.
+   */
+  class FilterTool : public HeliumTool
+  {
+    public:
+      /**
+       * Perform tool action.
+       */
+      int run(int argc, char**argv)
+      {
+        ParseArgs args(argc, argv, ParseArgs::Args("-max(number)"), ParseArgs::Args("in_file", "out_file"));
+        // optional arguments
+        const int maxThreshold = args.IsArg("-max") ? args.GetArgInt("-max", 0) : 32;
+        // required arguments
+        std::string inFile = args.GetArgString("in_file");
+        std::string outFile = args.GetArgString("out_file");
 
-  ParseArgs args(argc, argv, ParseArgs::Args(), ParseArgs::Args("in_file", "out_file"));
-  std::string inFile = args.GetArgString("in_file");
-  std::string outFile = args.GetArgString("out_file");
+        if (maxThreshold < 1 || maxThreshold > 255) {
+          std::cerr << "The maximum threshold must be in the range [1,255]" << std::endl;
+          return -1;
+        }
 
-  // open molecule file
-  MoleculeFile file(inFile);
-  HeMol mol;
+        try {
+          MemoryMappedMoleculeFile moleculeFile(inFile);
+          PropertyFilterIndex index;
+          index.build(moleculeFile, maxThreshold);
+          index.save(outFile);
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
 
-  std::map<int, std::vector<unsigned int> > sizes;
+        return 0;
+      }
 
-  // process molecules
-  while (file.read_molecule(mol)) {
-    sizes[num_atoms(mol)].push_back(file.current());
-  }
+  };
 
-  //std::cout << "num_sizes: " << sizes.size() << std::endl;
+  class FilterToolFactory : public HeliumToolFactory
+  {
+    public:
+      HELIUM_TOOL("filter", "Create property filters for substructure searches", 2, FilterTool);
 
-  // open filter file
-  std::ofstream ofs(outFile.c_str(), std::ios_base::out | std::ios_base::binary);
+      /**
+       * Get usage information.
+       */
+      std::string usage(const std::string &command) const
+      {
+        std::stringstream ss;
+        ss << "Usage: " << command << " [options] <in_file> <out_file>" << std::endl;
+        ss << std::endl;
+        ss << "Create cumulative bitmaps for the number of atoms, bonds, rings and atoms of common" << std::endl;
+        ss << "elements in the molecules. The substructure search uses these to remove molecules" << std::endl;
+        ss << "that are smaller than the query before verification (see the -filter option)." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -max <number>     The maximum threshold for each property (default is 32)" << std::endl;
+        ss << std::endl;
+        return ss.str();
+      }
+  };
 
-  // write number of molecules
-  write32(ofs, file.numMolecules());
-  // write number of sizes
-  write32(ofs, sizes.size());
-  // write sizes
-  for (std::map<int, std::vector<unsigned int> >::iterator i = sizes.begin(); i != sizes.end(); ++i)
-    write32(ofs, i->first);
-  // write filters
-  Word *filter = new Word[bitvec_num_words_for_bits(file.numMolecules())];
-  for (std::map<int, std::vector<unsigned int> >::iterator i = sizes.begin(); i != sizes.end(); ++i) {
-    //std::cout << i->first << " atoms: " << i->second.size() << " molecules" << std::endl;
-    bitvec_zero(filter, bitvec_num_words_for_bits(file.numMolecules()));
-    std::cout << i->first << ": ";
-    for (std::size_t j = 0; j < i->second.size(); ++j) {
-      bitvec_set(i->second[j], filter);
-      std::cout << i->second[j] << " ";
-    }
-    std::cout << std::endl;
-    //std::cout << i->first << " -> " << (static_cast<unsigned int>(ofs.tellp()) - 4 * (2 + sizes.size())) / sizeof(Word) << std::endl;
-    ofs.write(reinterpret_cast<const char*>(filter), sizeof(Word) * bitvec_num_words_for_bits(file.numMolecules()));
-  }
+  FilterToolFactory theFilterToolFactory;
 
-  delete [] filter;
 }
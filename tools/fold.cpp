@@ -31,12 +31,30 @@
 
 #include <numeric> // std::accumulate
 
+#ifdef HAVE_CPP11
+#include <thread>
+#endif
+
 #include "args.h"
 
 using namespace Helium;
 
 namespace Helium {
 
+  /**
+   * Fold the fingerprints in the range [begin,end).
+   */
+  void fold_fingerprints(const InMemoryRowMajorFingerprintStorage &inputFile, int words, int prime,
+      std::vector<Word> &folded, std::vector<int> &bitCounts, unsigned int begin, unsigned int end)
+  {
+    for (unsigned int i = begin; i < end; ++i) {
+      Word *fingerprint = &folded[0] + i * words;
+      bitvec_fold(inputFile.fingerprint(i), inputFile.numBits(), fingerprint, words, prime);
+      // record bit count
+      bitCounts[i] = bitvec_count(fingerprint, words);
+    }
+  }
+
   /**
    * Tool for folding fingerprint indexes.
    */
@@ -48,45 +66,73 @@ namespace Helium {
        */
       int run(int argc, char **argv)
       {
-        ParseArgs args(argc, argv, ParseArgs::Args(), ParseArgs::Args("bits", "in_file", "out_file"));
+        ParseArgs args(argc, argv, ParseArgs::Args("-mt"), ParseArgs::Args("bits", "in_file", "out_file"));
+#ifdef HAVE_CPP11
+        // optional arguments
+        const bool mt = args.IsArg("-mt");
+#endif
         // required arguments
         const int bits = args.GetArgInt("bits");
-        const int words = bits / (8 * sizeof(Word));
+        const int words = bitvec_num_words_for_bits(bits);
         const int prime = previous_prime(bits);
         std::string inFile = args.GetArgString("in_file");
         std::string outFile = args.GetArgString("out_file");
 
         // open input file
         InMemoryRowMajorFingerprintStorage inputFile;
-        inputFile.load(inFile);
+        try {
+          inputFile.load(inFile);
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+
+        if (bits >= inputFile.numBits()) {
+          std::cerr << "The number of bits must be less than the number of bits in the input file (" << inputFile.numBits() << ")" << std::endl;
+          return -1;
+        }
+
+        if (!inputFile.numFingerprints()) {
+          std::cerr << "Input file " << inFile << " does not contain any fingerprints" << std::endl;
+          return -1;
+        }
 
         // open output file
         RowMajorFingerprintOutputFile outputFile(outFile, bits);
 
-        // allocate bit vector
-        Word *folded = new Word[words];
+        // folded fingerprints
+        std::vector<Word> folded(static_cast<std::size_t>(inputFile.numFingerprints()) * words);
         // keep track of bit counts
-        std::vector<int> bitCounts;
-
-        // process molecules
-        for (unsigned int i = 0; i < inputFile.numFingerprints(); ++i) {
-
-          const Word *unfolded = inputFile.fingerprint(i);
-
-          bitvec_zero(folded, words);
-          for (int j = 0; j < inputFile.numBits(); ++j)
-            if (bitvec_get(j, unfolded))
-              bitvec_set(j % prime, folded);
-
-          // record bit count
-          int bitCount = bitvec_count(folded, words);
-          bitCounts.push_back(bitCount);
-
-          outputFile.writeFingerprint(folded);
-        }
-
-        // free bit vector
-        delete [] folded;
+        std::vector<int> bitCounts(inputFile.numFingerprints());
+
+        // fold the fingerprints
+#ifdef HAVE_CPP11
+        if (mt) {
+          unsigned numThreads = std::thread::hardware_concurrency();
+          // c++ implementations may return 0
+          if (!numThreads)
+            numThreads = 2;
+
+          unsigned int numFingerprints = inputFile.numFingerprints();
+          unsigned int taskSize = numFingerprints / numThreads + 1;
+
+          std::vector<std::thread> threads;
+          for (unsigned int i = 0; i < numThreads; ++i) {
+            unsigned int begin = std::min(numFingerprints, i * taskSize);
+            unsigned int end = std::min(numFingerprints, (i + 1) * taskSize);
+            threads.push_back(std::thread(fold_fingerprints, std::cref(inputFile), words, prime,
+                  std::ref(folded), std::ref(bitCounts), begin, end));
+          }
+
+          for (std::size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+        } else
+#endif
+        fold_fingerprints(inputFile, words, prime, folded, bitCounts, 0, inputFile.numFingerprints());
+
+        // write the folded fingerprints
+        for (unsigned int i = 0; i < inputFile.numFingerprints(); ++i)
+          outputFile.writeFingerprint(&folded[0] + i * words);
 
         unsigned int average_count = std::accumulate(bitCounts.begin(), bitCounts.end(), 0) / inputFile.numFingerprints();
         unsigned int min_count = *std::min_element(bitCounts.begin(), bitCounts.end());
@@ -97,6 +143,7 @@ namespace Helium {
         Json::Reader reader;
         Json::Value data;
         reader.parse(json, data);
+        remove_fingerprint_statistics(data);
         data["num_bits"] = bits;
         data["fingerprint"]["prime"] = prime;
         data["statistics"]["average_count"] = average_count;
@@ -105,7 +152,10 @@ namespace Helium {
 
         // write JSON header
         Json::StyledWriter writer;
-        outputFile.writeHeader(writer.write(data));
+        if (!outputFile.writeHeader(writer.write(data))) {
+          std::cerr << "Could not write file " << outFile << std::endl;
+          return -1;
+        }
 
         return 0;
       }
@@ -123,10 +173,15 @@ namespace Helium {
       std::string usage(const std::string &command) const
       {
         std::stringstream ss;
-        ss << "Usage: " << command << " <bits> <in_file> <out_file>" << std::endl;
+        ss << "Usage: " << command << " [options] <bits> <in_file> <out_file>" << std::endl;
         ss << std::endl;
         ss << "The fold tool can be used to fold fingerprint index files. Any bits argument specifies" << std::endl;
         ss << "the new number of bits, this must be less than the number of bits in the input file." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+#ifdef HAVE_CPP11
+        ss << "    -mt           Fold fingerprints using multiple threads (default is not to use threads)" << std::endl;
+#endif
         ss << std::endl;
         return ss.str();
       }
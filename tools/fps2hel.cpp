@@ -28,46 +28,16 @@
 #include <Helium/fileio/file.h>
 #include <Helium/bitvec.h>
 #include <Helium/fileio/fingerprints.h>
+#include <Helium/fileio/fps.h>
 
 #include "args.h"
 #include "progress.h"
 
 #include <json/json.h>
-#include <numeric>
+#include <algorithm>
 
 using namespace Helium;
 
-bool is_hex(char digit)
-{
-  switch (digit) {
-    case '0':
-    case '1':
-    case '2':
-    case '3':
-    case '4':
-    case '5':
-    case '6':
-    case '7':
-    case '8':
-    case '9':
-    case 'a':
-    case 'A':
-    case 'b':
-    case 'B':
-    case 'c':
-    case 'C':
-    case 'd':
-    case 'D':
-    case 'e':
-    case 'E':
-    case 'f':
-    case 'F':
-      return true;
-    default:
-      return false;
-  }
-}
-
 int main(int argc, char**argv)
 {
   if (argc < 2) {
@@ -79,77 +49,64 @@ int main(int argc, char**argv)
   std::string inFile = args.GetArgString("in_file");
   std::string outFile = args.GetArgString("out_file");
 
-
-  // open the input file
-  std::ifstream ifs(inFile.c_str());
-
-  int bits = -1;
-  int words = -1;
-  std::string type = "fps";
-
-  std::string line;
-  // read fps header
-  while (ifs && !ifs.eof() && ifs.peek() == '#') {
-    std::getline(ifs, line);
-    if (line.substr(0, 10) == "#num_bits=") {
-      std::stringstream ss(line.substr(10));
-      ss >> bits;
-      words = bitvec_num_words_for_bits(bits);
-    } else if (line.substr(0, 6) == "#type=") {
-      type = line.substr(6);
+  try {
+    // open the input file & read the fps header
+    FpsReader reader(inFile);
+    unsigned int bits = reader.numBits();
+    unsigned int words = bitvec_num_words_for_bits(bits);
+
+    // open index file, the statistics include the part counts for the
+    // default kD-grid of the similarity tool
+    RowMajorFingerprintOutputFile indexFile(outFile, bits, true, std::min(3u, bits));
+
+    // process fingerprints in chunks, only the statistics are kept
+    const unsigned int chunkSize = 4096;
+    std::vector<Word> chunk(static_cast<std::size_t>(chunkSize) * words);
+    uint64_t numFingerprints = 0, sumCount = 0;
+    unsigned int minCount = 0, maxCount = 0;
+    while (unsigned int n = reader.read(&chunk[0], chunkSize)) {
+      for (unsigned int i = 0; i < n; ++i) {
+        Word *fingerprint = &chunk[static_cast<std::size_t>(i) * words];
+
+        // record bit count
+        unsigned int bitCount = bitvec_count(fingerprint, words);
+        sumCount += bitCount;
+        minCount = numFingerprints ? std::min(minCount, bitCount) : bitCount;
+        maxCount = numFingerprints ? std::max(maxCount, bitCount) : bitCount;
+        ++numFingerprints;
+
+        indexFile.writeFingerprint(fingerprint);
+      }
     }
-  }
 
-  if (bits == -1) {
-    std::cerr << "Could not read num_bits header field." << std::endl;
+    unsigned int averageCount = numFingerprints ? sumCount / numFingerprints : 0;
+
+    // create JSON header
+    Json::Value data;
+    data["filetype"] = "fingerprints";
+    data["order"] = "row-major";
+    data["num_bits"] = bits;
+    data["num_fingerprints"] = static_cast<Json::UInt>(numFingerprints);
+    data["fingerprint"] = Json::Value(Json::objectValue);
+    data["fingerprint"]["name"] = reader.type();
+    data["fingerprint"]["type"] = reader.type();
+    data["statistics"] = Json::Value(Json::objectValue);
+    data["statistics"]["average_count"] = averageCount;
+    data["statistics"]["min_count"] = minCount;
+    data["statistics"]["max_count"] = maxCount;
+
+    // store the bit counts, column counts and part counts
+    if (!indexFile.writeStatistics(data))
+      throw std::runtime_error(make_string("Could not write file ", outFile));
+
+    // write JSON header
+    Json::StyledWriter writer;
+    if (!indexFile.writeHeader(writer.write(data)))
+      throw std::runtime_error(make_string("Could not write file ", outFile));
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
     return -1;
   }
 
-  // open index file
-  RowMajorFingerprintOutputFile indexFile(outFile, bits);
-
-  // allocate bit vector
-  Word *fingerprint = new Word[words];
-  bitvec_zero(fingerprint, words);
-  // keep track of bit counts
-  std::vector<int> bitCounts;
-
-  // process fingerprints
-  int nibbles = bits / 4 + ((bits % 4) ? 1 : 0);
-  while (std::getline(ifs, line)) {
-
-    // convert hex to fingerprint
-    hex_to_bitvec(line.substr(0, nibbles), fingerprint, words);
-
-    // record bit count
-    int bitCount = bitvec_count(fingerprint, words);
-    bitCounts.push_back(bitCount);
-
-    indexFile.writeFingerprint(fingerprint);
-  }
-
-  // free bit vector
-  delete [] fingerprint;
-
-  unsigned int average_count = std::accumulate(bitCounts.begin(), bitCounts.end(), 0) / bitCounts.size();
-  unsigned int min_count = *std::min_element(bitCounts.begin(), bitCounts.end());
-  unsigned int max_count = *std::max_element(bitCounts.begin(), bitCounts.end());
-
-  // create JSON header
-  Json::Value data;
-  data["filetype"] = "fingerprints";
-  data["order"] = "row-major";
-  data["num_bits"] = bits;
-  data["num_fingerprints"] = static_cast<int>(bitCounts.size());
-  data["fingerprint"] = Json::Value(Json::objectValue);
-  data["fingerprint"]["name"] = type;
-  data["fingerprint"]["type"] = type;
-  data["statistics"] = Json::Value(Json::objectValue);
-  data["statistics"]["average_count"] = average_count;
-  data["statistics"]["min_count"] = min_count;
-  data["statistics"]["max_count"] = max_count;
-
-  // write JSON header
-  Json::StyledWriter writer;
-  indexFile.writeHeader(writer.write(data));
+  return 0;
 }
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_HITWRITER_H
+#define HELIUM_HITWRITER_H
+
+#include <json/json.h>
+
+#include <ostream>
+#include <string>
+#include <limits>
+#include <stdint.h>
+
+namespace Helium {
+
+  /**
+   * @brief Write search hits incrementally.
+   *
+   * The search tools normally build a single JSON document containing all
+   * hits. For queries with millions of hits, building and serializing that
+   * document is slower than the search and uses a lot of memory. This class
+   * writes each hit as soon as it is passed to write() and the summary
+   * statistics after the hits (e.g. once per query or once at the end).
+   *
+   * Two formats are supported:
+   *
+   * - 'ndjson': newline delimited JSON, one object per hit with the
+   *   'query' and 'index' attributes and the score (e.g. 'tanimoto'), if
+   *   any. The hits are followed by an object with a single 'summary'
+   *   attribute.
+   * - 'binary': the 8 byte magic "HELHITS1" followed by a 16 byte record per
+   *   hit: the 32-bit query number, the 32-bit index and the score as a
+   *   64-bit double (0 if there is no score), all in native byte order.
+   *   The hits are followed by a record with query number 0xFFFFFFFF
+   *   whose index is the length of the summary JSON that follows.
+   */
+  class HitWriter
+  {
+    public:
+      /**
+       * The output format.
+       */
+      enum Format
+      {
+        NDJSON,
+        Binary
+      };
+
+      /**
+       * Parse the name of a format ('ndjson' or 'binary').
+       *
+       * @return True if the name is valid.
+       */
+      static bool parseFormat(const std::string &name, Format &format)
+      {
+        if (name == "ndjson")
+          format = NDJSON;
+        else if (name == "binary")
+          format = Binary;
+        else
+          return false;
+        return true;
+      }
+
+      /**
+       * Constructor.
+       *
+       * @param os The output stream (opened in binary mode for the binary
+       *        format).
+       * @param format The output format.
+       * @param scoreName The name of the score attribute (e.g. 'tanimoto'),
+       *        empty if the hits have no score.
+       */
+      HitWriter(std::ostream &os, Format format, const std::string &scoreName = std::string())
+        : m_os(os), m_format(format), m_scoreName(scoreName), m_numHits(0)
+      {
+        if (m_format == Binary)
+          m_os.write("HELHITS1", 8);
+      }
+
+      /**
+       * Get the number of hits written since the last summary.
+       */
+      uint64_t numHits() const
+      {
+        return m_numHits;
+      }
+
+      /**
+       * Write a single hit.
+       *
+       * @param query The query number.
+       * @param index The index of the hit.
+       * @param score The score of the hit (ignored if there is no score).
+       */
+      void write(unsigned int query, unsigned int index, double score = 0.0)
+      {
+        ++m_numHits;
+        if (m_format == Binary) {
+          writeRecord(query, index, m_scoreName.empty() ? 0.0 : score);
+          return;
+        }
+
+        m_os << "{\"query\":" << query << ",\"index\":" << index;
+        if (!m_scoreName.empty())
+          m_os << ",\"" << m_scoreName << "\":" << Json::valueToString(score);
+        m_os << "}\n";
+      }
+
+      /**
+       * Write the summary statistics for the hits written since the
+       * previous summary. The output is flushed.
+       *
+       * @param summary The summary (e.g. 'screened', 'partial', ...), the
+       *        number of hits is added as the 'num_hits' attribute.
+       */
+      void writeSummary(Json::Value summary)
+      {
+        summary["num_hits"] = static_cast<Json::UInt64>(m_numHits);
+        Json::FastWriter writer;
+        std::string json = writer.write(summary);
+
+        if (m_format == Binary) {
+          writeRecord(std::numeric_limits<uint32_t>::max(), json.size(), 0.0);
+          m_os.write(json.data(), json.size());
+        } else {
+          // FastWriter ends the document with a newline
+          if (!json.empty() && json[json.size() - 1] == '\n')
+            json.resize(json.size() - 1);
+          m_os << "{\"summary\":" << json << "}\n";
+        }
+        m_os.flush();
+        m_numHits = 0;
+      }
+
+    private:
+      void writeRecord(uint32_t query, uint32_t index, double score)
+      {
+        m_os.write(reinterpret_cast<const char*>(&query), sizeof(uint32_t));
+        m_os.write(reinterpret_cast<const char*>(&index), sizeof(uint32_t));
+        m_os.write(reinterpret_cast<const char*>(&score), sizeof(double));
+      }
+
+      std::ostream &m_os;
+      Format m_format;
+      std::string m_scoreName;
+      uint64_t m_numHits;
+  };
+
+}
+
+#endif
@@ -31,12 +31,86 @@
 #include <Helium/fileio/fingerprints.h>
 #include <Helium/fingerprints/fingerprints.h>
 
+#ifdef HAVE_CPP11
+#include <Helium/threadpool.h>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#endif
+
 #include <numeric> // std::accumulate
 
 #include "args.h"
+#include "progress.h"
 
 namespace Helium {
 
+  namespace impl {
+
+    /**
+     * @brief A chunk of molecules and their fingerprints.
+     */
+    struct IndexChunk
+    {
+      std::vector<HeMol> molecules; //!< The molecules
+      std::vector<Word> fingerprints; //!< The fingerprints (numWords per molecule)
+#ifdef HAVE_CPP11
+      ThreadPool::TaskGroup group; //!< The fingerprint task
+#endif
+    };
+
+    /**
+     * Read the next chunk of molecules.
+     *
+     * @return False if there are no more molecules.
+     */
+    inline bool read_index_chunk(BufferedMoleculeFile &file, IndexChunk &chunk, std::size_t chunkSize)
+    {
+      chunk.molecules.resize(chunkSize);
+      for (std::size_t i = 0; i < chunkSize; ++i)
+        if (!file.read_molecule(chunk.molecules[i])) {
+          chunk.molecules.resize(i);
+          return false;
+        }
+      return true;
+    }
+
+#ifdef HAVE_CPP11
+    /**
+     * @brief Fragment caches for the fingerprint tasks.
+     *
+     * The caches are not thread safe, each running task takes a cache from
+     * the pool and returns it when done. This way, there are never more caches
+     * than threads and the caches stay warm across chunks.
+     */
+    class FragmentCachePool
+    {
+      public:
+        std::unique_ptr<FragmentCache> take()
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          if (m_caches.empty())
+            return std::unique_ptr<FragmentCache>(new FragmentCache);
+          std::unique_ptr<FragmentCache> cache = std::move(m_caches.back());
+          m_caches.pop_back();
+          return cache;
+        }
+
+        void give(std::unique_ptr<FragmentCache> cache)
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_caches.push_back(std::move(cache));
+        }
+
+      private:
+        std::mutex m_mutex;
+        std::vector<std::unique_ptr<FragmentCache> > m_caches;
+    };
+#endif
+
+  }
+
   /**
    * Tool for  creating fingerprint indexes.
    */
@@ -48,39 +122,117 @@ namespace Helium {
        */
       enum Method {
         PathsMethod,
+        RollingPathsMethod,
         TreesMethod,
-        SubgraphsMethod
+        SubgraphsMethod,
+        CircularMethod
       };
 
+      /**
+       * Compute the fingerprint for a molecule.
+       */
+      static void computeFingerprint(Method method, HeMol &mol, Word *fingerprint, int k, int words, int prime,
+          FragmentCache *cache, Arena *arena)
+      {
+        switch (method) {
+          case PathsMethod:
+            path_fingerprint(mol, fingerprint, k, words, prime, cache, arena);
+            break;
+          case RollingPathsMethod:
+            rolling_path_fingerprint(mol, fingerprint, k, words, prime);
+            break;
+          case TreesMethod:
+            tree_fingerprint(mol, fingerprint, k, words, prime, cache, arena);
+            break;
+          case SubgraphsMethod:
+            subgraph_fingerprint(mol, fingerprint, k, words, prime, cache, arena);
+            break;
+          case CircularMethod:
+            circular_fingerprint(mol, fingerprint, k, words, prime);
+            break;
+        }
+      }
+
+      /**
+       * Compute the fingerprints for all molecules in a chunk.
+       */
+      static void computeChunk(impl::IndexChunk &chunk, Method method, int k, int words, int prime,
+          FragmentCache *cache)
+      {
+        chunk.fingerprints.resize(chunk.molecules.size() * words);
+        // the temporary buffers, reused for all molecules in the chunk
+        Arena arena;
+        for (std::size_t i = 0; i < chunk.molecules.size(); ++i) {
+          arena.reset();
+          computeFingerprint(method, chunk.molecules[i], &chunk.fingerprints[i * words], k, words, prime, cache, &arena);
+        }
+        // free the molecules
+        std::vector<HeMol>().swap(chunk.molecules);
+      }
+
+      /**
+       * Write the fingerprints of a chunk to the index file.
+       */
+      static void writeChunk(RowMajorFingerprintOutputFile &indexFile, impl::IndexChunk &chunk, int words,
+          std::vector<int> &bitCounts)
+      {
+        for (std::size_t i = 0; i < chunk.fingerprints.size(); i += words) {
+          // record bit count
+          bitCounts.push_back(bitvec_count(&chunk.fingerprints[i], words));
+          indexFile.writeFingerprint(&chunk.fingerprints[i]);
+          unknown_progress("Indexing", bitCounts.size(), 100);
+        }
+      }
+
       /**
        * Perform tool action.
        */
       int run(int argc, char **argv)
       {
-        ParseArgs args(argc, argv, ParseArgs::Args("-k(number)", "-bits(number)"), ParseArgs::Args("method", "in_file", "out_file"));
+        ParseArgs args(argc, argv, ParseArgs::Args("-k(number)", "-bits(number)", "-threads(number)", "-chunk(number)",
+              "-parts(number)"),
+            ParseArgs::Args("method", "in_file", "out_file"));
         // optional arguments
-        const int k = args.IsArg("-k") ? args.GetArgInt("-k", 0) : 7;
         const int bits = args.IsArg("-bits") ? args.GetArgInt("-bits", 0) : 1024;
         const int words = bits / (8 * sizeof(Word));
         const int prime = previous_prime(bits);
+        const int numThreads = args.IsArg("-threads") ? args.GetArgInt("-threads", 0) : 0;
+        const int chunkSize = args.IsArg("-chunk") ? args.GetArgInt("-chunk", 0) : 100;
+        const int numParts = args.IsArg("-parts") ? args.GetArgInt("-parts", 0) : 3;
         // required arguments
         std::string methodString = args.GetArgString("method");
         std::string inFile = args.GetArgString("in_file");
         std::string outFile = args.GetArgString("out_file");
+        // the radius for circular fingerprints
+        const int k = args.IsArg("-k") ? args.GetArgInt("-k", 0) : (methodString == "-circular" ? 2 : 7);
 
         // parse method argument
         Method method = PathsMethod;
         if (methodString == "-paths")
           method = PathsMethod;
+        else if (methodString == "-rolling_paths")
+          method = RollingPathsMethod;
         else if (methodString == "-trees")
           method = TreesMethod;
         else if (methodString == "-subgraphs")
           method = SubgraphsMethod;
+        else if (methodString == "-circular")
+          method = CircularMethod;
         else {
           std::cerr << "Method \"" << methodString << "\" not recognised" << std::endl;
           return -1;
         }
 
+        if (numThreads < 0 || chunkSize < 1) {
+          std::cerr << "Invalid number of threads or chunk size" << std::endl;
+          return -1;
+        }
+
+        if (numParts < 0 || numParts > bits) {
+          std::cerr << "Invalid number of parts" << std::endl;
+          return -1;
+        }
+
         // print fingerprint settings
         std::cerr << "Fingerprint settings:" << std::endl;
         std::cerr << "    method: " << methodString.substr(1) << std::endl;
@@ -91,47 +243,63 @@ namespace Helium {
         std::cerr << "Indexing " << inFile << "..." << std::endl;
 
         // open index file
-        RowMajorFingerprintOutputFile indexFile(outFile, bits);
+        RowMajorFingerprintOutputFile indexFile(outFile, bits, true, numParts);
 
         // open molecule file
-        MoleculeFile file(inFile);
-        HeMol mol;
-
-        // allocate bit vector
-        Word *fingerprint = new Word[words];
+        BufferedMoleculeFile file(inFile);
         // keep track of bit counts
         std::vector<int> bitCounts;
 
-        // process molecules
-        for (unsigned int i = 0; i < file.numMolecules(); ++i) {
-          file.read_molecule(mol);
-          if ((i % 100) == 0)
-            std::cout << i << std::endl;
-
-          // compute the fingerprint
-          switch (method) {
-            case PathsMethod:
-              path_fingerprint(mol, fingerprint, k, words, prime);
-              break;
-            case TreesMethod:
-              tree_fingerprint(mol, fingerprint, k, words, prime);
-              break;
-            case SubgraphsMethod:
-              subgraph_fingerprint(mol, fingerprint, k, words, prime);
+        // process molecules: the chunks are read and written in order on this
+        // thread, the fingerprints are computed by the worker threads
+#ifdef HAVE_CPP11
+        ThreadPool pool(numThreads);
+        impl::FragmentCachePool caches;
+        std::deque<std::unique_ptr<impl::IndexChunk> > chunks; // the chunks in progress (in input order)
+        bool more = true;
+        while (more || !chunks.empty()) {
+          // keep the worker threads busy
+          while (more && chunks.size() < 2 * pool.numThreads()) {
+            std::unique_ptr<impl::IndexChunk> chunk(new impl::IndexChunk);
+            more = impl::read_index_chunk(file, *chunk, chunkSize);
+            if (chunk->molecules.empty())
               break;
+            impl::IndexChunk *task = chunk.get();
+            pool.submit(task->group, [task, method, k, words, prime, &caches] {
+              std::unique_ptr<FragmentCache> cache = caches.take();
+              computeChunk(*task, method, k, words, prime, cache.get());
+              caches.give(std::move(cache));
+            });
+            chunks.push_back(std::move(chunk));
           }
 
-          // record bit count
-          int bitCount = bitvec_count(fingerprint, words);
-          bitCounts.push_back(bitCount);
+          if (chunks.empty())
+            break;
 
-          indexFile.writeFingerprint(fingerprint);
+          // write the oldest chunk
+          pool.wait(chunks.front()->group);
+          writeChunk(indexFile, *chunks.front(), words, bitCounts);
+          chunks.pop_front();
         }
+#else
+        // cache for the canonical codes of the paths/trees/subgraphs
+        FragmentCache cache;
+        bool more = true;
+        while (more) {
+          impl::IndexChunk chunk;
+          more = impl::read_index_chunk(file, chunk, chunkSize);
+          computeChunk(chunk, method, k, words, prime, &cache);
+          writeChunk(indexFile, chunk, words, bitCounts);
+        }
+#endif
+        std::cout << std::endl;
 
-        // free bit vector
-        delete [] fingerprint;
+        if (bitCounts.empty()) {
+          std::cerr << "No molecules in " << inFile << std::endl;
+          return -1;
+        }
 
-        unsigned int average_count = std::accumulate(bitCounts.begin(), bitCounts.end(), 0) / file.numMolecules();
+        unsigned int average_count = std::accumulate(bitCounts.begin(), bitCounts.end(), 0) / bitCounts.size();
         unsigned int min_count = *std::min_element(bitCounts.begin(), bitCounts.end());
         unsigned int max_count = *std::max_element(bitCounts.begin(), bitCounts.end());
 
@@ -155,10 +323,18 @@ namespace Helium {
         data["statistics"]["min_count"] = min_count;
         data["statistics"]["max_count"] = max_count;
 
+        // store the bit counts, column counts and part counts
+        if (!indexFile.writeStatistics(data)) {
+          std::cerr << "Could not write statistics to " << outFile << std::endl;
+          return -1;
+        }
+
         // write JSON header
         Json::StyledWriter writer;
-        indexFile.writeHeader(writer.write(data));
-
+        if (!indexFile.writeHeader(writer.write(data))) {
+          std::cerr << "Could not write file " << outFile << std::endl;
+          return -1;
+        }
 
         return 0;
       }
@@ -183,12 +359,21 @@ namespace Helium {
         ss << std::endl;
         ss << "Methods:" << std::endl;
         ss << "    -paths        Create hashed fingerprints from paths" << std::endl;
+        ss << "    -rolling_paths" << std::endl;
+        ss << "                  Create hashed fingerprints from paths using a rolling hash (faster)" << std::endl;
         ss << "    -trees        Create hashed fingerprints from trees" << std::endl;
         ss << "    -subgraphs    Create hashed fingerprints from subgraphs" << std::endl;
+        ss << "    -circular     Create hashed fingerprints from circular atom environments (only for" << std::endl;
+        ss << "                  similarity searches, substructure searches refuse these fingerprints," << std::endl;
+        ss << "                  k is the radius)" << std::endl;
         ss << std::endl;
         ss << "Options:" << std::endl;
-        ss << "    -k <n>        The maximum size of the path/tree/subgraph (default is 7)" << std::endl;
+        ss << "    -k <n>        The maximum size of the path/tree/subgraph (default is 7, 2 for circular)" << std::endl;
         ss << "    -bits <n>     The number of bits in the fingerprint (default is 1024)" << std::endl;
+        ss << "    -threads <n>  The number of threads (default is the number of cores)" << std::endl;
+        ss << "    -chunk <n>    The number of molecules per task (default is 100)" << std::endl;
+        ss << "    -parts <n>    Store the bit counts for the parts of a kD-grid with n dimensions" << std::endl;
+        ss << "                  (see similarity -k, default is 3, 0 for none)" << std::endl;
         ss << std::endl;
         return ss.str();
       }
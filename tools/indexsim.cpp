@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "tool.h"
+
+#include <Helium/fingerprints/similarity.h>
+#include <Helium/fingerprints/similaritytuning.h>
+#include <Helium/fileio/fingerprints.h>
+
+#include "args.h"
+
+namespace Helium {
+
+  class IndexSimTool : public HeliumTool
+  {
+    public:
+      /**
+       * Perform tool action.
+       */
+      int run(int argc, char **argv)
+      {
+        //
+        // Argument handling
+        //
+        ParseArgs args(argc, argv, ParseArgs::Args("-k(number)", "-auto-k", "-Tmin(number)", "-queries(number)"),
+            ParseArgs::Args("fingerprint_file", "output_file"));
+        // optional arguments
+        int k = args.IsArg("-k") ? args.GetArgInt("-k", 0) : 3;
+        const bool autoK = args.IsArg("-auto-k");
+        const double Tmin = args.IsArg("-Tmin") ? args.GetArgDouble("-Tmin", 0) : 0.7;
+        const int numQueries = args.IsArg("-queries") ? args.GetArgInt("-queries", 0) : 100;
+        // required arguments
+        std::string filename = args.GetArgString("fingerprint_file");
+        std::string outputFile = args.GetArgString("output_file");
+
+        if (k < 1) {
+          std::cerr << "The dimension of the kD-grid must be at least 1" << std::endl;
+          return -1;
+        }
+        if (numQueries < 1) {
+          std::cerr << "The number of sampled queries must be at least 1" << std::endl;
+          return -1;
+        }
+        if (autoK && args.IsArg("-k"))
+          std::cerr << "Option -k <n> has no effect when using option -auto-k, -k will be ignored." << std::endl;
+        if (!autoK && (args.IsArg("-Tmin") || args.IsArg("-queries")))
+          std::cerr << "Options -Tmin <n> and -queries <n> have no effect without option -auto-k and will be ignored." << std::endl;
+
+        //
+        // open fingerprint file
+        //
+        InMemoryRowMajorFingerprintStorage storage;
+        try {
+          storage.load(filename);
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+
+        //
+        // build, freeze and save the index
+        //
+        try {
+          // try each dimension on queries sampled from the storage and record the choice in the header
+          Json::Value attributes(Json::objectValue);
+          if (autoK) {
+            SimilarityIndexTuning tuning = tune_similarity_index_k(storage, Tmin, numQueries);
+            k = tuning.k;
+            attributes["k_tuning"] = tuning.json();
+            Json::StyledWriter writer;
+            std::cout << writer.write(attributes["k_tuning"]);
+          }
+
+          // build the frozen index using all cores
+          SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, k, 0);
+          index.save(outputFile, attributes);
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+
+        return 0;
+      }
+
+  };
+
+  class IndexSimToolFactory : public HeliumToolFactory
+  {
+    public:
+      HELIUM_TOOL("index-sim", "Create a similarity search index file", 2, IndexSimTool);
+
+      /**
+       * Get usage information.
+       */
+      std::string usage(const std::string &command) const
+      {
+        std::stringstream ss;
+        ss << "Usage: " << command << " [options] <fingerprint_file> <output_file>" << std::endl;
+        ss << std::endl;
+        ss << "Create a similarity search index file for a fingerprint file. The fingerprint file must" << std::endl;
+        ss << "store the fingerprints in row-major order. The index file can be used instead of the" << std::endl;
+        ss << "fingerprint file by the similarity tools to avoid building the index on each invocation." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -k <n>        Specify the dimension for the kD-grid (default is 3)" << std::endl;
+        ss << "    -auto-k       Select the fastest dimension by searching queries sampled from the fingerprint" << std::endl;
+        ss << "                  file for k = 1 to 5, the measurements are written and stored as 'k_tuning'" << std::endl;
+        ss << "                  in the header of the index file" << std::endl;
+        ss << "    -Tmin <n>     The threshold for the sampled queries when using -auto-k (default is 0.7)" << std::endl;
+        ss << "    -queries <n>  The number of sampled queries when using -auto-k (default is 100)" << std::endl;
+        ss << std::endl;
+        return ss.str();
+      }
+  };
+
+  IndexSimToolFactory theIndexSimToolFactory;
+
+}
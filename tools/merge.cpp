@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "tool.h"
+
+#include <Helium/fingerprints/similarity.h>
+#include <Helium/util/functor.h>
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <queue>
+
+#include "nxnpartial.h"
+
+namespace Helium {
+
+  class MergeTool : public HeliumTool
+  {
+    public:
+      /**
+       * Perform tool action.
+       */
+      int run(int argc, char **argv)
+      {
+        //
+        // Argument handling (any number of partial result files)
+        //
+        int N = 0;
+        bool json = false;
+        std::vector<std::string> filenames;
+        for (int i = 2; i < argc; ++i) {
+          std::string arg = argv[i];
+          if (arg == "-N" && i + 1 < argc)
+            N = std::atoi(argv[++i]);
+          else if (arg == "-json")
+            json = true;
+          else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return -1;
+          } else
+            filenames.push_back(arg);
+        }
+        if (filenames.size() < 2) {
+          std::cerr << "An output file and at least one partial result file are required." << std::endl;
+          return -1;
+        }
+        std::string outputFile = filenames.front();
+        filenames.erase(filenames.begin());
+
+        try {
+          return merge(outputFile, filenames, N, json);
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+      }
+
+    private:
+      typedef std::pair<unsigned int, std::size_t> RowReader; // (row, reader)
+
+      int merge(const std::string &outputFile, const std::vector<std::string> &filenames, int N, bool json)
+      {
+        //
+        // open the partial results and check that they belong to the same search
+        //
+        std::vector<NxNPartialReader*> readers;
+        for (std::size_t i = 0; i < filenames.size(); ++i)
+          readers.push_back(new NxNPartialReader(filenames[i]));
+
+        const Json::Value &first = readers[0]->header();
+        unsigned int numFingerprints = first["num_fingerprints"].asUInt();
+        int partialN = first["N"].asInt();
+        unsigned int rowBegin = numFingerprints, rowEnd = 0, colBegin = numFingerprints, colEnd = 0;
+        for (std::size_t i = 0; i < readers.size(); ++i) {
+          const Json::Value &header = readers[i]->header();
+          if (header["num_fingerprints"].asUInt() != numFingerprints || header["num_bits"] != first["num_bits"] ||
+              header["Tmin"].asDouble() != first["Tmin"].asDouble() || header["symmetric"] != first["symmetric"]) {
+            std::cerr << "Partial result " << filenames[i] << " does not belong to the same search as " << filenames[0] << std::endl;
+            return cleanup(readers, -1);
+          }
+          partialN = std::min(partialN, header["N"].asInt());
+          rowBegin = std::min(rowBegin, header["rows"][0].asUInt());
+          rowEnd = std::max(rowEnd, header["rows"][1].asUInt());
+          colBegin = std::min(colBegin, header["cols"][0].asUInt());
+          colEnd = std::max(colEnd, header["cols"][1].asUInt());
+        }
+        if (!N)
+          N = partialN;
+        if (N < 1 || N > partialN) {
+          std::cerr << "Option -N <n> must be in the range [1," << partialN << "] for these partial results." << std::endl;
+          return cleanup(readers, -1);
+        }
+
+        //
+        // merge the rows in a single pass, the readers are ordered by their current row
+        //
+        std::priority_queue<RowReader, std::vector<RowReader>, std::greater<RowReader> > queue;
+        for (std::size_t i = 0; i < readers.size(); ++i)
+          if (readers[i]->next())
+            queue.push(RowReader(readers[i]->row(), i));
+
+        NxNPartialWriter *writer = json ? 0 : new NxNPartialWriter(outputFile);
+        std::ofstream ofs;
+        if (json) {
+          ofs.open(outputFile.c_str());
+          if (!ofs) {
+            std::cerr << "Could not open output file \"" << outputFile << "\"" << std::endl;
+            return cleanup(readers, -1);
+          }
+          ofs << "{" << std::endl << "   \"hits\" : [";
+        }
+
+        unsigned int nextRow = 0; // the JSON output contains all rows
+        std::vector<std::pair<unsigned int, double> > hits;
+        while (!queue.empty()) {
+          unsigned int row = queue.top().first;
+          hits.clear();
+          while (!queue.empty() && queue.top().first == row) {
+            std::size_t i = queue.top().second;
+            queue.pop();
+            merge_nxn_hits(hits, readers[i]->hits(), N);
+            if (readers[i]->next()) {
+              if (readers[i]->row() <= row)
+                throw std::runtime_error(make_string("Partial result file ", filenames[i], " contains rows out of order"));
+              queue.push(RowReader(readers[i]->row(), i));
+            }
+          }
+
+          if (json) {
+            for (; nextRow < row; ++nextRow)
+              writeJsonRow(ofs, nextRow, std::vector<std::pair<unsigned int, double> >());
+            writeJsonRow(ofs, nextRow++, hits);
+          } else
+            writer->write(row, hits);
+        }
+
+        if (json) {
+          for (; nextRow < numFingerprints; ++nextRow)
+            writeJsonRow(ofs, nextRow, std::vector<std::pair<unsigned int, double> >());
+          ofs << std::endl << "   ]" << std::endl << "}" << std::endl;
+        } else {
+          Json::Value header;
+          header["num_bits"] = first["num_bits"];
+          header["num_fingerprints"] = numFingerprints;
+          header["N"] = N;
+          header["Tmin"] = first["Tmin"];
+          header["symmetric"] = first["symmetric"];
+          header["rows"][0] = rowBegin;
+          header["rows"][1] = rowEnd;
+          header["cols"][0] = colBegin;
+          header["cols"][1] = colEnd;
+          header["num_partials"] = static_cast<Json::UInt>(filenames.size());
+          writer->finish(header);
+          delete writer;
+        }
+
+        return cleanup(readers, 0);
+      }
+
+      /**
+       * Write a row in the same format as the similarityNxN tool (i.e. sorted
+       * by index).
+       */
+      static void writeJsonRow(std::ostream &os, unsigned int row, std::vector<std::pair<unsigned int, double> > hits)
+      {
+        std::sort(hits.begin(), hits.end(), compare_first<unsigned int, double>());
+        os << (row ? "," : "") << std::endl << "      [";
+        // the scores are formatted the same way as by the JSON writer of the similarityNxN tool
+        for (std::size_t i = 0; i < hits.size(); ++i)
+          os << (i ? ", " : " ") << "{ \"index\" : " << hits[i].first << ", \"tanimoto\" : "
+             << Json::valueToString(hits[i].second) << " }";
+        os << (hits.empty() ? "]" : " ]");
+      }
+
+      static int cleanup(std::vector<NxNPartialReader*> &readers, int ret)
+      {
+        for (std::size_t i = 0; i < readers.size(); ++i)
+          delete readers[i];
+        return ret;
+      }
+  };
+
+  class MergeToolFactory : public HeliumToolFactory
+  {
+    public:
+      HELIUM_TOOL("merge", "Merge the partial results of NxN similarity search tiles", 2, MergeTool);
+
+      /**
+       * Get usage information.
+       */
+      std::string usage(const std::string &command) const
+      {
+        std::stringstream ss;
+        ss << "Usage: " << command << " [options] <output_file> <partial_file> [<partial_file> ...]" << std::endl;
+        ss << std::endl;
+        ss << "Combine the N nearest neighbors for each row from the partial results written" << std::endl;
+        ss << "by the similarityNxN tool using the -rows, -cols and -output options. The" << std::endl;
+        ss << "partial results are read in a single streaming pass, only one row of each file" << std::endl;
+        ss << "is kept in memory. The merged result is written as a partial result so merges" << std::endl;
+        ss << "can be done in several steps." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -N <n>        The number of nearest neighbors to keep (default is the N of the partial results)" << std::endl;
+        ss << "    -json         Write the hits for all rows in the JSON format of the similarityNxN tool" << std::endl;
+        ss << std::endl;
+        return ss.str();
+      }
+  };
+
+  MergeToolFactory theMergeToolFactory;
+
+}
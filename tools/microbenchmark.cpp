@@ -0,0 +1,571 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <Helium/bitvec.h>
+#include <Helium/timeout.h>
+#include <Helium/util/memory.h>
+#include <Helium/fileio/fingerprints.h>
+
+#include <json/json.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+
+#include "args.h"
+
+using namespace Helium;
+
+namespace {
+
+  const char *kernelNames[] = { "scalar", "popcnt", "avx2", "avx512", 0 };
+
+  /**
+   * Results are accumulated in this variable so the compiler can not
+   * remove the benchmarked code.
+   */
+  volatile long long sink = 0;
+
+  // xorshift64, the fingerprints have a bit density of about 25%
+  Word random_word(Word &state)
+  {
+    Word words[2];
+    for (int i = 0; i < 2; ++i) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      words[i] = state;
+    }
+    return words[0] & words[1];
+  }
+
+  //
+  // A pass runs a kernel once for each fingerprint in the working set and
+  // returns the sum of the results.
+  //
+
+  struct CountPass
+  {
+    long long operator()() const
+    {
+      long long sum = 0;
+      for (unsigned int i = 0; i < n; ++i)
+        sum += kernels->count(data + static_cast<std::size_t>(i) * words, words);
+      return sum;
+    }
+
+    const impl::BitvecKernels *kernels;
+    const Word *data;
+    unsigned int n;
+    int words;
+  };
+
+  struct RangeCountPass
+  {
+    long long operator()() const
+    {
+      long long sum = 0;
+      for (unsigned int i = 0; i < n; ++i)
+        sum += bitvec_count(data + static_cast<std::size_t>(i) * words, 3, words * BitsPerWord - 5);
+      return sum;
+    }
+
+    const Word *data;
+    unsigned int n;
+    int words;
+  };
+
+  struct TanimotoPass
+  {
+    long long operator()() const
+    {
+      long long sum = 0;
+      for (unsigned int i = 0; i < n; ++i) {
+        int andCount, orCount;
+        kernels->andOrCount(query, data + static_cast<std::size_t>(i) * words, words, andCount, orCount);
+        sum += orCount ? 1000 * andCount / orCount : 0;
+      }
+      return sum;
+    }
+
+    const impl::BitvecKernels *kernels;
+    const Word *query;
+    const Word *data;
+    unsigned int n;
+    int words;
+  };
+
+  struct SubsetPass
+  {
+    long long operator()() const
+    {
+      long long sum = 0;
+      for (unsigned int i = 0; i < n; ++i)
+        sum += bitvec_is_subset_superset(query, data + static_cast<std::size_t>(i) * words, words);
+      return sum;
+    }
+
+    const Word *query;
+    const Word *data;
+    unsigned int n;
+    int words;
+  };
+
+  template<int NumWords>
+  struct FixedSubsetPass
+  {
+    long long operator()() const
+    {
+      long long sum = 0;
+      for (unsigned int i = 0; i < n; ++i)
+        sum += bitvec_is_subset_superset<NumWords>(query, data + static_cast<std::size_t>(i) * NumWords);
+      return sum;
+    }
+
+    const Word *query;
+    const Word *data;
+    unsigned int n;
+  };
+
+  struct HexPass
+  {
+    long long operator()() const
+    {
+      long long sum = 0;
+      std::size_t size = 2 * sizeof(Word) * words;
+      for (unsigned int i = 0; i < n; ++i) {
+        hex_to_bitvec(hex + i * size, size, bitvec, words);
+        sum += bitvec[0];
+      }
+      return sum;
+    }
+
+    const char *hex;
+    Word *bitvec;
+    unsigned int n;
+    int words;
+  };
+
+  /**
+   * Access the fingerprints of a storage in the order given by @p order.
+   */
+  template<typename StorageType>
+  struct StoragePass
+  {
+    long long operator()() const
+    {
+      long long sum = 0;
+      for (unsigned int i = 0; i < n; ++i)
+        sum += kernels->count(storage->fingerprint(order[i]), words);
+      return sum;
+    }
+
+    const impl::BitvecKernels *kernels;
+    const StorageType *storage;
+    const unsigned int *order;
+    unsigned int n;
+    int words;
+  };
+
+  /**
+   * The fixed-width kernel table for a number of words, 0 if there is none.
+   */
+  const impl::BitvecKernels* fixed_kernels(const std::string &name, int words)
+  {
+    switch (words) {
+      case 16:
+        return impl::bitvec_fixed_kernels_by_name<16>(name);
+      case 32:
+        return impl::bitvec_fixed_kernels_by_name<32>(name);
+      case 64:
+        return impl::bitvec_fixed_kernels_by_name<64>(name);
+      default:
+        return 0;
+    }
+  }
+
+  struct Measurement
+  {
+    std::string kernel; //!< The benchmarked function
+    std::string variant; //!< The kernel variant (e.g. avx2 or avx2/fixed)
+    std::string pattern; //!< The access pattern (sequential or random)
+    int bits; //!< The fingerprint width
+    std::size_t workingSet; //!< The working set size in bytes
+    double nsPerOp; //!< Nanoseconds per kernel call
+    double gbPerSecond; //!< Bytes read per second (1e9)
+  };
+
+  class MicroBenchmark
+  {
+    public:
+      MicroBenchmark(double minTime, int trials) : m_minTime(minTime), m_trials(trials)
+      {
+      }
+
+      /**
+       * Time a pass. Passes are repeated until @p minTime milliseconds
+       * passed, the best of @p trials runs is reported.
+       *
+       * @param numOps The number of kernel calls in a pass.
+       * @param bytesPerOp The number of bytes read by a kernel call.
+       */
+      template<typename Pass>
+      void run(const Pass &pass, const std::string &kernel, const std::string &variant, const std::string &pattern,
+          int bits, std::size_t workingSet, unsigned int numOps, std::size_t bytesPerOp)
+      {
+        // warm up (i.e. bring the working set in the cache)
+        sink += pass();
+
+        double best = 0.0;
+        for (int t = 0; t < m_trials; ++t) {
+          unsigned long long passes = 0;
+          unsigned long long start = impl::monotonic_nanoseconds();
+          unsigned long long elapsed = 0;
+          do {
+            sink += pass();
+            ++passes;
+            elapsed = impl::monotonic_nanoseconds() - start;
+          } while (elapsed < m_minTime * 1e6);
+          double nsPerOp = static_cast<double>(elapsed) / (passes * numOps);
+          if (!t || nsPerOp < best)
+            best = nsPerOp;
+        }
+
+        Measurement m;
+        m.kernel = kernel;
+        m.variant = variant;
+        m.pattern = pattern;
+        m.bits = bits;
+        m.workingSet = workingSet;
+        m.nsPerOp = best;
+        m.gbPerSecond = bytesPerOp / best;
+        m_measurements.push_back(m);
+
+        std::cout << std::left << std::setw(24) << kernel << std::setw(14) << variant << std::setw(12) << pattern
+                  << std::right << std::setw(6) << bits << std::setw(12) << format_size(workingSet)
+                  << std::fixed << std::setprecision(2) << std::setw(12) << m.nsPerOp
+                  << std::setw(10) << m.gbPerSecond << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+      }
+
+      const std::vector<Measurement>& measurements() const
+      {
+        return m_measurements;
+      }
+
+      static std::string format_size(std::size_t size)
+      {
+        if (size >= 1024 * 1024 * 1024 && size % (1024 * 1024 * 1024) == 0)
+          return make_string(size / (1024 * 1024 * 1024), "G");
+        if (size >= 1024 * 1024 && size % (1024 * 1024) == 0)
+          return make_string(size / (1024 * 1024), "M");
+        if (size >= 1024 && size % 1024 == 0)
+          return make_string(size / 1024, "K");
+        return make_string(size);
+      }
+
+    private:
+      std::vector<Measurement> m_measurements;
+      double m_minTime;
+      int m_trials;
+  };
+
+  /**
+   * Parse a size with an optional K, M or G suffix.
+   */
+  std::size_t parse_size(const std::string &str)
+  {
+    char *end;
+    double size = std::strtod(str.c_str(), &end);
+    std::string suffix(end);
+    if (suffix == "K" || suffix == "k")
+      size *= 1024;
+    else if (suffix == "M" || suffix == "m")
+      size *= 1024 * 1024;
+    else if (suffix == "G" || suffix == "g")
+      size *= 1024 * 1024 * 1024;
+    else if (!suffix.empty())
+      throw std::runtime_error(make_string("Invalid size \"", str, "\""));
+    if (size < 1.0)
+      throw std::runtime_error(make_string("Invalid size \"", str, "\""));
+    return static_cast<std::size_t>(size);
+  }
+
+  template<typename T>
+  std::vector<T> parse_list(const std::string &str, T (*parse)(const std::string&))
+  {
+    std::vector<T> result;
+    std::vector<std::string> tokens = tokenize(str, ",");
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+      result.push_back(parse(tokens[i]));
+    return result;
+  }
+
+  int parse_width(const std::string &str)
+  {
+    int bits = std::atoi(str.c_str());
+    if (bits < BitsPerWord || bits % BitsPerWord)
+      throw std::runtime_error(make_string("Invalid fingerprint width \"", str, "\", this must be a multiple of ",
+            BitsPerWord));
+    return bits;
+  }
+
+  /**
+   * Run the kernel benchmarks for a fingerprint width and working set size.
+   */
+  void benchmark_kernels(MicroBenchmark &benchmark, const std::vector<std::string> &kernels, int bits,
+      std::size_t workingSet)
+  {
+    int words = bits / BitsPerWord;
+    std::size_t fpBytes = words * sizeof(Word);
+    unsigned int n = std::max<std::size_t>(1, workingSet / fpBytes);
+
+    Word *data = aligned_new<Word>(static_cast<std::size_t>(n) * words);
+    Word *query = aligned_new<Word>(words);
+    Word state = 88172645463325252ULL;
+    for (std::size_t i = 0; i < static_cast<std::size_t>(n) * words; ++i)
+      data[i] = random_word(state);
+    // a sparse query so the subset checks do not fail at the first word
+    for (int i = 0; i < words; ++i)
+      query[i] = random_word(state) & random_word(state) & random_word(state);
+
+    for (std::size_t k = 0; k < kernels.size(); ++k) {
+      const impl::BitvecKernels *generic = impl::bitvec_kernels_by_name(kernels[k]);
+      if (!generic)
+        continue;
+      const impl::BitvecKernels *fixed = fixed_kernels(kernels[k], words);
+
+      CountPass count = { generic, data, n, words };
+      benchmark.run(count, "bitvec_count", kernels[k], "sequential", bits, workingSet, n, fpBytes);
+      if (fixed) {
+        count.kernels = fixed;
+        benchmark.run(count, "bitvec_count", kernels[k] + "/fixed", "sequential", bits, workingSet, n, fpBytes);
+      }
+
+      TanimotoPass tanimoto = { generic, query, data, n, words };
+      benchmark.run(tanimoto, "bitvec_tanimoto", kernels[k], "sequential", bits, workingSet, n, fpBytes);
+      if (fixed) {
+        tanimoto.kernels = fixed;
+        benchmark.run(tanimoto, "bitvec_tanimoto", kernels[k] + "/fixed", "sequential", bits, workingSet, n, fpBytes);
+      }
+    }
+
+    // these functions do not use the kernel tables
+    const std::string selected = impl::bitvec_kernels().name;
+    RangeCountPass range = { data, n, words };
+    benchmark.run(range, "bitvec_count_range", selected, "sequential", bits, workingSet, n, fpBytes);
+
+    SubsetPass subset = { query, data, n, words };
+    benchmark.run(subset, "bitvec_is_subset", "generic", "sequential", bits, workingSet, n, fpBytes);
+    if (words == 16) {
+      FixedSubsetPass<16> fixedSubset = { query, data, n };
+      benchmark.run(fixedSubset, "bitvec_is_subset", "fixed", "sequential", bits, workingSet, n, fpBytes);
+    } else if (words == 32) {
+      FixedSubsetPass<32> fixedSubset = { query, data, n };
+      benchmark.run(fixedSubset, "bitvec_is_subset", "fixed", "sequential", bits, workingSet, n, fpBytes);
+    } else if (words == 64) {
+      FixedSubsetPass<64> fixedSubset = { query, data, n };
+      benchmark.run(fixedSubset, "bitvec_is_subset", "fixed", "sequential", bits, workingSet, n, fpBytes);
+    }
+
+    // the working set is the hex input (2 characters per byte)
+    unsigned int numHex = std::max<std::size_t>(1, n / 2);
+    std::string hex;
+    hex.reserve(static_cast<std::size_t>(numHex) * 2 * fpBytes);
+    for (unsigned int i = 0; i < numHex; ++i)
+      hex += bitvec_to_hex(data + static_cast<std::size_t>(i) * words, words);
+    HexPass hexPass = { hex.data(), query, numHex, words };
+    benchmark.run(hexPass, "hex_to_bitvec", "table", "sequential", bits, workingSet, numHex, 2 * fpBytes);
+
+    aligned_delete(query);
+    aligned_delete(data);
+  }
+
+  /**
+   * Run the fingerprint(i) access pattern benchmarks for the storage
+   * classes.
+   */
+  void benchmark_storage(MicroBenchmark &benchmark, int bits, std::size_t workingSet, const std::string &filename)
+  {
+    int words = bits / BitsPerWord;
+    std::size_t fpBytes = words * sizeof(Word);
+    unsigned int n = std::max<std::size_t>(1, workingSet / fpBytes);
+
+    {
+      Word state = 88172645463325252ULL;
+      std::vector<Word> fp(words);
+      RowMajorFingerprintOutputFile file(filename, bits);
+      for (unsigned int i = 0; i < n; ++i) {
+        for (int j = 0; j < words; ++j)
+          fp[j] = random_word(state);
+        file.writeFingerprint(&fp[0]);
+      }
+      file.writeHeader(make_string("{ \"filetype\": \"fingerprints\", \"order\": \"row-major\", \"num_bits\": ",
+            bits, ", \"num_fingerprints\": ", n, " }"));
+    }
+
+    std::vector<unsigned int> sequential(n), random(n);
+    for (unsigned int i = 0; i < n; ++i)
+      sequential[i] = random[i] = i;
+    Word state = 2463534242ULL;
+    for (unsigned int i = n - 1; i > 0; --i)
+      std::swap(random[i], random[random_word(state) % (i + 1)]);
+
+    const impl::BitvecKernels *kernels = &impl::bitvec_kernels();
+    InMemoryRowMajorFingerprintStorage inMemory;
+    inMemory.load(filename);
+    MemoryMappedRowMajorFingerprintStorage memoryMapped(filename);
+
+    for (int p = 0; p < 2; ++p) {
+      const unsigned int *order = p ? &random[0] : &sequential[0];
+      const char *pattern = p ? "random" : "sequential";
+      StoragePass<InMemoryRowMajorFingerprintStorage> inMemoryPass = { kernels, &inMemory, order, n, words };
+      benchmark.run(inMemoryPass, "in_memory_row_major", kernels->name, pattern, bits, workingSet, n, fpBytes);
+      StoragePass<MemoryMappedRowMajorFingerprintStorage> mappedPass = { kernels, &memoryMapped, order, n, words };
+      benchmark.run(mappedPass, "memory_mapped_row_major", kernels->name, pattern, bits, workingSet, n, fpBytes);
+    }
+
+    std::remove(filename.c_str());
+  }
+
+  void usage(const char *command)
+  {
+    std::cerr << "Usage: " << command << " [options]" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Benchmark the bit vector kernels and the fingerprint storage access patterns. The" << std::endl;
+    std::cerr << "kernels are run for each dispatch variant supported by this CPU (scalar, popcnt, avx2" << std::endl;
+    std::cerr << "and avx512), fixed-width variants are included for 1024, 2048 and 4096 bits. The time" << std::endl;
+    std::cerr << "per kernel call (ns/op) and the bandwidth (GB/s) are reported for each fingerprint" << std::endl;
+    std::cerr << "width and working set size." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "    -widths <list>   Comma separated fingerprint widths in bits (default is" << std::endl;
+    std::cerr << "                     512,1024,2048,4096)" << std::endl;
+    std::cerr << "    -sizes <list>    Comma separated working set sizes with optional K, M or G suffix" << std::endl;
+    std::cerr << "                     (default is 16K,256K,4M,256M for L1, L2, L3 and DRAM)" << std::endl;
+    std::cerr << "    -kernels <list>  Comma separated kernel variants (default is all supported)" << std::endl;
+    std::cerr << "    -min-time <ms>   The minimum time per trial (default is 100)" << std::endl;
+    std::cerr << "    -trials <n>      The number of trials, the best is reported (default is 3)" << std::endl;
+    std::cerr << "    -no-storage      Do not benchmark the storage access patterns" << std::endl;
+    std::cerr << "    -json <file>     Also write the results as JSON" << std::endl;
+    std::cerr << std::endl;
+  }
+
+  std::string identity(const std::string &str)
+  {
+    return str;
+  }
+
+}
+
+int main(int argc, char **argv)
+{
+  ParseArgs args(argc, argv, ParseArgs::Args("-widths(list)", "-sizes(list)", "-kernels(list)", "-min-time(ms)",
+        "-trials(n)", "-no-storage", "-json(file)", "-help"), ParseArgs::Args());
+  if (!args.IsValid() || args.IsArg("-help")) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  std::vector<int> widths;
+  std::vector<std::size_t> sizes;
+  std::vector<std::string> kernels;
+  try {
+    widths = parse_list(args.IsArg("-widths") ? args.GetArgString("-widths", 0) : "512,1024,2048,4096", parse_width);
+    sizes = parse_list(args.IsArg("-sizes") ? args.GetArgString("-sizes", 0) : "16K,256K,4M,256M", parse_size);
+    if (args.IsArg("-kernels")) {
+      kernels = parse_list(args.GetArgString("-kernels", 0), identity);
+      for (std::size_t i = 0; i < kernels.size(); ++i)
+        if (!impl::bitvec_kernels_by_name(kernels[i]))
+          throw std::runtime_error(make_string("Kernel \"", kernels[i], "\" is not supported by this CPU"));
+    } else {
+      for (int i = 0; kernelNames[i]; ++i)
+        if (impl::bitvec_kernels_by_name(kernelNames[i]))
+          kernels.push_back(kernelNames[i]);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  const double minTime = args.IsArg("-min-time") ? args.GetArgDouble("-min-time", 0) : 100.0;
+  const int trials = args.IsArg("-trials") ? args.GetArgInt("-trials", 0) : 3;
+  if (minTime <= 0.0 || trials < 1) {
+    std::cerr << "The minimum time and number of trials must be positive" << std::endl;
+    return -1;
+  }
+
+  std::cout << "Selected kernel: " << impl::bitvec_kernels().name << std::endl;
+  std::cout << "Supported kernels:";
+  for (int i = 0; kernelNames[i]; ++i)
+    if (impl::bitvec_kernels_by_name(kernelNames[i]))
+      std::cout << " " << kernelNames[i];
+  std::cout << std::endl << std::endl;
+
+  std::cout << std::left << std::setw(24) << "kernel" << std::setw(14) << "variant" << std::setw(12) << "pattern"
+            << std::right << std::setw(6) << "bits" << std::setw(12) << "working set" << std::setw(12) << "ns/op"
+            << std::setw(10) << "GB/s" << std::endl;
+
+  MicroBenchmark benchmark(minTime, trials);
+  try {
+    for (std::size_t w = 0; w < widths.size(); ++w)
+      for (std::size_t s = 0; s < sizes.size(); ++s) {
+        benchmark_kernels(benchmark, kernels, widths[w], sizes[s]);
+        if (!args.IsArg("-no-storage"))
+          benchmark_storage(benchmark, widths[w], sizes[s], "microbenchmark_tmp.fps.hel");
+      }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  if (args.IsArg("-json")) {
+    Json::Value data;
+    data["selected_kernel"] = impl::bitvec_kernels().name;
+    data["measurements"] = Json::Value(Json::arrayValue);
+    const std::vector<Measurement> &measurements = benchmark.measurements();
+    for (std::size_t i = 0; i < measurements.size(); ++i) {
+      Json::Value &m = data["measurements"][Json::ArrayIndex(i)];
+      m["kernel"] = measurements[i].kernel;
+      m["variant"] = measurements[i].variant;
+      m["pattern"] = measurements[i].pattern;
+      m["bits"] = measurements[i].bits;
+      m["working_set"] = Json::UInt64(measurements[i].workingSet);
+      m["ns_per_op"] = measurements[i].nsPerOp;
+      m["gb_per_second"] = measurements[i].gbPerSecond;
+    }
+    std::ofstream ofs(args.GetArgString("-json", 0).c_str());
+    Json::StyledWriter writer;
+    ofs << writer.write(data);
+    if (!ofs) {
+      std::cerr << "Could not write " << args.GetArgString("-json", 0) << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_TOOLS_MOLECULEPIPELINE_H
+#define HELIUM_TOOLS_MOLECULEPIPELINE_H
+
+#include <Helium/fileio/file.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/util.h>
+
+#ifdef HAVE_CPP11
+#include <Helium/threadpool.h>
+
+#include <deque>
+#include <memory>
+#endif
+
+#include <json/json.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Helium {
+
+  /**
+   * @brief An input molecule that could not be converted.
+   */
+  struct MoleculeError
+  {
+    MoleculeError(std::size_t index_ = 0, const std::string &message_ = std::string())
+      : index(index_), message(message_)
+    {
+    }
+
+    std::size_t index; //!< The input number (starting from 0)
+    std::string message; //!< The error message
+  };
+
+  namespace impl {
+
+    /**
+     * @brief A chunk of input molecules and their converted records.
+     */
+    template<typename InputType>
+    struct MoleculeChunk
+    {
+      std::vector<InputType> inputs; //!< The input molecules
+      std::string records; //!< The concatenated molecule records
+      std::vector<std::size_t> sizes; //!< The size of each record in records
+      std::vector<MoleculeError> errors; //!< The inputs that could not be converted
+      std::size_t first; //!< The input number of the first input molecule
+#ifdef HAVE_CPP11
+      ThreadPool::TaskGroup group; //!< The conversion task
+#endif
+    };
+
+    /**
+     * Read the next chunk of input molecules.
+     *
+     * @return False if there are no more inputs.
+     */
+    template<typename InputType, typename ReadFunctor>
+    bool read_chunk(MoleculeChunk<InputType> &chunk, ReadFunctor &read, std::size_t chunkSize)
+    {
+      while (chunk.inputs.size() < chunkSize) {
+        chunk.inputs.push_back(InputType());
+        if (!read(chunk.inputs.back())) {
+          chunk.inputs.pop_back();
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /**
+     * Convert the input molecules of a chunk to molecule records. Inputs
+     * that can not be converted are skipped, the exceptions thrown by
+     * @p convert are added to the chunk's errors. The functor is copied
+     * so it can reuse its state for all inputs in the chunk.
+     */
+    template<typename InputType, typename ConvertFunctor>
+    void convert_chunk(MoleculeChunk<InputType> &chunk, const ConvertFunctor &functor)
+    {
+      ConvertFunctor convert(functor);
+      std::ostringstream os;
+      for (std::size_t i = 0; i < chunk.inputs.size(); ++i) {
+        os.str("");
+        bool valid = false;
+        try {
+          valid = convert(chunk.inputs[i], os);
+        } catch (const std::exception &e) {
+          chunk.errors.push_back(MoleculeError(chunk.first + i, e.what()));
+        }
+        if (!valid)
+          continue;
+        std::string record = os.str();
+        chunk.records += record;
+        chunk.sizes.push_back(record.size());
+      }
+      // free the input molecules
+      std::vector<InputType>().swap(chunk.inputs);
+    }
+
+    /**
+     * Append the records of a chunk to the file.
+     */
+    template<typename InputType>
+    void write_chunk(BinaryOutputFile &file, MoleculeChunk<InputType> &chunk, std::vector<uint64_t> &positions,
+        std::vector<MoleculeError> *errors)
+    {
+      if (errors)
+        errors->insert(errors->end(), chunk.errors.begin(), chunk.errors.end());
+      else
+        for (std::size_t i = 0; i < chunk.errors.size(); ++i)
+          std::cerr << chunk.errors[i].message << std::endl;
+
+      uint64_t position = file.stream().tellp();
+      for (std::size_t i = 0; i < chunk.sizes.size(); ++i) {
+        positions.push_back(position);
+        position += chunk.sizes[i];
+      }
+      file.write(chunk.records.data(), chunk.records.size());
+    }
+
+  }
+
+  /**
+   * @brief Write a Helium molecule file from input molecules using multiple threads.
+   *
+   * The input molecules are read in chunks on the calling thread using
+   * @p read. The chunks are converted to molecule records by the worker
+   * threads using @p convert and written to the file in input order by the
+   * calling thread. At most two chunks per thread are in progress at any
+   * time. Finally the molecule_indexes table and the JSON header are
+   * written.
+   *
+   * The functors are called as:
+   * @code
+   * bool read(InputType &input); // false when there are no more inputs
+   * bool convert(InputType &input, std::ostream &os); // false to skip the molecule
+   * @endcode
+   * The @p convert functor is copied for each chunk so it can keep state
+   * (e.g. a parser and molecule) that is reused for all inputs in the chunk.
+   * The copies are used concurrently. A convert functor may throw an
+   * exception for an invalid input, the message is added to @p errors (in
+   * input order) or printed to std::cerr when @p errors is 0. Without C++11
+   * support, the chunks are converted on the calling thread.
+   *
+   * @param filename The output molecule file.
+   * @param read The functor to read an input molecule.
+   * @param convert The functor to write the molecule record for an input.
+   * @param numThreads The number of threads, 0 for the number of cores.
+   * @param chunkSize The number of input molecules in a chunk.
+   * @param indexStride Only store the position of every indexStride-th
+   *        molecule (see @ref sparse_molecule_indexes).
+   * @param errors Optional output for the inputs that could not be converted.
+   *
+   * @return The number of molecules written to the file.
+   */
+  template<typename InputType, typename ReadFunctor, typename ConvertFunctor>
+  unsigned int write_molecule_file(const std::string &filename, ReadFunctor &read, ConvertFunctor &convert,
+      unsigned int numThreads = 0, std::size_t chunkSize = 1000, unsigned int indexStride = 1,
+      std::vector<MoleculeError> *errors = 0)
+  {
+    typedef impl::MoleculeChunk<InputType> Chunk;
+
+    BinaryOutputFile file(filename);
+    std::vector<uint64_t> positions;
+
+#ifdef HAVE_CPP11
+    ThreadPool pool(numThreads);
+    std::deque<std::unique_ptr<Chunk> > chunks; // the chunks in progress (in input order)
+    std::size_t numInputs = 0;
+    bool more = true;
+    while (more || !chunks.empty()) {
+      // keep the worker threads busy
+      while (more && chunks.size() < 2 * pool.numThreads()) {
+        std::unique_ptr<Chunk> chunk(new Chunk);
+        chunk->first = numInputs;
+        more = impl::read_chunk(*chunk, read, chunkSize);
+        if (chunk->inputs.empty())
+          break;
+        numInputs += chunk->inputs.size();
+        Chunk *task = chunk.get();
+        pool.submit(task->group, [task, &convert] { impl::convert_chunk(*task, convert); });
+        chunks.push_back(std::move(chunk));
+      }
+
+      if (chunks.empty())
+        break;
+
+      // write the oldest chunk
+      pool.wait(chunks.front()->group);
+      impl::write_chunk(file, *chunks.front(), positions, errors);
+      chunks.pop_front();
+    }
+#else
+    std::size_t numInputs = 0;
+    bool more = true;
+    while (more) {
+      Chunk chunk;
+      chunk.first = numInputs;
+      more = impl::read_chunk(chunk, read, chunkSize);
+      numInputs += chunk.inputs.size();
+      impl::convert_chunk(chunk, convert);
+      impl::write_chunk(file, chunk, positions, errors);
+    }
+#endif
+
+    // create JSON header
+    Json::Value data;
+    data["filetype"] = "molecules";
+    data["num_molecules"] = static_cast<unsigned int>(positions.size());
+
+    // write the molecule positions to the file
+    impl::write_molecule_indexes(file, positions, indexStride, data);
+
+    // write JSON header
+    Json::StyledWriter writer;
+    if (!file.writeHeader(writer.write(data)))
+      throw std::runtime_error(make_string("Could not write file ", filename));
+
+    return positions.size();
+  }
+
+}
+
+#endif
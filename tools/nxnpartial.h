@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_NXNPARTIAL_H
+#define HELIUM_NXNPARTIAL_H
+
+#include <Helium/fileio/file.h>
+#include <Helium/util.h>
+
+#include <json/json.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace Helium {
+
+  /**
+   * @brief Write the partial result of an NxN similarity search tile.
+   *
+   * A partial result file is a Helium binary file with a JSON header that
+   * has the 'filetype' attribute set to 'similarity-nxn-partial'. The header
+   * also contains the 'num_bits', 'num_fingerprints', 'N' and 'Tmin'
+   * attributes of the search, the 'rows' and 'cols' ranges of the tile(s),
+   * the 'symmetric' flag and the number of stored rows ('num_rows'). The
+   * binary data is a record for each row with at least one hit, sorted by
+   * ascending row index: the 32-bit row index and the 32-bit number of hits
+   * followed by a 32-bit index and a 64-bit score for each hit, all in
+   * native byte order.
+   */
+  class NxNPartialWriter
+  {
+    public:
+      NxNPartialWriter(const std::string &filename) : m_file(filename), m_filename(filename), m_numRows(0),
+          m_lastRow(0)
+      {
+        if (!m_file)
+          throw std::runtime_error(make_string("Could not open partial result file \"", filename, "\""));
+      }
+
+      /**
+       * Write the hits for a row, the rows must be written in ascending order.
+       */
+      void write(unsigned int row, const std::vector<std::pair<unsigned int, double> > &hits)
+      {
+        if (m_numRows && row <= m_lastRow)
+          throw std::runtime_error(make_string("Rows written out of order to \"", m_filename, "\""));
+        uint32_t record[2] = { row, static_cast<uint32_t>(hits.size()) };
+        m_file.write(record, sizeof(record));
+        for (std::size_t i = 0; i < hits.size(); ++i) {
+          uint32_t index = hits[i].first;
+          m_file.write(&index, sizeof(index));
+          m_file.write(&hits[i].second, sizeof(double));
+        }
+        m_lastRow = row;
+        ++m_numRows;
+      }
+
+      /**
+       * Write the header, @p header contains the attributes of the search.
+       */
+      void finish(Json::Value header)
+      {
+        header["filetype"] = "similarity-nxn-partial";
+        header["num_rows"] = m_numRows;
+        Json::StyledWriter writer;
+        if (!m_file.writeHeader(writer.write(header)))
+          throw std::runtime_error(make_string("Could not write partial result file \"", m_filename, "\""));
+      }
+
+    private:
+      BinaryOutputFile m_file;
+      std::string m_filename;
+      unsigned int m_numRows;
+      unsigned int m_lastRow;
+  };
+
+  /**
+   * @brief Read the partial result of an NxN similarity search tile.
+   *
+   * The rows are read one at a time so any number of partial results can be
+   * merged in a streaming pass (see NxNPartialWriter for the format).
+   */
+  class NxNPartialReader
+  {
+    public:
+      NxNPartialReader(const std::string &filename) : m_file(filename), m_filename(filename), m_remaining(0),
+          m_row(0)
+      {
+        if (!m_file)
+          throw std::runtime_error(make_string("Could not open partial result file \"", filename, "\""));
+
+        Json::Reader reader;
+        if (!reader.parse(m_file.header(), m_header))
+          throw std::runtime_error(reader.getFormattedErrorMessages());
+        if (!m_header.isMember("filetype") || m_header["filetype"].asString() != "similarity-nxn-partial")
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'filetype' attribute or is not 'similarity-nxn-partial'"));
+        if (!m_header.isMember("num_fingerprints") || !m_header.isMember("num_rows") ||
+            !m_header.isMember("N") || !m_header.isMember("Tmin"))
+          throw std::runtime_error(make_string("JSON header for file ", filename, " does not contain 'num_fingerprints', 'num_rows', 'N' or 'Tmin' attribute"));
+        m_remaining = m_header["num_rows"].asUInt();
+      }
+
+      const Json::Value& header() const
+      {
+        return m_header;
+      }
+
+      /**
+       * Read the next row.
+       *
+       * @return False if there are no more rows.
+       */
+      bool next()
+      {
+        if (!m_remaining)
+          return false;
+        --m_remaining;
+
+        uint32_t record[2];
+        if (!m_file.read(record, sizeof(record)))
+          throw std::runtime_error(make_string("Partial result file \"", m_filename, "\" is truncated"));
+        if (record[0] >= m_header["num_fingerprints"].asUInt())
+          throw std::runtime_error(make_string("Partial result file \"", m_filename, "\" contains an invalid row"));
+        m_row = record[0];
+        m_hits.resize(record[1]);
+        for (std::size_t i = 0; i < m_hits.size(); ++i) {
+          uint32_t index;
+          if (!m_file.read(&index, sizeof(index)) || !m_file.read(&m_hits[i].second, sizeof(double)))
+            throw std::runtime_error(make_string("Partial result file \"", m_filename, "\" is truncated"));
+          m_hits[i].first = index;
+        }
+        return true;
+      }
+
+      /**
+       * Get the index of the current row.
+       */
+      unsigned int row() const
+      {
+        return m_row;
+      }
+
+      /**
+       * Get the hits for the current row.
+       */
+      const std::vector<std::pair<unsigned int, double> >& hits() const
+      {
+        return m_hits;
+      }
+
+    private:
+      BinaryInputFile m_file;
+      std::string m_filename;
+      Json::Value m_header;
+      unsigned int m_remaining; //!< The number of rows that are not read yet
+      unsigned int m_row;
+      std::vector<std::pair<unsigned int, double> > m_hits;
+  };
+
+}
+
+#endif
@@ -29,12 +29,11 @@
 
 #include "args.h"
 #include "progress.h"
+#include "moleculepipeline.h"
 
 #include <openbabel/obconversion.h>
 #include <openbabel/mol.h>
 
-#include <json/json.h>
-
 using namespace Helium;
 
 std::string normalize_smiles(const std::string &smiles)
@@ -104,61 +103,77 @@ void write_molecule(std::ostream &os, OpenBabel::OBMol *mol)
   }
 }
 
+/**
+ * Read molecules using OpenBabel. The ring, aromaticity and hydrogen
+ * perception is done here since OpenBabel's perception is not thread safe.
+ */
+struct OBMolReader
+{
+  OBMolReader(OpenBabel::OBConversion &conv_) : conv(conv_), numMolecules(0)
+  {
+  }
+
+  bool operator()(OpenBabel::OBMol &mol)
+  {
+    if (!conv.Read(&mol))
+      return false;
+    unknown_progress("Converting molecules", ++numMolecules);
+    FOR_ATOMS_OF_MOL (atom, mol) {
+      atom->IsInRing();
+      atom->IsAromatic();
+      atom->ImplicitHydrogenCount();
+    }
+    return true;
+  }
+
+  OpenBabel::OBConversion &conv;
+  unsigned int numMolecules;
+};
+
+/**
+ * Write the molecule records for the perceived molecules.
+ */
+struct OBMolConverter
+{
+  bool operator()(OpenBabel::OBMol &mol, std::ostream &os)
+  {
+    write_molecule(os, &mol);
+    return true;
+  }
+};
 
 int main(int argc, char**argv)
 {
   if (argc < 2) {
-    std::cout << "Usage: " << argv[0] << " <in_file> <out_file>" << std::endl;
+    std::cout << "Usage: " << argv[0] << " [-threads <number>] <in_file> <out_file>" << std::endl;
     return 0;
   }
 
-  ParseArgs args(argc, argv, ParseArgs::Args(), ParseArgs::Args("in_file", "out_file"));
+  ParseArgs args(argc, argv, ParseArgs::Args("-threads(number)"), ParseArgs::Args("in_file", "out_file"));
+  const int numThreads = args.IsArg("-threads") ? args.GetArgInt("-threads", 0) : 0;
   std::string inFile = args.GetArgString("in_file");
   std::string outFile = args.GetArgString("out_file");
 
-
-  // open the input file
-  std::ifstream ifs(inFile.c_str());
-
-  // open the output file
-  BinaryOutputFile outputFile;
-  try {
-    outputFile.open(outFile);
-  } catch (const std::exception &e) {
-    std::cerr << e.what() << std::endl;
+  if (numThreads < 0) {
+    std::cerr << "Invalid number of threads" << std::endl;
     return -1;
   }
 
-  unsigned int numMolecules = 0;
+  // open the input file
+  std::ifstream ifs(inFile.c_str());
 
   // open the input file using OpenBabel
-  OpenBabel::OBMol mol;
   OpenBabel::OBConversion conv(&ifs);
   conv.SetInFormat(conv.FormatFromExt(inFile));
 
   // start converting the molecules
-  std::vector<std::size_t> positions;
-  while (conv.Read(&mol)) {
-    ++numMolecules;
-    unknown_progress("Converting molecules", numMolecules);
-    positions.push_back(outputFile.stream().tellp());
-    write_molecule(outputFile.stream(), &mol);
+  try {
+    OBMolReader reader(conv);
+    OBMolConverter converter;
+    write_molecule_file<OpenBabel::OBMol>(outFile, reader, converter, numThreads);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
   }
   std::cout << std::endl;
-
-  // save the stream position where the molecule positions are stored
-  Json::UInt64 positionsPos = outputFile.stream().tellp();
-
-  // write the molecule positions to the file
-  outputFile.write(&positions[0], positions.size() * sizeof(std::size_t));
-
-  // create JSON header
-  Json::Value data;
-  data["filetype"] = "molecules";
-  data["num_molecules"] = numMolecules;
-  data["molecule_indexes"] = positionsPos;
-
-  // write JSON header
-  Json::StyledWriter writer;
-  outputFile.writeHeader(writer.write(data));
 }
@@ -25,11 +25,15 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "tool.h"
+#include "opencl.h"
+
+#include <Helium/util/string.h>
 
 #include <iostream>
 #include <sstream>
-
-#include <CL/cl.hpp>
+#include <fstream>
+#include <iterator>
+#include <cstdlib>
 
 namespace Helium {
 
@@ -221,6 +225,111 @@ namespace Helium {
       std::exit(-1);
     }
   }
+
+  namespace {
+
+    void contextCallback(const char *error_info, const void *private_info, size_t cb, void *user_data)
+    {
+      std::cerr << "Error: " << error_info << std::endl;
+      std::exit(-1);
+    }
+
+    /**
+     * FNV-1a hash used for the names of the cached program binaries.
+     */
+    unsigned long long fnv1a(const std::string &str)
+    {
+      unsigned long long hash = 14695981039346656037ULL;
+      for (std::size_t i = 0; i < str.size(); ++i) {
+        hash ^= static_cast<unsigned char>(str[i]);
+        hash *= 1099511628211ULL;
+      }
+      return hash;
+    }
+
+  }
+
+  cl::Context create_context(int platformId, int deviceId, std::vector<cl::Device> &device)
+  {
+    // get a list of OpenCL platforms
+    std::vector<cl::Platform> platforms;
+    checkError(cl::Platform::get(&platforms), "Could not get OpenCL platforms");
+    if (platformId < 1 || platformId > platforms.size())
+      checkError(CL_INVALID_PLATFORM, make_string("Invalid OpenCL platform id (", platformId, ")"));
+
+    // get a list of devices for this platform
+    std::vector<cl::Device> devices;
+    checkError(platforms[platformId - 1].getDevices(CL_DEVICE_TYPE_ALL, &devices), "Could not get OpenCL platform devices");
+    if (deviceId < 1 || deviceId > devices.size())
+      checkError(CL_INVALID_DEVICE, make_string("Invalid OpenCL device id (", deviceId, ")"));
+    device.assign(1, devices[deviceId - 1]);
+
+    // create OpenCL context
+    cl_int err;
+    cl::Context context(device, NULL, contextCallback, NULL, &err);
+    checkError(err, "Could not create OpenCL context");
+
+    return context;
+  }
+
+  cl::Program build_program(const cl::Context &context, const std::vector<cl::Device> &device,
+      const char *source, const std::string &cacheDir)
+  {
+    cl_int err;
+
+    // the cached binary depends on the device, the driver and the source
+    std::string cacheFile;
+    if (!cacheDir.empty()) {
+      std::string name, driver;
+      checkError(device[0].getInfo(CL_DEVICE_NAME, &name), "Could not get OpenCL device name");
+      checkError(device[0].getInfo(CL_DRIVER_VERSION, &driver), "Could not get OpenCL driver version");
+      std::stringstream ss;
+      ss << cacheDir << "/helium-" << std::hex << fnv1a(name + driver + source) << ".bin";
+      cacheFile = ss.str();
+    }
+
+    // try the cached program binary
+    if (!cacheFile.empty()) {
+      std::ifstream ifs(cacheFile.c_str(), std::ios_base::in | std::ios_base::binary);
+      std::vector<char> binary((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+      if (!binary.empty()) {
+        cl::Program::Binaries binaries(1, std::make_pair(static_cast<const void*>(&binary[0]), binary.size()));
+        std::vector<cl_int> status;
+        cl::Program program(context, device, binaries, &status, &err);
+        if (err == CL_SUCCESS && program.build(device, NULL, NULL, NULL) == CL_SUCCESS)
+          return program;
+      }
+    }
+
+    // compile the embedded source
+    cl::Program program(context, source, false, &err);
+    checkError(err, "Could not create OpenCL program");
+    err = program.build(device, NULL, NULL, NULL);
+
+    // get build log
+    if (err != CL_SUCCESS) {
+      std::string build_log;
+      checkError(program.getBuildInfo(device[0], CL_PROGRAM_BUILD_LOG, &build_log), "Could not get OpenCL build log");
+      if (build_log.size())
+        std::cerr << "Build log:" << std::endl << build_log << std::endl;
+    }
+    checkError(err, "Could not build OpenCL program");
+
+    // write the program binary to the cache
+    if (cacheFile.empty())
+      return program;
+    std::size_t size;
+    if (clGetProgramInfo(program(), CL_PROGRAM_BINARY_SIZES, sizeof(std::size_t), &size, NULL) != CL_SUCCESS || !size)
+      return program;
+    std::vector<unsigned char> binary(size);
+    unsigned char *data = &binary[0];
+    if (clGetProgramInfo(program(), CL_PROGRAM_BINARIES, sizeof(unsigned char*), &data, NULL) != CL_SUCCESS)
+      return program;
+    std::ofstream ofs(cacheFile.c_str(), std::ios_base::out | std::ios_base::binary);
+    ofs.write(reinterpret_cast<const char*>(data), size);
+
+    return program;
+  }
   
   /**
    * Tool for listing OpenCL information
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_TOOLS_OPENCL_H
+#define HELIUM_TOOLS_OPENCL_H
+
+#include <CL/cl.hpp>
+
+#include <vector>
+#include <string>
+
+namespace Helium {
+
+  /**
+   * Check the return value of an OpenCL call. On error, the error code and
+   * @p msg are printed and the program is terminated.
+   */
+  void checkError(cl_int ret, const std::string &msg);
+
+  /**
+   * Create an OpenCL context for a single device.
+   *
+   * @param platformId The OpenCL platform to use (1-based).
+   * @param deviceId The OpenCL device to use (1-based).
+   * @param device Output parameter for the selected device.
+   */
+  cl::Context create_context(int platformId, int deviceId, std::vector<cl::Device> &device);
+
+  /**
+   * Build an OpenCL program for the devices of a context. When @p cacheDir
+   * is not empty, the program binary is loaded from (or saved to) a file in
+   * this directory. The name of the file depends on the device, the driver
+   * version and the source so a stale binary is never used.
+   *
+   * @param context The OpenCL context.
+   * @param device The devices to build the program for.
+   * @param source The OpenCL C source (embedded in the binary).
+   * @param cacheDir The directory for cached program binaries, an empty
+   *        string disables caching.
+   */
+  cl::Program build_program(const cl::Context &context, const std::vector<cl::Device> &device,
+      const char *source, const std::string &cacheDir);
+
+}
+
+#endif
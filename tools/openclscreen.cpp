@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "openclscreen.h"
+
+#include <Helium/fingerprints/screen.h>
+
+namespace Helium {
+
+  namespace {
+
+    /**
+     * The OpenCL C source for the screening kernel.
+     */
+    const char *screen_kernel_source =
+      "__kernel void screen(const uint num_words, const uint num_query_bits, __global const ulong *columns,\n"
+      "    __global const uint *query_bits, __global ulong *result)\n"
+      "{\n"
+      "  uint j = get_global_id(0);\n"
+      "  if (j >= num_words)\n"
+      "    return;\n"
+      "  ulong word = ~(ulong)0;\n"
+      "  for (uint i = 0; i < num_query_bits && word; ++i)\n"
+      "    word &= columns[(ulong)query_bits[i] * num_words + j];\n"
+      "  result[j] = word;\n"
+      "}\n";
+
+  }
+
+  OpenCLSubstructureScreen::OpenCLSubstructureScreen(const InMemoryColumnMajorFingerprintStorage &storage,
+      int platformId, int deviceId, const std::string &cacheDir) : m_storage(storage)
+  {
+    m_context = create_context(platformId, deviceId, m_device);
+    m_program = build_program(m_context, m_device, screen_kernel_source, cacheDir);
+
+    cl_int err;
+    m_kernel = cl::Kernel(m_program, "screen", &err);
+    checkError(err, "Could not create OpenCL kernel");
+
+    // create OpenCL command queue
+    m_queue = cl::CommandQueue(m_context, m_device[0], 0, &err);
+    checkError(err, "Could not create OpenCL command queue");
+
+    checkError(m_kernel.getWorkGroupInfo(m_device[0], CL_KERNEL_WORK_GROUP_SIZE, &m_workGroupSize),
+        "Could not get OpenCL kernel work group size");
+    m_workGroupSize = std::min<std::size_t>(m_workGroupSize, 256);
+
+    // copy the columns to the device, the buffers stay resident
+    std::size_t numWords = std::max(1u, bitvec_num_words_for_bits(storage.numFingerprints()));
+    std::size_t columnsSize = numWords * storage.numBits() * sizeof(Word);
+    m_columns = cl::Buffer(m_context, CL_MEM_READ_ONLY, std::max<std::size_t>(1, columnsSize), NULL, &err);
+    checkError(err, "Could not create OpenCL buffer to hold fingerprint columns");
+    m_bits = cl::Buffer(m_context, CL_MEM_READ_ONLY, std::max(1u, storage.numBits()) * sizeof(cl_uint), NULL, &err);
+    checkError(err, "Could not create OpenCL buffer to hold query bits");
+    m_result = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, numWords * sizeof(Word), NULL, &err);
+    checkError(err, "Could not create OpenCL buffer to hold candidates");
+
+    // the columns in the storage may be padded (see stride())
+    if (storage.numFingerprints() && storage.numBits()) {
+      if (storage.stride() == numWords)
+        checkError(m_queue.enqueueWriteBuffer(m_columns, CL_TRUE, 0, columnsSize, storage.bit(0)),
+            "Could not copy fingerprint columns to OpenCL device");
+      else
+        for (unsigned int i = 0; i < storage.numBits(); ++i)
+          checkError(m_queue.enqueueWriteBuffer(m_columns, CL_TRUE, i * numWords * sizeof(Word),
+                numWords * sizeof(Word), storage.bit(i)), "Could not copy fingerprint columns to OpenCL device");
+    }
+
+    checkError(m_kernel.setArg(0, static_cast<cl_uint>(bitvec_num_words_for_bits(storage.numFingerprints()))),
+        "Could not set num_words kernel argument (arg 0)");
+    checkError(m_kernel.setArg(2, m_columns), "Could not set columns kernel argument (arg 2)");
+    checkError(m_kernel.setArg(3, m_bits), "Could not set query_bits kernel argument (arg 3)");
+    checkError(m_kernel.setArg(4, m_result), "Could not set result kernel argument (arg 4)");
+  }
+
+  void OpenCLSubstructureScreen::screen(const Word *query, Word *result)
+  {
+    unsigned int numWords = bitvec_num_words_for_bits(m_storage.numFingerprints());
+    if (!numWords)
+      return;
+
+    // rarest bits first so the work items can stop early
+    std::vector<unsigned int> queryBits = impl::screen_query_bits(m_storage, query);
+    std::vector<cl_uint> bits(queryBits.begin(), queryBits.end());
+
+    if (!bits.empty())
+      checkError(m_queue.enqueueWriteBuffer(m_bits, CL_FALSE, 0, bits.size() * sizeof(cl_uint), &bits[0]),
+          "Could not copy query bits to OpenCL device");
+    checkError(m_kernel.setArg(1, static_cast<cl_uint>(bits.size())), "Could not set num_query_bits kernel argument (arg 1)");
+
+    std::size_t globalSize = (numWords + m_workGroupSize - 1) / m_workGroupSize * m_workGroupSize;
+    checkError(m_queue.enqueueNDRangeKernel(m_kernel, cl::NullRange, cl::NDRange(globalSize), cl::NDRange(m_workGroupSize)),
+        "Could not enqueue ND-range kernel to run");
+    checkError(m_queue.enqueueReadBuffer(m_result, CL_TRUE, 0, numWords * sizeof(Word), result),
+        "Could not copy candidates from OpenCL device");
+
+    // clear the padding bits in the last word
+    if (m_storage.numFingerprints() % BitsPerWord)
+      result[numWords - 1] &= (Word(1) << (m_storage.numFingerprints() % BitsPerWord)) - 1;
+  }
+
+  std::vector<unsigned int> OpenCLSubstructureScreen::candidates(const Word *query)
+  {
+    std::vector<Word> bitmap(std::max(1u, bitvec_num_words_for_bits(m_storage.numFingerprints())));
+    screen(query, &bitmap[0]);
+    return screen_candidates(&bitmap[0], m_storage.numFingerprints());
+  }
+
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_TOOLS_OPENCLSCREEN_H
+#define HELIUM_TOOLS_OPENCLSCREEN_H
+
+#include <Helium/fileio/fingerprints.h>
+
+#include "opencl.h"
+
+namespace Helium {
+
+  /**
+   * @brief Substructure screening on an OpenCL device.
+   *
+   * The columns of the column-major fingerprint storage are copied to the
+   * device once and stay resident across queries. For each query, only the
+   * indices of the set query bits are copied to the device. Each work item
+   * intersects the columns for one word of the candidate bitmap. The result
+   * is the same as for substructure_screen().
+   */
+  class OpenCLSubstructureScreen
+  {
+    public:
+      /**
+       * @brief Constructor.
+       *
+       * Errors are reported by checkError() which terminates the program.
+       *
+       * @param storage The column-major fingerprints, the storage must outlive
+       *        this object.
+       * @param platformId The OpenCL platform to use (1-based).
+       * @param deviceId The OpenCL device to use (1-based).
+       * @param cacheDir The directory for caching compiled program binaries,
+       *        an empty string disables caching.
+       */
+      OpenCLSubstructureScreen(const InMemoryColumnMajorFingerprintStorage &storage, int platformId, int deviceId,
+          const std::string &cacheDir = std::string());
+
+      /**
+       * @brief Screen the fingerprints for a query.
+       *
+       * @param query The query fingerprint.
+       * @param result The candidate bitmap, this must have room for
+       *        bitvec_num_words_for_bits(storage.numFingerprints()) words.
+       */
+      void screen(const Word *query, Word *result);
+
+      /**
+       * @brief Screen the fingerprints for a query.
+       *
+       * @param query The query fingerprint.
+       *
+       * @return The sorted indices of the candidates.
+       */
+      std::vector<unsigned int> candidates(const Word *query);
+
+    private:
+      const InMemoryColumnMajorFingerprintStorage &m_storage;
+      std::vector<cl::Device> m_device;
+      cl::Context m_context;
+      cl::Program m_program;
+      cl::Kernel m_kernel;
+      cl::CommandQueue m_queue;
+      cl::Buffer m_columns; //!< Resident fingerprint columns
+      cl::Buffer m_bits; //!< Set query bits
+      cl::Buffer m_result; //!< Candidate bitmap
+      std::size_t m_workGroupSize;
+  };
+
+}
+
+#endif
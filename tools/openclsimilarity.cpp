@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "openclsimilarity.h"
+
+#include <Helium/contract.h>
+#include <Helium/util/string.h>
+#include <Helium/util/functor.h>
+
+#include <algorithm>
+#include <functional>
+
+namespace Helium {
+
+  namespace {
+
+    /**
+     * The OpenCL C source for the k-nearest neighbor kernel. The scratch
+     * buffer holds MAX_K hits for each work item in the work group and the
+     * work group size must be a power of two.
+     */
+    const char *similarity_kernel_source =
+      "#define MAX_K 32\n"
+      "\n"
+      "typedef struct { uint index; float T; } Hit;\n"
+      "\n"
+      "inline bool better_hit(float T1, uint index1, float T2, uint index2)\n"
+      "{\n"
+      "  return T1 > T2 || (T1 == T2 && index1 < index2);\n"
+      "}\n"
+      "\n"
+      "inline void insert_hit(Hit *hits, uint *count, uint k, uint index, float T)\n"
+      "{\n"
+      "  if (*count == k && !better_hit(T, index, hits[k - 1].T, hits[k - 1].index))\n"
+      "    return;\n"
+      "  uint j = *count < k ? (*count)++ : k - 1;\n"
+      "  for (; j > 0 && better_hit(T, index, hits[j - 1].T, hits[j - 1].index); --j)\n"
+      "    hits[j] = hits[j - 1];\n"
+      "  hits[j].index = index;\n"
+      "  hits[j].T = T;\n"
+      "}\n"
+      "\n"
+      "__kernel void knn_search(const uint num_fingerprints, const uint num_words, const float Tmin, const uint k,\n"
+      "    __global const ulong *fingerprints, __global const uint *bit_counts, __global const ulong *queries,\n"
+      "    __global Hit *results, __local Hit *scratch)\n"
+      "{\n"
+      "  uint q = get_group_id(0);\n"
+      "  uint lid = get_local_id(0);\n"
+      "  uint lsize = get_local_size(0);\n"
+      "  __global const ulong *query = queries + q * num_words;\n"
+      "\n"
+      "  uint query_count = 0;\n"
+      "  for (uint w = 0; w < num_words; ++w)\n"
+      "    query_count += popcount(query[w]);\n"
+      "\n"
+      "  // the k best hits for the strided part of the database\n"
+      "  Hit hits[MAX_K];\n"
+      "  uint count = 0;\n"
+      "  for (uint i = lid; i < num_fingerprints; i += lsize) {\n"
+      "    __global const ulong *fp = fingerprints + i * num_words;\n"
+      "    uint and_count = 0;\n"
+      "    for (uint w = 0; w < num_words; ++w)\n"
+      "      and_count += popcount(query[w] & fp[w]);\n"
+      "    uint or_count = query_count + bit_counts[i] - and_count;\n"
+      "    float T = or_count ? (float)and_count / or_count : 0.0f;\n"
+      "    if (T >= Tmin)\n"
+      "      insert_hit(hits, &count, k, i, T);\n"
+      "  }\n"
+      "  for (uint j = count; j < k; ++j) {\n"
+      "    hits[j].index = 0xffffffff;\n"
+      "    hits[j].T = -1.0f;\n"
+      "  }\n"
+      "  for (uint j = 0; j < k; ++j)\n"
+      "    scratch[lid * k + j] = hits[j];\n"
+      "  barrier(CLK_LOCAL_MEM_FENCE);\n"
+      "\n"
+      "  // tree reduction, merge the hits of work items lid and lid + stride\n"
+      "  for (uint stride = lsize / 2; stride > 0; stride /= 2) {\n"
+      "    if (lid < stride) {\n"
+      "      __local const Hit *a = scratch + lid * k;\n"
+      "      __local const Hit *b = scratch + (lid + stride) * k;\n"
+      "      uint i = 0, j = 0;\n"
+      "      for (uint n = 0; n < k; ++n)\n"
+      "        hits[n] = better_hit(a[i].T, a[i].index, b[j].T, b[j].index) ? a[i++] : b[j++];\n"
+      "    }\n"
+      "    barrier(CLK_LOCAL_MEM_FENCE);\n"
+      "    if (lid < stride)\n"
+      "      for (uint n = 0; n < k; ++n)\n"
+      "        scratch[lid * k + n] = hits[n];\n"
+      "    barrier(CLK_LOCAL_MEM_FENCE);\n"
+      "  }\n"
+      "\n"
+      "  if (!lid)\n"
+      "    for (uint j = 0; j < k; ++j)\n"
+      "      results[q * k + j] = scratch[j];\n"
+      "}\n";
+
+    struct OpenCLHit
+    {
+      cl_uint index;
+      cl_float T;
+    };
+
+  }
+
+  OpenCLSimilaritySearch::OpenCLSimilaritySearch(const InMemoryRowMajorFingerprintStorage &storage,
+      int platformId, int deviceId, const std::string &cacheDir) : m_storage(storage)
+  {
+    m_context = create_context(platformId, deviceId, m_device);
+    m_program = build_program(m_context, m_device, similarity_kernel_source, cacheDir);
+
+    cl_int err;
+    m_kernel = cl::Kernel(m_program, "knn_search", &err);
+    checkError(err, "Could not create OpenCL kernel");
+
+    // create OpenCL command queue
+    m_queue = cl::CommandQueue(m_context, m_device[0], 0, &err);
+    checkError(err, "Could not create OpenCL command queue");
+
+    // the work group size must be a power of two for the reduction
+    std::size_t maxWorkGroupSize;
+    checkError(m_kernel.getWorkGroupInfo(m_device[0], CL_KERNEL_WORK_GROUP_SIZE, &maxWorkGroupSize),
+        "Could not get OpenCL kernel work group size");
+    m_workGroupSize = 1;
+    while (2 * m_workGroupSize <= std::min<std::size_t>(maxWorkGroupSize, 64))
+      m_workGroupSize *= 2;
+
+    // copy the database to the device, the buffers stay resident
+    std::size_t numFingerprints = std::max(1u, storage.numFingerprints());
+    std::size_t fingerprintsSize = numFingerprints * bitvec_num_words_for_bits(storage.numBits()) * sizeof(Word);
+    m_fingerprints = cl::Buffer(m_context, CL_MEM_READ_ONLY, fingerprintsSize, NULL, &err);
+    checkError(err, "Could not create OpenCL buffer to hold fingerprints");
+    m_bitCounts = cl::Buffer(m_context, CL_MEM_READ_ONLY, numFingerprints * sizeof(cl_uint), NULL, &err);
+    checkError(err, "Could not create OpenCL buffer to hold bit counts");
+
+    if (storage.numFingerprints()) {
+      // the fingerprints in the storage may be padded (see stride())
+      unsigned int numWords = bitvec_num_words_for_bits(storage.numBits());
+      if (storage.stride() == numWords)
+        checkError(m_queue.enqueueWriteBuffer(m_fingerprints, CL_TRUE, 0, fingerprintsSize, storage.fingerprint(0)),
+            "Could not copy fingerprints to OpenCL device");
+      else {
+        std::vector<Word> fingerprints(fingerprintsSize / sizeof(Word));
+        for (unsigned int i = 0; i < storage.numFingerprints(); ++i)
+          std::copy(storage.fingerprint(i), storage.fingerprint(i) + numWords, &fingerprints[0] + static_cast<std::size_t>(i) * numWords);
+        checkError(m_queue.enqueueWriteBuffer(m_fingerprints, CL_TRUE, 0, fingerprintsSize, &fingerprints[0]),
+            "Could not copy fingerprints to OpenCL device");
+      }
+      std::vector<cl_uint> bitCounts(storage.bitCounts(), storage.bitCounts() + storage.numFingerprints());
+      checkError(m_queue.enqueueWriteBuffer(m_bitCounts, CL_TRUE, 0, bitCounts.size() * sizeof(cl_uint), &bitCounts[0]),
+          "Could not copy bit counts to OpenCL device");
+    }
+  }
+
+  std::vector<std::vector<std::pair<unsigned int, double> > > OpenCLSimilaritySearch::knnSearch(
+      const std::vector<Word*> &queries, unsigned int k, double Tmin)
+  {
+    PRE(k > 0 && k <= MaxHits);
+
+    int numWords = bitvec_num_words_for_bits(m_storage.numBits());
+    std::vector<std::vector<std::pair<unsigned int, double> > > result(queries.size());
+
+    // the queries are searched in batches to bound the size of the buffers
+    const std::size_t batchSize = 4096;
+    std::size_t numBatchQueries = std::min(batchSize, queries.size());
+    std::vector<Word> batch(numBatchQueries * numWords);
+    std::vector<OpenCLHit> hits(numBatchQueries * k);
+
+    cl_int err;
+    cl::Buffer queriesBuffer(m_context, CL_MEM_READ_ONLY, std::max<std::size_t>(1, batch.size()) * sizeof(Word), NULL, &err);
+    checkError(err, "Could not create OpenCL buffer to hold queries");
+    cl::Buffer resultsBuffer(m_context, CL_MEM_WRITE_ONLY, std::max<std::size_t>(1, hits.size()) * sizeof(OpenCLHit), NULL, &err);
+    checkError(err, "Could not create OpenCL buffer to hold results");
+
+    checkError(m_kernel.setArg(0, static_cast<cl_uint>(m_storage.numFingerprints())), "Could not set num_fingerprints kernel argument (arg 0)");
+    checkError(m_kernel.setArg(1, static_cast<cl_uint>(numWords)), "Could not set num_words kernel argument (arg 1)");
+    checkError(m_kernel.setArg(2, static_cast<cl_float>(Tmin)), "Could not set Tmin kernel argument (arg 2)");
+    checkError(m_kernel.setArg(3, static_cast<cl_uint>(k)), "Could not set k kernel argument (arg 3)");
+    checkError(m_kernel.setArg(4, m_fingerprints), "Could not set fingerprints kernel argument (arg 4)");
+    checkError(m_kernel.setArg(5, m_bitCounts), "Could not set bit_counts kernel argument (arg 5)");
+    checkError(m_kernel.setArg(6, queriesBuffer), "Could not set queries kernel argument (arg 6)");
+    checkError(m_kernel.setArg(7, resultsBuffer), "Could not set results kernel argument (arg 7)");
+    checkError(m_kernel.setArg(8, cl::__local(m_workGroupSize * k * sizeof(OpenCLHit))), "Could not set scratch kernel argument (arg 8)");
+
+    for (std::size_t first = 0; first < queries.size(); first += batchSize) {
+      std::size_t n = std::min(batchSize, queries.size() - first);
+      for (std::size_t i = 0; i < n; ++i)
+        std::copy(queries[first + i], queries[first + i] + numWords, &batch[i * numWords]);
+
+      checkError(m_queue.enqueueWriteBuffer(queriesBuffer, CL_FALSE, 0, n * numWords * sizeof(Word), &batch[0]),
+          "Could not copy queries to OpenCL device");
+      // one work group per query
+      checkError(m_queue.enqueueNDRangeKernel(m_kernel, cl::NullRange, cl::NDRange(n * m_workGroupSize),
+            cl::NDRange(m_workGroupSize)), "Could not enqueue ND-range kernel to run");
+      checkError(m_queue.enqueueReadBuffer(resultsBuffer, CL_TRUE, 0, n * k * sizeof(OpenCLHit), &hits[0]),
+          "Could not copy results from OpenCL device");
+
+      // recompute the scores in double precision
+      for (std::size_t i = 0; i < n; ++i) {
+        std::vector<std::pair<unsigned int, double> > &queryResult = result[first + i];
+        for (unsigned int j = 0; j < k; ++j) {
+          const OpenCLHit &hit = hits[i * k + j];
+          if (hit.T < 0.0f)
+            break;
+          double T = bitvec_tanimoto(queries[first + i], m_storage.fingerprint(hit.index), numWords);
+          if (T >= Tmin)
+            queryResult.push_back(std::make_pair(hit.index, T));
+        }
+        std::stable_sort(queryResult.begin(), queryResult.end(), compare_second<unsigned int, double, std::greater>());
+      }
+    }
+
+    return result;
+  }
+
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_TOOLS_OPENCLSIMILARITY_H
+#define HELIUM_TOOLS_OPENCLSIMILARITY_H
+
+#include <Helium/fileio/fingerprints.h>
+
+#include "opencl.h"
+
+namespace Helium {
+
+  /**
+   * @brief Brute force k-nearest neighbor search on an OpenCL device.
+   *
+   * The OpenCL context, the compiled program and the buffers with the
+   * fingerprints (and their bit counts) of the database are created once
+   * and stay resident on the device across calls to knnSearch(). The kernel
+   * source is embedded in the binary and the compiled program binary can be
+   * cached in a directory to avoid compiling the kernel on each run.
+   *
+   * Each query is searched by a single work group: the work items scan a
+   * strided part of the database keeping their k best hits in private
+   * memory and the per work item hits are merged on the device using a tree
+   * reduction in local memory. Only the k best hits per query are copied
+   * back to the host where the scores are recomputed in double precision.
+   */
+  class OpenCLSimilaritySearch
+  {
+    public:
+      /**
+       * The maximum number of hits per query (k) supported by the kernel.
+       */
+      enum { MaxHits = 32 };
+
+      /**
+       * @brief Constructor.
+       *
+       * Errors are reported by checkError() which terminates the program.
+       *
+       * @param storage The fingerprints to search, the storage must outlive
+       *        this object.
+       * @param platformId The OpenCL platform to use (1-based).
+       * @param deviceId The OpenCL device to use (1-based).
+       * @param cacheDir The directory for caching compiled program binaries,
+       *        an empty string disables caching.
+       */
+      OpenCLSimilaritySearch(const InMemoryRowMajorFingerprintStorage &storage, int platformId, int deviceId,
+          const std::string &cacheDir = std::string());
+
+      /**
+       * @brief Search the k nearest neighbors for a batch of queries.
+       *
+       * @pre k must be in the range [1,MaxHits].
+       *
+       * @param queries The query fingerprints.
+       * @param k The number of nearest neighbors to find.
+       * @param Tmin The minimum Tanimoto score.
+       *
+       * @return The (at most) k best hits for each query as (index, Tanimoto
+       *         score) pairs, sorted by descending score (equal scores by
+       *         ascending index).
+       */
+      std::vector<std::vector<std::pair<unsigned int, double> > > knnSearch(const std::vector<Word*> &queries,
+          unsigned int k, double Tmin);
+
+    private:
+      const InMemoryRowMajorFingerprintStorage &m_storage;
+      std::vector<cl::Device> m_device;
+      cl::Context m_context;
+      cl::Program m_program;
+      cl::Kernel m_kernel;
+      cl::CommandQueue m_queue;
+      cl::Buffer m_fingerprints; //!< Resident database fingerprints
+      cl::Buffer m_bitCounts; //!< Resident database bit counts
+      std::size_t m_workGroupSize;
+  };
+
+}
+
+#endif
@@ -0,0 +1,568 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "queries.h"
+
+#include <Helium/fingerprints/screen.h>
+#include <Helium/substructuresearch.h>
+#include <Helium/algorithms/canonical.h>
+#include <Helium/algorithms/cachedproperties.h>
+#include <Helium/util/functor.h>
+#include <Helium/smiles.h>
+
+#include <sys/stat.h>
+#include <cstring>
+
+#ifdef HAVE_OPENCL
+#include "openclscreen.h"
+#endif
+
+namespace Helium {
+
+  namespace {
+
+    /**
+     * Get a string that identifies the contents of a file: the name, size
+     * and modification time.
+     */
+    std::string file_identity(const std::string &filename)
+    {
+      struct stat info;
+      if (stat(filename.c_str(), &info))
+        return filename;
+      return make_string(filename, ":", info.st_size, ":", info.st_mtime);
+    }
+
+    /**
+     * Approximate memory used by a cache entry.
+     */
+    template<typename T>
+    std::size_t cache_entry_size(const std::vector<unsigned long> &key, const std::vector<T> &hits)
+    {
+      // the key is stored twice (list and map) plus some overhead per node
+      return 2 * key.size() * sizeof(unsigned long) + hits.size() * sizeof(T) + 128;
+    }
+
+    /**
+     * Parse a query SMILES. An std::invalid_argument is thrown if the
+     * SMILES is invalid so the partial molecule is never searched.
+     */
+    void parse_query(const std::string &smiles, HeMol &mol)
+    {
+      SmilesParser<HeMol> parser;
+      if (!parser.parse(smiles, mol)) {
+        const SmilesError &error = parser.error();
+        throw std::invalid_argument(make_string("Invalid SMILES \"", smiles, "\": ",
+              error.syntaxError ? "syntax" : "semantics", " error at position ", error.pos, " (", error.what, ")"));
+      }
+    }
+
+    template<typename Cache>
+    Json::Value cache_statistics(const Cache &cache)
+    {
+      Json::Value data(Json::objectValue);
+      data["entries"] = static_cast<unsigned int>(cache.numEntries());
+      data["size"] = static_cast<unsigned int>(cache.size());
+      data["capacity"] = static_cast<unsigned int>(cache.capacity());
+      data["hits"] = static_cast<unsigned int>(cache.hits());
+      data["misses"] = static_cast<unsigned int>(cache.misses());
+      return data;
+    }
+
+  }
+
+  SubstructureQueries::SubstructureQueries() : m_compressed(false)
+#ifdef HAVE_OPENCL
+    , m_gpu(0)
+#endif
+  {
+  }
+
+  SubstructureQueries::~SubstructureQueries()
+  {
+#ifdef HAVE_OPENCL
+    delete m_gpu;
+#endif
+  }
+
+  void SubstructureQueries::load(const std::string &moleculeFilename, const std::string &fingerprintFilename)
+  {
+    // check the order to select the storage
+    BinaryInputFile file(fingerprintFilename);
+    Json::Reader reader;
+    Json::Value data;
+    if (!reader.parse(file.header(), data))
+      throw std::runtime_error(reader.getFormattedErrorMessages());
+    file.close();
+
+    m_compressed = data["order"].asString() == "compressed-column-major";
+    if (m_compressed)
+      m_compressedStorage.load(fingerprintFilename);
+    else
+      m_storage.load(fingerprintFilename);
+    m_molecules.load(moleculeFilename);
+
+    unsigned int numFingerprints = m_compressed ? m_compressedStorage.numFingerprints() : m_storage.numFingerprints();
+    if (m_molecules.numMolecules() != numFingerprints)
+      throw std::runtime_error(make_string("The number of molecules in ", moleculeFilename,
+            " does not match the number of fingerprints in ", fingerprintFilename));
+
+    // the fingerprint settings are only parsed once
+    if (!m_settings.parse(m_compressed ? m_compressedStorage.header() : m_storage.header()))
+      throw std::runtime_error(make_string("Invalid fingerprint settings in ", fingerprintFilename));
+    // screening with other fingerprints would silently drop matches
+    if (!m_settings.isSubstructureFingerprint())
+      throw std::runtime_error(make_string("The fingerprints in ", fingerprintFilename, " (", m_settings.type(),
+            ") can not be used for substructure searches, use paths, trees or subgraphs fingerprints"));
+
+    // cached results are only valid for the same files
+    std::string identity = file_identity(moleculeFilename) + "|" + file_identity(fingerprintFilename);
+#ifdef HAVE_CPP11
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+    if (identity != m_identity)
+      m_cache.clear();
+    m_identity = identity;
+  }
+
+  void SubstructureQueries::loadFilters(const std::string &filename)
+  {
+    m_filters.load(filename);
+    {
+      // the filters do not change the hits but they do change the screened count
+#ifdef HAVE_CPP11
+      std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+      m_cache.clear();
+    }
+    if (m_filters.numMolecules() != numMolecules())
+      throw std::runtime_error(make_string("The number of molecules in ", filename,
+            " does not match the number of molecules in the molecule file"));
+  }
+
+  void SubstructureQueries::setCacheSize(std::size_t bytes)
+  {
+#ifdef HAVE_CPP11
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+    m_cache.setCapacity(bytes);
+  }
+
+  Json::Value SubstructureQueries::cacheStatistics() const
+  {
+#ifdef HAVE_CPP11
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+    return cache_statistics(m_cache);
+  }
+
+#ifdef HAVE_OPENCL
+  void SubstructureQueries::useOpenCL(int platformId, int deviceId, const std::string &cacheDir)
+  {
+    if (m_compressed)
+      throw std::runtime_error("OpenCL screening requires an uncompressed column-major fingerprint file");
+    delete m_gpu;
+    m_gpu = new OpenCLSubstructureScreen(m_storage, platformId, deviceId, cacheDir);
+  }
+#endif
+
+  Json::Value SubstructureQueries::search(const std::string &smiles, bool mt, unsigned int timeout,
+      unsigned int candidateTimeout)
+  {
+    Result result = searchHits(smiles, mt, timeout, candidateTimeout);
+
+    Json::Value data = summary(result);
+    data["hits"] = Json::Value(Json::arrayValue);
+    for (std::size_t i = 0; i < result.hits.size(); ++i) {
+      data["hits"][Json::ArrayIndex(i)] = Json::Value(Json::objectValue);
+      Json::Value &obj = data["hits"][Json::ArrayIndex(i)];
+      obj["index"] = result.hits[i];
+    }
+
+    return data;
+  }
+
+  SubstructureQueries::Result SubstructureQueries::searchHits(const std::string &smiles, bool mt,
+      unsigned int timeout, unsigned int candidateTimeout)
+  {
+    CancellationToken token(timeout);
+
+    HeMol query;
+    parse_query(smiles, query);
+
+    // check the cache
+    std::vector<unsigned long> key;
+    CachedResult cached;
+    if (m_cache.capacity())
+      key = canonical_key(query, cached_extended_connectivities(query));
+    if (!key.empty()) {
+#ifdef HAVE_CPP11
+      std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+      if (m_cache.find(key, cached)) {
+        Result result;
+        result.hits = cached.hits;
+        result.screened = cached.screened;
+        result.cached = true;
+        return result;
+      }
+    }
+
+    // compute query fingerprint
+    Word *queryFingerprint = m_settings.compute(query);
+    if (!queryFingerprint)
+      throw std::runtime_error("Could not compute the query fingerprint");
+
+    // the property filters are intersected with the fingerprint columns
+    std::vector<ScreenOperand> filters;
+    if (m_filters.numProperties())
+      filters = m_filters.operands(query);
+
+    unsigned int numWords = bitvec_num_words_for_bits(numMolecules());
+    std::vector<Word> candidates(std::max(1u, numWords));
+    Result result;
+    bool pipelined = false;
+#ifdef HAVE_CPP11
+    pipelined = mt;
+#endif
+#ifdef HAVE_OPENCL
+    pipelined = pipelined && !m_gpu;
+#endif
+
+#ifdef HAVE_CPP11
+    // screen, prefetch and verify the candidates concurrently
+    if (pipelined && m_compressed)
+      result.hits = substructure_search_pipelined(SubstructureScreen<InMemoryCompressedColumnMajorFingerprintStorage>(
+            m_compressedStorage, queryFingerprint, filters), m_molecules, query, &candidates[0], token,
+          candidateTimeout, result.timedOut);
+    else if (pipelined)
+      result.hits = substructure_search_pipelined(SubstructureScreen<InMemoryColumnMajorFingerprintStorage>(
+            m_storage, queryFingerprint, filters), m_molecules, query, &candidates[0], token,
+          candidateTimeout, result.timedOut);
+#endif
+
+    if (!pipelined) {
+      // screen the fingerprints
+#ifdef HAVE_OPENCL
+      if (m_gpu) {
+        m_gpu->screen(queryFingerprint, &candidates[0]);
+        for (std::size_t i = 0; i < filters.size(); ++i)
+          for (unsigned int j = 0; j < numWords; ++j)
+            candidates[j] &= filters[i].bitmap[j];
+      } else
+#endif
+      if (m_compressed)
+        substructure_screen(m_compressedStorage, queryFingerprint, filters, &candidates[0]);
+      else
+        substructure_screen(m_storage, queryFingerprint, filters, &candidates[0]);
+
+      // verify the candidates
+#ifdef HAVE_CPP11
+      if (mt)
+        result.hits = substructure_verify_threaded(m_molecules, query, &candidates[0], token, candidateTimeout, result.timedOut);
+      else
+#endif
+        result.hits = substructure_verify(m_molecules, query, &candidates[0], token, candidateTimeout, result.timedOut);
+    }
+    delete [] queryFingerprint;
+
+    result.screened = bitvec_count(&candidates[0], numWords);
+    result.partial = token.isCancelled();
+
+    // partial results are not cached
+    if (!key.empty() && !result.partial && result.timedOut.empty()) {
+      cached.hits = result.hits;
+      cached.screened = result.screened;
+#ifdef HAVE_CPP11
+      std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+      m_cache.insert(key, cached, cache_entry_size(key, result.hits));
+    }
+
+    return result;
+  }
+
+  std::vector<SubstructureQueries::Result> SubstructureQueries::searchHitsBatch(
+      const std::vector<std::string> &smiles, bool mt, unsigned int timeout, unsigned int candidateTimeout)
+  {
+    std::vector<Result> results(smiles.size());
+    std::vector<HeMol> queries(smiles.size());
+    std::vector<std::vector<unsigned long> > keys(smiles.size());
+
+    // parse the queries and check the cache
+    std::vector<unsigned int> todo;
+    for (std::size_t i = 0; i < smiles.size(); ++i) {
+      try {
+        parse_query(smiles[i], queries[i]);
+      } catch (const std::exception &e) {
+        results[i].error = e.what();
+        continue;
+      }
+
+      if (m_cache.capacity())
+        keys[i] = canonical_key(queries[i], cached_extended_connectivities(queries[i]));
+      if (!keys[i].empty()) {
+        CachedResult cached;
+#ifdef HAVE_CPP11
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+        if (m_cache.find(keys[i], cached)) {
+          results[i].hits = cached.hits;
+          results[i].screened = cached.screened;
+          results[i].cached = true;
+          continue;
+        }
+      }
+
+      todo.push_back(i);
+    }
+
+    // compute the query fingerprints
+    std::vector<const Word*> fingerprints;
+    std::vector<std::vector<ScreenOperand> > filters;
+    std::vector<unsigned int> screened;
+    for (std::size_t i = 0; i < todo.size(); ++i) {
+      Word *fingerprint = m_settings.compute(queries[todo[i]]);
+      if (!fingerprint) {
+        results[todo[i]].error = "Could not compute the query fingerprint";
+        continue;
+      }
+      fingerprints.push_back(fingerprint);
+      filters.push_back(m_filters.numProperties() ? m_filters.operands(queries[todo[i]]) : std::vector<ScreenOperand>());
+      screened.push_back(todo[i]);
+    }
+
+    // screen all queries at once
+    unsigned int numWords = bitvec_num_words_for_bits(numMolecules());
+    std::vector<Word> candidates(std::max(1u, numWords) * screened.size());
+    std::vector<Word*> candidatePtrs;
+    for (std::size_t i = 0; i < screened.size(); ++i)
+      candidatePtrs.push_back(&candidates[i * std::max(1u, numWords)]);
+
+    bool batch = !m_compressed;
+#ifdef HAVE_OPENCL
+    batch = batch && !m_gpu;
+#endif
+    if (batch) {
+#ifdef HAVE_CPP11
+      if (mt)
+        substructure_screen_batch_threaded(m_storage, fingerprints, filters, candidatePtrs);
+      else
+#endif
+        substructure_screen_batch(m_storage, fingerprints, filters, candidatePtrs);
+    } else {
+      // the compressed and OpenCL screens handle one query at a time
+      for (std::size_t i = 0; i < screened.size(); ++i) {
+#ifdef HAVE_OPENCL
+        if (m_gpu) {
+          m_gpu->screen(fingerprints[i], candidatePtrs[i]);
+          for (std::size_t j = 0; j < filters[i].size(); ++j)
+            for (unsigned int k = 0; k < numWords; ++k)
+              candidatePtrs[i][k] &= filters[i][j].bitmap[k];
+          continue;
+        }
+#endif
+        substructure_screen(m_compressedStorage, fingerprints[i], filters[i], candidatePtrs[i]);
+      }
+    }
+
+    for (std::size_t i = 0; i < fingerprints.size(); ++i)
+      delete [] fingerprints[i];
+
+    // verify the candidates
+    for (std::size_t i = 0; i < screened.size(); ++i) {
+      unsigned int q = screened[i];
+      Result &result = results[q];
+      CancellationToken token(timeout);
+#ifdef HAVE_CPP11
+      if (mt)
+        result.hits = substructure_verify_threaded(m_molecules, queries[q], candidatePtrs[i], token,
+            candidateTimeout, result.timedOut);
+      else
+#endif
+        result.hits = substructure_verify(m_molecules, queries[q], candidatePtrs[i], token,
+            candidateTimeout, result.timedOut);
+
+      result.screened = bitvec_count(candidatePtrs[i], numWords);
+      result.partial = token.isCancelled();
+
+      // partial results are not cached
+      if (!keys[q].empty() && !result.partial && result.timedOut.empty()) {
+        CachedResult cached;
+        cached.hits = result.hits;
+        cached.screened = result.screened;
+#ifdef HAVE_CPP11
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+        m_cache.insert(keys[q], cached, cache_entry_size(keys[q], result.hits));
+      }
+    }
+
+    return results;
+  }
+
+  Json::Value SubstructureQueries::summary(const Result &result)
+  {
+    Json::Value data;
+    data["screened"] = Json::Value(result.screened);
+    data["confirmed"] = Json::Value(static_cast<unsigned int>(result.hits.size()));
+    // NaN is not valid JSON
+    data["false_positives"] = Json::Value(result.screened ?
+        1.0 - static_cast<double>(result.hits.size()) / result.screened : 0.0);
+    data["partial"] = result.partial;
+    data["timed_out"] = Json::Value(Json::arrayValue);
+    for (std::size_t i = 0; i < result.timedOut.size(); ++i)
+      data["timed_out"][Json::ArrayIndex(i)] = result.timedOut[i];
+    data["cached"] = result.cached;
+
+    return data;
+  }
+
+  SimilarityQueries::SimilarityQueries() : m_index(0)
+  {
+  }
+
+  SimilarityQueries::~SimilarityQueries()
+  {
+    delete m_index;
+  }
+
+  void SimilarityQueries::load(const std::string &filename, int k, unsigned int numThreads)
+  {
+    delete m_index;
+    m_index = 0;
+
+    // a similarity index file (see the index-sim tool) contains the fingerprints
+    m_header = BinaryInputFile(filename).header();
+    Json::Reader reader;
+    Json::Value data;
+    if (!reader.parse(m_header, data))
+      throw std::runtime_error(reader.getFormattedErrorMessages());
+
+    if (data["filetype"].asString() == "similarity-index") {
+      m_index = new IndexType(filename);
+    } else {
+      m_storage.load(filename);
+      m_index = new IndexType(m_storage, k, numThreads);
+    }
+
+    if (!m_settings.parse(m_header))
+      throw std::runtime_error(make_string("Invalid fingerprint settings in ", filename));
+
+    // cached results are only valid for the same file
+    std::string identity = make_string(file_identity(filename), ":", k);
+#ifdef HAVE_CPP11
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+    if (identity != m_identity)
+      m_cache.clear();
+    m_identity = identity;
+  }
+
+  void SimilarityQueries::setCacheSize(std::size_t bytes)
+  {
+#ifdef HAVE_CPP11
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+    m_cache.setCapacity(bytes);
+  }
+
+  Json::Value SimilarityQueries::cacheStatistics() const
+  {
+#ifdef HAVE_CPP11
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+    return cache_statistics(m_cache);
+  }
+
+  Json::Value SimilarityQueries::search(const std::string &smiles, double Tmin, int N, unsigned int timeout) const
+  {
+    CancellationToken token(timeout);
+
+    if (!m_index)
+      throw std::runtime_error("No similarity index loaded");
+
+    HeMol mol;
+    parse_query(smiles, mol);
+
+    // the key contains the search parameters
+    std::vector<unsigned long> key;
+    if (m_cache.capacity())
+      key = canonical_key(mol, cached_extended_connectivities(mol));
+    if (!key.empty()) {
+      unsigned int bits[2];
+      std::memcpy(bits, &Tmin, sizeof(double));
+      key.push_back(bits[0]);
+      key.push_back(bits[1]);
+      key.push_back(N);
+    }
+
+    CachedResult result;
+    bool cached = false;
+    if (!key.empty()) {
+#ifdef HAVE_CPP11
+      std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+      cached = m_cache.find(key, result);
+    }
+
+    if (!cached) {
+      Word *fingerprint = m_settings.compute(mol);
+      if (!fingerprint)
+        throw std::runtime_error("Could not compute the query fingerprint");
+
+      if (N)
+        result = m_index->knnSearch(fingerprint, N, Tmin, token);
+      else
+        result = m_index->search(fingerprint, Tmin, 0, token);
+      delete [] fingerprint;
+
+      std::sort(result.begin(), result.end(), compare_first<unsigned int, double>());
+
+      // partial results are not cached
+      if (!key.empty() && !token.isCancelled()) {
+#ifdef HAVE_CPP11
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+#endif
+        m_cache.insert(key, result, cache_entry_size(key, result));
+      }
+    }
+
+    Json::Value data;
+    data["hits"] = Json::Value(Json::arrayValue);
+    for (std::size_t i = 0; i < result.size(); ++i) {
+      data["hits"][Json::ArrayIndex(i)] = Json::Value(Json::objectValue);
+      Json::Value &obj = data["hits"][Json::ArrayIndex(i)];
+      obj["index"] = result[i].first;
+      obj["tanimoto"] = result[i].second;
+    }
+    data["partial"] = token.isCancelled();
+    data["cached"] = cached;
+
+    return data;
+  }
+
+}
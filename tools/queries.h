@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_TOOLS_QUERIES_H
+#define HELIUM_TOOLS_QUERIES_H
+
+#include <Helium/fileio/fingerprints.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/fingerprints/similarity.h>
+#include <Helium/propertyfilters.h>
+#include <Helium/lrucache.h>
+
+#include "queryfingerprint.h"
+
+#include <json/json.h>
+
+#include <string>
+
+#ifdef HAVE_CPP11
+#include <mutex>
+#endif
+
+namespace Helium {
+
+#ifdef HAVE_OPENCL
+  class OpenCLSubstructureScreen;
+#endif
+
+  /**
+   * @brief Substructure searches on a resident molecule and fingerprint file.
+   *
+   * The (compressed) column-major fingerprint file is loaded and the molecule file is
+   * mapped once, any number of queries can be searched afterwards. Calling
+   * search() concurrently from multiple threads is safe unless OpenCL
+   * screening is enabled.
+   *
+   * Optionally, the results are kept in a memory bounded least recently
+   * used cache (see setCacheSize()). The results are keyed on the
+   * canonical_key() of the query so equivalent SMILES share the same
+   * result. The cache is cleared when different files are loaded.
+   */
+  class SubstructureQueries
+  {
+    public:
+      /**
+       * The result of a substructure search (see search()).
+       */
+      struct Result
+      {
+        Result() : screened(0), partial(false), cached(false)
+        {
+        }
+
+        std::vector<unsigned int> hits; //!< The molecule indices
+        unsigned int screened; //!< The number of candidates after screening
+        bool partial; //!< True if the timeout expired
+        std::vector<unsigned int> timedOut; //!< Candidates that exceeded the candidate timeout
+        bool cached; //!< True if the result was found in the cache
+        std::string error; //!< The error message for a failed query in a batch (see searchHitsBatch())
+      };
+
+      SubstructureQueries();
+      ~SubstructureQueries();
+
+      /**
+       * Load the molecule and column-major fingerprint files. The
+       * fingerprint file may also be a compressed column-major file (see
+       * the transpose tool). Errors are reported by throwing a
+       * std::runtime_error.
+       */
+      void load(const std::string &moleculeFilename, const std::string &fingerprintFilename);
+
+      /**
+       * Load a property filter index (see the filter tool). The filters are
+       * intersected with the fingerprint columns when screening. The
+       * molecule and fingerprint files must be loaded first.
+       */
+      void loadFilters(const std::string &filename);
+
+      /**
+       * Set the maximum memory used by cached results in bytes, 0 (the
+       * default) disables the cache.
+       */
+      void setCacheSize(std::size_t bytes);
+
+      /**
+       * Get the 'entries', 'size', 'capacity', 'hits' and 'misses' of the
+       * result cache.
+       */
+      Json::Value cacheStatistics() const;
+
+#ifdef HAVE_OPENCL
+      /**
+       * Screen the fingerprints on an OpenCL device, the fingerprints must
+       * be loaded first.
+       */
+      void useOpenCL(int platformId, int deviceId, const std::string &cacheDir);
+#endif
+
+      /**
+       * Get the number of molecules.
+       */
+      unsigned int numMolecules() const
+      {
+        return m_molecules.numMolecules();
+      }
+
+      /**
+       * Search a query. The result contains the 'hits' (the molecule
+       * indices), 'screened', 'confirmed' and 'false_positives' attributes.
+       * The 'partial' attribute is true if the search was stopped because
+       * the timeout expired and 'timed_out' contains the indices of the
+       * candidates that exceeded the per candidate timeout. The 'cached'
+       * attribute is true if the result was found in the cache, partial
+       * results are never cached. An invalid SMILES is reported by
+       * throwing a std::invalid_argument, other errors by throwing a
+       * std::runtime_error.
+       *
+       * @param smiles The query SMILES.
+       * @param mt Screen and verify using the global thread pool (ignored
+       *        without C++11 support).
+       * @param timeout The timeout for the query in milliseconds, 0 for none.
+       * @param candidateTimeout The timeout for verifying a single candidate
+       *        in milliseconds, 0 for none.
+       */
+      Json::Value search(const std::string &smiles, bool mt, unsigned int timeout = 0,
+          unsigned int candidateTimeout = 0);
+
+      /**
+       * Search a query without creating the JSON result. This is used to
+       * write large results incrementally (see HitWriter), the parameters
+       * are the same as for search().
+       */
+      Result searchHits(const std::string &smiles, bool mt, unsigned int timeout = 0,
+          unsigned int candidateTimeout = 0);
+
+      /**
+       * Search a batch of queries. All queries are screened in a single pass
+       * over the fingerprint columns (see substructure_screen_batch()) and
+       * the candidates are verified one query at a time. This is faster
+       * than calling searchHits() for each query when there are many
+       * queries. Invalid queries do not stop the batch, the error message
+       * is stored in the query's result instead.
+       *
+       * @param smiles The query SMILES.
+       * @param mt Screen and verify using the global thread pool (ignored
+       *        without C++11 support).
+       * @param timeout The timeout for verifying each query in
+       *        milliseconds, 0 for none.
+       * @param candidateTimeout The timeout for verifying a single candidate
+       *        in milliseconds, 0 for none.
+       */
+      std::vector<Result> searchHitsBatch(const std::vector<std::string> &smiles, bool mt,
+          unsigned int timeout = 0, unsigned int candidateTimeout = 0);
+
+      /**
+       * Get the summary attributes of a result: all attributes of the
+       * search() result except 'hits'.
+       */
+      static Json::Value summary(const Result &result);
+
+    private:
+      struct CachedResult
+      {
+        std::vector<unsigned int> hits;
+        unsigned int screened;
+      };
+
+      InMemoryColumnMajorFingerprintStorage m_storage;
+      InMemoryCompressedColumnMajorFingerprintStorage m_compressedStorage;
+      bool m_compressed; //!< True if the compressed storage is used
+      PropertyFilterIndex m_filters;
+      MemoryMappedMoleculeFile m_molecules;
+      FingerprintSettings m_settings; //!< The parsed fingerprint settings
+      std::string m_identity; //!< Identity of the loaded files
+      mutable LRUCache<std::vector<unsigned long>, CachedResult> m_cache;
+#ifdef HAVE_CPP11
+      mutable std::mutex m_cacheMutex;
+#endif
+#ifdef HAVE_OPENCL
+      OpenCLSubstructureScreen *m_gpu;
+#endif
+  };
+
+  /**
+   * @brief Similarity searches on a resident similarity search index.
+   *
+   * The index is built from a row-major fingerprint file or loaded from a
+   * similarity index file once, any number of queries can be searched
+   * afterwards. Calling search() concurrently from multiple threads is safe.
+   * The results can be cached in the same way as for SubstructureQueries,
+   * the key includes the search parameters.
+   */
+  class SimilarityQueries
+  {
+    public:
+      typedef SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> IndexType;
+
+      SimilarityQueries();
+      ~SimilarityQueries();
+
+      /**
+       * Load a fingerprint file or similarity index file (see the index-sim
+       * tool). Errors are reported by throwing a std::runtime_error.
+       *
+       * @param filename The fingerprint or similarity index file.
+       * @param k The number of bits used to split the index (ignored for
+       *        similarity index files).
+       * @param numThreads The number of threads used to build the index, 0
+       *        to use all cores.
+       */
+      void load(const std::string &filename, int k, unsigned int numThreads);
+
+      /**
+       * Set the maximum memory used by cached results in bytes, 0 (the
+       * default) disables the cache.
+       */
+      void setCacheSize(std::size_t bytes);
+
+      /**
+       * Get the 'entries', 'size', 'capacity', 'hits' and 'misses' of the
+       * result cache.
+       */
+      Json::Value cacheStatistics() const;
+
+      /**
+       * Get the number of fingerprints.
+       */
+      unsigned int numFingerprints() const
+      {
+        return m_index ? m_index->numFingerprints() : 0;
+      }
+
+      /**
+       * Search a query. The result contains the 'hits' attribute with the
+       * 'index' and 'tanimoto' attributes for each hit sorted by index.
+       * The 'partial' attribute is true if the search was stopped because
+       * the timeout expired and 'cached' is true if the result was found
+       * in the cache. An invalid SMILES is reported by throwing a
+       * std::invalid_argument, other errors by throwing a std::runtime_error.
+       *
+       * @param smiles The query SMILES.
+       * @param Tmin The minimum Tanimoto score.
+       * @param N The number of nearest neighbors, 0 for all hits above Tmin.
+       * @param timeout The timeout for the query in milliseconds, 0 for none.
+       */
+      Json::Value search(const std::string &smiles, double Tmin, int N, unsigned int timeout = 0) const;
+
+    private:
+      SimilarityQueries(const SimilarityQueries&);
+      SimilarityQueries& operator=(const SimilarityQueries&);
+
+      typedef std::vector<std::pair<unsigned int, double> > CachedResult;
+
+      InMemoryRowMajorFingerprintStorage m_storage;
+      IndexType *m_index;
+      std::string m_header; //!< The fingerprint settings
+      FingerprintSettings m_settings; //!< The parsed fingerprint settings
+      std::string m_identity; //!< Identity of the loaded file
+      mutable LRUCache<std::vector<unsigned long>, CachedResult> m_cache;
+#ifdef HAVE_CPP11
+      mutable std::mutex m_cacheMutex;
+#endif
+  };
+
+}
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HELIUM_TOOLS_QUERYFINGERPRINT_H
+#define HELIUM_TOOLS_QUERYFINGERPRINT_H
+
+#include <Helium/fingerprints/fingerprints.h>
+#include <Helium/bitvec.h>
+
+#include <json/json.h>
+
+#include <iostream>
+#include <string>
+
+namespace Helium {
+
+  /**
+   * @brief Fingerprint settings from the JSON header of a fingerprint file.
+   *
+   * The header is parsed once, the fingerprint for any number of query
+   * molecules can be computed afterwards.
+   */
+  class FingerprintSettings
+  {
+    public:
+      FingerprintSettings() : m_words(0), m_k(0), m_prime(0)
+      {
+      }
+
+      /**
+       * Parse the fingerprint settings.
+       *
+       * @param settings The JSON header of the fingerprint file.
+       *
+       * @return True if successful.
+       */
+      bool parse(const std::string &settings)
+      {
+        Json::Reader reader;
+        Json::Value data;
+
+        if (!reader.parse(settings, data)) {
+          std::cerr << reader.getFormattedErrorMessages() << std::endl;
+          return false;
+        }
+
+        m_words = bitvec_num_words_for_bits(data["num_bits"].asInt());
+        m_k = data["fingerprint"]["k"].asInt();
+        m_prime = data["fingerprint"]["prime"].asInt();
+        m_type = data["fingerprint"]["type"].asString();
+
+        return true;
+      }
+
+      /**
+       * Check if the fingerprints can be used to screen substructure
+       * searches. The fingerprints of the paths, trees and subgraphs in a
+       * query are also found in every molecule containing the query. This
+       * is not the case for circular fingerprints since the atom
+       * environments include the degree and the neighbors of the atoms.
+       */
+      bool isSubstructureFingerprint() const
+      {
+        return m_type == "Helium::paths_fingerprint" || m_type == "Helium::rolling_paths_fingerprint" ||
+            m_type == "Helium::trees_fingerprint" || m_type == "Helium::subgraph_fingerprint";
+      }
+
+      /**
+       * Get the fingerprint type (e.g. "Helium::paths_fingerprint").
+       */
+      const std::string& type() const
+      {
+        return m_type;
+      }
+
+      /**
+       * Compute the fingerprint for a query molecule.
+       *
+       * @param mol The query molecule.
+       *
+       * @return The fingerprint (to be deleted by the caller) or 0 if the
+       *         settings are invalid.
+       */
+      template<typename MoleculeType>
+      Word* compute(MoleculeType &mol) const
+      {
+        Word *fingerprint = new Word[m_words];
+
+        if (m_type == "Helium::paths_fingerprint") {
+          path_fingerprint(mol, fingerprint, m_k, m_words, m_prime);
+          return fingerprint;
+        }
+
+        if (m_type == "Helium::rolling_paths_fingerprint") {
+          rolling_path_fingerprint(mol, fingerprint, m_k, m_words, m_prime);
+          return fingerprint;
+        }
+
+        if (m_type == "Helium::trees_fingerprint") {
+          tree_fingerprint(mol, fingerprint, m_k, m_words, m_prime);
+          return fingerprint;
+        }
+
+        if (m_type == "Helium::subgraph_fingerprint") {
+          subgraph_fingerprint(mol, fingerprint, m_k, m_words, m_prime);
+          return fingerprint;
+        }
+
+        if (m_type == "Helium::circular_fingerprint") {
+          circular_fingerprint(mol, fingerprint, m_k, m_words, m_prime);
+          return fingerprint;
+        }
+
+        std::cerr << "Fingerprint type \"" << m_type << "\" not recognised" << std::endl;
+
+        delete [] fingerprint;
+        return 0;
+      }
+
+    private:
+      int m_words;
+      int m_k;
+      int m_prime;
+      std::string m_type;
+  };
+
+  /**
+   * Compute the fingerprint for a query molecule using the fingerprint
+   * settings from the JSON header of a fingerprint file.
+   *
+   * @param settings The JSON header of the fingerprint file.
+   * @param mol The query molecule.
+   *
+   * @return The fingerprint (to be deleted by the caller) or 0 if the
+   *         settings are invalid.
+   */
+  template<typename MoleculeType>
+  Word* compute_fingerprint(const std::string &settings, MoleculeType &mol)
+  {
+    FingerprintSettings parsed;
+    if (!parsed.parse(settings))
+      return 0;
+    return parsed.compute(mol);
+  }
+
+}
+
+#endif
@@ -0,0 +1,484 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "tool.h"
+
+#include <Helium/hemol.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/fileio/fingerprints.h>
+#include <Helium/fingerprints/cluster.h>
+#include <Helium/algorithms/canonical.h>
+#include <Helium/algorithms/cachedproperties.h>
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+#include "args.h"
+
+namespace Helium {
+
+  /**
+   * Tool for reordering a library to improve the locality of searches.
+   *
+   * The molecules are sorted by a key so similar molecules are stored next
+   * to each other. The candidates of a substructure screen and the hits of
+   * a similarity search are then clustered in fewer pages of the molecule
+   * file and fewer cache lines of the fingerprint files. The molecule file
+   * and any row-major and column-major fingerprint files are permuted in
+   * the same way and the permutation is written to a JSON file to map the
+   * new indices back to the original ones.
+   */
+  class ReorderTool : public HeliumTool
+  {
+    public:
+      /**
+       * Hash a canonical key (see canonical_key()).
+       */
+      static uint64_t hash_key(const std::vector<unsigned long> &key)
+      {
+        uint64_t h = 0x9e3779b97f4a7c15ULL ^ key.size();
+        for (std::size_t i = 0; i < key.size(); ++i) {
+          h ^= key[i];
+          h *= 0xbf58476d1ce4e5b9ULL;
+          h ^= h >> 31;
+        }
+        return h;
+      }
+
+      /**
+       * Compute the Murcko framework of a molecule: the ring systems and the
+       * linkers between them. The side chains are removed by repeatedly
+       * removing atoms with at most one remaining neighbor. The element and
+       * aromaticity of the atoms and the order and aromaticity of the bonds
+       * are copied.
+       */
+      static void murcko_framework(HeMol &mol, HeMol &framework)
+      {
+        std::vector<int> degrees(num_atoms(mol));
+        std::vector<bool> removed(num_atoms(mol));
+        std::vector<Index> queue;
+        FOREACH_ATOM (atom, mol, HeMol) {
+          degrees[get_index(mol, *atom)] = get_degree(mol, *atom);
+          if (degrees[get_index(mol, *atom)] <= 1)
+            queue.push_back(get_index(mol, *atom));
+        }
+
+        while (!queue.empty()) {
+          Index index = queue.back();
+          queue.pop_back();
+          if (removed[index])
+            continue;
+          removed[index] = true;
+          FOREACH_NBR (nbr, get_atom(mol, index), mol, HeMol)
+            if (!removed[get_index(mol, *nbr)] && --degrees[get_index(mol, *nbr)] <= 1)
+              queue.push_back(get_index(mol, *nbr));
+        }
+
+        framework.clear();
+        std::vector<Index> indices(num_atoms(mol));
+        FOREACH_ATOM (kept, mol, HeMol) {
+          if (removed[get_index(mol, *kept)])
+            continue;
+          indices[get_index(mol, *kept)] = num_atoms(framework);
+          molecule_traits<HeMol>::atom_type copy = framework.addAtom();
+          copy.setElement(get_element(mol, *kept));
+          copy.setAromatic(is_aromatic(mol, *kept));
+        }
+        FOREACH_BOND (bond, mol, HeMol) {
+          Index source = get_index(mol, get_source(mol, *bond));
+          Index target = get_index(mol, get_target(mol, *bond));
+          if (removed[source] || removed[target])
+            continue;
+          molecule_traits<HeMol>::bond_type copy = framework.addBond(get_atom(framework, indices[source]),
+              get_atom(framework, indices[target]));
+          copy.setOrder(get_order(mol, *bond));
+          copy.setAromatic(is_aromatic(mol, *bond));
+        }
+      }
+
+      /**
+       * Order the molecules by number of atoms.
+       */
+      static std::vector<unsigned int> atoms_order(MemoryMappedMoleculeFile &file)
+      {
+        std::vector<std::pair<unsigned int, unsigned int> > keys;
+        MoleculeView mol;
+        for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+          file.read_molecule(i, mol);
+          keys.push_back(std::make_pair(num_atoms(mol), i));
+        }
+        return sorted_order(keys);
+      }
+
+      /**
+       * Order the molecules by Murcko framework. Molecules with the same
+       * framework are grouped and ordered by number of atoms, the groups are
+       * ordered by framework size. Molecules without a (connected)
+       * framework are placed last.
+       */
+      static std::vector<unsigned int> scaffold_order(MemoryMappedMoleculeFile &file)
+      {
+        std::vector<std::pair<std::pair<unsigned int, uint64_t>, std::pair<unsigned int, unsigned int> > > keys;
+        HeMol mol, framework;
+        for (unsigned int i = 0; i < file.numMolecules(); ++i) {
+          file.read_molecule(i, mol);
+          murcko_framework(mol, framework);
+          std::vector<unsigned long> key = canonical_key(framework, cached_extended_connectivities(framework));
+          unsigned int size = key.empty() ? std::numeric_limits<unsigned int>::max() : num_atoms(framework);
+          keys.push_back(std::make_pair(std::make_pair(size, key.empty() ? 0 : hash_key(key)),
+                std::make_pair(num_atoms(mol), i)));
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<unsigned int> order;
+        for (std::size_t i = 0; i < keys.size(); ++i)
+          order.push_back(keys[i].second.second);
+        return order;
+      }
+
+      /**
+       * Order the molecules by the population count of their fingerprints.
+       */
+      static std::vector<unsigned int> popcount_order(const std::vector<unsigned int> &counts)
+      {
+        std::vector<std::pair<unsigned int, unsigned int> > keys;
+        for (unsigned int i = 0; i < counts.size(); ++i)
+          keys.push_back(std::make_pair(counts[i], i));
+        return sorted_order(keys);
+      }
+
+      /**
+       * Order the molecules by cluster (see butina_clustering()). The
+       * clusters are placed in the order they are found (i.e. the largest
+       * clusters first) with the centroid first.
+       */
+      static std::vector<unsigned int> cluster_order(const InMemoryRowMajorFingerprintStorage &storage,
+          double Tmin, int k, unsigned int numThreads)
+      {
+        std::vector<std::vector<unsigned int> > clusters = butina_clustering(storage, Tmin, k, numThreads);
+        std::vector<unsigned int> order;
+        std::vector<bool> placed(storage.numFingerprints());
+        for (std::size_t i = 0; i < clusters.size(); ++i)
+          for (std::size_t j = 0; j < clusters[i].size(); ++j)
+            if (!placed[clusters[i][j]]) {
+              placed[clusters[i][j]] = true;
+              order.push_back(clusters[i][j]);
+            }
+        for (unsigned int i = 0; i < placed.size(); ++i)
+          if (!placed[i])
+            order.push_back(i);
+        return order;
+      }
+
+      /**
+       * Get the indices of a sorted list of (key, index) pairs.
+       */
+      static std::vector<unsigned int> sorted_order(std::vector<std::pair<unsigned int, unsigned int> > &keys)
+      {
+        std::sort(keys.begin(), keys.end());
+        std::vector<unsigned int> order;
+        for (std::size_t i = 0; i < keys.size(); ++i)
+          order.push_back(keys[i].second);
+        return order;
+      }
+
+      /**
+       * Write the molecule records in the new order. The output file is not
+       * compressed (see the compress tool).
+       */
+      static void write_molecules(MemoryMappedMoleculeFile &file, const std::vector<unsigned int> &order,
+          const std::string &filename)
+      {
+        BinaryOutputFile out(filename);
+        std::vector<uint64_t> positions;
+        MoleculeView mol;
+        for (std::size_t i = 0; i < order.size(); ++i) {
+          file.read_molecule(order[i], mol);
+          positions.push_back(out.stream().tellp());
+          out.write(mol.data(), MoleculeView::record_size(mol.data()));
+        }
+
+        // create JSON header
+        Json::Value data;
+        data["filetype"] = "molecules";
+        data["num_molecules"] = static_cast<unsigned int>(positions.size());
+
+        // write the molecule positions to the file
+        impl::write_molecule_indexes(out, positions, 1, data);
+
+        // write JSON header
+        Json::StyledWriter writer;
+        if (!out.writeHeader(writer.write(data)))
+          throw std::runtime_error(make_string("Could not write file ", filename));
+      }
+
+      /**
+       * Parse the JSON header of a fingerprint file, the statistics are
+       * removed if @p removeStatistics is true.
+       */
+      static Json::Value fingerprint_header(const std::string &header, bool removeStatistics = true)
+      {
+        Json::Reader reader;
+        Json::Value data;
+        if (!reader.parse(header, data))
+          throw std::runtime_error(reader.getFormattedErrorMessages());
+        if (removeStatistics)
+          remove_fingerprint_statistics(data);
+        return data;
+      }
+
+      /**
+       * Write a row-major fingerprint file in the new order, the statistics
+       * are computed again.
+       */
+      static void write_row_major(const InMemoryRowMajorFingerprintStorage &storage,
+          const std::vector<unsigned int> &order, const std::string &filename)
+      {
+        Json::Value data = fingerprint_header(storage.header(), false);
+        // the part counts are computed again for the same number of parts
+        unsigned int numParts = data.isMember("part_counts") ? data["part_counts"]["k"].asUInt() : 0;
+        remove_fingerprint_statistics(data);
+        RowMajorFingerprintOutputFile out(filename, storage.numBits(), true, numParts);
+        for (std::size_t i = 0; i < order.size(); ++i)
+          if (!out.writeFingerprint(storage.fingerprint(order[i])))
+            throw std::runtime_error(make_string("Could not write file ", filename));
+        Json::StyledWriter writer;
+        if (!out.writeStatistics(data) || !out.writeHeader(writer.write(data)))
+          throw std::runtime_error(make_string("Could not write file ", filename));
+      }
+
+      /**
+       * Write a column-major fingerprint file in the new order. The columns
+       * are transposed to row-major order in memory first.
+       */
+      static void write_column_major(const InMemoryColumnMajorFingerprintStorage &storage,
+          const std::vector<unsigned int> &order, const std::string &filename)
+      {
+        unsigned int numWords = bitvec_num_words_for_bits(storage.numBits());
+        std::vector<Word> fingerprints(static_cast<std::size_t>(storage.numFingerprints()) * numWords);
+        unsigned int columnWords = bitvec_num_words_for_bits(storage.numFingerprints());
+        for (unsigned int bit = 0; bit < storage.numBits(); ++bit) {
+          const Word *column = storage.bit(bit);
+          for (unsigned int i = 0; i < columnWords; ++i)
+            for (Word word = column[i]; word; word &= word - 1)
+              bitvec_set(bit, &fingerprints[(static_cast<std::size_t>(i) * BitsPerWord +
+                    __builtin_ctzll(word)) * numWords]);
+        }
+
+        Json::Value data = fingerprint_header(storage.header());
+        ColumnMajorFingerprintOutputFile out(filename, storage.numBits(), storage.numFingerprints());
+        for (std::size_t i = 0; i < order.size(); ++i)
+          out.writeFingerprint(&fingerprints[static_cast<std::size_t>(order[i]) * numWords]);
+
+        // store the column counts for ordering the screen by selectivity
+        Json::Value counts(Json::arrayValue);
+        for (unsigned int i = 0; i < storage.numBits(); ++i)
+          counts.append(out.columnCounts()[i]);
+        data["column_counts"] = counts;
+
+        Json::StyledWriter writer;
+        if (!out.writeHeader(writer.write(data)))
+          throw std::runtime_error(make_string("Could not write file ", filename));
+      }
+
+      /**
+       * Write the permutation: the original index for each new index.
+       */
+      static void write_permutation(const std::vector<unsigned int> &order, const std::string &key,
+          const std::string &filename)
+      {
+        Json::Value data;
+        data["filetype"] = "permutation";
+        data["order"] = key;
+        data["num_molecules"] = static_cast<unsigned int>(order.size());
+        data["original_indices"] = Json::Value(Json::arrayValue);
+        for (std::size_t i = 0; i < order.size(); ++i)
+          data["original_indices"][Json::ArrayIndex(i)] = order[i];
+
+        std::ofstream ofs(filename.c_str());
+        Json::FastWriter writer;
+        if (!(ofs << writer.write(data)))
+          throw std::runtime_error(make_string("Could not write file ", filename));
+      }
+
+      /**
+       * Perform tool action.
+       */
+      int run(int argc, char **argv)
+      {
+        ParseArgs args(argc, argv, ParseArgs::Args("-order(key)", "-row_major(in_file,out_file)",
+              "-column_major(in_file,out_file)", "-Tmin(number)", "-k(number)"
+#ifdef HAVE_CPP11
+              , "-mt"
+#endif
+              ), ParseArgs::Args("molecule_file", "out_molecule_file", "permutation_file"));
+        // optional arguments
+        const std::string key = args.IsArg("-order") ? args.GetArgString("-order", 0) : "atoms";
+        const bool rowMajor = args.IsArg("-row_major");
+        const bool columnMajor = args.IsArg("-column_major");
+        const double Tmin = args.IsArg("-Tmin") ? args.GetArgDouble("-Tmin", 0) - 10e-5 : 0.7 - 10e-5;
+        const int k = args.IsArg("-k") ? args.GetArgInt("-k", 0) : 3;
+        unsigned int numThreads = 1;
+#ifdef HAVE_CPP11
+        if (args.IsArg("-mt"))
+          numThreads = 0;
+#endif
+        // required arguments
+        std::string moleculeFilename = args.GetArgString("molecule_file");
+        std::string outMoleculeFilename = args.GetArgString("out_molecule_file");
+        std::string permutationFilename = args.GetArgString("permutation_file");
+
+        if (key != "atoms" && key != "popcount" && key != "scaffold" && key != "cluster") {
+          std::cerr << "Invalid order, must be 'atoms', 'popcount', 'scaffold' or 'cluster'" << std::endl;
+          return -1;
+        }
+        if (key == "cluster" && !rowMajor) {
+          std::cerr << "Ordering by cluster requires a row-major fingerprint file (-row_major)" << std::endl;
+          return -1;
+        }
+        if (key == "popcount" && !rowMajor && !columnMajor) {
+          std::cerr << "Ordering by popcount requires a fingerprint file (-row_major or -column_major)" << std::endl;
+          return -1;
+        }
+        if (k < 1) {
+          std::cerr << "The dimension of the kD-grid must be at least 1" << std::endl;
+          return -1;
+        }
+
+        try {
+          //
+          // load the input files
+          //
+          MemoryMappedMoleculeFile molecules(moleculeFilename);
+          unsigned int numMolecules = molecules.numMolecules();
+
+          InMemoryRowMajorFingerprintStorage rowStorage;
+          if (rowMajor) {
+            rowStorage.load(args.GetArgString("-row_major", 0));
+            if (rowStorage.numFingerprints() != numMolecules)
+              throw std::runtime_error(make_string("The number of fingerprints in ", args.GetArgString("-row_major", 0),
+                    " does not match the number of molecules in ", moleculeFilename));
+          }
+          InMemoryColumnMajorFingerprintStorage columnStorage;
+          if (columnMajor) {
+            columnStorage.load(args.GetArgString("-column_major", 0));
+            if (columnStorage.numFingerprints() != numMolecules)
+              throw std::runtime_error(make_string("The number of fingerprints in ", args.GetArgString("-column_major", 0),
+                    " does not match the number of molecules in ", moleculeFilename));
+          }
+
+          //
+          // compute the new order
+          //
+          std::vector<unsigned int> order;
+          if (key == "atoms")
+            order = atoms_order(molecules);
+          else if (key == "scaffold")
+            order = scaffold_order(molecules);
+          else if (key == "cluster")
+            order = cluster_order(rowStorage, Tmin, k, numThreads);
+          else {
+            std::vector<unsigned int> counts(numMolecules, 0);
+            if (rowMajor)
+              for (unsigned int i = 0; i < numMolecules; ++i)
+                counts[i] = rowStorage.bitCount(i);
+            else
+              for (unsigned int bit = 0; bit < columnStorage.numBits(); ++bit) {
+                const Word *column = columnStorage.bit(bit);
+                for (unsigned int i = 0; i < bitvec_num_words_for_bits(numMolecules); ++i)
+                  for (Word word = column[i]; word; word &= word - 1)
+                    ++counts[i * BitsPerWord + __builtin_ctzll(word)];
+              }
+            order = popcount_order(counts);
+          }
+
+          //
+          // write the permuted files
+          //
+          write_molecules(molecules, order, outMoleculeFilename);
+          if (rowMajor)
+            write_row_major(rowStorage, order, args.GetArgString("-row_major", 1));
+          if (columnMajor)
+            write_column_major(columnStorage, order, args.GetArgString("-column_major", 1));
+          write_permutation(order, key, permutationFilename);
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+
+        return 0;
+      }
+
+  };
+
+  class ReorderToolFactory : public HeliumToolFactory
+  {
+    public:
+      HELIUM_TOOL("reorder", "Reorder molecule and fingerprint files to improve locality", 3, ReorderTool);
+
+      /**
+       * Get usage information.
+       */
+      std::string usage(const std::string &command) const
+      {
+        std::stringstream ss;
+        ss << "Usage: " << command << " [options] <molecule_file> <out_molecule_file> <permutation_file>" << std::endl;
+        ss << std::endl;
+        ss << "Reorder the molecules in a molecule file so similar molecules are stored next to each" << std::endl;
+        ss << "other. The candidates of substructure searches and the hits of similarity searches are" << std::endl;
+        ss << "then stored in fewer pages which reduces the number of random reads. The fingerprint" << std::endl;
+        ss << "files for the molecule file can be reordered in the same way. The permutation file is a" << std::endl;
+        ss << "JSON file whose 'original_indices' attribute contains the original index for each new" << std::endl;
+        ss << "index so the hits can be mapped back to the original molecules." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -order <key>  The order of the molecules (default is atoms):" << std::endl;
+        ss << "                      atoms     The number of atoms" << std::endl;
+        ss << "                      popcount  The fingerprint population count (requires a fingerprint file)" << std::endl;
+        ss << "                      scaffold  The Murcko framework, ordered by framework size" << std::endl;
+        ss << "                      cluster   The Taylor-Butina clusters (requires -row_major)" << std::endl;
+        ss << "    -row_major <in_file> <out_file>" << std::endl;
+        ss << "                  Also reorder a row-major fingerprint file" << std::endl;
+        ss << "    -column_major <in_file> <out_file>" << std::endl;
+        ss << "                  Also reorder a (uncompressed) column-major fingerprint file" << std::endl;
+        ss << "    -Tmin <n>     The minimum tanimoto score for cluster neighbors (default is 0.7)" << std::endl;
+        ss << "    -k <n>        Specify the dimension for the kD-grid used for clustering (default is 3)" << std::endl;
+#ifdef HAVE_CPP11
+        ss << "    -mt           Find the cluster neighbors using multiple threads (default is not to use threads)" << std::endl;
+#endif
+        ss << std::endl;
+        ss << "The molecule file is written uncompressed (see the compress tool)." << std::endl;
+        ss << std::endl;
+        return ss.str();
+      }
+  };
+
+  ReorderToolFactory theReorderToolFactory;
+
+}
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "tool.h"
+#include "queries.h"
+
+#ifdef HAVE_CPP11
+#include <Helium/threadpool.h>
+#endif
+
+#include <json/json.h>
+
+#include "args.h"
+
+namespace Helium {
+
+  /**
+   * Handle JSON-RPC 2.0 requests using the resident data.
+   */
+  class QueryServer
+  {
+    public:
+      QueryServer(SubstructureQueries *substructure, const SimilarityQueries *similarity)
+        : m_substructure(substructure), m_similarity(similarity)
+      {
+      }
+
+      /**
+       * Handle a request (or batch of requests) and get the response. The
+       * response is empty if the request only contains notifications.
+       */
+      std::string handle(const std::string &request)
+      {
+        Json::Reader reader;
+        Json::Value data;
+        if (!reader.parse(request, data))
+          return write(error(Json::Value(), -32700, "Parse error"));
+
+        if (!data.isArray())
+          return write(handleRequest(data));
+
+        if (!data.size())
+          return write(error(Json::Value(), -32600, "Invalid Request"));
+
+        Json::Value responses(Json::arrayValue);
+        for (Json::ArrayIndex i = 0; i < data.size(); ++i) {
+          Json::Value response = handleRequest(data[i]);
+          if (!response.isNull())
+            responses.append(response);
+        }
+
+        return responses.size() ? write(responses) : std::string();
+      }
+
+    private:
+      std::string write(const Json::Value &response) const
+      {
+        if (response.isNull())
+          return std::string();
+        Json::FastWriter writer;
+        return writer.write(response);
+      }
+
+      Json::Value error(const Json::Value &id, int code, const std::string &message) const
+      {
+        Json::Value response;
+        response["jsonrpc"] = "2.0";
+        response["error"]["code"] = code;
+        response["error"]["message"] = message;
+        response["id"] = id;
+        return response;
+      }
+
+      Json::Value handleRequest(const Json::Value &request)
+      {
+        if (!request.isObject() || !request.isMember("method") || !request["method"].isString())
+          return error(Json::Value(), -32600, "Invalid Request");
+
+        // requests without id are notifications and get no response
+        const bool notification = !request.isMember("id");
+        const Json::Value id = request.get("id", Json::Value());
+        const std::string method = request["method"].asString();
+        const Json::Value params = request.get("params", Json::Value(Json::objectValue));
+
+        Json::Value response;
+        response["jsonrpc"] = "2.0";
+        try {
+          if (!params.isObject())
+            response = error(id, -32602, "Invalid params: params must be an object");
+          else if (method == "substructure")
+            response["result"] = substructure(params);
+          else if (method == "similarity")
+            response["result"] = similarity(params);
+          else if (method == "info")
+            response["result"] = info();
+          else
+            response = error(id, -32601, "Method not found");
+        } catch (const std::invalid_argument &e) {
+          response = error(id, -32602, make_string("Invalid params: ", e.what()));
+        } catch (const std::exception &e) {
+          response = error(id, -32603, e.what());
+        }
+        response["id"] = id;
+
+        return notification ? Json::Value() : response;
+      }
+
+      std::string query(const Json::Value &params) const
+      {
+        if (!params.isMember("query") || !params["query"].isString())
+          throw std::invalid_argument("'query' must be a SMILES string");
+        return params["query"].asString();
+      }
+
+      unsigned int timeout(const Json::Value &params, const char *name) const
+      {
+        const Json::Value value = params.get(name, 0);
+        if (!value.isIntegral() || value.asInt() < 0)
+          throw std::invalid_argument(make_string("'", name, "' must be a non-negative integer"));
+        return value.asUInt();
+      }
+
+      Json::Value substructure(const Json::Value &params)
+      {
+        if (!m_substructure)
+          throw std::runtime_error("The server was started without substructure data");
+        return m_substructure->search(query(params), false, timeout(params, "timeout"),
+            timeout(params, "candidate_timeout"));
+      }
+
+      Json::Value similarity(const Json::Value &params)
+      {
+        if (!m_similarity)
+          throw std::runtime_error("The server was started without similarity data");
+        if (!params.get("Tmin", 0.7).isNumeric() || !params.get("N", 0).isIntegral())
+          throw std::invalid_argument("'Tmin' must be a number and 'N' an integer");
+        double Tmin = params.get("Tmin", 0.7).asDouble() - 10e-5;
+        int N = params.get("N", 0).asInt();
+        if (N < 0)
+          throw std::invalid_argument("'N' must not be negative");
+        return m_similarity->search(query(params), Tmin, N, timeout(params, "timeout"));
+      }
+
+      Json::Value info() const
+      {
+        Json::Value data(Json::objectValue);
+        if (m_substructure) {
+          data["substructure"]["num_molecules"] = m_substructure->numMolecules();
+          data["substructure"]["cache"] = m_substructure->cacheStatistics();
+        }
+        if (m_similarity) {
+          data["similarity"]["num_fingerprints"] = m_similarity->numFingerprints();
+          data["similarity"]["cache"] = m_similarity->cacheStatistics();
+        }
+        return data;
+      }
+
+      SubstructureQueries *m_substructure;
+      const SimilarityQueries *m_similarity;
+  };
+
+  class ServerTool : public HeliumTool
+  {
+    public:
+      /**
+       * Perform tool action.
+       */
+      int run(int argc, char **argv)
+      {
+        ParseArgs args(argc, argv, ParseArgs::Args("-substructure(molecule_file,fingerprint_file)",
+              "-filter(filter_file)", "-similarity(fingerprint_file)", "-k(number)", "-cache(megabytes)"
+#ifdef HAVE_CPP11
+              , "-mt"
+#endif
+              ), ParseArgs::Args());
+        const int k = args.IsArg("-k") ? args.GetArgInt("-k", 0) : 3;
+        const std::size_t cacheSize = args.IsArg("-cache") ? args.GetArgInt("-cache", 0) : 0;
+#ifdef HAVE_CPP11
+        const bool mt = args.IsArg("-mt");
+#else
+        const bool mt = false;
+#endif
+
+        if (!args.IsArg("-substructure") && !args.IsArg("-similarity")) {
+          std::cerr << "At least one of the options -substructure and -similarity is required." << std::endl;
+          return -1;
+        }
+
+        // load all data before answering requests
+        SubstructureQueries substructure;
+        SimilarityQueries similarity;
+        try {
+          if (args.IsArg("-substructure"))
+            substructure.load(args.GetArgString("-substructure", 0), args.GetArgString("-substructure", 1));
+          if (args.IsArg("-substructure") && args.IsArg("-filter"))
+            substructure.loadFilters(args.GetArgString("-filter", 0));
+          if (args.IsArg("-similarity"))
+            similarity.load(args.GetArgString("-similarity", 0), k, mt ? 0 : 1);
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+        substructure.setCacheSize(cacheSize << 20);
+        similarity.setCacheSize(cacheSize << 20);
+
+        QueryServer server(args.IsArg("-substructure") ? &substructure : 0,
+            args.IsArg("-similarity") ? &similarity : 0);
+
+#ifdef HAVE_CPP11
+        if (mt) {
+          // handle requests concurrently, the responses are written in completion order
+          ThreadPool &pool = ThreadPool::global();
+          ThreadPool::TaskGroup group;
+          std::mutex mutex;
+          std::string line;
+          while (std::getline(std::cin, line)) {
+            if (line.empty())
+              continue;
+            pool.submit(group, [&server, &mutex, line] {
+              std::string response = server.handle(line);
+              if (response.empty())
+                return;
+              std::lock_guard<std::mutex> lock(mutex);
+              std::cout << response;
+              std::cout.flush();
+            });
+          }
+          pool.wait(group);
+          return 0;
+        }
+#endif
+
+        std::string line;
+        while (std::getline(std::cin, line)) {
+          if (line.empty())
+            continue;
+          std::cout << server.handle(line);
+          std::cout.flush();
+        }
+
+        return 0;
+      }
+
+  };
+
+  class ServerToolFactory : public HeliumToolFactory
+  {
+    public:
+      HELIUM_TOOL("server", "Answer substructure and similarity queries using resident data", 0, ServerTool);
+
+      /**
+       * Get usage information.
+       */
+      std::string usage(const std::string &command) const
+      {
+        std::stringstream ss;
+        ss << "Usage: " << command << " [options]" << std::endl;
+        ss << std::endl;
+        ss << "Load the molecule, fingerprint and similarity index files once and answer JSON-RPC 2.0" << std::endl;
+        ss << "requests. Each line on standard input is a request (or batch of requests) and the" << std::endl;
+        ss << "responses are written to standard output as a single line each. The server can be exposed" << std::endl;
+        ss << "on a socket using tools such as socat or inetd." << std::endl;
+        ss << std::endl;
+        ss << "Methods:" << std::endl;
+        ss << "    substructure  params: { \"query\": <smiles>, \"timeout\": <ms>, \"candidate_timeout\": <ms> }" << std::endl;
+        ss << "    similarity    params: { \"query\": <smiles>, \"Tmin\": <number>, \"N\": <n>, \"timeout\": <ms> }" << std::endl;
+        ss << "    info          params: none" << std::endl;
+        ss << std::endl;
+        ss << "The timeouts are optional (default is no timeout), results of searches that were stopped" << std::endl;
+        ss << "are marked as partial." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -substructure <molecule_file> <fingerprint_file>" << std::endl;
+        ss << "                  Load the files for substructure searches, the fingerprint file must" << std::endl;
+        ss << "                  store the fingerprints in column-major order" << std::endl;
+        ss << "    -filter <filter_file>" << std::endl;
+        ss << "                  Also screen substructure queries using the property filters created by" << std::endl;
+        ss << "                  the filter tool" << std::endl;
+        ss << "    -similarity <fingerprint_file>" << std::endl;
+        ss << "                  Load a row-major fingerprint file or similarity index file for similarity" << std::endl;
+        ss << "                  searches" << std::endl;
+        ss << "    -k <n>        The number of bits used to split the similarity index (default is 3)" << std::endl;
+        ss << "    -cache <megabytes>" << std::endl;
+        ss << "                  Cache the results of up to this amount of memory for each search type," << std::endl;
+        ss << "                  equivalent queries (e.g. different SMILES for the same molecule) share" << std::endl;
+        ss << "                  results (default is no cache)" << std::endl;
+#ifdef HAVE_CPP11
+        ss << "    -mt           Handle requests concurrently using multiple threads, the responses are" << std::endl;
+        ss << "                  written in completion order (default is to handle requests in order)" << std::endl;
+#endif
+        ss << std::endl;
+        return ss.str();
+      }
+  };
+
+  ServerToolFactory theServerToolFactory;
+
+}
@@ -27,63 +27,32 @@
 #include "tool.h"
 
 #include <Helium/fingerprints/similarity.h>
+#include <Helium/fingerprints/foldedsearch.h>
+#include <Helium/fingerprints/lsh.h>
+#include <Helium/fingerprints/shards.h>
 #include <Helium/fileio/fingerprints.h>
 #include <Helium/fileio/fps.h>
 #include <Helium/smiles.h>
+#include <Helium/instrumentation.h>
 
 #ifdef HAVE_CPP11
 #include <Helium/concurrent.h>
 #endif
 
+#ifdef HAVE_OPENCL
+#include "openclsimilarity.h"
+#endif
+
 #include <json/json.h>
 
+#include <cstdlib>
+
 #include "args.h"
+#include "queryfingerprint.h"
+#include "hitwriter.h"
 
 namespace Helium {
 
-  Word* compute_fingerprint(const std::string &settings, const std::string &smiles)
-  {
-    Json::Reader reader;
-    Json::Value data;
-
-    if (!reader.parse(settings, data)) {
-      std::cerr << reader.getFormattedErrorMessages() << std::endl;
-      return 0;
-    }
-
-    HeMol mol;
-    parse_smiles(smiles, mol);
-
-    int bits = data["num_bits"].asInt();
-    int words = bitvec_num_words_for_bits(bits);
-    int k = data["fingerprint"]["k"].asInt();
-    int prime = data["fingerprint"]["prime"].asInt();
-    std::string type = data["fingerprint"]["type"].asString();
-
-    Word *fingerprint = new Word[words];
-
-    if (type == "Helium::paths_fingerprint") {
-      path_fingerprint(mol, fingerprint, k, words, prime);
-      return fingerprint;
-    }
-
-    if (type == "Helium::trees_fingerprint") {
-      tree_fingerprint(mol, fingerprint, k, words, prime);
-      return fingerprint;
-    }
-
-    if (type == "Helium::subgraph_fingerprint") {
-      subgraph_fingerprint(mol, fingerprint, k, words, prime);
-      return fingerprint;
-    }
-
-    std::cerr << "Fingerprint type \"" << type << "\" not recognised" << std::endl;
-
-    delete [] fingerprint;
-    return 0;
-  }
-
-
   bool is_fps_file(const std::string &filename)
   {
     std::ifstream ifs(filename.c_str());
@@ -94,6 +63,20 @@ namespace Helium {
     return line == "#FPS1";
   }
 
+  bool is_similarity_index_file(const std::string &filename)
+  {
+    try {
+      BinaryInputFile file(filename);
+      Json::Reader reader;
+      Json::Value data;
+      if (!reader.parse(file.header(), data))
+        return false;
+      return data.isObject() && data["filetype"].asString() == "similarity-index";
+    } catch (const std::exception &e) {
+      return false;
+    }
+  }
+
   bool load_queries(const std::string &query, const std::string &storage_header, std::vector<Word*> &queries)
   {
     if (is_fps_file(query)) {
@@ -107,7 +90,9 @@ namespace Helium {
         queries.push_back(bitvec_copy(fpsFile.fingerprint(i), numWords));
     } else {
       // query is SMILES
-      Word *fingerprint = compute_fingerprint(storage_header, query);
+      HeMol mol;
+      parse_smiles(query, mol);
+      Word *fingerprint = compute_fingerprint(storage_header, mol);
       if (!fingerprint)
         return false;
       queries.push_back(fingerprint);
@@ -123,26 +108,30 @@ namespace Helium {
   }
 
   // functor used by Concurrent
-  template<typename FingerprintStorageType>
+  template<typename IndexType>
   struct RunSimilaritySearch
   {
-    RunSimilaritySearch(const SimilaritySearchIndex<FingerprintStorageType> &index_, double Tmin_)
-      : index(index_), Tmin(Tmin_)
+    RunSimilaritySearch(const IndexType &index_, double Tmin_, int N_)
+      : index(index_), Tmin(Tmin_), N(N_)
     {
     }
 
     void operator()(const Word *query, std::vector<std::pair<unsigned int, double> > &result) const
     {
-      result = index.search(query, Tmin);
+      if (N)
+        result = index.knnSearch(query, N, Tmin);
+      else
+        result = index.search(query, Tmin);
     }
 
-    const SimilaritySearchIndex<FingerprintStorageType> &index;
+    const IndexType &index;
     const double Tmin;
+    const int N; //!< Number of nearest neighbors, 0 for all hits above Tmin
   };
 
   // alternative method for making similarity search threaded
-  template<typename FingerprintStorageType>
-  void run_similarity_search(const SimilaritySearchIndex<FingerprintStorageType> &index, double Tmin,
+  template<typename IndexType>
+  void run_similarity_search(const IndexType &index, double Tmin,
       const std::vector<Word*> &queries, std::vector<std::vector<std::pair<unsigned int, double> > > &result,
       unsigned int begin, unsigned int end)
   {
@@ -150,6 +139,110 @@ namespace Helium {
       result[i] = index.search(queries[i], Tmin);
   }
 
+  // search the queries using any index with search() and knnSearch() members
+  template<typename IndexType>
+  void run_searches(const IndexType &index, bool mt, double Tmin, int N, const std::vector<Word*> &queries,
+      std::vector<std::vector<std::pair<unsigned int, double> > > &result)
+  {
+#ifdef HAVE_CPP11
+    if (mt) {
+      /*
+      // run searches in concurrently using multiple threads
+      unsigned numThreads = std::thread::hardware_concurrency();
+      // c++ implementations may return 0
+      if (!numThreads)
+        numThreads = 2;
+
+      unsigned int taskSize = queries.size() / numThreads;
+
+      std::vector<std::thread> threads;
+      for (int i = 0; i < numThreads; ++i) {
+        unsigned int begin = i * taskSize;
+        unsigned int end = std::min(static_cast<unsigned int>(queries.size()), (i + 1) * taskSize);
+        std::cout << "(" << begin << ", " << end << ")" << std::endl;
+        threads.push_back(std::thread(run_similarity_search<IndexType>,
+              std::ref(index), Tmin, std::ref(queries), std::ref(result), begin, end));
+      }
+
+      for (auto &thread : threads)
+        thread.join();
+      */
+
+      // run searches in concurrently using multiple threads
+      typedef RunSimilaritySearch<IndexType> CallableType;
+      typedef Word* TaskType;
+      typedef std::vector<std::pair<unsigned int, double> > ResultType;
+
+      Concurrent<const CallableType&, TaskType, ResultType> concurrent;
+      concurrent.run(CallableType(index, Tmin, N), queries, result);
+      return;
+    }
+#endif
+    // run all searches sequentially using a single thread
+    for (std::size_t i = 0; i < queries.size(); ++i)
+      RunSimilaritySearch<IndexType>(index, Tmin, N)(queries[i], result[i]);
+  }
+
+  // search the queries using a similarity index built from the storage or loaded from an index file
+  template<typename Metric>
+  void run_index_search(const std::string &filename, bool isIndexFile, const InMemoryRowMajorFingerprintStorage &storage,
+      int k, bool mt, double Tmin, int N, const std::vector<Word*> &queries,
+      std::vector<std::vector<std::pair<unsigned int, double> > > &result)
+  {
+    typedef SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage, Metric> IndexType;
+
+    IndexType *index;
+    if (isIndexFile)
+      index = new IndexType(filename);
+    else
+      // build the compact layout with contiguous leaves directly
+      index = new IndexType(storage, k, mt ? 0 : 1);
+
+#ifdef HAVE_CPP11
+    if (mt && queries.size() == 1) {
+      // split the search for a single query over multiple threads
+      if (N)
+        result[0] = index->parallelKnnSearch(queries[0], N, Tmin);
+      else
+        result[0] = index->parallelSearch(queries[0], Tmin);
+    } else
+#endif
+      run_searches(*index, mt, Tmin, N, queries, result);
+
+    delete index;
+  }
+
+  // search the queries using one similarity index per shard
+  template<typename Metric>
+  void run_sharded_search(const std::vector<std::string> &shards, int k, bool mt, double Tmin, int N,
+      const std::vector<Word*> &queries, std::vector<std::vector<std::pair<unsigned int, double> > > &result)
+  {
+    // the shards are searched concurrently when using multiple threads
+    ShardedSimilaritySearchIndex<Metric> index(shards, k, mt ? 0 : 1);
+    run_searches(index, mt && queries.size() > 1, Tmin, N, queries, result);
+  }
+
+  // search the shards in a manifest or a single fingerprint file or similarity index file
+  template<typename Metric>
+  void run_metric_search(const std::vector<std::string> &shards, const std::string &filename, bool isIndexFile,
+      const InMemoryRowMajorFingerprintStorage &storage, int k, bool mt, double Tmin, int N,
+      const std::vector<Word*> &queries, std::vector<std::vector<std::pair<unsigned int, double> > > &result)
+  {
+    if (shards.size())
+      run_sharded_search<Metric>(shards, k, mt, Tmin, N, queries, result);
+    else
+      run_index_search<Metric>(filename, isIndexFile, storage, k, mt, Tmin, N, queries, result);
+  }
+
+  // approximate search using a MinHash index built from the storage
+  void run_lsh_search(const InMemoryRowMajorFingerprintStorage &storage, int bands, int rows, bool mt,
+      double Tmin, int N, const std::vector<Word*> &queries,
+      std::vector<std::vector<std::pair<unsigned int, double> > > &result)
+  {
+    MinHashIndex<InMemoryRowMajorFingerprintStorage> index(storage, bands, rows);
+    run_searches(index, mt, Tmin, N, queries, result);
+  }
+
   class SimilarityTool : public HeliumTool
   {
     public:
@@ -163,24 +256,128 @@ namespace Helium {
         //
         ParseArgs args(argc, argv, ParseArgs::Args("-Tmin(number)", "-brute",
 #ifdef HAVE_CPP11
-              "-brute-mt", "-mt",
+              "-brute-mt", "-mt", "-numa",
+#endif
+#ifdef HAVE_OPENCL
+              "-opencl", "-platform(number)", "-device(number)",
 #endif
-              "-k(number)"), ParseArgs::Args("query", "fingerprint_file"));
+              "-k(number)", "-N(number)", "-metric(name)", "-lsh", "-bands(number)", "-rows(number)",
+              "-stream(format)", "-profile", "-prefilter(bits)"),
+            ParseArgs::Args("query", "fingerprint_file"));
         // optional arguments
         const double Tmin = args.IsArg("-Tmin") ? args.GetArgDouble("-Tmin", 0) - 10e-5 : 0.7 - 10e-5;
         bool brute = args.IsArg("-brute");
 #ifdef HAVE_CPP11
-        const bool brute_mt = args.IsArg("-brute-mt");
+        bool brute_mt = args.IsArg("-brute-mt");
         const bool mt = args.IsArg("-mt");
+        bool numa = args.IsArg("-numa");
 #endif
         const int k = args.IsArg("-k") ? args.GetArgInt("-k", 0) : 3;
+        const int N = args.IsArg("-N") ? args.GetArgInt("-N", 0) : 0;
+        const std::string metric = args.IsArg("-metric") ? args.GetArgString("-metric", 0) : std::string("tanimoto");
+        const bool lsh = args.IsArg("-lsh");
+        const int bands = args.IsArg("-bands") ? args.GetArgInt("-bands", 0) : 16;
+        const int rows = args.IsArg("-rows") ? args.GetArgInt("-rows", 0) : 4;
+        const bool stream = args.IsArg("-stream");
+        bool profile = args.IsArg("-profile");
+        const int prefilter = args.IsArg("-prefilter") ? args.GetArgInt("-prefilter", 0) : 0;
+#ifdef HAVE_OPENCL
+        const bool opencl = args.IsArg("-opencl");
+        const int platform_id = args.IsArg("-platform") ? args.GetArgInt("-platform", 0) : 1;
+        const int device_id = args.IsArg("-device") ? args.GetArgInt("-device", 0) : 1;
+#endif
         // required arguments
         std::string query = args.GetArgString("query");
         std::string filename = args.GetArgString("fingerprint_file");
 
+        // a similarity index file (see index-sim tool) can be used instead of the fingerprint file
+        const bool isIndexFile = is_similarity_index_file(filename);
+        // a shard manifest (see ShardedSimilaritySearchIndex) can be used to search multiple files
+        const bool isManifest = !isIndexFile && ShardedSimilaritySearchIndex<>::isManifest(filename);
+
         //
         // check for incompatible arguments
         //
+        HitWriter::Format format = HitWriter::NDJSON;
+        if (stream && !HitWriter::parseFormat(args.GetArgString("-stream", 0), format)) {
+          std::cerr << "Invalid output format, must be 'ndjson' or 'binary'" << std::endl;
+          return -1;
+        }
+        if (profile && !instrumentation_enabled()) {
+          std::cerr << "Option -profile requires Helium to be built with ENABLE_INSTRUMENTATION, -profile will be ignored." << std::endl;
+          profile = false;
+        }
+        if (metric != "tanimoto" && metric != "cosine" && metric != "hamming" &&
+            metric != "russell-rao" && metric != "forbes") {
+          std::cerr << "Unknown similarity metric \"" << metric << "\"." << std::endl;
+          return -1;
+        }
+#ifdef HAVE_CPP11
+        if (metric != "tanimoto" && (brute || brute_mt)) {
+#else
+        if (metric != "tanimoto" && brute) {
+#endif
+          std::cerr << "Option -metric <name> requires an index search, only tanimoto is supported for brute force search." << std::endl;
+          return -1;
+        }
+#ifdef HAVE_CPP11
+        if (isManifest && (brute || brute_mt || lsh)) {
+#else
+        if (isManifest && (brute || lsh)) {
+#endif
+          std::cerr << "Options -brute, -brute-mt and -lsh require a fingerprint file, not a shard manifest." << std::endl;
+          return -1;
+        }
+        if (lsh && (isIndexFile || metric != "tanimoto")) {
+          std::cerr << "Option -lsh requires a fingerprint file and the tanimoto metric." << std::endl;
+          return -1;
+        }
+        if (lsh && (bands < 1 || rows < 1)) {
+          std::cerr << "Options -bands <n> and -rows <n> must be greater than 0." << std::endl;
+          return -1;
+        }
+#ifdef HAVE_OPENCL
+#ifdef HAVE_CPP11
+        if (opencl && (isIndexFile || isManifest || metric != "tanimoto" || lsh || brute || brute_mt)) {
+#else
+        if (opencl && (isIndexFile || isManifest || metric != "tanimoto" || lsh || brute)) {
+#endif
+          std::cerr << "Option -opencl requires a fingerprint file and the tanimoto metric and can not be combined with -lsh or -brute." << std::endl;
+          return -1;
+        }
+        if (opencl && (N < 1 || N > OpenCLSimilaritySearch::MaxHits)) {
+          std::cerr << "Option -opencl requires option -N <n> in the range [1," << OpenCLSimilaritySearch::MaxHits << "]." << std::endl;
+          return -1;
+        }
+#endif
+        if (!lsh && (args.IsArg("-bands") || args.IsArg("-rows")))
+          std::cerr << "Options -bands <n> and -rows <n> have no effect without option -lsh and will be ignored." << std::endl;
+        if (lsh && brute) {
+          std::cerr << "Options -lsh and -brute can not be used simultaneously, -brute will be ignored." << std::endl;
+          brute = false;
+        }
+        if (lsh && args.IsArg("-k"))
+          std::cerr << "Option -k <n> has no effect when using option -lsh, -k will be ignored." << std::endl;
+        if (isIndexFile && brute) {
+          std::cerr << "Option -brute requires a fingerprint file, not a similarity index file." << std::endl;
+          return -1;
+        }
+#ifdef HAVE_CPP11
+        if (isIndexFile && brute_mt) {
+          std::cerr << "Option -brute-mt requires a fingerprint file, not a similarity index file." << std::endl;
+          return -1;
+        }
+#endif
+        if (args.IsArg("-prefilter") && (!brute || isIndexFile || isManifest)) {
+          std::cerr << "Option -prefilter <bits> requires option -brute and a fingerprint file." << std::endl;
+          return -1;
+        }
+        if (args.IsArg("-prefilter") && (prefilter < 64 || prefilter % 64)) {
+          std::cerr << "Option -prefilter <bits> must be a multiple of 64." << std::endl;
+          return -1;
+        }
+        if (isIndexFile && args.IsArg("-k"))
+          std::cerr << "Option -k <n> has no effect when using a similarity index file, -k will be ignored." << std::endl;
         if (brute && args.IsArg("-k"))
           std::cerr << "Option -k <n> has no effect when using option -brute, -k will be ignored." << std::endl;
 #ifdef HAVE_CPP11
@@ -194,15 +391,70 @@ namespace Helium {
           std::cerr << "Option -mt has no effect when using option -brute, -mt will be ignored." << std::endl;
         if (brute_mt && mt)
           std::cerr << "Option -mt has no effect when using option -brute-mt, -mt will be ignored." << std::endl;
+        if (lsh && brute_mt) {
+          std::cerr << "Options -lsh and -brute-mt can not be used simultaneously, -brute-mt will be ignored." << std::endl;
+          brute_mt = false;
+        }
+        if (numa && !brute_mt) {
+          std::cerr << "Option -numa has no effect without option -brute-mt, -numa will be ignored." << std::endl;
+          numa = false;
+        }
+
+        // the pinned pool loads the fingerprints on the nodes that search them
+        std::unique_ptr<ThreadPool> numaPool;
+        if (numa)
+          numaPool.reset(new ThreadPool(0, true));
 #endif
 
 
         //
-        // open fingerprint file
+        // open fingerprint file (a similarity index file or shards are opened when searching)
         //
         InMemoryRowMajorFingerprintStorage storage;
+        // a column-major fingerprint file (see transpose tool) is searched using bit-sliced counts
+        InMemoryColumnMajorFingerprintStorage columnStorage;
+        bool columnMajor = false;
+        std::vector<std::string> shards;
+        std::string header;
         try {
-          storage.load(filename);
+          if (!isManifest && !isIndexFile) {
+            Json::Reader reader;
+            Json::Value data;
+            if (!reader.parse(BinaryInputFile(filename).header(), data))
+              throw std::runtime_error(reader.getFormattedErrorMessages());
+            columnMajor = data["order"].asString() == "column-major";
+          }
+
+          if (columnMajor) {
+#ifdef HAVE_CPP11
+            if ((!brute && !brute_mt) || numa) {
+#else
+            if (!brute) {
+#endif
+              std::cerr << "Fingerprint files in column-major order can only be searched using -brute or -brute-mt (without -numa)." << std::endl;
+              return -1;
+            }
+            if (prefilter) {
+              std::cerr << "Option -prefilter <bits> requires a fingerprint file in row-major order." << std::endl;
+              return -1;
+            }
+            columnStorage.load(filename);
+            header = columnStorage.header();
+          } else if (isManifest) {
+            // the shards are opened when searching
+            shards = ShardedSimilaritySearchIndex<>::readManifest(filename);
+            header = BinaryInputFile(shards[0]).header();
+          } else if (isIndexFile) {
+            header = BinaryInputFile(filename).header();
+          } else {
+#ifdef HAVE_CPP11
+            if (numa)
+              storage.load(filename, *numaPool);
+            else
+#endif
+              storage.load(filename);
+            header = storage.header();
+          }
         } catch (const std::exception &e) {
           std::cerr << e.what() << std::endl;
           return -1;
@@ -212,7 +464,7 @@ namespace Helium {
         // load queries
         //
         std::vector<Word*> queries;
-        if (!load_queries(query, storage.header(), queries)) {
+        if (!load_queries(query, header, queries)) {
           std::cerr << "Could not load queries" << std::endl;
           return -1;
         }
@@ -220,61 +472,99 @@ namespace Helium {
         //
         // perform search
         //
+        ProfileScope profileScope;
         std::vector<std::vector<std::pair<unsigned int, double> > > result(queries.size());
+        if (columnMajor) {
+          for (std::size_t i = 0; i < queries.size(); ++i)
+#ifdef HAVE_CPP11
+            if (brute_mt)
+              result[i] = bitsliced_similarity_search_threaded(queries[i], columnStorage, Tmin);
+            else
+#endif
+              result[i] = bitsliced_similarity_search(queries[i], columnStorage, Tmin);
+        } else
 #ifdef HAVE_CPP11
         if (brute_mt) {
+          ThreadPool &pool = numa ? *numaPool : ThreadPool::global();
+          if (queries.size() > 1)
+            result = brute_force_similarity_search_batch_threaded(queries, storage, Tmin, pool);
+          else
+            result[0] = brute_force_similarity_search_threaded(queries[0], storage, Tmin, pool);
+        } else
+#endif
+        if (brute && prefilter) {
+          if (static_cast<unsigned int>(prefilter) > storage.numBits()) {
+            std::cerr << "Option -prefilter <bits> must not exceed the number of bits in the fingerprints." << std::endl;
+            free_queries(queries);
+            return -1;
+          }
+          // scan the folded fingerprints and score the candidates at full width
+          FoldedSimilaritySearch<InMemoryRowMajorFingerprintStorage> folded(storage, prefilter);
           for (std::size_t i = 0; i < queries.size(); ++i)
-            result[i] = brute_force_similarity_search_threaded(queries[i], storage, Tmin);
+            if (N)
+              result[i] = folded.knnSearch(queries[i], N, Tmin);
+            else
+              result[i] = folded.search(queries[i], Tmin);
+        } else if (brute) {
+          if (queries.size() > 1)
+            result = brute_force_similarity_search_batch(queries, storage, Tmin);
+          else if (N)
+            result[0] = brute_force_knn_search(queries[0], storage, N, Tmin);
+          else
+            result[0] = brute_force_similarity_search(queries[0], storage, Tmin);
+        }
+#ifdef HAVE_OPENCL
+        if (opencl) {
+          // the fingerprints stay resident on the device while the batch of queries is searched
+          const char *cacheDir = std::getenv("HELIUM_OPENCL_CACHE");
+          OpenCLSimilaritySearch gpu(storage, platform_id, device_id, cacheDir ? cacheDir : "");
+          result = gpu.knnSearch(queries, N, Tmin);
         } else
 #endif
+#ifdef HAVE_CPP11
+        if (brute || brute_mt) {
+#else
         if (brute) {
-          for (std::size_t i = 0; i < queries.size(); ++i)
-            result[i] = brute_force_similarity_search(queries[i], storage, Tmin);
+#endif
+          // keep the N best hits
+          if (N)
+            for (std::size_t i = 0; i < queries.size(); ++i) {
+              std::stable_sort(result[i].begin(), result[i].end(), compare_second<unsigned int, double, std::greater>());
+              result[i].resize(std::min<std::size_t>(N, result[i].size()));
+            }
         } else {
-          SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, k);
 #ifdef HAVE_CPP11
-          if (mt) {
-            /*
-            // run searches in concurrently using multiple threads
-            unsigned numThreads = std::thread::hardware_concurrency();
-            // c++ implementations may return 0
-            if (!numThreads)
-              numThreads = 2;
-
-            unsigned int taskSize = queries.size() / numThreads;
-
-            std::vector<std::thread> threads;
-            for (int i = 0; i < numThreads; ++i) {
-              unsigned int begin = i * taskSize;
-              unsigned int end = std::min(static_cast<unsigned int>(queries.size()), (i + 1) * taskSize);
-              std::cout << "(" << begin << ", " << end << ")" << std::endl;
-              threads.push_back(std::thread(run_similarity_search<InMemoryRowMajorFingerprintStorage>,
-                    std::ref(index), Tmin, std::ref(queries), std::ref(result), begin, end));
-            }
-
-            for (auto &thread : threads)
-              thread.join();
-            */
-
-            // run searches in concurrently using multiple threads
-            typedef RunSimilaritySearch<InMemoryRowMajorFingerprintStorage> CallableType;
-            typedef Word* TaskType;
-            typedef std::vector<std::pair<unsigned int, double> > ResultType;
-
-            Concurrent<const CallableType&, TaskType, ResultType> concurrent;
-            concurrent.run(CallableType(index, Tmin), queries, result);
-          } else {
-            // run all searches sequentially using a single thread
-            for (std::size_t i = 0; i < queries.size(); ++i)
-              result[i] = index.search(queries[i], Tmin);
-          }
+          const bool threaded = mt;
 #else
-          // run all searches sequentially using a single thread
-          for (std::size_t i = 0; i < queries.size(); ++i)
-            result[i] = index.search(queries[i], Tmin);
+          const bool threaded = false;
 #endif
+          if (lsh) {
+            run_lsh_search(storage, bands, rows, threaded, Tmin, N, queries, result);
+          } else {
+            try {
+              if (metric == "cosine")
+                run_metric_search<CosineMetric>(shards, filename, isIndexFile, storage, k, threaded, Tmin, N, queries, result);
+              else if (metric == "hamming")
+                run_metric_search<HammingMetric>(shards, filename, isIndexFile, storage, k, threaded, Tmin, N, queries, result);
+              else if (metric == "russell-rao")
+                run_metric_search<RussellRaoMetric>(shards, filename, isIndexFile, storage, k, threaded, Tmin, N, queries, result);
+              else if (metric == "forbes")
+                run_metric_search<ForbesMetric>(shards, filename, isIndexFile, storage, k, threaded, Tmin, N, queries, result);
+              else
+                run_metric_search<TanimotoMetric>(shards, filename, isIndexFile, storage, k, threaded, Tmin, N, queries, result);
+            } catch (const std::exception &e) {
+              std::cerr << e.what() << std::endl;
+              free_queries(queries);
+              return -1;
+            }
+          }
         }
 
+        // the counters and phases for all queries
+        Json::Value profileData;
+        if (profile)
+          profileData = profileScope.profile().json();
+
         // deallocate fingerprint
         free_queries(queries);
 
@@ -285,6 +575,22 @@ namespace Helium {
         //
         // print results
         //
+        if (stream) {
+          // the hits of each query are released once written
+          HitWriter writer(std::cout, format, metric);
+          for (std::size_t i = 0; i < result.size(); ++i) {
+            for (std::size_t j = 0; j < result[i].size(); ++j)
+              writer.write(i, result[i][j].first, result[i][j].second);
+            std::vector<std::pair<unsigned int, double> >().swap(result[i]);
+          }
+          Json::Value summary;
+          summary["num_queries"] = Json::UInt(result.size());
+          if (profile)
+            summary["profile"] = profileData;
+          writer.writeSummary(summary);
+          return 0;
+        }
+
         Json::Value data;
         data["hits"] = Json::Value(Json::arrayValue);
         for (std::size_t i = 0; i < result.size(); ++i) {
@@ -293,9 +599,11 @@ namespace Helium {
             data["hits"][Json::ArrayIndex(i)][Json::ArrayIndex(j)] = Json::Value(Json::objectValue);
             Json::Value &obj = data["hits"][Json::ArrayIndex(i)][Json::ArrayIndex(j)];
             obj["index"] = result[i][j].first;
-            obj["tanimoto"] = result[i][j].second;
+            obj[metric] = result[i][j].second;
           }
         }
+        if (profile)
+          data["profile"] = profileData;
 
         Json::StyledWriter writer;
         std::cout << writer.write(data);
@@ -319,16 +627,51 @@ namespace Helium {
         ss << "Usage: " << command << " [options] <query> <fingerprint_file>" << std::endl;
         ss << std::endl;
         ss << "Perform a similarity search on a fingerprint file. The fingerprint file must store the" << std::endl;
-        ss << "fingerprints in row-major order. The query has to be a SMILES string." << std::endl;
+        ss << "fingerprints in row-major order. The query has to be a SMILES string. A similarity index" << std::endl;
+        ss << "file created using the index-sim tool can be used instead of the fingerprint file." << std::endl;
+        ss << "A column-major fingerprint file (see transpose tool) can be searched using -brute or -brute-mt," << std::endl;
+        ss << "this allows the same file to be used for substructure and similarity searches." << std::endl;
+        ss << "To search a library split in multiple fingerprint (or similarity index) files, a JSON shard" << std::endl;
+        ss << "manifest can be used instead of the fingerprint file:" << std::endl;
+        ss << std::endl;
+        ss << "    { \"filetype\": \"similarity-shards\", \"shards\": [ \"part1.fpi\", \"part2.fpi\" ] }" << std::endl;
+        ss << std::endl;
+        ss << "The hits are reported using global indices (i.e. the shards are numbered in order)." << std::endl;
         ss << std::endl;
         ss << "Options:" << std::endl;
-        ss << "    -Tmin <n>     The minimum tanimoto score (default is 0.7)" << std::endl;
+        ss << "    -Tmin <n>     The minimum score (default is 0.7)" << std::endl;
+        ss << "    -metric <name> The similarity metric: tanimoto, cosine, hamming, russell-rao or forbes (default is tanimoto)," << std::endl;
+        ss << "                  metrics other than tanimoto require an index search" << std::endl;
+        ss << "    -N <n>        Only report the n nearest neighbors for each query (default is all hits above Tmin)" << std::endl;
+        ss << "    -stream <format>" << std::endl;
+        ss << "                  Write the hits one at a time followed by a summary instead of a single JSON" << std::endl;
+        ss << "                  document, the format is 'ndjson' (one JSON object per line) or 'binary'" << std::endl;
+        ss << "                  (16 byte records)" << std::endl;
+        ss << "    -profile      Add the search counters and phase times for all queries to the output ('profile'" << std::endl;
+        ss << "                  attribute), this requires Helium to be built with ENABLE_INSTRUMENTATION" << std::endl;
         ss << "    -brute        Do brute force search (default is to use index)" << std::endl;
+        ss << "    -prefilter <bits>" << std::endl;
+        ss << "                  When using -brute, first scan a copy of the fingerprints folded to this number" << std::endl;
+        ss << "                  of bits (e.g. 256) and only score the remaining candidates at full width, the" << std::endl;
+        ss << "                  hits are the same" << std::endl;
 #ifdef HAVE_CPP11
         ss << "    -brute-mt     Do threaded brute force search (default is to use index)" << std::endl;
         ss << "    -mt           Do threaded index search (default is not to use threads)" << std::endl;
+        ss << "    -numa         When using -brute-mt, pin the threads to the NUMA nodes and load the fingerprints" << std::endl;
+        ss << "                  on the node of the thread that searches them" << std::endl;
 #endif
         ss << "    -k <n>        When using an index (i.e. no -brute), specify the dimension for the kD-grid (default is 3)" << std::endl;
+        ss << "    -lsh          Do approximate search using a MinHash index, hits may be missed but the reported" << std::endl;
+        ss << "                  scores are exact (default is exact search)" << std::endl;
+        ss << "    -bands <n>    When using -lsh, the number of bands (default is 16, more bands increase recall)" << std::endl;
+        ss << "    -rows <n>     When using -lsh, the number of MinHash values per band (default is 4, more rows" << std::endl;
+        ss << "                  give fewer candidates and faster searches but lower recall)" << std::endl;
+#ifdef HAVE_OPENCL
+        ss << "    -opencl       Do brute force search on an OpenCL device, requires -N <n> with n <= " << OpenCLSimilaritySearch::MaxHits << std::endl;
+        ss << "                  (the compiled program is cached in $HELIUM_OPENCL_CACHE if set)" << std::endl;
+        ss << "    -platform <n> The OpenCL platform to use (default is to use platform 1)" << std::endl;
+        ss << "    -device <n>   The OpenCL device to use (default is to use device 1)" << std::endl;
+#endif
         ss << std::endl;
         return ss.str();
       }
@@ -29,6 +29,7 @@
 #include <numeric>
 #include <algorithm>
 #include <functional>
+#include <cstdlib>
 
 #include <Helium/fingerprints/similarity.h>
 #include <Helium/fileio/fingerprints.h>
@@ -40,12 +41,13 @@
 #endif
 
 #ifdef HAVE_OPENCL
-#include <CL/cl.hpp>
+#include "openclsimilarity.h"
 #endif
 
 #include <json/json.h>
 
 #include "args.h"
+#include "nxnpartial.h"
 
 namespace Helium {
 
@@ -53,79 +55,50 @@ namespace Helium {
   template<typename FingerprintStorageType>
   struct RunSimilaritySearch
   {
-    RunSimilaritySearch(const SimilaritySearchIndex<FingerprintStorageType> &index_, double Tmin_)
-      : index(index_), Tmin(Tmin_)
+    RunSimilaritySearch(const SimilaritySearchIndex<FingerprintStorageType> &index_, double Tmin_, int N_)
+      : index(index_), Tmin(Tmin_), N(N_)
     {
     }
 
     void operator()(const Word *query, std::vector<std::pair<unsigned int, double> > &result) const
     {
-      result = index.search(query, Tmin);
+      result = index.knnSearch(query, N, Tmin);
     }
 
     const SimilaritySearchIndex<FingerprintStorageType> &index;
     const double Tmin;
+    const int N;
   };
- 
-#ifdef HAVE_OPENCL 
-  // defined in tools/opencl.cpp
-  void checkError(cl_int ret, const std::string &msg);
-
-  void contextCallback(const char *error_info, const void *private_info, size_t cb, void *user_data)
-  {
-    std::cerr << "Error: " << error_info << std::endl;
-    std::exit(-1);
-  }
-
-  /**
-   * @brief Read a files contents into a std::string.
-   *
-   * This function is used to get the source for an OpenCL program.
-   *
-   * @param filename The file containing the OpenCL source code.
-   *
-   * @return std::string containing the files contents (source code).
-   */
-  std::string read_source(const std::string &filename)
-  {
-    std::ifstream ifs(filename.c_str());
-    if (!ifs) {
-      std::cerr << "Error: Could not open file " << filename << " for reading" << std::endl;
-      return std::string();
-    }
-
-    std::string line, source;
-    while (std::getline(ifs, line))
-      source += line + "\n";
-
-    return source;
-  }
-#endif
-
 
   // alternative method for making similarity search threaded
   template<typename FingerprintStorageType>
-  void run_similarity_search(const SimilaritySearchIndex<FingerprintStorageType> &index, double Tmin,
+  void run_similarity_search(const SimilaritySearchIndex<FingerprintStorageType> &index, double Tmin, int N,
       const std::vector<Word*> &queries, std::vector<std::vector<std::pair<unsigned int, double> > > &result,
       unsigned int begin, unsigned int end)
   {
     for (unsigned int i = begin; i < end; ++i)
-      result[i] = index.search(queries[i], Tmin);
+      result[i] = index.knnSearch(queries[i], N, Tmin);
   }
 
-  template<typename T>
-  T padded(T value, std::size_t unit)
+  /**
+   * Parse a range "begin:end" of rows or columns. The begin and end may be
+   * omitted (i.e. 0 and n).
+   */
+  bool parse_tile_range(const std::string &range, unsigned int n, unsigned int &begin, unsigned int &end)
   {
-    return value + unit - (value % unit);
+    std::size_t colon = range.find(':');
+    if (colon == std::string::npos)
+      return false;
+    std::string first = range.substr(0, colon);
+    std::string last = range.substr(colon + 1);
+    if (first.find_first_not_of("0123456789") != std::string::npos ||
+        last.find_first_not_of("0123456789") != std::string::npos)
+      return false;
+    begin = first.empty() ? 0 : std::strtoul(first.c_str(), 0, 10);
+    end = last.empty() ? n : std::strtoul(last.c_str(), 0, 10);
+    return begin <= end && end <= n;
   }
 
-#ifdef HAVE_OPENCL
-  struct OpenCLResult
-  {
-    cl_uint index;
-    cl_float T;
-  };
-#endif
 
   class SimilarityNxNTool : public HeliumTool
   {
@@ -145,7 +118,8 @@ namespace Helium {
 #ifdef HAVE_OPENCL
               "-opencl", "-platform(number)", "-device(number)",
 #endif
-              "-k(number)", "-N(number)"), ParseArgs::Args("fingerprint_file"));
+              "-k(number)", "-N(number)", "-index(filename)", "-rows(range)", "-cols(range)", "-symmetric",
+              "-output(filename)"), ParseArgs::Args("fingerprint_file"));
         // optional arguments
         const double Tmin = args.IsArg("-Tmin") ? args.GetArgDouble("-Tmin", 0) - 10e-5 : 0.7 - 10e-5;
         bool brute = args.IsArg("-brute");
@@ -161,12 +135,32 @@ namespace Helium {
         const bool benchmark = args.IsArg("-benchmark");
         const int k = args.IsArg("-k") ? args.GetArgInt("-k", 0) : 3;
         const int N = args.IsArg("-N") ? args.GetArgInt("-N", 0) : 10;
+        const std::string indexFile = args.IsArg("-index") ? args.GetArgString("-index", 0) : std::string();
+        const bool symmetric = args.IsArg("-symmetric");
+        const std::string outputFile = args.IsArg("-output") ? args.GetArgString("-output", 0) : std::string();
         // required arguments
         std::string filename = args.GetArgString("fingerprint_file");
 
+        //
+        // compute a tile of the NxN matrix
+        //
+        if (args.IsArg("-rows") || args.IsArg("-cols") || symmetric || outputFile.size()) {
+          if (outputFile.empty()) {
+            std::cerr << "Option -output <file> is required when using options -rows, -cols or -symmetric." << std::endl;
+            return -1;
+          }
+          if (indexFile.size() || args.IsArg("-k") || args.IsArg("-benchmark"))
+            std::cerr << "Tiles are computed using a brute force search, options -index, -k and -benchmark will be ignored." << std::endl;
+
+          return runTile(filename, args.IsArg("-rows") ? args.GetArgString("-rows", 0) : std::string(":"),
+              args.IsArg("-cols") ? args.GetArgString("-cols", 0) : std::string(":"), N, Tmin, symmetric, outputFile);
+        }
+
         //
         // check for incompatible arguments
         //
+        if (indexFile.size() && args.IsArg("-k"))
+          std::cerr << "Option -k <n> has no effect when using option -index, -k will be ignored." << std::endl;
         if (brute && args.IsArg("-k"))
           std::cerr << "Option -k <n> has no effect when using option -brute, -k will be ignored." << std::endl;
 #ifdef HAVE_CPP11
@@ -206,189 +200,69 @@ namespace Helium {
           return -1;
         }
 
+        //
+        // open similarity index file
+        //
+        SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> *index = 0;
+        if (indexFile.size()) {
+          try {
+            index = new SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage>(indexFile);
+          } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+          }
+
+          if (index->numBits() != storage.numBits() || index->numFingerprints() != storage.numFingerprints()) {
+            std::cerr << "Similarity index file " << indexFile << " does not match fingerprint file " << filename << std::endl;
+            delete index;
+            return -1;
+          }
+        }
+
         //
         // perform search
         //
         std::vector<std::vector<std::pair<unsigned int, double> > > result(storage.numFingerprints());
 #ifdef HAVE_CPP11
-        if (brute_mt) {
-          std::vector<std::pair<unsigned int, double> > tmp;
-          for (std::size_t i = 0; i < storage.numFingerprints(); ++i) {
-            tmp = brute_force_similarity_search_threaded(storage.fingerprint(i), storage, Tmin);
-            std::sort(tmp.begin(), tmp.end(), compare_second<unsigned int, double, std::greater>());
-            tmp.resize(std::min(N, static_cast<int>(tmp.size())));
-            result[i] = tmp;
-          }
-        } else
-#endif
+        if (brute || brute_mt) {
+#else
         if (brute) {
-          std::vector<std::pair<unsigned int, double> > tmp;
-          for (std::size_t i = 0; i < storage.numFingerprints(); ++i) {
-            tmp = brute_force_similarity_search(storage.fingerprint(i), storage, Tmin);
-            std::sort(tmp.begin(), tmp.end(), compare_second<unsigned int, double, std::greater>());
-            tmp.resize(std::min<int>(N, static_cast<int>(tmp.size())));
-            result[i] = tmp;
-          }
+#endif
+          // each pair is only computed once (see brute_force_similarity_search_nxn())
+#ifdef HAVE_CPP11
+          if (brute_mt)
+            result = brute_force_similarity_search_nxn_threaded(storage, N, Tmin);
+          else
+#endif
+            result = brute_force_similarity_search_nxn(storage, N, Tmin);
         } else
 #ifdef HAVE_OPENCL
         if (opencl) {
-
-          // get a list of OpenCL platforms
-          std::vector<cl::Platform> platforms;
-          checkError(cl::Platform::get(&platforms), "Could not get OpenCL platforms");
-
-          // check if platform is valid
-          if (platform_id < 1 || platform_id > platforms.size()) {
-            std::cerr << "Error: invalid OpenCL platform id (" << platform_id << ")" << std::endl;
+          if (N < 1 || N > OpenCLSimilaritySearch::MaxHits) {
+            std::cerr << "Option -N <n> must be in the range [1," << OpenCLSimilaritySearch::MaxHits << "] when using option -opencl." << std::endl;
             return -1;
           }
 
-          cl::Platform &platform = platforms[platform_id - 1];
-          // get a list of devices for this platform
-          std::vector<cl::Device> devices;
-          checkError(platform.getDevices(CL_DEVICE_TYPE_ALL, &devices), "Could not get OpenCL platform devices");
-        
-          // check if device is valid
-          if (device_id < 1 || device_id > devices.size()) {
-            std::cerr << "Error: invalid OpenCL device id (" << device_id << ")" << std::endl;
-            return -1;
-          }
-
-          std::vector<cl::Device> device(1, devices[device_id - 1]);
-          
-          // create OpenCL context
-          cl_int err;
-          cl::Context context(device, // devices
-                              NULL, // properties
-                              contextCallback, // callback
-                              NULL, // uer data
-                              &err);
-          checkError(err, "Could not create OpenCL context");
-
-          // create OpenCL program
-          cl::Program program(context, read_source("similarity.cl").c_str(), err);
-          checkError(err, "Could not create OpenCL program");
-
-          // build the program
-          err = program.build(device, //devices
-                              //"-cl-std=CL1.2", // options
-                              NULL, // options
-                              NULL, // callback
-                              NULL); // user data
-
-          // get build log
-          if (err != CL_SUCCESS) {
-            for (std::size_t i = 0; i < device.size(); ++i) {
-              std::string build_log;
-              checkError(program.getBuildInfo(device[i], CL_PROGRAM_BUILD_LOG, &build_log), "Could not get OpenCL build log");
-              if (build_log.size()) {
-                std::cerr << "Device " << i + 1 << " build log:" << std::endl;
-                std::cerr << build_log << std::endl;
-              }
-            }
-          }
-
-          checkError(err, "Could not build OpenCL program");
-
-          // create OpenCL kernels
-          std::vector<cl::Kernel> kernels;
-          checkError(program.createKernels(&kernels), "Could not create OpenCL kernels");
-
-          // create OpenCL command queue
-          cl::CommandQueue queue(context, device[0], 0, &err);
-          checkError(err, "Could not create OpenCL command queue");
-
-          // create OpenCL buffer to hold fingerprints
-          std::size_t fingerprints_buffer_size = storage.numFingerprints() * bitvec_num_words_for_bits(storage.numBits()) * sizeof(Word);
-          cl::Buffer fingerprints_buffer(context, // context
-                                         CL_MEM_READ_ONLY, // flags
-                                         fingerprints_buffer_size, // size
-                                         NULL, // host pointer
-                                         &err);
-          checkError(err, "Could not create OpenCL buffer to hold fingerprints");
-
-          // create OpenCL buffer to hold fingerprints
-          cl::Buffer results_buffer(context, // context
-                                    //CL_MEM_WRITE_ONLY, // flags
-                                    CL_MEM_READ_WRITE, // flags
-                                    N * storage.numFingerprints() * sizeof(OpenCLResult), // size
-                                    NULL, // host pointer
-                                    &err);
-          checkError(err, "Could not create OpenCL buffer to hold results");
-
-          // copy fingerprints to OpenCL device
-          checkError(queue.enqueueWriteBuffer(fingerprints_buffer, // buffer
-                                              CL_TRUE, // blocking write
-                                              0, // offset
-                                              fingerprints_buffer_size, // size
-                                              storage.fingerprint(0), // host pointer
-                                              NULL, // events
-                                              NULL), // event
-                     "Could not copy fingerprints to OpenCL device");
-          
-          // set OpenCL kernel arguments
-          cl::Kernel &kernel = kernels[0];
-          checkError(kernel.setArg(0, (cl_uint)storage.numFingerprints()), "Could not set num_fingerprints kernel argument (arg 0)");
-          checkError(kernel.setArg(1, (cl_uint)bitvec_num_words_for_bits(storage.numBits())), "Could not set num_fingerprints kernel argument (arg 1)");
-          checkError(kernel.setArg(2, (cl_float)Tmin), "Could not set threshold kernel argument (arg 2)");
-          checkError(kernel.setArg(3, (cl_uint)N), "Could not set N kernel argument (arg 3)");
-          checkError(kernel.setArg(4, fingerprints_buffer), "Could not set fingerprints kernel argument (arg 4)");
-          checkError(kernel.setArg(5, results_buffer), "Could not set results kernel argument (arg 5)");
-
-          size_t work_group_size;
-          checkError(kernel.getWorkGroupInfo(device[0], CL_KERNEL_WORK_GROUP_SIZE, &work_group_size), "Could not get OpenCL kernel work group size");
-          work_group_size = std::min(work_group_size, static_cast<size_t>(64));
-
-          unsigned int num_fingerprints = padded(storage.numFingerprints(), work_group_size);
-
-          // enueue the OpenCL kernel to run
-          checkError(queue.enqueueNDRangeKernel(kernel, // kernel
-                                                cl::NDRange(0), // offset
-                                                cl::NDRange(num_fingerprints), // global
-                                                cl::NDRange(work_group_size), // local
-                                                NULL, // events
-                                                NULL), // event
-                     "Could not enqueue ND-range kernel to run");
-
-          checkError(queue.finish(), "Could not finish queue");
-
-          // copy results back to host
-          std::vector<OpenCLResult> results(N * storage.numFingerprints());
-          checkError(queue.enqueueReadBuffer(results_buffer, // buffer
-                                             CL_TRUE, // blocking read,
-                                             0, // offset
-                                             results.size() * sizeof(OpenCLResult), // size
-                                             &results[0], // host pointer,
-                                             NULL, // events
-                                             NULL), // event
-                     "Could not copy results from OpenCL device");
-    
-          // convert results to std::vector result
-          for (std::size_t i = 0; i < storage.numFingerprints(); ++i) {
-            for (std::size_t j = 0; j < N; ++j) {
-              const OpenCLResult &hit = results[i * N + j];
-              if (hit.T < 0.0)
-                break;
-              if (hit.T >= Tmin)
-                result[i].push_back(std::make_pair(hit.index, hit.T));
-            }
-            std::sort(result[i].begin(), result[i].end(), compare_second<unsigned int, double, std::greater>());
-          }
-
-
-
-
-
-
-
-
-
-
+          // the program binary is cached in $HELIUM_OPENCL_CACHE (if set)
+          const char *cacheDir = std::getenv("HELIUM_OPENCL_CACHE");
+          OpenCLSimilaritySearch gpu(storage, platform_id, device_id, cacheDir ? cacheDir : "");
 
+          std::vector<Word*> queries(storage.numFingerprints());
+          for (std::size_t i = 0; i < storage.numFingerprints(); ++i)
+            queries[i] = storage.fingerprint(i);
+          result = gpu.knnSearch(queries, N, Tmin);
         } else
 #endif
         {
-          SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, k);
+          if (!index) {
+            // build the compact layout with contiguous leaves directly
+            unsigned int buildThreads = 1;
+#ifdef HAVE_CPP11
+            if (mt)
+              buildThreads = 0;
+#endif
+            index = new SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage>(storage, k, buildThreads);
+          }
 #ifdef HAVE_CPP11
           if (mt) {
             /*
@@ -406,7 +280,7 @@ namespace Helium {
               unsigned int end = std::min(static_cast<unsigned int>(queries.size()), (i + 1) * taskSize);
               std::cout << "(" << begin << ", " << end << ")" << std::endl;
               threads.push_back(std::thread(run_similarity_search<InMemoryRowMajorFingerprintStorage>,
-                    std::ref(index), Tmin, std::ref(queries), std::ref(result), begin, end));
+                    std::ref(index), Tmin, N, std::ref(queries), std::ref(result), begin, end));
             }
 
             for (auto &thread : threads)
@@ -423,29 +297,21 @@ namespace Helium {
               queries[i] = storage.fingerprint(i);
 
             Concurrent<const CallableType&, TaskType, ResultType> concurrent;
-            concurrent.run(CallableType(index, Tmin), queries, result);
+            concurrent.run(CallableType(*index, Tmin, N), queries, result);
           } else {
             // run all searches sequentially using a single thread
-            std::vector<std::pair<unsigned int, double> > tmp;
-            for (std::size_t i = 0; i < storage.numFingerprints(); ++i) {
-              tmp = index.search(storage.fingerprint(i), Tmin);
-              std::sort(tmp.begin(), tmp.end(), compare_second<unsigned int, double, std::greater>());
-              tmp.resize(std::min(N, static_cast<int>(tmp.size())));
-              result[i] = tmp;
-            }
+            for (std::size_t i = 0; i < storage.numFingerprints(); ++i)
+              result[i] = index->knnSearch(storage.fingerprint(i), N, Tmin);
           }
 #else
           // run all searches sequentially using a single thread
-          std::vector<std::pair<unsigned int, double> > tmp;
-          for (std::size_t i = 0; i < storage.numFingerprints(); ++i) {
-            tmp = index.search(storage.fingerprint(i), Tmin);
-            std::sort(tmp.begin(), tmp.end(), compare_second<unsigned int, double, std::greater>());
-            tmp.resize(std::min<int>(N, static_cast<int>(tmp.size())));
-            result[i] = tmp;
-          }
+          for (std::size_t i = 0; i < storage.numFingerprints(); ++i)
+            result[i] = index->knnSearch(storage.fingerprint(i), N, Tmin);
 #endif
         }
 
+        delete index;
+
         if (benchmark)
           return 0;
 
@@ -475,6 +341,52 @@ namespace Helium {
         return 0;
       }
 
+    private:
+      int runTile(const std::string &filename, const std::string &rows, const std::string &cols, int N,
+          double Tmin, bool symmetric, const std::string &outputFile)
+      {
+        try {
+          // only the pages for the tile's rows and columns are read
+          MemoryMappedRowMajorFingerprintStorage storage(filename);
+
+          unsigned int rowBegin, rowEnd, colBegin, colEnd;
+          if (!parse_tile_range(rows, storage.numFingerprints(), rowBegin, rowEnd)) {
+            std::cerr << "Invalid range for option -rows, must be a:b with 0 <= a <= b <= " << storage.numFingerprints() << std::endl;
+            return -1;
+          }
+          if (!parse_tile_range(cols, storage.numFingerprints(), colBegin, colEnd)) {
+            std::cerr << "Invalid range for option -cols, must be a:b with 0 <= a <= b <= " << storage.numFingerprints() << std::endl;
+            return -1;
+          }
+          if (symmetric && colEnd <= rowBegin && colBegin < colEnd && rowBegin < rowEnd)
+            std::cerr << "Warning: symmetric tiles below the diagonal are empty." << std::endl;
+
+          std::vector<std::pair<unsigned int, std::vector<std::pair<unsigned int, double> > > > result =
+            brute_force_similarity_search_nxn_tile(storage, rowBegin, rowEnd, colBegin, colEnd, N, Tmin, symmetric);
+
+          NxNPartialWriter writer(outputFile);
+          for (std::size_t i = 0; i < result.size(); ++i)
+            writer.write(result[i].first, result[i].second);
+
+          Json::Value header;
+          header["num_bits"] = storage.numBits();
+          header["num_fingerprints"] = storage.numFingerprints();
+          header["N"] = N;
+          header["Tmin"] = Tmin;
+          header["symmetric"] = symmetric;
+          header["rows"][0] = rowBegin;
+          header["rows"][1] = rowEnd;
+          header["cols"][0] = colBegin;
+          header["cols"][1] = colEnd;
+          writer.finish(header);
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+
+        return 0;
+      }
+
   };
 
   class SimilarityNxNToolFactory : public HeliumToolFactory
@@ -504,9 +416,26 @@ namespace Helium {
 #ifdef HAVE_OPENCL
         ss << "    -opencl       Use OpenCL (default is not to use OpenCL)" << std::endl;
         ss << "    -platform <n> The OpenCL platform to use (default is to use platform 1)" << std::endl;
+        ss << "    -device <n>   The OpenCL device to use (default is to use device 1)" << std::endl;
 #endif
         ss << "    -k <n>        When using an index (i.e. no -brute), specify the dimension for the kD-grid (default is 3)" << std::endl;
+        ss << "    -index <file> Use a similarity index file created using the index-sim tool instead of building the index" << std::endl;
         ss << std::endl;
+        ss << "Tile options:" << std::endl;
+        ss << "    -rows <a:b>   Only compute the rows [a,b) of the NxN matrix (default is all rows)" << std::endl;
+        ss << "    -cols <a:b>   Only compute the columns [a,b) of the NxN matrix (default is all columns)" << std::endl;
+        ss << "    -symmetric    Only compute the pairs (i,j) with i <= j and add each hit to both rows (only the" << std::endl;
+        ss << "                  tiles on and above the diagonal are needed)" << std::endl;
+        ss << "    -output <file> Write the partial result for the tile to a binary file" << std::endl;
+        ss << std::endl;
+        ss << "The tiles are computed using a brute force search and can be run as independent jobs. The" << std::endl;
+        ss << "partial results are combined using the merge tool." << std::endl;
+        ss << std::endl;
+#ifdef HAVE_OPENCL
+        ss << "The compiled OpenCL program is cached in the directory specified by the HELIUM_OPENCL_CACHE" << std::endl;
+        ss << "environment variable (if set). At most " << OpenCLSimilaritySearch::MaxHits << " nearest matches can be found using OpenCL." << std::endl;
+        ss << std::endl;
+#endif
         return ss.str();
       }
   };
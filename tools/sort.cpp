@@ -31,61 +31,149 @@
 #include <Helium/fileio/fingerprints.h>
 #include <Helium/fingerprints/fingerprints.h>
 
-#include <numeric> // std::accumulate
+#include <algorithm>
 
 #include "args.h"
 
 namespace Helium {
 
   /**
-   * Tool for sroting fingerprint indexes based on population count.
+   * Tool for sorting fingerprint indexes based on population count.
+   *
+   * The fingerprints are sorted using a counting sort: the bucket offsets
+   * are computed from the (cached) population counts and every fingerprint
+   * is copied to the next position of its bucket. Each bucket has a write
+   * buffer which is written to the bucket's position in the output file
+   * when full. The total buffer size is limited so files larger than the
+   * available memory can be sorted with a single pass over the (memory
+   * mapped) input. The order of fingerprints with the same population count
+   * is preserved.
    */
   class SortTool : public HeliumTool
   {
     public:
+      /**
+       * Write the buffered fingerprints of a bucket to the output file.
+       */
+      static void flush_bucket(BinaryOutputFile &file, unsigned int bucket, std::vector<unsigned int> &positions,
+          std::vector<unsigned int> &sizes, const std::vector<std::size_t> &buffers,
+          const std::vector<Word> &buffer, unsigned int numWords)
+      {
+        if (!sizes[bucket])
+          return;
+        file.seek(static_cast<uint64_t>(positions[bucket]) * numWords * sizeof(Word));
+        file.write(&buffer[buffers[bucket]], static_cast<std::size_t>(sizes[bucket]) * numWords * sizeof(Word));
+        positions[bucket] += sizes[bucket];
+        sizes[bucket] = 0;
+      }
+
       /**
        * Perform tool action.
        */
       int run(int argc, char **argv)
       {
-        ParseArgs args(argc, argv, ParseArgs::Args(), ParseArgs::Args("in_file", "out_file"));
+        ParseArgs args(argc, argv, ParseArgs::Args("-memory(number)"), ParseArgs::Args("in_file", "out_file"));
+        // optional arguments
+        const int memory = args.IsArg("-memory") ? args.GetArgInt("-memory", 0) : 256;
         // required arguments
         std::string inFile = args.GetArgString("in_file");
         std::string outFile = args.GetArgString("out_file");
 
-
+        if (memory < 1) {
+          std::cerr << "Invalid memory size" << std::endl;
+          return -1;
+        }
 
         //
-        // open input fingerprint file
+        // open input fingerprint file (the population counts are cached by load())
         //
-        InMemoryRowMajorFingerprintStorage storage;
+        MemoryMappedRowMajorFingerprintStorage storage;
         try {
-          storage.load(inFile);
+          storage.load(inFile, SequentialAdvice);
         } catch (const std::exception &e) {
           std::cerr << e.what() << std::endl;
           return -1;
         }
 
+        unsigned int numBits = storage.numBits();
+        unsigned int numWords = bitvec_num_words_for_bits(numBits);
+        unsigned int numFingerprints = storage.numFingerprints();
+
+        //
+        // compute the population count bucket offsets
+        //
+        std::vector<unsigned int> offsets(numBits + 2, 0);
+        for (unsigned int i = 0; i < numFingerprints; ++i)
+          ++offsets[storage.bitCount(i) + 1];
+        for (unsigned int c = 0; c <= numBits; ++c)
+          offsets[c + 1] += offsets[c];
+
         //
-        // open output fingerprint file
+        // add the population count bucket offsets to the JSON header, the
+        // header is created first to reserve enough space for the offsets
         //
-        RowMajorFingerprintOutputFile indexFile(outFile, storage.numBits());
+        Json::Reader reader;
+        Json::Value data;
+        if (!reader.parse(storage.header(), data)) {
+          std::cerr << reader.getFormattedErrorMessages() << std::endl;
+          return -1;
+        }
+        // the stored bit counts and part counts are not copied (the column
+        // counts don't depend on the order)
+        data.removeMember("bit_counts");
+        data.removeMember("part_counts");
+        data["popcount_offsets"] = Json::Value(Json::arrayValue);
+        for (std::size_t c = 0; c < offsets.size(); ++c)
+          data["popcount_offsets"][Json::ArrayIndex(c)] = offsets[c];
+        Json::StyledWriter writer;
+        std::string header = writer.write(data);
 
         //
-        // sort the fingerprints
+        // assign each bucket a part of the write buffer
         //
-        int numWords = bitvec_num_words_for_bits(storage.numBits());
-        for (int c = 0; c < storage.numBits(); ++c) {
-          for (unsigned int i = 0; i < storage.numFingerprints(); ++i) {
-            int popcnt = bitvec_count(storage.fingerprint(i), numWords);
-            if (c == popcnt)
-              indexFile.writeFingerprint(storage.fingerprint(i));
-          }
+        std::size_t bufferFingerprints = std::max<std::size_t>(numBits + 1,
+            static_cast<std::size_t>(memory) * 1024 * 1024 / (numWords * sizeof(Word)));
+        std::size_t perBucket = bufferFingerprints / (numBits + 1);
+        std::vector<std::size_t> buffers(numBits + 2, 0); // bucket offsets in buffer (in fingerprints)
+        std::vector<unsigned int> capacities(numBits + 1);
+        for (unsigned int c = 0; c <= numBits; ++c) {
+          capacities[c] = std::min<std::size_t>(perBucket, offsets[c + 1] - offsets[c]);
+          buffers[c + 1] = buffers[c] + capacities[c];
         }
+        std::vector<Word> buffer(buffers[numBits + 1] * numWords);
+        for (unsigned int c = 0; c <= numBits + 1; ++c)
+          buffers[c] *= numWords;
+
+        //
+        // scatter the fingerprints
+        //
+        BinaryOutputFile indexFile;
+        try {
+          indexFile.open(outFile, std::max<std::size_t>(BinaryOutputFile::DefaultHeaderSize, header.size() + 1));
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+        std::vector<unsigned int> positions(offsets.begin(), offsets.end() - 1);
+        std::vector<unsigned int> sizes(numBits + 1, 0);
+        for (unsigned int i = 0; i < numFingerprints; ++i) {
+          unsigned int c = storage.bitCount(i);
+          Word *fingerprint = storage.fingerprint(i);
+          std::copy(fingerprint, fingerprint + numWords, &buffer[buffers[c] + static_cast<std::size_t>(sizes[c]) * numWords]);
+          if (++sizes[c] == capacities[c])
+            flush_bucket(indexFile, c, positions, sizes, buffers, buffer, numWords);
+        }
+        for (unsigned int c = 0; c <= numBits; ++c)
+          flush_bucket(indexFile, c, positions, sizes, buffers, buffer, numWords);
+
+        // position after the last fingerprint for writing the header
+        indexFile.seek(static_cast<uint64_t>(numFingerprints) * numWords * sizeof(Word));
 
         // write JSON header
-        Json::StyledWriter writer;
-        indexFile.writeHeader(storage.header());
+        if (!indexFile.writeHeader(header)) {
+          std::cerr << "Could not write file " << outFile << std::endl;
+          return -1;
+        }
 
         return 0;
       }
@@ -103,7 +191,18 @@ namespace Helium {
       std::string usage(const std::string &command) const
       {
         std::stringstream ss;
-        ss << "Usage: " << command << " <in_file> <out_file>" << std::endl;
+        ss << "Usage: " << command << " [options] <in_file> <out_file>" << std::endl;
+        ss << std::endl;
+        ss << "Sort the fingerprints in a row-major order fingerprint file by population count. The" << std::endl;
+        ss << "offsets of the population count buckets are stored in the JSON header and are used by" << std::endl;
+        ss << "the brute force similarity search to skip fingerprints that can not be similar to the" << std::endl;
+        ss << "query. Note that the indices of the hits refer to the sorted fingerprints." << std::endl;
+        ss << std::endl;
+        ss << "The fingerprints are sorted in a single pass using a counting sort. Files larger than" << std::endl;
+        ss << "the available memory are sorted by buffering the output for each population count." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -memory <n>   The size of the output buffers in MB (default is 256)" << std::endl;
         ss << std::endl;
         return ss.str();
       }
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2013, Tim Vandermeersch
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "tool.h"
+
+#include <Helium/fileio/file.h>
+#include <Helium/fileio/fingerprints.h>
+#include <Helium/fileio/molecules.h>
+#include <Helium/fingerprints/similarity.h>
+#include <Helium/util/memory.h>
+
+#include <json/json.h>
+
+#include "args.h"
+
+namespace Helium {
+
+  static Json::Value memory_usage_json(const MemoryUsage &usage)
+  {
+    Json::Value data;
+    data["heap"] = static_cast<Json::UInt64>(usage.heap);
+    data["mapped"] = static_cast<Json::UInt64>(usage.mapped);
+    data["resident"] = static_cast<Json::UInt64>(usage.resident);
+    data["total"] = static_cast<Json::UInt64>(usage.total());
+    return data;
+  }
+
+  class StatsTool : public HeliumTool
+  {
+    public:
+      int run(int argc, char**argv)
+      {
+        ParseArgs args(argc, argv, ParseArgs::Args("-load", "-k(number)"), ParseArgs::Args("filename"));
+        // optional arguments
+        const bool load = args.IsArg("-load");
+        const int k = args.IsArg("-k") ? args.GetArgInt("-k", 0) : 3;
+        // required arguments
+        std::string filename = args.GetArgString("filename");
+
+        if (k < 1) {
+          std::cerr << "The -k option must be at least 1" << std::endl;
+          return -1;
+        }
+
+        Json::Value header;
+        {
+          BinaryInputFile file(filename);
+          if (!file) {
+            std::cerr << "Could not open file \"" << filename << "\"" << std::endl;
+            return -1;
+          }
+          Json::Reader reader;
+          if (!reader.parse(file.header(), header)) {
+            std::cerr << reader.getFormattedErrorMessages() << std::endl;
+            return -1;
+          }
+        }
+
+        Json::Value data;
+        data["filename"] = filename;
+        data["filetype"] = header["filetype"];
+        data["file_size"] = static_cast<Json::UInt64>(file_size(filename));
+
+        try {
+          const std::string filetype = header["filetype"].asString();
+          if (filetype == "fingerprints")
+            fingerprintStats(filename, header, k, load, data);
+          else if (filetype == "molecules")
+            moleculeStats(filename, load, data);
+          else if (filetype == "similarity-index")
+            indexStats(filename, load, data);
+          else {
+            std::cerr << "Unsupported file type '" << filetype << "'" << std::endl;
+            return -1;
+          }
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+
+        Json::StyledWriter writer;
+        std::cout << writer.write(data);
+
+        return 0;
+      }
+
+    private:
+      template<typename StorageType>
+      static Json::Value loadedStorage(const std::string &filename)
+      {
+        StorageType storage;
+        storage.load(filename);
+        return memory_usage_json(storage.memoryUsage());
+      }
+
+      void fingerprintStats(const std::string &filename, const Json::Value &header, int k, bool load, Json::Value &data)
+      {
+        const std::string order = header["order"].asString();
+        data["order"] = order;
+        data["num_bits"] = header["num_bits"];
+        data["num_fingerprints"] = header["num_fingerprints"];
+
+        Json::Value &estimates = data["estimates"];
+        if (order == "row-major") {
+          estimates["in_memory"] = memory_usage_json(InMemoryRowMajorFingerprintStorage::estimateMemoryUsage(filename));
+          estimates["memory_mapped"] = memory_usage_json(MemoryMappedRowMajorFingerprintStorage::estimateMemoryUsage(filename));
+          estimates["similarity_index"] = memory_usage_json(SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage>::estimateMemoryUsage(
+                header["num_fingerprints"].asUInt(), header["num_bits"].asUInt(), k));
+        } else if (order == "column-major") {
+          estimates["in_memory"] = memory_usage_json(InMemoryColumnMajorFingerprintStorage::estimateMemoryUsage(filename));
+          estimates["memory_mapped"] = memory_usage_json(MemoryMappedColumnMajorFingerprintStorage::estimateMemoryUsage(filename));
+        } else if (order == "compressed-column-major") {
+          estimates["in_memory"] = memory_usage_json(InMemoryCompressedColumnMajorFingerprintStorage::estimateMemoryUsage(filename));
+        } else
+          throw std::runtime_error(make_string("Unsupported fingerprint order '", order, "'"));
+
+        if (!load)
+          return;
+
+        Json::Value &loaded = data["loaded"];
+        if (order == "row-major") {
+          InMemoryRowMajorFingerprintStorage storage;
+          storage.load(filename);
+          loaded["in_memory"] = memory_usage_json(storage.memoryUsage());
+          loaded["memory_mapped"] = loadedStorage<MemoryMappedRowMajorFingerprintStorage>(filename);
+          // the frozen index copies the fingerprints in leaf order
+          SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> index(storage, k, 0);
+          loaded["similarity_index"] = memory_usage_json(index.memoryUsage());
+        } else if (order == "column-major") {
+          loaded["in_memory"] = loadedStorage<InMemoryColumnMajorFingerprintStorage>(filename);
+          loaded["memory_mapped"] = loadedStorage<MemoryMappedColumnMajorFingerprintStorage>(filename);
+        } else {
+          loaded["in_memory"] = loadedStorage<InMemoryCompressedColumnMajorFingerprintStorage>(filename);
+        }
+      }
+
+      void moleculeStats(const std::string &filename, bool load, Json::Value &data)
+      {
+        data["estimates"]["memory_mapped"] = memory_usage_json(MemoryMappedMoleculeFile::estimateMemoryUsage(filename));
+        if (!load)
+          return;
+
+        MemoryMappedMoleculeFile file(filename);
+        data["num_molecules"] = file.numMolecules();
+        data["loaded"]["memory_mapped"] = memory_usage_json(file.memoryUsage());
+      }
+
+      void indexStats(const std::string &filename, bool load, Json::Value &data)
+      {
+        typedef SimilaritySearchIndex<InMemoryRowMajorFingerprintStorage> IndexType;
+        data["estimates"]["memory_mapped"] = memory_usage_json(IndexType::estimateMemoryUsage(filename));
+        if (!load)
+          return;
+
+        IndexType index(filename);
+        data["loaded"]["memory_mapped"] = memory_usage_json(index.memoryUsage());
+      }
+  };
+
+  class StatsToolFactory : public HeliumToolFactory
+  {
+    public:
+      HELIUM_TOOL("stats", "Report the memory footprint of binary Helium files", 1, StatsTool);
+
+      /**
+       * Get usage information.
+       */
+      std::string usage(const std::string &command) const
+      {
+        std::stringstream ss;
+        ss << "Usage: " << command << " [options] <filename>" << std::endl;
+        ss << std::endl;
+        ss << "Print the estimated memory footprint (heap, mapped and resident bytes) of the" << std::endl;
+        ss << "ways a fingerprint, molecule or similarity index file can be loaded. The" << std::endl;
+        ss << "estimates are computed from the file header." << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -load          Also load the file and report the actual memory usage" << std::endl;
+        ss << "    -k <n>         The kD-grid dimension for the similarity index estimate (default is 3)" << std::endl;
+        ss << std::endl;
+        return ss.str();
+      }
+  };
+
+  StatsToolFactory theStatsToolFactory;
+
+}
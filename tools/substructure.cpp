@@ -26,81 +26,19 @@
  */
 #include "tool.h"
 
-#include <Helium/fingerprints/fingerprints.h>
-#include <Helium/smiles.h>
-#include <Helium/fileio/fingerprints.h>
-#include <Helium/fileio/molecules.h>
-#include <Helium/algorithms/isomorphism.h>
+#include <Helium/instrumentation.h>
 
 #include <json/json.h>
 
+#include <cstdlib>
+#include <fstream>
+
 #include "args.h"
+#include "hitwriter.h"
+#include "queries.h"
 
 namespace Helium {
 
-  template<typename MoleculeType>
-  Word* compute_fingerprint(const std::string &settings, MoleculeType &mol)
-  {
-    Json::Reader reader;
-    Json::Value data;
-
-    if (!reader.parse(settings, data)) {
-      std::cerr << reader.getFormattedErrorMessages() << std::endl;
-      return 0;
-    }
-
-    int bits = data["num_bits"].asInt();
-    int words = bitvec_num_words_for_bits(bits);
-    int k = data["fingerprint"]["k"].asInt();
-    int prime = data["fingerprint"]["prime"].asInt();
-    std::string type = data["fingerprint"]["type"].asString();
-
-    Word *fingerprint = new Word[words];
-
-    if (type == "Helium::paths_fingerprint") {
-      path_fingerprint(mol, fingerprint, k, words, prime);
-      return fingerprint;
-    }
-
-    if (type == "Helium::trees_fingerprint") {
-      tree_fingerprint(mol, fingerprint, k, words, prime);
-      return fingerprint;
-    }
-
-    if (type == "Helium::subgraph_fingerprint") {
-      subgraph_fingerprint(mol, fingerprint, k, words, prime);
-      return fingerprint;
-    }
-
-    std::cerr << "Fingerprint type \"" << type << "\" not recognised" << std::endl;
-
-    delete [] fingerprint;
-    return 0;
-  }
-
-
-  void screen(InMemoryColumnMajorFingerprintStorage &storage, Word *fingerprint, Word *result)
-  {
-    bool first = true;
-    for (int i = 0; i < storage.numBits(); ++i) { // foreach bit
-      // skip this bit if it is not set
-      if (!bitvec_get(i, fingerprint))
-        continue;
-
-      if (first) {
-        // if this is the first bit, just set result
-        for (unsigned int j = 0; j < bitvec_num_words_for_bits(storage.numFingerprints()); ++j)
-          result[j] = storage.bit(i)[j];
-        first = false;
-      } else {
-        // do set intersection
-        for (unsigned int j = 0; j < bitvec_num_words_for_bits(storage.numFingerprints()); ++j)
-          result[j] &= storage.bit(i)[j];
-      }
-    }
-  }
-
-
   class SubstructureTool : public HeliumTool
   {
     public:
@@ -109,65 +47,233 @@ namespace Helium {
        */
       int run(int argc, char **argv)
       {
-        ParseArgs args(argc, argv, ParseArgs::Args("-styled"),
+        ParseArgs args(argc, argv, ParseArgs::Args(
+#ifdef HAVE_CPP11
+              "-mt",
+#endif
+#ifdef HAVE_OPENCL
+              "-opencl", "-platform(number)", "-device(number)",
+#endif
+              "-filter(filter_file)", "-timeout(ms)", "-candidate_timeout(ms)", "-styled",
+              "-stream(format)", "-profile", "-batch"),
             ParseArgs::Args("query", "molecule_file", "fingerprint_file"));
         // optional arguments
         const bool styled = args.IsArg("-styled");
+        const bool stream = args.IsArg("-stream");
+        const bool batch = args.IsArg("-batch");
+        const unsigned int timeout = args.IsArg("-timeout") ? args.GetArgInt("-timeout", 0) : 0;
+        const unsigned int candidateTimeout = args.IsArg("-candidate_timeout") ?
+            args.GetArgInt("-candidate_timeout", 0) : 0;
+#ifdef HAVE_CPP11
+        const bool mt = args.IsArg("-mt");
+#endif
+#ifdef HAVE_OPENCL
+        const bool opencl = args.IsArg("-opencl");
+        const int platform_id = args.IsArg("-platform") ? args.GetArgInt("-platform", 0) : 1;
+        const int device_id = args.IsArg("-device") ? args.GetArgInt("-device", 0) : 1;
+#endif
         // required arguments
         std::string smiles = args.GetArgString("query");
         std::string moleculeFilename = args.GetArgString("molecule_file");
         std::string fingerprintFilename = args.GetArgString("fingerprint_file");
+#ifndef HAVE_CPP11
+        const bool mt = false;
+#endif
 
-        // open fingerprint file
-        InMemoryColumnMajorFingerprintStorage storage;
+        HitWriter::Format format = HitWriter::NDJSON;
+        if (stream && !HitWriter::parseFormat(args.GetArgString("-stream", 0), format)) {
+          std::cerr << "Invalid output format, must be 'ndjson' or 'binary'" << std::endl;
+          return -1;
+        }
+        m_profile = args.IsArg("-profile");
+        if (m_profile && !instrumentation_enabled()) {
+          std::cerr << "Option -profile requires Helium to be built with ENABLE_INSTRUMENTATION, -profile will be ignored." << std::endl;
+          m_profile = false;
+        }
+
+        // load the fingerprint and molecule files
+        SubstructureQueries queries;
         try {
-          storage.load(fingerprintFilename);
+          queries.load(moleculeFilename, fingerprintFilename);
+          if (args.IsArg("-filter"))
+            queries.loadFilters(args.GetArgString("-filter", 0));
         } catch (const std::exception &e) {
           std::cerr << e.what() << std::endl;
           return -1;
         }
 
-        // compute query fingerprint
-        HeMol query;
-        parse_smiles(smiles, query);
-        Word *queryFingerprint = compute_fingerprint(storage.header(), query);
+#ifdef HAVE_OPENCL
+        if (opencl) {
+          // the program binary is cached in $HELIUM_OPENCL_CACHE (if set)
+          const char *cacheDir = std::getenv("HELIUM_OPENCL_CACHE");
+          queries.useOpenCL(platform_id, device_id, cacheDir ? cacheDir : "");
+        }
+#endif
+
+        if (batch) {
+          // the query argument is a file with one query per line
+          std::ifstream ifs(smiles.c_str());
+          if (!ifs) {
+            std::cerr << "Could not open " << smiles << std::endl;
+            return -1;
+          }
+          std::vector<std::string> lines;
+          std::string line;
+          while (std::getline(ifs, line))
+            if (!line.empty())
+              lines.push_back(line);
+
+          if (stream) {
+            HitWriter writer(std::cout, format);
+            write_hits_batch(queries, lines, mt, timeout, candidateTimeout, writer);
+          } else
+            search_batch(queries, lines, mt, timeout, candidateTimeout, styled);
+          return 0;
+        }
+
+        if (stream) {
+          HitWriter writer(std::cout, format);
+          if (smiles != "interactive")
+            return write_hits(queries, smiles, 0, mt, timeout, candidateTimeout, writer, true);
+
+          // the hits are numbered by query, each query is followed by its summary
+          std::string line;
+          for (unsigned int q = 0; std::getline(std::cin, line); ) {
+            if (line.empty())
+              continue;
+            write_hits(queries, line, q++, mt, timeout, candidateTimeout, writer, false);
+          }
+          return 0;
+        }
+
+        if (smiles != "interactive") {
+          try {
+            print(search(queries, smiles, mt, timeout, candidateTimeout), styled);
+          } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+          }
+          return 0;
+        }
+
+        // read one query per line from stdin, the files stay loaded between queries
+        std::string line;
+        while (std::getline(std::cin, line)) {
+          if (line.empty())
+            continue;
+          try {
+            print(search(queries, line, mt, timeout, candidateTimeout), styled);
+          } catch (const std::exception &e) {
+            Json::Value error;
+            error["error"] = e.what();
+            print(error, styled);
+          }
+          std::cout.flush();
+        }
 
-        // perform search
-        Word *candidates = new Word[bitvec_num_words_for_bits(storage.numFingerprints())];
+        return 0;
+      }
 
-        screen(storage, queryFingerprint, candidates);
+    private:
+      /**
+       * Search a query, the profile for the query is added when using
+       * -profile.
+       */
+      Json::Value search(SubstructureQueries &queries, const std::string &smiles, bool mt,
+          unsigned int timeout, unsigned int candidateTimeout)
+      {
+        ProfileScope scope;
+        Json::Value data = queries.search(smiles, mt, timeout, candidateTimeout);
+        if (m_profile)
+          data["profile"] = scope.profile().json();
+        return data;
+      }
 
-        //MoleculeFile moleculeFile;
-        MemoryMappedMoleculeFile moleculeFile;
+      /**
+       * Search a query and write the hits followed by the summary. Errors
+       * are reported in the summary ('error' attribute) or on standard
+       * error if @p fatal is true.
+       */
+      int write_hits(SubstructureQueries &queries, const std::string &smiles, unsigned int query, bool mt,
+          unsigned int timeout, unsigned int candidateTimeout, HitWriter &writer, bool fatal)
+      {
+        Json::Value summary;
+        ProfileScope scope;
         try {
-          moleculeFile.load(moleculeFilename);
+          SubstructureQueries::Result result = queries.searchHits(smiles, mt, timeout, candidateTimeout);
+          for (std::size_t i = 0; i < result.hits.size(); ++i)
+            writer.write(query, result.hits[i]);
+          summary = SubstructureQueries::summary(result);
+          if (m_profile)
+            summary["profile"] = scope.profile().json();
         } catch (const std::exception &e) {
-          std::cerr << e.what() << std::endl;
-          return -1;
+          if (fatal) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+          }
+          summary["error"] = e.what();
         }
+        summary["query"] = query;
+        writer.writeSummary(summary);
+        return 0;
+      }
 
-        HeMol mol;
-        std::vector<Index> result;
-        for (unsigned int i = 0; i < moleculeFile.numMolecules(); ++i) {
-          if (bitvec_get(i, candidates)) {
-            moleculeFile.read_molecule(i, mol);
-            if (isomorphism_search<DefaultAtomMatcher, DefaultBondMatcher>(mol, query))
-              result.push_back(i);
-          }
+      /**
+       * Search a batch of queries and print the result for each query, the
+       * profile for the whole batch is printed last when using -profile.
+       */
+      void search_batch(SubstructureQueries &queries, const std::vector<std::string> &smiles, bool mt,
+          unsigned int timeout, unsigned int candidateTimeout, bool styled)
+      {
+        ProfileScope scope;
+        std::vector<SubstructureQueries::Result> results = queries.searchHitsBatch(smiles, mt, timeout,
+            candidateTimeout);
+        for (std::size_t q = 0; q < results.size(); ++q) {
+          Json::Value data;
+          if (results[q].error.empty()) {
+            data = SubstructureQueries::summary(results[q]);
+            data["hits"] = Json::Value(Json::arrayValue);
+            for (std::size_t i = 0; i < results[q].hits.size(); ++i)
+              data["hits"][Json::ArrayIndex(i)]["index"] = results[q].hits[i];
+          } else
+            data["error"] = results[q].error;
+          print(data, styled);
+        }
+        if (m_profile) {
+          Json::Value data;
+          data["profile"] = scope.profile().json();
+          print(data, styled);
         }
+      }
 
-        // print results
-        Json::Value data;
-        data["hits"] = Json::Value(Json::arrayValue);
-        data["screened"] = Json::Value(bitvec_count(candidates, bitvec_num_words_for_bits(storage.numFingerprints())));
-        data["confirmed"] = Json::Value(static_cast<unsigned int>(result.size()));
-        data["false_positives"] = Json::Value(1.0 - static_cast<double>(result.size()) / bitvec_count(candidates, bitvec_num_words_for_bits(storage.numFingerprints())));
-        for (std::size_t i = 0; i < result.size(); ++i) {
-          data["hits"][Json::ArrayIndex(i)] = Json::Value(Json::objectValue);
-          Json::Value &obj = data["hits"][Json::ArrayIndex(i)];
-          obj["index"] = result[i];
+      /**
+       * Search a batch of queries and write the hits followed by the summary
+       * for each query in the same way as for interactive streaming.
+       */
+      void write_hits_batch(SubstructureQueries &queries, const std::vector<std::string> &smiles, bool mt,
+          unsigned int timeout, unsigned int candidateTimeout, HitWriter &writer)
+      {
+        ProfileScope scope;
+        std::vector<SubstructureQueries::Result> results = queries.searchHitsBatch(smiles, mt, timeout,
+            candidateTimeout);
+        for (std::size_t q = 0; q < results.size(); ++q) {
+          Json::Value summary;
+          if (results[q].error.empty()) {
+            for (std::size_t i = 0; i < results[q].hits.size(); ++i)
+              writer.write(q, results[q].hits[i]);
+            summary = SubstructureQueries::summary(results[q]);
+          } else
+            summary["error"] = results[q].error;
+          // the profile covers the whole batch
+          if (m_profile && q + 1 == results.size())
+            summary["profile"] = scope.profile().json();
+          summary["query"] = static_cast<unsigned int>(q);
+          writer.writeSummary(summary);
         }
+      }
 
+      void print(const Json::Value &data, bool styled)
+      {
         if (styled) {
           Json::StyledWriter writer;
           std::cout << writer.write(data);
@@ -175,15 +281,10 @@ namespace Helium {
           Json::FastWriter writer;
           std::cout << writer.write(data);
         }
-
-        // deallocate fingerprint
-        if (queryFingerprint)
-          delete [] queryFingerprint;
-        delete [] candidates;
-
-        return 0;
       }
 
+      bool m_profile; //!< Add the profile for each query to the output
+
   };
 
   class SubstructureToolFactory : public HeliumToolFactory
@@ -202,10 +303,40 @@ namespace Helium {
         ss << "Perform a substructure search. The fingerprint file must store the" << std::endl;
         ss << "fingerprints in column-major order. The query has to be a SMILES string." << std::endl;
         ss << std::endl;
-        ss << "Optionally, the <query> can be replaced with 'interactive' to start an interactive session" << std::endl;
+        ss << "Optionally, the <query> can be replaced with 'interactive' to start an interactive session." << std::endl;
+        ss << "The files are loaded once and a query is read from each line on standard input. The results" << std::endl;
+        ss << "are written as JSON for each query (see also the server tool)." << std::endl;
+        ss << std::endl;
+        ss << "Using -batch, the <query> is a file with one query per line. All queries are screened in a" << std::endl;
+        ss << "single pass over the fingerprints and the results are written in the same way as for an" << std::endl;
+        ss << "interactive session." << std::endl;
         ss << std::endl;
         ss << "Options:" << std::endl;
         ss << "    -styled       Output nicely formatted JSON (default is fast non-human friendly JSON)" << std::endl;
+        ss << "    -stream <format>" << std::endl;
+        ss << "                  Write the hits as they are found followed by the summary, the format is" << std::endl;
+        ss << "                  'ndjson' (one JSON object per line) or 'binary' (16 byte records)" << std::endl;
+        ss << "    -profile      Add the search counters and phase times to the result of each query ('profile'" << std::endl;
+        ss << "                  attribute), this requires Helium to be built with ENABLE_INSTRUMENTATION" << std::endl;
+        ss << "    -batch        Search all queries in the <query> file, the -timeout applies to each query" << std::endl;
+        ss << "    -filter <filter_file>" << std::endl;
+        ss << "                  Also screen using the property filters created by the filter tool" << std::endl;
+        ss << "    -timeout <ms> Stop verifying the candidates of a query after this number of milliseconds," << std::endl;
+        ss << "                  the result is marked as partial (default is no timeout)" << std::endl;
+        ss << "    -candidate_timeout <ms>" << std::endl;
+        ss << "                  Skip candidates that take longer than this number of milliseconds to" << std::endl;
+        ss << "                  verify, these are listed in 'timed_out' (default is no timeout)" << std::endl;
+#ifdef HAVE_CPP11
+        ss << "    -mt           Screen the fingerprints and verify the candidates using multiple threads" << std::endl;
+        ss << "                  (default is not to use threads), the molecule records of the candidates" << std::endl;
+        ss << "                  are prefetched while the remaining fingerprints are being screened" << std::endl;
+#endif
+#ifdef HAVE_OPENCL
+        ss << "    -opencl       Screen the fingerprints on an OpenCL device (the compiled program is cached" << std::endl;
+        ss << "                  in $HELIUM_OPENCL_CACHE if set)" << std::endl;
+        ss << "    -platform <n> The OpenCL platform to use (default is to use platform 1)" << std::endl;
+        ss << "    -device <n>   The OpenCL device to use (default is to use device 1)" << std::endl;
+#endif
         ss << std::endl;
         return ss.str();
       }
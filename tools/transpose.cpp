@@ -41,44 +41,84 @@ namespace Helium {
   class TransposeTool : public HeliumTool
   {
     public:
+      /**
+       * Write the fingerprints and the JSON header to the output file.
+       *
+       * @return True if the header was written successfully.
+       */
+      template<typename InputFileType, typename OutputFileType>
+      static bool write_columns(InputFileType &inputFile, OutputFileType &outputFile, Json::Value &data)
+      {
+        // process fingerprints
+        for (unsigned int i = 0; i < inputFile.numFingerprints(); ++i) {
+          Word *fingerprint = inputFile.fingerprint(i);
+          outputFile.writeFingerprint(fingerprint);
+        }
+
+        // store the column counts for ordering the screen by selectivity
+        Json::Value counts(Json::arrayValue);
+        for (unsigned int i = 0; i < inputFile.numBits(); ++i)
+          counts.append(outputFile.columnCounts()[i]);
+        data["column_counts"] = counts;
+
+        // write JSON header
+        Json::StyledWriter writer;
+        return outputFile.writeHeader(writer.write(data));
+      }
+
       /**
        * Perform tool action.
        */
       int run(int argc, char**argv)
       {
-        ParseArgs args(argc, argv, ParseArgs::Args(), ParseArgs::Args("in_file", "out_file"));
+        ParseArgs args(argc, argv, ParseArgs::Args("-compressed", "-stripe(number)"), ParseArgs::Args("in_file", "out_file"));
+        // optional arguments
+        const bool compressed = args.IsArg("-compressed");
+        const int stripeSize = args.IsArg("-stripe") ? args.GetArgInt("-stripe", 0) : 1048576;
         // required arguments
         std::string inFile = args.GetArgString("in_file");
         std::string outFile = args.GetArgString("out_file");
 
-        // open input file
-        InMemoryRowMajorFingerprintStorage inputFile;
+        if (stripeSize < 0) {
+          std::cerr << "Invalid stripe size" << std::endl;
+          return -1;
+        }
+
+        // open input file (memory mapped, only the current stripe needs to be resident)
+        MemoryMappedRowMajorFingerprintStorage inputFile;
         try {
-          inputFile.load(inFile);
+          inputFile.load(inFile, SequentialAdvice);
         } catch (const std::exception &e) {
           std::cerr << e.what() << std::endl;
           return -1;
         }
 
-        // open output file
-        ColumnMajorFingerprintOutputFile outputFile(outFile, inputFile.numBits(), inputFile.numFingerprints());
-
-        // process fingerprints
-        for (unsigned int i = 0; i < inputFile.numFingerprints(); ++i) {
-          Word *fingerprint = inputFile.fingerprint(i);
-          outputFile.writeFingerprint(fingerprint);
-        }
-
         // create JSON header
         std::string json = inputFile.header();
         Json::Reader reader;
         Json::Value data;
         reader.parse(json, data);
-        data["order"] = "column-major";
+        remove_fingerprint_statistics(data);
+        data["order"] = compressed ? "compressed-column-major" : "column-major";
 
-        // write JSON header
-        Json::StyledWriter writer;
-        outputFile.writeHeader(writer.write(data));
+        bool ok;
+        try {
+          if (compressed) {
+            CompressedColumnMajorFingerprintOutputFile outputFile(outFile, inputFile.numBits(), inputFile.numFingerprints());
+            ok = write_columns(inputFile, outputFile, data);
+          } else {
+            ColumnMajorFingerprintOutputFile outputFile(outFile, inputFile.numBits(), inputFile.numFingerprints(), stripeSize);
+            ok = write_columns(inputFile, outputFile, data);
+          }
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          return -1;
+        }
+
+        if (!ok) {
+          std::cerr << "Could not write file " << outFile << std::endl;
+          return -1;
+        }
 
         return 0;
       }
@@ -96,7 +136,12 @@ namespace Helium {
       std::string usage(const std::string &command) const
       {
         std::stringstream ss;
-        ss << "Usage: " << command << " <in_file> <out_file>" << std::endl;
+        ss << "Usage: " << command << " [options] <in_file> <out_file>" << std::endl;
+        ss << std::endl;
+        ss << "Options:" << std::endl;
+        ss << "    -compressed       Write compressed columns (Roaring bitmaps) for sparse fingerprints" << std::endl;
+        ss << "    -stripe <n>       The number of fingerprints transposed in memory at a time, 0 to keep" << std::endl;
+        ss << "                      all columns in memory (default is 1048576)" << std::endl;
         ss << std::endl;
         return ss.str();
       }